@@ -0,0 +1,629 @@
+#include "src/utils.h"
+#include "src/nonce_allocator.h"
+#include "randomx/randomx.h"
+#include "randomx/configuration.h"
+#include "randomx/blake2/blake2.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Conformance and throughput matrix over every RandomX configuration this
+// build and CPU support: each Blake2b compression function must give the
+// reference digests, each Argon2 implementation must fill the same cache,
+// and every mode (light, medium, fast) x VM (interpreter, JIT, secure JIT) x
+// AES (hardware, table, compact) combination must give the known answers and
+// the same hashes as the reference (light, interpreter, table AES) on a set
+// of generated headers. Each combination's single-thread hashrate goes in
+// the same table, so a new kernel gets its correctness gate and its speed
+// comparison in one run.
+//
+//   backend_matrix [--modes light,medium,fast] [--seconds S]
+//
+// Fast mode builds a 2GB dataset per key with every hardware thread; leave
+// it out of --modes for a quick run. Last, randomx_search_nonce must find
+// the same nonces and hashes as hashing them one by one, in every mode and
+// VM, and so must randomx_search_nonce_midstate, before and after an nTime
+// change. Exits 1 on any mismatch.
+
+struct KnownAnswer {
+    const char* key;
+    const char* input;  // Text, or hex if hex is set
+    bool hex;
+    const char* expected;
+};
+
+static const KnownAnswer KNOWN_ANSWERS[] = {
+    // The RandomX reference vectors (randomx/tests)
+    {"test key 000", "This is a test", false,
+     "639183aae1bf4c9a35884cb46b09cad9175f04efd7684e7262a0ac1c2f0b4e3f"},
+    {"test key 000", "Lorem ipsum dolor sit amet", false,
+     "300a0adb47603dedb42228ccb2b211104f4da45af709cd7547cd049e9489c969"},
+    {"test key 000", "sed do eiusmod tempor incididunt ut labore et dolore magna aliqua", false,
+     "c36d4ed4191e617309867ed66a443be4075014e2b061bcdaf9ce7b721d2b77a8"},
+    {"test key 001", "sed do eiusmod tempor incididunt ut labore et dolore magna aliqua", false,
+     "e9ff4503201c0c2cca26d285c93ae883f9b1d30c9eb240b820756f2d5a7905fc"},
+    {"test key 001",
+     "0b0b98bea7e805e0010a2126d287a2a0cc833d312cb786385a7c2f9de69d25537f584a9bc9977b00000000666fd8753bf61a8631f12984e3fd44f4014eca629276817b56f32e9b68bd82f416",
+     true, "c56414121acda1713c2f2a819d8ae38aed7c80c35c2a769298d34f03833cd5f1"},
+    // Juno Cash block 1583 (see verify_block_1583)
+    {"ZcashRandomXPoW",
+     "0400000017aaf427912826953a63852eb244c4f6a54ea619052307f5c30046ece39ed3238e4f3e67f229791c86e5ea92c441faa454738f5fcfb0a023136bded20c0156cff542b9ac32e77aabc1a4d592ef36590226a37e5685d20294d7b699aa88d39cbf1166ec68a8da091f62125ab280c1169d136b8015bcce9778275329907528cd868c027781204b0000",
+     true, "4268bf0d59a72f3f086020274dcc869164c092442ecc52246d6e760b28a80500"},
+};
+
+static const char* const KEYS[] = {"test key 000", "test key 001", "ZcashRandomXPoW"};
+
+// Generated headers per key, compared against the reference configuration
+static const int GENERATED_INPUTS = 8;
+static const size_t HEADER_SIZE = 140;
+
+// Nonce searches run over this many nonces of the block 1583 header
+static const int SEARCH_HASHES = 8;
+static const size_t NONCE_OFFSET = 108;
+static const size_t TIME_OFFSET = 100;
+
+// Medium mode keeps this fraction of the dataset resident: small, to keep
+// the build quick, but hashes still read both resident and computed items
+static const unsigned MEDIUM_DIVISOR = 64;
+
+enum Mode { MODE_LIGHT, MODE_MEDIUM, MODE_FAST, MODES };
+static const char* const MODE_NAMES[MODES] = {"light", "medium", "fast"};
+
+struct VmKind {
+    const char* name;
+    randomx_flags flags;
+};
+
+struct AesKind {
+    const char* name;
+    const char* soft_aes;  // randomx_set_soft_aes name, null for hardware AES
+};
+
+struct Argon2Kind {
+    const char* name;
+    randomx_flags flags;
+};
+
+// One key's caches and datasets, plus the inputs hashed under it
+struct KeyState {
+    const char* key;
+    randomx_cache* cache;
+    randomx_cache* jit_cache;  // Same key, with JIT-compiled SuperscalarHash
+    randomx_dataset* partial;
+    randomx_dataset* dataset;
+    std::vector<std::vector<uint8_t>> inputs;
+    std::vector<std::string> expected;  // Known answer, or empty for a generated input
+    std::vector<std::string> reference;
+};
+
+// Blake2b: the RFC 7693 "abc" vector, then digests of every input length
+// over a few blocks, at several output lengths, and a long (Argon2 H') output
+static const char* const BLAKE2B_ABC =
+    "ba80a53f981c4d0d6a2797b69f12f6e94c212f14685ac4b74b12bb6fdbffa2d1"
+    "7d87c5392aab792dc252d5de4533cc9518d38aa8dbf1925ab92386edd4009923";
+static const size_t BLAKE2B_MAX_INPUT = 3 * BLAKE2B_BLOCKBYTES + 1;
+
+static std::vector<std::string> blake2b_digests(const std::vector<uint8_t>& data) {
+    std::vector<std::string> digests;
+    uint8_t out[1024];
+    for (size_t len = 0; len <= BLAKE2B_MAX_INPUT; len++) {
+        for (size_t outlen : {(size_t)32, (size_t)64}) {
+            blake2b(out, outlen, data.data(), len, nullptr, 0);
+            digests.push_back(utils::bytes_to_hex(out, outlen));
+        }
+    }
+    blake2b_long(out, sizeof(out), data.data(), 72);
+    digests.push_back(utils::bytes_to_hex(out, sizeof(out)));
+    return digests;
+}
+
+static void init_dataset(randomx_dataset* dataset, randomx_cache* cache, unsigned long items) {
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        unsigned long start = items * t / threads;
+        unsigned long count = items * (t + 1) / threads - start;
+        workers.emplace_back(randomx_init_dataset, dataset, cache, start, count);
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+static std::string hash_hex(randomx_vm* vm, const std::vector<uint8_t>& input) {
+    uint8_t hash[RANDOMX_HASH_SIZE];
+    randomx_calculate_hash(vm, input.data(), input.size(), hash);
+    return utils::bytes_to_hex(hash, sizeof(hash));
+}
+
+// A VM for one mode on one key, null if the mode has no dataset
+static randomx_vm* create_vm(int mode, randomx_flags flags, KeyState& state) {
+    if (mode == MODE_FAST) {
+        return state.dataset ? randomx_create_vm((randomx_flags)(flags | RANDOMX_FLAG_FULL_MEM), nullptr, state.dataset)
+                             : nullptr;
+    }
+    randomx_cache* cache = (flags & RANDOMX_FLAG_JIT) ? state.jit_cache : state.cache;
+    randomx_vm* vm = randomx_create_vm(flags, cache, nullptr);
+    if (vm && mode == MODE_MEDIUM) {
+        if (!state.partial) {
+            randomx_destroy_vm(vm);
+            return nullptr;
+        }
+        randomx_vm_set_partial_dataset(vm, state.partial);
+    }
+    return vm;
+}
+
+// A nonce search entry point bound to its VM and header: (nonce,
+// iterations, target, hash, hash count) -> found
+typedef std::function<int(uint8_t*, uint64_t, const uint8_t*, uint8_t*, uint64_t*)> Search;
+
+// Adds 1 to the whole nonce, or from byte first on to the 64-bit counter there
+static void add_one(uint8_t* nonce, size_t first) {
+    const size_t end = first ? first + 8 : RANDOMX_NONCE_SIZE;
+    for (size_t i = first; i < end && ++nonce[i] == 0; i++) {
+    }
+}
+
+static void subtract_one(uint8_t* number, size_t size) {
+    for (size_t i = 0; i < size && number[i]-- == 0; i++) {
+    }
+}
+
+// 256-bit little-endian a < b
+static bool less_than(const uint8_t* a, const uint8_t* b) {
+    for (int i = RANDOMX_HASH_SIZE - 1; i >= 0; i--) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i];
+        }
+    }
+    return false;
+}
+
+// What a search must find: SEARCH_HASHES hashes computed one at a time,
+// and the nonces from the start on (one more, for where a miss leaves off)
+struct SearchReference {
+    std::vector<std::vector<uint8_t>> nonces;
+    std::vector<std::vector<uint8_t>> hashes;
+};
+
+static SearchReference search_reference(randomx_vm* vm, std::vector<uint8_t> header, size_t first) {
+    SearchReference reference;
+    uint8_t* nonce = header.data() + NONCE_OFFSET;
+    for (int i = 0; i <= SEARCH_HASHES; i++) {
+        reference.nonces.emplace_back(nonce, nonce + RANDOMX_NONCE_SIZE);
+        if (i < SEARCH_HASHES) {
+            std::vector<uint8_t> hash(RANDOMX_HASH_SIZE);
+            randomx_calculate_hash(vm, header.data(), header.size(), hash.data());
+            reference.hashes.push_back(hash);
+        }
+        add_one(nonce, first);
+    }
+    return reference;
+}
+
+// Runs a search from nonce start of the reference and checks it finds the
+// first hash at or below the target within the iterations, with its nonce
+// and the hash count up to it, or else counts every iteration and leaves
+// off at the next nonce. A reference with fewer hashes is a nonce range that
+// ends there: the search must stop at its end.
+static bool search_matches(const Search& search, const SearchReference& reference, int start, int iterations,
+                           const std::vector<uint8_t>& target) {
+    const int end = std::min(start + iterations, (int)reference.hashes.size());
+    int hit = -1;
+    for (int i = start; i < end && hit < 0; i++) {
+        if (!less_than(target.data(), reference.hashes[i].data())) {
+            hit = i;
+        }
+    }
+    std::vector<uint8_t> nonce = reference.nonces[start];
+    std::vector<uint8_t> hash(RANDOMX_HASH_SIZE);
+    uint64_t done = 0;
+    const int found = search(nonce.data(), iterations, target.data(), hash.data(), &done);
+    if (hit >= 0) {
+        return found == 1 && nonce == reference.nonces[hit] && hash == reference.hashes[hit] &&
+               done == (uint64_t)(hit - start + 1);
+    }
+    return found == 0 && nonce == reference.nonces[end] && done == (uint64_t)(end - start);
+}
+
+// Every hash lower than all before it is planted as the target: the search
+// must stop on it, miss a target one lower, and stop short of it when the
+// iterations (the miner's poll interval) run out first. Then a hit on the
+// second of two consecutive nonces, each hash found from its own nonce (odd
+// starts included), and an odd number of iterations with a target nothing
+// meets. First, though, searches that pick up where the last one left off,
+// as the miner polls, so the library carries its pipeline over: a hit on
+// every nonce from 1 on, then from 0 misses and hits in turn.
+static void check_search(const Search& search, const SearchReference& reference, unsigned& checked,
+                         unsigned& mismatches) {
+    auto expect = [&](bool ok) {
+        checked++;
+        mismatches += ok ? 0 : 1;
+    };
+    for (int i = 1; i < SEARCH_HASHES; i++) {
+        expect(search_matches(search, reference, i, std::min(2, SEARCH_HASHES - i), reference.hashes[i]));
+    }
+    for (int i = 0, step = 1; i < SEARCH_HASHES; step = step % 2 + 1) {
+        expect(search_matches(search, reference, i, 1, reference.hashes[i]));
+        if (++i < SEARCH_HASHES) {
+            const int iterations = std::min(step, SEARCH_HASHES - i);
+            expect(search_matches(search, reference, i, iterations, std::vector<uint8_t>(RANDOMX_HASH_SIZE)));
+            i += iterations;
+        }
+    }
+    const std::vector<uint8_t>* lowest = nullptr;
+    for (int i = 0; i < SEARCH_HASHES; i++) {
+        const std::vector<uint8_t>& planted = reference.hashes[i];
+        if (lowest && !less_than(planted.data(), lowest->data())) {
+            continue;
+        }
+        lowest = &planted;
+        expect(search_matches(search, reference, 0, SEARCH_HASHES, planted));
+        std::vector<uint8_t> below = planted;
+        subtract_one(below.data(), below.size());
+        expect(search_matches(search, reference, 0, i + 1, below));
+        if (i > 0) {
+            expect(search_matches(search, reference, 0, i, planted));
+        }
+    }
+    for (int i = 1; i < SEARCH_HASHES; i++) {
+        if (less_than(reference.hashes[i].data(), reference.hashes[i - 1].data())) {
+            expect(search_matches(search, reference, i - 1, SEARCH_HASHES - (i - 1), reference.hashes[i]));
+            break;
+        }
+    }
+    for (int i = 0; i < SEARCH_HASHES; i++) {
+        expect(search_matches(search, reference, i, SEARCH_HASHES - i, reference.hashes[i]));
+    }
+    expect(search_matches(search, reference, 0, SEARCH_HASHES - 1, std::vector<uint8_t>(RANDOMX_HASH_SIZE)));
+}
+
+// The last nonces of a midstate counter: polled one at a time, as light
+// workers do, then from each of them with iterations to spare, missing and
+// hitting on the last one
+static void check_range_end(const Search& search, const SearchReference& reference, unsigned& checked,
+                            unsigned& mismatches) {
+    auto expect = [&](bool ok) {
+        checked++;
+        mismatches += ok ? 0 : 1;
+    };
+    const int left = (int)reference.hashes.size();
+    const std::vector<uint8_t> zero(RANDOMX_HASH_SIZE);
+    for (int i = 0; i < left; i++) {
+        expect(search_matches(search, reference, i, 1, zero));
+    }
+    for (int i = 0; i < left; i++) {
+        expect(search_matches(search, reference, i, left - i + 2, zero));
+        expect(search_matches(search, reference, i, left - i + 2, reference.hashes[left - 1]));
+    }
+}
+
+static std::string cache_digest(randomx_cache* cache) {
+    // FNV-1a over the cache memory: enough to tell two fills apart
+    const uint8_t* memory = static_cast<const uint8_t*>(randomx_get_cache_memory(cache));
+    uint64_t digest = 1469598103934665603ull;
+    for (size_t i = 0; i < RANDOMX_ARGON_MEMORY * 1024ull; i++) {
+        digest = (digest ^ memory[i]) * 1099511628211ull;
+    }
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", (unsigned long long)digest);
+    return text;
+}
+
+static bool parse_modes(const std::string& list, bool (&enabled)[MODES]) {
+    std::fill(enabled, enabled + MODES, false);
+    std::istringstream in(list);
+    std::string name;
+    while (std::getline(in, name, ',')) {
+        bool known = false;
+        for (int mode = 0; mode < MODES; mode++) {
+            if (name == MODE_NAMES[mode]) {
+                enabled[mode] = known = true;
+            }
+        }
+        if (!known) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::setvbuf(stdout, nullptr, _IOLBF, 0);
+    bool modes[MODES] = {true, true, true};
+    double seconds = 1.0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--modes" && i + 1 < argc && parse_modes(argv[i + 1], modes)) {
+            i++;
+        } else if (arg == "--seconds" && i + 1 < argc && std::atof(argv[i + 1]) > 0) {
+            seconds = std::atof(argv[++i]);
+        } else {
+            std::cerr << "Usage: backend_matrix [--modes light,medium,fast] [--seconds S]" << std::endl;
+            return 2;
+        }
+    }
+
+    const randomx_flags cpu_flags = randomx_get_flags();
+    std::vector<VmKind> vms = {{"interpreter", RANDOMX_FLAG_DEFAULT}};
+    if (cpu_flags & RANDOMX_FLAG_JIT) {
+        vms.push_back({"jit", RANDOMX_FLAG_JIT});
+        vms.push_back({"jit-secure", (randomx_flags)(RANDOMX_FLAG_JIT | RANDOMX_FLAG_SECURE)});
+    }
+    // The reference configuration (table AES) comes first
+    std::vector<AesKind> aes_kinds = {{"table", "table"}, {"compact", "compact"}};
+    if (cpu_flags & RANDOMX_FLAG_HARD_AES) {
+        aes_kinds.push_back({"hardware", nullptr});
+    }
+    const Argon2Kind argon2_kinds[] = {
+        {"reference", RANDOMX_FLAG_DEFAULT},
+        {"ssse3", RANDOMX_FLAG_ARGON2_SSSE3},
+        {"avx2", RANDOMX_FLAG_ARGON2_AVX2},
+        {"avx512", RANDOMX_FLAG_ARGON2_AVX512},
+    };
+    bool failed = false;
+
+    // Blake2b: every compression function must match the reference
+    std::printf("%-12s %-10s %12s\n", "blake2b", "result", "MB/s");
+    const std::string selected_blake2b = randomx_get_blake2b();
+    std::vector<uint8_t> blake2b_data(BLAKE2B_MAX_INPUT);
+    for (size_t i = 0; i < blake2b_data.size(); i++) blake2b_data[i] = static_cast<uint8_t>(i * 7 + 1);
+    std::vector<std::string> reference_blake2b;
+    for (const char* name : {"ref", "avx2", "avx512"}) {
+        if (!randomx_set_blake2b(name)) {
+            std::printf("%-12s %-10s\n", name, "n/a");
+            continue;
+        }
+        uint8_t abc[BLAKE2B_OUTBYTES];
+        blake2b(abc, sizeof(abc), "abc", 3, nullptr, 0);
+        std::vector<std::string> digests = blake2b_digests(blake2b_data);
+        if (reference_blake2b.empty()) {
+            reference_blake2b = digests;
+        }
+        bool same = utils::bytes_to_hex(abc, sizeof(abc)) == BLAKE2B_ABC && digests == reference_blake2b;
+        failed |= !same;
+        // Throughput on whole blocks, as in the input hash of a long header
+        std::vector<uint8_t> bulk(64 * 1024);
+        uint8_t digest[BLAKE2B_OUTBYTES];
+        size_t bytes = 0;
+        double elapsed = 0;
+        auto start = std::chrono::steady_clock::now();
+        do {
+            blake2b(digest, sizeof(digest), bulk.data(), bulk.size(), nullptr, 0);
+            bulk[0] = digest[0];
+            bytes += bulk.size();
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (elapsed < seconds / 4);
+        std::printf("%-12s %-10s %12.1f\n", name, same ? "ok" : "MISMATCH", bytes / elapsed / 1e6);
+    }
+    randomx_set_blake2b(selected_blake2b.c_str());
+    std::printf("\n");
+
+    // Argon2: every implementation must fill the cache the reference does
+    std::printf("%-12s %-10s %12s  %s\n", "argon2", "result", "fill ms", "digest");
+    std::string reference_digest;
+    for (const Argon2Kind& argon2 : argon2_kinds) {
+        randomx_cache* cache = randomx_alloc_cache(argon2.flags);
+        if (!cache) {
+            std::printf("%-12s %-10s\n", argon2.name, "n/a");
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        randomx_fill_cache(cache, KEYS[0], std::strlen(KEYS[0]));
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::string digest = cache_digest(cache);
+        if (reference_digest.empty()) {
+            reference_digest = digest;
+        }
+        bool same = digest == reference_digest;
+        failed |= !same;
+        std::printf("%-12s %-10s %12.1f  %s\n", argon2.name, same ? "ok" : "MISMATCH", ms, digest.c_str());
+        randomx_release_cache(cache);
+    }
+
+    // Caches, datasets and inputs per key
+    std::mt19937 rng(1583);
+    std::vector<KeyState> keys;
+    for (const char* key : KEYS) {
+        KeyState state = {key, nullptr, nullptr, nullptr, nullptr, {}, {}, {}};
+        state.cache = randomx_alloc_cache((randomx_flags)(cpu_flags & RANDOMX_FLAG_ARGON2));
+        randomx_init_cache(state.cache, key, std::strlen(key));
+        if (cpu_flags & RANDOMX_FLAG_JIT) {
+            state.jit_cache = randomx_alloc_cache((randomx_flags)(RANDOMX_FLAG_JIT | (cpu_flags & RANDOMX_FLAG_ARGON2)));
+            randomx_init_cache(state.jit_cache, key, std::strlen(key));
+        }
+        const unsigned long items = randomx_dataset_item_count();
+        if (modes[MODE_MEDIUM]) {
+            state.partial = randomx_alloc_partial_dataset(RANDOMX_FLAG_DEFAULT, -1, items / MEDIUM_DIVISOR);
+            if (state.partial) {
+                init_dataset(state.partial, state.cache, items / MEDIUM_DIVISOR);
+            }
+        }
+        if (modes[MODE_FAST]) {
+            std::cout << "Building the dataset for \"" << key << "\"..." << std::endl;
+            state.dataset = randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT);
+            if (state.dataset) {
+                init_dataset(state.dataset, state.cache, items);
+            }
+        }
+        for (const KnownAnswer& answer : KNOWN_ANSWERS) {
+            if (std::strcmp(answer.key, key) != 0) continue;
+            state.inputs.push_back(answer.hex ? utils::hex_to_bytes(answer.input)
+                                              : std::vector<uint8_t>(answer.input, answer.input + std::strlen(answer.input)));
+            state.expected.push_back(answer.expected);
+        }
+        for (int i = 0; i < GENERATED_INPUTS; i++) {
+            std::vector<uint8_t> header(HEADER_SIZE);
+            for (auto& byte : header) byte = static_cast<uint8_t>(rng());
+            state.inputs.push_back(header);
+            state.expected.push_back(std::string());
+        }
+        keys.push_back(state);
+    }
+
+    // Hashes: each combination against the known answers and the reference
+    std::printf("\n%-8s %-12s %-9s %-10s %10s %12s\n", "mode", "vm", "aes", "result", "checked", "H/s");
+    for (int mode = 0; mode < MODES; mode++) {
+        if (!modes[mode]) continue;
+        for (const VmKind& vm_kind : vms) {
+            for (const AesKind& aes : aes_kinds) {
+                randomx_flags flags = vm_kind.flags;
+                if (aes.soft_aes) {
+                    randomx_set_soft_aes(aes.soft_aes);
+                } else {
+                    flags = (randomx_flags)(flags | RANDOMX_FLAG_HARD_AES);
+                }
+                unsigned checked = 0;
+                unsigned mismatches = 0;
+                bool available = true;
+                uint64_t hashes = 0;
+                double elapsed = 0;
+                for (KeyState& state : keys) {
+                    randomx_vm* vm = create_vm(mode, flags, state);
+                    if (!vm) {
+                        available = false;
+                        break;
+                    }
+                    const bool reference = mode == MODE_LIGHT && &vm_kind == &vms[0] && &aes == &aes_kinds[0];
+                    for (size_t i = 0; i < state.inputs.size(); i++) {
+                        std::string hash = hash_hex(vm, state.inputs[i]);
+                        if (reference) {
+                            state.reference.push_back(hash);
+                        }
+                        const std::string& want = !state.expected[i].empty() ? state.expected[i]
+                                                : i < state.reference.size() ? state.reference[i]
+                                                : hash;
+                        checked++;
+                        if (hash != want) {
+                            mismatches++;
+                        }
+                    }
+                    // Throughput on the first key only: every key costs the same
+                    if (&state == &keys[0]) {
+                        auto start = std::chrono::steady_clock::now();
+                        std::vector<uint8_t> input = state.inputs.back();
+                        do {
+                            hash_hex(vm, input);
+                            next_nonce(input.data() + NONCE_OFFSET);
+                            hashes++;
+                            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                        } while (elapsed < seconds);
+                    }
+                    randomx_destroy_vm(vm);
+                }
+                if (!available) {
+                    std::printf("%-8s %-12s %-9s %-10s\n", MODE_NAMES[mode], vm_kind.name, aes.name, "n/a");
+                    continue;
+                }
+                failed |= mismatches > 0;
+                std::printf("%-8s %-12s %-9s %-10s %10u %12.1f\n", MODE_NAMES[mode], vm_kind.name, aes.name,
+                            mismatches ? "MISMATCH" : "ok", checked, elapsed > 0 ? hashes / elapsed : 0.0);
+            }
+        }
+    }
+    randomx_set_soft_aes("auto");
+
+    // Nonce searches, starting two increments before a carry across two
+    // nonce bytes. The midstate search counts in nonce bytes 20-27 only,
+    // so its carry is across header bytes 128 and 129, and it runs again on
+    // the header with nTime moved on a second, as the miner rolls it, from a
+    // recomputed midstate, and at the end of the counter.
+    std::printf("\n%-8s %-12s %-16s %-10s %10s\n", "mode", "vm", "search", "result", "checked");
+    KeyState& block_key = keys.back();
+    std::vector<uint8_t> block_header = block_key.inputs[0];
+    block_header[NONCE_OFFSET] = 0xfe;
+    block_header[NONCE_OFFSET + 1] = 0xff;
+    const size_t midstate_first = RANDOMX_MIDSTATE_BLOCK - NONCE_OFFSET;
+    std::vector<uint8_t> midstate_header = block_key.inputs[0];
+    midstate_header[RANDOMX_MIDSTATE_BLOCK] = 0xfe;
+    midstate_header[RANDOMX_MIDSTATE_BLOCK + 1] = 0xff;
+    std::vector<uint8_t> rolled_header = midstate_header;
+    utils::write_le32(rolled_header.data() + TIME_OFFSET, utils::read_le32(rolled_header.data() + TIME_OFFSET) + 1);
+    // END_HASHES nonces short of the end of the counter, with the salt after
+    // it set: the search must not carry into it
+    const int END_HASHES = 3;
+    std::vector<uint8_t> end_header = midstate_header;
+    utils::write_le64(end_header.data() + NONCE_OFFSET + NONCE_COUNTER_OFFSET, ~0ull - (END_HASHES - 1));
+    end_header[NONCE_OFFSET + NONCE_SALT_TAIL_OFFSET] = 0x5a;
+    end_header[NONCE_OFFSET + NONCE_SALT_TAIL_OFFSET + 1] = 0xa5;
+    for (int mode = 0; mode < MODES; mode++) {
+        if (!modes[mode]) continue;
+        for (const VmKind& vm_kind : vms) {
+            randomx_vm* vm = create_vm(mode, (randomx_flags)(vm_kind.flags | (cpu_flags & RANDOMX_FLAG_HARD_AES)),
+                                       block_key);
+            if (!vm) {
+                std::printf("%-8s %-12s %-16s %-10s\n", MODE_NAMES[mode], vm_kind.name, "*", "n/a");
+                continue;
+            }
+            const SearchReference reference = search_reference(vm, block_header, 0);
+            const SearchReference midstate_reference = search_reference(vm, midstate_header, midstate_first);
+            const SearchReference rolled_reference = search_reference(vm, rolled_header, midstate_first);
+            const Search search = [&](uint8_t* nonce, uint64_t iterations, const uint8_t* target, uint8_t* hash,
+                                      uint64_t* done) {
+                return randomx_search_nonce(vm, block_header.data(), block_header.size(), NONCE_OFFSET, nonce,
+                                            iterations, target, hash, done);
+            };
+            // One header buffer, rolled in place between the two runs
+            std::vector<uint8_t> header;
+            uint8_t midstate[RANDOMX_MIDSTATE_SIZE];
+            const Search midstate_search = [&](uint8_t* nonce, uint64_t iterations, const uint8_t* target,
+                                               uint8_t* hash, uint64_t* done) {
+                return randomx_search_nonce_midstate(vm, midstate, header.data(), header.size(), NONCE_OFFSET,
+                                                     nonce, iterations, target, hash, done);
+            };
+            auto report = [&](const char* name, const Search& search, const SearchReference& reference) {
+                unsigned checked = 0;
+                unsigned mismatches = 0;
+                check_search(search, reference, checked, mismatches);
+                failed |= mismatches > 0;
+                std::printf("%-8s %-12s %-16s %-10s %10u\n", MODE_NAMES[mode], vm_kind.name, name,
+                            mismatches ? "MISMATCH" : "ok", checked);
+            };
+            report("search", search, reference);
+            header = midstate_header;
+            randomx_calculate_midstate(header.data(), header.size(), midstate);
+            report("midstate", midstate_search, midstate_reference);
+            // Leave the VM mid-pipeline at nonce 1 of the old header, where the
+            // rolled checks start: the new nTime must not be carried over
+            std::vector<uint8_t> primed = midstate_reference.nonces[0];
+            uint8_t primed_hash[RANDOMX_HASH_SIZE];
+            const std::vector<uint8_t> zero_target(RANDOMX_HASH_SIZE);
+            midstate_search(primed.data(), 1, zero_target.data(), primed_hash, nullptr);
+            std::memcpy(header.data() + TIME_OFFSET, rolled_header.data() + TIME_OFFSET, 4);
+            randomx_calculate_midstate(header.data(), header.size(), midstate);
+            report("midstate nTime", midstate_search, rolled_reference);
+            {
+                header = end_header;
+                randomx_calculate_midstate(header.data(), header.size(), midstate);
+                SearchReference end_reference = search_reference(vm, end_header, midstate_first);
+                end_reference.hashes.resize(END_HASHES);
+                end_reference.nonces.resize(END_HASHES + 1);
+                unsigned checked = 0;
+                unsigned mismatches = 0;
+                check_range_end(midstate_search, end_reference, checked, mismatches);
+                failed |= mismatches > 0;
+                std::printf("%-8s %-12s %-16s %-10s %10u\n", MODE_NAMES[mode], vm_kind.name, "midstate end",
+                            mismatches ? "MISMATCH" : "ok", checked);
+            }
+            randomx_destroy_vm(vm);
+        }
+    }
+
+    for (KeyState& state : keys) {
+        randomx_release_cache(state.cache);
+        if (state.jit_cache) randomx_release_cache(state.jit_cache);
+        if (state.partial) randomx_release_dataset(state.partial);
+        if (state.dataset) randomx_release_dataset(state.dataset);
+    }
+    std::cout << (failed ? "\nFAILED: some configurations disagree" : "\nAll configurations agree") << std::endl;
+    return failed ? 1 : 0;
+}
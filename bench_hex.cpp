@@ -0,0 +1,96 @@
+#include "src/utils.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Microbenchmark and cross-check for the hex codecs in utils: compares every
+// length up to 200 bytes (all SIMD tails) against a plain reference, checks
+// that each kind of invalid character is rejected, then times encode/decode
+// on sizes from a hash up to a full block.
+
+static std::string reference_encode(const std::vector<uint8_t>& data) {
+    std::string hex;
+    char digits[3];
+    for (uint8_t byte : data) {
+        std::snprintf(digits, sizeof(digits), "%02x", byte);
+        hex += digits;
+    }
+    return hex;
+}
+
+static bool check(std::mt19937& rng) {
+    for (size_t len = 0; len <= 200; len++) {
+        std::vector<uint8_t> data(len);
+        for (auto& byte : data) byte = static_cast<uint8_t>(rng());
+        std::string expected = reference_encode(data);
+
+        std::string hex(len * 2, '\0');
+        utils::hex_encode(data.data(), len, &hex[0]);
+        if (hex != expected) {
+            std::cerr << "encode mismatch at length " << len << std::endl;
+            return false;
+        }
+
+        // Mixed case must decode to the same bytes
+        for (size_t i = 0; i < hex.size(); i += 3) {
+            hex[i] = static_cast<char>(std::toupper(static_cast<unsigned char>(hex[i])));
+        }
+        std::vector<uint8_t> decoded(len);
+        if (!utils::hex_decode(hex.data(), len, decoded.data()) || decoded != data) {
+            std::cerr << "decode mismatch at length " << len << std::endl;
+            return false;
+        }
+
+        // Any single non-hex character, anywhere, must be rejected
+        for (int c = 0; c < 256 && len > 0; c++) {
+            if (std::isxdigit(c)) continue;
+            std::string bad = hex;
+            bad[rng() % bad.size()] = static_cast<char>(c);
+            if (utils::hex_decode(bad.data(), len, decoded.data())) {
+                std::cerr << "accepted invalid character " << c << " at length " << len << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template<typename F>
+static double time_ns_per_byte(size_t len, F f) {
+    size_t iterations = std::max<size_t>(1, (64u << 20) / std::max<size_t>(len, 1));
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        f();
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return elapsed / (static_cast<double>(iterations) * len);
+}
+
+int main() {
+    std::cout << "Hex codec: " << utils::hex_codec_name() << std::endl;
+    std::mt19937 rng(12345);
+    if (!check(rng)) {
+        return 1;
+    }
+    std::cout << "Cross-check against the reference: OK" << std::endl;
+
+    const size_t sizes[] = {32, 250, 4096, 2 * 1024 * 1024};
+    for (size_t len : sizes) {
+        std::vector<uint8_t> data(len);
+        for (auto& byte : data) byte = static_cast<uint8_t>(rng());
+        std::string hex(len * 2, '\0');
+        std::vector<uint8_t> decoded(len);
+        volatile bool ok = true;
+
+        double encode = time_ns_per_byte(len, [&]() { utils::hex_encode(data.data(), len, &hex[0]); });
+        double decode = time_ns_per_byte(len, [&]() { ok = utils::hex_decode(hex.data(), len, decoded.data()); });
+        std::printf("%9zu bytes: encode %.3f ns/byte (%.0f MB/s), decode %.3f ns/byte (%.0f MB/s)\n",
+                    len, encode, 1000.0 / encode, decode, 1000.0 / decode);
+    }
+    return 0;
+}
@@ -0,0 +1,336 @@
+#include "src/utils.h"
+#include "src/miner.h"
+#include "src/nonce_allocator.h"
+#include "src/template_parser.h"
+#include <json/json.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Microbenchmarks of juno-miner's own code on fixed inputs: the target
+// checks, hex codecs, nonce step, block serialization and template
+// parsing on a full-size synthetic getblocktemplate answer. Every input
+// comes from a fixed seed, so two runs (or two commits) time the same work.
+//
+//   juno-bench [--filter TEXT] [--seconds S] [--json FILE] [--baseline FILE] [--max-regression PCT]
+//
+// --json writes the results as a baseline; --baseline compares against one
+// and --max-regression fails the run if any case got slower by more than PCT
+// percent.
+
+// Keep the compiler from dropping a result nobody reads
+template<typename T>
+static inline void keep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct BenchResult {
+    std::string name;
+    double ns_per_op;
+    size_t bytes_per_op;  // Input bytes per operation, 0 where throughput means nothing
+    uint64_t iterations;
+};
+
+// Best of five batches of about seconds / 5 each, after doubling the batch
+// until it runs for a few milliseconds
+template<typename F>
+static BenchResult run_case(const std::string& name, size_t bytes, double seconds, F f) {
+    typedef std::chrono::steady_clock Clock;
+    auto time_batch = [&](uint64_t count) {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < count; i++) {
+            f();
+        }
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    };
+    uint64_t batch = 1;
+    double ns = time_batch(batch);
+    while (ns < 2e6 && batch < (1ull << 40)) {
+        batch *= 2;
+        ns = time_batch(batch);
+    }
+    const int BATCHES = 5;
+    batch = std::max<uint64_t>(1, (uint64_t)(batch * (seconds * 1e9 / BATCHES) / std::max(ns, 1.0)));
+    BenchResult result{name, 0, bytes, 0};
+    for (int b = 0; b < BATCHES; b++) {
+        double per_op = time_batch(batch) / batch;
+        if (b == 0 || per_op < result.ns_per_op) {
+            result.ns_per_op = per_op;
+        }
+        result.iterations += batch;
+    }
+    return result;
+}
+
+// A getblocktemplate answer near the 2MB block limit: 3000 transactions of
+// 600 bytes with the fields a node sends beside their data
+static std::string synthetic_template_json(std::mt19937& rng) {
+    auto random_hex = [&rng](size_t bytes) {
+        std::vector<uint8_t> data(bytes);
+        for (auto& byte : data) byte = static_cast<uint8_t>(rng());
+        return utils::bytes_to_hex(data.data(), data.size());
+    };
+    std::ostringstream json;
+    json << "{\"result\":{\"capabilities\":[\"proposal\"],\"version\":4,"
+         << "\"previousblockhash\":\"" << random_hex(32) << "\","
+         << "\"defaultroots\":{\"merkleroot\":\"" << random_hex(32) << "\",\"chainhistoryroot\":\""
+         << random_hex(32) << "\",\"authdataroot\":\"" << random_hex(32) << "\",\"blockcommitmentshash\":\""
+         << random_hex(32) << "\"},\"transactions\":[";
+    for (int i = 0; i < 3000; i++) {
+        json << (i ? "," : "") << "{\"data\":\"" << random_hex(600) << "\",\"hash\":\"" << random_hex(32)
+             << "\",\"authdigest\":\"" << random_hex(32) << "\",\"depends\":[],\"fee\":" << (1000 + i)
+             << ",\"sigops\":2}";
+    }
+    json << "],\"coinbasetxn\":{\"data\":\"" << random_hex(180) << "\",\"hash\":\"" << random_hex(32)
+         << "\",\"depends\":[],\"fee\":-3000000,\"sigops\":1,\"required\":true},"
+         << "\"longpollid\":\"" << random_hex(32) << "12345\",\"target\":\"" << std::string(4, '0')
+         << random_hex(30) << "\",\"mintime\":1700000000,\"mutable\":[\"time\",\"transactions\",\"prevblock\"],"
+         << "\"noncerange\":\"00000000ffffffff\",\"sigoplimit\":20000,\"sizelimit\":2000000,"
+         << "\"curtime\":1700000600,\"bits\":\"1d00ffff\",\"height\":2000000,"
+         << "\"randomxseedheight\":1998848,\"randomxseedhash\":\"" << random_hex(32) << "\"},"
+         << "\"error\":null,\"id\":1}";
+    return json.str();
+}
+
+static bool write_baseline(const std::string& path, const std::vector<BenchResult>& results) {
+    Json::Value root;
+    root["hex_codec"] = utils::hex_codec_name();
+    root["results"] = Json::Value(Json::objectValue);
+    for (const BenchResult& result : results) {
+        Json::Value& entry = root["results"][result.name];
+        entry["ns_per_op"] = result.ns_per_op;
+        entry["iterations"] = (Json::UInt64)result.iterations;
+        if (result.bytes_per_op) {
+            entry["bytes_per_op"] = (Json::UInt64)result.bytes_per_op;
+            entry["mb_per_s"] = result.bytes_per_op * 1e3 / result.ns_per_op;
+        }
+    }
+    std::ofstream out(path);
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "  ";
+    out << Json::writeString(writer, root) << std::endl;
+    return out.good();
+}
+
+static bool read_baseline(const std::string& path, std::map<std::string, double>& ns_per_op) {
+    std::ifstream in(path);
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    std::string errors;
+    if (!in || !Json::parseFromStream(builder, in, &root, &errors) || !root["results"].isObject()) {
+        return false;
+    }
+    for (const std::string& name : root["results"].getMemberNames()) {
+        ns_per_op[name] = root["results"][name]["ns_per_op"].asDouble();
+    }
+    return true;
+}
+
+static void usage() {
+    std::cerr << "Usage: juno-bench [--filter TEXT] [--seconds S] [--json FILE] [--baseline FILE]"
+                 " [--max-regression PCT]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::string filter;
+    std::string json_path;
+    std::string baseline_path;
+    double seconds = 0.5;
+    double max_regression = -1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 2;
+        }
+        if (arg == "--filter") {
+            filter = argv[++i];
+        } else if (arg == "--seconds") {
+            seconds = std::atof(argv[++i]);
+        } else if (arg == "--json") {
+            json_path = argv[++i];
+        } else if (arg == "--baseline") {
+            baseline_path = argv[++i];
+        } else if (arg == "--max-regression") {
+            max_regression = std::atof(argv[++i]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (seconds <= 0) {
+        usage();
+        return 2;
+    }
+    std::map<std::string, double> baseline;
+    if (!baseline_path.empty() && !read_baseline(baseline_path, baseline)) {
+        std::cerr << "Cannot read baseline " << baseline_path << std::endl;
+        return 2;
+    }
+
+    // Inputs
+    std::mt19937 rng(20240601);
+    const std::string template_json = synthetic_template_json(rng);
+    Json::Value template_response;
+    {
+        Json::CharReaderBuilder builder;
+        std::istringstream in(template_json);
+        std::string errors;
+        if (!Json::parseFromStream(builder, in, &template_response, &errors)) {
+            std::cerr << "Synthetic template is not JSON: " << errors << std::endl;
+            return 1;
+        }
+    }
+    const Json::Value& template_result = template_response["result"];
+    const BlockTemplate block_template = parse_block_template(template_result);
+    std::vector<std::string> txn_hex;
+    for (const Json::Value& txn : template_result["transactions"]) {
+        txn_hex.push_back(txn["data"].asString());
+    }
+    const std::string coinbase_hex = template_result["coinbasetxn"]["data"].asString();
+    std::vector<uint8_t> header = block_template.header_base;
+    std::vector<uint8_t> solution(32);
+    for (auto& byte : solution) byte = static_cast<uint8_t>(rng());
+
+    std::vector<std::vector<uint8_t>> hashes(1024, std::vector<uint8_t>(32));
+    for (auto& hash : hashes) {
+        for (auto& byte : hash) byte = static_cast<uint8_t>(rng());
+    }
+    std::vector<uint8_t> hash_32(32);
+    std::vector<uint8_t> block_bytes(2 * 1024 * 1024);
+    for (auto& byte : hash_32) byte = static_cast<uint8_t>(rng());
+    for (auto& byte : block_bytes) byte = static_cast<uint8_t>(rng());
+    const std::string hex_32 = utils::bytes_to_hex(hash_32.data(), hash_32.size());
+    const std::string hex_block = utils::bytes_to_hex(block_bytes.data(), block_bytes.size());
+
+    std::cout << "Hex codec: " << utils::hex_codec_name() << ", template " << template_json.size() / 1024
+              << " KB with " << txn_hex.size() << " transactions" << std::endl;
+
+    std::vector<BenchResult> results;
+    auto bench = [&](const std::string& name, size_t bytes, auto f) {
+        if (!filter.empty() && name.find(filter) == std::string::npos) {
+            return;
+        }
+        BenchResult result = run_case(name, bytes, seconds, f);
+        std::printf("%-36s %14.1f ns/op", name.c_str(), result.ns_per_op);
+        if (bytes) {
+            std::printf(" %9.0f MB/s", bytes * 1e3 / result.ns_per_op);
+        } else {
+            std::printf(" %14s", "");
+        }
+        auto old = baseline.find(name);
+        if (old != baseline.end() && old->second > 0) {
+            std::printf("  %+6.1f%% vs baseline", (result.ns_per_op / old->second - 1) * 100);
+        }
+        std::printf("\n");
+        results.push_back(result);
+    };
+
+    // Target checks, on a spread of hashes so the branch isn't always the same
+    size_t next_hash = 0;
+    const utils::TargetLimbs limbs = block_template.target_limbs;
+    bench("hash_meets_target/limbs", 0, [&]() {
+        bool ok = utils::hash_meets_target(hashes[next_hash++ & 1023].data(), limbs);
+        keep(ok);
+    });
+    bench("hash_meets_target/vector", 0, [&]() {
+        bool ok = utils::hash_meets_target(hashes[next_hash++ & 1023].data(), block_template.target);
+        keep(ok);
+    });
+    uint32_t bits = 0x1d00ffff;
+    bench("compact_to_target", 0, [&]() {
+        std::vector<uint8_t> target = utils::compact_to_target(bits);
+        keep(target);
+        bits ^= 0x00010000;
+    });
+
+    // Hex
+    bench("bytes_to_hex/32", 32, [&]() {
+        std::string hex = utils::bytes_to_hex(hash_32.data(), hash_32.size());
+        keep(hex);
+    });
+    bench("bytes_to_hex/2MB", block_bytes.size(), [&]() {
+        std::string hex = utils::bytes_to_hex(block_bytes.data(), block_bytes.size());
+        keep(hex);
+    });
+    bench("hex_to_bytes/32", 32, [&]() {
+        std::vector<uint8_t> bytes = utils::hex_to_bytes(hex_32);
+        keep(bytes);
+    });
+    bench("hex_to_bytes/2MB", block_bytes.size(), [&]() {
+        std::vector<uint8_t> bytes = utils::hex_to_bytes(hex_block);
+        keep(bytes);
+    });
+
+    // The worker's nonce step, at the unaligned header offset it has there
+    uint8_t hash_input[BLOCK_HEADER_SIZE] = {};
+    bench("next_nonce", 0, [&]() {
+        next_nonce(hash_input + NONCE_OFFSET);
+        keep(hash_input);
+    });
+
+    // Blocks: the legacy all-in-one serializer and the per-solution path
+    // that prepends a header to the body serialized with the template
+    bench("serialize_block/full", block_template.block_body_hex.size() / 2, [&]() {
+        std::string block = utils::serialize_block(header, solution, coinbase_hex, txn_hex);
+        keep(block);
+    });
+    bench("format_block/full", block_template.block_body_hex.size() / 2, [&]() {
+        std::string block = utils::format_block(header.data(), solution.data(), block_template.block_body_hex);
+        keep(block);
+    });
+
+    // Templates: from a parsed JSON document, from the text through a DOM,
+    // and streamed in 16KB chunks as the RPC client receives them
+    bench("parse_block_template/dom", template_json.size(), [&]() {
+        BlockTemplate parsed = parse_block_template(template_result);
+        keep(parsed);
+    });
+    bench("parse_block_template/text", template_json.size(), [&]() {
+        Json::CharReaderBuilder builder;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        Json::Value response;
+        std::string errors;
+        reader->parse(template_json.data(), template_json.data() + template_json.size(), &response, &errors);
+        BlockTemplate parsed = parse_block_template(response["result"]);
+        keep(parsed);
+    });
+    BlockTemplateParser parser;
+    bench("template_parser/stream", template_json.size(), [&]() {
+        parser.reset();
+        parser.reserve(template_json.size());
+        for (size_t offset = 0; offset < template_json.size(); offset += 16384) {
+            parser.feed(template_json.data() + offset, std::min<size_t>(16384, template_json.size() - offset));
+        }
+        BlockTemplate parsed;
+        bool ok = parser.finish(parsed);
+        keep(ok);
+        keep(parsed);
+    });
+
+    if (!json_path.empty() && !write_baseline(json_path, results)) {
+        std::cerr << "Cannot write " << json_path << std::endl;
+        return 1;
+    }
+    if (max_regression >= 0) {
+        for (const BenchResult& result : results) {
+            auto old = baseline.find(result.name);
+            if (old != baseline.end() && old->second > 0 &&
+                (result.ns_per_op / old->second - 1) * 100 > max_regression) {
+                std::cerr << result.name << " is more than " << max_regression << "% slower than the baseline"
+                          << std::endl;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
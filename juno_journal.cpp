@@ -0,0 +1,246 @@
+#include "src/telemetry_journal.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Exports telemetry journals (juno-miner --journal DIR) to CSV, one row
+// per record, oldest file first:
+//
+//   juno-journal [--type T[,T...]] [--since UNIX] [--until UNIX] [--output FILE] FILE|DIR...
+//
+// Columns: time (Unix seconds), type, thread (worker index, empty if none),
+// name, value, detail. What value and detail hold depends on the type:
+//   hashes       hashes in the interval, seconds it covers
+//   job_switch   the height switched to
+//   latency      milliseconds, name says what (switch.fetch, switch.total, ...)
+//   power        package watts
+//   temperature  degrees Celsius, name is the sensor
+//   rpc          milliseconds, "ok" or "failed" (plus "new connection")
+
+namespace fs = std::filesystem;
+
+struct Filter {
+    std::set<int> types;        // Empty = every type but names
+    double since = 0;
+    double until = 0;           // 0 = no end
+};
+
+static std::string csv_field(const std::string& text) {
+    if (text.find_first_of(",\"\n") == std::string::npos) {
+        return text;
+    }
+    std::string quoted = "\"";
+    for (char c : text) {
+        quoted += c == '"' ? std::string("\"\"") : std::string(1, c);
+    }
+    return quoted + "\"";
+}
+
+// Write one journal file's records; false if it isn't a journal
+static bool export_file(const std::string& path, const Filter& filter, std::ostream& out, uint64_t& rows,
+                        uint64_t& empty) {
+    std::ifstream in(path, std::ios::binary);
+    JournalRecord header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&header);
+    uint32_t version;
+    uint32_t record_size;
+    std::memcpy(&version, bytes + 8, sizeof(version));
+    std::memcpy(&record_size, bytes + 12, sizeof(record_size));
+    if (std::memcmp(bytes, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || version != JOURNAL_VERSION ||
+        record_size != sizeof(JournalRecord)) {
+        return false;
+    }
+
+    // Names are written into each file ahead of their first use in it
+    std::map<uint32_t, std::map<uint16_t, std::string>> parts;
+    auto name_of = [&](uint32_t id) {
+        auto it = parts.find(id);
+        if (it == parts.end()) {
+            return "#" + std::to_string(id);
+        }
+        std::string name;
+        for (const auto& part : it->second) {
+            name += part.second;
+        }
+        return name;
+    };
+
+    // Unwritten slots before the last record (the live file's unused end isn't counted)
+    uint64_t unwritten = 0;
+    std::vector<JournalRecord> records(4096);
+    while (in) {
+        in.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(JournalRecord));
+        const size_t count = (size_t)in.gcount() / sizeof(JournalRecord);
+        for (size_t i = 0; i < count; i++) {
+            const JournalRecord& record = records[i];
+            if (record.type == JOURNAL_EMPTY || record.type >= JOURNAL_TYPES) {
+                unwritten++;
+                continue;
+            }
+            empty += unwritten;
+            unwritten = 0;
+            if (record.type == JOURNAL_NAME) {
+                char text[17] = {};
+                std::memcpy(text, &record.a, 8);
+                std::memcpy(text + 8, &record.b, 8);
+                parts[record.value][record.thread] = text;
+                continue;
+            }
+            const double time = record.time_us / 1e6;
+            if ((!filter.types.empty() && !filter.types.count(record.type)) || time < filter.since ||
+                (filter.until > 0 && time >= filter.until)) {
+                continue;
+            }
+            std::string name;
+            std::ostringstream value;
+            std::string detail;
+            value.precision(9);
+            switch (record.type) {
+            case JOURNAL_HASHES:
+                value << record.a;
+                detail = std::to_string(record.b / 1e6);
+                break;
+            case JOURNAL_JOB_SWITCH:
+                value << record.value;
+                break;
+            case JOURNAL_LATENCY:
+                name = name_of(record.value);
+                value << record.a / 1e6;
+                break;
+            case JOURNAL_POWER:
+                value << record.a / 1e3;
+                break;
+            case JOURNAL_TEMPERATURE:
+                name = name_of(record.value);
+                value << (int64_t)record.a / 1e3;
+                break;
+            case JOURNAL_RPC:
+                name = name_of(record.value);
+                value << record.a / 1e3;
+                detail = (record.flags & JOURNAL_RPC_FAILED) ? "failed" : "ok";
+                if (record.flags & JOURNAL_RPC_CONNECTED) {
+                    detail += " new connection";
+                }
+                break;
+            }
+            char stamp[32];
+            std::snprintf(stamp, sizeof(stamp), "%.6f", time);
+            out << stamp << "," << JOURNAL_TYPE_NAMES[record.type] << ","
+                << (record.thread == JOURNAL_NO_THREAD ? std::string() : std::to_string(record.thread)) << ","
+                << csv_field(name) << "," << value.str() << "," << csv_field(detail) << "\n";
+            rows++;
+        }
+    }
+    return true;
+}
+
+static void usage() {
+    std::cerr << "Usage: juno-journal [--type T[,T...]] [--since UNIX] [--until UNIX] [--output FILE] FILE|DIR..."
+              << std::endl;
+    std::cerr << "Types: hashes, job_switch, latency, power, temperature, rpc" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    Filter filter;
+    std::string output;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            usage();
+            return 0;
+        }
+        if (arg.compare(0, 2, "--") == 0 && i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        if (arg == "--type") {
+            std::istringstream list(argv[++i]);
+            std::string type;
+            while (std::getline(list, type, ',')) {
+                int found = -1;
+                for (int t = JOURNAL_HASHES; t < JOURNAL_TYPES; t++) {
+                    if (type == JOURNAL_TYPE_NAMES[t]) {
+                        found = t;
+                    }
+                }
+                if (found < 0) {
+                    std::cerr << "Unknown type " << type << std::endl;
+                    usage();
+                    return 1;
+                }
+                filter.types.insert(found);
+            }
+        } else if (arg == "--since") {
+            filter.since = std::atof(argv[++i]);
+        } else if (arg == "--until") {
+            filter.until = std::atof(argv[++i]);
+        } else if (arg == "--output") {
+            output = argv[++i];
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage();
+            return 1;
+        } else if (fs::is_directory(arg)) {
+            std::vector<std::string> found;
+            std::error_code ec;
+            for (const fs::directory_entry& entry : fs::directory_iterator(arg, ec)) {
+                const std::string name = entry.path().filename().string();
+                if (name.compare(0, 8, "journal-") == 0 && entry.path().extension() == JOURNAL_EXTENSION) {
+                    found.push_back(entry.path().string());
+                }
+            }
+            // File names sort in the order they were written
+            std::sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) {
+        usage();
+        return 1;
+    }
+
+    std::ofstream file;
+    if (!output.empty()) {
+        file.open(output);
+        if (!file) {
+            std::cerr << "Cannot write " << output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = output.empty() ? std::cout : file;
+    out << "time,type,thread,name,value,detail\n";
+    uint64_t rows = 0;
+    uint64_t empty = 0;
+    int failed = 0;
+    for (const std::string& path : files) {
+        if (!export_file(path, filter, out, rows, empty)) {
+            std::cerr << path << ": not a juno-miner journal" << std::endl;
+            failed++;
+        }
+    }
+    out.flush();
+    if (!out) {
+        std::cerr << "Write failed" << std::endl;
+        return 1;
+    }
+    std::cerr << rows << " rows from " << files.size() - failed << " files";
+    if (empty) {
+        std::cerr << " (" << empty << " unwritten slots skipped)";
+    }
+    std::cerr << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,1172 @@
+#include "src/utils.h"
+#include "src/node_traffic.h"
+#include "src/switch_trace.h"
+#include <json/json.h>
+#include <algorithm>
+#include <cctype>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Load generator for the work proxy (juno-miner --proxy): thousands of
+// lightweight rigs speaking its stratum dialect from one epoll thread, each
+// logging in, taking jobs and submitting shares at a Poisson rate, with
+// reconnect storms on top. Optionally it is also the proxy's node (--node):
+// an HTTP JSON-RPC server answering from a TrafficReplay, either a
+// recording (--replay) or templates it synthesizes one block interval
+// apart, so it knows when each template left the node.
+//
+//   juno-loadgen --proxy HOST:PORT [--rigs N] [--connect-rate R] [--duration S]
+//                [--share-rate R] [--storm-every S] [--storm-fraction F]
+//                [--node HOST:PORT] [--replay FILE] [--replay-speed X]
+//                [--block-interval S] [--bits HEX] [--proxy-pid PID] [--json FILE]
+//   juno-loadgen --write-recording FILE [--blocks N] [--block-interval S] [--bits HEX]
+//
+// Reported: job push latency (the node sending a template to each rig
+// holding its job, with --node; otherwise the spread from the first rig to
+// get a job to each of the others), share and login round trips, and the
+// proxy's CPU time per rig-second and resident memory per rig from /proc
+// (the process listening on the proxy port if it runs here, or
+// --proxy-pid). The rigs connect once the proxy takes connections, so with
+// --node the proxy is started after the generator. Run the proxy with
+// --share-bits so the shares (which sit exactly on the job target) aren't
+// blocks.
+
+typedef std::chrono::steady_clock Clock;
+
+static std::atomic<bool> stop_requested(false);
+
+static void on_signal(int) {
+    stop_requested = true;
+}
+
+static double ms_between(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// ---------------------------------------------------------------------------
+// Fake upstream node
+
+// A recording of blocks templates one interval apart, in the --replay format
+static bool write_synthetic_recording(const std::string& path, unsigned int blocks, double interval_seconds,
+                                      const std::string& bits, std::string& error) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        error = "can't write " + path;
+        return false;
+    }
+    out << NODE_TRAFFIC_MAGIC << "\n";
+    const uint32_t first_height = 1000000;
+    const uint64_t now = utils::get_current_timestamp();
+    for (unsigned int i = 0; i < blocks; i++) {
+        const uint32_t height = first_height + i;
+        const uint64_t time_ms = (uint64_t)std::llround(i * interval_seconds * 1000.0);
+        char previous[65];
+        std::snprintf(previous, sizeof(previous), "%064x", height - 1);
+        std::ostringstream body;
+        body << "{\"result\":{\"version\":4,\"previousblockhash\":\"" << previous << "\","
+             << "\"defaultroots\":{\"merkleroot\":\"" << std::string(62, '1') << std::setw(2) << std::setfill('0')
+             << std::hex << (i & 0xff) << std::dec << "\",\"blockcommitmentshash\":\"" << std::string(64, '2') << "\"},"
+             << "\"transactions\":[],\"coinbasetxn\":{\"data\":\"0400008085202f89\"},"
+             << "\"curtime\":" << now + time_ms / 1000 << ",\"mintime\":" << now - 600 << ","
+             << "\"bits\":\"" << bits << "\",\"height\":" << height << ","
+             << "\"randomxseedheight\":0,\"randomxseedhash\":\"" << std::string(64, '0') << "\","
+             << "\"longpollid\":\"loadgen-" << height << "\"},\"error\":null,\"id\":1}";
+        const std::string text = body.str();
+        out << time_ms << " getblocktemplate 500 ok " << text.size() << "\n" << text << "\n";
+
+        std::ostringstream info;
+        info << "{\"result\":{\"chain\":\"test\",\"blocks\":" << height - 1 << ",\"bestblockhash\":\"" << previous
+             << "\"},\"error\":null,\"id\":1}";
+        out << time_ms << " getblockchaininfo 300 ok " << info.str().size() << "\n" << info.str() << "\n";
+        const std::string best = std::string("{\"result\":\"") + previous + "\",\"error\":null,\"id\":1}";
+        out << time_ms << " getbestblockhash 300 ok " << best.size() << "\n" << best << "\n";
+    }
+    if (!out) {
+        error = "can't write " + path;
+        return false;
+    }
+    return true;
+}
+
+// HTTP JSON-RPC server over a TrafficReplay, one thread per connection (the
+// proxy opens a handful). Notes when each template height first goes out.
+class ReplayNode {
+public:
+    explicit ReplayNode(TrafficReplay& replay) : replay_(replay), listen_fd_(-1), stop_(false) {}
+    ~ReplayNode() { stop(); }
+
+    bool listen(const std::string& address, std::string& error) {
+        listen_fd_ = utils::listen_tcp(address, error);
+        return listen_fd_ >= 0;
+    }
+
+    void start() {
+        accept_thread_ = std::thread(&ReplayNode::accept_loop, this);
+    }
+
+    void stop() {
+        stop_ = true;
+        if (accept_thread_.joinable()) {
+            accept_thread_.join();
+        }
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            threads.swap(connection_threads_);
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        if (listen_fd_ >= 0) {
+            close(listen_fd_);
+            listen_fd_ = -1;
+        }
+    }
+
+    // When the node first sent a template of height, false if it hasn't
+    bool released(uint32_t height, Clock::time_point& time) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = releases_.find(height);
+        if (it == releases_.end()) {
+            return false;
+        }
+        time = it->second;
+        return true;
+    }
+
+private:
+    TrafficReplay& replay_;
+    int listen_fd_;
+    std::atomic<bool> stop_;
+    std::thread accept_thread_;
+    std::mutex mutex_;
+    // Guarded by mutex_
+    std::vector<std::thread> connection_threads_;
+    std::map<uint32_t, Clock::time_point> releases_;
+
+    void accept_loop() {
+        while (!stop_) {
+            pollfd pfd = {listen_fd_, POLLIN, 0};
+            if (poll(&pfd, 1, 100) <= 0) {
+                continue;
+            }
+            int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            std::lock_guard<std::mutex> lock(mutex_);
+            connection_threads_.emplace_back(&ReplayNode::serve, this, fd);
+        }
+    }
+
+    // Keep-alive HTTP/1.1: one request after another until the proxy hangs up
+    void serve(int fd) {
+        std::string buffer;
+        char chunk[16384];
+        while (!stop_) {
+            size_t header_end = buffer.find("\r\n\r\n");
+            if (header_end == std::string::npos) {
+                pollfd pfd = {fd, POLLIN, 0};
+                if (poll(&pfd, 1, 100) == 0) {
+                    continue;
+                }
+                ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+                if (n <= 0) {
+                    break;
+                }
+                buffer.append(chunk, (size_t)n);
+                continue;
+            }
+            size_t content_length = 0;
+            std::string headers = buffer.substr(0, header_end);
+            std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+            size_t field = headers.find("content-length:");
+            if (field != std::string::npos) {
+                content_length = std::strtoul(headers.c_str() + field + 15, nullptr, 10);
+            }
+            if (buffer.size() < header_end + 4 + content_length) {
+                ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+                if (n <= 0) {
+                    break;
+                }
+                buffer.append(chunk, (size_t)n);
+                continue;
+            }
+            std::string body = buffer.substr(header_end + 4, content_length);
+            buffer.erase(0, header_end + 4 + content_length);
+            if (!answer(fd, body)) {
+                break;
+            }
+        }
+        close(fd);
+    }
+
+    bool answer(int fd, const std::string& body) {
+        Json::CharReaderBuilder builder;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        Json::Value request;
+        std::string errors;
+        if (!reader->parse(body.data(), body.data() + body.size(), &request, &errors)) {
+            return false;
+        }
+        // Labelled the way RPCClient labels its calls
+        std::string label;
+        if (request.isArray()) {
+            for (const Json::Value& call : request) {
+                label += (label.empty() ? "" : "+") + call["method"].asString();
+            }
+        } else {
+            label = request["method"].asString();
+        }
+
+        std::string response;
+        double latency_ms = 0;
+        std::string error;
+        if (!replay_.respond(label, request, &stop_, response, latency_ms, error)) {
+            if (stop_) {
+                return false;
+            }
+            response = "{\"result\":null,\"error\":{\"code\":-32601,\"message\":" +
+                       Json::valueToQuotedString(error.c_str()) + "},\"id\":null}";
+        }
+        // The request's id, not the recorded one (a batch's are renumbered by the replay)
+        Json::Value answer;
+        if (request.isObject() && reader->parse(response.data(), response.data() + response.size(), &answer, &errors) &&
+            answer.isObject()) {
+            answer["id"] = request["id"];
+            Json::StreamWriterBuilder writer;
+            writer["indentation"] = "";
+            response = Json::writeString(writer, answer);
+        }
+        std::ostringstream out;
+        out << "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " << response.size()
+            << "\r\n\r\n" << response;
+        const std::string text = out.str();
+        const Clock::time_point sent = Clock::now();
+        size_t done = 0;
+        while (done < text.size()) {
+            ssize_t n = send(fd, text.data() + done, text.size() - done, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return false;
+            }
+            done += (size_t)n;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (label.find("getblocktemplate") != std::string::npos) {
+            size_t at = response.find("\"height\":");
+            if (at != std::string::npos) {
+                uint32_t height = (uint32_t)std::strtoul(response.c_str() + at + 9, nullptr, 10);
+                releases_.emplace(height, sent);
+            }
+        }
+        return true;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Proxy process accounting
+
+struct ProcessSample {
+    bool ok;
+    double cpu_seconds;   // User plus system time
+    double rss_kb;
+    Clock::time_point time;
+};
+
+static ProcessSample sample_process(const std::string& pid) {
+    ProcessSample sample;
+    sample.ok = false;
+    sample.cpu_seconds = 0;
+    sample.rss_kb = 0;
+    sample.time = Clock::now();
+    std::ifstream stat("/proc/" + pid + "/stat");
+    std::string line;
+    if (!std::getline(stat, line)) {
+        return sample;
+    }
+    // Fields after the command name, which may hold spaces: state is the 3rd
+    size_t close_paren = line.rfind(')');
+    if (close_paren == std::string::npos) {
+        return sample;
+    }
+    std::istringstream fields(line.substr(close_paren + 2));
+    std::string field;
+    unsigned long long utime = 0;
+    unsigned long long stime = 0;
+    for (int i = 3; i <= 15 && fields >> field; i++) {
+        if (i == 14) {
+            utime = std::strtoull(field.c_str(), nullptr, 10);
+        } else if (i == 15) {
+            stime = std::strtoull(field.c_str(), nullptr, 10);
+        }
+    }
+    sample.cpu_seconds = (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+    std::ifstream status("/proc/" + pid + "/status");
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            sample.rss_kb = std::atof(line.c_str() + 6);
+        }
+    }
+    sample.ok = true;
+    return sample;
+}
+
+// The process listening on TCP port on this host (from /proc/net/tcp and the
+// processes' descriptors), empty if none is found
+static std::string find_listener_pid(unsigned int port) {
+    std::vector<std::string> inodes;
+    for (const char* table : {"/proc/net/tcp", "/proc/net/tcp6"}) {
+        std::ifstream in(table);
+        std::string line;
+        std::getline(in, line);
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            std::string slot, local, remote, state, queues, timer, retransmits, uid, timeout, inode;
+            fields >> slot >> local >> remote >> state >> queues >> timer >> retransmits >> uid >> timeout >> inode;
+            size_t colon = local.rfind(':');
+            if (state == "0A" && colon != std::string::npos &&
+                std::strtoul(local.c_str() + colon + 1, nullptr, 16) == port) {
+                inodes.push_back("socket:[" + inode + "]");
+            }
+        }
+    }
+    if (inodes.empty()) {
+        return std::string();
+    }
+    DIR* proc = opendir("/proc");
+    std::string found;
+    while (proc && found.empty()) {
+        dirent* entry = readdir(proc);
+        if (!entry) {
+            break;
+        }
+        if (!std::isdigit((unsigned char)entry->d_name[0])) {
+            continue;
+        }
+        const std::string fd_dir = std::string("/proc/") + entry->d_name + "/fd";
+        DIR* fds = opendir(fd_dir.c_str());
+        while (fds && found.empty()) {
+            dirent* fd = readdir(fds);
+            if (!fd) {
+                break;
+            }
+            char target[64];
+            ssize_t n = readlink((fd_dir + "/" + fd->d_name).c_str(), target, sizeof(target) - 1);
+            if (n > 0 && std::find(inodes.begin(), inodes.end(), std::string(target, (size_t)n)) != inodes.end()) {
+                found = entry->d_name;
+            }
+        }
+        if (fds) {
+            closedir(fds);
+        }
+    }
+    if (proc) {
+        closedir(proc);
+    }
+    return found;
+}
+
+// ---------------------------------------------------------------------------
+// Rigs
+
+enum RigState {
+    RIG_IDLE,        // Waiting to connect
+    RIG_CONNECTING,
+    RIG_LOGGING_IN,
+    RIG_ACTIVE
+};
+
+enum TimerKind {
+    TIMER_CONNECT,
+    TIMER_LOGIN,     // Ask again: the proxy has no job yet
+    TIMER_SHARE
+};
+
+struct Rig {
+    int fd = -1;
+    RigState state = RIG_IDLE;
+    uint32_t generation = 0;        // Bumped per connection, so its timers die with it
+    uint32_t instance_id = 0;
+    bool storm = false;             // Reconnecting after a storm
+    bool ever_logged_in = false;
+    uint64_t login_id = 0;
+    std::string in;
+    std::string out;
+    std::string job_id;
+    std::string result_hex;         // A share for the job: its target, as a hash
+    Clock::time_point connect_started;
+    Clock::time_point logged_in;
+    std::vector<std::pair<uint64_t, Clock::time_point>> pending;  // Submits by request id
+};
+
+struct Timer {
+    Clock::time_point time;
+    uint32_t rig;
+    uint32_t generation;
+    TimerKind kind;
+
+    bool operator>(const Timer& other) const { return time > other.time; }
+};
+
+struct Options {
+    std::string proxy;
+    unsigned int rigs = 1000;
+    double connect_rate = 500;      // New connections per second while ramping up
+    double duration = 60;           // Steady state after the ramp, seconds
+    double share_rate = 0.1;        // Shares per rig per second
+    double storm_every = 0;         // Seconds between reconnect storms, 0 = none
+    double storm_fraction = 0.25;
+    std::string node;
+    std::string replay_path;
+    double replay_speed = 1.0;
+    double block_interval = 10;
+    std::string bits = "1d00ffff";
+    std::string proxy_pid;
+    std::string json_path;
+    std::string recording_path;
+    unsigned int blocks = 0;
+};
+
+struct Stats {
+    LatencyHistogram push;          // Node sent the template -> rig has the job
+    LatencyHistogram spread;        // First rig has the job -> each other rig has it
+    LatencyHistogram login;         // Connect -> login answered, first connections
+    LatencyHistogram storm_login;   // The same after a storm
+    LatencyHistogram share;         // Submit -> answer
+    uint64_t jobs = 0;              // Job notifications received
+    uint64_t shares_accepted = 0;
+    uint64_t shares_rejected = 0;
+    uint64_t connect_failures = 0;
+    uint64_t disconnects = 0;       // Dropped by the proxy
+    uint64_t storms = 0;
+    uint64_t storm_reconnects = 0;
+};
+
+class LoadGenerator {
+public:
+    LoadGenerator(const Options& options, ReplayNode* node)
+        : options_(options), node_(node), rigs_(options.rigs), epoll_fd_(-1), rng_(12345), next_request_id_(1)
+        , active_(0) {}
+    ~LoadGenerator() {
+        for (Rig& rig : rigs_) {
+            if (rig.fd >= 0) {
+                close(rig.fd);
+            }
+        }
+        if (epoll_fd_ >= 0) {
+            close(epoll_fd_);
+        }
+    }
+
+    bool resolve(std::string& error) {
+        size_t colon = options_.proxy.rfind(':');
+        if (colon == std::string::npos) {
+            error = "--proxy takes HOST:PORT";
+            return false;
+        }
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        int res = getaddrinfo(options_.proxy.substr(0, colon).c_str(), options_.proxy.substr(colon + 1).c_str(),
+                              &hints, &addresses);
+        if (res != 0 || !addresses) {
+            error = "can't resolve " + options_.proxy + ": " + gai_strerror(res);
+            return false;
+        }
+        std::memcpy(&address_, addresses->ai_addr, addresses->ai_addrlen);
+        address_length_ = addresses->ai_addrlen;
+        family_ = addresses->ai_family;
+        freeaddrinfo(addresses);
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        return epoll_fd_ >= 0;
+    }
+
+    // Block until the proxy takes connections; false if interrupted first
+    bool wait_for_proxy() {
+        while (!stop_requested) {
+            int fd = socket(family_, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            bool ok = fd >= 0 && connect(fd, (sockaddr*)&address_, address_length_) == 0;
+            if (fd >= 0) {
+                close(fd);
+            }
+            if (ok) {
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        return false;
+    }
+
+    // Ramp up, hold for the duration, report
+    void run(Stats& stats, ProcessSample& connected, ProcessSample& self_connected, double& ramp_seconds) {
+        stats_ = &stats;
+        const Clock::time_point started = Clock::now();
+        for (uint32_t i = 0; i < rigs_.size(); i++) {
+            schedule(started + std::chrono::microseconds((int64_t)(i * 1e6 / options_.connect_rate)), i,
+                     TIMER_CONNECT);
+        }
+
+        // Ramp: until every rig has logged in once (or a minute past the
+        // schedule), then the steady window
+        const Clock::time_point ramp_deadline = started +
+            std::chrono::milliseconds((int64_t)(rigs_.size() * 1000.0 / options_.connect_rate) + 60000);
+        bool ramped = false;
+        Clock::time_point steady_end;
+        Clock::time_point next_storm;
+        Clock::time_point next_progress = started + std::chrono::seconds(5);
+        std::vector<epoll_event> events(1024);
+        while (!stop_requested) {
+            Clock::time_point now = Clock::now();
+            if (!ramped && (logged_in_once_ == rigs_.size() || now >= ramp_deadline)) {
+                ramped = true;
+                ramp_seconds = ms_between(started, now) / 1000.0;
+                connected = options_.proxy_pid.empty() ? ProcessSample() : sample_process(options_.proxy_pid);
+                self_connected = sample_process("self");
+                steady_end = now + std::chrono::milliseconds((int64_t)(options_.duration * 1000));
+                next_storm = now + std::chrono::milliseconds((int64_t)(options_.storm_every * 1000));
+                std::cout << "Ramp done in " << std::fixed << std::setprecision(1) << ramp_seconds << " s: "
+                          << logged_in_once_ << "/" << rigs_.size() << " rigs logged in, holding for "
+                          << options_.duration << " s" << std::endl;
+            }
+            if (ramped && now >= steady_end) {
+                break;
+            }
+            if (ramped && options_.storm_every > 0 && now >= next_storm) {
+                storm(now);
+                next_storm = now + std::chrono::milliseconds((int64_t)(options_.storm_every * 1000));
+            }
+            if (now >= next_progress) {
+                std::cout << "  " << active_ << " rigs active, " << stats.jobs << " jobs, "
+                          << stats.shares_accepted << " shares accepted" << std::endl;
+                next_progress = now + std::chrono::seconds(5);
+            }
+            run_timers(now);
+
+            int timeout_ms = 100;
+            if (!timers_.empty()) {
+                double until = ms_between(Clock::now(), timers_.top().time);
+                timeout_ms = std::max(0, std::min(timeout_ms, (int)std::ceil(until)));
+            }
+            int n = epoll_wait(epoll_fd_, events.data(), (int)events.size(), timeout_ms);
+            for (int i = 0; i < n; i++) {
+                Rig& rig = rigs_[events[i].data.u32];
+                if (rig.fd < 0) {
+                    continue;
+                }
+                if (rig.state == RIG_CONNECTING) {
+                    connected_socket(events[i].data.u32);
+                } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    read_rig(events[i].data.u32);
+                }
+                if (rig.fd >= 0 && (events[i].events & EPOLLOUT)) {
+                    flush(events[i].data.u32);
+                }
+            }
+        }
+        if (!ramped) {
+            ramp_seconds = ms_between(started, Clock::now()) / 1000.0;
+            connected = options_.proxy_pid.empty() ? ProcessSample() : sample_process(options_.proxy_pid);
+            self_connected = sample_process("self");
+        }
+    }
+
+    size_t active() const { return active_; }
+
+private:
+    const Options& options_;
+    ReplayNode* node_;
+    std::vector<Rig> rigs_;
+    int epoll_fd_;
+    sockaddr_storage address_;
+    socklen_t address_length_ = 0;
+    int family_ = AF_INET;
+    std::mt19937 rng_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+    uint64_t next_request_id_;
+    size_t active_;
+    size_t logged_in_once_ = 0;
+    std::map<std::string, Clock::time_point> first_receipt_;  // By job id
+    Json::CharReaderBuilder reader_builder_;
+    Stats* stats_ = nullptr;
+
+    void schedule(Clock::time_point time, uint32_t rig, TimerKind kind) {
+        timers_.push(Timer{time, rig, rigs_[rig].generation, kind});
+    }
+
+    void run_timers(Clock::time_point now) {
+        while (!timers_.empty() && timers_.top().time <= now) {
+            Timer timer = timers_.top();
+            timers_.pop();
+            Rig& rig = rigs_[timer.rig];
+            if (timer.generation != rig.generation) {
+                continue;
+            }
+            if (timer.kind == TIMER_CONNECT && rig.state == RIG_IDLE) {
+                connect_rig(timer.rig);
+            } else if (timer.kind == TIMER_LOGIN && rig.state == RIG_LOGGING_IN) {
+                send_login(timer.rig);
+            } else if (timer.kind == TIMER_SHARE && rig.state == RIG_ACTIVE) {
+                submit_share(timer.rig);
+                schedule_share(timer.rig, now);
+            }
+        }
+    }
+
+    void connect_rig(uint32_t index) {
+        Rig& rig = rigs_[index];
+        rig.generation++;
+        rig.connect_started = Clock::now();
+        rig.fd = socket(family_, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (rig.fd < 0) {
+            failed(index, "socket");
+            return;
+        }
+        int one = 1;
+        setsockopt(rig.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(rig.fd, (sockaddr*)&address_, address_length_) < 0 && errno != EINPROGRESS) {
+            failed(index, "connect");
+            return;
+        }
+        rig.state = RIG_CONNECTING;
+        epoll_event event;
+        event.events = EPOLLOUT;
+        event.data.u32 = index;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, rig.fd, &event);
+    }
+
+    void connected_socket(uint32_t index) {
+        Rig& rig = rigs_[index];
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(rig.fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+            failed(index, "connect");
+            return;
+        }
+        rig.state = RIG_LOGGING_IN;
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = index;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, rig.fd, &event);
+        send_login(index);
+    }
+
+    // The connection failed before login: try again in a second
+    void failed(uint32_t index, const char*) {
+        stats_->connect_failures++;
+        drop(index);
+        schedule(Clock::now() + std::chrono::seconds(1), index, TIMER_CONNECT);
+    }
+
+    void drop(uint32_t index) {
+        Rig& rig = rigs_[index];
+        if (rig.fd >= 0) {
+            close(rig.fd);
+            rig.fd = -1;
+        }
+        if (rig.state == RIG_ACTIVE) {
+            active_--;
+        }
+        rig.state = RIG_IDLE;
+        rig.generation++;
+        rig.in.clear();
+        rig.out.clear();
+        rig.pending.clear();
+        rig.job_id.clear();
+    }
+
+    void send_login(uint32_t index) {
+        Rig& rig = rigs_[index];
+        rig.login_id = next_request_id_++;
+        write_line(index, "{\"id\":" + std::to_string(rig.login_id) + ",\"jsonrpc\":\"2.0\",\"method\":\"login\","
+                          "\"params\":{\"login\":\"loadgen-" + std::to_string(index) + "\",\"pass\":\"x\","
+                          "\"agent\":\"juno-loadgen\"}}");
+    }
+
+    void schedule_share(uint32_t index, Clock::time_point now) {
+        if (options_.share_rate <= 0) {
+            return;
+        }
+        std::exponential_distribution<double> gap(options_.share_rate);
+        schedule(now + std::chrono::microseconds((int64_t)(gap(rng_) * 1e6)), index, TIMER_SHARE);
+    }
+
+    void submit_share(uint32_t index) {
+        Rig& rig = rigs_[index];
+        if (rig.job_id.empty()) {
+            return;
+        }
+        // Any nonce in the rig's range, with a made-up hash: the proxy must
+        // run with --share-verify 0 to take it
+        uint8_t nonce[32];
+        for (size_t i = 0; i < sizeof(nonce); i++) {
+            nonce[i] = (uint8_t)rng_();
+        }
+        utils::write_le32(nonce + 2, rig.instance_id);
+        const uint64_t id = next_request_id_++;
+        rig.pending.emplace_back(id, Clock::now());
+        write_line(index, "{\"id\":" + std::to_string(id) + ",\"jsonrpc\":\"2.0\",\"method\":\"submit\","
+                          "\"params\":{\"id\":\"rig\",\"job_id\":\"" + rig.job_id + "\",\"nonce\":\"" +
+                          utils::bytes_to_hex(nonce, sizeof(nonce)) + "\",\"result\":\"" + rig.result_hex + "\"}}");
+    }
+
+    void write_line(uint32_t index, const std::string& line) {
+        Rig& rig = rigs_[index];
+        const bool idle = rig.out.empty();
+        rig.out += line;
+        rig.out += '\n';
+        if (idle) {
+            flush(index);
+        }
+    }
+
+    void flush(uint32_t index) {
+        Rig& rig = rigs_[index];
+        while (!rig.out.empty()) {
+            ssize_t n = send(rig.fd, rig.out.data(), rig.out.size(), MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (n <= 0) {
+                lost(index);
+                return;
+            }
+            rig.out.erase(0, (size_t)n);
+        }
+        epoll_event event;
+        event.events = EPOLLIN | (rig.out.empty() ? 0 : EPOLLOUT);
+        event.data.u32 = index;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, rig.fd, &event);
+    }
+
+    // The proxy dropped the rig (or it can't be written): reconnect in a second
+    void lost(uint32_t index) {
+        stats_->disconnects++;
+        drop(index);
+        if (!stop_requested) {
+            schedule(Clock::now() + std::chrono::seconds(1), index, TIMER_CONNECT);
+        }
+    }
+
+    void read_rig(uint32_t index) {
+        Rig& rig = rigs_[index];
+        char buffer[16384];
+        for (;;) {
+            ssize_t n = recv(rig.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (n <= 0) {
+                lost(index);
+                return;
+            }
+            rig.in.append(buffer, (size_t)n);
+        }
+        const Clock::time_point now = Clock::now();
+        size_t start = 0;
+        size_t end;
+        std::unique_ptr<Json::CharReader> reader(reader_builder_.newCharReader());
+        while (rig.fd >= 0 && (end = rig.in.find('\n', start)) != std::string::npos) {
+            Json::Value message;
+            std::string errors;
+            bool ok = reader->parse(rig.in.data() + start, rig.in.data() + end, &message, &errors);
+            start = end + 1;
+            if (ok && message.isObject()) {
+                handle(index, message, now);
+            }
+        }
+        if (rig.fd >= 0) {
+            rig.in.erase(0, start);
+        }
+    }
+
+    void take_job(Rig& rig, const Json::Value& job) {
+        rig.job_id = job["job_id"].asString();
+        // The target comes as a big-endian number; a hash equal to it is
+        // the easiest share it takes
+        std::vector<uint8_t> target = utils::hex_to_bytes(job["target"].asString());
+        std::reverse(target.begin(), target.end());
+        target.resize(32, 0);
+        rig.result_hex = utils::bytes_to_hex(target.data(), target.size());
+    }
+
+    void handle(uint32_t index, const Json::Value& message, Clock::time_point now) {
+        Rig& rig = rigs_[index];
+        if (message["method"].isString() && message["method"].asString() == "job") {
+            const Json::Value& job = message["params"];
+            take_job(rig, job);
+            stats_->jobs++;
+            auto first = first_receipt_.emplace(rig.job_id, now).first;
+            stats_->spread.add(ms_between(first->second, now));
+            Clock::time_point released;
+            if (node_ && node_->released(job["height"].asUInt(), released) && released >= rig.logged_in) {
+                stats_->push.add(ms_between(released, now));
+            }
+            return;
+        }
+        if (!message["id"].isIntegral()) {
+            return;
+        }
+        const uint64_t id = message["id"].asUInt64();
+        if (rig.state == RIG_LOGGING_IN && id == rig.login_id) {
+            if (!message["error"].isNull() || !message["result"].isObject()) {
+                // No job yet: ask again
+                schedule(now + std::chrono::seconds(1), index, TIMER_LOGIN);
+                return;
+            }
+            const Json::Value& result = message["result"];
+            rig.instance_id = result["instance_id"].asUInt();
+            take_job(rig, result["job"]);
+            rig.state = RIG_ACTIVE;
+            rig.logged_in = now;
+            active_++;
+            (rig.storm ? stats_->storm_login : stats_->login).add(ms_between(rig.connect_started, now));
+            rig.storm = false;
+            if (!rig.ever_logged_in) {
+                rig.ever_logged_in = true;
+                logged_in_once_++;
+            }
+            schedule_share(index, now);
+            return;
+        }
+        for (size_t i = 0; i < rig.pending.size(); i++) {
+            if (rig.pending[i].first == id) {
+                stats_->share.add(ms_between(rig.pending[i].second, now));
+                (message["error"].isNull() ? stats_->shares_accepted : stats_->shares_rejected)++;
+                rig.pending.erase(rig.pending.begin() + i);
+                return;
+            }
+        }
+    }
+
+    // Drop a fraction of the active rigs at once; they all reconnect now
+    void storm(Clock::time_point now) {
+        std::vector<uint32_t> candidates;
+        for (uint32_t i = 0; i < rigs_.size(); i++) {
+            if (rigs_[i].state == RIG_ACTIVE) {
+                candidates.push_back(i);
+            }
+        }
+        std::shuffle(candidates.begin(), candidates.end(), rng_);
+        candidates.resize((size_t)(candidates.size() * options_.storm_fraction));
+        for (uint32_t index : candidates) {
+            drop(index);
+            rigs_[index].storm = true;
+            schedule(now, index, TIMER_CONNECT);
+        }
+        stats_->storms++;
+        stats_->storm_reconnects += candidates.size();
+        std::cout << "Storm: " << candidates.size() << " rigs reconnecting" << std::endl;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Report
+
+static Json::Value histogram_json(const LatencyHistogram& histogram) {
+    Json::Value entry;
+    entry["count"] = (Json::UInt64)histogram.count();
+    entry["p50_ms"] = histogram.percentile(0.50);
+    entry["p90_ms"] = histogram.percentile(0.90);
+    entry["p99_ms"] = histogram.percentile(0.99);
+    entry["p999_ms"] = histogram.percentile(0.999);
+    entry["max_ms"] = histogram.max_ms();
+    return entry;
+}
+
+static void print_histogram(const char* name, const LatencyHistogram& histogram) {
+    std::cout << "  " << std::left << std::setw(20) << name << std::right << " n=" << std::setw(8)
+              << histogram.count();
+    if (histogram.count()) {
+        std::cout << "  p50 " << std::setw(8) << histogram.percentile(0.50) << "  p90 " << std::setw(8)
+                  << histogram.percentile(0.90) << "  p99 " << std::setw(8) << histogram.percentile(0.99)
+                  << "  p99.9 " << std::setw(8) << histogram.percentile(0.999) << "  max " << std::setw(8)
+                  << histogram.max_ms() << " ms";
+    }
+    std::cout << std::endl;
+}
+
+static void usage() {
+    std::cerr << "Usage: juno-loadgen --proxy HOST:PORT [--rigs N] [--connect-rate R] [--duration S]\n"
+                 "                    [--share-rate R] [--storm-every S] [--storm-fraction F]\n"
+                 "                    [--node HOST:PORT] [--replay FILE] [--replay-speed X]\n"
+                 "                    [--block-interval S] [--bits HEX] [--proxy-pid PID] [--json FILE]\n"
+                 "       juno-loadgen --write-recording FILE [--blocks N] [--block-interval S] [--bits HEX]"
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            usage();
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--proxy") {
+            options.proxy = value;
+        } else if (arg == "--rigs") {
+            options.rigs = (unsigned int)std::strtoul(value.c_str(), nullptr, 10);
+        } else if (arg == "--connect-rate") {
+            options.connect_rate = std::atof(value.c_str());
+        } else if (arg == "--duration") {
+            options.duration = std::atof(value.c_str());
+        } else if (arg == "--share-rate") {
+            options.share_rate = std::atof(value.c_str());
+        } else if (arg == "--storm-every") {
+            options.storm_every = std::atof(value.c_str());
+        } else if (arg == "--storm-fraction") {
+            options.storm_fraction = std::atof(value.c_str());
+        } else if (arg == "--node") {
+            options.node = value;
+        } else if (arg == "--replay") {
+            options.replay_path = value;
+        } else if (arg == "--replay-speed") {
+            options.replay_speed = std::atof(value.c_str());
+        } else if (arg == "--block-interval") {
+            options.block_interval = std::atof(value.c_str());
+        } else if (arg == "--bits") {
+            options.bits = value;
+        } else if (arg == "--proxy-pid") {
+            options.proxy_pid = value;
+        } else if (arg == "--json") {
+            options.json_path = value;
+        } else if (arg == "--write-recording") {
+            options.recording_path = value;
+        } else if (arg == "--blocks") {
+            options.blocks = (unsigned int)std::strtoul(value.c_str(), nullptr, 10);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (options.block_interval <= 0 || options.connect_rate <= 0 || options.replay_speed <= 0 ||
+        options.storm_fraction < 0 || options.storm_fraction > 1 || options.bits.size() != 8) {
+        usage();
+        return 1;
+    }
+    // Blocks enough for the whole run unless asked for
+    if (options.blocks == 0) {
+        double seconds = options.rigs / options.connect_rate + options.duration + 120;
+        options.blocks = (unsigned int)std::ceil(seconds / options.block_interval) + 1;
+    }
+
+    std::string error;
+    if (!options.recording_path.empty()) {
+        if (!write_synthetic_recording(options.recording_path, options.blocks, options.block_interval, options.bits,
+                                       error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << options.blocks << " templates, " << options.block_interval << " s apart, to "
+                  << options.recording_path << " (juno-miner --proxy ... --replay " << options.recording_path << ")"
+                  << std::endl;
+        return 0;
+    }
+    if (options.proxy.empty() || options.rigs == 0) {
+        usage();
+        return 1;
+    }
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // One descriptor per rig
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < options.rigs + 64) {
+            std::cerr << "Warning: only " << limit.rlim_cur << " file descriptors allowed for " << options.rigs
+                      << " rigs (raise the hard limit: ulimit -Hn)" << std::endl;
+        }
+    }
+
+    TrafficReplay replay;
+    std::unique_ptr<ReplayNode> node;
+    std::string synthetic_path;
+    if (!options.node.empty()) {
+        std::string path = options.replay_path;
+        if (path.empty()) {
+            synthetic_path = "/tmp/juno-loadgen-" + std::to_string(getpid()) + ".traffic";
+            path = synthetic_path;
+            if (!write_synthetic_recording(path, options.blocks, options.block_interval, options.bits, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return 1;
+            }
+        }
+        if (!replay.load(path, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        if (!synthetic_path.empty()) {
+            unlink(synthetic_path.c_str());
+        }
+        node.reset(new ReplayNode(replay));
+        if (!node->listen(options.node, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        replay.start(options.replay_speed);
+        node->start();
+        std::cout << "Node on " << options.node << ": " << replay.event_count() << " recorded answers"
+                  << (options.replay_path.empty() ? " (synthesized, one block every " +
+                      std::to_string((int)options.block_interval) + " s)" : std::string()) << std::endl;
+    }
+
+    LoadGenerator generator(options, node.get());
+    if (!generator.resolve(error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+
+    // The proxy may only be started now, against this node
+    std::cout << "Waiting for the proxy on " << options.proxy << std::endl;
+    if (!generator.wait_for_proxy()) {
+        return 1;
+    }
+    if (options.proxy_pid.empty()) {
+        options.proxy_pid = find_listener_pid((unsigned int)std::strtoul(
+            options.proxy.substr(options.proxy.rfind(':') + 1).c_str(), nullptr, 10));
+        if (!options.proxy_pid.empty()) {
+            std::cout << "Proxy is pid " << options.proxy_pid << std::endl;
+        }
+    }
+    ProcessSample base = options.proxy_pid.empty() ? ProcessSample() : sample_process(options.proxy_pid);
+    if (!options.proxy_pid.empty() && !base.ok) {
+        std::cerr << "Warning: can't read /proc/" << options.proxy_pid << ", no proxy CPU or memory figures"
+                  << std::endl;
+    }
+    std::cout << "Connecting " << options.rigs << " rigs to " << options.proxy << " at " << options.connect_rate
+              << "/s" << std::endl;
+    Stats stats;
+    ProcessSample connected;
+    ProcessSample self_connected;
+    double ramp_seconds = 0;
+    generator.run(stats, connected, self_connected, ramp_seconds);
+    ProcessSample end = options.proxy_pid.empty() ? ProcessSample() : sample_process(options.proxy_pid);
+    ProcessSample self_end = sample_process("self");
+    const size_t active = generator.active();
+    if (node) {
+        node->stop();
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "\n" << options.rigs << " rigs, " << active << " active at the end, ramp " << ramp_seconds << " s\n"
+              << "  jobs received " << stats.jobs << ", shares accepted " << stats.shares_accepted << ", rejected "
+              << stats.shares_rejected << ", connect failures " << stats.connect_failures << ", dropped by the proxy "
+              << stats.disconnects << ", storms " << stats.storms << " (" << stats.storm_reconnects
+              << " reconnects)" << std::endl;
+    std::cout << "Latency:" << std::endl;
+    if (node) {
+        print_histogram("job push (node->rig)", stats.push);
+    }
+    print_histogram("job fan-out spread", stats.spread);
+    print_histogram("login", stats.login);
+    print_histogram("login after storm", stats.storm_login);
+    print_histogram("share round trip", stats.share);
+
+    Json::Value root;
+    root["rigs"] = options.rigs;
+    root["active"] = (Json::UInt64)active;
+    root["ramp_seconds"] = ramp_seconds;
+    root["jobs"] = (Json::UInt64)stats.jobs;
+    root["shares_accepted"] = (Json::UInt64)stats.shares_accepted;
+    root["shares_rejected"] = (Json::UInt64)stats.shares_rejected;
+    root["connect_failures"] = (Json::UInt64)stats.connect_failures;
+    root["disconnects"] = (Json::UInt64)stats.disconnects;
+    root["storm_reconnects"] = (Json::UInt64)stats.storm_reconnects;
+    if (node) {
+        root["latency"]["push"] = histogram_json(stats.push);
+    }
+    root["latency"]["spread"] = histogram_json(stats.spread);
+    root["latency"]["login"] = histogram_json(stats.login);
+    root["latency"]["storm_login"] = histogram_json(stats.storm_login);
+    root["latency"]["share"] = histogram_json(stats.share);
+
+    // Per connection: memory the connected rigs added over the idle proxy,
+    // CPU over the steady window
+    if (base.ok && connected.ok && end.ok) {
+        const double seconds = ms_between(connected.time, end.time) / 1000.0;
+        const double cpu = end.cpu_seconds - connected.cpu_seconds;
+        const double rigs = std::max<double>(1, active);
+        std::cout << "Proxy (pid " << options.proxy_pid << "):\n"
+                  << "  RSS " << base.rss_kb / 1024 << " MB idle, " << end.rss_kb / 1024 << " MB at the end, "
+                  << (connected.rss_kb - base.rss_kb) / options.rigs << " KB per rig\n"
+                  << "  CPU " << 100 * cpu / seconds << "% of a core over " << seconds << " s, "
+                  << 1e6 * cpu / seconds / rigs << " us per rig-second";
+        if (stats.jobs) {
+            std::cout << ", " << 1e6 * cpu / stats.jobs << " us per job delivered to a rig";
+        }
+        std::cout << std::endl;
+        root["proxy"]["rss_idle_kb"] = base.rss_kb;
+        root["proxy"]["rss_end_kb"] = end.rss_kb;
+        root["proxy"]["kb_per_rig"] = (connected.rss_kb - base.rss_kb) / options.rigs;
+        root["proxy"]["cpu_percent"] = 100 * cpu / seconds;
+        root["proxy"]["cpu_us_per_rig_second"] = 1e6 * cpu / seconds / rigs;
+    }
+    // A generator near a full core measures itself as much as the proxy
+    if (self_connected.ok && self_end.ok) {
+        const double seconds = ms_between(self_connected.time, self_end.time) / 1000.0;
+        const double percent = seconds > 0 ? 100 * (self_end.cpu_seconds - self_connected.cpu_seconds) / seconds : 0;
+        std::cout << "Load generator: " << percent << "% of a core" << (percent > 80 ? " (saturated: the latencies "
+                  "above include its own queueing; run more generators with fewer rigs each)" : "") << std::endl;
+        root["generator_cpu_percent"] = percent;
+    }
+
+    if (!options.json_path.empty()) {
+        std::ofstream out(options.json_path);
+        Json::StreamWriterBuilder writer;
+        writer["indentation"] = "  ";
+        out << Json::writeString(writer, root) << std::endl;
+        if (!out) {
+            std::cerr << "Error: can't write " << options.json_path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -27,12 +27,45 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "soft_aes.h"
+#include "cpu.hpp"
 #include <cassert>
 
 //NOTE: The functions below were tuned for maximum performance
 //and are not cryptographically secure outside of the scope of RandomX.
 //It's not recommended to use them as general hash functions and PRNGs.
 
+enum AesImpl {
+	AesHardware,
+	AesSoftTable,
+	AesSoftCompact,
+};
+
+//One AES round in each of the 4 lanes. Lane i is encrypted if bit i of 'enc'
+//is set and decrypted otherwise.
+template<int impl, int enc>
+static FORCE_INLINE void aesRound4(rx_vec_i128& s0, rx_vec_i128& s1, rx_vec_i128& s2, rx_vec_i128& s3,
+	rx_vec_i128 k0, rx_vec_i128 k1, rx_vec_i128 k2, rx_vec_i128 k3) {
+	if (impl == AesSoftCompact) {
+		rx_vec_i128 state[4] = { s0, s1, s2, s3 };
+		const rx_vec_i128 key[4] = { k0, k1, k2, k3 };
+		soft_aes4_compact<enc>(state, key);
+		s0 = state[0];
+		s1 = state[1];
+		s2 = state[2];
+		s3 = state[3];
+		return;
+	}
+	constexpr bool soft = impl != AesHardware;
+	s0 = (enc & 1) ? aesenc<soft>(s0, k0) : aesdec<soft>(s0, k0);
+	s1 = (enc & 2) ? aesenc<soft>(s1, k1) : aesdec<soft>(s1, k1);
+	s2 = (enc & 4) ? aesenc<soft>(s2, k2) : aesdec<soft>(s2, k2);
+	s3 = (enc & 8) ? aesenc<soft>(s3, k3) : aesdec<soft>(s3, k3);
+}
+
+//lanes 0 and 2 encrypted (AesHash1R), lanes 1 and 3 encrypted (AesGenerator)
+constexpr int EncLanes02 = 0x5;
+constexpr int EncLanes13 = 0xa;
+
 //AesHash1R:
 //state0, state1, state2, state3 = Blake2b-512("RandomX AesHash1R state")
 //xkey0, xkey1 = Blake2b-256("RandomX AesHash1R xkeys")
@@ -57,8 +90,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 	Hashing throughput: >20 GiB/s per CPU core with hardware AES
 */
-template<bool softAes>
-void hashAes1Rx4(const void *input, size_t inputSize, void *hash) {
+template<int impl>
+static void hashAes1Rx4Impl(const void *input, size_t inputSize, void *hash) {
 	assert(inputSize % 64 == 0);
 	const uint8_t* inptr = (uint8_t*)input;
 	const uint8_t* inputEnd = inptr + inputSize;
@@ -79,10 +112,7 @@ void hashAes1Rx4(const void *input, size_t inputSize, void *hash) {
 		in2 = rx_load_vec_i128((rx_vec_i128*)inptr + 2);
 		in3 = rx_load_vec_i128((rx_vec_i128*)inptr + 3);
 
-		state0 = aesenc<softAes>(state0, in0);
-		state1 = aesdec<softAes>(state1, in1);
-		state2 = aesenc<softAes>(state2, in2);
-		state3 = aesdec<softAes>(state3, in3);
+		aesRound4<impl, EncLanes02>(state0, state1, state2, state3, in0, in1, in2, in3);
 
 		inptr += 64;
 	}
@@ -91,15 +121,9 @@ void hashAes1Rx4(const void *input, size_t inputSize, void *hash) {
 	rx_vec_i128 xkey0 = rx_set_int_vec_i128(AES_HASH_1R_XKEY0);
 	rx_vec_i128 xkey1 = rx_set_int_vec_i128(AES_HASH_1R_XKEY1);
 
-	state0 = aesenc<softAes>(state0, xkey0);
-	state1 = aesdec<softAes>(state1, xkey0);
-	state2 = aesenc<softAes>(state2, xkey0);
-	state3 = aesdec<softAes>(state3, xkey0);
+	aesRound4<impl, EncLanes02>(state0, state1, state2, state3, xkey0, xkey0, xkey0, xkey0);
 
-	state0 = aesenc<softAes>(state0, xkey1);
-	state1 = aesdec<softAes>(state1, xkey1);
-	state2 = aesenc<softAes>(state2, xkey1);
-	state3 = aesdec<softAes>(state3, xkey1);
+	aesRound4<impl, EncLanes02>(state0, state1, state2, state3, xkey1, xkey1, xkey1, xkey1);
 
 	//output hash
 	rx_store_vec_i128((rx_vec_i128*)hash + 0, state0);
@@ -108,6 +132,16 @@ void hashAes1Rx4(const void *input, size_t inputSize, void *hash) {
 	rx_store_vec_i128((rx_vec_i128*)hash + 3, state3);
 }
 
+template<bool softAes>
+void hashAes1Rx4(const void *input, size_t inputSize, void *hash) {
+	if (!softAes)
+		hashAes1Rx4Impl<AesHardware>(input, inputSize, hash);
+	else if (getSoftAes() == SoftAesCompact)
+		hashAes1Rx4Impl<AesSoftCompact>(input, inputSize, hash);
+	else
+		hashAes1Rx4Impl<AesSoftTable>(input, inputSize, hash);
+}
+
 template void hashAes1Rx4<false>(const void *input, size_t inputSize, void *hash);
 template void hashAes1Rx4<true>(const void *input, size_t inputSize, void *hash);
 
@@ -129,8 +163,8 @@ template void hashAes1Rx4<true>(const void *input, size_t inputSize, void *hash)
 	The modified state is written back to 'state' to allow multiple
 	calls to this function.
 */
-template<bool softAes>
-void fillAes1Rx4(void *state, size_t outputSize, void *buffer) {
+template<int impl>
+static void fillAes1Rx4Impl(void *state, size_t outputSize, void *buffer) {
 	assert(outputSize % 64 == 0);
 	const uint8_t* outptr = (uint8_t*)buffer;
 	const uint8_t* outputEnd = outptr + outputSize;
@@ -149,10 +183,7 @@ void fillAes1Rx4(void *state, size_t outputSize, void *buffer) {
 	state3 = rx_load_vec_i128((rx_vec_i128*)state + 3);
 
 	while (outptr < outputEnd) {
-		state0 = aesdec<softAes>(state0, key0);
-		state1 = aesenc<softAes>(state1, key1);
-		state2 = aesdec<softAes>(state2, key2);
-		state3 = aesenc<softAes>(state3, key3);
+		aesRound4<impl, EncLanes13>(state0, state1, state2, state3, key0, key1, key2, key3);
 
 		rx_store_vec_i128((rx_vec_i128*)outptr + 0, state0);
 		rx_store_vec_i128((rx_vec_i128*)outptr + 1, state1);
@@ -168,6 +199,16 @@ void fillAes1Rx4(void *state, size_t outputSize, void *buffer) {
 	rx_store_vec_i128((rx_vec_i128*)state + 3, state3);
 }
 
+template<bool softAes>
+void fillAes1Rx4(void *state, size_t outputSize, void *buffer) {
+	if (!softAes)
+		fillAes1Rx4Impl<AesHardware>(state, outputSize, buffer);
+	else if (getSoftAes() == SoftAesCompact)
+		fillAes1Rx4Impl<AesSoftCompact>(state, outputSize, buffer);
+	else
+		fillAes1Rx4Impl<AesSoftTable>(state, outputSize, buffer);
+}
+
 template void fillAes1Rx4<true>(void *state, size_t outputSize, void *buffer);
 template void fillAes1Rx4<false>(void *state, size_t outputSize, void *buffer);
 
@@ -184,8 +225,8 @@ template void fillAes1Rx4<false>(void *state, size_t outputSize, void *buffer);
 #define AES_GEN_4R_KEY6 0xf63befa7, 0x2ba9660a, 0xf765a38b, 0xf273c9e7
 #define AES_GEN_4R_KEY7 0xc0b0762d, 0x0c06d1fd, 0x915839de, 0x7a7cd609
 
-template<bool softAes>
-void fillAes4Rx4(void *state, size_t outputSize, void *buffer) {
+template<int impl>
+static void fillAes4Rx4Impl(void *state, size_t outputSize, void *buffer) {
 	assert(outputSize % 64 == 0);
 	const uint8_t* outptr = (uint8_t*)buffer;
 	const uint8_t* outputEnd = outptr + outputSize;
@@ -208,25 +249,10 @@ void fillAes4Rx4(void *state, size_t outputSize, void *buffer) {
 	state3 = rx_load_vec_i128((rx_vec_i128*)state + 3);
 
 	while (outptr < outputEnd) {
-		state0 = aesdec<softAes>(state0, key0);
-		state1 = aesenc<softAes>(state1, key0);
-		state2 = aesdec<softAes>(state2, key4);
-		state3 = aesenc<softAes>(state3, key4);
-
-		state0 = aesdec<softAes>(state0, key1);
-		state1 = aesenc<softAes>(state1, key1);
-		state2 = aesdec<softAes>(state2, key5);
-		state3 = aesenc<softAes>(state3, key5);
-
-		state0 = aesdec<softAes>(state0, key2);
-		state1 = aesenc<softAes>(state1, key2);
-		state2 = aesdec<softAes>(state2, key6);
-		state3 = aesenc<softAes>(state3, key6);
-
-		state0 = aesdec<softAes>(state0, key3);
-		state1 = aesenc<softAes>(state1, key3);
-		state2 = aesdec<softAes>(state2, key7);
-		state3 = aesenc<softAes>(state3, key7);
+		aesRound4<impl, EncLanes13>(state0, state1, state2, state3, key0, key0, key4, key4);
+		aesRound4<impl, EncLanes13>(state0, state1, state2, state3, key1, key1, key5, key5);
+		aesRound4<impl, EncLanes13>(state0, state1, state2, state3, key2, key2, key6, key6);
+		aesRound4<impl, EncLanes13>(state0, state1, state2, state3, key3, key3, key7, key7);
 
 		rx_store_vec_i128((rx_vec_i128*)outptr + 0, state0);
 		rx_store_vec_i128((rx_vec_i128*)outptr + 1, state1);
@@ -237,11 +263,109 @@ void fillAes4Rx4(void *state, size_t outputSize, void *buffer) {
 	}
 }
 
+template<bool softAes>
+void fillAes4Rx4(void *state, size_t outputSize, void *buffer) {
+	if (!softAes)
+		fillAes4Rx4Impl<AesHardware>(state, outputSize, buffer);
+	else if (getSoftAes() == SoftAesCompact)
+		fillAes4Rx4Impl<AesSoftCompact>(state, outputSize, buffer);
+	else
+		fillAes4Rx4Impl<AesSoftTable>(state, outputSize, buffer);
+}
+
 template void fillAes4Rx4<true>(void *state, size_t outputSize, void *buffer);
 template void fillAes4Rx4<false>(void *state, size_t outputSize, void *buffer);
 
-template<bool softAes>
-void hashAndFillAes1Rx4(void *scratchpad, size_t scratchpadSize, void *hash, void* fill_state) {
+#if defined(__VAES__) && defined(__AVX2__)
+#define HAVE_VAES_HASH
+#define VAES_TARGET
+#elif defined(JUNO_PORTABLE) && defined(__GNUC__) && defined(__x86_64__)
+//Portable build: only these functions are compiled for VAES, and only
+//called when the CPU has it
+#define HAVE_VAES_HASH
+#define VAES_TARGET __attribute__((target("avx2,aes,vaes")))
+#endif
+
+#ifdef HAVE_VAES_HASH
+static const bool vaesSupported = randomx::Cpu().hasVaes();
+
+static FORCE_INLINE VAES_TARGET __m256i loadLanes(const uint8_t* lo, const uint8_t* hi) {
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)lo)), _mm_loadu_si128((const __m128i*)hi), 1);
+}
+
+static FORCE_INLINE VAES_TARGET void storeLanes(uint8_t* lo, uint8_t* hi, __m256i v) {
+	_mm_storeu_si128((__m128i*)lo, _mm256_castsi256_si128(v));
+	_mm_storeu_si128((__m128i*)hi, _mm256_extracti128_si256(v, 1));
+}
+
+/*
+	hashAndFillAes1Rx4 with 256-bit AES instructions. Lanes 0 and 2 of the
+	hash take aesenc and lanes 1 and 3 aesdec (the other way round for the
+	fill), so each pair shares a register and one instruction: 4 instead of
+	8 AES instructions per 64 bytes. Loads and stores split the pairs
+	without shuffles.
+*/
+static VAES_TARGET void hashAndFillAes1Rx4Vaes(void *scratchpad, size_t scratchpadSize, void *hash, void* fill_state) {
+	uint8_t* scratchpadPtr = (uint8_t*)scratchpad;
+	const uint8_t* scratchpadEnd = scratchpadPtr + scratchpadSize;
+	uint8_t* fillPtr = (uint8_t*)fill_state;
+
+	// initial state
+	__m256i hash_state02 = _mm256_set_m128i(rx_set_int_vec_i128(AES_HASH_1R_STATE2), rx_set_int_vec_i128(AES_HASH_1R_STATE0));
+	__m256i hash_state13 = _mm256_set_m128i(rx_set_int_vec_i128(AES_HASH_1R_STATE3), rx_set_int_vec_i128(AES_HASH_1R_STATE1));
+
+	const __m256i key02 = _mm256_set_m128i(rx_set_int_vec_i128(AES_GEN_1R_KEY2), rx_set_int_vec_i128(AES_GEN_1R_KEY0));
+	const __m256i key13 = _mm256_set_m128i(rx_set_int_vec_i128(AES_GEN_1R_KEY3), rx_set_int_vec_i128(AES_GEN_1R_KEY1));
+
+	__m256i fill_state02 = loadLanes(fillPtr + 0, fillPtr + 32);
+	__m256i fill_state13 = loadLanes(fillPtr + 16, fillPtr + 48);
+
+	constexpr int PREFETCH_DISTANCE = 4096;
+	const char* prefetchPtr = ((const char*)scratchpad) + PREFETCH_DISTANCE;
+	scratchpadEnd -= PREFETCH_DISTANCE;
+
+	for (int i = 0; i < 2; ++i) {
+		//process 64 bytes at a time in 4 lanes
+		while (scratchpadPtr < scratchpadEnd) {
+			hash_state02 = _mm256_aesenc_epi128(hash_state02, loadLanes(scratchpadPtr + 0, scratchpadPtr + 32));
+			hash_state13 = _mm256_aesdec_epi128(hash_state13, loadLanes(scratchpadPtr + 16, scratchpadPtr + 48));
+
+			fill_state02 = _mm256_aesdec_epi128(fill_state02, key02);
+			fill_state13 = _mm256_aesenc_epi128(fill_state13, key13);
+
+			storeLanes(scratchpadPtr + 0, scratchpadPtr + 32, fill_state02);
+			storeLanes(scratchpadPtr + 16, scratchpadPtr + 48, fill_state13);
+
+			rx_prefetch_t0(prefetchPtr);
+
+			scratchpadPtr += 64;
+			prefetchPtr += 64;
+		}
+		prefetchPtr = (const char*) scratchpad;
+		scratchpadEnd += PREFETCH_DISTANCE;
+	}
+
+	storeLanes(fillPtr + 0, fillPtr + 32, fill_state02);
+	storeLanes(fillPtr + 16, fillPtr + 48, fill_state13);
+
+	//two extra rounds to achieve full diffusion
+	const __m256i xkey0 = _mm256_broadcastsi128_si256(rx_set_int_vec_i128(AES_HASH_1R_XKEY0));
+	const __m256i xkey1 = _mm256_broadcastsi128_si256(rx_set_int_vec_i128(AES_HASH_1R_XKEY1));
+
+	hash_state02 = _mm256_aesenc_epi128(hash_state02, xkey0);
+	hash_state13 = _mm256_aesdec_epi128(hash_state13, xkey0);
+
+	hash_state02 = _mm256_aesenc_epi128(hash_state02, xkey1);
+	hash_state13 = _mm256_aesdec_epi128(hash_state13, xkey1);
+
+	//output hash
+	storeLanes((uint8_t*)hash + 0, (uint8_t*)hash + 32, hash_state02);
+	storeLanes((uint8_t*)hash + 16, (uint8_t*)hash + 48, hash_state13);
+}
+#endif
+
+template<int impl>
+static void hashAndFillAes1Rx4Impl(void *scratchpad, size_t scratchpadSize, void *hash, void* fill_state) {
 	uint8_t* scratchpadPtr = (uint8_t*)scratchpad;
 	const uint8_t* scratchpadEnd = scratchpadPtr + scratchpadSize;
 
@@ -268,15 +392,14 @@ void hashAndFillAes1Rx4(void *scratchpad, size_t scratchpadSize, void *hash, voi
 	for (int i = 0; i < 2; ++i) {
 		//process 64 bytes at a time in 4 lanes
 		while (scratchpadPtr < scratchpadEnd) {
-			hash_state0 = aesenc<softAes>(hash_state0, rx_load_vec_i128((rx_vec_i128*)scratchpadPtr + 0));
-			hash_state1 = aesdec<softAes>(hash_state1, rx_load_vec_i128((rx_vec_i128*)scratchpadPtr + 1));
-			hash_state2 = aesenc<softAes>(hash_state2, rx_load_vec_i128((rx_vec_i128*)scratchpadPtr + 2));
-			hash_state3 = aesdec<softAes>(hash_state3, rx_load_vec_i128((rx_vec_i128*)scratchpadPtr + 3));
+			rx_vec_i128 in0 = rx_load_vec_i128((rx_vec_i128*)scratchpadPtr + 0);
+			rx_vec_i128 in1 = rx_load_vec_i128((rx_vec_i128*)scratchpadPtr + 1);
+			rx_vec_i128 in2 = rx_load_vec_i128((rx_vec_i128*)scratchpadPtr + 2);
+			rx_vec_i128 in3 = rx_load_vec_i128((rx_vec_i128*)scratchpadPtr + 3);
 
-			fill_state0 = aesdec<softAes>(fill_state0, key0);
-			fill_state1 = aesenc<softAes>(fill_state1, key1);
-			fill_state2 = aesdec<softAes>(fill_state2, key2);
-			fill_state3 = aesenc<softAes>(fill_state3, key3);
+			aesRound4<impl, EncLanes02>(hash_state0, hash_state1, hash_state2, hash_state3, in0, in1, in2, in3);
+
+			aesRound4<impl, EncLanes13>(fill_state0, fill_state1, fill_state2, fill_state3, key0, key1, key2, key3);
 
 			rx_store_vec_i128((rx_vec_i128*)scratchpadPtr + 0, fill_state0);
 			rx_store_vec_i128((rx_vec_i128*)scratchpadPtr + 1, fill_state1);
@@ -301,15 +424,9 @@ void hashAndFillAes1Rx4(void *scratchpad, size_t scratchpadSize, void *hash, voi
 	rx_vec_i128 xkey0 = rx_set_int_vec_i128(AES_HASH_1R_XKEY0);
 	rx_vec_i128 xkey1 = rx_set_int_vec_i128(AES_HASH_1R_XKEY1);
 
-	hash_state0 = aesenc<softAes>(hash_state0, xkey0);
-	hash_state1 = aesdec<softAes>(hash_state1, xkey0);
-	hash_state2 = aesenc<softAes>(hash_state2, xkey0);
-	hash_state3 = aesdec<softAes>(hash_state3, xkey0);
+	aesRound4<impl, EncLanes02>(hash_state0, hash_state1, hash_state2, hash_state3, xkey0, xkey0, xkey0, xkey0);
 
-	hash_state0 = aesenc<softAes>(hash_state0, xkey1);
-	hash_state1 = aesdec<softAes>(hash_state1, xkey1);
-	hash_state2 = aesenc<softAes>(hash_state2, xkey1);
-	hash_state3 = aesdec<softAes>(hash_state3, xkey1);
+	aesRound4<impl, EncLanes02>(hash_state0, hash_state1, hash_state2, hash_state3, xkey1, xkey1, xkey1, xkey1);
 
 	//output hash
 	rx_store_vec_i128((rx_vec_i128*)hash + 0, hash_state0);
@@ -318,5 +435,21 @@ void hashAndFillAes1Rx4(void *scratchpad, size_t scratchpadSize, void *hash, voi
 	rx_store_vec_i128((rx_vec_i128*)hash + 3, hash_state3);
 }
 
+template<bool softAes>
+void hashAndFillAes1Rx4(void *scratchpad, size_t scratchpadSize, void *hash, void* fill_state) {
+#ifdef HAVE_VAES_HASH
+	if (!softAes && vaesSupported) {
+		hashAndFillAes1Rx4Vaes(scratchpad, scratchpadSize, hash, fill_state);
+		return;
+	}
+#endif
+	if (!softAes)
+		hashAndFillAes1Rx4Impl<AesHardware>(scratchpad, scratchpadSize, hash, fill_state);
+	else if (getSoftAes() == SoftAesCompact)
+		hashAndFillAes1Rx4Impl<AesSoftCompact>(scratchpad, scratchpadSize, hash, fill_state);
+	else
+		hashAndFillAes1Rx4Impl<AesSoftTable>(scratchpad, scratchpadSize, hash, fill_state);
+}
+
 template void hashAndFillAes1Rx4<false>(void *scratchpad, size_t scratchpadSize, void *hash, void* fill_state);
 template void hashAndFillAes1Rx4<true>(void *scratchpad, size_t scratchpadSize, void *hash, void* fill_state);
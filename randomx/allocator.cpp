@@ -31,6 +31,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "intrin_portable.h"
 #include "virtual_memory.h"
 #include "common.hpp"
+#include "scratchpad_arena.hpp"
 
 namespace randomx {
 
@@ -51,6 +52,8 @@ namespace randomx {
 
 	void* LargePageAllocator::allocMemory(size_t count) {
 		void *mem = allocLargePagesMemory(count);
+		if (mem == nullptr) //no reserved hugetlbfs pages, fall back to transparent huge pages
+			mem = allocTransparentHugePagesMemory(count);
 		if (mem == nullptr)
 			throw std::bad_alloc();
 		return mem;
@@ -60,4 +63,25 @@ namespace randomx {
 		freePagedMemory(ptr, count);
 	};
 
+	void* ScratchpadAllocator::allocMemory(size_t count) {
+		void *mem = count == ScratchpadSize ? ScratchpadArena::allocate() : nullptr;
+		return mem != nullptr ? mem : LargePageAllocator::allocMemory(count);
+	}
+
+	void ScratchpadAllocator::freeMemory(void* ptr, size_t count) {
+		if (!ScratchpadArena::release(ptr))
+			LargePageAllocator::freeMemory(ptr, count);
+	}
+
+	void* HugePage1GAllocator::allocMemory(size_t count) {
+		void *mem = allocHugePages1GMemory(count);
+		if (mem == nullptr)
+			throw std::bad_alloc();
+		return mem;
+	}
+
+	void HugePage1GAllocator::freeMemory(void* ptr, size_t count) {
+		freeHugePages1GMemory(ptr, count);
+	};
+
 }
@@ -43,4 +43,16 @@ namespace randomx {
 		static void freeMemory(void*, size_t);
 	};
 
+	//LargePageAllocator for VM scratchpads: colored in the ScratchpadArena
+	//where it can map chunks
+	struct ScratchpadAllocator {
+		static void* allocMemory(size_t);
+		static void freeMemory(void*, size_t);
+	};
+
+	struct HugePage1GAllocator {
+		static void* allocMemory(size_t);
+		static void freeMemory(void*, size_t);
+	};
+
 }
\ No newline at end of file
@@ -109,6 +109,15 @@ extern "C" {
 	int blake2b_long(void *out, size_t outlen, const void *in, size_t inlen);
 	/* Argon2 Team - End Code */
 
+	/* Compression function behind all of the above. The vectorized ones
+	 * (blake2b_avx2.c, blake2b_avx512.c) return NULL when the build doesn't
+	 * target their instruction set; randomx_set_blake2b picks one by CPU. */
+	typedef void randomx_blake2b_compress_fn(blake2b_state *S, const uint8_t *block);
+	randomx_blake2b_compress_fn *randomx_blake2b_compress_ref(void);
+	randomx_blake2b_compress_fn *randomx_blake2b_compress_avx2(void);
+	randomx_blake2b_compress_fn *randomx_blake2b_compress_avx512(void);
+	void randomx_blake2b_set_compress(randomx_blake2b_compress_fn *compress);
+
 #if defined(__cplusplus)
 }
 #endif
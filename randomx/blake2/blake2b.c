@@ -179,7 +179,7 @@ int blake2b_init_key(blake2b_state *S, size_t outlen, const void *key, size_t ke
 	return 0;
 }
 
-static void blake2b_compress(blake2b_state *S, const uint8_t *block) {
+static void blake2b_compress_ref(blake2b_state *S, const uint8_t *block) {
 	uint64_t m[16];
 	uint64_t v[16];
 	unsigned int i, r;
@@ -237,6 +237,17 @@ static void blake2b_compress(blake2b_state *S, const uint8_t *block) {
 #undef ROUND
 }
 
+/* Chosen by randomx_set_blake2b; the vectorized one for the CPU by default */
+static randomx_blake2b_compress_fn *blake2b_compress = &blake2b_compress_ref;
+
+randomx_blake2b_compress_fn *randomx_blake2b_compress_ref(void) {
+	return &blake2b_compress_ref;
+}
+
+void randomx_blake2b_set_compress(randomx_blake2b_compress_fn *compress) {
+	blake2b_compress = compress != NULL ? compress : &blake2b_compress_ref;
+}
+
 int blake2b_update(blake2b_state *S, const void *in, size_t inlen) {
 	const uint8_t *pin = (const uint8_t *)in;
 
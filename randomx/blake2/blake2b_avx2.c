@@ -0,0 +1,126 @@
+/*
+Copyright (c) 2018-2019, tevador <tevador@gmail.com>
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the copyright holder nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* BLAKE2b compression on 256-bit vectors: the state is four rows of four
+ * words, G runs on all four columns at once, and the rows are rotated to
+ * bring the diagonals into columns (and back) between the two halves of
+ * each round. Bit-exact with blake2b.c. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "blake2.h"
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+static const uint64_t blake2b_IV[8] = {
+	UINT64_C(0x6a09e667f3bcc908), UINT64_C(0xbb67ae8584caa73b),
+	UINT64_C(0x3c6ef372fe94f82b), UINT64_C(0xa54ff53a5f1d36f1),
+	UINT64_C(0x510e527fade682d1), UINT64_C(0x9b05688c2b3e6c1f),
+	UINT64_C(0x1f83d9abfb41bd6b), UINT64_C(0x5be0cd19137e2179) };
+
+static const uint8_t blake2b_sigma[12][16] = {
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+	{14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+	{11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+	{7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+	{9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+	{2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+	{12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+	{13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+	{6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+	{10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+	{14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+};
+
+static void blake2b_compress_avx2(blake2b_state *S, const uint8_t *block) {
+	uint64_t m[16];
+	memcpy(m, block, sizeof(m));
+
+	__m256i a = _mm256_loadu_si256((const __m256i *)&S->h[0]);
+	__m256i b = _mm256_loadu_si256((const __m256i *)&S->h[4]);
+	__m256i c = _mm256_loadu_si256((const __m256i *)&blake2b_IV[0]);
+	__m256i d = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)&blake2b_IV[4]),
+		_mm256_loadu_si256((const __m256i *)&S->t[0]));
+	const __m256i rot24 = _mm256_setr_epi8(
+		3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+		3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+	const __m256i rot16 = _mm256_setr_epi8(
+		2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+		2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+
+#define LOAD_MSG(s, i) _mm256_setr_epi64x((long long)m[s[i]], (long long)m[s[(i) + 2]], \
+	(long long)m[s[(i) + 4]], (long long)m[s[(i) + 6]])
+
+#define G_HALF(mx, my)                                                         \
+	do {                                                                       \
+		a = _mm256_add_epi64(_mm256_add_epi64(a, b), mx);                      \
+		d = _mm256_shuffle_epi32(_mm256_xor_si256(d, a), _MM_SHUFFLE(2, 3, 0, 1)); \
+		c = _mm256_add_epi64(c, d);                                            \
+		b = _mm256_shuffle_epi8(_mm256_xor_si256(b, c), rot24);                \
+		a = _mm256_add_epi64(_mm256_add_epi64(a, b), my);                      \
+		d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16);                \
+		c = _mm256_add_epi64(c, d);                                            \
+		b = _mm256_xor_si256(b, c);                                            \
+		b = _mm256_xor_si256(_mm256_srli_epi64(b, 63), _mm256_add_epi64(b, b)); \
+	} while ((void)0, 0)
+
+	for (int r = 0; r < 12; ++r) {
+		const uint8_t *s = blake2b_sigma[r];
+		G_HALF(LOAD_MSG(s, 0), LOAD_MSG(s, 1));
+		/* Diagonals into columns */
+		b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(0, 3, 2, 1));
+		c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+		d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(2, 1, 0, 3));
+		G_HALF(LOAD_MSG(s, 8), LOAD_MSG(s, 9));
+		b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(2, 1, 0, 3));
+		c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+		d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(0, 3, 2, 1));
+	}
+
+#undef G_HALF
+#undef LOAD_MSG
+
+	_mm256_storeu_si256((__m256i *)&S->h[0], _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)&S->h[0]),
+		_mm256_xor_si256(a, c)));
+	_mm256_storeu_si256((__m256i *)&S->h[4], _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)&S->h[4]),
+		_mm256_xor_si256(b, d)));
+}
+
+#endif
+
+randomx_blake2b_compress_fn *randomx_blake2b_compress_avx2(void) {
+#if defined(__AVX2__)
+	return &blake2b_compress_avx2;
+#else
+	return NULL;
+#endif
+}
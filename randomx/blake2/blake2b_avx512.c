@@ -0,0 +1,120 @@
+/*
+Copyright (c) 2018-2019, tevador <tevador@gmail.com>
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the copyright holder nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* BLAKE2b compression as in blake2b_avx2.c, with the AVX-512VL single
+ * instruction rotates, and the message words of each half round gathered
+ * from two registers by one permute. Bit-exact with blake2b.c. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "blake2.h"
+
+#if defined(__AVX512F__) && defined(__AVX512VL__)
+
+#include <immintrin.h>
+
+static const uint64_t blake2b_IV[8] = {
+	UINT64_C(0x6a09e667f3bcc908), UINT64_C(0xbb67ae8584caa73b),
+	UINT64_C(0x3c6ef372fe94f82b), UINT64_C(0xa54ff53a5f1d36f1),
+	UINT64_C(0x510e527fade682d1), UINT64_C(0x9b05688c2b3e6c1f),
+	UINT64_C(0x1f83d9abfb41bd6b), UINT64_C(0x5be0cd19137e2179) };
+
+/* blake2b.c's sigma reordered for the permutes: per round, the column
+ * step's even and odd entries, then the diagonal step's */
+static const uint8_t blake2b_sigma_split[12][16] = {
+	{0, 2, 4, 6, 1, 3, 5, 7, 8, 10, 12, 14, 9, 11, 13, 15},
+	{14, 4, 9, 13, 10, 8, 15, 6, 1, 0, 11, 5, 12, 2, 7, 3},
+	{11, 12, 5, 15, 8, 0, 2, 13, 10, 3, 7, 9, 14, 6, 1, 4},
+	{7, 3, 13, 11, 9, 1, 12, 14, 2, 5, 4, 15, 6, 10, 0, 8},
+	{9, 5, 2, 10, 0, 7, 4, 15, 14, 11, 6, 3, 1, 12, 8, 13},
+	{2, 6, 0, 8, 12, 10, 11, 3, 4, 7, 15, 1, 13, 5, 14, 9},
+	{12, 1, 14, 4, 5, 15, 13, 10, 0, 6, 9, 8, 7, 3, 2, 11},
+	{13, 7, 12, 3, 11, 14, 1, 9, 5, 15, 8, 2, 0, 4, 6, 10},
+	{6, 14, 11, 0, 15, 9, 3, 8, 12, 13, 1, 10, 2, 7, 4, 5},
+	{10, 8, 7, 1, 2, 4, 6, 5, 15, 9, 3, 13, 11, 14, 12, 0},
+	{0, 2, 4, 6, 1, 3, 5, 7, 8, 10, 12, 14, 9, 11, 13, 15},
+	{14, 4, 9, 13, 10, 8, 15, 6, 1, 0, 11, 5, 12, 2, 7, 3},
+};
+
+static void blake2b_compress_avx512(blake2b_state *S, const uint8_t *block) {
+	const __m512i m_lo = _mm512_loadu_si512((const void *)block);
+	const __m512i m_hi = _mm512_loadu_si512((const void *)(block + 64));
+
+	__m256i a = _mm256_loadu_si256((const __m256i *)&S->h[0]);
+	__m256i b = _mm256_loadu_si256((const __m256i *)&S->h[4]);
+	__m256i c = _mm256_loadu_si256((const __m256i *)&blake2b_IV[0]);
+	__m256i d = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)&blake2b_IV[4]),
+		_mm256_loadu_si256((const __m256i *)&S->t[0]));
+
+#define G_HALF(mx, my)                                                         \
+	do {                                                                       \
+		a = _mm256_add_epi64(_mm256_add_epi64(a, b), mx);                      \
+		d = _mm256_ror_epi64(_mm256_xor_si256(d, a), 32);                      \
+		c = _mm256_add_epi64(c, d);                                            \
+		b = _mm256_ror_epi64(_mm256_xor_si256(b, c), 24);                      \
+		a = _mm256_add_epi64(_mm256_add_epi64(a, b), my);                      \
+		d = _mm256_ror_epi64(_mm256_xor_si256(d, a), 16);                      \
+		c = _mm256_add_epi64(c, d);                                            \
+		b = _mm256_ror_epi64(_mm256_xor_si256(b, c), 63);                      \
+	} while ((void)0, 0)
+
+	for (int r = 0; r < 12; ++r) {
+		const uint8_t *s = blake2b_sigma_split[r];
+		const __m512i column_idx = _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i *)&s[0]));
+		const __m512i diagonal_idx = _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i *)&s[8]));
+		const __m512i column = _mm512_permutex2var_epi64(m_lo, column_idx, m_hi);
+		const __m512i diagonal = _mm512_permutex2var_epi64(m_lo, diagonal_idx, m_hi);
+
+		G_HALF(_mm512_castsi512_si256(column), _mm512_extracti64x4_epi64(column, 1));
+		b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(0, 3, 2, 1));
+		c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+		d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(2, 1, 0, 3));
+		G_HALF(_mm512_castsi512_si256(diagonal), _mm512_extracti64x4_epi64(diagonal, 1));
+		b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(2, 1, 0, 3));
+		c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+		d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(0, 3, 2, 1));
+	}
+
+#undef G_HALF
+
+	_mm256_storeu_si256((__m256i *)&S->h[0], _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)&S->h[0]),
+		_mm256_xor_si256(a, c)));
+	_mm256_storeu_si256((__m256i *)&S->h[4], _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)&S->h[4]),
+		_mm256_xor_si256(b, d)));
+}
+
+#endif
+
+randomx_blake2b_compress_fn *randomx_blake2b_compress_avx512(void) {
+#if defined(__AVX512F__) && defined(__AVX512VL__)
+	return &blake2b_compress_avx512;
+#else
+	return NULL;
+#endif
+}
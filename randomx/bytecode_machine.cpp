@@ -78,6 +78,82 @@ namespace randomx {
 		}
 	}
 
+#if defined(__GNUC__)
+#define INSTR_LABEL(x) op_ ## x: \
+	exe_ ## x(*ibc, pc, scratchpad, config); \
+	INSTR_NEXT
+
+#define INSTR_NEXT \
+	if (++pc == RANDOMX_PROGRAM_SIZE) \
+		return; \
+	ibc = &bytecode[pc]; \
+	goto *dispatch[(int)ibc->type];
+
+	//Threaded code (computed goto): the handlers are inlined here and each
+	//one jumps straight to the next, so every instruction type gets its own,
+	//better predicted indirect branch instead of a call and a shared switch
+	void BytecodeMachine::executeBytecode(InstructionByteCode bytecode[RANDOMX_PROGRAM_SIZE], uint8_t* scratchpad, ProgramConfiguration& config) {
+		//indexed by InstructionType
+		static void* const dispatch[] = {
+			&&op_IADD_RS, &&op_IADD_M, &&op_ISUB_R, &&op_ISUB_M, &&op_IMUL_R, &&op_IMUL_M,
+			&&op_IMULH_R, &&op_IMULH_M, &&op_ISMULH_R, &&op_ISMULH_M, &&op_IMUL_RCP, &&op_INEG_R,
+			&&op_IXOR_R, &&op_IXOR_M, &&op_IROR_R, &&op_IROL_R, &&op_ISWAP_R, &&op_FSWAP_R,
+			&&op_FADD_R, &&op_FADD_M, &&op_FSUB_R, &&op_FSUB_M, &&op_FSCAL_R, &&op_FMUL_R,
+			&&op_FDIV_M, &&op_FSQRT_R, &&op_CBRANCH, &&op_CFROUND, &&op_ISTORE, &&op_NOP,
+		};
+		static_assert(sizeof(dispatch) / sizeof(dispatch[0]) == (int)InstructionType::NOP + 1, "dispatch table size");
+
+		int pc = 0;
+		InstructionByteCode* ibc = &bytecode[0];
+		goto *dispatch[(int)ibc->type];
+
+		INSTR_LABEL(IADD_RS)
+		INSTR_LABEL(IADD_M)
+		INSTR_LABEL(ISUB_R)
+		INSTR_LABEL(ISUB_M)
+		INSTR_LABEL(IMUL_R)
+		INSTR_LABEL(IMUL_M)
+		INSTR_LABEL(IMULH_R)
+		INSTR_LABEL(IMULH_M)
+		INSTR_LABEL(ISMULH_R)
+		INSTR_LABEL(ISMULH_M)
+		INSTR_LABEL(INEG_R)
+		INSTR_LABEL(IXOR_R)
+		INSTR_LABEL(IXOR_M)
+		INSTR_LABEL(IROR_R)
+		INSTR_LABEL(IROL_R)
+		INSTR_LABEL(ISWAP_R)
+		INSTR_LABEL(FSWAP_R)
+		INSTR_LABEL(FADD_R)
+		INSTR_LABEL(FADD_M)
+		INSTR_LABEL(FSUB_R)
+		INSTR_LABEL(FSUB_M)
+		INSTR_LABEL(FSCAL_R)
+		INSTR_LABEL(FMUL_R)
+		INSTR_LABEL(FDIV_M)
+		INSTR_LABEL(FSQRT_R)
+		INSTR_LABEL(CBRANCH)
+		INSTR_LABEL(CFROUND)
+		INSTR_LABEL(ISTORE)
+
+	op_NOP:
+		INSTR_NEXT
+
+	op_IMUL_RCP: //executed as IMUL_R
+		UNREACHABLE;
+	}
+
+#undef INSTR_NEXT
+#undef INSTR_LABEL
+#else
+	void BytecodeMachine::executeBytecode(InstructionByteCode bytecode[RANDOMX_PROGRAM_SIZE], uint8_t* scratchpad, ProgramConfiguration& config) {
+		for (int pc = 0; pc < RANDOMX_PROGRAM_SIZE; ++pc) {
+			auto& ibc = bytecode[pc];
+			executeInstruction(ibc, pc, scratchpad, config);
+		}
+	}
+#endif
+
 	void BytecodeMachine::compileInstruction(RANDOMX_GEN_ARGS) {
 		int opcode = instr.opcode;
 
@@ -123,12 +123,7 @@ namespace randomx {
 			}
 		}
 
-		static void executeBytecode(InstructionByteCode bytecode[RANDOMX_PROGRAM_SIZE], uint8_t* scratchpad, ProgramConfiguration& config) {
-			for (int pc = 0; pc < RANDOMX_PROGRAM_SIZE; ++pc) {
-				auto& ibc = bytecode[pc];
-				executeInstruction(ibc, pc, scratchpad, config);
-			}
-		}
+		static void executeBytecode(InstructionByteCode bytecode[RANDOMX_PROGRAM_SIZE], uint8_t* scratchpad, ProgramConfiguration& config);
 
 		void compileInstruction(RANDOMX_GEN_ARGS)
 #ifdef RANDOMX_GEN_TABLE
@@ -26,6 +26,7 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <cstring>
 #include "cpu.hpp"
 
 #if defined(_M_X64) || defined(__x86_64__)
@@ -33,11 +34,17 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 	#if defined(_MSC_VER)
 		#include <intrin.h>
 		#define cpuid(info, x) __cpuidex(info, x, 0)
+		#define xgetbv0() _xgetbv(0)
 	#else //GCC
 		#include <cpuid.h>
 		void cpuid(int info[4], int InfoType) {
 			__cpuid_count(InfoType, 0, info[0], info[1], info[2], info[3]);
 		}
+		static unsigned long long xgetbv0() {
+			unsigned lo, hi;
+			__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+			return ((unsigned long long)hi << 32) | lo;
+		}
 	#endif
 #endif
 
@@ -46,21 +53,59 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 	#include <asm/hwcap.h>
 #endif
 
+#if defined(__riscv) && __riscv_xlen == 64 && defined(__linux__)
+	#define HAVE_HWPROBE
+	#include <stdint.h>
+	#include <unistd.h>
+	#include <sys/syscall.h>
+	//riscv_hwprobe (Linux 6.4+), from asm/hwprobe.h
+	#ifndef __NR_riscv_hwprobe
+		#define __NR_riscv_hwprobe 258
+	#endif
+	#define RISCV_HWPROBE_KEY_IMA_EXT_0 4
+	#define RISCV_HWPROBE_EXT_ZBA (1 << 3)
+	#define RISCV_HWPROBE_EXT_ZBB (1 << 4)
+#endif
+
 namespace randomx {
 
-	Cpu::Cpu() : aes_(false), ssse3_(false), avx2_(false) {
+	Cpu::Cpu() : aes_(false), ssse3_(false), avx2_(false), avx512_(false), avx512bw_(false), avx512vl_(false), vaes_(false), zba_(false), zbb_(false),
+		intel_(false), amd_(false), family_(0), model_(0) {
 #ifdef HAVE_CPUID
 		int info[4];
 		cpuid(info, 0);
 		int nIds = info[0];
+		char vendor[13] = { 0 };
+		memcpy(vendor + 0, &info[1], 4);
+		memcpy(vendor + 4, &info[3], 4);
+		memcpy(vendor + 8, &info[2], 4);
+		intel_ = strcmp(vendor, "GenuineIntel") == 0;
+		amd_ = strcmp(vendor, "AuthenticAMD") == 0 || strcmp(vendor, "HygonGenuine") == 0;
+		bool ymmState = false, zmmState = false;
 		if (nIds >= 0x00000001) {
 			cpuid(info, 0x00000001);
+			family_ = (info[0] >> 8) & 0xf;
+			model_ = (info[0] >> 4) & 0xf;
+			if (family_ == 0x6 || family_ == 0xf)
+				model_ |= ((info[0] >> 16) & 0xf) << 4;
+			if (family_ == 0xf)
+				family_ += (info[0] >> 20) & 0xff;
 			ssse3_ = (info[2] & (1 << 9)) != 0;
 			aes_ = (info[2] & (1 << 25)) != 0;
+			if ((info[2] & (1 << 27)) != 0) {
+				unsigned long long xcr0 = xgetbv0();
+				ymmState = (xcr0 & 0x06) == 0x06;
+				//XMM, YMM, opmask and both halves of the ZMM state
+				zmmState = (xcr0 & 0xe6) == 0xe6;
+			}
 		}
 		if (nIds >= 0x00000007) {
 			cpuid(info, 0x00000007);
 			avx2_ = (info[1] & (1 << 5)) != 0;
+			avx512_ = zmmState && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 17)) != 0;
+			avx512bw_ = zmmState && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+			avx512vl_ = zmmState && (info[1] & (1 << 16)) != 0 && (info[1] & (1u << 31)) != 0;
+			vaes_ = ymmState && avx2_ && aes_ && (info[2] & (1 << 9)) != 0;
 		}
 #elif defined(__aarch64__)
 	#if defined(HWCAP_AES)
@@ -69,8 +114,40 @@ namespace randomx {
 	#elif defined(__APPLE__)
 		aes_ = true;
 	#endif
+#elif defined(__riscv) && __riscv_xlen == 64
+	#if defined(__riscv_zba)
+		zba_ = true;
+	#endif
+	#if defined(__riscv_zbb)
+		zbb_ = true;
+	#endif
+	#if defined(HAVE_HWPROBE)
+		//Older kernels fail the call; then only the build's own -march counts
+		struct { int64_t key; uint64_t value; } pair = { RISCV_HWPROBE_KEY_IMA_EXT_0, 0 };
+		if (syscall(__NR_riscv_hwprobe, &pair, 1, 0, nullptr, 0) == 0 && pair.key == RISCV_HWPROBE_KEY_IMA_EXT_0) {
+			zba_ = zba_ || (pair.value & RISCV_HWPROBE_EXT_ZBA) != 0;
+			zbb_ = zbb_ || (pair.value & RISCV_HWPROBE_EXT_ZBB) != 0;
+		}
+	#endif
 #endif
 		//TODO POWER8 AES
 	}
 
+	bool Cpu::hasJccErratum() const {
+		if (!intel_ || family_ != 6)
+			return false;
+		switch (model_) {
+			case 0x4e: //Skylake (mobile)
+			case 0x5e: //Skylake
+			case 0x55: //Skylake-SP, Cascade Lake, Cooper Lake
+			case 0x8e: //Kaby Lake, Amber Lake, Whiskey Lake, Comet Lake (mobile)
+			case 0x9e: //Kaby Lake, Coffee Lake
+			case 0xa5: //Comet Lake
+			case 0xa6: //Comet Lake (mobile)
+				return true;
+			default:
+				return false;
+		}
+	}
+
 }
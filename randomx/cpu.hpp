@@ -42,8 +42,49 @@ namespace randomx {
 		bool hasAvx2() const {
 			return avx2_;
 		}
+		//AVX-512 F and DQ, with the ZMM state enabled by the OS
+		bool hasAvx512() const {
+			return avx512_;
+		}
+		//AVX-512 byte and word instructions (BW), with the ZMM state enabled by the OS
+		bool hasAvx512Bw() const {
+			return avx512bw_;
+		}
+		//AVX-512 on 128/256-bit vectors (VL), with the ZMM state enabled by the OS
+		bool hasAvx512Vl() const {
+			return avx512vl_;
+		}
+		//AES on 256-bit vectors (VAES with AVX2)
+		bool hasVaes() const {
+			return vaes_;
+		}
+		//RISC-V address generation (sh1add..sh3add) and rotates (ror, rori)
+		bool hasZba() const {
+			return zba_;
+		}
+		bool hasZbb() const {
+			return zbb_;
+		}
+		//x86 vendor (Hygon counts as AMD) and display family/model
+		bool isIntel() const {
+			return intel_;
+		}
+		bool isAmd() const {
+			return amd_;
+		}
+		int family() const {
+			return family_;
+		}
+		int model() const {
+			return model_;
+		}
+		//Skylake-derived Intel core that needs jumps kept off 32-byte boundaries
+		//(JCC erratum microcode update)
+		bool hasJccErratum() const;
 	private:
-		bool aes_, ssse3_, avx2_;
+		bool aes_, ssse3_, avx2_, avx512_, avx512bw_, avx512vl_, vaes_, zba_, zbb_;
+		bool intel_, amd_;
+		int family_, model_;
 	};
 
 }
@@ -68,7 +68,7 @@ namespace randomx {
 	template void deallocCache<DefaultAllocator>(randomx_cache* cache);
 	template void deallocCache<LargePageAllocator>(randomx_cache* cache);
 
-	void initCache(randomx_cache* cache, const void* key, size_t keySize) {
+	void fillCacheMemory(randomx_cache* cache, const void* key, size_t keySize) {
 		uint32_t memory_blocks, segment_length;
 		argon2_instance_t instance;
 		argon2_context context;
@@ -123,7 +123,9 @@ namespace randomx {
 		randomx_argon2_initialize(&instance, &context);
 
 		randomx_argon2_fill_memory_blocks(&instance);
+	}
 
+	void restoreCache(randomx_cache* cache, const void* key, size_t keySize) {
 		cache->reciprocalCache.clear();
 		randomx::Blake2Generator gen(key, keySize);
 		for (int i = 0; i < RANDOMX_CACHE_ACCESSES; ++i) {
@@ -139,30 +141,44 @@ namespace randomx {
 		}
 	}
 
+	void initCache(randomx_cache* cache, const void* key, size_t keySize) {
+		fillCacheMemory(cache, key, keySize);
+		restoreCache(cache, key, keySize);
+	}
+
+#if defined(RANDOMX_COMPILER_X86)
+	//whole batches through the AVX-512 code, the remaining items through the scalar JIT code
+	static void initDatasetBatch(randomx_cache* cache, uint8_t* dataset, uint32_t startItem, uint32_t endItem) {
+		const uint32_t batchEnd = startItem + (endItem - startItem) / DatasetBatchItems * DatasetBatchItems;
+		if (batchEnd != startItem)
+			cache->jit->getDatasetBatchFunc()(cache->memory, dataset, startItem, batchEnd);
+		if (batchEnd != endItem)
+			cache->jit->getDatasetInitFunc()(cache, dataset + (uint64_t)(batchEnd - startItem) * CacheLineSize, batchEnd, endItem);
+	}
+#endif
+
 	void initCacheCompile(randomx_cache* cache, const void* key, size_t keySize) {
-		initCache(cache, key, keySize);
+		fillCacheMemory(cache, key, keySize);
+		restoreCacheCompile(cache, key, keySize);
+	}
+
+	void restoreCacheCompile(randomx_cache* cache, const void* key, size_t keySize) {
+		restoreCache(cache, key, keySize);
 		cache->jit->enableWriting();
 		cache->jit->generateSuperscalarHash(cache->programs, cache->reciprocalCache);
 		cache->jit->generateDatasetInitCode();
 		cache->jit->enableExecution();
+#if defined(RANDOMX_COMPILER_X86)
+		cache->datasetInit = cache->jit->generateSuperscalarBatch(cache->programs, cache->reciprocalCache) ? &initDatasetBatch : cache->jit->getDatasetInitFunc();
+#endif
 	}
 
-	constexpr uint64_t superscalarMul0 = 6364136223846793005ULL;
-	constexpr uint64_t superscalarAdd1 = 9298411001130361340ULL;
-	constexpr uint64_t superscalarAdd2 = 12065312585734608966ULL;
-	constexpr uint64_t superscalarAdd3 = 9306329213124626780ULL;
-	constexpr uint64_t superscalarAdd4 = 5281919268842080866ULL;
-	constexpr uint64_t superscalarAdd5 = 10536153434571861004ULL;
-	constexpr uint64_t superscalarAdd6 = 3398623926847679864ULL;
-	constexpr uint64_t superscalarAdd7 = 9549104520008361294ULL;
-
 	static inline uint8_t* getMixBlock(uint64_t registerValue, uint8_t *memory) {
 		constexpr uint32_t mask = CacheSize / CacheLineSize - 1;
 		return memory + (registerValue & mask) * CacheLineSize;
 	}
 
-	void initDatasetItem(randomx_cache* cache, uint8_t* out, uint64_t itemNumber) {
-		int_reg_t rl[8];
+	static FORCE_INLINE void calcDatasetItem(randomx_cache* cache, int_reg_t (&rl)[8], uint64_t itemNumber) {
 		uint8_t* mixBlock;
 		uint64_t registerValue = itemNumber;
 		rl[0] = (itemNumber + 1) * superscalarMul0;
@@ -185,12 +201,45 @@ namespace randomx {
 
 			registerValue = rl[prog.getAddressRegister()];
 		}
+	}
+
+	void initDatasetItem(randomx_cache* cache, uint8_t* out, uint64_t itemNumber) {
+		int_reg_t rl[8];
+		calcDatasetItem(cache, rl, itemNumber);
+		memcpy(out, &rl, CacheLineSize);
+	}
 
+	//Dataset items are only read back by hashing, much later: non-temporal
+	//stores keep 2 GB of output from evicting the cache lines and superscalar
+	//programs item generation needs, and skip the read-for-ownership
+	static FORCE_INLINE void storeDatasetItem(uint8_t* out, const int_reg_t (&rl)[8]) {
+#if defined(__SSE2__)
+		const __m128i* src = (const __m128i*)rl;
+		for (unsigned q = 0; q < 4; ++q)
+			_mm_stream_si128((__m128i*)out + q, _mm_loadu_si128(src + q));
+#elif defined(__aarch64__) && defined(__GNUC__)
+		asm volatile (
+			"stnp %1, %2, [%0]\n"
+			"stnp %3, %4, [%0, 16]\n"
+			"stnp %5, %6, [%0, 32]\n"
+			"stnp %7, %8, [%0, 48]\n"
+			: : "r"(out), "r"(rl[0]), "r"(rl[1]), "r"(rl[2]), "r"(rl[3]), "r"(rl[4]), "r"(rl[5]), "r"(rl[6]), "r"(rl[7])
+			: "memory");
+#else
 		memcpy(out, &rl, CacheLineSize);
+#endif
 	}
 
 	void initDataset(randomx_cache* cache, uint8_t* dataset, uint32_t startItem, uint32_t endItem) {
-		for (uint32_t itemNumber = startItem; itemNumber < endItem; ++itemNumber, dataset += CacheLineSize)
-			initDatasetItem(cache, dataset, itemNumber);
+		int_reg_t rl[8];
+		for (uint32_t itemNumber = startItem; itemNumber < endItem; ++itemNumber, dataset += CacheLineSize) {
+			calcDatasetItem(cache, rl, itemNumber);
+			storeDatasetItem(dataset, rl);
+		}
+#if defined(__SSE2__)
+		_mm_sfence();
+#elif defined(__aarch64__) && defined(__GNUC__)
+		asm volatile ("dmb ishst" : : : "memory");
+#endif
 	}
 }
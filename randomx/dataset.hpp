@@ -40,6 +40,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 struct randomx_dataset {
 	uint8_t* memory = nullptr;
 	randomx::DatasetDeallocFunc* dealloc;
+	bool hugePages1G = false;
+	uint64_t itemCount = randomx::DatasetSize / RANDOMX_DATASET_ITEM_SIZE; //fewer for a partial dataset
 };
 
 /* Global scope for C binding */
@@ -77,21 +79,41 @@ namespace randomx {
 
 	using DefaultAllocator = AlignedAllocator<CacheLineSize>;
 
+	//initial register values of a dataset item
+	constexpr uint64_t superscalarMul0 = 6364136223846793005ULL;
+	constexpr uint64_t superscalarAdd1 = 9298411001130361340ULL;
+	constexpr uint64_t superscalarAdd2 = 12065312585734608966ULL;
+	constexpr uint64_t superscalarAdd3 = 9306329213124626780ULL;
+	constexpr uint64_t superscalarAdd4 = 5281919268842080866ULL;
+	constexpr uint64_t superscalarAdd5 = 10536153434571861004ULL;
+	constexpr uint64_t superscalarAdd6 = 3398623926847679864ULL;
+	constexpr uint64_t superscalarAdd7 = 9549104520008361294ULL;
+
 	template<class Allocator>
 	void deallocDataset(randomx_dataset* dataset) {
 		if (dataset->memory != nullptr)
-			Allocator::freeMemory(dataset->memory, DatasetSize);
+			Allocator::freeMemory(dataset->memory, dataset->itemCount * RANDOMX_DATASET_ITEM_SIZE);
+	}
+
+	//views (randomx_create_dataset_view) don't own their memory
+	inline void deallocDatasetView(randomx_dataset*) {
 	}
 
 	template<class Allocator>
 	void deallocCache(randomx_cache* cache);
 
+	void fillCacheMemory(randomx_cache*, const void*, size_t);
 	void initCache(randomx_cache*, const void*, size_t);
 	void initCacheCompile(randomx_cache*, const void*, size_t);
+	void restoreCache(randomx_cache*, const void*, size_t);
+	void restoreCacheCompile(randomx_cache*, const void*, size_t);
 	void initDatasetItem(randomx_cache* cache, uint8_t* out, uint64_t blockNumber);
 	void initDataset(randomx_cache* cache, uint8_t* dataset, uint32_t startBlock, uint32_t endBlock);
 
 	inline randomx_argon2_impl* selectArgonImpl(randomx_flags flags) {
+		if (flags & RANDOMX_FLAG_ARGON2_AVX512) {
+			return randomx_argon2_impl_avx512();
+		}
 		if (flags & RANDOMX_FLAG_ARGON2_AVX2) {
 			return randomx_argon2_impl_avx2();
 		}
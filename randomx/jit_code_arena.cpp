@@ -0,0 +1,130 @@
+/*
+Copyright (c) 2018-2019, tevador <tevador@gmail.com>
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the copyright holder nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <bitset>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include "jit_code_arena.hpp"
+#include "virtual_memory.h"
+
+namespace randomx {
+
+	namespace {
+
+		constexpr size_t ChunkPages = JitArenaChunkSize / JitArenaPageSize;
+
+		struct Chunk {
+			uint8_t* code;
+			uint8_t* codeExec;
+			int node;
+			std::bitset<ChunkPages> used;    //page 0, the shared page, always
+		};
+
+		struct Arena {
+			std::mutex mutex;
+			std::vector<Chunk*> chunks;
+		};
+
+		//never destroyed: a VM may be released during static destruction
+		Arena& arena() {
+			static Arena* instance = new Arena();
+			return *instance;
+		}
+
+		//first fit: index of the first of pages free pages in a row, 0 if none
+		size_t findPages(const Chunk& chunk, size_t pages) {
+			size_t run = 0;
+			for (size_t i = 1; i < ChunkPages; ++i) {
+				run = chunk.used[i] ? 0 : run + 1;
+				if (run == pages)
+					return i + 1 - pages;
+			}
+			return 0;
+		}
+	}
+
+	namespace JitCodeArena {
+
+		bool allocate(size_t bytes, const uint8_t* sharedCode, size_t sharedSize, JitCodeSlot& slot) {
+			const size_t pages = bytes / JitArenaPageSize;
+			if (pages == 0 || pages >= ChunkPages || sharedSize > JitArenaPageSize)
+				return false;
+			const int node = currentMemoryNode();
+			Arena& arena = randomx::arena();
+			std::lock_guard<std::mutex> lock(arena.mutex);
+			Chunk* chunk = nullptr;
+			size_t first = 0;
+			for (Chunk* candidate : arena.chunks) {
+				if (candidate->node == node && (first = findPages(*candidate, pages)) != 0) {
+					chunk = candidate;
+					break;
+				}
+			}
+			if (chunk == nullptr) {
+				void* codeExec;
+				uint8_t* code = (uint8_t*)allocDualMappedHugePages(JitArenaChunkSize, &codeExec);
+				if (code == nullptr)
+					return false;
+				//faulted in here, under this thread's memory policy
+				memcpy(code, sharedCode, sharedSize);
+				chunk = new Chunk{ code, (uint8_t*)codeExec, node, {} };
+				chunk->used.set(0);
+				arena.chunks.push_back(chunk);
+				first = 1;
+			}
+			for (size_t i = first; i < first + pages; ++i)
+				chunk->used.set(i);
+			slot.code = chunk->code + first * JitArenaPageSize;
+			slot.codeExec = chunk->codeExec + first * JitArenaPageSize;
+			slot.shared = chunk->code;
+			slot.chunk = chunk;
+			return true;
+		}
+
+		void release(const JitCodeSlot& slot, size_t bytes) {
+			Chunk* chunk = (Chunk*)slot.chunk;
+			const size_t first = (slot.code - chunk->code) / JitArenaPageSize;
+			Arena& arena = randomx::arena();
+			std::lock_guard<std::mutex> lock(arena.mutex);
+			for (size_t i = first; i < first + bytes / JitArenaPageSize; ++i)
+				chunk->used.reset(i);
+			if (chunk->used.count() > 1)
+				return;
+			for (size_t i = 0; i < arena.chunks.size(); ++i) {
+				if (arena.chunks[i] == chunk) {
+					arena.chunks.erase(arena.chunks.begin() + i);
+					break;
+				}
+			}
+			freePagedMemory(chunk->codeExec, JitArenaChunkSize);
+			freePagedMemory(chunk->code, JitArenaChunkSize);
+			delete chunk;
+		}
+	}
+}
@@ -0,0 +1,61 @@
+/*
+Copyright (c) 2018-2019, tevador <tevador@gmail.com>
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the copyright holder nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace randomx {
+
+	constexpr size_t JitArenaPageSize = 4096;
+	constexpr size_t JitArenaChunkSize = 2 * 1024 * 1024;
+
+	//A run of pages in a JIT code arena chunk
+	struct JitCodeSlot {
+		uint8_t* code;        //writable view
+		uint8_t* codeExec;    //executable view of the same pages
+		uint8_t* shared;      //writable view of the chunk's shared page
+		void* chunk;
+	};
+
+	//JIT code buffers of the VMs on one NUMA node, packed into 2 MB chunks
+	//instead of a mapping of their own each: a chunk is one huge page where
+	//the kernel gives one (allocDualMappedHugePages), so the VMs running on
+	//a node share iTLB entries. The first page of every chunk holds read-only
+	//code all its slots share, which they reach with rel32 jumps. Chunks are
+	//dual mapped (W^X without mprotect, which would split the huge page), so
+	//there is no arena where dual mapping is unavailable. Thread-safe.
+	namespace JitCodeArena {
+		//bytes: a multiple of JitArenaPageSize. sharedCode is copied into
+		//the shared page of a new chunk; every caller must pass the same.
+		//False if no chunk could be mapped.
+		bool allocate(size_t bytes, const uint8_t* sharedCode, size_t sharedSize, JitCodeSlot& slot);
+		void release(const JitCodeSlot& slot, size_t bytes);
+	}
+}
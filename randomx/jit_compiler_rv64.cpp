@@ -36,12 +36,19 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "program.hpp"
 #include "reciprocal.h"
 #include "virtual_memory.h"
+#include "cpu.hpp"
 
 
 namespace {
 #define HANDLER_ARGS randomx::CompilerState& state, randomx::Instruction isn, int i
 	using InstructionHandler = void(HANDLER_ARGS);
 	extern InstructionHandler* opcodeMap1[256];
+
+	//Zba and Zbb are used in generated code when the CPU reports them, even if
+	//the build (and so the static code) targets plain rv64gc
+	const randomx::Cpu cpu;
+	const bool hasZba = cpu.hasZba();
+	const bool hasZbb = cpu.hasZbb();
 }
 
 namespace rv64 {
@@ -515,16 +522,15 @@ namespace randomx {
 					//c.add x{dst}, x{src}
 					buf.emit(rvc(rv64::C_ADD, regSS(isn.dst), regSS(isn.src)));
 				}
+				else if (hasZba) {
+					//sh{1,2,3}add x{dst}, x{src}, x{dst}
+					buf.emit(rv64::SHXADD | rvrs2(regSS(isn.dst)) | rvrs1(regSS(isn.src)) | (shift << 13) | rvrd(regSS(isn.dst)));
+				}
 				else {
-#ifdef __riscv_zba
-				//sh{1,2,3}add x{dst}, x{src}, x{dst}
-				buf.emit(rv64::SHXADD | rvrs2(regSS(isn.dst)) | rvrs1(regSS(isn.src)) | (shift << 13) | rvrd(regSS(isn.dst)));
-#else
-				//slli x28, x{src}, {shift}
-				buf.emit(rvi(rv64::SLLI, SshTmp1Reg, regSS(isn.src), shift));
-				//c.add x{dst}, x28
-				buf.emit(rvc(rv64::C_ADD, regSS(isn.dst), SshTmp1Reg));
-#endif
+					//slli x28, x{src}, {shift}
+					buf.emit(rvi(rv64::SLLI, SshTmp1Reg, regSS(isn.src), shift));
+					//c.add x{dst}, x28
+					buf.emit(rvc(rv64::C_ADD, regSS(isn.dst), SshTmp1Reg));
 				}
 			}
 			break;
@@ -534,22 +540,23 @@ namespace randomx {
 			break;
 		case randomx::SuperscalarInstructionType::IROR_C:
 			{
-#ifdef __riscv_zbb
-				int32_t imm = isn.getImm32() & 63;
-				//rori x{dst}, x{dst}, {imm}
-				buf.emit(rvi(rv64::RORI, regSS(isn.dst), regSS(isn.dst), imm));
-#else
-				int32_t immr = isn.getImm32() & 63;
-				int32_t imml = -immr & 63;
-				int32_t imml5 = imml >> 5;
-				int32_t imml40 = imml & 31;
-				//srli x28, x{dst}, {immr}
-				buf.emit(rvi(rv64::SRLI, SshTmp1Reg, regSS(isn.dst), immr));
-				//c.slli x{dst}, {imml}
-				buf.emit(rvc(rv64::C_SLLI, imml5, regSS(isn.dst), imml40));
-				//or x{dst}, x{dst}, x28
-				buf.emit(rvi(rv64::OR, regSS(isn.dst), regSS(isn.dst), SshTmp1Reg));
-#endif
+				if (hasZbb) {
+					int32_t imm = isn.getImm32() & 63;
+					//rori x{dst}, x{dst}, {imm}
+					buf.emit(rvi(rv64::RORI, regSS(isn.dst), regSS(isn.dst), imm));
+				}
+				else {
+					int32_t immr = isn.getImm32() & 63;
+					int32_t imml = -immr & 63;
+					int32_t imml5 = imml >> 5;
+					int32_t imml40 = imml & 31;
+					//srli x28, x{dst}, {immr}
+					buf.emit(rvi(rv64::SRLI, SshTmp1Reg, regSS(isn.dst), immr));
+					//c.slli x{dst}, {imml}
+					buf.emit(rvc(rv64::C_SLLI, imml5, regSS(isn.dst), imml40));
+					//or x{dst}, x{dst}, x28
+					buf.emit(rvi(rv64::OR, regSS(isn.dst), regSS(isn.dst), SshTmp1Reg));
+				}
 			}
 			break;
 		case randomx::SuperscalarInstructionType::IADD_C7:
@@ -683,15 +690,16 @@ namespace randomx {
 			state.emit(rvc(rv64::C_ADD, regR(isn.dst), regR(isn.src)));
 		}
 		else {
-#ifdef __riscv_zba
-			//sh{1,2,3}add x{dst}, x{src}, x{dst}
-			state.emit(rv64::SHXADD | rvrs2(regR(isn.dst)) | rvrs1(regR(isn.src)) | (shift << 13) | rvrd(regR(isn.dst)));
-#else
-			//slli x8, x{src}, {shift}
-			state.emit(rvi(rv64::SLLI, Tmp1Reg, regR(isn.src), shift));
-			//c.add x{dst}, x8
-			state.emit(rvc(rv64::C_ADD, regR(isn.dst), Tmp1Reg));
-#endif
+			if (hasZba) {
+				//sh{1,2,3}add x{dst}, x{src}, x{dst}
+				state.emit(rv64::SHXADD | rvrs2(regR(isn.dst)) | rvrs1(regR(isn.src)) | (shift << 13) | rvrd(regR(isn.dst)));
+			}
+			else {
+				//slli x8, x{src}, {shift}
+				state.emit(rvi(rv64::SLLI, Tmp1Reg, regR(isn.src), shift));
+				//c.add x{dst}, x8
+				state.emit(rvc(rv64::C_ADD, regR(isn.dst), Tmp1Reg));
+			}
 		}
 		if (isn.dst == RegisterNeedsDisplacement) {
 			int32_t imm = unsigned32ToSigned2sCompl(isn.getImm32());
@@ -830,78 +838,80 @@ namespace randomx {
 
 	static void v1_IROR_R(HANDLER_ARGS) {
 		state.registerUsage[isn.dst] = i;
-#ifdef __riscv_zbb
-		if (isn.src != isn.dst) {
-			//ror x{dst}, x{dst}, x{src}
-			state.emit(rvi(rv64::ROR, regR(isn.dst), regR(isn.dst), regR(isn.src)));
-		}
-		else {
-			int32_t imm = isn.getImm32() & 63;
-			//rori x{dst}, x{dst}, {imm}
-			state.emit(rvi(rv64::RORI, regR(isn.dst), regR(isn.dst), imm));
-		}
-#else
-		if (isn.src != isn.dst) {
-			//sub x8, x0, x{src}
-			state.emit(rvi(rv64::SUB, Tmp1Reg, 0, regR(isn.src)));
-			//srl x9, x{dst}, x{src}
-			state.emit(rvi(rv64::SRL, Tmp2Reg, regR(isn.dst), regR(isn.src)));
-			//sll x{dst}, x{dst}, x8
-			state.emit(rvi(rv64::SLL, regR(isn.dst), regR(isn.dst), Tmp1Reg));
-			//or x{dst}, x{dst}, x9
-			state.emit(rvi(rv64::OR, regR(isn.dst), regR(isn.dst), Tmp2Reg));
+		if (hasZbb) {
+			if (isn.src != isn.dst) {
+				//ror x{dst}, x{dst}, x{src}
+				state.emit(rvi(rv64::ROR, regR(isn.dst), regR(isn.dst), regR(isn.src)));
+			}
+			else {
+				int32_t imm = isn.getImm32() & 63;
+				//rori x{dst}, x{dst}, {imm}
+				state.emit(rvi(rv64::RORI, regR(isn.dst), regR(isn.dst), imm));
+			}
 		}
 		else {
-			int32_t immr = isn.getImm32() & 63;
-			int32_t imml = -immr & 63;
-			int32_t imml5 = imml >> 5;
-			int32_t imml40 = imml & 31;
-			//srli x8, x{dst}, {immr}
-			state.emit(rvi(rv64::SRLI, Tmp1Reg, regR(isn.dst), immr));
-			//c.slli x{dst}, {imml}
-			state.emit(rvc(rv64::C_SLLI, imml5, regR(isn.dst), imml40));
-			//or x{dst}, x{dst}, x8
-			state.emit(rvi(rv64::OR, regR(isn.dst), regR(isn.dst), Tmp1Reg));
+			if (isn.src != isn.dst) {
+				//sub x8, x0, x{src}
+				state.emit(rvi(rv64::SUB, Tmp1Reg, 0, regR(isn.src)));
+				//srl x9, x{dst}, x{src}
+				state.emit(rvi(rv64::SRL, Tmp2Reg, regR(isn.dst), regR(isn.src)));
+				//sll x{dst}, x{dst}, x8
+				state.emit(rvi(rv64::SLL, regR(isn.dst), regR(isn.dst), Tmp1Reg));
+				//or x{dst}, x{dst}, x9
+				state.emit(rvi(rv64::OR, regR(isn.dst), regR(isn.dst), Tmp2Reg));
+			}
+			else {
+				int32_t immr = isn.getImm32() & 63;
+				int32_t imml = -immr & 63;
+				int32_t imml5 = imml >> 5;
+				int32_t imml40 = imml & 31;
+				//srli x8, x{dst}, {immr}
+				state.emit(rvi(rv64::SRLI, Tmp1Reg, regR(isn.dst), immr));
+				//c.slli x{dst}, {imml}
+				state.emit(rvc(rv64::C_SLLI, imml5, regR(isn.dst), imml40));
+				//or x{dst}, x{dst}, x8
+				state.emit(rvi(rv64::OR, regR(isn.dst), regR(isn.dst), Tmp1Reg));
+			}
 		}
-#endif
 	}
 
 	static void v1_IROL_R(HANDLER_ARGS) {
 		state.registerUsage[isn.dst] = i;
-#ifdef __riscv_zbb
-		if (isn.src != isn.dst) {
-			//rol x{dst}, x{dst}, x{src}
-			state.emit(rvi(rv64::ROL, regR(isn.dst), regR(isn.dst), regR(isn.src)));
-		}
-		else {
-			int32_t imm = -isn.getImm32() & 63;
-			//rori x{dst}, x{dst}, {imm}
-			state.emit(rvi(rv64::RORI, regR(isn.dst), regR(isn.dst), imm));
-		}
-#else
-		if (isn.src != isn.dst) {
-			//sub x8, x0, x{src}
-			state.emit(rvi(rv64::SUB, Tmp1Reg, 0, regR(isn.src)));
-			//sll x9, x{dst}, x{src}
-			state.emit(rvi(rv64::SLL, Tmp2Reg, regR(isn.dst), regR(isn.src)));
-			//srl x{dst}, x{dst}, x8
-			state.emit(rvi(rv64::SRL, regR(isn.dst), regR(isn.dst), Tmp1Reg));
-			//or x{dst}, x{dst}, x9
-			state.emit(rvi(rv64::OR, regR(isn.dst), regR(isn.dst), Tmp2Reg));
+		if (hasZbb) {
+			if (isn.src != isn.dst) {
+				//rol x{dst}, x{dst}, x{src}
+				state.emit(rvi(rv64::ROL, regR(isn.dst), regR(isn.dst), regR(isn.src)));
+			}
+			else {
+				int32_t imm = -isn.getImm32() & 63;
+				//rori x{dst}, x{dst}, {imm}
+				state.emit(rvi(rv64::RORI, regR(isn.dst), regR(isn.dst), imm));
+			}
 		}
 		else {
-			int32_t imml = isn.getImm32() & 63;
-			int32_t immr = -imml & 63;
-			int32_t imml5 = imml >> 5;
-			int32_t imml40 = imml & 31;
-			//srli x8, x{dst}, {immr}
-			state.emit(rvi(rv64::SRLI, Tmp1Reg, regR(isn.dst), immr));
-			//c.slli x{dst}, {imml}
-			state.emit(rvc(rv64::C_SLLI, imml5, regR(isn.dst), imml40));
-			//or x{dst}, x{dst}, x8
-			state.emit(rvi(rv64::OR, regR(isn.dst), regR(isn.dst), Tmp1Reg));
+			if (isn.src != isn.dst) {
+				//sub x8, x0, x{src}
+				state.emit(rvi(rv64::SUB, Tmp1Reg, 0, regR(isn.src)));
+				//sll x9, x{dst}, x{src}
+				state.emit(rvi(rv64::SLL, Tmp2Reg, regR(isn.dst), regR(isn.src)));
+				//srl x{dst}, x{dst}, x8
+				state.emit(rvi(rv64::SRL, regR(isn.dst), regR(isn.dst), Tmp1Reg));
+				//or x{dst}, x{dst}, x9
+				state.emit(rvi(rv64::OR, regR(isn.dst), regR(isn.dst), Tmp2Reg));
+			}
+			else {
+				int32_t imml = isn.getImm32() & 63;
+				int32_t immr = -imml & 63;
+				int32_t imml5 = imml >> 5;
+				int32_t imml40 = imml & 31;
+				//srli x8, x{dst}, {immr}
+				state.emit(rvi(rv64::SRLI, Tmp1Reg, regR(isn.dst), immr));
+				//c.slli x{dst}, {imml}
+				state.emit(rvc(rv64::C_SLLI, imml5, regR(isn.dst), imml40));
+				//or x{dst}, x{dst}, x8
+				state.emit(rvi(rv64::OR, regR(isn.dst), regR(isn.dst), Tmp1Reg));
+			}
 		}
-#endif
 	}
 
 	static void v1_ISWAP_R(HANDLER_ARGS) {
@@ -1096,18 +1106,19 @@ namespace randomx {
 	static void v1_CFROUND(HANDLER_ARGS) {
 		int32_t imm = (isn.getImm32() - 2) & 63; //-2 to avoid a later left shift to multiply by 4
 		if (imm != 0) {
-#ifdef __riscv_zbb
-			//rori x8, x{src}, {imm}
-			state.emit(rvi(rv64::RORI, Tmp1Reg, regR(isn.src), imm));
-#else
-			int32_t imml = -imm & 63;
-			//srli x8, x{src}, {imm}
-			state.emit(rvi(rv64::SRLI, Tmp1Reg, regR(isn.src), imm));
-			//slli x9, x{src}, {imml}
-			state.emit(rvi(rv64::SLLI, Tmp2Reg, regR(isn.src), imml));
-			//c.or x8, x9
-			state.emit(rvc(rv64::C_OR, Tmp1Reg + OffsetXC, Tmp2Reg + OffsetXC));
-#endif
+			if (hasZbb) {
+				//rori x8, x{src}, {imm}
+				state.emit(rvi(rv64::RORI, Tmp1Reg, regR(isn.src), imm));
+			}
+			else {
+				int32_t imml = -imm & 63;
+				//srli x8, x{src}, {imm}
+				state.emit(rvi(rv64::SRLI, Tmp1Reg, regR(isn.src), imm));
+				//slli x9, x{src}, {imml}
+				state.emit(rvi(rv64::SLLI, Tmp2Reg, regR(isn.src), imml));
+				//c.or x8, x9
+				state.emit(rvc(rv64::C_OR, Tmp1Reg + OffsetXC, Tmp2Reg + OffsetXC));
+			}
 			//c.andi x8, 12
 			state.emit(rvc(rv64::C_ANDI, Tmp1Reg + OffsetXC, 12));
 		}
@@ -29,12 +29,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdexcept>
 #include <cstring>
 #include <climits>
-#include "jit_compiler_x86.hpp"
+#include <initializer_list>
+#include "jit_compiler.hpp"
 #include "jit_compiler_x86_static.hpp"
 #include "superscalar.hpp"
 #include "program.hpp"
 #include "reciprocal.h"
 #include "virtual_memory.h"
+#include "dataset.hpp"
+#include "cpu.hpp"
 
 namespace randomx {
 	/*
@@ -78,7 +81,7 @@ namespace randomx {
 
 	//Calculate the required code buffer size that is sufficient for the largest possible program:
 
-	constexpr size_t MaxRandomXInstrCodeSize = 32;   //FDIV_M requires up to 32 bytes of x86 code
+	constexpr size_t MaxRandomXInstrCodeSize = 33;   //CBRANCH requires up to 33 bytes of x86 code with JCC erratum padding (keep SUPERSCALAR_OFFSET in jit_compiler_x86_static.S/.asm in sync)
 	constexpr size_t MaxSuperscalarInstrSize = 14;   //IMUL_RCP requires 14 bytes of x86 code
 	constexpr size_t SuperscalarProgramHeader = 128; //overhead per superscalar program
 	constexpr size_t CodeAlign = 4096;               //align code size to a multiple of 4 KiB
@@ -94,6 +97,13 @@ namespace randomx {
 
 	constexpr int32_t superScalarHashOffset = RandomXCodeSize;
 
+	constexpr size_t MaxBatchInstrSize = 136;        //ISMULH_R requires 131 bytes of AVX-512 code
+	constexpr size_t BatchProgramHeader = 320;       //mix block gathers and prefetches per superscalar program
+	constexpr size_t BatchConstantsSize = 64 + 8 * (24 + SuperscalarMaxSize * RANDOMX_CACHE_ACCESSES);
+	constexpr size_t BatchCodeSize = alignSize(ReserveCodeSize + (BatchProgramHeader + MaxBatchInstrSize * SuperscalarMaxSize) * RANDOMX_CACHE_ACCESSES + BatchConstantsSize, CodeAlign);
+
+	static_assert(BatchCodeSize < INT32_MAX / 2, "BatchCodeSize is too large");
+
 #if defined(_MSC_VER) && (defined(_DEBUG) || defined (RELWITHDEBINFO))
 #define ADDR(x) ((((uint8_t*)&x)[0] == 0xE9) ? (((uint8_t*)&x) + *(const int32_t*)(((uint8_t*)&x) + 1) + 5) : ((uint8_t*)&x))
 #else
@@ -129,8 +139,6 @@ namespace randomx {
 	const int32_t codeSshPrefetchSize = codeShhEnd - codeShhPrefetch;
 	const int32_t codeSshInitSize = codeProgramEnd - codeShhInit;
 
-	const int32_t epilogueOffset = CodeSize - epilogueSize;
-
 	static const uint8_t REX_ADD_RR[] = { 0x4d, 0x03 };
 	static const uint8_t REX_ADD_RM[] = { 0x4c, 0x03 };
 	static const uint8_t REX_SUB_RR[] = { 0x4d, 0x2b };
@@ -207,6 +215,24 @@ namespace randomx {
 	static const uint8_t LEA_32[] = { 0x41, 0x8d };
 	static const uint8_t MOVNTI[] = { 0x4c, 0x0f, 0xc3 };
 	static const uint8_t ADD_EBX_I[] = { 0x81, 0xc3 };
+	static const uint8_t CMP_EBX_I[] = { 0x81, 0xfb };
+	static const uint8_t JAE_SHORT = 0x73;
+	static const uint8_t JMP_SHORT = 0xeb;
+	static const uint8_t SHL_RBX_6[] = { 0x48, 0xc1, 0xe3, 0x06 };
+	static const uint8_t MOV_EAX_EBP[] = { 0x89, 0xe8 };
+	static const uint8_t ADD_EAX_I = 0x05;
+	static const uint8_t PREFETCHT0_RDI_RAX[] = { 0x0f, 0x18, 0x0c, 0x07 };
+	//mov r8..r15, qword ptr [rcx+rbx+0..56]
+	static const uint8_t LOAD_ITEM_RCX_RBX[] = {
+		0x4c, 0x8b, 0x04, 0x19,
+		0x4c, 0x8b, 0x4c, 0x19, 0x08,
+		0x4c, 0x8b, 0x54, 0x19, 0x10,
+		0x4c, 0x8b, 0x5c, 0x19, 0x18,
+		0x4c, 0x8b, 0x64, 0x19, 0x20,
+		0x4c, 0x8b, 0x6c, 0x19, 0x28,
+		0x4c, 0x8b, 0x74, 0x19, 0x30,
+		0x4c, 0x8b, 0x7c, 0x19, 0x38,
+	};
 
 	static const uint8_t NOP1[] = { 0x90 };
 	static const uint8_t NOP2[] = { 0x66, 0x90 };
@@ -219,32 +245,172 @@ namespace randomx {
 
 	static const uint8_t* NOPX[] = { NOP1, NOP2, NOP3, NOP4, NOP5, NOP6, NOP7, NOP8 };
 
+	enum TemplateFlagsX86 : uint8_t {
+		TemplateSetsDst = 1,      //registerUsage[dst] = i
+		TemplateSetsSrc = 2,      //registerUsage[src] = i
+		TemplateAddress = 4,      //preceded by the scratchpad address of src in eax, as genAddressReg
+		TemplateAddressRcx = 8,   //... in ecx
+		TemplateAddressDst = 16,  //preceded by the ISTORE address of dst in eax (L3 mask for StoreL3Condition)
+	};
+
+	//Up to 16 bytes of x86 code for one instruction form with every register field at
+	//its base value. dstStep and srcStep hold the per-byte multiples of dst and src that
+	//are added to the ModRM/SIB fields (a field never carries into the next byte), and
+	//the masked imm32 is stored at immPos, so emitting a form takes no branches.
+	struct InstructionTemplateX86 {
+		uint64_t code[2];
+		uint64_t dstStep[2];
+		uint64_t srcStep[2];
+		uint32_t immMask;
+		uint8_t immPos;
+		uint8_t size;
+		uint8_t regMask;
+		uint8_t flags;
+		//address prefix: lea eax/ecx, [reg+imm32]; and eax/ecx, mask
+		uint8_t address;          //1 if the form has one
+		uint8_t addressModrm;
+		uint8_t addressAndSize;
+		uint16_t addressAnd;
+
+		InstructionTemplateX86(int regCount, uint8_t flags) : code(), dstStep(), srcStep(), immMask(0), immPos(16), size(0), regMask(regCount - 1), flags(flags) {
+			const bool rcx = (flags & TemplateAddressRcx) != 0;
+			address = (flags & (TemplateAddress | TemplateAddressRcx | TemplateAddressDst)) != 0;
+			addressModrm = rcx ? 0x88 : 0x80;
+			addressAndSize = rcx ? sizeof(AND_ECX_I) : 1;
+			addressAnd = rcx ? AND_ECX_I[0] | AND_ECX_I[1] << 8 : AND_EAX_I;
+		}
+
+		template<size_t N>
+		InstructionTemplateX86& op(const uint8_t (&bytes)[N]) {
+			for (size_t i = 0; i < N; ++i)
+				put(bytes[i], 0, 0);
+			return *this;
+		}
+
+		InstructionTemplateX86& byte(uint8_t value) {
+			put(value, 0, 0);
+			return *this;
+		}
+
+		InstructionTemplateX86& reg(uint8_t base, uint8_t dstMul, uint8_t srcMul) {
+			put(base, dstMul, srcMul);
+			return *this;
+		}
+
+		//the imm32 (or a low imm8 when it ends the template)
+		InstructionTemplateX86& imm(uint32_t mask, int immSize = 4) {
+			immMask = mask;
+			immPos = size;
+			size += immSize;
+			return *this;
+		}
+
+	private:
+		void put(uint8_t value, uint8_t dstMul, uint8_t srcMul) {
+			const int shift = 8 * (size % 8);
+			code[size / 8] |= (uint64_t)value << shift;
+			dstStep[size / 8] |= (uint64_t)dstMul << shift;
+			srcStep[size / 8] |= (uint64_t)srcMul << shift;
+			size++;
+		}
+	};
+
+	static const JitProfileX86 profiles[] = {
+		{ "generic", false, PrefetchT0, false },
+		{ "skylake", true, PrefetchT0, false },
+		{ "intel", false, PrefetchT0, false },
+		{ "zen", false, PrefetchT0, true },
+		{ "nta", false, PrefetchNta, false },
+		{ "load", false, PrefetchLoad, false },
+		{ "skzen", true, PrefetchT0, true },
+	};
+
+	static const JitProfileX86* detectProfile() {
+		Cpu cpu;
+		if (cpu.hasJccErratum())
+			return &profiles[1];
+		if (cpu.isIntel())
+			return &profiles[2];
+		if (cpu.isAmd())
+			return &profiles[3];
+		return &profiles[0];
+	}
+
+	//set before any compiler is created; each compiler keeps the profile it started with
+	static const JitProfileX86* forcedProfile = nullptr;
+
+	bool JitCompilerX86::setProfile(const char* name) {
+		if (name == nullptr || strcmp(name, "auto") == 0) {
+			forcedProfile = nullptr;
+			return true;
+		}
+		for (const JitProfileX86& p : profiles) {
+			if (strcmp(p.name, name) == 0) {
+				forcedProfile = &p;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	const JitProfileX86& JitCompilerX86::getProfile() {
+		static const JitProfileX86* detected = detectProfile();
+		return forcedProfile != nullptr ? *forcedProfile : *detected;
+	}
+
 	size_t JitCompilerX86::getCodeSize() {
-		return CodeSize;
+		return codeSize;
 	}
 
-	JitCompilerX86::JitCompilerX86() {
-		code = (uint8_t*)allocMemoryPages(CodeSize);
-		if (code == nullptr)
-			throw std::runtime_error("allocMemoryPages");
+	JitCompilerX86::JitCompilerX86(JitLayoutX86 layout) : profile(&getProfile()) {
+		//fast-mode VMs never call the superscalar hash, so they don't map it
+		codeSize = layout == JitLayoutProgram ? RandomXCodeSize : CodeSize;
+		slot.chunk = nullptr;
+		if (JitCodeArena::allocate(codeSize, codeEpilogue, epilogueSize, slot)) {
+			code = slot.code;
+			codeExec = slot.codeExec;
+			epilogueOffset = (int32_t)(slot.shared - code);
+		}
+		else {
+			//with two views of the code, W^X holds without mprotect per program
+			code = (uint8_t*)allocDualMappedMemory(codeSize, (void**)&codeExec);
+			if (code == nullptr) {
+				code = codeExec = (uint8_t*)allocMemoryPages(codeSize);
+				if (code == nullptr)
+					throw std::runtime_error("allocMemoryPages");
+			}
+			epilogueOffset = (int32_t)(codeSize - epilogueSize);
+			memcpy(code + epilogueOffset, codeEpilogue, epilogueSize);
+		}
 		memcpy(code, codePrologue, prologueSize);
-		memcpy(code + epilogueOffset, codeEpilogue, epilogueSize);
 	}
 
 	JitCompilerX86::~JitCompilerX86() {
-		freePagedMemory(code, CodeSize);
+		if (slot.chunk != nullptr) {
+			JitCodeArena::release(slot, codeSize);
+		}
+		else {
+			if (codeExec != code)
+				freePagedMemory(codeExec, codeSize);
+			freePagedMemory(code, codeSize);
+		}
+		if (batchCode != nullptr)
+			freePagedMemory(batchCode, BatchCodeSize);
 	}
 
 	void JitCompilerX86::enableAll() {
-		setPagesRWX(code, CodeSize);
+		if (codeExec == code)
+			setPagesRWX(code, codeSize);
 	}
 
 	void JitCompilerX86::enableWriting() {
-		setPagesRW(code, CodeSize);
+		if (codeExec == code)
+			setPagesRW(code, codeSize);
 	}
 
 	void JitCompilerX86::enableExecution() {
-		setPagesRX(code, CodeSize);
+		if (codeExec == code)
+			setPagesRX(code, codeSize);
 	}
 
 	void JitCompilerX86::generateProgram(Program& prog, ProgramConfiguration& pcfg) {
@@ -259,6 +425,34 @@ namespace randomx {
 		emit(codeReadDatasetLightSshInit, readDatasetLightInitSize);
 		emit(ADD_EBX_I);
 		emit32(datasetOffset / CacheLineSize);
+		emitNextItemPrefetch(datasetOffset);
+		alignJump(5);
+		emitByte(CALL);
+		emit32(superScalarHashOffset - (codePos + 4));
+		emit(codeReadDatasetLightSshFin, readDatasetLightFinSize);
+		generateProgramEpilogue(prog, pcfg);
+	}
+
+	void JitCompilerX86::generateProgramPartial(Program& prog, ProgramConfiguration& pcfg, uint32_t datasetOffset, const uint8_t* items, uint32_t itemCount) {
+		//as generateProgramLight, but items below itemCount are loaded from memory
+		//into r8-r15 (where the superscalar hash leaves its result) instead of computed
+		constexpr uint8_t CallSize = 5;
+		constexpr uint8_t ResidentSize = sizeof(MOV_RCX_I) + 8 + sizeof(SHL_RBX_6) + sizeof(LOAD_ITEM_RCX_RBX) + 2;
+		generateProgramPrologue(prog, pcfg);
+		emit(codeReadDatasetLightSshInit, readDatasetLightInitSize);
+		emit(ADD_EBX_I);
+		emit32(datasetOffset / CacheLineSize);
+		emitNextItemPrefetch(datasetOffset);
+		emit(CMP_EBX_I);
+		emit32(itemCount);
+		emitByte(JAE_SHORT);
+		emitByte(ResidentSize);
+		emit(MOV_RCX_I);
+		emit64((uint64_t)items);
+		emit(SHL_RBX_6);
+		emit(LOAD_ITEM_RCX_RBX);
+		emitByte(JMP_SHORT);
+		emitByte(CallSize);
 		emitByte(CALL);
 		emit32(superScalarHashOffset - (codePos + 4));
 		emit(codeReadDatasetLightSshFin, readDatasetLightFinSize);
@@ -301,8 +495,332 @@ namespace randomx {
 		memcpy(code, codeDatasetInit, datasetInitSize);
 	}
 
+	/*
+
+	SUPERSCALAR BATCH (AVX-512): DatasetBatchItems dataset items at a time, item i of the batch in lane i
+
+	; rax -> temporary
+	; rcx -> end item
+	; rsi -> dataset pointer
+	; rdi -> cache memory
+	; rbp -> item number
+	; rsp -> mix block offsets (64 bytes), transposed output (512 bytes)
+	; zmm16-zmm23 -> "r0"-"r7"
+	; zmm24-zmm29 -> temporary
+	; zmm30 -> mix block offsets
+	; zmm31 -> mix block qwords
+
+	Only zmm16-zmm31 are used: they need no vzeroupper, and none is callee-saved on Windows.
+
+	*/
+
+	namespace {
+		constexpr int BatchReg = 16;
+		constexpr int BatchTmp = 24;
+		constexpr int BatchAddr = 30;
+		constexpr int BatchMix = 31;
+		constexpr int32_t BatchStackSize = 64 + 512;
+
+		constexpr uint8_t EvexMap0F = 1;
+		constexpr uint8_t EvexMap0F38 = 2;
+		constexpr uint8_t Evex66 = 1;
+		constexpr uint8_t EvexF3 = 2;
+
+		constexpr uint8_t VPADDQ = 0xd4;
+		constexpr uint8_t VPSUBQ = 0xfb;
+		constexpr uint8_t VPXORQ = 0xef;
+		constexpr uint8_t VPANDQ = 0xdb;
+		constexpr uint8_t VPMULUDQ = 0xf4;
+		constexpr uint8_t VPMULLQ = 0x40;      //0F38
+		constexpr uint8_t VPSHIFTQ_I = 0x73;   // /2 vpsrlq, /6 vpsllq
+		constexpr uint8_t VPROTQ_I = 0x72;     // /0 vprorq, /4 vpsraq
+
+		//constant pool indices
+		enum BatchConst {
+			ConstIota = 0,  //8 qwords: 0, 1, ..., 7
+			ConstOne = 8,
+			ConstMul0,
+			ConstAdd1,      //ConstAdd1 + k - 1 = superscalarAddk
+			ConstCacheMask = ConstAdd1 + 7,
+			ConstLow32
+		};
+
+		class BatchEmitter {
+		public:
+			BatchEmitter(uint8_t* code) {
+				buf.code = code;
+				buf.codePos = 0;
+				buf.rcpCount = 0;
+				for (uint64_t i = 0; i < 8; ++i)
+					constants.push_back(i);
+				constants.push_back(1);
+				constants.push_back(superscalarMul0);
+				for (uint64_t add : { superscalarAdd1, superscalarAdd2, superscalarAdd3, superscalarAdd4,
+					superscalarAdd5, superscalarAdd6, superscalarAdd7 })
+					constants.push_back(add);
+				constants.push_back(CacheSize / CacheLineSize - 1);
+				constants.push_back(0xffffffff);
+			}
+
+			int32_t pos() const {
+				return buf.codePos;
+			}
+
+			void bytes(std::initializer_list<uint8_t> list) {
+				for (uint8_t b : list)
+					buf.emit(b);
+			}
+
+			void emit32(int32_t val) {
+				buf.emit(val);
+			}
+
+			//EVEX.512.W1 prefix
+			//reg: ModRM.reg (5 bits), vvvv: NDS register (5 bits, bit 4 doubles as VSIB index bit 4),
+			//x, b: high bits of ModRM.rm (register operands) or of the SIB index/base
+			void evex(uint8_t map, uint8_t pp, int reg, int vvvv, int x, int b, bool broadcast = false, int mask = 0) {
+				buf.emit((uint8_t)0x62);
+				buf.emit((uint8_t)((((~reg >> 3) & 1) << 7) | ((~x & 1) << 6) | ((~b & 1) << 5) | (((~reg >> 4) & 1) << 4) | map));
+				buf.emit((uint8_t)(0x80 | ((~vvvv & 15) << 3) | 0x04 | pp));
+				buf.emit((uint8_t)(0x40 | (broadcast ? 0x10 : 0) | (((~vvvv >> 4) & 1) << 3) | mask));
+			}
+
+			//dst = a op b
+			void op(uint8_t opcode, int dst, int a, int b, uint8_t map = EvexMap0F) {
+				evex(map, Evex66, dst, a, b >> 4, b >> 3);
+				buf.emit(opcode);
+				buf.emit((uint8_t)(0xc0 | ((dst & 7) << 3) | (b & 7)));
+			}
+
+			//dst = a op imm8 (opcode extension ext)
+			void opImm(uint8_t opcode, int ext, int dst, int a, uint8_t imm) {
+				evex(EvexMap0F, Evex66, ext, dst, a >> 4, a >> 3);
+				buf.emit(opcode);
+				buf.emit((uint8_t)(0xc0 | (ext << 3) | (a & 7)));
+				buf.emit(imm);
+			}
+
+			//dst = a op constants[index] (broadcast to all lanes unless it is the 8-qword iota)
+			void opConst(uint8_t opcode, int dst, int a, int index, uint8_t map = EvexMap0F) {
+				evex(map, Evex66, dst, a, 0, 0, index != ConstIota);
+				buf.emit(opcode);
+				buf.emit((uint8_t)(0x05 | ((dst & 7) << 3)));
+				fixups.push_back({ buf.codePos, index });
+				emit32(0);
+			}
+
+			int constant(uint64_t value) {
+				constants.push_back(value);
+				return (int)constants.size() - 1;
+			}
+
+			//vmovdqu64 [rsp+disp], zmm
+			void storeStack(int src, int32_t disp) {
+				evex(EvexMap0F, EvexF3, src, 0, 0, 0);
+				bytes({ 0x7f, (uint8_t)(0x84 | ((src & 7) << 3)), 0x24 });
+				emit32(disp);
+			}
+
+			//mov rax, [rsp+disp]
+			void loadStackRax(int32_t disp) {
+				bytes({ 0x48, 0x8b, 0x84, 0x24 });
+				emit32(disp);
+			}
+
+			//dst = unsigned high 64 bits of a * b from 32x32-bit products; dst may be a or b
+			void mulHigh(int dst, int a, int b) {
+				const int ah = BatchTmp, bh = BatchTmp + 1, t = BatchTmp + 2, u = BatchTmp + 3;
+				opImm(VPSHIFTQ_I, 2, ah, a, 32);
+				opImm(VPSHIFTQ_I, 2, bh, b, 32);
+				op(VPMULUDQ, t, a, b);
+				op(VPMULUDQ, u, ah, b);
+				opImm(VPSHIFTQ_I, 2, t, t, 32);
+				op(VPADDQ, u, u, t);              //ah*bl + (al*bl >> 32)
+				op(VPMULUDQ, t, a, bh);
+				op(VPMULUDQ, ah, ah, bh);
+				opImm(VPSHIFTQ_I, 2, bh, u, 32);
+				op(VPADDQ, ah, ah, bh);
+				opConst(VPANDQ, u, u, ConstLow32);
+				op(VPADDQ, t, t, u);              //al*bh + low half of the above
+				opImm(VPSHIFTQ_I, 2, t, t, 32);
+				op(VPADDQ, dst, ah, t);
+			}
+
+			void instruction(Instruction& instr, std::vector<uint64_t> &reciprocalCache) {
+				const int dst = BatchReg + instr.dst;
+				const int src = BatchReg + instr.src;
+				switch ((SuperscalarInstructionType)instr.opcode)
+				{
+				case SuperscalarInstructionType::ISUB_R:
+					op(VPSUBQ, dst, dst, src);
+					break;
+				case SuperscalarInstructionType::IXOR_R:
+					op(VPXORQ, dst, dst, src);
+					break;
+				case SuperscalarInstructionType::IADD_RS:
+					if (instr.getModShift() != 0) {
+						opImm(VPSHIFTQ_I, 6, BatchTmp, src, instr.getModShift());
+						op(VPADDQ, dst, dst, BatchTmp);
+					}
+					else {
+						op(VPADDQ, dst, dst, src);
+					}
+					break;
+				case SuperscalarInstructionType::IMUL_R:
+					op(VPMULLQ, dst, dst, src, EvexMap0F38);
+					break;
+				case SuperscalarInstructionType::IROR_C:
+					if ((instr.getImm32() & 63) != 0)
+						opImm(VPROTQ_I, 0, dst, dst, instr.getImm32() & 63);
+					break;
+				case SuperscalarInstructionType::IADD_C7:
+				case SuperscalarInstructionType::IADD_C8:
+				case SuperscalarInstructionType::IADD_C9:
+					opConst(VPADDQ, dst, dst, constant((uint64_t)(int64_t)(int32_t)instr.getImm32()));
+					break;
+				case SuperscalarInstructionType::IXOR_C7:
+				case SuperscalarInstructionType::IXOR_C8:
+				case SuperscalarInstructionType::IXOR_C9:
+					opConst(VPXORQ, dst, dst, constant((uint64_t)(int64_t)(int32_t)instr.getImm32()));
+					break;
+				case SuperscalarInstructionType::IMULH_R:
+					mulHigh(dst, dst, src);
+					break;
+				case SuperscalarInstructionType::ISMULH_R: {
+					//signed high = unsigned high - (a < 0 ? b : 0) - (b < 0 ? a : 0)
+					const int fix = BatchTmp + 4, fix2 = BatchTmp + 5;
+					opImm(VPROTQ_I, 4, fix, dst, 63);
+					op(VPANDQ, fix, fix, src);
+					opImm(VPROTQ_I, 4, fix2, src, 63);
+					op(VPANDQ, fix2, fix2, dst);
+					op(VPADDQ, fix, fix, fix2);
+					mulHigh(dst, dst, src);
+					op(VPSUBQ, dst, dst, fix);
+				} break;
+				case SuperscalarInstructionType::IMUL_RCP:
+					opConst(VPMULLQ, dst, dst, constant(reciprocalCache[instr.getImm32()]), EvexMap0F38);
+					break;
+				default:
+					UNREACHABLE;
+				}
+			}
+
+			//mix block offsets of the lanes of reg, prefetched
+			void mixBlockAddress(int reg) {
+				opConst(VPANDQ, BatchAddr, reg, ConstCacheMask);
+				opImm(VPSHIFTQ_I, 6, BatchAddr, BatchAddr, 6);
+				storeStack(BatchAddr, 0);
+				for (int lane = 0; lane < 8; ++lane) {
+					loadStackRax(8 * lane);
+					bytes({ 0x0f, 0x18, 0x04, 0x07 });   //prefetchnta [rdi+rax]
+				}
+			}
+
+			void mixBlockXor() {
+				for (int q = 0; q < 8; ++q) {
+					bytes({ 0xc5, 0xf4, 0x46, 0xc9 });   //kxnorw k1, k1, k1
+					//vpgatherqq zmm31{k1}, [rdi+zmm30+8*q]
+					evex(EvexMap0F38, Evex66, BatchMix, BatchAddr & 16, BatchAddr >> 3, 0, false, 1);
+					bytes({ 0x91, (uint8_t)(0x84 | ((BatchMix & 7) << 3)), (uint8_t)(((BatchAddr & 7) << 3) | 7) });
+					emit32(8 * q);
+					op(VPXORQ, BatchReg + q, BatchReg + q, BatchMix);
+				}
+			}
+
+			template<size_t N>
+			void generate(SuperscalarProgram(&programs)[N], std::vector<uint64_t> &reciprocalCache) {
+				bytes({ 0x55 });                                 //push rbp
+#if defined(_WIN32) || defined(__CYGWIN__)
+				bytes({ 0x57, 0x56 });                           //push rdi; push rsi
+				bytes({ 0x48, 0x89, 0xcf, 0x48, 0x89, 0xd6 });   //mov rdi, rcx; mov rsi, rdx
+				bytes({ 0x4c, 0x89, 0xc5, 0x4c, 0x89, 0xc9 });   //mov rbp, r8; mov rcx, r9
+#else
+				bytes({ 0x48, 0x89, 0xd5 });                     //mov rbp, rdx
+#endif
+				bytes({ 0x48, 0x81, 0xec });                     //sub rsp, BatchStackSize
+				emit32(BatchStackSize);
+				const int32_t loop = pos();
+				//vpbroadcastq zmm24, rbp
+				evex(EvexMap0F38, Evex66, BatchTmp, 0, 0, 0);
+				bytes({ 0x7c, (uint8_t)(0xc0 | ((BatchTmp & 7) << 3) | 5) });
+				opConst(VPADDQ, BatchTmp, BatchTmp, ConstIota);
+				opConst(VPADDQ, BatchReg, BatchTmp, ConstOne);
+				opConst(VPMULLQ, BatchReg, BatchReg, ConstMul0, EvexMap0F38);
+				for (int k = 1; k < 8; ++k)
+					opConst(VPXORQ, BatchReg + k, BatchReg, ConstAdd1 + k - 1);
+				mixBlockAddress(BatchTmp);
+				for (unsigned j = 0; j < N; ++j) {
+					SuperscalarProgram& prog = programs[j];
+					for (unsigned i = 0; i < prog.getSize(); ++i)
+						instruction(prog(i), reciprocalCache);
+					mixBlockXor();
+					if (j < N - 1)
+						mixBlockAddress(BatchReg + prog.getAddressRegister());
+				}
+				//transpose through the stack: item i = qword i of r0-r7
+				for (int q = 0; q < 8; ++q)
+					storeStack(BatchReg + q, 64 + 64 * q);
+				for (int lane = 0; lane < 8; ++lane) {
+					for (int q = 0; q < 8; ++q) {
+						loadStackRax(64 + 64 * q + 8 * lane);
+						bytes({ 0x48, 0x0f, 0xc3, 0x46, (uint8_t)(8 * q) });   //movnti [rsi+8*q], rax
+					}
+					bytes({ 0x48, 0x83, 0xc6, 0x40 });   //add rsi, 64
+				}
+				bytes({ 0x48, 0x83, 0xc5, (uint8_t)DatasetBatchItems });   //add rbp, DatasetBatchItems
+				bytes({ 0x48, 0x39, 0xcd, 0x0f, 0x82 });   //cmp rbp, rcx; jb loop
+				emit32(loop - (pos() + 4));
+				bytes({ 0x0f, 0xae, 0xf8 });                     //sfence
+				bytes({ 0x48, 0x81, 0xc4 });                     //add rsp, BatchStackSize
+				emit32(BatchStackSize);
+#if defined(_WIN32) || defined(__CYGWIN__)
+				bytes({ 0x5e, 0x5f });                           //pop rsi; pop rdi
+#endif
+				bytes({ 0x5d, 0xc3 });                           //pop rbp; ret
+
+				//constant pool
+				while (buf.codePos % 64 != 0)
+					buf.emit((uint8_t)0xcc);
+				const int32_t pool = pos();
+				for (uint64_t c : constants)
+					buf.emit(c);
+				for (auto& fixup : fixups)
+					buf.emitAt(fixup.first, (int32_t)(pool + 8 * fixup.second - (fixup.first + 4)));
+			}
+
+		private:
+			CodeBuffer buf;
+			std::vector<uint64_t> constants;
+			std::vector<std::pair<int32_t, int>> fixups;
+		};
+	}
+
+	template<size_t N>
+	bool JitCompilerX86::generateSuperscalarBatch(SuperscalarProgram(&programs)[N], std::vector<uint64_t> &reciprocalCache) {
+		static const bool supported = Cpu().hasAvx512();
+		if (!supported)
+			return false;
+		if (batchCode == nullptr) {
+			batchCode = (uint8_t*)allocMemoryPages(BatchCodeSize);
+			if (batchCode == nullptr)
+				return false;
+		}
+		else {
+			setPagesRW(batchCode, BatchCodeSize);
+		}
+		BatchEmitter emitter(batchCode);
+		emitter.generate(programs, reciprocalCache);
+		setPagesRX(batchCode, BatchCodeSize);
+		return true;
+	}
+
+	template
+		bool JitCompilerX86::generateSuperscalarBatch(SuperscalarProgram(&programs)[RANDOMX_CACHE_ACCESSES], std::vector<uint64_t> &reciprocalCache);
+
+
 	void JitCompilerX86::generateProgramPrologue(Program& prog, ProgramConfiguration& pcfg) {
 		instructionOffsets.clear();
+		reciprocals.clear();
 		for (unsigned i = 0; i < RegistersCount; ++i) {
 			registerUsage[i] = -1;
 		}
@@ -328,22 +846,124 @@ namespace randomx {
 		emitByte(0xc0 + pcfg.readReg0);
 		emit(REX_XOR_RAX_R64);
 		emitByte(0xc0 + pcfg.readReg1);
+		const int32_t prefetchPos = codePos;
 		emit(ADDR(randomx_prefetch_scratchpad), ADDR(randomx_prefetch_scratchpad_end) - ADDR(randomx_prefetch_scratchpad));
+		if (profile->prefetch != PrefetchT0) {
+			//rewrite prefetcht0 [rsi+rax] and prefetcht0 [rsi+rdx] (0F 18 0C 06/16)
+			for (int32_t pos = prefetchPos; pos + 4 <= codePos; ++pos) {
+				if (code[pos] == 0x0f && code[pos + 1] == 0x18 && code[pos + 2] == 0x0c) {
+					const uint8_t sib = code[pos + 3];
+					if (profile->prefetch == PrefetchNta) {
+						code[pos + 2] = 0x04; //prefetchnta
+					}
+					else {
+						//cmp byte ptr [rsi+reg], 0 (the flags are overwritten before they are read)
+						code[pos + 0] = 0x80;
+						code[pos + 1] = 0x3c;
+						code[pos + 2] = sib;
+						code[pos + 3] = 0x00;
+					}
+					pos += 3;
+				}
+			}
+		}
 		memcpy(code + codePos, codeLoopStore, loopStoreSize);
 		codePos += loopStoreSize;
+		alignJump(sizeof(SUB_EBX) + sizeof(JNZ) + 4);
 		emit(SUB_EBX);
 		emit(JNZ);
 		emit32(prologueSize - codePos - 4);
 		emitByte(JMP);
 		emit32(epilogueOffset - codePos - 4);
+		emitReciprocals();
+	}
+
+	void JitCompilerX86::emitNextItemPrefetch(uint32_t datasetOffset) {
+		//the next iteration reads item (mx + datasetOffset) / 64, whose first superscalar
+		//step mixes the cache line selected by the item number; prefetch it one iteration
+		//ahead (the other 7 lines depend on the superscalar results and are prefetched per step)
+		emit(MOV_EAX_EBP);
+		emitByte(AND_EAX_I);
+		emit32(CacheLineAlignMask);
+		emitByte(ADD_EAX_I);
+		emit32(datasetOffset);
+		emitByte(AND_EAX_I);
+		emit32(CacheSize - CacheLineSize);
+		emit(PREFETCHT0_RDI_RAX);
+	}
+
+	void JitCompilerX86::alignJump(int size) {
+		//pad so that a (macro-fused) jump of the given size neither crosses nor ends on a
+		//32-byte boundary: such jumps are not cached in the uop cache with the JCC erratum fix
+		if (!profile->alignBranches)
+			return;
+		const int offset = codePos % 32;
+		if (offset + size < 32)
+			return;
+		int padding = 32 - offset;
+		while (padding > 0) {
+			const int nopSize = padding > 8 ? 8 : padding;
+			emit(NOPX[nopSize - 1], nopSize);
+			padding -= nopSize;
+		}
+	}
+
+	void JitCompilerX86::emitReciprocals() {
+		if (reciprocals.empty())
+			return;
+		while (codePos % 8 != 0)
+			emitByte(0xcc);
+		for (auto& rcp : reciprocals) {
+			const int32_t disp = codePos - (rcp.first + 4);
+			memcpy(code + rcp.first, &disp, sizeof disp);
+			emit64(rcp.second);
+		}
 	}
 
 	void JitCompilerX86::generateCode(Instruction& instr, int i) {
 		instructionOffsets.push_back(codePos);
+		const InstructionTemplateX86* forms = templates[instr.opcode];
+		if (forms != nullptr) {
+			generateFromTemplate(forms[instr.src == instr.dst], instr, i);
+			return;
+		}
 		auto generator = engine[instr.opcode];
 		(this->*generator)(instr, i);
 	}
 
+	void JitCompilerX86::generateFromTemplate(const InstructionTemplateX86& t, Instruction& instr, int i) {
+		//Random programs make every data-dependent branch here mispredict, so all parts
+		//are written unconditionally: usage updates the form doesn't make go to the spare
+		//slot registerUsage[RegistersCount], and the address prefix is only kept (codePos
+		//advanced past it) when the form has one. The code buffer has room for these
+		//stores past the end of any program.
+		registerUsage[(t.flags & TemplateSetsDst) ? instr.dst : RegistersCount] = i;
+		registerUsage[(t.flags & TemplateSetsSrc) ? instr.src : RegistersCount] = i;
+
+		const uint32_t imm = instr.getImm32();
+		const bool addressDst = (t.flags & TemplateAddressDst) != 0;
+		const uint32_t addressReg = addressDst ? instr.dst : instr.src;
+		const uint32_t sib = addressReg == RegisterNeedsSib;
+		uint32_t mask = instr.getModMem() ? ScratchpadL1Mask : ScratchpadL2Mask;
+		mask = (addressDst && instr.getModCond() >= StoreL3Condition) ? ScratchpadL3Mask : mask;
+		const uint64_t lea = opcodeTemplate(LEA_32) | (uint64_t)(t.addressModrm + addressReg) << 16 | 0x24 << 24;
+		const uint64_t andMask = t.addressAnd | (uint64_t)mask << (8 * t.addressAndSize);
+		memcpy(code + codePos, &lea, sizeof lea);
+		memcpy(code + codePos + 3 + sib, &imm, sizeof imm);
+		memcpy(code + codePos + 7 + sib, &andMask, sizeof andMask);
+		codePos += t.address * (7 + sib + t.addressAndSize + 4);
+
+		const uint64_t dst = instr.dst & t.regMask;
+		const uint64_t src = instr.src & t.regMask;
+		const uint64_t lo = t.code[0] + dst * t.dstStep[0] + src * t.srcStep[0];
+		const uint64_t hi = t.code[1] + dst * t.dstStep[1] + src * t.srcStep[1];
+		const uint32_t immMasked = imm & t.immMask;
+		memcpy(code + codePos, &lo, sizeof lo);
+		memcpy(code + codePos + 8, &hi, sizeof hi);
+		memcpy(code + codePos + t.immPos, &immMasked, sizeof immMasked);
+		codePos += t.size;
+	}
+
 	void JitCompilerX86::generateSuperscalarCode(Instruction& instr, std::vector<uint64_t> &reciprocalCache) {
 		switch ((SuperscalarInstructionType)instr.opcode)
 		{
@@ -439,339 +1059,61 @@ namespace randomx {
 	}
 
 	void JitCompilerX86::genAddressReg(Instruction& instr, bool rax = true) {
-		emit(LEA_32);
-		emitByte(0x80 + instr.src + (rax ? 0 : 8));
-		if (instr.src == RegisterNeedsSib) {
-			emitByte(0x24);
-		}
-		emit32(instr.getImm32());
+		const uint8_t modrm = 0x80 + instr.src + (rax ? 0 : 8);
+		if (instr.src == RegisterNeedsSib)
+			emitRMI(LEA_32, modrm, 0x24, instr.getImm32());
+		else
+			emitRMI(LEA_32, modrm, instr.getImm32());
+		const uint32_t mask = instr.getModMem() ? ScratchpadL1Mask : ScratchpadL2Mask;
 		if (rax)
-			emitByte(AND_EAX_I);
+			emitTemplate(AND_EAX_I | (uint64_t)mask << 8, 5);
 		else
-			emit(AND_ECX_I);
-		emit32(instr.getModMem() ? ScratchpadL1Mask : ScratchpadL2Mask);
-	}
-
-	void JitCompilerX86::genAddressRegDst(Instruction& instr) {
-		emit(LEA_32);
-		emitByte(0x80 + instr.dst);
-		if (instr.dst == RegisterNeedsSib) {
-			emitByte(0x24);
-		}
-		emit32(instr.getImm32());
-		emitByte(AND_EAX_I);
-		if (instr.getModCond() < StoreL3Condition) {
-			emit32(instr.getModMem() ? ScratchpadL1Mask : ScratchpadL2Mask);
-		}
-		else {
-			emit32(ScratchpadL3Mask);
-		}
-	}
-
-	void JitCompilerX86::genAddressImm(Instruction& instr) {
-		emit32(instr.getImm32() & ScratchpadL3Mask);
+			emitTemplate(opcodeTemplate(AND_ECX_I) | (uint64_t)mask << 16, 6);
 	}
 
 	void JitCompilerX86::h_IADD_RS(Instruction& instr, int i) {
 		registerUsage[instr.dst] = i;
-		emit(REX_LEA);
+		const uint8_t sib = (instr.getModShift() << 6) | (instr.src << 3) | instr.dst;
 		if (instr.dst == RegisterNeedsDisplacement)
-			emitByte(0xac);
+			emitRMI(REX_LEA, 0xac, sib, instr.getImm32());
 		else
-			emitByte(0x04 + 8 * instr.dst);
-		genSIB(instr.getModShift(), instr.src, instr.dst);
-		if (instr.dst == RegisterNeedsDisplacement)
-			emit32(instr.getImm32());
-	}
-
-	void JitCompilerX86::h_IADD_M(Instruction& instr, int i) {
-		registerUsage[instr.dst] = i;
-		if (instr.src != instr.dst) {
-			genAddressReg(instr);
-			emit(REX_ADD_RM);
-			emitByte(0x04 + 8 * instr.dst);
-			emitByte(0x06);
-		}
-		else {
-			emit(REX_ADD_RM);
-			emitByte(0x86 + 8 * instr.dst);
-			genAddressImm(instr);
-		}
+			emitRM(REX_LEA, 0x04 + 8 * instr.dst, sib);
 	}
 
 	void JitCompilerX86::genSIB(int scale, int index, int base) {
 		emitByte((scale << 6) | (index << 3) | base);
 	}
 
-	void JitCompilerX86::h_ISUB_R(Instruction& instr, int i) {
-		registerUsage[instr.dst] = i;
-		if (instr.src != instr.dst) {
-			emit(REX_SUB_RR);
-			emitByte(0xc0 + 8 * instr.dst + instr.src);
-		}
-		else {
-			emit(REX_81);
-			emitByte(0xe8 + instr.dst);
-			emit32(instr.getImm32());
-		}
-	}
-
-	void JitCompilerX86::h_ISUB_M(Instruction& instr, int i) {
-		registerUsage[instr.dst] = i;
-		if (instr.src != instr.dst) {
-			genAddressReg(instr);
-			emit(REX_SUB_RM);
-			emitByte(0x04 + 8 * instr.dst);
-			emitByte(0x06);
-		}
-		else {
-			emit(REX_SUB_RM);
-			emitByte(0x86 + 8 * instr.dst);
-			genAddressImm(instr);
-		}
-	}
-
-	void JitCompilerX86::h_IMUL_R(Instruction& instr, int i) {
-		registerUsage[instr.dst] = i;
-		if (instr.src != instr.dst) {
-			emit(REX_IMUL_RR);
-			emitByte(0xc0 + 8 * instr.dst + instr.src);
-		}
-		else {
-			emit(REX_IMUL_RRI);
-			emitByte(0xc0 + 9 * instr.dst);
-			emit32(instr.getImm32());
-		}
-	}
-
-	void JitCompilerX86::h_IMUL_M(Instruction& instr, int i) {
-		registerUsage[instr.dst] = i;
-		if (instr.src != instr.dst) {
-			genAddressReg(instr);
-			emit(REX_IMUL_RM);
-			emitByte(0x04 + 8 * instr.dst);
-			emitByte(0x06);
-		}
-		else {
-			emit(REX_IMUL_RM);
-			emitByte(0x86 + 8 * instr.dst);
-			genAddressImm(instr);
-		}
-	}
-
-	void JitCompilerX86::h_IMULH_R(Instruction& instr, int i) {
-		registerUsage[instr.dst] = i;
-		emit(REX_MOV_RR64);
-		emitByte(0xc0 + instr.dst);
-		emit(REX_MUL_R);
-		emitByte(0xe0 + instr.src);
-		emit(REX_MOV_R64R);
-		emitByte(0xc2 + 8 * instr.dst);
-	}
-
-	void JitCompilerX86::h_IMULH_M(Instruction& instr, int i) {
-		registerUsage[instr.dst] = i;
-		if (instr.src != instr.dst) {
-			genAddressReg(instr, false);
-			emit(REX_MOV_RR64);
-			emitByte(0xc0 + instr.dst);
-			emit(REX_MUL_MEM);
-		}
-		else {
-			emit(REX_MOV_RR64);
-			emitByte(0xc0 + instr.dst);
-			emit(REX_MUL_M);
-			emitByte(0xa6);
-			genAddressImm(instr);
-		}
-		emit(REX_MOV_R64R);
-		emitByte(0xc2 + 8 * instr.dst);
-	}
-
-	void JitCompilerX86::h_ISMULH_R(Instruction& instr, int i) {
-		registerUsage[instr.dst] = i;
-		emit(REX_MOV_RR64);
-		emitByte(0xc0 + instr.dst);
-		emit(REX_MUL_R);
-		emitByte(0xe8 + instr.src);
-		emit(REX_MOV_R64R);
-		emitByte(0xc2 + 8 * instr.dst);
-	}
-
-	void JitCompilerX86::h_ISMULH_M(Instruction& instr, int i) {
-		registerUsage[instr.dst] = i;
-		if (instr.src != instr.dst) {
-			genAddressReg(instr, false);
-			emit(REX_MOV_RR64);
-			emitByte(0xc0 + instr.dst);
-			emit(REX_IMUL_MEM);
-		}
-		else {
-			emit(REX_MOV_RR64);
-			emitByte(0xc0 + instr.dst);
-			emit(REX_MUL_M);
-			emitByte(0xae);
-			genAddressImm(instr);
-		}
-		emit(REX_MOV_R64R);
-		emitByte(0xc2 + 8 * instr.dst);
-	}
-
 	void JitCompilerX86::h_IMUL_RCP(Instruction& instr, int i) {
 		const uint32_t divisor = instr.getImm32();
 		if (!isZeroOrPowerOf2(divisor)) {
 			registerUsage[instr.dst] = i;
-			emit(MOV_RAX_I);
-			emit64(randomx_reciprocal_fast(divisor));
-			emit(REX_IMUL_RM);
-			emitByte(0xc0 + 8 * instr.dst);
-		}
-	}
-
-	void JitCompilerX86::h_INEG_R(Instruction& instr, int i) {
-		registerUsage[instr.dst] = i;
-		emit(REX_NEG);
-		emitByte(0xd8 + instr.dst);
-	}
-
-	void JitCompilerX86::h_IXOR_R(Instruction& instr, int i) {
-		registerUsage[instr.dst] = i;
-		if (instr.src != instr.dst) {
-			emit(REX_XOR_RR);
-			emitByte(0xc0 + 8 * instr.dst + instr.src);
-		}
-		else {
-			emit(REX_XOR_RI);
-			emitByte(0xf0 + instr.dst);
-			emit32(instr.getImm32());
-		}
-	}
-
-	void JitCompilerX86::h_IXOR_M(Instruction& instr, int i) {
-		registerUsage[instr.dst] = i;
-		if (instr.src != instr.dst) {
-			genAddressReg(instr);
-			emit(REX_XOR_RM);
-			emitByte(0x04 + 8 * instr.dst);
-			emitByte(0x06);
-		}
-		else {
-			emit(REX_XOR_RM);
-			emitByte(0x86 + 8 * instr.dst);
-			genAddressImm(instr);
-		}
-	}
-
-	void JitCompilerX86::h_IROR_R(Instruction& instr, int i) {
-		registerUsage[instr.dst] = i;
-		if (instr.src != instr.dst) {
-			emit(REX_MOV_RR);
-			emitByte(0xc8 + instr.src);
-			emit(REX_ROT_CL);
-			emitByte(0xc8 + instr.dst);
-		}
-		else {
-			emit(REX_ROT_I8);
-			emitByte(0xc8 + instr.dst);
-			emitByte(instr.getImm32() & 63);
-		}
-	}
-
-	void JitCompilerX86::h_IROL_R(Instruction& instr, int i) {
-		registerUsage[instr.dst] = i;
-		if (instr.src != instr.dst) {
-			emit(REX_MOV_RR);
-			emitByte(0xc8 + instr.src);
-			emit(REX_ROT_CL);
-			emitByte(0xc0 + instr.dst);
-		}
-		else {
-			emit(REX_ROT_I8);
-			emitByte(0xc0 + instr.dst);
-			emitByte(instr.getImm32() & 63);
-		}
-	}
-
-	void JitCompilerX86::h_ISWAP_R(Instruction& instr, int i) {
-		if (instr.src != instr.dst) {
-			registerUsage[instr.dst] = i;
-			registerUsage[instr.src] = i;
-			emit(REX_XCHG);
-			emitByte(0xc0 + instr.src + 8 * instr.dst);
+			if (profile->reciprocalFromMemory) {
+				//imul dst, [rip+disp32], the constant follows the program
+				reciprocals.emplace_back(codePos + sizeof(REX_IMUL_RM) + 1, randomx_reciprocal_fast(divisor));
+				emitRMI(REX_IMUL_RM, 0x05 + 8 * instr.dst, 0);
+			}
+			else {
+				emit(MOV_RAX_I);
+				emit64(randomx_reciprocal_fast(divisor));
+				emitRM(REX_IMUL_RM, 0xc0 + 8 * instr.dst);
+			}
 		}
 	}
 
-	void JitCompilerX86::h_FSWAP_R(Instruction& instr, int i) {
-		emit(SHUFPD);
-		emitByte(0xc0 + 9 * instr.dst);
-		emitByte(1);
-	}
-
-	void JitCompilerX86::h_FADD_R(Instruction& instr, int i) {
-		instr.dst %= RegisterCountFlt;
-		instr.src %= RegisterCountFlt;
-		emit(REX_ADDPD);
-		emitByte(0xc0 + instr.src + 8 * instr.dst);
-	}
-
-	void JitCompilerX86::h_FADD_M(Instruction& instr, int i) {
-		instr.dst %= RegisterCountFlt;
-		genAddressReg(instr);
-		emit(REX_CVTDQ2PD_XMM12);
-		emit(REX_ADDPD);
-		emitByte(0xc4 + 8 * instr.dst);
-	}
-
-	void JitCompilerX86::h_FSUB_R(Instruction& instr, int i) {
-		instr.dst %= RegisterCountFlt;
-		instr.src %= RegisterCountFlt;
-		emit(REX_SUBPD);
-		emitByte(0xc0 + instr.src + 8 * instr.dst);
-	}
-
-	void JitCompilerX86::h_FSUB_M(Instruction& instr, int i) {
-		instr.dst %= RegisterCountFlt;
-		genAddressReg(instr);
-		emit(REX_CVTDQ2PD_XMM12);
-		emit(REX_SUBPD);
-		emitByte(0xc4 + 8 * instr.dst);
-	}
-
-	void JitCompilerX86::h_FSCAL_R(Instruction& instr, int i) {
-		instr.dst %= RegisterCountFlt;
-		emit(REX_XORPS);
-		emitByte(0xc7 + 8 * instr.dst);
-	}
-
-	void JitCompilerX86::h_FMUL_R(Instruction& instr, int i) {
-		instr.dst %= RegisterCountFlt;
-		instr.src %= RegisterCountFlt;
-		emit(REX_MULPD);
-		emitByte(0xe0 + instr.src + 8 * instr.dst);
-	}
-
 	void JitCompilerX86::h_FDIV_M(Instruction& instr, int i) {
 		instr.dst %= RegisterCountFlt;
 		genAddressReg(instr);
 		emit(REX_CVTDQ2PD_XMM12);
 		emit(REX_ANDPS_XMM12);
-		emit(REX_DIVPD);
-		emitByte(0xe4 + 8 * instr.dst);
-	}
-
-	void JitCompilerX86::h_FSQRT_R(Instruction& instr, int i) {
-		instr.dst %= RegisterCountFlt;
-		emit(SQRTPD);
-		emitByte(0xe4 + 9 * instr.dst);
+		emitRM(REX_DIVPD, 0xe4 + 8 * instr.dst);
 	}
 
 	void JitCompilerX86::h_CFROUND(Instruction& instr, int i) {
-		emit(REX_MOV_RR64);
-		emitByte(0xc0 + instr.src);
+		emitRM(REX_MOV_RR64, 0xc0 + instr.src);
 		int rotate = (13 - (instr.getImm32() & 63)) & 63;
 		if (rotate != 0) {
-			emit(ROL_RAX);
-			emitByte(rotate);
+			emitRM(ROL_RAX, rotate);
 		}
 		emit(AND_OR_MOV_LDMXCSR);
 	}
@@ -779,16 +1121,13 @@ namespace randomx {
 	void JitCompilerX86::h_CBRANCH(Instruction& instr, int i) {
 		int reg = instr.dst;
 		int target = registerUsage[reg] + 1;
-		emit(REX_ADD_I);
-		emitByte(0xc0 + reg);
 		int shift = instr.getModCond() + ConditionOffset;
 		uint32_t imm = instr.getImm32() | (1UL << shift);
 		if (ConditionOffset > 0 || shift > 0)
 			imm &= ~(1UL << (shift - 1));
-		emit32(imm);
-		emit(REX_TEST);
-		emitByte(0xc0 + reg);
-		emit32(ConditionMask << shift);
+		emitRMI(REX_ADD_I, 0xc0 + reg, imm);
+		alignJump(sizeof(REX_TEST) + 1 + 4 + sizeof(JZ) + 4);
+		emitRMI(REX_TEST, 0xc0 + reg, ConditionMask << shift);
 		emit(JZ);
 		emit32(instructionOffsets[target] - (codePos + 4));
 		//mark all registers as used
@@ -797,51 +1136,201 @@ namespace randomx {
 		}
 	}
 
-	void JitCompilerX86::h_ISTORE(Instruction& instr, int i) {
-		genAddressRegDst(instr);
-		emit(REX_MOV_MR);
-		emitByte(0x04 + 8 * instr.src);
-		emitByte(0x06);
-	}
+	//{src != dst, src == dst}
+	static const InstructionTemplateX86 tmpl_IADD_M[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst | TemplateAddress).op(REX_ADD_RM).reg(0x04, 8, 0).byte(0x06),
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_ADD_RM).reg(0x86, 8, 0).imm(ScratchpadL3Mask),
+	};
 
-	void JitCompilerX86::h_NOP(Instruction& instr, int i) {
-		emit(NOP1);
-	}
+	static const InstructionTemplateX86 tmpl_ISUB_R[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_SUB_RR).reg(0xc0, 8, 1),
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_81).reg(0xe8, 1, 0).imm(UINT32_MAX),
+	};
+
+	static const InstructionTemplateX86 tmpl_ISUB_M[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst | TemplateAddress).op(REX_SUB_RM).reg(0x04, 8, 0).byte(0x06),
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_SUB_RM).reg(0x86, 8, 0).imm(ScratchpadL3Mask),
+	};
+
+	static const InstructionTemplateX86 tmpl_IMUL_R[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_IMUL_RR).reg(0xc0, 8, 1),
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_IMUL_RRI).reg(0xc0, 9, 0).imm(UINT32_MAX),
+	};
+
+	static const InstructionTemplateX86 tmpl_IMUL_M[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst | TemplateAddress).op(REX_IMUL_RM).reg(0x04, 8, 0).byte(0x06),
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_IMUL_RM).reg(0x86, 8, 0).imm(ScratchpadL3Mask),
+	};
+
+	static const InstructionTemplateX86 tmpl_IMULH_R[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_MOV_RR64).reg(0xc0, 1, 0).op(REX_MUL_R).reg(0xe0, 0, 1).op(REX_MOV_R64R).reg(0xc2, 8, 0),
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_MOV_RR64).reg(0xc0, 1, 0).op(REX_MUL_R).reg(0xe0, 0, 1).op(REX_MOV_R64R).reg(0xc2, 8, 0),
+	};
+
+	static const InstructionTemplateX86 tmpl_IMULH_M[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst | TemplateAddressRcx).op(REX_MOV_RR64).reg(0xc0, 1, 0).op(REX_MUL_MEM).op(REX_MOV_R64R).reg(0xc2, 8, 0),
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_MOV_RR64).reg(0xc0, 1, 0).op(REX_MUL_M).byte(0xa6).imm(ScratchpadL3Mask).op(REX_MOV_R64R).reg(0xc2, 8, 0),
+	};
+
+	static const InstructionTemplateX86 tmpl_ISMULH_R[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_MOV_RR64).reg(0xc0, 1, 0).op(REX_MUL_R).reg(0xe8, 0, 1).op(REX_MOV_R64R).reg(0xc2, 8, 0),
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_MOV_RR64).reg(0xc0, 1, 0).op(REX_MUL_R).reg(0xe8, 0, 1).op(REX_MOV_R64R).reg(0xc2, 8, 0),
+	};
+
+	static const InstructionTemplateX86 tmpl_ISMULH_M[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst | TemplateAddressRcx).op(REX_MOV_RR64).reg(0xc0, 1, 0).op(REX_IMUL_MEM).op(REX_MOV_R64R).reg(0xc2, 8, 0),
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_MOV_RR64).reg(0xc0, 1, 0).op(REX_MUL_M).byte(0xae).imm(ScratchpadL3Mask).op(REX_MOV_R64R).reg(0xc2, 8, 0),
+	};
+
+	static const InstructionTemplateX86 tmpl_INEG_R[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_NEG).reg(0xd8, 1, 0),
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_NEG).reg(0xd8, 1, 0),
+	};
+
+	static const InstructionTemplateX86 tmpl_IXOR_R[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_XOR_RR).reg(0xc0, 8, 1),
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_XOR_RI).reg(0xf0, 1, 0).imm(UINT32_MAX),
+	};
+
+	static const InstructionTemplateX86 tmpl_IXOR_M[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst | TemplateAddress).op(REX_XOR_RM).reg(0x04, 8, 0).byte(0x06),
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_XOR_RM).reg(0x86, 8, 0).imm(ScratchpadL3Mask),
+	};
+
+	static const InstructionTemplateX86 tmpl_IROR_R[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_MOV_RR).reg(0xc8, 0, 1).op(REX_ROT_CL).reg(0xc8, 1, 0),
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_ROT_I8).reg(0xc8, 1, 0).imm(63, 1),
+	};
+
+	static const InstructionTemplateX86 tmpl_IROL_R[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_MOV_RR).reg(0xc8, 0, 1).op(REX_ROT_CL).reg(0xc0, 1, 0),
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst).op(REX_ROT_I8).reg(0xc0, 1, 0).imm(63, 1),
+	};
+
+	static const InstructionTemplateX86 tmpl_ISWAP_R[] = {
+		InstructionTemplateX86(RegistersCount, TemplateSetsDst | TemplateSetsSrc).op(REX_XCHG).reg(0xc0, 8, 1),
+		InstructionTemplateX86(RegistersCount, 0),
+	};
+
+	static const InstructionTemplateX86 tmpl_FSWAP_R[] = {
+		InstructionTemplateX86(RegistersCount, 0).op(SHUFPD).reg(0xc0, 9, 0).byte(1),
+		InstructionTemplateX86(RegistersCount, 0).op(SHUFPD).reg(0xc0, 9, 0).byte(1),
+	};
+
+	static const InstructionTemplateX86 tmpl_FADD_R[] = {
+		InstructionTemplateX86(RegisterCountFlt, 0).op(REX_ADDPD).reg(0xc0, 8, 1),
+		InstructionTemplateX86(RegisterCountFlt, 0).op(REX_ADDPD).reg(0xc0, 8, 1),
+	};
+
+	static const InstructionTemplateX86 tmpl_FADD_M[] = {
+		InstructionTemplateX86(RegisterCountFlt, TemplateAddress).op(REX_CVTDQ2PD_XMM12).op(REX_ADDPD).reg(0xc4, 8, 0),
+		InstructionTemplateX86(RegisterCountFlt, TemplateAddress).op(REX_CVTDQ2PD_XMM12).op(REX_ADDPD).reg(0xc4, 8, 0),
+	};
+
+	static const InstructionTemplateX86 tmpl_FSUB_R[] = {
+		InstructionTemplateX86(RegisterCountFlt, 0).op(REX_SUBPD).reg(0xc0, 8, 1),
+		InstructionTemplateX86(RegisterCountFlt, 0).op(REX_SUBPD).reg(0xc0, 8, 1),
+	};
+
+	static const InstructionTemplateX86 tmpl_FSUB_M[] = {
+		InstructionTemplateX86(RegisterCountFlt, TemplateAddress).op(REX_CVTDQ2PD_XMM12).op(REX_SUBPD).reg(0xc4, 8, 0),
+		InstructionTemplateX86(RegisterCountFlt, TemplateAddress).op(REX_CVTDQ2PD_XMM12).op(REX_SUBPD).reg(0xc4, 8, 0),
+	};
+
+	static const InstructionTemplateX86 tmpl_FSCAL_R[] = {
+		InstructionTemplateX86(RegisterCountFlt, 0).op(REX_XORPS).reg(0xc7, 8, 0),
+		InstructionTemplateX86(RegisterCountFlt, 0).op(REX_XORPS).reg(0xc7, 8, 0),
+	};
+
+	static const InstructionTemplateX86 tmpl_FMUL_R[] = {
+		InstructionTemplateX86(RegisterCountFlt, 0).op(REX_MULPD).reg(0xe0, 8, 1),
+		InstructionTemplateX86(RegisterCountFlt, 0).op(REX_MULPD).reg(0xe0, 8, 1),
+	};
+
+	static const InstructionTemplateX86 tmpl_FSQRT_R[] = {
+		InstructionTemplateX86(RegisterCountFlt, 0).op(SQRTPD).reg(0xe4, 9, 0),
+		InstructionTemplateX86(RegisterCountFlt, 0).op(SQRTPD).reg(0xe4, 9, 0),
+	};
+
+	static const InstructionTemplateX86 tmpl_ISTORE[] = {
+		InstructionTemplateX86(RegistersCount, TemplateAddressDst).op(REX_MOV_MR).reg(0x04, 0, 8).byte(0x06),
+		InstructionTemplateX86(RegistersCount, TemplateAddressDst).op(REX_MOV_MR).reg(0x04, 0, 8).byte(0x06),
+	};
+
+	static const InstructionTemplateX86 tmpl_NOP[] = {
+		InstructionTemplateX86(RegistersCount, 0).op(NOP1),
+		InstructionTemplateX86(RegistersCount, 0).op(NOP1),
+	};
 
 #include "instruction_weights.hpp"
 #define INST_HANDLE(x) REPN(&JitCompilerX86::h_##x, WT(x))
+#define INST_TEMPLATE(x) REPN(tmpl_##x, WT(x))
+#define INST_NONE(x) REPN(nullptr, WT(x))
+
+	const InstructionTemplateX86* JitCompilerX86::templates[256] = {
+		INST_NONE(IADD_RS)
+		INST_TEMPLATE(IADD_M)
+		INST_TEMPLATE(ISUB_R)
+		INST_TEMPLATE(ISUB_M)
+		INST_TEMPLATE(IMUL_R)
+		INST_TEMPLATE(IMUL_M)
+		INST_TEMPLATE(IMULH_R)
+		INST_TEMPLATE(IMULH_M)
+		INST_TEMPLATE(ISMULH_R)
+		INST_TEMPLATE(ISMULH_M)
+		INST_NONE(IMUL_RCP)
+		INST_TEMPLATE(INEG_R)
+		INST_TEMPLATE(IXOR_R)
+		INST_TEMPLATE(IXOR_M)
+		INST_TEMPLATE(IROR_R)
+		INST_TEMPLATE(IROL_R)
+		INST_TEMPLATE(ISWAP_R)
+		INST_TEMPLATE(FSWAP_R)
+		INST_TEMPLATE(FADD_R)
+		INST_TEMPLATE(FADD_M)
+		INST_TEMPLATE(FSUB_R)
+		INST_TEMPLATE(FSUB_M)
+		INST_TEMPLATE(FSCAL_R)
+		INST_TEMPLATE(FMUL_R)
+		INST_NONE(FDIV_M)
+		INST_TEMPLATE(FSQRT_R)
+		INST_NONE(CBRANCH)
+		INST_NONE(CFROUND)
+		INST_TEMPLATE(ISTORE)
+		INST_TEMPLATE(NOP)
+	};
 
 	InstructionGeneratorX86 JitCompilerX86::engine[256] = {
 		INST_HANDLE(IADD_RS)
-		INST_HANDLE(IADD_M)
-		INST_HANDLE(ISUB_R)
-		INST_HANDLE(ISUB_M)
-		INST_HANDLE(IMUL_R)
-		INST_HANDLE(IMUL_M)
-		INST_HANDLE(IMULH_R)
-		INST_HANDLE(IMULH_M)
-		INST_HANDLE(ISMULH_R)
-		INST_HANDLE(ISMULH_M)
+		INST_NONE(IADD_M)
+		INST_NONE(ISUB_R)
+		INST_NONE(ISUB_M)
+		INST_NONE(IMUL_R)
+		INST_NONE(IMUL_M)
+		INST_NONE(IMULH_R)
+		INST_NONE(IMULH_M)
+		INST_NONE(ISMULH_R)
+		INST_NONE(ISMULH_M)
 		INST_HANDLE(IMUL_RCP)
-		INST_HANDLE(INEG_R)
-		INST_HANDLE(IXOR_R)
-		INST_HANDLE(IXOR_M)
-		INST_HANDLE(IROR_R)
-		INST_HANDLE(IROL_R)
-		INST_HANDLE(ISWAP_R)
-		INST_HANDLE(FSWAP_R)
-		INST_HANDLE(FADD_R)
-		INST_HANDLE(FADD_M)
-		INST_HANDLE(FSUB_R)
-		INST_HANDLE(FSUB_M)
-		INST_HANDLE(FSCAL_R)
-		INST_HANDLE(FMUL_R)
+		INST_NONE(INEG_R)
+		INST_NONE(IXOR_R)
+		INST_NONE(IXOR_M)
+		INST_NONE(IROR_R)
+		INST_NONE(IROL_R)
+		INST_NONE(ISWAP_R)
+		INST_NONE(FSWAP_R)
+		INST_NONE(FADD_R)
+		INST_NONE(FADD_M)
+		INST_NONE(FSUB_R)
+		INST_NONE(FSUB_M)
+		INST_NONE(FSCAL_R)
+		INST_NONE(FMUL_R)
 		INST_HANDLE(FDIV_M)
-		INST_HANDLE(FSQRT_R)
+		INST_NONE(FSQRT_R)
 		INST_HANDLE(CBRANCH)
 		INST_HANDLE(CFROUND)
-		INST_HANDLE(ISTORE)
-		INST_HANDLE(NOP)
+		INST_NONE(ISTORE)
+		INST_NONE(NOP)
 	};
 
 }
@@ -30,8 +30,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <cstdint>
 #include <cstring>
+#include <utility>
 #include <vector>
 #include "common.hpp"
+#include "jit_code_arena.hpp"
 
 namespace randomx {
 
@@ -40,23 +42,58 @@ namespace randomx {
 	class SuperscalarProgram;
 	class JitCompilerX86;
 	class Instruction;
+	struct InstructionTemplateX86;
 
 	typedef void(JitCompilerX86::*InstructionGeneratorX86)(Instruction&, int);
 
+	//computes dataset items startItem to endItem (a positive multiple of DatasetBatchItems apart)
+	typedef void(DatasetBatchFunc)(const uint8_t* cacheMemory, uint8_t* dataset, uint64_t startItem, uint64_t endItem);
+
+	constexpr int DatasetBatchItems = 8;
+
+	//how the scratchpad lines of the next iteration are touched
+	enum ScratchpadPrefetchX86 : uint8_t {
+		PrefetchT0,
+		PrefetchNta,
+		PrefetchLoad,
+	};
+
+	//code generation choices tuned per microarchitecture; every profile
+	//generates programs with the same results
+	struct JitProfileX86 {
+		const char* name;
+		bool alignBranches;           //keep jumps from crossing or ending on a 32-byte boundary (JCC erratum)
+		ScratchpadPrefetchX86 prefetch;
+		bool reciprocalFromMemory;    //IMUL_RCP multiplies by a constant pool entry instead of mov rax, imm64
+	};
+
+	//what a compiler's code buffer holds
+	enum JitLayoutX86 : uint8_t {
+		JitLayoutFull,     //program and superscalar hash: light VMs and the dataset init code
+		JitLayoutProgram,  //program only: fast-mode VMs, which read the dataset
+	};
+
 	class JitCompilerX86 {
 	public:
-		JitCompilerX86();
+		explicit JitCompilerX86(JitLayoutX86 layout = JitLayoutFull);
 		~JitCompilerX86();
 		void generateProgram(Program&, ProgramConfiguration&);
 		void generateProgramLight(Program&, ProgramConfiguration&, uint32_t);
+		void generateProgramPartial(Program&, ProgramConfiguration&, uint32_t, const uint8_t*, uint32_t);
 		template<size_t N>
 		void generateSuperscalarHash(SuperscalarProgram (&programs)[N], std::vector<uint64_t> &);
 		void generateDatasetInitCode();
+		template<size_t N>
+		bool generateSuperscalarBatch(SuperscalarProgram (&programs)[N], std::vector<uint64_t> &);
 		ProgramFunc* getProgramFunc() {
-			return (ProgramFunc*)code;
+			return (ProgramFunc*)codeExec;
 		}
 		DatasetInitFunc* getDatasetInitFunc() {
-			return (DatasetInitFunc*)code;
+			return (DatasetInitFunc*)codeExec;
+		}
+		//nullptr unless generateSuperscalarBatch succeeded
+		DatasetBatchFunc* getDatasetBatchFunc() {
+			return (DatasetBatchFunc*)batchCode;
 		}
 		uint8_t* getCode() {
 			return code;
@@ -65,21 +102,41 @@ namespace randomx {
 		void enableWriting();
 		void enableExecution();
 		void enableAll();
+		//nullptr or "auto" selects the profile from CPUID; false if name is unknown
+		static bool setProfile(const char* name);
+		static const JitProfileX86& getProfile();
 	private:
 		static InstructionGeneratorX86 engine[256];
+		//per opcode: the {src != dst, src == dst} templates, nullptr where engine emits the code
+		static const InstructionTemplateX86* templates[256];
 		std::vector<int32_t> instructionOffsets;
-		int registerUsage[RegistersCount];
+		int registerUsage[RegistersCount + 1]; //+ a spare slot for generateFromTemplate
 		uint8_t* code;
+		//where the code runs: a second, read-execute mapping of the same pages,
+		//or code itself when dual mapping is unavailable
+		uint8_t* codeExec;
+		size_t codeSize;
+		//in a JitCodeArena slot (slot.chunk != nullptr) or a mapping of its own
+		JitCodeSlot slot;
+		//where programs jump to when done: the epilogue shared by the arena
+		//chunk (before code) or a copy at the end of the buffer
+		int32_t epilogueOffset;
 		int32_t codePos;
+		uint8_t* batchCode = nullptr;
+		const JitProfileX86* profile;
+		//IMUL_RCP constant pool: disp32 position, reciprocal
+		std::vector<std::pair<int32_t, uint64_t>> reciprocals;
 
 		void generateProgramPrologue(Program&, ProgramConfiguration&);
 		void generateProgramEpilogue(Program&, ProgramConfiguration&);
 		void genAddressReg(Instruction&, bool);
-		void genAddressRegDst(Instruction&);
-		void genAddressImm(Instruction&);
 		void genSIB(int scale, int index, int base);
+		void alignJump(int size);
+		void emitNextItemPrefetch(uint32_t datasetOffset);
+		void emitReciprocals();
 
 		void generateCode(Instruction&, int);
+		void generateFromTemplate(const InstructionTemplateX86&, Instruction&, int);
 		void generateSuperscalarCode(Instruction &, std::vector<uint64_t> &);
 
 		void emitByte(uint8_t val) {
@@ -107,36 +164,51 @@ namespace randomx {
 			codePos += count;
 		}
 
+		//Instruction templates: the opcode bytes packed little-endian into one word with
+		//the ModRM byte, an optional SIB/imm8 byte and an optional imm32 patched in after
+		//them, written with a single 8-byte store. The code buffer always has more than
+		//8 bytes of room after codePos; bytes past the instruction are overwritten next.
+		template<size_t N>
+		static uint64_t opcodeTemplate(const uint8_t (&op)[N]) {
+			static_assert(N <= 4, "opcode too long for a template");
+			uint64_t value = 0;
+			for (size_t i = 0; i < N; ++i)
+				value |= (uint64_t)op[i] << (8 * i);
+			return value;
+		}
+
+		void emitTemplate(uint64_t bytes, int size) {
+			memcpy(code + codePos, &bytes, sizeof bytes);
+			codePos += size;
+		}
+
+		template<size_t N>
+		void emitRM(const uint8_t (&op)[N], uint8_t modrm) {
+			emitTemplate(opcodeTemplate(op) | (uint64_t)modrm << (8 * N), N + 1);
+		}
+
+		template<size_t N>
+		void emitRM(const uint8_t (&op)[N], uint8_t modrm, uint8_t byte) {
+			emitTemplate(opcodeTemplate(op) | (uint64_t)modrm << (8 * N) | (uint64_t)byte << (8 * N + 8), N + 2);
+		}
+
+		template<size_t N>
+		void emitRMI(const uint8_t (&op)[N], uint8_t modrm, uint32_t imm) {
+			static_assert(N <= 3, "opcode too long for an imm32 template");
+			emitTemplate(opcodeTemplate(op) | (uint64_t)modrm << (8 * N) | (uint64_t)imm << (8 * N + 8), N + 5);
+		}
+
+		template<size_t N>
+		void emitRMI(const uint8_t (&op)[N], uint8_t modrm, uint8_t sib, uint32_t imm) {
+			static_assert(N <= 2, "opcode too long for an imm32 template");
+			emitTemplate(opcodeTemplate(op) | (uint64_t)modrm << (8 * N) | (uint64_t)sib << (8 * N + 8) | (uint64_t)imm << (8 * N + 16), N + 6);
+		}
+
 		void h_IADD_RS(Instruction&, int);
-		void h_IADD_M(Instruction&, int);
-		void h_ISUB_R(Instruction&, int);
-		void h_ISUB_M(Instruction&, int);
-		void h_IMUL_R(Instruction&, int);
-		void h_IMUL_M(Instruction&, int);
-		void h_IMULH_R(Instruction&, int);
-		void h_IMULH_M(Instruction&, int);
-		void h_ISMULH_R(Instruction&, int);
-		void h_ISMULH_M(Instruction&, int);
 		void h_IMUL_RCP(Instruction&, int);
-		void h_INEG_R(Instruction&, int);
-		void h_IXOR_R(Instruction&, int);
-		void h_IXOR_M(Instruction&, int);
-		void h_IROR_R(Instruction&, int);
-		void h_IROL_R(Instruction&, int);
-		void h_ISWAP_R(Instruction&, int);
-		void h_FSWAP_R(Instruction&, int);
-		void h_FADD_R(Instruction&, int);
-		void h_FADD_M(Instruction&, int);
-		void h_FSUB_R(Instruction&, int);
-		void h_FSUB_M(Instruction&, int);
-		void h_FSCAL_R(Instruction&, int);
-		void h_FMUL_R(Instruction&, int);
 		void h_FDIV_M(Instruction&, int);
-		void h_FSQRT_R(Instruction&, int);
 		void h_CBRANCH(Instruction&, int);
 		void h_CFROUND(Instruction&, int);
-		void h_ISTORE(Instruction&, int);
-		void h_NOP(Instruction&, int);
 	};
 
 }
\ No newline at end of file
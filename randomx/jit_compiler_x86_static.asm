@@ -54,7 +54,7 @@ RANDOMX_SCRATCHPAD_MASK     EQU (RANDOMX_SCRATCHPAD_L3-64)
 RANDOMX_DATASET_BASE_MASK   EQU (RANDOMX_DATASET_BASE_SIZE-64)
 RANDOMX_CACHE_MASK          EQU (RANDOMX_ARGON_MEMORY*16-1)
 RANDOMX_ALIGN               EQU 4096
-SUPERSCALAR_OFFSET          EQU ((((RANDOMX_ALIGN + 32 * RANDOMX_PROGRAM_SIZE) - 1) / (RANDOMX_ALIGN) + 1) * (RANDOMX_ALIGN))
+SUPERSCALAR_OFFSET          EQU ((((RANDOMX_ALIGN + 33 * RANDOMX_PROGRAM_SIZE) - 1) / (RANDOMX_ALIGN) + 1) * (RANDOMX_ALIGN))
 
 randomx_prefetch_scratchpad PROC
 	mov rdx, rax
@@ -133,23 +133,24 @@ randomx_dataset_init PROC
 	mov rbp, r8  ;# block index
 	push r9      ;# max. block index
 init_block_loop:
-	prefetchw byte ptr [rsi]
 	mov rbx, rbp
 	db 232 ;# 0xE8 = call
 	dd SUPERSCALAR_OFFSET - distance
 	distance equ $ - offset randomx_dataset_init
-	mov qword ptr [rsi+0], r8
-	mov qword ptr [rsi+8], r9
-	mov qword ptr [rsi+16], r10
-	mov qword ptr [rsi+24], r11
-	mov qword ptr [rsi+32], r12
-	mov qword ptr [rsi+40], r13
-	mov qword ptr [rsi+48], r14
-	mov qword ptr [rsi+56], r15
+	;# items are read back only by hashing, much later: stream them past the cache
+	movnti qword ptr [rsi+0], r8
+	movnti qword ptr [rsi+8], r9
+	movnti qword ptr [rsi+16], r10
+	movnti qword ptr [rsi+24], r11
+	movnti qword ptr [rsi+32], r12
+	movnti qword ptr [rsi+40], r13
+	movnti qword ptr [rsi+48], r14
+	movnti qword ptr [rsi+56], r15
 	add rbp, 1
 	add rsi, 64
 	cmp rbp, qword ptr [rsp]
 	jb init_block_loop
+	sfence
 	pop r9
 	pop r15
 	pop r14
@@ -0,0 +1,126 @@
+/*
+Copyright (c) 2018-2019, tevador <tevador@gmail.com>
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the copyright holder nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "randomx.h"
+
+#if defined(RANDOMX_PHASE_PROFILE)
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#elif !defined(__aarch64__)
+#include <chrono>
+#endif
+#endif
+
+/* Per-worker phase histograms, filled by the VM it is attached to.
+   Only that worker writes, so updates are plain relaxed load/store pairs;
+   any thread may read. */
+struct randomx_phase_profile {
+	std::atomic<uint64_t> count[RANDOMX_PHASE_COUNT];
+	std::atomic<uint64_t> ticks[RANDOMX_PHASE_COUNT];
+	std::atomic<uint64_t> buckets[RANDOMX_PHASE_COUNT][RANDOMX_PHASE_BUCKETS];
+
+	randomx_phase_profile() {
+		for (int phase = 0; phase < RANDOMX_PHASE_COUNT; ++phase) {
+			count[phase].store(0, std::memory_order_relaxed);
+			ticks[phase].store(0, std::memory_order_relaxed);
+			for (int bucket = 0; bucket < RANDOMX_PHASE_BUCKETS; ++bucket)
+				buckets[phase][bucket].store(0, std::memory_order_relaxed);
+		}
+	}
+};
+
+namespace randomx {
+
+	/* TSC on x86, the generic timer (cntvct) on ARM64, nanoseconds elsewhere */
+	inline uint64_t phaseTimer() {
+#if !defined(RANDOMX_PHASE_PROFILE)
+		return 0;
+#elif defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+		return __rdtsc();
+#elif defined(__aarch64__)
+		uint64_t ticks;
+		asm volatile("isb; mrs %0, cntvct_el0" : "=r"(ticks) : : "memory");
+		return ticks;
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	inline void phaseAdd(randomx_phase_profile* profile, int phase, uint64_t ticks) {
+		if (profile == nullptr)
+			return;
+		int bucket = 0;
+		while (bucket < RANDOMX_PHASE_BUCKETS - 1 && (ticks >> (bucket + 1)) != 0)
+			++bucket;
+		auto bump = [](std::atomic<uint64_t>& counter, uint64_t value) {
+			counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		};
+		bump(profile->count[phase], 1);
+		bump(profile->ticks[phase], ticks);
+		bump(profile->buckets[phase][bucket], 1);
+	}
+
+	/* Times consecutive phases of a hash: each lap is one sample of a phase,
+	   from the previous lap (or construction, or restart). Does nothing
+	   unless built with RANDOMX_PHASE_PROFILE. */
+#if defined(RANDOMX_PHASE_PROFILE)
+	class PhaseClock {
+	public:
+		explicit PhaseClock(randomx_phase_profile* profile) : profile(profile), start(phaseTimer()) {}
+		void restart() {
+			start = phaseTimer();
+		}
+		/* excluded: ticks of the lap already recorded as another phase */
+		void lap(int phase, uint64_t excluded = 0) {
+			uint64_t now = phaseTimer();
+			phaseAdd(profile, phase, now - start - excluded);
+			start = now;
+		}
+	private:
+		randomx_phase_profile* profile;
+		uint64_t start;
+	};
+#else
+	class PhaseClock {
+	public:
+		explicit PhaseClock(randomx_phase_profile*) {}
+		void restart() {}
+		void lap(int, uint64_t = 0) {}
+	};
+#endif
+
+}
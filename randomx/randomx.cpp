@@ -33,8 +33,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "vm_compiled.hpp"
 #include "vm_compiled_light.hpp"
 #include "blake2/blake2.h"
+#include "blake2/endian.h"
 #include "cpu.hpp"
+#include "soft_aes.h"
+#include "virtual_memory.h"
+#include "superscalar.hpp"
+#include "phase_profile.hpp"
+#include "scratchpad_arena.hpp"
 #include <cassert>
+#include <cstring>
 #include <limits>
 
 #if defined(__SSE__) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP > 0))
@@ -44,6 +51,99 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cfenv>
 #endif
 
+namespace randomx {
+
+	// Increments a 256-bit little-endian nonce in place, one 64-bit limb at a time
+	static FORCE_INLINE void incrementNonce(uint8_t* nonce) {
+		for (int limb = 0; limb < RANDOMX_NONCE_SIZE; limb += 8) {
+			uint64_t w = load64(nonce + limb) + 1;
+			store64(nonce + limb, w);
+			if (w != 0)
+				break;
+		}
+	}
+
+	// hash <= target, both 256-bit little-endian; the top limb rejects almost every hash
+	static FORCE_INLINE bool hashMeetsTarget(const void* hash, const uint64_t (&target)[4]) {
+		const uint8_t* h = (const uint8_t*)hash;
+		for (int limb = 3; limb >= 0; --limb) {
+			uint64_t w = load64(h + 8 * limb);
+			if (w != target[limb])
+				return w < target[limb];
+		}
+		return true;
+	}
+
+	// Bytes of the little-endian counter a midstate search increments
+	static const size_t MidstateCounterSize = 8;
+
+	// incrementNonce, or for a midstate search (first > 0) the 64-bit counter
+	// at byte 'first': the nonce bytes in the first Blake2b block stay alone,
+	// and so do those after the counter. Returns false once it wraps to zero.
+	static FORCE_INLINE bool advanceNonce(uint8_t* nonce, size_t first) {
+		if (first == 0) {
+			incrementNonce(nonce);
+			return true;
+		}
+		const uint64_t counter = load64(nonce + first) + 1;
+		store64(nonce + first, counter);
+		return counter != 0;
+	}
+
+	static_assert(RANDOMX_MIDSTATE_BLOCK == BLAKE2B_BLOCKBYTES && RANDOMX_MIDSTATE_SIZE == BLAKE2B_OUTBYTES, "midstate is one Blake2b-512 block");
+
+	// Blake2b-512 of a hash input, the seed of its first program. Given the
+	// midstate of its first block (randomx_calculate_midstate), only the rest
+	// is compressed.
+	static void hashSeed(uint64_t (&seed)[8], const void* input, size_t inputSize, const uint8_t* midstate) {
+		if (midstate == nullptr) {
+			blake2b(seed, sizeof(seed), input, inputSize, nullptr, 0);
+			return;
+		}
+		blake2b_state state;
+		for (int i = 0; i < 8; ++i)
+			state.h[i] = load64(midstate + 8 * i);
+		state.t[0] = RANDOMX_MIDSTATE_BLOCK;
+		state.t[1] = 0;
+		state.f[0] = 0;
+		state.f[1] = 0;
+		state.buflen = 0;
+		state.outlen = BLAKE2B_OUTBYTES;
+		state.last_node = 0;
+		blake2b_update(&state, (const uint8_t*)input + RANDOMX_MIDSTATE_BLOCK, inputSize - RANDOMX_MIDSTATE_BLOCK);
+		blake2b_final(&state, seed, sizeof(seed));
+	}
+
+	// randomx_calculate_hash_first/next, with an optional input midstate
+	static void hashFirst(randomx_vm* machine, const void* input, size_t inputSize, const uint8_t* midstate) {
+		PhaseClock clock(machine->phaseProfile);
+		hashSeed(machine->tempHash, input, inputSize, midstate);
+		clock.lap(RANDOMX_PHASE_BLAKE2B);
+		machine->initScratchpad(machine->tempHash);
+		clock.lap(RANDOMX_PHASE_FILL_SCRATCHPAD);
+	}
+
+	static void hashNext(randomx_vm* machine, const void* nextInput, size_t nextInputSize, const uint8_t* midstate, void* output) {
+		PhaseClock clock(machine->phaseProfile);
+		machine->resetRoundingMode();
+		for (uint32_t chain = 0; chain < RANDOMX_PROGRAM_COUNT - 1; ++chain) {
+			machine->run(machine->tempHash);
+			clock.restart();
+			blake2b(machine->tempHash, sizeof(machine->tempHash), machine->getRegisterFile(), sizeof(RegisterFile), nullptr, 0);
+			clock.lap(RANDOMX_PHASE_BLAKE2B);
+		}
+		machine->run(machine->tempHash);
+
+		// Finish current hash and fill the scratchpad for the next hash at the same time
+		clock.restart();
+		hashSeed(machine->tempHash, nextInput, nextInputSize, midstate);
+		clock.lap(RANDOMX_PHASE_BLAKE2B);
+		machine->hashAndFill(output, RANDOMX_HASH_SIZE, machine->tempHash);
+		clock.lap(RANDOMX_PHASE_FINAL_HASH);
+	}
+
+}
+
 extern "C" {
 
 	randomx_flags randomx_get_flags() {
@@ -57,6 +157,9 @@ extern "C" {
 		if (HAVE_AES && cpu.hasAes()) {
 			flags |= RANDOMX_FLAG_HARD_AES;
 		}
+		if (randomx_argon2_impl_avx512() != nullptr && cpu.hasAvx512()) {
+			flags |= RANDOMX_FLAG_ARGON2_AVX512;
+		}
 		if (randomx_argon2_impl_avx2() != nullptr && cpu.hasAvx2()) {
 			flags |= RANDOMX_FLAG_ARGON2_AVX2;
 		}
@@ -66,6 +169,65 @@ extern "C" {
 		return flags;
 	}
 
+	int randomx_set_jit_profile(const char *name) {
+#if defined(RANDOMX_COMPILER_X86)
+		return randomx::JitCompilerX86::setProfile(name) ? 1 : 0;
+#else
+		return name == nullptr || strcmp(name, "auto") == 0 || strcmp(name, "generic") == 0;
+#endif
+	}
+
+	const char *randomx_get_jit_profile() {
+#if defined(RANDOMX_COMPILER_X86)
+		return randomx::JitCompilerX86::getProfile().name;
+#else
+		return "generic";
+#endif
+	}
+
+	int randomx_set_soft_aes(const char *name) {
+		return setSoftAes(name) ? 1 : 0;
+	}
+
+	const char *randomx_get_soft_aes() {
+		return getSoftAesName();
+	}
+
+	void randomx_set_scratchpad_coloring(int enable) {
+		randomx::ScratchpadArena::setEnabled(enable != 0);
+	}
+
+	static const char *blake2bName = "ref";
+
+	int randomx_set_blake2b(const char *name) {
+		randomx::Cpu cpu;
+		const bool automatic = name == nullptr || strcmp(name, "auto") == 0;
+		const struct {
+			const char *name;
+			randomx_blake2b_compress_fn *compress;
+			bool supported;
+		} impls[] = {
+			{ "avx512", randomx_blake2b_compress_avx512(), cpu.hasAvx512() && cpu.hasAvx512Vl() },
+			{ "avx2", randomx_blake2b_compress_avx2(), cpu.hasAvx2() },
+			{ "ref", randomx_blake2b_compress_ref(), true },
+		};
+		for (const auto &impl : impls) {
+			if ((automatic || strcmp(name, impl.name) == 0) && impl.compress != nullptr && impl.supported) {
+				randomx_blake2b_set_compress(impl.compress);
+				blake2bName = impl.name;
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	const char *randomx_get_blake2b() {
+		return blake2bName;
+	}
+
+	//The widest implementation is in use from the start
+	static const int blake2bSelected = randomx_set_blake2b(nullptr);
+
 	randomx_cache *randomx_alloc_cache(randomx_flags flags) {
 		randomx_cache *cache = nullptr;
 		auto impl = randomx::selectArgonImpl(flags);
@@ -127,6 +289,56 @@ extern "C" {
 		return cache;
 	}
 
+	void *randomx_get_cache_memory(randomx_cache *cache) {
+		assert(cache != nullptr);
+		return cache->memory;
+	}
+
+	unsigned randomx_get_superscalar_program(randomx_cache *cache, unsigned index,
+		randomx_superscalar_instr *out, unsigned capacity, unsigned *addressRegister) {
+		assert(cache != nullptr && cache->isInitialized());
+		assert(out != nullptr && addressRegister != nullptr);
+		if (index >= RANDOMX_CACHE_ACCESSES)
+			return 0;
+		randomx::SuperscalarProgram& prog = cache->programs[index];
+		if (prog.getSize() > capacity)
+			return 0;
+		for (unsigned i = 0; i < prog.getSize(); ++i) {
+			randomx::Instruction& instr = prog(i);
+			randomx_superscalar_instr& flat = out[i];
+			flat.opcode = instr.opcode;
+			flat.dst = instr.dst;
+			flat.src = instr.src;
+			flat.shift = 0;
+			flat.reserved = 0;
+			flat.imm = 0;
+			switch ((randomx::SuperscalarInstructionType)instr.opcode) {
+			case randomx::SuperscalarInstructionType::IADD_RS:
+				flat.shift = instr.getModShift();
+				break;
+			case randomx::SuperscalarInstructionType::IROR_C:
+				flat.shift = instr.getImm32() & 63;
+				break;
+			case randomx::SuperscalarInstructionType::IADD_C7:
+			case randomx::SuperscalarInstructionType::IADD_C8:
+			case randomx::SuperscalarInstructionType::IADD_C9:
+			case randomx::SuperscalarInstructionType::IXOR_C7:
+			case randomx::SuperscalarInstructionType::IXOR_C8:
+			case randomx::SuperscalarInstructionType::IXOR_C9:
+				flat.imm = signExtend2sCompl(instr.getImm32());
+				break;
+			case randomx::SuperscalarInstructionType::IMUL_RCP:
+				//the cache keeps the reciprocal, imm32 is its index
+				flat.imm = cache->reciprocalCache[instr.getImm32()];
+				break;
+			default:
+				break;
+			}
+		}
+		*addressRegister = prog.getAddressRegister();
+		return prog.getSize();
+	}
+
 	void randomx_init_cache(randomx_cache *cache, const void *key, size_t keySize) {
 		assert(cache != nullptr);
 		assert(keySize == 0 || key != nullptr);
@@ -138,6 +350,25 @@ extern "C" {
 		}
 	}
 
+	void randomx_fill_cache(randomx_cache *cache, const void *key, size_t keySize) {
+		assert(cache != nullptr);
+		assert(keySize == 0 || key != nullptr);
+		randomx::fillCacheMemory(cache, key, keySize);
+		cache->cacheKey.clear();
+	}
+
+	void randomx_restore_cache(randomx_cache *cache, const void *key, size_t keySize) {
+		assert(cache != nullptr);
+		assert(keySize == 0 || key != nullptr);
+		if (cache->jit != nullptr) {
+			randomx::restoreCacheCompile(cache, key, keySize);
+		}
+		else {
+			randomx::restoreCache(cache, key, keySize);
+		}
+		cache->cacheKey.assign((const char *)key, keySize);
+	}
+
 	void randomx_release_cache(randomx_cache* cache) {
 		assert(cache != nullptr);
 		cache->dealloc(cache);
@@ -145,9 +376,21 @@ extern "C" {
 	}
 
 	randomx_dataset *randomx_alloc_dataset(randomx_flags flags) {
+		return randomx_alloc_dataset_node(flags, -1);
+	}
+
+	constexpr unsigned long DatasetItemCount = randomx::DatasetSize / RANDOMX_DATASET_ITEM_SIZE;
+
+	randomx_dataset *randomx_alloc_dataset_node(randomx_flags flags, int node) {
+		return randomx_alloc_partial_dataset(flags, node, DatasetItemCount);
+	}
+
+	randomx_dataset *randomx_alloc_partial_dataset(randomx_flags flags, int node, unsigned long itemCount) {
+		assert(itemCount > 0 && itemCount <= DatasetItemCount);
 
 		//fail on 32-bit systems if DatasetSize is >= 4 GiB
-		if (randomx::DatasetSize > std::numeric_limits<size_t>::max()) {
+		const uint64_t size = (uint64_t)itemCount * RANDOMX_DATASET_ITEM_SIZE;
+		if (size > std::numeric_limits<size_t>::max()) {
 			return nullptr;
 		}
 
@@ -155,13 +398,35 @@ extern "C" {
 
 		try {
 			dataset = new randomx_dataset();
-			if (flags & RANDOMX_FLAG_LARGE_PAGES) {
-				dataset->dealloc = &randomx::deallocDataset<randomx::LargePageAllocator>;
-				dataset->memory = (uint8_t*)randomx::LargePageAllocator::allocMemory(randomx::DatasetSize);
+			dataset->dealloc = &randomx::deallocDataset<randomx::DefaultAllocator>;
+			dataset->itemCount = itemCount;
+			if (flags & RANDOMX_FLAG_1GB_PAGES) {
+				try {
+					dataset->memory = (uint8_t*)randomx::HugePage1GAllocator::allocMemory(size);
+					dataset->dealloc = &randomx::deallocDataset<randomx::HugePage1GAllocator>;
+					dataset->hugePages1G = true;
+				}
+				catch (std::bad_alloc&) {
+					//no 1 GB pages reserved, fall back to large pages
+					flags |= RANDOMX_FLAG_LARGE_PAGES;
+				}
 			}
-			else {
-				dataset->dealloc = &randomx::deallocDataset<randomx::DefaultAllocator>;
-				dataset->memory = (uint8_t*)randomx::DefaultAllocator::allocMemory(randomx::DatasetSize);
+			if (dataset->memory == nullptr && (flags & RANDOMX_FLAG_LARGE_PAGES)) {
+				try {
+					dataset->memory = (uint8_t*)randomx::LargePageAllocator::allocMemory(size);
+					dataset->dealloc = &randomx::deallocDataset<randomx::LargePageAllocator>;
+				}
+				catch (std::bad_alloc&) {
+					//the 1 GB path degrades all the way to normal pages
+					if (!(flags & RANDOMX_FLAG_1GB_PAGES))
+						throw;
+				}
+			}
+			if (dataset->memory == nullptr) {
+				dataset->memory = (uint8_t*)randomx::DefaultAllocator::allocMemory(size);
+			}
+			if (node >= 0) {
+				bindPagesToNode(dataset->memory, size, node);
 			}
 		}
 		catch (std::exception &ex) {
@@ -178,7 +443,24 @@ extern "C" {
 		return dataset;
 	}
 
-	constexpr unsigned long DatasetItemCount = randomx::DatasetSize / RANDOMX_DATASET_ITEM_SIZE;
+	randomx_dataset *randomx_create_dataset_view(void *memory) {
+		assert(memory != nullptr);
+		randomx_dataset *dataset = nullptr;
+		try {
+			dataset = new randomx_dataset();
+			dataset->memory = (uint8_t*)memory;
+			dataset->dealloc = &randomx::deallocDatasetView;
+		}
+		catch (std::exception &ex) {
+			dataset = nullptr;
+		}
+		return dataset;
+	}
+
+	int randomx_dataset_has_1gb_pages(randomx_dataset *dataset) {
+		assert(dataset != nullptr);
+		return dataset->hugePages1G ? 1 : 0;
+	}
 
 	unsigned long randomx_dataset_item_count() {
 		return DatasetItemCount;
@@ -187,8 +469,8 @@ extern "C" {
 	void randomx_init_dataset(randomx_dataset *dataset, randomx_cache *cache, unsigned long startItem, unsigned long itemCount) {
 		assert(dataset != nullptr);
 		assert(cache != nullptr);
-		assert(startItem < DatasetItemCount && itemCount <= DatasetItemCount);
-		assert(startItem + itemCount <= DatasetItemCount);
+		assert(startItem < dataset->itemCount && itemCount <= dataset->itemCount);
+		assert(startItem + itemCount <= dataset->itemCount);
 		cache->datasetInit(cache, dataset->memory + startItem * randomx::CacheLineSize, startItem, startItem + itemCount);
 	}
 
@@ -353,11 +635,68 @@ extern "C" {
 		machine->setDataset(dataset);
 	}
 
+	void randomx_vm_set_partial_dataset(randomx_vm *machine, randomx_dataset *dataset) {
+		assert(machine != nullptr);
+		machine->setPartialDataset(dataset);
+	}
+
 	void randomx_destroy_vm(randomx_vm *machine) {
 		assert(machine != nullptr);
 		delete machine;
 	}
 
+	const void *randomx_get_scratchpad(randomx_vm *machine) {
+		assert(machine != nullptr);
+		return machine->getScratchpad();
+	}
+
+	const void *randomx_get_jit_code(randomx_vm *machine, size_t *size) {
+		assert(machine != nullptr);
+		assert(size != nullptr);
+		const void *code = machine->getCode(*size);
+		if (code == nullptr) {
+			*size = 0;
+		}
+		return code;
+	}
+
+	randomx_phase_profile *randomx_alloc_phase_profile() {
+#if defined(RANDOMX_PHASE_PROFILE)
+		try {
+			return new randomx_phase_profile();
+		}
+		catch (std::bad_alloc&) {
+			return nullptr;
+		}
+#else
+		return nullptr;
+#endif
+	}
+
+	void randomx_release_phase_profile(randomx_phase_profile *profile) {
+		delete profile;
+	}
+
+	void randomx_vm_set_phase_profile(randomx_vm *machine, randomx_phase_profile *profile) {
+		assert(machine != nullptr);
+		machine->phaseProfile = profile;
+	}
+
+	void randomx_read_phase_profile(const randomx_phase_profile *profile, randomx_phase_stats *stats) {
+		assert(profile != nullptr);
+		assert(stats != nullptr);
+		for (int phase = 0; phase < RANDOMX_PHASE_COUNT; ++phase) {
+			stats[phase].count = profile->count[phase].load(std::memory_order_relaxed);
+			stats[phase].ticks = profile->ticks[phase].load(std::memory_order_relaxed);
+			for (int bucket = 0; bucket < RANDOMX_PHASE_BUCKETS; ++bucket)
+				stats[phase].buckets[bucket] = profile->buckets[phase][bucket].load(std::memory_order_relaxed);
+		}
+	}
+
+	uint64_t randomx_phase_timer() {
+		return randomx::phaseTimer();
+	}
+
 	void randomx_calculate_hash(randomx_vm *machine, const void *input, size_t inputSize, void *output) {
 		assert(machine != nullptr);
 		assert(inputSize == 0 || input != nullptr);
@@ -370,18 +709,26 @@ extern "C" {
 		fegetenv(&fpstate);
 #endif
 
+		machine->searchInputSize = 0;
+		randomx::PhaseClock clock(machine->phaseProfile);
 		alignas(16) uint64_t tempHash[8];
 		int blakeResult = blake2b(tempHash, sizeof(tempHash), input, inputSize, nullptr, 0);
 		assert(blakeResult == 0);
+		clock.lap(RANDOMX_PHASE_BLAKE2B);
 		machine->initScratchpad(&tempHash);
+		clock.lap(RANDOMX_PHASE_FILL_SCRATCHPAD);
 		machine->resetRoundingMode();
 		for (int chain = 0; chain < RANDOMX_PROGRAM_COUNT - 1; ++chain) {
 			machine->run(&tempHash);
+			clock.restart();
 			blakeResult = blake2b(tempHash, sizeof(tempHash), machine->getRegisterFile(), sizeof(randomx::RegisterFile), nullptr, 0);
 			assert(blakeResult == 0);
+			clock.lap(RANDOMX_PHASE_BLAKE2B);
 		}
 		machine->run(&tempHash);
+		clock.restart();
 		machine->getFinalResult(output, RANDOMX_HASH_SIZE);
+		clock.lap(RANDOMX_PHASE_FINAL_HASH);
 
 #ifdef USE_CSR_INTRINSICS
 		_mm_setcsr(fpstate);
@@ -391,31 +738,132 @@ extern "C" {
 	}
 
 	void randomx_calculate_hash_first(randomx_vm* machine, const void* input, size_t inputSize) {
-		blake2b(machine->tempHash, sizeof(machine->tempHash), input, inputSize, nullptr, 0);
-		machine->initScratchpad(machine->tempHash);
+		machine->searchInputSize = 0;
+		randomx::hashFirst(machine, input, inputSize, nullptr);
 	}
 
 	void randomx_calculate_hash_next(randomx_vm* machine, const void* nextInput, size_t nextInputSize, void* output) {
-		machine->resetRoundingMode();
-		for (uint32_t chain = 0; chain < RANDOMX_PROGRAM_COUNT - 1; ++chain) {
-			machine->run(machine->tempHash);
-			blake2b(machine->tempHash, sizeof(machine->tempHash), machine->getRegisterFile(), sizeof(randomx::RegisterFile), nullptr, 0);
-		}
-		machine->run(machine->tempHash);
-
-		// Finish current hash and fill the scratchpad for the next hash at the same time
-		blake2b(machine->tempHash, sizeof(machine->tempHash), nextInput, nextInputSize, nullptr, 0);
-		machine->hashAndFill(output, RANDOMX_HASH_SIZE, machine->tempHash);
+		machine->searchInputSize = 0;
+		randomx::hashNext(machine, nextInput, nextInputSize, nullptr, output);
 	}
 
 	void randomx_calculate_hash_last(randomx_vm* machine, void* output) {
+		machine->searchInputSize = 0;
+		randomx::PhaseClock clock(machine->phaseProfile);
 		machine->resetRoundingMode();
 		for (int chain = 0; chain < RANDOMX_PROGRAM_COUNT - 1; ++chain) {
 			machine->run(machine->tempHash);
+			clock.restart();
 			blake2b(machine->tempHash, sizeof(machine->tempHash), machine->getRegisterFile(), sizeof(randomx::RegisterFile), nullptr, 0);
+			clock.lap(RANDOMX_PHASE_BLAKE2B);
 		}
 		machine->run(machine->tempHash);
+		clock.restart();
 		machine->getFinalResult(output, RANDOMX_HASH_SIZE);
+		clock.lap(RANDOMX_PHASE_FINAL_HASH);
+	}
+
+	void randomx_calculate_midstate(const void* input, size_t inputSize, void* midstate) {
+		assert(input != nullptr);
+		assert(inputSize > RANDOMX_MIDSTATE_BLOCK);
+		assert(midstate != nullptr);
+		// A byte past the block makes blake2b_update compress it
+		blake2b_state state;
+		blake2b_init(&state, BLAKE2B_OUTBYTES);
+		blake2b_update(&state, input, RANDOMX_MIDSTATE_BLOCK + 1);
+		for (int i = 0; i < 8; ++i)
+			store64((uint8_t*)midstate + 8 * i, state.h[i]);
+	}
+
+	static int searchNonce(randomx_vm* machine, const uint8_t* midstate, const void* header, size_t headerSize, size_t nonceOffset, void* nonce, uint64_t iterations, const void* target, void* output, uint64_t* hashCount) {
+		assert(machine != nullptr);
+		assert(header != nullptr);
+		assert(headerSize <= RANDOMX_SEARCH_MAX_INPUT_SIZE);
+		assert(nonceOffset + RANDOMX_NONCE_SIZE <= headerSize);
+		assert(nonce != nullptr);
+		assert(target != nullptr);
+		assert(output != nullptr);
+
+		// The first nonce byte the search varies
+		const size_t first = midstate != nullptr ? RANDOMX_MIDSTATE_BLOCK - nonceOffset : 0;
+
+		if (hashCount != nullptr)
+			*hashCount = 0;
+		if (iterations == 0)
+			return 0;
+
+#ifdef USE_CSR_INTRINSICS
+		const unsigned int fpstate = _mm_getcsr();
+#else
+		fenv_t fpstate;
+		fegetenv(&fpstate);
+#endif
+
+		alignas(64) uint8_t input[RANDOMX_SEARCH_MAX_INPUT_SIZE];
+		alignas(16) uint8_t hashedNonce[RANDOMX_NONCE_SIZE];
+		alignas(16) uint64_t hash[RANDOMX_HASH_SIZE / sizeof(uint64_t)];
+		uint64_t targetLimbs[4];
+		for (int limb = 0; limb < 4; ++limb)
+			targetLimbs[limb] = load64((const uint8_t*)target + 8 * limb);
+
+		memcpy(input, header, headerSize);
+		uint8_t* inputNonce = input + nonceOffset;
+		memcpy(inputNonce, nonce, RANDOMX_NONCE_SIZE);
+
+		int found = 0;
+		bool more = true;
+		uint64_t done = 0;
+		// A previous search that ended on this exact input already filled the
+		// scratchpad for it; otherwise the pipeline starts over
+		if (machine->searchInputSize != headerSize || memcmp(machine->searchInput, input, headerSize) != 0)
+			randomx::hashFirst(machine, input, headerSize, midstate);
+		while (more && done < iterations) {
+			// inputNonce is in flight; advance it and finish the previous hash.
+			// The last one fills for the next nonce too, so the pipeline stays
+			// full across calls instead of draining with hash_last, unless the
+			// midstate counter has run out and there is no next nonce.
+			memcpy(hashedNonce, inputNonce, RANDOMX_NONCE_SIZE);
+			more = randomx::advanceNonce(inputNonce, first);
+			++done;
+			if (more) {
+				randomx::hashNext(machine, input, headerSize, midstate, hash);
+			}
+			else {
+				randomx_calculate_hash_last(machine, hash);
+			}
+			if (randomx::hashMeetsTarget(hash, targetLimbs)) {
+				memcpy(nonce, hashedNonce, RANDOMX_NONCE_SIZE);
+				memcpy(output, hash, RANDOMX_HASH_SIZE);
+				found = 1;
+				break;
+			}
+		}
+		if (!found)
+			memcpy(nonce, inputNonce, RANDOMX_NONCE_SIZE);
+		if (more) {
+			memcpy(machine->searchInput, input, headerSize);
+			machine->searchInputSize = headerSize;
+		}
+		if (hashCount != nullptr)
+			*hashCount = done;
+
+#ifdef USE_CSR_INTRINSICS
+		_mm_setcsr(fpstate);
+#else
+		fesetenv(&fpstate);
+#endif
+		return found;
+	}
+
+	int randomx_search_nonce(randomx_vm* machine, const void* header, size_t headerSize, size_t nonceOffset, void* nonce, uint64_t iterations, const void* target, void* output, uint64_t* hashCount) {
+		return searchNonce(machine, nullptr, header, headerSize, nonceOffset, nonce, iterations, target, output, hashCount);
+	}
+
+	int randomx_search_nonce_midstate(randomx_vm* machine, const void* midstate, const void* header, size_t headerSize, size_t nonceOffset, void* nonce, uint64_t iterations, const void* target, void* output, uint64_t* hashCount) {
+		assert(midstate != nullptr);
+		assert(nonceOffset < RANDOMX_MIDSTATE_BLOCK && nonceOffset + RANDOMX_NONCE_SIZE >= RANDOMX_MIDSTATE_BLOCK + randomx::MidstateCounterSize);
+		assert(headerSize > RANDOMX_MIDSTATE_BLOCK);
+		return searchNonce(machine, (const uint8_t*)midstate, header, headerSize, nonceOffset, nonce, iterations, target, output, hashCount);
 	}
 
 	void randomx_calculate_commitment(const void* input, size_t inputSize, const void* hash_in, void* com_out) {
@@ -33,6 +33,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdint.h>
 
 #define RANDOMX_HASH_SIZE 32
+#define RANDOMX_NONCE_SIZE 32
+#define RANDOMX_SEARCH_MAX_INPUT_SIZE 256
+#define RANDOMX_MIDSTATE_SIZE 64
+#define RANDOMX_MIDSTATE_BLOCK 128
 #define RANDOMX_DATASET_ITEM_SIZE 64
 
 #ifndef RANDOMX_EXPORT
@@ -48,13 +52,57 @@ typedef enum {
   RANDOMX_FLAG_SECURE = 16,
   RANDOMX_FLAG_ARGON2_SSSE3 = 32,
   RANDOMX_FLAG_ARGON2_AVX2 = 64,
-  RANDOMX_FLAG_ARGON2 = 96
+  RANDOMX_FLAG_ARGON2 = 352,
+  RANDOMX_FLAG_1GB_PAGES = 128,
+  RANDOMX_FLAG_ARGON2_AVX512 = 256
 } randomx_flags;
 
+/**
+ * One SuperscalarHash instruction in the flat form returned by
+ * randomx_get_superscalar_program, for engines that build dataset items
+ * outside this library (e.g. on a GPU).
+ *
+ * opcode: 0 ISUB_R, 1 IXOR_R, 2 IADD_RS, 3 IMUL_R, 4 IROR_C, 5 IADD_C7, 6 IXOR_C7,
+ *         7 IADD_C8, 8 IXOR_C8, 9 IADD_C9, 10 IXOR_C9, 11 IMULH_R, 12 ISMULH_R, 13 IMUL_RCP
+ * shift:  IADD_RS shift, IROR_C rotate count
+ * imm:    sign-extended immediate (IADD_C*, IXOR_C*) or the precomputed reciprocal (IMUL_RCP)
+ */
+typedef struct randomx_superscalar_instr {
+  uint8_t opcode;
+  uint8_t dst;
+  uint8_t src;
+  uint8_t shift;
+  uint32_t reserved;
+  uint64_t imm;
+} randomx_superscalar_instr;
+
 typedef struct randomx_dataset randomx_dataset;
 typedef struct randomx_cache randomx_cache;
 typedef struct randomx_vm randomx_vm;
 
+/* Phases of a hash timed by a build with RANDOMX_PHASE_PROFILE */
+typedef enum {
+  RANDOMX_PHASE_BLAKE2B,           /* Blake2b of the input and between chained programs */
+  RANDOMX_PHASE_FILL_SCRATCHPAD,   /* AES fill of the scratchpad (first hash of a pipeline) */
+  RANDOMX_PHASE_GENERATE_PROGRAM,  /* AES generation of the program and its configuration */
+  RANDOMX_PHASE_COMPILE,           /* JIT compilation (bytecode for the interpreter) */
+  RANDOMX_PHASE_EXECUTE,           /* Program execution (including dataset reads when JIT compiled) */
+  RANDOMX_PHASE_DATASET_READ,      /* Dataset reads of one program, interpreted VMs only */
+  RANDOMX_PHASE_FINAL_HASH,        /* AES hash of the scratchpad (pipelined: fused with the next fill) */
+  RANDOMX_PHASE_COUNT
+} randomx_phase;
+
+/* Histogram bucket b counts samples of [2^b, 2^(b+1)) ticks (bucket 0 also 0 and 1) */
+#define RANDOMX_PHASE_BUCKETS 40
+
+typedef struct randomx_phase_stats {
+  uint64_t count;   /* Samples */
+  uint64_t ticks;   /* Their total */
+  uint64_t buckets[RANDOMX_PHASE_BUCKETS];
+} randomx_phase_stats;
+
+typedef struct randomx_phase_profile randomx_phase_profile;
+
 
 #if defined(__cplusplus)
 
@@ -88,18 +136,97 @@ extern "C" {
  */
 RANDOMX_EXPORT randomx_flags randomx_get_flags(void);
 
+/**
+ * Selects the code generation profile of the x86 JIT compiler. Profiles only change
+ * how programs are compiled (branch alignment, scratchpad prefetch, constants),
+ * never the hashes. Takes effect for virtual machines and caches created afterwards.
+ *
+ * @param name is "auto" (or NULL) to choose from CPUID, or one of:
+ *        "generic" - no tuning
+ *        "skylake" - jumps kept off 32-byte boundaries (JCC erratum)
+ *        "intel"   - same code as "generic"
+ *        "zen"     - IMUL_RCP reads its constant from memory
+ *        "skzen"   - "skylake" and "zen" combined
+ *        "nta"     - scratchpad prefetched with prefetchnta
+ *        "load"    - scratchpad touched with a plain load
+ *        Other JIT compilers only accept "auto" and "generic".
+ *
+ * @return 1 on success, 0 if the profile is unknown.
+ */
+RANDOMX_EXPORT int randomx_set_jit_profile(const char *name);
+
+/**
+ * @return The name of the JIT profile used for new virtual machines.
+ */
+RANDOMX_EXPORT const char *randomx_get_jit_profile(void);
+
+/**
+ * Selects the software AES implementation used when RANDOMX_FLAG_HARD_AES is not set.
+ * Both compute the same result, they differ only in speed and memory footprint.
+ * Takes effect for hashes started afterwards.
+ *
+ * @param name is "auto" (or NULL) for the default, or one of:
+ *        "table"   - 8 KiB of T-tables, fastest when they stay in L1
+ *        "compact" - 512 bytes of S-boxes with MixColumns computed for
+ *                    4 lanes at a time, leaves L1 to the scratchpad
+ *
+ * @return 1 on success, 0 if the implementation is unknown.
+ */
+RANDOMX_EXPORT int randomx_set_soft_aes(const char *name);
+
+/**
+ * @return The name of the software AES implementation in use.
+ */
+RANDOMX_EXPORT const char *randomx_get_soft_aes(void);
+
+/**
+ * Turns scratchpad coloring on or off (default: on). Virtual machines created
+ * with RANDOMX_FLAG_LARGE_PAGES then get their scratchpads from shared
+ * huge-page chunks, each at a different offset into its huge pages, so VMs
+ * sharing an L2 or L3 don't put their hot regions on the same cache sets.
+ * Affects speed only, never the hashes. Takes effect for virtual machines
+ * created afterwards.
+ *
+ * @param enable is 1 to color scratchpads, 0 to give each one huge pages of its own.
+ */
+RANDOMX_EXPORT void randomx_set_scratchpad_coloring(int enable);
+
+/**
+ * Selects the Blake2b compression function, used for the input hash of every
+ * hash, by Argon2 and by the program generator. All compute the same result.
+ * The widest one the CPU supports is selected at startup. Not thread safe:
+ * call it before hashing starts.
+ *
+ * @param name is "auto" (or NULL) to choose from CPUID, or one of:
+ *        "ref"    - portable C
+ *        "avx2"   - 256-bit vectors
+ *        "avx512" - 256-bit vectors with AVX-512VL rotates and permutes
+ *
+ * @return 1 on success, 0 if the implementation is unknown or not supported
+ *         by this build and CPU.
+ */
+RANDOMX_EXPORT int randomx_set_blake2b(const char *name);
+
+/**
+ * @return The name of the Blake2b compression function in use.
+ */
+RANDOMX_EXPORT const char *randomx_get_blake2b(void);
+
 /**
  * Creates a randomx_cache structure and allocates memory for RandomX Cache.
  *
  * @param flags is any combination of these 2 flags (each flag can be set or not set):
- *        RANDOMX_FLAG_LARGE_PAGES - allocate memory in large pages
+ *        RANDOMX_FLAG_LARGE_PAGES - allocate memory in large pages (on Linux, falls back
+ *                                   to transparent huge pages if no hugetlbfs pages are reserved)
  *        RANDOMX_FLAG_JIT - create cache structure with JIT compilation support; this makes
  *                           subsequent Dataset initialization faster
- *        Optionally, one of these two flags may be selected:
+ *        Optionally, one of these three flags may be selected (the widest one wins if several are set):
  *        RANDOMX_FLAG_ARGON2_SSSE3 - optimized Argon2 for CPUs with the SSSE3 instruction set
  *                                   makes subsequent cache initialization faster
  *        RANDOMX_FLAG_ARGON2_AVX2 - optimized Argon2 for CPUs with the AVX2 instruction set
  *                                   makes subsequent cache initialization faster
+ *        RANDOMX_FLAG_ARGON2_AVX512 - optimized Argon2 for CPUs with the AVX-512F instruction set
+ *                                     makes subsequent cache initialization faster
  *
  * @return Pointer to an allocated randomx_cache structure.
  *         Returns NULL if:
@@ -109,6 +236,16 @@ RANDOMX_EXPORT randomx_flags randomx_get_flags(void);
  */
 RANDOMX_EXPORT randomx_cache *randomx_alloc_cache(randomx_flags flags);
 
+/**
+ * Returns a pointer to the internal memory buffer of the cache structure. The size
+ * of the internal memory buffer is RANDOMX_ARGON_MEMORY KiB.
+ *
+ * @param cache is a pointer to a previously allocated randomx_cache structure. Must not be NULL.
+ *
+ * @return Pointer to the internal memory buffer of the cache structure.
+*/
+RANDOMX_EXPORT void *randomx_get_cache_memory(randomx_cache *cache);
+
 /**
  * Initializes the cache memory and SuperscalarHash using the provided key value.
  * Does nothing if called again with the same key value.
@@ -119,6 +256,45 @@ RANDOMX_EXPORT randomx_cache *randomx_alloc_cache(randomx_flags flags);
 */
 RANDOMX_EXPORT void randomx_init_cache(randomx_cache *cache, const void *key, size_t keySize);
 
+/**
+ * Runs only the Argon2 fill of randomx_init_cache, so the two steps can be timed apart.
+ * The cache is not usable until randomx_restore_cache is called with the same key.
+ *
+ * @param cache is a pointer to a previously allocated randomx_cache structure. Must not be NULL.
+ * @param key is a pointer to memory which contains the key value. Must not be NULL.
+ * @param keySize is the number of bytes of the key.
+*/
+RANDOMX_EXPORT void randomx_fill_cache(randomx_cache *cache, const void *key, size_t keySize);
+
+/**
+ * Initializes SuperscalarHash for a cache whose memory buffer already holds the Argon2
+ * output for the provided key (e.g. restored from disk), skipping the Argon2 fill.
+ *
+ * @param cache is a pointer to a previously allocated randomx_cache structure. Must not be NULL.
+ *        The buffer returned by randomx_get_cache_memory must already contain the cache
+ *        memory of a cache initialized with the same key.
+ * @param key is a pointer to memory which contains the key value. Must not be NULL.
+ * @param keySize is the number of bytes of the key.
+*/
+RANDOMX_EXPORT void randomx_restore_cache(randomx_cache *cache, const void *key, size_t keySize);
+
+/**
+ * Exports one of the SuperscalarHash programs of an initialized cache. A dataset item
+ * is built by running programs 0, 1, ... in order, each followed by mixing in the
+ * cache line selected by the previous address register (see the RandomX specification).
+ *
+ * @param cache is a pointer to an initialized randomx_cache structure. Must not be NULL.
+ * @param index is the program number.
+ * @param out receives the instructions. Must not be NULL.
+ * @param capacity is the number of instructions out can hold.
+ * @param addressRegister receives the program's address register. Must not be NULL.
+ *
+ * @return the number of instructions, or 0 if index is past the last program
+ *         or the program does not fit in capacity.
+*/
+RANDOMX_EXPORT unsigned randomx_get_superscalar_program(randomx_cache *cache, unsigned index,
+	randomx_superscalar_instr *out, unsigned capacity, unsigned *addressRegister);
+
 /**
  * Releases all memory occupied by the randomx_cache structure.
  *
@@ -130,13 +306,68 @@ RANDOMX_EXPORT void randomx_release_cache(randomx_cache* cache);
  * Creates a randomx_dataset structure and allocates memory for RandomX Dataset.
  *
  * @param flags is the initialization flags. Only one flag is supported (can be set or not set):
- *        RANDOMX_FLAG_LARGE_PAGES - allocate memory in large pages
+ *        RANDOMX_FLAG_LARGE_PAGES - allocate memory in large pages (on Linux, falls back
+ *                                   to transparent huge pages if no hugetlbfs pages are reserved)
  *
  * @return Pointer to an allocated randomx_dataset structure.
  *         NULL is returned if memory allocation fails.
  */
 RANDOMX_EXPORT randomx_dataset *randomx_alloc_dataset(randomx_flags flags);
 
+/**
+ * Creates a randomx_dataset structure and allocates memory for RandomX Dataset,
+ * preferring memory on the given NUMA node.
+ *
+ * @param flags is the initialization flags. Two flags are supported:
+ *        RANDOMX_FLAG_LARGE_PAGES - allocate memory in large pages (as randomx_alloc_dataset)
+ *        RANDOMX_FLAG_1GB_PAGES - allocate memory in 1 GB hugetlbfs pages (Linux only).
+ *                                 If none are available, falls back to large pages and
+ *                                 then to normal pages.
+ * @param node is the NUMA node the memory should be placed on, or -1 for the
+ *        default placement. Placement is a preference: if the node runs out of
+ *        memory, pages come from another node.
+ *
+ * @return Pointer to an allocated randomx_dataset structure.
+ *         NULL is returned if memory allocation fails.
+ */
+RANDOMX_EXPORT randomx_dataset *randomx_alloc_dataset_node(randomx_flags flags, int node);
+
+/**
+ * Creates a partial dataset holding only the first itemCount dataset items.
+ * Light-mode VMs given one with randomx_vm_set_partial_dataset read those items
+ * from memory and compute the rest from the cache, so the hashrate lies between
+ * light and fast mode, roughly in proportion to the resident fraction.
+ *
+ * @param flags and node are as for randomx_alloc_dataset_node.
+ * @param itemCount is the number of resident items, 1 to randomx_dataset_item_count().
+ *
+ * @return Pointer to an allocated randomx_dataset structure.
+ *         NULL is returned if memory allocation fails.
+ */
+RANDOMX_EXPORT randomx_dataset *randomx_alloc_partial_dataset(randomx_flags flags, int node, unsigned long itemCount);
+
+/**
+ * Creates a dataset structure over memory the caller owns, e.g. a shared-memory
+ * mapping another process has already filled. randomx_release_dataset frees
+ * only the structure; the memory must outlive every VM using the dataset.
+ *
+ * @param memory is a buffer of randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE
+ *        bytes, aligned to at least 64 bytes. Must not be NULL.
+ *
+ * @return Pointer to an allocated randomx_dataset structure.
+ *         NULL is returned if memory allocation fails.
+ */
+RANDOMX_EXPORT randomx_dataset *randomx_create_dataset_view(void *memory);
+
+/**
+ * Reports whether the dataset memory is backed by 1 GB pages.
+ *
+ * @param dataset is a pointer to a previously allocated randomx_dataset structure. Must not be NULL.
+ *
+ * @return 1 if the dataset was allocated in 1 GB pages, 0 otherwise.
+*/
+RANDOMX_EXPORT int randomx_dataset_has_1gb_pages(randomx_dataset *dataset);
+
 /**
  * Gets the number of items contained in the dataset.
  *
@@ -149,6 +380,7 @@ RANDOMX_EXPORT unsigned long randomx_dataset_item_count(void);
  *
  * Note: In order to use the Dataset, all items from 0 to (randomx_dataset_item_count() - 1) must be initialized.
  * This may be done by several calls to this function using non-overlapping item sequences.
+ * A partial dataset only holds (and needs) the items it was allocated with.
  *
  * @param dataset is a pointer to a previously allocated randomx_dataset structure. Must not be NULL.
  * @param cache is a pointer to a previously allocated and initialized randomx_cache structure. Must not be NULL.
@@ -178,7 +410,8 @@ RANDOMX_EXPORT void randomx_release_dataset(randomx_dataset *dataset);
  * Creates and initializes a RandomX virtual machine.
  *
  * @param flags is any combination of these 5 flags (each flag can be set or not set):
- *        RANDOMX_FLAG_LARGE_PAGES - allocate scratchpad memory in large pages
+ *        RANDOMX_FLAG_LARGE_PAGES - allocate scratchpad memory in large pages (with the same
+ *                                   transparent huge page fallback as the cache)
  *        RANDOMX_FLAG_HARD_AES - virtual machine will use hardware accelerated AES
  *        RANDOMX_FLAG_FULL_MEM - virtual machine will use the full dataset
  *        RANDOMX_FLAG_JIT - virtual machine will use a JIT compiler
@@ -221,6 +454,19 @@ RANDOMX_EXPORT void randomx_vm_set_cache(randomx_vm *machine, randomx_cache* cac
 */
 RANDOMX_EXPORT void randomx_vm_set_dataset(randomx_vm *machine, randomx_dataset *dataset);
 
+/**
+ * Gives a light-mode virtual machine a partial dataset (see randomx_alloc_partial_dataset).
+ * Items the dataset holds are read from it; all others are still computed from the cache,
+ * which the VM keeps using. Supported by the x86-64 JIT and the interpreter; other VMs
+ * ignore it. The dataset's items must be initialized from the VM's current cache.
+ *
+ * @param machine is a pointer to a randomx_vm structure that was initialized
+ *        without RANDOMX_FLAG_FULL_MEM. Must not be NULL.
+ * @param dataset is a pointer to an initialized partial dataset, or NULL to
+ *        compute every item from the cache again.
+*/
+RANDOMX_EXPORT void randomx_vm_set_partial_dataset(randomx_vm *machine, randomx_dataset *dataset);
+
 /**
  * Releases all memory occupied by the randomx_vm structure.
  *
@@ -228,6 +474,27 @@ RANDOMX_EXPORT void randomx_vm_set_dataset(randomx_vm *machine, randomx_dataset
 */
 RANDOMX_EXPORT void randomx_destroy_vm(randomx_vm *machine);
 
+/**
+ * Returns a pointer to the scratchpad of a virtual machine. The size of the
+ * scratchpad is RANDOMX_SCRATCHPAD_L3 bytes.
+ *
+ * @param machine is a pointer to a randomx_vm structure. Must not be NULL.
+ *
+ * @return Pointer to the scratchpad memory of the virtual machine.
+*/
+RANDOMX_EXPORT const void *randomx_get_scratchpad(randomx_vm *machine);
+
+/**
+ * Returns the buffer a JIT-compiled virtual machine generates its programs into.
+ *
+ * @param machine is a pointer to a randomx_vm structure. Must not be NULL.
+ * @param size receives the size of the buffer in bytes (0 if there is none).
+ *        Must not be NULL.
+ *
+ * @return Pointer to the code buffer, NULL for interpreted virtual machines.
+*/
+RANDOMX_EXPORT const void *randomx_get_jit_code(randomx_vm *machine, size_t *size);
+
 /**
  * Calculates a RandomX hash value.
  *
@@ -260,6 +527,118 @@ RANDOMX_EXPORT void randomx_calculate_hash_first(randomx_vm* machine, const void
 RANDOMX_EXPORT void randomx_calculate_hash_next(randomx_vm* machine, const void* nextInput, size_t nextInputSize, void* output);
 RANDOMX_EXPORT void randomx_calculate_hash_last(randomx_vm* machine, void* output);
 
+/**
+ * Searches a range of nonces for a hash that meets a 256-bit target.
+ * The header is hashed with a 256-bit little-endian nonce written at nonceOffset,
+ * incrementing the nonce by 1 after each hash. The loop is pipelined internally
+ * (same as randomx_calculate_hash_first/next/last), so no per-hash state leaves
+ * the library. The search returns on the first hash that is less than or equal
+ * to the target, or when the iteration count is exhausted.
+ *
+ * The pipeline is not drained on return: the scratchpad is left filled for the
+ * returned nonce (or the one after a winning nonce). A following call with the
+ * same header and that nonce carries on from there, so a caller can poll often
+ * at no cost in throughput; any other input starts the pipeline over. The
+ * other hashing functions of the virtual machine end the carried state.
+ *
+ * This function preserves the floating point rounding mode of the calling thread.
+ *
+ * @param machine is a pointer to a randomx_vm structure. Must not be NULL.
+ * @param header is a pointer to the header to be hashed. Must not be NULL.
+ * @param headerSize is the size of the header in bytes. Must not exceed
+ *        RANDOMX_SEARCH_MAX_INPUT_SIZE.
+ * @param nonceOffset is the offset of the nonce within the header. The nonce
+ *        (RANDOMX_NONCE_SIZE bytes) must fit entirely within the header.
+ * @param nonce is a pointer to the starting nonce (RANDOMX_NONCE_SIZE bytes,
+ *        little-endian). Must not be NULL. On return, it holds the winning nonce
+ *        if one was found, otherwise the next nonce that has not been hashed.
+ * @param iterations is the maximum number of nonces to hash.
+ * @param target is a pointer to the 256-bit little-endian target
+ *        (RANDOMX_HASH_SIZE bytes). Must not be NULL.
+ * @param output is a pointer to memory where the winning hash will be stored.
+ *        Must not be NULL and at least RANDOMX_HASH_SIZE bytes must be available
+ *        for writing. Only written if a winning nonce was found.
+ * @param hashCount is a pointer where the number of hashes computed is stored.
+ *        May be NULL.
+ *
+ * @return 1 if a nonce meeting the target was found, 0 otherwise.
+*/
+RANDOMX_EXPORT int randomx_search_nonce(randomx_vm* machine, const void* header, size_t headerSize, size_t nonceOffset, void* nonce, uint64_t iterations, const void* target, void* output, uint64_t* hashCount);
+
+/**
+ * Calculates the Blake2b midstate of a hash input: the Blake2b-512 state after
+ * its first 128-byte block, for randomx_search_nonce_midstate. It depends only
+ * on those 128 bytes.
+ *
+ * @param input is a pointer to the hash input. Must not be NULL.
+ * @param inputSize is the size of the input in bytes. Must be greater than
+ *        RANDOMX_MIDSTATE_BLOCK.
+ * @param midstate is a pointer to memory where the midstate will be stored.
+ *        Must not be NULL and at least RANDOMX_MIDSTATE_SIZE bytes must be
+ *        available for writing.
+*/
+RANDOMX_EXPORT void randomx_calculate_midstate(const void *input, size_t inputSize, void *midstate);
+
+/**
+ * Same as randomx_search_nonce, except that only the nonce bytes past the
+ * first RANDOMX_MIDSTATE_BLOCK bytes of the header are varied, so the first
+ * Blake2b block is the same for every hash and each hash starts from the
+ * midstate instead. What is incremented is the 64-bit little-endian counter
+ * in the first 8 of those bytes (bytes 20-27 of a nonce at offset 108); the
+ * nonce bytes after it never change. The search also returns after hashing
+ * the counter's last value (all ones); without a hit it leaves the counter
+ * wrapped to zero, which tells the caller its range is used up.
+ *
+ * @param midstate is the midstate of the header (randomx_calculate_midstate).
+ *        Must not be NULL. It must be recalculated whenever the first
+ *        RANDOMX_MIDSTATE_BLOCK bytes of the header change.
+ * @param nonceOffset must leave at least 8 nonce bytes past byte
+ *        RANDOMX_MIDSTATE_BLOCK of the header, which must be longer than that.
+ *
+ * All other parameters and the return value are as for randomx_search_nonce.
+*/
+RANDOMX_EXPORT int randomx_search_nonce_midstate(randomx_vm* machine, const void* midstate, const void* header, size_t headerSize, size_t nonceOffset, void* nonce, uint64_t iterations, const void* target, void* output, uint64_t* hashCount);
+
+/**
+ * Creates a phase profile: per-phase histograms of the time each phase of a
+ * hash takes, for the virtual machines it is attached to. The time is read
+ * from the TSC on x86, the generic timer (cntvct) on ARM64 and a nanosecond
+ * clock elsewhere, see randomx_phase_timer.
+ *
+ * @return Pointer to a zeroed profile, or NULL if the library was built
+ *         without RANDOMX_PHASE_PROFILE (or allocation failed).
+*/
+RANDOMX_EXPORT randomx_phase_profile *randomx_alloc_phase_profile(void);
+
+/**
+ * Releases a phase profile. No virtual machine may still use it for hashing.
+*/
+RANDOMX_EXPORT void randomx_release_phase_profile(randomx_phase_profile *profile);
+
+/**
+ * Attaches a phase profile to a virtual machine; its hashes are recorded in
+ * the profile from now on. A profile must only be attached to the virtual
+ * machines of one thread at a time.
+ *
+ * @param profile may be NULL to stop recording.
+*/
+RANDOMX_EXPORT void randomx_vm_set_phase_profile(randomx_vm *machine, randomx_phase_profile *profile);
+
+/**
+ * Copies the histograms of a profile. Safe to call from any thread while
+ * the profile is being filled.
+ *
+ * @param stats receives RANDOMX_PHASE_COUNT entries, indexed by randomx_phase.
+*/
+RANDOMX_EXPORT void randomx_read_phase_profile(const randomx_phase_profile *profile, randomx_phase_stats *stats);
+
+/**
+ * @return The current reading of the timer phase profiles are measured in,
+ *         0 if the library was built without RANDOMX_PHASE_PROFILE. Read it
+ *         twice over a known interval for its rate.
+*/
+RANDOMX_EXPORT uint64_t randomx_phase_timer(void);
+
 /**
  * Calculate a RandomX commitment from a RandomX hash and its input.
  *
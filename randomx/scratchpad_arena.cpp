@@ -0,0 +1,144 @@
+/*
+Copyright (c) 2018-2019, tevador <tevador@gmail.com>
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the copyright holder nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <atomic>
+#include <bitset>
+#include <mutex>
+#include <vector>
+#include "scratchpad_arena.hpp"
+#include "virtual_memory.h"
+
+namespace randomx {
+
+	namespace {
+
+		constexpr size_t HugePageSize = 2 * 1024 * 1024;
+		constexpr size_t SlotStride = ScratchpadSize + ScratchpadColorStep;
+		constexpr size_t ChunkSize = alignSize(ScratchpadColors * SlotStride, HugePageSize);
+
+		struct Chunk {
+			uint8_t* memory;
+			bool hugetlb;
+			bool exhausted;                              //hugetlb pool ran out
+			int node;
+			std::bitset<ScratchpadColors> used;
+			std::bitset<ScratchpadColors> populated;
+		};
+
+		struct Arena {
+			std::mutex mutex;
+			std::vector<Chunk*> chunks;
+			std::atomic<bool> enabled{ true };
+		};
+
+		//never destroyed: a VM may be released during static destruction
+		Arena& arena() {
+			static Arena* instance = new Arena();
+			return *instance;
+		}
+
+		//fault in the huge pages under slot i, false if a hugetlb chunk can't
+		bool takeSlot(Chunk& chunk, size_t i) {
+			if (!chunk.populated[i]) {
+				const size_t first = i * SlotStride / HugePageSize * HugePageSize;
+				const size_t last = alignSize(i * SlotStride + ScratchpadSize, HugePageSize);
+				if (populatePages(chunk.memory + first, last - first) != 0 && chunk.hugetlb) {
+					chunk.exhausted = true;
+					return false;
+				}
+				chunk.populated.set(i);
+			}
+			chunk.used.set(i);
+			return true;
+		}
+
+		void freeChunk(Chunk* chunk) {
+			freePagedMemory(chunk->memory, ChunkSize);
+			delete chunk;
+		}
+	}
+
+	namespace ScratchpadArena {
+
+		void setEnabled(bool enabled) {
+			arena().enabled = enabled;
+		}
+
+		bool isEnabled() {
+			return arena().enabled;
+		}
+
+		void* allocate() {
+			Arena& arena = randomx::arena();
+			if (!arena.enabled)
+				return nullptr;
+			const int node = currentMemoryNode();
+			std::lock_guard<std::mutex> lock(arena.mutex);
+			for (Chunk* chunk : arena.chunks) {
+				if (chunk->node != node || chunk->exhausted)
+					continue;
+				for (size_t i = 0; i < ScratchpadColors; ++i) {
+					if (!chunk->used[i] && takeSlot(*chunk, i))
+						return chunk->memory + i * SlotStride;
+				}
+			}
+			uint8_t* memory = (uint8_t*)reserveLargePagesMemory(ChunkSize);
+			if (memory != nullptr) {
+				Chunk* chunk = new Chunk{ memory, true, false, node, {}, {} };
+				if (takeSlot(*chunk, 0)) {
+					arena.chunks.push_back(chunk);
+					return memory;
+				}
+				freeChunk(chunk);
+			}
+			memory = (uint8_t*)allocTransparentHugePagesMemory(ChunkSize);
+			if (memory == nullptr)
+				return nullptr;
+			Chunk* chunk = new Chunk{ memory, false, false, node, {}, {} };
+			takeSlot(*chunk, 0);
+			arena.chunks.push_back(chunk);
+			return memory;
+		}
+
+		bool release(void* ptr) {
+			Arena& arena = randomx::arena();
+			std::lock_guard<std::mutex> lock(arena.mutex);
+			for (size_t c = 0; c < arena.chunks.size(); ++c) {
+				Chunk* chunk = arena.chunks[c];
+				if ((uint8_t*)ptr < chunk->memory || (uint8_t*)ptr >= chunk->memory + ChunkSize)
+					continue;
+				chunk->used.reset(((uint8_t*)ptr - chunk->memory) / SlotStride);
+				if (chunk->used.none()) {
+					arena.chunks.erase(arena.chunks.begin() + c);
+					freeChunk(chunk);
+				}
+				return true;
+			}
+			return false;
+		}
+	}
+}
@@ -0,0 +1,57 @@
+/*
+Copyright (c) 2018-2019, tevador <tevador@gmail.com>
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the copyright holder nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <cstddef>
+#include "common.hpp"
+
+namespace randomx {
+
+	//Scratchpad n of a chunk starts n * ScratchpadColorStep into a huge page
+	constexpr size_t ScratchpadColors = 8;
+	constexpr size_t ScratchpadColorStep = RANDOMX_SCRATCHPAD_L1;
+
+	//Scratchpads of the VMs on one NUMA node, packed into huge-page chunks at
+	//a different offset (color) each. Within a huge page the virtual offset
+	//is the physical one, and L2 and L3 sets are indexed by the low physical
+	//bits, so scratchpads in 2 MB pages of their own all put their hot L1
+	//region (the first 16 KiB) on the same sets, where SMT siblings and
+	//threads sharing an L3 evict each other's. Staggered by 16 KiB, the eight
+	//of a chunk spread over 128 KiB worth of sets. Chunks are hugetlb pages
+	//faulted in per scratchpad, so the chunk's unused pages stay in the pool,
+	//else transparent huge pages. Thread-safe.
+	namespace ScratchpadArena {
+		//For scratchpads allocated afterwards (default: on)
+		void setEnabled(bool enabled);
+		bool isEnabled();
+		//ScratchpadSize bytes, nullptr if disabled or no chunk could be mapped
+		void* allocate();
+		//False if ptr is not from the arena
+		bool release(void* ptr);
+	}
+}
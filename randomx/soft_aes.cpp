@@ -27,6 +27,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "soft_aes.h"
+#include <cstring>
 
 alignas(16) const uint8_t sbox[256] = {
 	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
@@ -47,6 +48,25 @@ alignas(16) const uint8_t sbox[256] = {
 	0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
 };
 
+alignas(16) const uint8_t sboxInv[256] = {
+	0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
+	0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
+	0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
+	0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
+	0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
+	0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
+	0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
+	0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
+	0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
+	0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
+	0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
+	0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
+	0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
+	0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
+	0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
+	0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d,
+};
+
 alignas(16) const uint32_t lutEnc0[256] = {
 	0xa56363c6, 0x847c7cf8, 0x997777ee, 0x8d7b7bf6, 0x0df2f2ff, 0xbd6b6bd6, 0xb16f6fde, 0x54c5c591,
 	0x50303060, 0x03010102, 0xa96767ce, 0x7d2b2b56, 0x19fefee7, 0x62d7d7b5, 0xe6abab4d, 0x9a7676ec,
@@ -362,3 +382,156 @@ rx_vec_i128 soft_aesdec(rx_vec_i128 in, rx_vec_i128 key) {
 
 	return rx_xor_vec_i128(out, key);
 }
+
+/*
+	Compact software AES: the two 256-byte S-boxes replace the 8 KiB of
+	T-tables, so the AES state no longer competes with the scratchpad for L1.
+	ShiftRows is folded into the S-box gather and MixColumns is computed on
+	whole columns (4 at a time with SSE2, 2 per 64-bit word otherwise).
+	InvMixColumns is MixColumns preceded by a multiplication with the
+	circulant {05,00,04,00}, so the decrypted lanes take that step first and
+	then share the MixColumns pass with the encrypted lanes.
+*/
+
+//SubBytes(ShiftRows(in)) or InvSubBytes(InvShiftRows(in)) of column c
+template<bool enc>
+static FORCE_INLINE uint32_t subShiftColumn(const uint32_t (&col)[4], int c) {
+	const uint8_t* box = enc ? sbox : sboxInv;
+	constexpr int d = enc ? 1 : 3;
+	return (uint32_t)box[col[c] & 0xff] |
+		(uint32_t)box[(col[(c + d) & 3] >> 8) & 0xff] << 8 |
+		(uint32_t)box[(col[(c + 2) & 3] >> 16) & 0xff] << 16 |
+		(uint32_t)box[col[(c + 3 * d) & 3] >> 24] << 24;
+}
+
+template<bool enc>
+static FORCE_INLINE void subShiftLane(rx_vec_i128 in, uint32_t (&out)[4]) {
+	const uint32_t col[4] = {
+		(uint32_t)rx_vec_i128_x(in),
+		(uint32_t)rx_vec_i128_y(in),
+		(uint32_t)rx_vec_i128_z(in),
+		(uint32_t)rx_vec_i128_w(in)
+	};
+	out[0] = subShiftColumn<enc>(col, 0);
+	out[1] = subShiftColumn<enc>(col, 1);
+	out[2] = subShiftColumn<enc>(col, 2);
+	out[3] = subShiftColumn<enc>(col, 3);
+}
+
+#ifdef __SSE2__
+
+typedef __m128i MixWord;
+
+static FORCE_INLINE MixWord loadMixWord(const uint32_t* col) {
+	return _mm_set_epi32(col[3], col[2], col[1], col[0]);
+}
+
+static FORCE_INLINE MixWord xorMix(MixWord a, MixWord b) {
+	return _mm_xor_si128(a, b);
+}
+
+static FORCE_INLINE MixWord xtime(MixWord x) {
+	return _mm_xor_si128(_mm_add_epi8(x, x), _mm_and_si128(_mm_cmplt_epi8(x, _mm_setzero_si128()), _mm_set1_epi8(0x1b)));
+}
+
+//rotate each 32-bit column so that row r receives row r+1 (r+2)
+static FORCE_INLINE MixWord rotateRows8(MixWord x) {
+	return _mm_or_si128(_mm_srli_epi32(x, 8), _mm_slli_epi32(x, 24));
+}
+
+static FORCE_INLINE MixWord rotateRows16(MixWord x) {
+	return _mm_or_si128(_mm_srli_epi32(x, 16), _mm_slli_epi32(x, 16));
+}
+
+#else
+
+typedef uint64_t MixWord;
+
+static FORCE_INLINE MixWord loadMixWord(const uint32_t* col) {
+	return col[0] | (uint64_t)col[1] << 32;
+}
+
+static FORCE_INLINE MixWord xorMix(MixWord a, MixWord b) {
+	return a ^ b;
+}
+
+static FORCE_INLINE MixWord xtime(MixWord x) {
+	return ((x & 0x7f7f7f7f7f7f7f7f) << 1) ^ (((x >> 7) & 0x0101010101010101) * 0x1b);
+}
+
+static FORCE_INLINE MixWord rotateRows8(MixWord x) {
+	return ((x >> 8) & 0x00ffffff00ffffff) | ((x << 24) & 0xff000000ff000000);
+}
+
+static FORCE_INLINE MixWord rotateRows16(MixWord x) {
+	return ((x >> 16) & 0x0000ffff0000ffff) | ((x << 16) & 0xffff0000ffff0000);
+}
+
+#endif
+
+constexpr int MixWordsPerLane = sizeof(rx_vec_i128) / sizeof(MixWord);
+
+template<bool enc>
+static FORCE_INLINE void subShiftMix(rx_vec_i128 in, MixWord* out) {
+	uint32_t col[4];
+	subShiftLane<enc>(in, col);
+	for (int i = 0; i < MixWordsPerLane; ++i) {
+		MixWord x = loadMixWord(col + i * (4 / MixWordsPerLane));
+		if (!enc) {
+			x = xorMix(x, xtime(xtime(xorMix(x, rotateRows16(x)))));
+		}
+		out[i] = x;
+	}
+}
+
+template<int enc>
+void soft_aes4_compact(rx_vec_i128* state, const rx_vec_i128* key) {
+	MixWord mix[4 * MixWordsPerLane];
+	subShiftMix<(enc & 1) != 0>(state[0], mix + 0 * MixWordsPerLane);
+	subShiftMix<(enc & 2) != 0>(state[1], mix + 1 * MixWordsPerLane);
+	subShiftMix<(enc & 4) != 0>(state[2], mix + 2 * MixWordsPerLane);
+	subShiftMix<(enc & 8) != 0>(state[3], mix + 3 * MixWordsPerLane);
+	for (int i = 0; i < 4 * MixWordsPerLane; ++i) {
+		MixWord x = mix[i];
+		MixWord y = rotateRows8(x);
+		MixWord t = xorMix(x, y);
+		mix[i] = xorMix(xorMix(xtime(t), y), rotateRows16(t));
+	}
+	for (int i = 0; i < 4; ++i) {
+#ifdef __SSE2__
+		state[i] = rx_xor_vec_i128(mix[i], key[i]);
+#else
+		rx_vec_i128 out = rx_set_int_vec_i128(mix[2 * i + 1] >> 32, mix[2 * i + 1], mix[2 * i] >> 32, mix[2 * i]);
+		state[i] = rx_xor_vec_i128(out, key[i]);
+#endif
+	}
+}
+
+template void soft_aes4_compact<0x5>(rx_vec_i128* state, const rx_vec_i128* key);
+template void soft_aes4_compact<0xa>(rx_vec_i128* state, const rx_vec_i128* key);
+
+static SoftAesImpl softAesImpl = SoftAesTable;
+
+static const char* softAesNames[] = { "table", "compact" };
+
+bool setSoftAes(const char* name) {
+	if (name == nullptr || strcmp(name, "auto") == 0) {
+		softAesImpl = SoftAesTable;
+		return true;
+	}
+	for (int i = 0; i < 2; ++i) {
+		if (strcmp(name, softAesNames[i]) == 0) {
+			softAesImpl = (SoftAesImpl)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+SoftAesImpl getSoftAes() {
+	return softAesImpl;
+}
+
+const char* getSoftAesName() {
+	return softAesNames[softAesImpl];
+}
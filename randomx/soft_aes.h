@@ -35,6 +35,24 @@ rx_vec_i128 soft_aesenc(rx_vec_i128 in, rx_vec_i128 key);
 
 rx_vec_i128 soft_aesdec(rx_vec_i128 in, rx_vec_i128 key);
 
+//One round in each of 4 lanes with the compact (S-box only) implementation.
+//Lane i is encrypted if bit i of 'enc' is set and decrypted otherwise.
+template<int enc>
+void soft_aes4_compact(rx_vec_i128* state, const rx_vec_i128* key);
+
+enum SoftAesImpl {
+	SoftAesTable,   //T-tables, 8.25 KiB
+	SoftAesCompact, //S-boxes, 512 bytes
+};
+
+//Selects the software AES used by the AES hash/generator functions:
+//"auto" (or nullptr), "table" or "compact". Returns false if the name is unknown.
+bool setSoftAes(const char* name);
+
+SoftAesImpl getSoftAes();
+
+const char* getSoftAesName();
+
 template<bool soft>
 inline rx_vec_i128 aesenc(rx_vec_i128 in, rx_vec_i128 key) {
 	return soft ? soft_aesenc(in, key) : rx_aesenc_vec_i128(in, key);
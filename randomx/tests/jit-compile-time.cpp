@@ -0,0 +1,84 @@
+#include <vector>
+#include "../aes_hash.hpp"
+#include "../jit_compiler_x86.hpp"
+#include "../program.hpp"
+#include "utility.hpp"
+#include "stopwatch.hpp"
+#include "../blake2/blake2.h"
+
+//Reports the time to JIT-compile one program (generateProgram and generateProgramLight).
+//Programs are generated up front so only the compiler is measured.
+
+constexpr int ProgramPool = 64;
+
+template<bool softAes>
+void fillPrograms(std::vector<randomx::Program>& programs) {
+	const char seed[] = "JIT compile time test seed";
+	uint8_t hash[64];
+	blake2b(&hash, sizeof hash, &seed, sizeof seed, nullptr, 0);
+	for (auto& program : programs) {
+		fillAes1Rx4<softAes>(hash, sizeof(program), &program);
+	}
+}
+
+template<bool light>
+double compileTime(randomx::JitCompilerX86& jit, std::vector<randomx::Program>& programs, int count) {
+	randomx::ProgramConfiguration config;
+	Stopwatch sw(true);
+	for (int i = 0; i < count; ++i) {
+		randomx::Program& program = programs[i % ProgramPool];
+		auto addressRegisters = program.getEntropy(12);
+		config.readReg0 = 0 + (addressRegisters & 1);
+		addressRegisters >>= 1;
+		config.readReg1 = 2 + (addressRegisters & 1);
+		addressRegisters >>= 1;
+		config.readReg2 = 4 + (addressRegisters & 1);
+		addressRegisters >>= 1;
+		config.readReg3 = 6 + (addressRegisters & 1);
+		if (light)
+			jit.generateProgramLight(program, config, i * randomx::CacheLineSize);
+		else
+			jit.generateProgram(program, config);
+	}
+	return sw.getElapsed() * 1e+9 / count;
+}
+
+int main(int argc, char** argv) {
+	int count;
+	bool softAes, help;
+	readIntOption("--count", argc, argv, count, 1000000);
+	readOption("--softAes", argc, argv, softAes);
+	readOption("--help", argc, argv, help);
+
+	if (help) {
+		std::cout << "Usage: " << argv[0] << " [OPTIONS]" << std::endl;
+		std::cout << "  --count N        compile N programs per mode (default: 1000000)" << std::endl;
+		std::cout << "  --profile NAME   JIT codegen profile (default: auto)" << std::endl;
+		std::cout << "  --softAes        generate the programs with software AES" << std::endl;
+		return 0;
+	}
+
+	for (int i = 0; i < argc - 1; ++i) {
+		if (strcmp(argv[i], "--profile") == 0 && !randomx::JitCompilerX86::setProfile(argv[i + 1])) {
+			std::cout << "Unknown JIT profile " << argv[i + 1] << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<randomx::Program> programs(ProgramPool);
+	if (softAes)
+		fillPrograms<true>(programs);
+	else
+		fillPrograms<false>(programs);
+
+	randomx::JitCompilerX86 jit;
+	std::cout << "JIT profile: " << randomx::JitCompilerX86::getProfile().name << std::endl;
+	std::cout << "Compiling " << count << " programs per mode..." << std::endl;
+
+	//warm up the code buffer and the caches
+	compileTime<false>(jit, programs, ProgramPool);
+
+	std::cout << "generateProgram:      " << compileTime<false>(jit, programs, count) << " ns/program" << std::endl;
+	std::cout << "generateProgramLight: " << compileTime<true>(jit, programs, count) << " ns/program" << std::endl;
+	return 0;
+}
@@ -174,6 +174,37 @@ int main() {
 		assert(equalsHex(state, "fa89397dd6ca422513aeadba3f124b5540324c4ad4b6db434394307a17c833ab"));
 	});
 
+	runTest("AesGenerator1R (compact soft AES)", true, []() {
+		char state[64] = { 0 };
+		hex2bin("6c19536eb2de31b6c0065f7f116e86f960d8af0c57210a6584c3237b9d064dc7", 64, state);
+		assert(randomx_set_soft_aes("compact"));
+		assert(strcmp(randomx_get_soft_aes(), "compact") == 0);
+		fillAes1Rx4<true>(state, sizeof(state), state);
+		randomx_set_soft_aes("auto");
+		assert(equalsHex(state, "fa89397dd6ca422513aeadba3f124b5540324c4ad4b6db434394307a17c833ab"));
+	});
+
+	runTest("Soft AES compact vs table", true, []() {
+		assert(!randomx_set_soft_aes("bitsliced"));
+		alignas(16) uint8_t seed[64];
+		alignas(16) uint8_t buffer[2][8192];
+		alignas(16) uint8_t hash[2][128];
+		alignas(16) uint8_t state[2][64];
+		for (int impl = 0; impl < 2; ++impl) {
+			randomx_set_soft_aes(impl ? "compact" : "table");
+			for (int i = 0; i < 64; ++i)
+				seed[i] = i * 37 + 1;
+			fillAes4Rx4<true>(seed, sizeof(buffer[impl]), buffer[impl]);
+			memcpy(state[impl], buffer[impl], 64);
+			hashAndFillAes1Rx4<true>(buffer[impl], sizeof(buffer[impl]), hash[impl], state[impl]);
+			hashAes1Rx4<true>(buffer[impl], sizeof(buffer[impl]), hash[impl] + 64);
+		}
+		randomx_set_soft_aes("auto");
+		assert(memcmp(buffer[0], buffer[1], sizeof(buffer[0])) == 0);
+		assert(memcmp(hash[0], hash[1], sizeof(hash[0])) == 0);
+		assert(memcmp(state[0], state[1], sizeof(state[0])) == 0);
+	});
+
 	randomx::NativeRegisterFile reg;
 	randomx::BytecodeMachine decoder;
 	randomx::InstructionByteCode ibc;
@@ -1090,6 +1121,60 @@ int main() {
 		assert(rx_get_rounding_mode() == RoundToNearest);
 	});
 
+	runTest("JIT code buffer", RANDOMX_HAVE_COMPILER, []() {
+		size_t size = 0;
+		assert(randomx_get_jit_code(vm, &size) != nullptr);
+		assert(size > 0);
+		randomx_vm* interpreted = randomx_create_vm(RANDOMX_FLAG_DEFAULT, cache, nullptr);
+		assert(randomx_get_jit_code(interpreted, &size) == nullptr);
+		assert(size == 0);
+		randomx_destroy_vm(interpreted);
+	});
+
+	runTest("Cache fill + restore", stringsEqual(RANDOMX_ARGON_SALT, "RandomX\x03"), []() {
+		const char key[] = "test key 000";
+		randomx_cache* split = randomx_alloc_cache(RANDOMX_FLAG_DEFAULT);
+		randomx_fill_cache(split, key, sizeof(key) - 1);
+		randomx_restore_cache(split, key, sizeof(key) - 1);
+		uint64_t* cacheMemory = (uint64_t*)randomx_get_cache_memory(split);
+		assert(cacheMemory[0] == 0x191e0e1d23c02186);
+		assert(cacheMemory[33554431] == 0x1f47f056d05cd99b);
+		randomx_vm* machine = randomx_create_vm(RANDOMX_FLAG_DEFAULT, split, nullptr);
+		const char input[] = "Lorem ipsum dolor sit amet";
+		char hash[RANDOMX_HASH_SIZE];
+		randomx_calculate_hash(machine, input, sizeof(input) - 1, hash);
+		assert(equalsHex(hash, "300a0adb47603dedb42228ccb2b211104f4da45af709cd7547cd049e9489c969"));
+		randomx_destroy_vm(machine);
+		randomx_release_cache(split);
+	});
+
+	randomx_phase_profile* phaseProfile = randomx_alloc_phase_profile();
+
+	runTest("Phase profile", phaseProfile != nullptr && stringsEqual(RANDOMX_ARGON_SALT, "RandomX\x03"), [phaseProfile]() {
+		char hash[RANDOMX_HASH_SIZE];
+		randomx_vm_set_phase_profile(vm, phaseProfile);
+		calcStringHash("test key 000", "Lorem ipsum dolor sit amet", &hash);
+		randomx_vm_set_phase_profile(vm, nullptr);
+		assert(equalsHex(hash, "300a0adb47603dedb42228ccb2b211104f4da45af709cd7547cd049e9489c969"));
+
+		randomx_phase_stats stats[RANDOMX_PHASE_COUNT];
+		randomx_read_phase_profile(phaseProfile, stats);
+		assert(stats[RANDOMX_PHASE_BLAKE2B].count == RANDOMX_PROGRAM_COUNT);
+		assert(stats[RANDOMX_PHASE_FILL_SCRATCHPAD].count == 1);
+		assert(stats[RANDOMX_PHASE_GENERATE_PROGRAM].count == RANDOMX_PROGRAM_COUNT);
+		assert(stats[RANDOMX_PHASE_COMPILE].count == RANDOMX_PROGRAM_COUNT);
+		assert(stats[RANDOMX_PHASE_EXECUTE].count == RANDOMX_PROGRAM_COUNT);
+		assert(stats[RANDOMX_PHASE_FINAL_HASH].count == 1);
+		for (int phase = 0; phase < RANDOMX_PHASE_COUNT; ++phase) {
+			uint64_t bucketed = 0;
+			for (int bucket = 0; bucket < RANDOMX_PHASE_BUCKETS; ++bucket)
+				bucketed += stats[phase].buckets[bucket];
+			assert(bucketed == stats[phase].count);
+		}
+	});
+
+	randomx_release_phase_profile(phaseProfile);
+
 	if (RANDOMX_HAVE_COMPILER) {
 		randomx_destroy_vm(vm);
 		vm = nullptr;
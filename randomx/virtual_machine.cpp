@@ -138,6 +138,6 @@ namespace randomx {
 
 	template class VmBase<AlignedAllocator<CacheLineSize>, false>;
 	template class VmBase<AlignedAllocator<CacheLineSize>, true>;
-	template class VmBase<LargePageAllocator, false>;
-	template class VmBase<LargePageAllocator, true>;
+	template class VmBase<ScratchpadAllocator, false>;
+	template class VmBase<ScratchpadAllocator, true>;
 }
\ No newline at end of file
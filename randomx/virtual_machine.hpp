@@ -41,6 +41,9 @@ public:
 	virtual void hashAndFill(void* out, size_t outSize, uint64_t *fill_state) = 0;
 	virtual void setDataset(randomx_dataset* dataset) { }
 	virtual void setCache(randomx_cache* cache) { }
+	void setPartialDataset(randomx_dataset* dataset) {
+		partialPtr = dataset;
+	}
 	virtual void initScratchpad(void* seed) = 0;
 	virtual void run(void* seed) = 0;
 	void resetRoundingMode();
@@ -50,6 +53,10 @@ public:
 	const void* getScratchpad() {
 		return scratchpad;
 	}
+	virtual const void* getCode(size_t& size) {
+		size = 0;
+		return nullptr;
+	}
 	const randomx::Program& getProgram()
 	{
 		return program;
@@ -69,9 +76,15 @@ protected:
 		randomx_dataset* datasetPtr;
 	};
 	uint64_t datasetOffset;
+	randomx_dataset* partialPtr = nullptr; //light mode: resident leading dataset items
 public:
+	randomx_phase_profile* phaseProfile = nullptr;
 	std::string cacheKey;
 	alignas(16) uint64_t tempHash[8]; //8 64-bit values used to store intermediate data
+	//randomx_search_nonce*: the input the scratchpad and tempHash were last
+	//filled for, so the next search call can pick the pipeline up there
+	alignas(16) uint8_t searchInput[RANDOMX_SEARCH_MAX_INPUT_SIZE];
+	size_t searchInputSize = 0; //0: no search in flight
 };
 
 namespace randomx {
@@ -44,6 +44,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <errno.h>
+#include <stdint.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#endif
 #ifndef MAP_ANONYMOUS
 #define MAP_ANONYMOUS MAP_ANON
 #endif
@@ -122,6 +130,20 @@ out:
 	}
 	return error;
 }
+
+/* The node this thread's allocations ask for (setPreferredMemoryNode), -1
+ * for none: Windows' counterpart of a preferred memory policy */
+#if defined(_MSC_VER)
+static __declspec(thread) int preferredNode = -1;
+#else
+static __thread int preferredNode = -1;
+#endif
+
+static void* allocNodeMemory(size_t bytes, DWORD type, DWORD protect) {
+	if (preferredNode >= 0)
+		return VirtualAllocExNuma(GetCurrentProcess(), NULL, bytes, type, protect, (DWORD)preferredNode);
+	return VirtualAlloc(NULL, bytes, type, protect);
+}
 #else
 #define Fail(func)	do  {*errfunc = func; return errno;} while(0)
 #endif
@@ -129,7 +151,7 @@ out:
 void* allocMemoryPages(size_t bytes) {
 	void* mem;
 #if defined(_WIN32) || defined(__CYGWIN__)
-	mem = VirtualAlloc(NULL, bytes, MEM_COMMIT, PAGE_READWRITE);
+	mem = allocNodeMemory(bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
 #else
 	#if defined(__NetBSD__)
 		#define RESERVED_FLAGS PROT_MPROTECT(PROT_EXEC)
@@ -156,6 +178,40 @@ void* allocMemoryPages(size_t bytes) {
 	return mem;
 }
 
+/* Two views of the same anonymous file: writable at the returned address,
+ * executable at *execView. Code written through one runs from the other
+ * without any page ever being writable and executable, and without mprotect.
+ * NULL where memfd is unavailable or executable shared mappings are refused.
+ */
+void* allocDualMappedMemory(size_t bytes, void** execView) {
+#if defined(__linux__) && defined(SYS_memfd_create)
+	void *rw, *rx;
+	int fd = (int)syscall(SYS_memfd_create, "randomx-jit", MFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, (off_t)bytes) != 0) {
+		close(fd);
+		return NULL;
+	}
+	rw = mmap(NULL, bytes, PAGE_READWRITE, MAP_SHARED, fd, 0);
+	rx = mmap(NULL, bytes, PAGE_EXECUTE_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (rw == MAP_FAILED || rx == MAP_FAILED) {
+		if (rw != MAP_FAILED)
+			munmap(rw, bytes);
+		if (rx != MAP_FAILED)
+			munmap(rx, bytes);
+		return NULL;
+	}
+	*execView = rx;
+	return rw;
+#else
+	(void)bytes;
+	(void)execView;
+	return NULL;
+#endif
+}
+
 static inline int pageProtect(void* ptr, size_t bytes, int rules, char **errfunc) {
 #if defined(_WIN32) || defined(__CYGWIN__)
 	DWORD oldp;
@@ -207,14 +263,19 @@ void* allocLargePagesMemory(size_t bytes) {
 	void* mem;
 	char *errfunc;
 #if defined(_WIN32) || defined(__CYGWIN__)
-	if (setPrivilege("SeLockMemoryPrivilege", 1, &errfunc))
+	/* The privilege stays enabled in the token: adjust it once, not for
+	 * every scratchpad */
+	static volatile LONG privilegeState = 0; /* 0 unknown, 1 enabled, -1 refused */
+	if (privilegeState == 0)
+		InterlockedExchange(&privilegeState, setPrivilege("SeLockMemoryPrivilege", 1, &errfunc) ? -1 : 1);
+	if (privilegeState < 0)
 		return NULL;
 	size_t pageMinimum = GetLargePageMinimum();
 	if (!pageMinimum) {
 		errfunc = "No large pages";
 		return NULL;
 	}
-	mem = VirtualAlloc(NULL, alignSize(bytes, pageMinimum), MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+	mem = allocNodeMemory(alignSize(bytes, pageMinimum), MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
 #else
 #ifdef __APPLE__
 	mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, VM_FLAGS_SUPERPAGE_SIZE_2MB, 0);
@@ -231,6 +292,243 @@ void* allocLargePagesMemory(size_t bytes) {
 	return mem;
 }
 
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+void* allocTransparentHugePagesMemory(size_t bytes) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	/* Over-map by one huge page, trim to a 2 MB aligned region so the kernel
+	 * can back all of it with transparent huge pages, then ask it to. The
+	 * result can be released with freePagedMemory(ptr, bytes). */
+	size_t mapped = bytes + HUGE_PAGE_SIZE;
+	uint8_t* raw = (uint8_t*)mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED)
+		return NULL;
+	uint8_t* mem = (uint8_t*)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+	size_t head = mem - raw;
+	size_t tail = mapped - head - bytes;
+	size_t pageSize = 4096;
+	tail = tail / pageSize * pageSize;
+	if (head)
+		munmap(raw, head);
+	if (tail)
+		munmap(raw + mapped - tail, tail);
+	if (madvise(mem, bytes, MADV_HUGEPAGE) != 0) {
+		munmap(mem, bytes);
+		return NULL;
+	}
+	return mem;
+#else
+	(void)bytes;
+	return NULL;
+#endif
+}
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+void* reserveLargePagesMemory(size_t bytes) {
+#if defined(__linux__) && defined(MAP_HUGETLB) && defined(MAP_NORESERVE)
+	/* 2 MB hugetlb pages, neither reserved nor populated: the caller faults
+	 * in only what it uses with populatePages, which fails with ENOMEM where
+	 * a plain write past the pool would be a SIGBUS. */
+	void* mem = mmap(NULL, alignSize(bytes, HUGE_PAGE_SIZE), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_NORESERVE, -1, 0);
+	if (mem == MAP_FAILED)
+		mem = NULL;
+	return mem;
+#else
+	(void)bytes;
+	return NULL;
+#endif
+}
+
+int populatePages(void* ptr, size_t bytes) {
+#if defined(__linux__)
+	/* Write-fault the pages in (Linux 5.14+); 0 on success, else errno */
+	uintptr_t start = (uintptr_t)ptr & ~(uintptr_t)4095;
+	size_t len = bytes + ((uintptr_t)ptr - start);
+	if (madvise((void*)start, len, MADV_POPULATE_WRITE) != 0)
+		return errno;
+	return 0;
+#else
+	(void)ptr;
+	(void)bytes;
+	return -1;
+#endif
+}
+
+#define HUGE_PAGE_1G_SIZE ((size_t)1024 * 1024 * 1024)
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+void* allocHugePages1GMemory(size_t bytes) {
+#if defined(__linux__) && defined(MAP_HUGETLB)
+	/* The mapping is not populated here: hugetlb pages are reserved at mmap
+	 * time, so faults cannot fail, and the caller gets a chance to set the
+	 * NUMA placement (bindPagesToNode) before the pages are faulted in. */
+	void* mem = mmap(NULL, alignSize(bytes, HUGE_PAGE_1G_SIZE), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_1GB, -1, 0);
+	if (mem == MAP_FAILED)
+		mem = NULL;
+	return mem;
+#else
+	(void)bytes;
+	return NULL;
+#endif
+}
+
+void freeHugePages1GMemory(void* ptr, size_t bytes) {
+#if defined(_WIN32) || defined(__CYGWIN__)
+	(void)ptr;
+	(void)bytes;
+#else
+	munmap(ptr, alignSize(bytes, HUGE_PAGE_1G_SIZE));
+#endif
+}
+
+int bindPagesToNode(void* ptr, size_t bytes, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+	/* MPOL_PREFERRED rather than MPOL_BIND, so a node that runs out of
+	 * (huge) pages spills over to another node instead of faulting.
+	 * MPOL_MF_MOVE migrates pages that are already populated. */
+	const int mpolPreferred = 1;
+	const unsigned mpolMfMove = 1 << 1;
+	unsigned long nodemask[16] = { 0 };
+	const int bitsPerLong = 8 * sizeof(unsigned long);
+	if (node < 0 || node >= 16 * bitsPerLong)
+		return -1;
+	nodemask[node / bitsPerLong] = 1UL << (node % bitsPerLong);
+	/* mbind needs a page-aligned start */
+	uintptr_t start = (uintptr_t)ptr & ~(uintptr_t)4095;
+	size_t len = bytes + ((uintptr_t)ptr - start);
+	if (syscall(SYS_mbind, (void*)start, len, mpolPreferred, nodemask, (unsigned long)(16 * bitsPerLong), mpolMfMove) != 0)
+		return errno;
+	return 0;
+#else
+	(void)ptr;
+	(void)bytes;
+	(void)node;
+	return -1;
+#endif
+}
+
+#if defined(__linux__) && defined(SYS_memfd_create)
+/* Maps fd at a 2 MB aligned address, so the kernel can back the view with
+ * huge pages */
+static void* mapHugeAligned(int fd, size_t bytes, int prot) {
+	size_t mapped = bytes + HUGE_PAGE_SIZE;
+	uint8_t* raw = (uint8_t*)mmap(NULL, mapped, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (raw == MAP_FAILED)
+		return NULL;
+	uint8_t* mem = (uint8_t*)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+	if (mmap(mem, bytes, prot, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(raw, mapped);
+		return NULL;
+	}
+	if (mem != raw)
+		munmap(raw, mem - raw);
+	if (raw + mapped != mem + bytes)
+		munmap(mem + bytes, raw + mapped - (mem + bytes));
+	return mem;
+}
+#endif
+
+void* allocDualMappedHugePages(size_t bytes, void** execView) {
+#if defined(__linux__) && defined(SYS_memfd_create)
+	/* As allocDualMappedMemory, in whole huge pages: hugetlbfs pages if any
+	 * are reserved, else shared memory with transparent huge pages asked for
+	 * (granted when /sys/kernel/mm/transparent_hugepage/shmem_enabled allows) */
+	const unsigned mfdHugetlb = 0x0004U;
+	void *rw, *rx;
+	int fd = (int)syscall(SYS_memfd_create, "randomx-jit", MFD_CLOEXEC | mfdHugetlb);
+	bytes = alignSize(bytes, HUGE_PAGE_SIZE);
+	if (fd >= 0 && ftruncate(fd, (off_t)bytes) != 0) {
+		close(fd);
+		fd = -1;
+	}
+	if (fd >= 0) {
+		/* hugetlb pages are reserved at mmap time, so faults cannot fail */
+		rw = mmap(NULL, bytes, PAGE_READWRITE, MAP_SHARED, fd, 0);
+		rx = rw == MAP_FAILED ? MAP_FAILED : mmap(NULL, bytes, PAGE_EXECUTE_READ, MAP_SHARED, fd, 0);
+		if (rw != MAP_FAILED && rx != MAP_FAILED) {
+			close(fd);
+			*execView = rx;
+			return rw;
+		}
+		if (rw != MAP_FAILED)
+			munmap(rw, bytes);
+		close(fd);
+	}
+	fd = (int)syscall(SYS_memfd_create, "randomx-jit", MFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, (off_t)bytes) != 0) {
+		close(fd);
+		return NULL;
+	}
+	rw = mapHugeAligned(fd, bytes, PAGE_READWRITE);
+	rx = rw ? mapHugeAligned(fd, bytes, PAGE_EXECUTE_READ) : NULL;
+	close(fd);
+	if (rx == NULL) {
+		if (rw != NULL)
+			munmap(rw, bytes);
+		return NULL;
+	}
+#ifdef MADV_HUGEPAGE
+	madvise(rw, bytes, MADV_HUGEPAGE);
+	madvise(rx, bytes, MADV_HUGEPAGE);
+#endif
+	*execView = rx;
+	return rw;
+#else
+	(void)bytes;
+	(void)execView;
+	return NULL;
+#endif
+}
+
+void setPreferredMemoryNode(int node) {
+#if defined(_WIN32) || defined(__CYGWIN__)
+	preferredNode = node;
+#else
+	/* Linux sets the thread's memory policy instead (numa_set_preferred) */
+	(void)node;
+#endif
+}
+
+int currentMemoryNode(void) {
+#if defined(_WIN32) || defined(__CYGWIN__)
+	/* The preferred node, else the node of the processor it runs on */
+	PROCESSOR_NUMBER number;
+	USHORT node;
+	if (preferredNode >= 0)
+		return preferredNode;
+	GetCurrentProcessorNumberEx(&number);
+	if (GetNumaProcessorNodeEx(&number, &node) && node != 0xffff)
+		return (int)node;
+#elif defined(__linux__) && defined(SYS_get_mempolicy) && defined(SYS_getcpu)
+	/* The preferred node of this thread's memory policy (numa_set_preferred),
+	 * else the node it runs on */
+	const int mpolPreferred = 1;
+	unsigned long nodemask[16] = { 0 };
+	const int bitsPerLong = 8 * sizeof(unsigned long);
+	int mode = 0;
+	unsigned cpu, node;
+	if (syscall(SYS_get_mempolicy, &mode, nodemask, (unsigned long)(16 * bitsPerLong), NULL, 0UL) == 0 && mode == mpolPreferred) {
+		for (int i = 0; i < 16 * bitsPerLong; ++i) {
+			if (nodemask[i / bitsPerLong] & (1UL << (i % bitsPerLong)))
+				return i;
+		}
+	}
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+		return (int)node;
+#endif
+	return 0;
+}
+
 void freePagedMemory(void* ptr, size_t bytes) {
 #if defined(_WIN32) || defined(__CYGWIN__)
 	VirtualFree(ptr, 0, MEM_RELEASE);
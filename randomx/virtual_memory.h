@@ -37,10 +37,20 @@ extern "C" {
 #define alignSize(pos, align) (((pos - 1) / align + 1) * align)
 
 void* allocMemoryPages(size_t);
+void* allocDualMappedMemory(size_t, void**);
+void* allocDualMappedHugePages(size_t, void**);
 void setPagesRW(void*, size_t);
 void setPagesRX(void*, size_t);
 void setPagesRWX(void*, size_t);
 void* allocLargePagesMemory(size_t);
+void* allocTransparentHugePagesMemory(size_t);
+void* reserveLargePagesMemory(size_t);
+int populatePages(void*, size_t);
+void* allocHugePages1GMemory(size_t);
+void freeHugePages1GMemory(void*, size_t);
+int bindPagesToNode(void*, size_t, int);
+int currentMemoryNode(void);
+void setPreferredMemoryNode(int);
 void freePagedMemory(void*, size_t);
 
 #ifdef __cplusplus
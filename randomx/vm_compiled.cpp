@@ -28,6 +28,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "vm_compiled.hpp"
 #include "common.hpp"
+#include "phase_profile.hpp"
 
 namespace randomx {
 
@@ -35,7 +36,16 @@ namespace randomx {
 	static_assert(sizeof(RegisterFile) == 256, "Invalid alignment of struct randomx::RegisterFile");
 
 	template<class Allocator, bool softAes, bool secureJit>
-	CompiledVm<Allocator, softAes, secureJit>::CompiledVm() {
+	CompiledVm<Allocator, softAes, secureJit>::CompiledVm() : CompiledVm(false) {
+	}
+
+	template<class Allocator, bool softAes, bool secureJit>
+	CompiledVm<Allocator, softAes, secureJit>::CompiledVm(bool superscalar)
+#ifdef RANDOMX_COMPILER_X86
+		: compiler(superscalar ? JitLayoutFull : JitLayoutProgram)
+#endif
+	{
+		(void)superscalar;
 		if (!secureJit) {
 			compiler.enableAll(); //make JIT buffer both writable and executable
 		}
@@ -48,8 +58,10 @@ namespace randomx {
 
 	template<class Allocator, bool softAes, bool secureJit>
 	void CompiledVm<Allocator, softAes, secureJit>::run(void* seed) {
+		PhaseClock clock(phaseProfile);
 		VmBase<Allocator, softAes>::generateProgram(seed);
 		randomx_vm::initialize();
+		clock.lap(RANDOMX_PHASE_GENERATE_PROGRAM);
 		if (secureJit) {
 			compiler.enableWriting();
 		}
@@ -57,8 +69,10 @@ namespace randomx {
 		if (secureJit) {
 			compiler.enableExecution();
 		}
+		clock.lap(RANDOMX_PHASE_COMPILE);
 		mem.memory = datasetPtr->memory + datasetOffset;
 		execute();
+		clock.lap(RANDOMX_PHASE_EXECUTE);
 	}
 
 	template<class Allocator, bool softAes, bool secureJit>
@@ -71,10 +85,10 @@ namespace randomx {
 
 	template class CompiledVm<AlignedAllocator<CacheLineSize>, false, false>;
 	template class CompiledVm<AlignedAllocator<CacheLineSize>, true, false>;
-	template class CompiledVm<LargePageAllocator, false, false>;
-	template class CompiledVm<LargePageAllocator, true, false>;
+	template class CompiledVm<ScratchpadAllocator, false, false>;
+	template class CompiledVm<ScratchpadAllocator, true, false>;
 	template class CompiledVm<AlignedAllocator<CacheLineSize>, false, true>;
 	template class CompiledVm<AlignedAllocator<CacheLineSize>, true, true>;
-	template class CompiledVm<LargePageAllocator, false, true>;
-	template class CompiledVm<LargePageAllocator, true, true>;
+	template class CompiledVm<ScratchpadAllocator, false, true>;
+	template class CompiledVm<ScratchpadAllocator, true, true>;
 }
\ No newline at end of file
@@ -52,6 +52,10 @@ namespace randomx {
 		CompiledVm();
 		void setDataset(randomx_dataset* dataset) override;
 		void run(void* seed) override;
+		const void* getCode(size_t& size) override {
+			size = compiler.getCodeSize();
+			return compiler.getCode();
+		}
 
 		using VmBase<Allocator, softAes>::mem;
 		using VmBase<Allocator, softAes>::program;
@@ -60,7 +64,11 @@ namespace randomx {
 		using VmBase<Allocator, softAes>::scratchpad;
 		using VmBase<Allocator, softAes>::datasetPtr;
 		using VmBase<Allocator, softAes>::datasetOffset;
+		using VmBase<Allocator, softAes>::phaseProfile;
 	protected:
+		//superscalar: keep room for the superscalar hash in the code buffer
+		//(light VMs); a fast-mode VM reads the dataset instead
+		explicit CompiledVm(bool superscalar);
 		void execute();
 
 		JitCompiler compiler;
@@ -68,10 +76,10 @@ namespace randomx {
 
 	using CompiledVmDefault = CompiledVm<AlignedAllocator<CacheLineSize>, true, false>;
 	using CompiledVmHardAes = CompiledVm<AlignedAllocator<CacheLineSize>, false, false>;
-	using CompiledVmLargePage = CompiledVm<LargePageAllocator, true, false>;
-	using CompiledVmLargePageHardAes = CompiledVm<LargePageAllocator, false, false>;
+	using CompiledVmLargePage = CompiledVm<ScratchpadAllocator, true, false>;
+	using CompiledVmLargePageHardAes = CompiledVm<ScratchpadAllocator, false, false>;
 	using CompiledVmDefaultSecure = CompiledVm<AlignedAllocator<CacheLineSize>, true, true>;
 	using CompiledVmHardAesSecure = CompiledVm<AlignedAllocator<CacheLineSize>, false, true>;
-	using CompiledVmLargePageSecure = CompiledVm<LargePageAllocator, true, true>;
-	using CompiledVmLargePageHardAesSecure = CompiledVm<LargePageAllocator, false, true>;
+	using CompiledVmLargePageSecure = CompiledVm<ScratchpadAllocator, true, true>;
+	using CompiledVmLargePageHardAesSecure = CompiledVm<ScratchpadAllocator, false, true>;
 }
@@ -28,6 +28,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "vm_compiled_light.hpp"
 #include "common.hpp"
+#include "phase_profile.hpp"
 #include <stdexcept>
 
 namespace randomx {
@@ -47,24 +48,33 @@ namespace randomx {
 
 	template<class Allocator, bool softAes, bool secureJit>
 	void CompiledLightVm<Allocator, softAes, secureJit>::run(void* seed) {
+		PhaseClock clock(phaseProfile);
 		VmBase<Allocator, softAes>::generateProgram(seed);
 		randomx_vm::initialize();
+		clock.lap(RANDOMX_PHASE_GENERATE_PROGRAM);
 		if (secureJit) {
 			compiler.enableWriting();
 		}
+#if defined(RANDOMX_COMPILER_X86)
+		if (partialPtr != nullptr)
+			compiler.generateProgramPartial(program, config, datasetOffset, partialPtr->memory, partialPtr->itemCount);
+		else
+#endif
 		compiler.generateProgramLight(program, config, datasetOffset);
 		if (secureJit) {
 			compiler.enableExecution();
 		}
+		clock.lap(RANDOMX_PHASE_COMPILE);
 		CompiledVm<Allocator, softAes, secureJit>::execute();
+		clock.lap(RANDOMX_PHASE_EXECUTE);
 	}
 
 	template class CompiledLightVm<AlignedAllocator<CacheLineSize>, false, false>;
 	template class CompiledLightVm<AlignedAllocator<CacheLineSize>, true, false>;
-	template class CompiledLightVm<LargePageAllocator, false, false>;
-	template class CompiledLightVm<LargePageAllocator, true, false>;
+	template class CompiledLightVm<ScratchpadAllocator, false, false>;
+	template class CompiledLightVm<ScratchpadAllocator, true, false>;
 	template class CompiledLightVm<AlignedAllocator<CacheLineSize>, false, true>;
 	template class CompiledLightVm<AlignedAllocator<CacheLineSize>, true, true>;
-	template class CompiledLightVm<LargePageAllocator, false, true>;
-	template class CompiledLightVm<LargePageAllocator, true, true>;
+	template class CompiledLightVm<ScratchpadAllocator, false, true>;
+	template class CompiledLightVm<ScratchpadAllocator, true, true>;
 }
\ No newline at end of file
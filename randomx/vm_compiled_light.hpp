@@ -45,6 +45,7 @@ namespace randomx {
 		void operator delete(void* ptr) {
 			AlignedAllocator<CacheLineSize>::freeMemory(ptr, sizeof(CompiledLightVm));
 		}
+		CompiledLightVm() : CompiledVm<Allocator, softAes, secureJit>(true) { }
 		void setCache(randomx_cache* cache) override;
 		void setDataset(randomx_dataset* dataset) override { }
 		void run(void* seed) override;
@@ -55,14 +56,16 @@ namespace randomx {
 		using CompiledVm<Allocator, softAes, secureJit>::config;
 		using CompiledVm<Allocator, softAes, secureJit>::cachePtr;
 		using CompiledVm<Allocator, softAes, secureJit>::datasetOffset;
+		using CompiledVm<Allocator, softAes, secureJit>::partialPtr;
+		using CompiledVm<Allocator, softAes, secureJit>::phaseProfile;
 	};
 
 	using CompiledLightVmDefault = CompiledLightVm<AlignedAllocator<CacheLineSize>, true, false>;
 	using CompiledLightVmHardAes = CompiledLightVm<AlignedAllocator<CacheLineSize>, false, false>;
-	using CompiledLightVmLargePage = CompiledLightVm<LargePageAllocator, true, false>;
-	using CompiledLightVmLargePageHardAes = CompiledLightVm<LargePageAllocator, false, false>;
+	using CompiledLightVmLargePage = CompiledLightVm<ScratchpadAllocator, true, false>;
+	using CompiledLightVmLargePageHardAes = CompiledLightVm<ScratchpadAllocator, false, false>;
 	using CompiledLightVmDefaultSecure = CompiledLightVm<AlignedAllocator<CacheLineSize>, true, true>;
 	using CompiledLightVmHardAesSecure = CompiledLightVm<AlignedAllocator<CacheLineSize>, false, true>;
-	using CompiledLightVmLargePageSecure = CompiledLightVm<LargePageAllocator, true, true>;
-	using CompiledLightVmLargePageHardAesSecure = CompiledLightVm<LargePageAllocator, false, true>;
+	using CompiledLightVmLargePageSecure = CompiledLightVm<ScratchpadAllocator, true, true>;
+	using CompiledLightVmLargePageHardAesSecure = CompiledLightVm<ScratchpadAllocator, false, true>;
 }
\ No newline at end of file
@@ -36,6 +36,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "dataset.hpp"
 #include "intrin_portable.h"
 #include "reciprocal.h"
+#include "phase_profile.hpp"
 
 namespace randomx {
 
@@ -47,8 +48,10 @@ namespace randomx {
 
 	template<class Allocator, bool softAes>
 	void InterpretedVm<Allocator, softAes>::run(void* seed) {
+		PhaseClock clock(phaseProfile);
 		VmBase<Allocator, softAes>::generateProgram(seed);
 		randomx_vm::initialize();
+		clock.lap(RANDOMX_PHASE_GENERATE_PROGRAM);
 		execute();
 	}
 
@@ -60,7 +63,10 @@ namespace randomx {
 		for(unsigned i = 0; i < RegisterCountFlt; ++i)
 			nreg.a[i] = rx_load_vec_f128(&reg.a[i].lo);
 
+		PhaseClock clock(phaseProfile);
 		compileProgram(program, bytecode, nreg);
+		clock.lap(RANDOMX_PHASE_COMPILE);
+		uint64_t readTicks = 0;
 
 		uint32_t spAddr0 = mem.mx;
 		uint32_t spAddr1 = mem.ma;
@@ -86,7 +92,13 @@ namespace randomx {
 			mem.mx ^= nreg.r[config.readReg2] ^ nreg.r[config.readReg3];
 			mem.mx &= CacheLineAlignMask;
 			datasetPrefetch(datasetOffset + mem.mx);
+#if defined(RANDOMX_PHASE_PROFILE)
+			uint64_t readStart = phaseTimer();
 			datasetRead(datasetOffset + mem.ma, nreg.r);
+			readTicks += phaseTimer() - readStart;
+#else
+			datasetRead(datasetOffset + mem.ma, nreg.r);
+#endif
 			std::swap(mem.mx, mem.ma);
 
 			for (unsigned i = 0; i < RegistersCount; ++i)
@@ -110,6 +122,11 @@ namespace randomx {
 
 		for (unsigned i = 0; i < RegisterCountFlt; ++i)
 			rx_store_vec_f128(&reg.e[i].lo, nreg.e[i]);
+
+		clock.lap(RANDOMX_PHASE_EXECUTE, readTicks);
+#if defined(RANDOMX_PHASE_PROFILE)
+		phaseAdd(phaseProfile, RANDOMX_PHASE_DATASET_READ, readTicks);
+#endif
 	}
 
 	template<class Allocator, bool softAes>
@@ -126,6 +143,6 @@ namespace randomx {
 
 	template class InterpretedVm<AlignedAllocator<CacheLineSize>, false>;
 	template class InterpretedVm<AlignedAllocator<CacheLineSize>, true>;
-	template class InterpretedVm<LargePageAllocator, false>;
-	template class InterpretedVm<LargePageAllocator, true>;
+	template class InterpretedVm<ScratchpadAllocator, false>;
+	template class InterpretedVm<ScratchpadAllocator, true>;
 }
\ No newline at end of file
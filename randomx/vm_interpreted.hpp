@@ -48,6 +48,7 @@ namespace randomx {
 		using VmBase<Allocator, softAes>::reg;
 		using VmBase<Allocator, softAes>::datasetPtr;
 		using VmBase<Allocator, softAes>::datasetOffset;
+		using VmBase<Allocator, softAes>::phaseProfile;
 		void* operator new(size_t size) {
 			void* ptr = AlignedAllocator<CacheLineSize>::allocMemory(size);
 			if (ptr == nullptr)
@@ -70,6 +71,6 @@ namespace randomx {
 
 	using InterpretedVmDefault = InterpretedVm<AlignedAllocator<CacheLineSize>, true>;
 	using InterpretedVmHardAes = InterpretedVm<AlignedAllocator<CacheLineSize>, false>;
-	using InterpretedVmLargePage = InterpretedVm<LargePageAllocator, true>;
-	using InterpretedVmLargePageHardAes = InterpretedVm<LargePageAllocator, false>;
+	using InterpretedVmLargePage = InterpretedVm<ScratchpadAllocator, true>;
+	using InterpretedVmLargePageHardAes = InterpretedVm<ScratchpadAllocator, false>;
 }
\ No newline at end of file
@@ -28,6 +28,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "vm_interpreted_light.hpp"
 #include "dataset.hpp"
+#include <cstring>
 
 namespace randomx {
 
@@ -42,14 +43,29 @@ namespace randomx {
 		uint32_t itemNumber = address / CacheLineSize;
 		int_reg_t rl[8];
 		
-		initDatasetItem(cachePtr, (uint8_t*)rl, itemNumber);
+		if (partialPtr != nullptr && itemNumber < partialPtr->itemCount)
+			memcpy(rl, partialPtr->memory + (uint64_t)itemNumber * CacheLineSize, sizeof(rl));
+		else
+			initDatasetItem(cachePtr, (uint8_t*)rl, itemNumber);
 
 		for (unsigned q = 0; q < 8; ++q)
 			r[q] ^= rl[q];
 	}
 
+	template<class Allocator, bool softAes>
+	void InterpretedLightVm<Allocator, softAes>::datasetPrefetch(uint64_t address) {
+		//the item is read in the next iteration; its first superscalar step mixes
+		//the cache line selected by the item number, so that line can be fetched now
+		uint32_t itemNumber = address / CacheLineSize;
+
+		if (partialPtr != nullptr && itemNumber < partialPtr->itemCount)
+			rx_prefetch_t0(partialPtr->memory + (uint64_t)itemNumber * CacheLineSize);
+		else
+			rx_prefetch_t0(cachePtr->memory + (itemNumber & (CacheSize / CacheLineSize - 1)) * CacheLineSize);
+	}
+
 	template class InterpretedLightVm<AlignedAllocator<CacheLineSize>, false>;
 	template class InterpretedLightVm<AlignedAllocator<CacheLineSize>, true>;
-	template class InterpretedLightVm<LargePageAllocator, false>;
-	template class InterpretedLightVm<LargePageAllocator, true>;
+	template class InterpretedLightVm<ScratchpadAllocator, false>;
+	template class InterpretedLightVm<ScratchpadAllocator, true>;
 }
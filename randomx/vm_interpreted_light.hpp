@@ -38,6 +38,7 @@ namespace randomx {
 	public:
 		using VmBase<Allocator, softAes>::mem;
 		using VmBase<Allocator, softAes>::cachePtr;
+		using VmBase<Allocator, softAes>::partialPtr;
 		void* operator new(size_t size) {
 			void* ptr = AlignedAllocator<CacheLineSize>::allocMemory(size);
 			if (ptr == nullptr)
@@ -51,11 +52,11 @@ namespace randomx {
 		void setCache(randomx_cache* cache) override;
 	protected:
 		void datasetRead(uint64_t address, int_reg_t(&r)[8]) override;
-		void datasetPrefetch(uint64_t address) override { }
+		void datasetPrefetch(uint64_t address) override;
 	};
 
 	using InterpretedLightVmDefault = InterpretedLightVm<AlignedAllocator<CacheLineSize>, true>;
 	using InterpretedLightVmHardAes = InterpretedLightVm<AlignedAllocator<CacheLineSize>, false>;
-	using InterpretedLightVmLargePage = InterpretedLightVm<LargePageAllocator, true>;
-	using InterpretedLightVmLargePageHardAes = InterpretedLightVm<LargePageAllocator, false>;
+	using InterpretedLightVmLargePage = InterpretedLightVm<ScratchpadAllocator, true>;
+	using InterpretedLightVmLargePageHardAes = InterpretedLightVm<ScratchpadAllocator, false>;
 }
@@ -0,0 +1,386 @@
+#include "autotune.h"
+#include "benchmark.h"
+#include "cpu_topology.h"
+#include "logger.h"
+#include "msr_profile.h"
+#include "power_governor.h"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <json/json.h>
+
+namespace fs = std::filesystem;
+
+// RAM left free beside a medium-mode dataset the tuner sizes itself, and
+// the smallest such dataset worth trying over light mode
+static const size_t AUTOTUNE_MEDIUM_HEADROOM_MB = 1024;
+static const size_t AUTOTUNE_MEDIUM_MIN_MB = 256;
+
+namespace {
+
+struct Candidate {
+    std::string mode;
+    bool fast;
+    unsigned int medium_mb;
+    bool huge_pages;
+    std::string msr;    // MSR profile applied while measuring
+};
+
+MinerConfig candidate_config(const MinerConfig& base, const Candidate& candidate) {
+    MinerConfig config = base;
+    config.fast_mode = candidate.fast;
+    config.medium_mode_mb = candidate.fast ? 0 : candidate.medium_mb;
+    config.huge_pages = candidate.huge_pages;
+    config.huge_pages_1gb = candidate.huge_pages && base.huge_pages_1gb;
+    return config;
+}
+
+std::string cpu_model() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        // x86 names the model; many ARM kernels only name the board
+        if (line.compare(0, 10, "model name") == 0 || line.compare(0, 8, "Hardware") == 0) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos && colon + 2 <= line.size()) {
+                return line.substr(colon + 2);
+            }
+        }
+    }
+    return "unknown CPU";
+}
+
+}  // namespace
+
+std::string autotune_host_key() {
+    CpuTopology topology = CpuTopology::detect();
+    size_t cores = 0;
+    for (const CpuInfo& cpu : topology.cpus()) {
+        if (cpu.smt_index == 0) cores++;
+    }
+    size_t l3_mb = topology.l3_domains().empty() ? 0 : topology.l3_domains()[0].l3_bytes / (1024 * 1024);
+    std::ostringstream key;
+    key << cpu_model() << " / " << topology.cpus().size() << " CPUs, " << cores << " cores, "
+        << topology.l3_domains().size() << " x " << l3_mb << " MB L3";
+    return key.str();
+}
+
+std::string default_profile_path() {
+#ifdef _WIN32
+    const char* appdata = std::getenv("APPDATA");
+    if (appdata && *appdata) return (fs::path(appdata) / "juno-miner" / "profiles.json").string();
+    return std::string();
+#else
+    const char* xdg = std::getenv("XDG_CONFIG_HOME");
+    if (xdg && *xdg) return (fs::path(xdg) / "juno-miner" / "profiles.json").string();
+    const char* home = std::getenv("HOME");
+    if (home && *home) return (fs::path(home) / ".config" / "juno-miner" / "profiles.json").string();
+    return std::string();
+#endif
+}
+
+static bool read_profiles(const std::string& path, Json::Value& profiles) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    Json::CharReaderBuilder builder;
+    std::string errors;
+    if (!Json::parseFromStream(builder, in, &profiles, &errors) || !profiles.isObject()) {
+        LOG_WARNING_STREAM("Ignoring unreadable tuning profiles in " << path << ": " << errors);
+        return false;
+    }
+    return true;
+}
+
+bool load_tune_profile(const std::string& path, const std::string& host_key, TuneProfile& profile) {
+    Json::Value profiles;
+    if (path.empty() || !read_profiles(path, profiles)) {
+        return false;
+    }
+    const Json::Value& entry = profiles[host_key];
+    if (!entry.isObject() || !entry["threads"].isUInt() || entry["threads"].asUInt() == 0) {
+        return false;
+    }
+    std::string mode = entry["mode"].asString();
+    if (mode != "fast" && mode != "medium" && mode != "light") {
+        return false;
+    }
+    profile.mode = mode;
+    profile.medium_mb = entry["medium_mb"].asUInt();
+    profile.threads = entry["threads"].asUInt();
+    profile.huge_pages = entry["huge_pages"].asBool();
+    profile.msr_profile = entry["msr_profile"].asString();
+    profile.hashrate = entry["hashrate"].asDouble();
+    profile.watts = entry["watts"].asDouble();
+    profile.efficiency = entry["target"].asString() == "efficiency";
+    return mode != "medium" || profile.medium_mb;
+}
+
+bool save_tune_profile(const std::string& path, const std::string& host_key, const TuneProfile& profile,
+                       std::string& error) {
+    if (path.empty()) {
+        error = "no place for tuning profiles (HOME is not set)";
+        return false;
+    }
+    Json::Value profiles(Json::objectValue);
+    read_profiles(path, profiles);  // Other hosts' profiles are kept
+
+    Json::Value entry(Json::objectValue);
+    entry["mode"] = profile.mode;
+    entry["medium_mb"] = profile.medium_mb;
+    entry["threads"] = profile.threads;
+    entry["huge_pages"] = profile.huge_pages;
+    if (!profile.msr_profile.empty()) {
+        entry["msr_profile"] = profile.msr_profile;
+    }
+    entry["hashrate"] = profile.hashrate;
+    entry["target"] = profile.efficiency ? "efficiency" : "hashrate";
+    if (profile.watts > 0) {
+        entry["watts"] = profile.watts;
+    }
+    entry["tuned_at"] = (Json::UInt64)utils::get_current_timestamp();
+    profiles[host_key] = entry;
+
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    // Written aside and renamed, so a rig reading it at startup never sees half
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp);
+        Json::StreamWriterBuilder writer;
+        writer["indentation"] = "  ";
+        out << Json::writeString(writer, profiles) << std::endl;
+        if (!out) {
+            error = "can't write " + temp;
+            return false;
+        }
+    }
+    fs::rename(temp, path, ec);
+    if (ec) {
+        error = "can't replace " + path + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+std::string apply_tune_profile(const TuneProfile& profile, MinerConfig& config) {
+    std::vector<std::string> applied;
+    if (config.auto_threads && config.cpu_list.empty()) {
+        config.num_threads = profile.threads;
+        config.auto_threads = false;
+        applied.push_back(std::to_string(profile.threads) + " threads");
+    }
+    if (!config.fast_mode && !config.medium_mode_mb) {
+        if (profile.mode == "fast") {
+            config.fast_mode = true;
+        } else if (profile.mode == "medium") {
+            config.medium_mode_mb = profile.medium_mb;
+        }
+        applied.push_back(profile.mode + " mode");
+    }
+    if (profile.huge_pages && !config.huge_pages) {
+        config.huge_pages = true;
+        applied.push_back("huge pages");
+    }
+    if (!profile.msr_profile.empty() && config.msr_profile.empty()) {
+        config.msr_profile = profile.msr_profile;
+        applied.push_back("MSR profile " + profile.msr_profile);
+    }
+
+    std::string description;
+    for (const std::string& part : applied) {
+        description += (description.empty() ? "" : ", ") + part;
+    }
+    return description;
+}
+
+bool autotune(const MinerConfig& config, const utils::SystemResources& resources, unsigned int seconds,
+              const std::atomic<bool>& running, TuneProfile& best, std::string& error) {
+    CpuTopology topology = CpuTopology::detect();
+    unsigned int logical = (unsigned int)topology.cpus().size();
+    unsigned int cores = 0;
+    for (const CpuInfo& cpu : topology.cpus()) {
+        if (cpu.smt_index == 0) cores++;
+    }
+    cores = std::max(1u, cores);
+    unsigned int l3_cap = std::max(1u, topology.max_mining_threads());
+    unsigned int reference = std::min(cores, l3_cap);
+
+    if (config.autotune_efficiency) {
+        PowerMeter meter;
+        if (!meter.open()) {
+            error = "package power can't be read (RAPL or amd_energy, as root) to tune for efficiency";
+            return false;
+        }
+    }
+    // What the tuner maximizes: hashrate, or hashes per joule
+    struct Measurement {
+        double hashrate;
+        double watts;
+        double score;
+    };
+    auto measure = [&](MiningBackend& miner, const Candidate& candidate, unsigned int threads) -> Measurement {
+        if (!miner.set_thread_count(threads)) {
+            return Measurement{0.0, 0.0, 0.0};
+        }
+        BenchmarkResult result;
+        measure_hashrate(miner, seconds, 0, running, result);
+        std::ostringstream point;
+        point << std::left << std::setw(6) << candidate.mode << std::right << std::setw(4) << threads << " threads"
+              << (candidate.huge_pages ? ", huge pages" : "")
+              << (candidate.msr.empty() ? "" : ", MSR " + candidate.msr) << ": " << std::fixed << std::setprecision(1)
+              << result.hashrate << " H/s";
+        if (result.watts > 0) {
+            point << ", " << result.watts << " W, " << std::setprecision(3) << result.hashes_per_joule() << " H/J"
+                  << std::setprecision(1);
+        }
+        for (const CoreTypeHashrate& type : hashrate_by_core_type(result)) {
+            point << ", " << core_type_name(type.type) << "s " << type.hashrate;
+        }
+        std::cout << "  " << point.str() << std::endl;
+        LOG_INFO_STREAM("Autotune: " << point.str());
+        return Measurement{result.hashrate, result.watts,
+                           config.autotune_efficiency ? result.hashes_per_joule() : result.hashrate};
+    };
+
+    // 1. The mode, at one thread per physical core (within the L3 caps)
+    std::vector<Candidate> modes;
+    modes.push_back({"light", false, 0, config.huge_pages, ""});
+    if (utils::calculate_optimal_threads(resources, true) > 0) {
+        modes.push_back({"fast", true, 0, config.huge_pages, ""});
+    } else if (resources.available_ram_mb >= AUTOTUNE_MEDIUM_HEADROOM_MB + AUTOTUNE_MEDIUM_MIN_MB) {
+        modes.push_back({"medium", false, (unsigned int)(resources.available_ram_mb - AUTOTUNE_MEDIUM_HEADROOM_MB),
+                         config.huge_pages, ""});
+    }
+    std::cout << "Modes at " << reference << " threads:" << std::endl;
+    std::unique_ptr<MiningBackend> best_miner;
+    Candidate best_mode = modes[0];
+    Measurement best_rate = {0.0, 0.0, -1.0};
+    for (const Candidate& mode : modes) {
+        if (!running.load()) break;
+        BenchmarkResult init;
+        std::string build_error;
+        std::unique_ptr<MiningBackend> miner = create_benchmark_backend(candidate_config(config, mode), reference,
+                                                                        mode.fast, init, build_error);
+        if (!miner) {
+            std::cout << "  " << mode.mode << ": " << build_error << std::endl;
+            continue;
+        }
+        Measurement rate = measure(*miner, mode, reference);
+        if (rate.score > best_rate.score) {
+            best_rate = rate;
+            best_mode = mode;
+            best_miner = std::move(miner);  // The previous best is freed
+        }
+    }
+    if (!best_miner) {
+        error = running.load() ? "no mode could be benchmarked" : "interrupted";
+        return false;
+    }
+
+    // 2. The thread count in that mode: a spread up to every logical CPU,
+    // through the physical core count and the L3 cap
+    std::set<unsigned int> counts = {1, cores / 4, cores / 2, cores * 3 / 4, cores, l3_cap,
+                                     (cores + logical) / 2, logical};
+    // On a hybrid CPU threads go to P-cores first, then E-cores: the P-cores
+    // alone against all cores shows whether the E-cores add net hashrate
+    if (topology.hybrid()) {
+        unsigned int p_cores = topology.core_count(CORE_TYPE_PERFORMANCE);
+        counts.insert(p_cores);
+        counts.insert(p_cores + topology.core_count(CORE_TYPE_EFFICIENCY));
+    }
+    std::map<unsigned int, Measurement> rates;
+    rates[reference] = best_rate;
+    std::cout << "Threads in " << best_mode.mode << " mode:" << std::endl;
+    for (unsigned int count : counts) {
+        if (!running.load()) break;
+        if (count >= 1 && count <= logical && !rates.count(count)) {
+            rates[count] = measure(*best_miner, best_mode, count);
+        }
+    }
+    best_miner.reset();
+    double top = 0.0;
+    for (const auto& rate : rates) {
+        top = std::max(top, rate.second.score);
+    }
+    unsigned int knee = reference;
+    for (const auto& rate : rates) {
+        if (rate.second.score >= top * (1.0 - AUTOTUNE_KNEE_TOLERANCE)) {
+            knee = rate.first;  // Counts are in ascending order: the smallest
+            break;
+        }
+    }
+    Measurement knee_rate = rates[knee];
+
+    // 3. Huge pages at that count, if they weren't asked for already and the
+    // hugetlb cgroup has room for them (touching pages past its limit is a SIGBUS)
+    bool huge_pages = config.huge_pages;
+    const size_t dataset_mb = randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE / (1024 * 1024);
+    const size_t huge_need_mb = 256 + (best_mode.fast ? dataset_mb : best_mode.medium_mb);
+    if (!huge_pages && resources.huge_page_budget_mb >= huge_need_mb && running.load()) {
+        Candidate candidate = best_mode;
+        candidate.huge_pages = true;
+        BenchmarkResult init;
+        std::string build_error;
+        std::unique_ptr<MiningBackend> miner = create_benchmark_backend(candidate_config(config, candidate), knee,
+                                                                        candidate.fast, init, build_error);
+        if (miner) {
+            Measurement rate = measure(*miner, candidate, knee);
+            if (rate.score >= knee_rate.score * (1.0 + AUTOTUNE_HUGE_PAGE_GAIN)) {
+                huge_pages = true;
+                knee_rate = rate;
+            }
+        }
+    }
+
+    // 4. The MSR profile, if one was given: the stock prefetchers against
+    // it on one backend, kept only on a gain
+    std::string msr_best;
+    if (!config.msr_profile.empty() && running.load()) {
+        Candidate candidate = best_mode;
+        candidate.huge_pages = huge_pages;
+        BenchmarkResult init;
+        std::string build_error;
+        std::unique_ptr<MiningBackend> miner = create_benchmark_backend(candidate_config(config, candidate), knee,
+                                                                        candidate.fast, init, build_error);
+        MsrProfile msr;
+        std::string msr_error;
+        if (miner && parse_msr_profile(config.msr_profile, msr, msr_error)) {
+            Measurement stock = measure(*miner, candidate, knee);
+            if (!apply_msr_profile(msr, miner->get_thread_cpus(), msr_error)) {
+                std::cout << "  MSR profile " << msr.name << ": " << msr_error << std::endl;
+            }
+            if (!active_msr_profile().empty() && running.load()) {
+                candidate.msr = msr.name;
+                Measurement rate = measure(*miner, candidate, knee);
+                if (rate.score >= stock.score * (1.0 + AUTOTUNE_MSR_GAIN)) {
+                    msr_best = msr.name;
+                    knee_rate = rate;
+                }
+            }
+            restore_msr_profile();
+        }
+    }
+    if (!running.load()) {
+        error = "interrupted";
+        return false;
+    }
+
+    best.mode = best_mode.mode;
+    best.medium_mb = best_mode.fast ? 0 : best_mode.medium_mb;
+    best.threads = knee;
+    best.huge_pages = huge_pages;
+    best.msr_profile = msr_best;
+    best.hashrate = knee_rate.hashrate;
+    best.watts = knee_rate.watts;
+    best.efficiency = config.autotune_efficiency;
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <atomic>
+#include <string>
+#include "config.h"
+#include "utils.h"
+
+// A thread count within this fraction of the best measured is good enough:
+// the tuner keeps the smallest such count (the knee of the curve), since
+// threads past it only add heat and contention for noise-level gains
+static const double AUTOTUNE_KNEE_TOLERANCE = 0.02;
+// Huge pages are kept only if they gain at least this fraction
+static const double AUTOTUNE_HUGE_PAGE_GAIN = 0.01;
+// An MSR profile (--msr-profile) only if it gains this much over the stock prefetchers
+static const double AUTOTUNE_MSR_GAIN = 0.01;
+
+// The winning configuration for one host type
+struct TuneProfile {
+    std::string mode;          // "fast", "medium" or "light"
+    unsigned int medium_mb;    // Medium mode: resident dataset MB
+    unsigned int threads;      // Placed automatically (see CpuTopology::place_threads)
+    bool huge_pages;
+    std::string msr_profile;   // Prefetcher MSR preset (see parse_msr_profile), empty = none
+    double hashrate;           // What the tuner measured with it
+    double watts;              // Package power it measured, 0 if unreadable
+    bool efficiency;           // Chosen for hashes per joule, not hashrate
+
+    TuneProfile() : mode("light"), medium_mb(0), threads(1), huge_pages(false), hashrate(0), watts(0), efficiency(false) {}
+};
+
+// What a profile is keyed by: the CPU model and the topology the miner
+// places threads on (logical CPUs, cores, L3 domains and their size), so
+// every rig of one SKU and layout shares a profile
+std::string autotune_host_key();
+
+// Profiles live in one JSON file, an object keyed by host key
+// (~/.config/juno-miner/profiles.json, or under XDG_CONFIG_HOME / APPDATA)
+std::string default_profile_path();
+bool load_tune_profile(const std::string& path, const std::string& host_key, TuneProfile& profile);
+bool save_tune_profile(const std::string& path, const std::string& host_key, const TuneProfile& profile,
+                       std::string& error);
+
+// Apply a profile to what the command line left at its defaults: the
+// thread count (unless --threads or --cpus was given), the mode (unless
+// --fast-mode or --medium-mode was), huge pages and the MSR profile (unless --msr-profile was given). Returns a description
+// of what was applied, empty if nothing was.
+std::string apply_tune_profile(const TuneProfile& profile, MinerConfig& config);
+
+// Search for the best profile on this host with the benchmark engine,
+// seconds per measurement (see AUTOTUNE_KNEE_TOLERANCE): first the mode at
+// one thread per physical core, then the thread count in the best mode, then
+// huge pages at that count, and last the --msr-profile given against the
+// stock prefetchers. Sweeping the count also sweeps SMT and the
+// per-L3 caps: automatic placement fills physical cores before SMT
+// siblings and each L3 up to its cap first. With config.autotune_efficiency
+// every step maximizes hashes per joule instead, which needs package power
+// (see PowerMeter). Prints each measurement. Stops early once running is
+// cleared.
+bool autotune(const MinerConfig& config, const utils::SystemResources& resources, unsigned int seconds,
+              const std::atomic<bool>& running, TuneProfile& best, std::string& error);
+
+#endif // AUTOTUNE_H
@@ -0,0 +1,143 @@
+#include "benchmark.h"
+#include "config.h"
+#include "power_governor.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+const std::vector<uint8_t>& benchmark_seed() {
+    static const std::vector<uint8_t> seed(32, 0);
+    return seed;
+}
+
+BlockTemplatePtr benchmark_template() {
+    BlockTemplate synthetic;
+    synthetic.version = 4;
+    synthetic.time = BENCHMARK_HEADER_TIME;
+    synthetic.height = 1;
+    synthetic.seed_height = 0;
+    synthetic.seed_hash = benchmark_seed();
+    synthetic.header_base.assign(NONCE_OFFSET, 0);
+    utils::write_le32(synthetic.header_base.data(), synthetic.version);
+    utils::write_le32(synthetic.header_base.data() + TIME_OFFSET, synthetic.time);
+    synthetic.target.assign(32, 0);
+    synthetic.target_limbs = utils::target_to_limbs(synthetic.target);
+    synthetic.target_hex = std::string(64, '0');
+    return std::make_shared<const BlockTemplate>(std::move(synthetic));
+}
+
+std::unique_ptr<MiningBackend> create_benchmark_backend(const MinerConfig& config, unsigned int num_threads,
+                                                        bool fast_mode, BenchmarkResult& result,
+                                                        std::string& error) {
+    MinerConfig engine_config = config;
+    engine_config.dataset_cache = false;
+    std::unique_ptr<MiningBackend> miner = create_mining_backend(engine_config, num_threads, fast_mode, error);
+    if (!miner) {
+        return nullptr;
+    }
+    miner->set_nonce_allocator(NonceAllocator(config.deterministic_nonce, config.auto_instance_id, config.instance_id));
+    miner->set_share_bits(config.share_bits);
+
+    auto start = std::chrono::steady_clock::now();
+    if (!miner->initialize(benchmark_seed())) {
+        error = "failed to initialize the miner";
+        return nullptr;
+    }
+    result.init_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return miner;
+}
+
+void measure_hashrate(MiningBackend& miner, unsigned int seconds, uint64_t hashes, const std::atomic<bool>& running,
+                      BenchmarkResult& result, const std::function<void(double, uint64_t)>& progress,
+                      bool hardware_counters) {
+    auto ready_start = std::chrono::steady_clock::now();
+    miner.start_mining(benchmark_template());
+    while (running.load() && miner.is_warming_up()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    result.ready_seconds = result.init_seconds +
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - ready_start).count();
+
+    PerfCounters perf;
+    bool counting = false;
+    if (hardware_counters) {
+        // Each worker records its thread ID as it comes up
+        std::vector<int> thread_ids = miner.get_thread_os_ids();
+        for (int wait = 0; wait < 100 && std::count(thread_ids.begin(), thread_ids.end(), 0) > 0; wait++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            thread_ids = miner.get_thread_os_ids();
+        }
+        counting = perf.open(thread_ids, result.perf_error);
+    }
+
+    // The counters keep running from start_mining: measure differences
+    if (counting) {
+        perf.start();
+    }
+    PowerMeter power;
+    double start_joules = power.open() ? power.joules() : 0.0;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint64_t> start_counts = miner.get_thread_hash_counts();
+    std::vector<HashPhaseProfile> start_phases = miner.get_thread_phase_profiles();
+    uint64_t start_ticks = randomx_phase_timer();
+    uint64_t start_hashes = miner.get_hash_count();
+    auto deadline = start + std::chrono::seconds(seconds);
+    auto last_progress = start;
+    while (running.load()) {
+        auto now = std::chrono::steady_clock::now();
+        uint64_t done = miner.get_hash_count() - start_hashes;
+        if (hashes ? done >= hashes : now >= deadline) {
+            break;
+        }
+        if (progress && now - last_progress >= std::chrono::seconds(5)) {
+            progress(std::chrono::duration<double>(now - start).count(), done);
+            last_progress = now;
+        }
+        if (power.available()) {
+            power.joules();  // Often enough to see the counters wrap
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(hashes ? 10 : 100));
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::vector<uint64_t> counts = miner.get_thread_hash_counts();
+    std::vector<HashPhaseProfile> phases = miner.get_thread_phase_profiles();
+    uint64_t ticks = randomx_phase_timer() - start_ticks;
+    result.hashes = miner.get_hash_count() - start_hashes;
+    double joules = power.available() ? power.joules() - start_joules : 0.0;
+    if (counting) {
+        perf.stop();
+        result.thread_perf = perf.read();
+    }
+    miner.stop();
+
+    result.hashrate = result.seconds > 0 ? result.hashes / result.seconds : 0.0;
+    result.watts = result.seconds > 0 ? joules / result.seconds : 0.0;
+    result.thread_hashrates.clear();
+    result.thread_hashes.clear();
+    for (size_t i = 0; i < counts.size(); i++) {
+        uint64_t thread_hashes = counts[i] - (i < start_counts.size() ? start_counts[i] : 0);
+        result.thread_hashes.push_back(thread_hashes);
+        result.thread_hashrates.push_back(result.seconds > 0 ? thread_hashes / result.seconds : 0.0);
+    }
+    result.thread_core_types = miner.get_thread_core_types();
+    result.thread_phases.clear();
+    for (size_t i = 0; i < phases.size(); i++) {
+        result.thread_phases.push_back(i < start_phases.size() ? phases[i].since(start_phases[i]) : phases[i]);
+    }
+    result.phase_timer_hz = result.seconds > 0 ? ticks / result.seconds : 0.0;
+}
+
+std::vector<CoreTypeHashrate> hashrate_by_core_type(const BenchmarkResult& result) {
+    std::vector<CoreTypeHashrate> types;
+    for (CoreType type : {CORE_TYPE_PERFORMANCE, CORE_TYPE_EFFICIENCY, CORE_TYPE_UNKNOWN}) {
+        CoreTypeHashrate rate = {type, 0, 0.0};
+        for (size_t i = 0; i < result.thread_core_types.size() && i < result.thread_hashrates.size(); i++) {
+            if (result.thread_core_types[i] == type) {
+                rate.threads++;
+                rate.hashrate += result.thread_hashrates[i];
+            }
+        }
+        if (rate.threads) types.push_back(rate);
+    }
+    return types;
+}
@@ -0,0 +1,80 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mining_backend.h"
+#include "perf_counters.h"
+
+struct MinerConfig;
+
+// Header time of the synthetic benchmark header
+static const uint32_t BENCHMARK_HEADER_TIME = 1700000000;
+
+struct BenchmarkResult {
+    double init_seconds;    // initialize() on the benchmark seed
+    double ready_seconds;   // Until the workers hashed at full speed (after any warm-up)
+    double seconds;         // Measured span
+    uint64_t hashes;
+    double hashrate;
+    std::vector<double> thread_hashrates;
+    std::vector<CoreType> thread_core_types;  // Empty unless the CPU is hybrid
+    // Over the measured span, with a JUNO_PHASE_PROFILE build (else empty)
+    std::vector<HashPhaseProfile> thread_phases;
+    double phase_timer_hz;  // Rate of the ticks they are in
+    std::vector<uint64_t> thread_hashes;
+    // Hardware counters per thread over the measured span, if asked for;
+    // empty with perf_error set if they couldn't be counted
+    std::vector<PerfCounts> thread_perf;
+    std::string perf_error;
+    // CPU package power over the measured span, 0 if it can't be read (see PowerMeter)
+    double watts;
+
+    BenchmarkResult()
+        : init_seconds(0), ready_seconds(0), seconds(0), hashes(0), hashrate(0), phase_timer_hz(0), watts(0) {}
+    double hashes_per_joule() const { return watts > 0 ? hashrate / watts : 0.0; }
+};
+
+// Hashrate of the threads on one core type
+struct CoreTypeHashrate {
+    CoreType type;
+    unsigned int threads;
+    double hashrate;
+
+    double per_thread() const { return threads ? hashrate / threads : 0.0; }
+};
+
+// A result's thread hashrates summed per core type, P-cores first; empty
+// unless it ran on a hybrid CPU
+std::vector<CoreTypeHashrate> hashrate_by_core_type(const BenchmarkResult& result);
+
+// The benchmark's fixed seed (all zeros: any seed costs the same)
+const std::vector<uint8_t>& benchmark_seed();
+// A synthetic job on it with a zero target, so nothing is ever found and
+// every worker hashes until stopped
+BlockTemplatePtr benchmark_template();
+
+// The backend named by config for a benchmark, initialized on the benchmark
+// seed (init_seconds set in result). The dataset cache is bypassed: every
+// run builds its dataset, and none is saved for a seed no chain uses.
+// nullptr with error set on failure.
+std::unique_ptr<MiningBackend> create_benchmark_backend(const MinerConfig& config, unsigned int num_threads,
+                                                        bool fast_mode, BenchmarkResult& result,
+                                                        std::string& error);
+
+// Mine the benchmark job on an initialized backend and measure it, from
+// once it hashes at full speed, for seconds or (if non-zero) until hashes.
+// progress, if set, is called every few seconds with the elapsed time and
+// hashes so far. Stops early once running is cleared; the workers are
+// stopped on return. hardware_counters also counts the workers' hardware
+// events over the same span (see PerfCounters). Package power is measured
+// too where it can be read.
+void measure_hashrate(MiningBackend& miner, unsigned int seconds, uint64_t hashes, const std::atomic<bool>& running,
+                      BenchmarkResult& result, const std::function<void(double, uint64_t)>& progress = nullptr,
+                      bool hardware_counters = false);
+
+#endif // BENCHMARK_H
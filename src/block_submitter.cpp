@@ -0,0 +1,143 @@
+#include "block_submitter.h"
+#include "logger.h"
+#include "trace_recorder.h"
+#include <chrono>
+
+BlockSubmitter::BlockSubmitter(unsigned int node, const std::string& url, const std::string& user,
+                               const std::string& password, std::function<void()> on_result)
+    : node_(node), rpc_(url, user, password), on_result_(std::move(on_result)), retry_window_(0), inbox_(nullptr),
+      stop_(false) {}
+
+void BlockSubmitter::start() {
+    if (!thread_.joinable()) {
+        thread_ = std::thread(&BlockSubmitter::run, this);
+    }
+}
+
+void BlockSubmitter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void BlockSubmitter::submit(std::shared_ptr<const std::string> block_hex, uint32_t height, std::string block_hash_hex,
+                            bool fetch_next) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        queue_.push_back({std::move(block_hex), height, std::move(block_hash_hex), now, now, 0, fetch_next});
+    }
+    cv_.notify_one();
+}
+
+bool BlockSubmitter::take_result(SubmitResult& result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (results_.empty()) {
+        return false;
+    }
+    result = std::move(results_.front());
+    results_.pop_front();
+    return true;
+}
+
+void BlockSubmitter::run() {
+    TraceRecorder::set_thread_name("submitter " + std::to_string(node_));
+    Json::Value info;
+    rpc_.get_blockchain_info(info);  // Open the connection before it is needed
+
+    // Blocks waiting for the node to come back, soonest retry first (only
+    // this thread touches them)
+    std::deque<PendingBlock> retrying;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        // Blocks still queued at shutdown are submitted first
+        auto wake = retrying.empty()
+            ? std::chrono::steady_clock::now() + std::chrono::seconds(SUBMITTER_KEEPALIVE_SECONDS)
+            : retrying.front().retry_at;
+        bool woken = cv_.wait_until(lock, wake, [this]() { return stop_.load() || !queue_.empty(); });
+        PendingBlock block;
+        if (!queue_.empty()) {
+            block = std::move(queue_.front());
+            queue_.pop_front();
+        } else if (stop_.load()) {
+            for (const PendingBlock& given_up : retrying) {
+                LOG_WARNING_STREAM("Block at height " << given_up.height << " never reached node " << node_
+                                   << " before shutdown");
+            }
+            return;
+        } else if (!retrying.empty()) {
+            block = std::move(retrying.front());
+            retrying.pop_front();
+        } else {
+            if (!woken) {
+                lock.unlock();
+                rpc_.get_blockchain_info(info);
+                lock.lock();
+            }
+            continue;
+        }
+        lock.unlock();
+
+        SubmitResult result;
+        result.node = node_;
+        result.height = block.height;
+        result.block_hash_hex = block.block_hash_hex;
+        result.accepted = rpc_.submit_block(*block.block_hex, result.result);
+        result.next_template = false;
+        block.attempts++;
+        auto now = std::chrono::steady_clock::now();
+        if (!result.accepted && result.result.empty()) {
+            result.result = rpc_.get_last_error();
+            // No verdict: the node is down or restarting. Try again while the
+            // block can still make it.
+            if (now - block.found < retry_window_ && !stop_.load()) {
+                LOG_WARNING_STREAM("Block at height " << block.height << " not delivered to node " << node_
+                                   << " (attempt " << block.attempts << ": " << result.result << "), retrying");
+                block.retry_at = now + std::chrono::seconds(SUBMITTER_RETRY_SECONDS);
+                lock.lock();
+                retrying.push_back(std::move(block));
+                continue;
+            }
+        }
+        result.submit_ms = std::chrono::duration<double, std::milli>(now - block.found).count();
+        LOG_DEBUG_STREAM("Block at height " << result.height << " submitted to node " << node_ << " in "
+                         << result.submit_ms << " ms" << (block.attempts > 1 ? " (after retries)" : ""));
+        if (result.accepted && block.fetch_next && inbox_) {
+            result.next_template = fetch_next_template(block);
+        }
+
+        lock.lock();
+        results_.push_back(std::move(result));
+        lock.unlock();
+        if (on_result_) {
+            on_result_();
+        }
+        lock.lock();
+    }
+}
+
+bool BlockSubmitter::fetch_next_template(const PendingBlock& block) {
+    BlockTemplate next;
+    if (!rpc_.get_block_template(next, "")) {
+        // The main loop checks the tip and fetches it itself
+        LOG_WARNING_STREAM("Template after our block at height " << block.height << " not fetched from node "
+                           << node_ << ": " << rpc_.get_last_error());
+        return false;
+    }
+    if (next.previous_block_hash != block.block_hash_hex) {
+        LOG_DEBUG_STREAM("Template after our block at height " << block.height << " builds on "
+                         << next.previous_block_hash << " instead");
+    }
+    LOG_DEBUG_STREAM("Template for height " << next.height << " fetched from node " << node_ << " in "
+                     << rpc_.get_call_stats("getblocktemplate").last_ms << " ms after our block was accepted");
+    next.node = node_;
+    // The tip moved when the block was found: the switch is timed from there
+    next.times.noticed = block.found;
+    inbox_->push(std::make_shared<const BlockTemplate>(std::move(next)), "own block");
+    return true;
+}
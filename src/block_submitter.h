@@ -0,0 +1,97 @@
+#ifndef BLOCK_SUBMITTER_H
+#define BLOCK_SUBMITTER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "rpc_client.h"
+#include "template_inbox.h"
+
+// Seconds between keep-alive calls while no block has been submitted, so the
+// connection is still open when a solution comes
+static const int SUBMITTER_KEEPALIVE_SECONDS = 30;
+// Seconds between attempts at a block the node didn't answer for
+static const int SUBMITTER_RETRY_SECONDS = 2;
+
+// How a submitted block fared
+struct SubmitResult {
+    unsigned int node;           // Submitter's node (index into MinerConfig::rpc_urls)
+    uint32_t height;
+    std::string block_hash_hex;  // Display order
+    bool accepted;
+    std::string result;          // submitblock's answer (or the error)
+    double submit_ms;            // From the solution being found to the node's answer
+    bool next_template;          // Accepted, and the template on top of it is in the inbox already
+};
+
+// Submits blocks on a dedicated thread and warm RPC connection. Mining
+// workers call submit() straight from the hot loop with a fully serialized
+// block; results go back to the main loop through take_result(), and
+// on_result runs after each one (the main loop wakes its EventLoop there).
+// With several nodes there is one submitter per node and every block goes to
+// all of them at once; the block itself is shared, not copied per node.
+// A block the node gives no verdict on (unreachable, restarting) is retried
+// for the retry window, so it still lands if the node comes back in time.
+// Once a block asked to fetch_next is accepted, the template that builds on
+// it is fetched over the same warm connection and left in the main loop's
+// inbox before the result is reported, so the workers (still hashing the
+// found block's job) switch without a tip check or a fetch on the main loop.
+class BlockSubmitter {
+public:
+    BlockSubmitter(unsigned int node, const std::string& url, const std::string& user,
+                   const std::string& password, std::function<void()> on_result);
+    ~BlockSubmitter() { stop(); }
+
+    BlockSubmitter(const BlockSubmitter&) = delete;
+    BlockSubmitter& operator=(const BlockSubmitter&) = delete;
+
+    void start();
+    void stop();
+
+    // Queue a block for submission; never blocks on the network
+    void submit(std::shared_ptr<const std::string> block_hex, uint32_t height, std::string block_hash_hex,
+                bool fetch_next = false);
+    // How long after it was found a block is still retried (default 0: one
+    // attempt). Set before start.
+    void set_retry_window(std::chrono::seconds window) { retry_window_ = window; }
+    // Where the next template goes after an accepted fetch_next block (none
+    // by default). Set before start.
+    void set_next_template_inbox(TemplateInbox* inbox) { inbox_ = inbox; }
+
+    bool take_result(SubmitResult& result);
+
+private:
+    struct PendingBlock {
+        std::shared_ptr<const std::string> block_hex;
+        uint32_t height;
+        std::string block_hash_hex;
+        std::chrono::steady_clock::time_point found;
+        std::chrono::steady_clock::time_point retry_at;
+        unsigned int attempts;
+        bool fetch_next;
+    };
+
+    unsigned int node_;
+    RPCClient rpc_;
+    std::function<void()> on_result_;
+    std::chrono::seconds retry_window_;
+    TemplateInbox* inbox_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<PendingBlock> queue_;     // Guarded by mutex_
+    std::deque<SubmitResult> results_;   // Guarded by mutex_
+    std::atomic<bool> stop_;
+
+    void run();
+    bool fetch_next_template(const PendingBlock& block);
+};
+
+#endif // BLOCK_SUBMITTER_H
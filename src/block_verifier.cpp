@@ -0,0 +1,419 @@
+#include "block_verifier.h"
+#include "dataset_init.h"
+#include "logger.h"
+#include "miner.h"
+#include "rpc_client.h"
+#include "utils.h"
+#include "randomx.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// A block as fetched: its header and the solution it carries
+struct FetchedBlock {
+    uint64_t height;
+    uint8_t header[BLOCK_HEADER_SIZE];
+    uint8_t solution[RANDOMX_HASH_SIZE];
+    std::string malformed;  // Why it couldn't be read, empty if it could
+};
+
+struct FetchedEpoch {
+    uint64_t seed_height;
+    std::vector<uint8_t> key;
+    std::vector<FetchedBlock> blocks;
+};
+
+// Heights sharing a seed: RandomX_SeedHeight never decreases with the
+// height, so each epoch is one contiguous run
+struct EpochRange {
+    uint64_t seed_height;
+    uint64_t from;
+    uint64_t to;
+};
+
+// Both getblockheader (verbose false) and getblock (verbosity 0) start
+// with the header and the compact-size solution
+static void parse_serialized_header(const std::string& hex, FetchedBlock& block) {
+    static const size_t PREFIX_SIZE = BLOCK_HEADER_SIZE + 1 + RANDOMX_HASH_SIZE;
+    uint8_t prefix[PREFIX_SIZE];
+    if (hex.size() < PREFIX_SIZE * 2) {
+        block.malformed = "serialized header too short";
+    } else if (!utils::hex_decode(hex.data(), PREFIX_SIZE, prefix)) {
+        block.malformed = "serialized header is not hex";
+    } else if (prefix[BLOCK_HEADER_SIZE] != RANDOMX_HASH_SIZE) {
+        block.malformed = "solution is not a 32-byte RandomX hash";
+    } else {
+        std::memcpy(block.header, prefix, BLOCK_HEADER_SIZE);
+        std::memcpy(block.solution, prefix + BLOCK_HEADER_SIZE + 1, RANDOMX_HASH_SIZE);
+    }
+}
+
+// Fetches the blocks of an epoch in batches: their hashes, then their
+// headers. Nodes without getblockheader get getblock, which sends the whole
+// block for the same prefix.
+class BlockFetcher {
+public:
+    explicit BlockFetcher(RPCClient& rpc) : rpc_(rpc), use_getblockheader_(true) {}
+
+    bool fetch(const EpochRange& range, FetchedEpoch& epoch, std::string& error) {
+        epoch.seed_height = range.seed_height;
+        epoch.blocks.clear();
+        if (range.seed_height == 0) {
+            epoch.key.assign(GENESIS_EPOCH_KEY, GENESIS_EPOCH_KEY + std::strlen(GENESIS_EPOCH_KEY));
+        } else {
+            // The seed block's hash in internal byte order (getblockhash prints it reversed)
+            std::vector<std::string> seed_hash;
+            if (!block_hashes(range.seed_height, range.seed_height, seed_hash, error)) {
+                return false;
+            }
+            if (seed_hash[0].size() != 64) {
+                error = "getblockhash " + std::to_string(range.seed_height) + ": not a block hash";
+                return false;
+            }
+            epoch.key = utils::hex_to_bytes(seed_hash[0]);
+            std::reverse(epoch.key.begin(), epoch.key.end());
+        }
+
+        for (uint64_t from = range.from; from <= range.to; from += VERIFY_FETCH_BATCH) {
+            uint64_t to = std::min<uint64_t>(range.to, from + VERIFY_FETCH_BATCH - 1);
+            std::vector<std::string> hashes;
+            if (!block_hashes(from, to, hashes, error) || !headers(from, hashes, epoch.blocks, error)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    RPCClient& rpc_;
+    bool use_getblockheader_;
+
+    bool block_hashes(uint64_t from, uint64_t to, std::vector<std::string>& hashes, std::string& error) {
+        std::vector<RPCBatchCall> calls;
+        for (uint64_t height = from; height <= to; height++) {
+            Json::Value params(Json::arrayValue);
+            params.append((Json::UInt64)height);
+            calls.emplace_back("getblockhash", params);
+        }
+        if (!rpc_.call_batch(calls)) {
+            error = "getblockhash: " + rpc_.get_last_error();
+            return false;
+        }
+        for (size_t i = 0; i < calls.size(); i++) {
+            if (!calls[i].ok || !calls[i].result.isString()) {
+                error = "getblockhash " + std::to_string(from + i) + ": " +
+                        (calls[i].ok ? std::string("not a block hash") : calls[i].error);
+                return false;
+            }
+            hashes.push_back(calls[i].result.asString());
+        }
+        return true;
+    }
+
+    bool headers(uint64_t from, const std::vector<std::string>& hashes, std::vector<FetchedBlock>& blocks,
+                 std::string& error) {
+        std::vector<RPCBatchCall> calls;
+        for (const std::string& hash : hashes) {
+            Json::Value params(Json::arrayValue);
+            params.append(hash);
+            if (use_getblockheader_) {
+                params.append(false);
+                calls.emplace_back("getblockheader", params);
+            } else {
+                params.append(0);
+                calls.emplace_back("getblock", params);
+            }
+        }
+        if (!rpc_.call_batch(calls)) {
+            error = calls[0].method + ": " + rpc_.get_last_error();
+            return false;
+        }
+        if (use_getblockheader_ && !calls.empty() && !calls[0].ok) {
+            LOG_INFO_STREAM("getblockheader failed (" << calls[0].error << "), fetching whole blocks instead");
+            use_getblockheader_ = false;
+            return headers(from, hashes, blocks, error);
+        }
+        for (size_t i = 0; i < calls.size(); i++) {
+            if (!calls[i].ok) {
+                error = calls[i].method + " " + std::to_string(from + i) + ": " + calls[i].error;
+                return false;
+            }
+            FetchedBlock block;
+            block.height = from + i;
+            if (calls[i].result.isString()) {
+                parse_serialized_header(calls[i].result.asString(), block);
+            } else {
+                block.malformed = "not a serialized header";
+            }
+            blocks.push_back(block);
+        }
+        return true;
+    }
+};
+
+// Per worker, a contiguous share of an epoch's blocks. A worker takes from
+// the front of its own share; once that is empty it steals the back half of
+// the largest other share, so threads that finish early (or run on faster
+// cores) keep working until every block is done.
+class StealingQueue {
+public:
+    StealingQueue(size_t items, unsigned int workers) : shares_(workers) {
+        for (unsigned int w = 0; w < workers; w++) {
+            shares_[w].next = items * w / workers;
+            shares_[w].end = items * (w + 1) / workers;
+        }
+    }
+
+    bool take(unsigned int worker, size_t& item) {
+        Share& own = shares_[worker];
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (own.next < own.end) {
+                item = own.next++;
+                return true;
+            }
+        }
+        for (;;) {
+            size_t victim = shares_.size();
+            size_t most = 0;
+            for (size_t v = 0; v < shares_.size(); v++) {
+                std::lock_guard<std::mutex> lock(shares_[v].mutex);
+                if (v != worker && shares_[v].end - shares_[v].next > most) {
+                    most = shares_[v].end - shares_[v].next;
+                    victim = v;
+                }
+            }
+            if (victim == shares_.size()) {
+                return false;
+            }
+            size_t begin;
+            size_t end;
+            {
+                std::lock_guard<std::mutex> lock(shares_[victim].mutex);
+                size_t left = shares_[victim].end - shares_[victim].next;
+                if (left == 0) {
+                    continue;  // Emptied meanwhile: look again
+                }
+                end = shares_[victim].end;
+                begin = end - (left + 1) / 2;
+                shares_[victim].end = begin;
+            }
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.next = begin + 1;
+            own.end = end;
+            item = begin;
+            return true;
+        }
+    }
+
+private:
+    struct Share {
+        std::mutex mutex;
+        size_t next = 0;
+        size_t end = 0;
+    };
+    std::vector<Share> shares_;
+};
+
+static bool stopped(const BlockVerifyOptions& options) {
+    return options.running && !options.running->load();
+}
+
+// Verify one epoch's blocks; reasons[i] is set for each invalid block
+static void verify_epoch(const FetchedEpoch& epoch, const BlockVerifyOptions& options, std::vector<std::string>& reasons,
+                         std::atomic<uint64_t>& verified, EpochVerifyStats& stats,
+                         const std::function<void()>& progress) {
+    auto t0 = std::chrono::steady_clock::now();
+    randomx_flags flags = randomx_get_flags();
+    stats.seed_height = epoch.seed_height;
+    stats.blocks = epoch.blocks.size();
+    stats.dataset = false;
+
+    randomx_cache* cache = randomx_alloc_cache(flags);
+    if (!cache) {
+        cache = randomx_alloc_cache((randomx_flags)(flags & ~RANDOMX_FLAG_JIT));
+    }
+    randomx_init_cache(cache, epoch.key.data(), epoch.key.size());
+    randomx_dataset* dataset = nullptr;
+    if (options.allow_dataset && epoch.blocks.size() >= VERIFY_DATASET_MIN_BLOCKS) {
+        dataset = randomx_alloc_dataset(flags);
+        if (dataset) {
+            DatasetInitializer initializer(cache);
+            initializer.add_dataset(dataset, std::vector<int>());
+            initializer.run();
+            stats.dataset = true;
+        } else {
+            LOG_WARNING("Cannot allocate a dataset, verifying in light mode");
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    stats.init_seconds = std::chrono::duration<double>(t1 - t0).count();
+
+    const unsigned int threads = std::max(1u, std::min<unsigned int>(options.threads, epoch.blocks.size()));
+    StealingQueue queue(epoch.blocks.size(), threads);
+    std::vector<std::thread> workers;
+    std::atomic<unsigned int> running_workers(threads);
+    for (unsigned int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            pin_current_thread_to_hashing_cpus();
+            randomx_vm* vm = dataset ? randomx_create_vm((randomx_flags)(flags | RANDOMX_FLAG_FULL_MEM), nullptr, dataset)
+                                     : randomx_create_vm(flags, cache, nullptr);
+            if (!vm) {
+                vm = randomx_create_vm((randomx_flags)(flags & ~RANDOMX_FLAG_JIT), dataset ? nullptr : cache, dataset);
+            }
+            if (!vm) {
+                LOG_ERROR("Cannot create a RandomX VM for verification");
+                running_workers--;
+                return;  // The other workers steal its share
+            }
+            size_t i;
+            uint8_t hash[RANDOMX_HASH_SIZE];
+            while (!stopped(options) && queue.take(t, i)) {
+                const FetchedBlock& block = epoch.blocks[i];
+                if (!block.malformed.empty()) {
+                    reasons[i] = block.malformed;
+                } else {
+                    randomx_calculate_hash(vm, block.header, BLOCK_HEADER_SIZE, hash);
+                    if (std::memcmp(hash, block.solution, RANDOMX_HASH_SIZE) != 0) {
+                        reasons[i] = "header hashes to " + utils::bytes_to_hex(hash, RANDOMX_HASH_SIZE) +
+                                     ", block carries " + utils::bytes_to_hex(block.solution, RANDOMX_HASH_SIZE);
+                    } else if (!utils::hash_meets_target(hash, utils::compact_to_target(utils::read_le32(block.header + 104)))) {
+                        reasons[i] = "hash above the nBits target";
+                    }
+                }
+                verified.fetch_add(1, std::memory_order_relaxed);
+            }
+            randomx_destroy_vm(vm);
+            running_workers--;
+        });
+    }
+    // Report progress while the workers run
+    while (running_workers.load() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        if (progress) {
+            progress();
+        }
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    stats.hash_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+
+    if (dataset) {
+        randomx_release_dataset(dataset);
+    }
+    randomx_release_cache(cache);
+}
+
+bool verify_blocks(RPCClient& rpc, const BlockVerifyOptions& options, BlockVerifyReport& report, std::string& error,
+                   const std::function<void(uint64_t, uint64_t)>& progress) {
+    report = BlockVerifyReport();
+    if (options.to_height < options.from_height) {
+        error = "empty height range";
+        return false;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const uint64_t total = options.to_height - options.from_height + 1;
+
+    std::vector<EpochRange> ranges;
+    for (uint64_t height = options.from_height; height <= options.to_height; height++) {
+        uint64_t seed_height = RandomX_SeedHeight(height);
+        if (ranges.empty() || ranges.back().seed_height != seed_height) {
+            ranges.push_back({seed_height, height, height});
+        } else {
+            ranges.back().to = height;
+        }
+    }
+
+    // The next epoch is fetched while this one is hashed
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<FetchedEpoch> ready;
+    bool fetch_done = false;
+    bool quit = false;  // Verification ended: fetch nothing more
+    std::string fetch_error;
+    std::thread fetcher([&]() {
+        BlockFetcher fetch(rpc);
+        for (const EpochRange& range : ranges) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return ready.size() < 2 || quit || stopped(options); });
+                if (quit || stopped(options)) {
+                    break;
+                }
+            }
+            FetchedEpoch epoch;
+            std::string fetch_failure;
+            bool ok = fetch.fetch(range, epoch, fetch_failure);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!ok) {
+                fetch_error = fetch_failure;
+                break;
+            }
+            ready.push_back(std::move(epoch));
+            cv.notify_all();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        fetch_done = true;
+        cv.notify_all();
+    });
+
+    std::atomic<uint64_t> verified(0);
+    auto report_progress = [&]() {
+        if (progress) {
+            progress(verified.load(std::memory_order_relaxed), total);
+        }
+    };
+    for (;;) {
+        FetchedEpoch epoch;
+        {
+            auto wait_start = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> lock(mutex);
+            // Wake now and then to notice a stop while the node is slow
+            while (ready.empty() && !fetch_done && !stopped(options)) {
+                cv.wait_for(lock, std::chrono::milliseconds(200));
+            }
+            report.fetch_wait_seconds +=
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - wait_start).count();
+            if (ready.empty() || stopped(options)) {
+                break;
+            }
+            epoch = std::move(ready.front());
+            ready.pop_front();
+            cv.notify_all();
+        }
+        std::vector<std::string> reasons(epoch.blocks.size());
+        EpochVerifyStats stats;
+        verify_epoch(epoch, options, reasons, verified, stats, report_progress);
+        report.epochs.push_back(stats);
+        for (size_t i = 0; i < epoch.blocks.size(); i++) {
+            report.blocks++;
+            if (reasons[i].empty()) {
+                report.valid++;
+            } else {
+                report.failures.push_back({epoch.blocks[i].height, reasons[i]});
+            }
+        }
+        LOG_INFO_STREAM("Verified " << epoch.blocks.size() << " blocks of the epoch seeded at " << epoch.seed_height
+                        << " (" << (stats.dataset ? "dataset" : "cache") << " built in " << stats.init_seconds
+                        << " s, hashed in " << stats.hash_seconds << " s)");
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;  // Let a fetcher waiting for room see the stop
+        cv.notify_all();
+    }
+    fetcher.join();
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report_progress();
+
+    if (!fetch_error.empty()) {
+        error = fetch_error;
+        return false;
+    }
+    return true;
+}
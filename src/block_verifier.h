@@ -0,0 +1,74 @@
+#ifndef BLOCK_VERIFIER_H
+#define BLOCK_VERIFIER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class RPCClient;
+
+// An epoch with at least this many blocks to check is verified on a full
+// dataset instead of the cache: building one costs about as much CPU as 500
+// light-mode hashes, and fast-mode hashes are several times cheaper
+static const uint64_t VERIFY_DATASET_MIN_BLOCKS = 512;
+
+// Heights per JSON-RPC batch when fetching headers
+static const size_t VERIFY_FETCH_BATCH = 250;
+
+// RandomX key of epoch 0 (seed height 0); later epochs are keyed by the
+// hash of their seed block
+static const char* const GENESIS_EPOCH_KEY = "ZcashRandomXPoW";
+
+struct BlockVerifyOptions {
+    uint64_t from_height;
+    uint64_t to_height;         // Inclusive
+    unsigned int threads;
+    bool allow_dataset;         // Else every epoch is verified in light mode
+    const std::atomic<bool>* running;  // Stops early once cleared (may be null)
+
+    BlockVerifyOptions() : from_height(0), to_height(0), threads(1), allow_dataset(true), running(nullptr) {}
+};
+
+struct BlockVerifyFailure {
+    uint64_t height;
+    std::string reason;
+};
+
+// One epoch's share of a run
+struct EpochVerifyStats {
+    uint64_t seed_height;
+    uint64_t blocks;
+    bool dataset;               // Verified in fast mode
+    double init_seconds;        // Cache (and dataset) build
+    double hash_seconds;
+};
+
+struct BlockVerifyReport {
+    uint64_t blocks;            // Verified, valid or not
+    uint64_t valid;
+    std::vector<BlockVerifyFailure> failures;
+    std::vector<EpochVerifyStats> epochs;
+    double seconds;             // Whole run
+    double fetch_wait_seconds;  // Hashing stalled on the node
+
+    BlockVerifyReport() : blocks(0), valid(0), seconds(0), fetch_wait_seconds(0) {}
+    double blocks_per_second() const { return seconds > 0 ? blocks / seconds : 0; }
+};
+
+// Re-checks the proof of work of blocks from_height..to_height on a node:
+// each block's RandomX hash of its 140-byte header must equal the solution
+// it carries and meet its nBits target. Blocks are fetched in batches
+// (getblockhash, then getblockheader or getblock), an epoch ahead of the
+// hashing, and grouped by RandomX_SeedHeight so each epoch's cache (or
+// dataset, see VERIFY_DATASET_MIN_BLOCKS) is built once. The hashes of an
+// epoch are spread over the threads through per-thread queues that idle
+// threads steal from. progress, if set, is called from the calling thread
+// about once a second with the blocks verified so far and the total.
+// False with error set if the node couldn't be read; invalid blocks are
+// not an error but failures in report.
+bool verify_blocks(RPCClient& rpc, const BlockVerifyOptions& options, BlockVerifyReport& report, std::string& error,
+                   const std::function<void(uint64_t, uint64_t)>& progress = nullptr);
+
+#endif // BLOCK_VERIFIER_H
@@ -0,0 +1,259 @@
+#include "cache_partition.h"
+#include "cpu_topology.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+bool read_line(const fs::path& path, std::string& line) {
+    std::ifstream file(path);
+    return file && std::getline(file, line);
+}
+
+// resctrl takes one command per write, and says why it refused one in
+// info/last_cmd_status
+bool write_line(const fs::path& path, const std::string& line, std::string& error) {
+    std::ofstream file(path);
+    if (file) {
+        file << line << std::endl;
+    }
+    if (file) {
+        return true;
+    }
+    error = std::strerror(errno);
+    std::string status;
+    if (read_line(fs::path(RESCTRL_ROOT) / "info" / "last_cmd_status", status) && status != "ok") {
+        error = status;
+    }
+    return false;
+}
+
+// The IDs in a schemata line ("L3:0=7ff;1=7ff") for resource
+std::vector<int> schemata_ids(const fs::path& schemata, const std::string& resource) {
+    std::vector<int> ids;
+    std::ifstream file(schemata);
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t start = line.find_first_not_of(' ');
+        if (start == std::string::npos || line.compare(start, resource.size() + 1, resource + ":") != 0) {
+            continue;
+        }
+        std::stringstream domains(line.substr(start + resource.size() + 1));
+        std::string domain;
+        while (std::getline(domains, domain, ';')) {
+            ids.push_back(std::atoi(domain.c_str()));
+        }
+    }
+    return ids;
+}
+
+// The L3 a CPU sits on: its cache ID and size, false if sysfs doesn't say
+bool cpu_l3(int cpu, int& id, size_t& bytes) {
+    const fs::path cache = fs::path("/sys/devices/system/cpu") / ("cpu" + std::to_string(cpu)) / "cache";
+    for (int index = 0; index < 8; index++) {
+        const fs::path dir = cache / ("index" + std::to_string(index));
+        std::string level, id_text, size;
+        if (!read_line(dir / "level", level)) {
+            break;
+        }
+        if (level != "3" || !read_line(dir / "id", id_text) || !read_line(dir / "size", size)) {
+            continue;
+        }
+        id = std::atoi(id_text.c_str());
+        bytes = std::strtoull(size.c_str(), nullptr, 10);
+        bytes *= size.find('M') != std::string::npos ? 1024 * 1024 : size.find('K') != std::string::npos ? 1024 : 1;
+        return true;
+    }
+    return false;
+}
+
+unsigned int count_bits(uint64_t mask) {
+    unsigned int bits = 0;
+    for (; mask; mask &= mask - 1) bits++;
+    return bits;
+}
+
+std::string hex(uint64_t value) {
+    std::ostringstream text;
+    text << std::hex << value;
+    return text.str();
+}
+
+}  // namespace
+
+bool CachePartition::open(const CachePartitionConfig& config, std::string& error) {
+    close();
+    config_ = config;
+    const fs::path root(RESCTRL_ROOT);
+    std::string text;
+    if (!fs::exists(root / "info")) {
+        error = "resctrl is not mounted (mount -t resctrl resctrl /sys/fs/resctrl, as root)";
+        return false;
+    }
+    if (!read_line(root / "info" / "L3" / "cbm_mask", text)) {
+        error = "this CPU or kernel has no L3 cache allocation (" +
+                std::string(fs::exists(root / "info" / "L3CODE") ? "code/data prioritization is on" : "no info/L3") + ")";
+        return false;
+    }
+    cbm_mask_ = std::strtoull(text.c_str(), nullptr, 16);
+    cbm_bits_ = count_bits(cbm_mask_);
+    min_bits_ = read_line(root / "info" / "L3" / "min_cbm_bits", text) ? std::max(1, std::atoi(text.c_str())) : 1;
+    if (config_.l3_mask && ((config_.l3_mask & ~cbm_mask_) || count_bits(config_.l3_mask) < min_bits_)) {
+        error = "L3 mask " + hex(config_.l3_mask) + " doesn't fit the cache's ways (" + hex(cbm_mask_) + ", at least " +
+                std::to_string(min_bits_) + ")";
+        return false;
+    }
+
+    // A group left behind by a run that didn't get to remove it is taken over
+    dir_ = (root / RESCTRL_GROUP).string();
+    std::error_code ec;
+    fs::create_directory(dir_, ec);
+    if (ec) {
+        error = "can't create " + dir_ + ": " + ec.message();
+        return false;
+    }
+    caches_.clear();
+    for (int id : schemata_ids(fs::path(dir_) / "schemata", "L3")) {
+        caches_[id] = Cache{0, 0, 0};
+    }
+    tids_.clear();
+    cpus_.clear();
+    active_ = 0;
+    open_ = true;
+
+    if (config_.l3_mask) {
+        std::string line = "L3:";
+        for (auto& cache : caches_) {
+            line += (line.size() > 3 ? ";" : "") + std::to_string(cache.first) + "=" + hex(config_.l3_mask);
+            cache.second.mask = config_.l3_mask;
+        }
+        if (!write_schemata(line)) {
+            error = "the kernel refused L3 mask " + hex(config_.l3_mask);
+            close();
+            return false;
+        }
+    }
+    if (config_.mba) {
+        std::vector<int> ids = schemata_ids(fs::path(dir_) / "schemata", "MB");
+        std::string line = "MB:";
+        for (int id : ids) {
+            line += (line.size() > 3 ? ";" : "") + std::to_string(id) + "=" + std::to_string(config_.mba);
+        }
+        if (ids.empty() || !write_schemata(line)) {
+            LOG_WARNING_STREAM("Cache partition: no memory bandwidth allocation"
+                               << (ids.empty() ? " on this CPU" : ", the kernel refused " + line));
+            config_.mba = 0;
+        }
+    }
+    LOG_DEBUG_STREAM("Cache partition: " << dir_ << ", L3 ways " << hex(cbm_mask_) << " (at least " << min_bits_
+                     << "), " << caches_.size() << " caches");
+    return true;
+}
+
+bool CachePartition::write_schemata(const std::string& line) {
+    std::string error;
+    if (!write_line(fs::path(dir_) / "schemata", line, error)) {
+        LOG_WARNING_STREAM("Cache partition: writing '" << line << "' failed: " << error);
+        return false;
+    }
+    return true;
+}
+
+uint64_t CachePartition::mask_for(const Cache& cache, unsigned int workers) const {
+    // The top ways, leaving the low ones (where the default group's
+    // allocations start) to the services
+    unsigned int ways = cbm_bits_;
+    if (cache.bytes > 0 && cbm_bits_ > 0) {
+        const size_t way_bytes = std::max<size_t>(1, cache.bytes / cbm_bits_);
+        ways = (unsigned int)std::min<size_t>(cbm_bits_, (workers * RANDOMX_L3_PER_THREAD + way_bytes - 1) / way_bytes);
+    }
+    ways = std::max(ways, min_bits_);
+    const uint64_t low = ways >= 64 ? ~0ULL : (1ULL << ways) - 1;
+    return (low << (cbm_bits_ - ways)) & cbm_mask_;
+}
+
+bool CachePartition::update(const std::vector<int>& worker_tids, const std::vector<int>& cpus, unsigned int active) {
+    if (!open_) {
+        return false;
+    }
+    for (int tid : worker_tids) {
+        if (tid <= 0 || tids_.count(tid)) continue;
+        std::string error;
+        if (!write_line(fs::path(dir_) / "tasks", std::to_string(tid), error)) {
+            LOG_WARNING_STREAM("Cache partition: can't move thread " << tid << ": " << error);
+        }
+        tids_.insert(tid);  // Not tried again either way
+    }
+    if (config_.l3_mask || (cpus == cpus_ && active == active_)) {
+        return false;
+    }
+
+    if (cpus != cpus_) {
+        for (auto& cache : caches_) {
+            cache.second.cpus = 0;
+        }
+        for (int cpu : cpus) {
+            int id;
+            size_t bytes;
+            if (cpu_l3(cpu, id, bytes) && caches_.count(id)) {
+                caches_[id].bytes = bytes;
+                caches_[id].cpus++;
+            }
+        }
+        cpus_ = cpus;
+    }
+    active_ = active;
+
+    // The active workers shared out over the caches by their CPUs on each
+    unsigned int total = 0;
+    for (const auto& cache : caches_) {
+        total += cache.second.cpus;
+    }
+    std::string line;
+    for (auto& cache : caches_) {
+        // Where the CPUs aren't known, every cache is sized for all of them
+        unsigned int workers = total ? std::min(cache.second.cpus, (active * cache.second.cpus + total - 1) / total)
+                                     : active;
+        uint64_t mask = mask_for(cache.second, workers);
+        if (mask == cache.second.mask) continue;
+        line += (line.empty() ? "L3:" : ";") + std::to_string(cache.first) + "=" + hex(mask);
+        cache.second.mask = mask;
+    }
+    return !line.empty() && write_schemata(line);
+}
+
+void CachePartition::close() {
+    if (!open_) {
+        return;
+    }
+    // Its tasks go back to the default group
+    std::error_code ec;
+    fs::remove(dir_, ec);
+    if (ec) {
+        LOG_WARNING_STREAM("Cache partition: can't remove " << dir_ << ": " << ec.message());
+    }
+    open_ = false;
+}
+
+std::string CachePartition::describe() const {
+    std::ostringstream text;
+    text << "L3 ";
+    bool first = true;
+    for (const auto& cache : caches_) {
+        text << (first ? "" : ", ") << cache.first << "=" << hex(cache.second.mask) << " ("
+             << count_bits(cache.second.mask) << " of " << cbm_bits_ << " ways)";
+        first = false;
+    }
+    if (config_.mba) {
+        text << ", MB " << config_.mba;
+    }
+    return text.str();
+}
@@ -0,0 +1,75 @@
+#ifndef CACHE_PARTITION_H
+#define CACHE_PARTITION_H
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// The resctrl filesystem and the group the mining workers go in
+static const char* const RESCTRL_ROOT = "/sys/fs/resctrl";
+static const char* const RESCTRL_GROUP = "juno-miner";
+
+// What to give the mining workers' class of service
+struct CachePartitionConfig {
+    uint64_t l3_mask;           // Fixed L3 way mask on every cache, 0 = sized from the active workers
+    unsigned int mba;           // Memory bandwidth limit as the kernel takes it (percent on Intel), 0 = none
+
+    CachePartitionConfig() : l3_mask(0), mba(0) {}
+};
+
+// Cache partitioning for co-located mining (Linux resctrl: Intel RDT, AMD
+// QoS). The workers get a resctrl group of their own, whose L3 capacity
+// bitmask holds them to the top ways of each L3: by default as many as
+// their scratchpads need (RANDOMX_L3_PER_THREAD per active worker, shared
+// out over the L3s in proportion to the workers' CPUs on each), so the
+// miner only ever evicts lines from those ways and the services keep the
+// rest to themselves. With adaptive co-location the mask shrinks as workers are
+// idled and grows back as they resume. Needs root and resctrl mounted
+// (mount -t resctrl resctrl /sys/fs/resctrl); the group is removed on
+// close, which moves the workers back to the default group.
+class CachePartition {
+public:
+    CachePartition() : open_(false), cbm_mask_(0), cbm_bits_(0), min_bits_(1), active_(0) {}
+    ~CachePartition() { close(); }
+
+    CachePartition(const CachePartition&) = delete;
+    CachePartition& operator=(const CachePartition&) = delete;
+
+    // Create (or take over) the group and apply the bandwidth limit; false
+    // with error set if resctrl or the L3 allocation isn't there
+    bool open(const CachePartitionConfig& config, std::string& error);
+    bool is_open() const { return open_; }
+    // Move workers (OS thread IDs, 0 = not running yet) that aren't in the
+    // group yet into it, and size the mask for active workers hashing on
+    // cpus. Cheap when nothing changed; true when the schemata was rewritten.
+    bool update(const std::vector<int>& worker_tids, const std::vector<int>& cpus, unsigned int active);
+    void close();
+
+    // "L3 0=0x7e0 (6 of 11 ways), MB 50"
+    std::string describe() const;
+
+private:
+    struct Cache {
+        size_t bytes;
+        unsigned int cpus;      // Worker CPUs on it
+        uint64_t mask;          // Last written
+    };
+
+    bool write_schemata(const std::string& line);
+    uint64_t mask_for(const Cache& cache, unsigned int workers) const;
+
+    bool open_;
+    CachePartitionConfig config_;
+    std::string dir_;
+    uint64_t cbm_mask_;         // All ways (info/L3/cbm_mask)
+    unsigned int cbm_bits_;
+    unsigned int min_bits_;     // info/L3/min_cbm_bits
+    std::map<int, Cache> caches_;   // By L3 cache ID
+    std::set<int> tids_;        // Moved in already
+    std::vector<int> cpus_;     // Sized for
+    unsigned int active_;
+};
+
+#endif // CACHE_PARTITION_H
@@ -0,0 +1,188 @@
+#include "colocation_governor.h"
+#include "logger.h"
+#include "mining_backend.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+// "total=" of the "some" line of a PSI file (microseconds stalled), -1 if
+// unreadable. psi_dir is /proc/pressure (files cpu, memory) or a cgroup
+// directory (cpu.pressure, memory.pressure).
+int64_t read_psi_total(const std::string& psi_dir, const std::string& resource) {
+    std::ifstream file(psi_dir + "/" + resource + ".pressure");
+    if (!file) {
+        file.open(psi_dir + "/" + resource);
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, 5, "some ") != 0) continue;
+        size_t total = line.find("total=");
+        if (total == std::string::npos) return -1;
+        return std::strtoll(line.c_str() + total + 6, nullptr, 10);
+    }
+    return -1;
+}
+
+// Steal and all ticks from the aggregate "cpu" line of /proc/stat
+bool read_steal(int64_t& steal, int64_t& total) {
+    std::ifstream file("/proc/stat");
+    std::string label;
+    if (!(file >> label) || label != "cpu") return false;
+    // user nice system idle iowait irq softirq steal (guest time is in user)
+    int64_t value;
+    total = 0;
+    for (int field = 0; field < 8 && file >> value; field++) {
+        total += value;
+        if (field == 7) {
+            steal = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+// First number in the file, -1 if there is none
+double read_signal(const std::string& path) {
+    std::ifstream file(path);
+    double value;
+    return file >> value ? value : -1;
+}
+
+}  // namespace
+
+ColocationGovernor::ColocationGovernor(MiningBackend& backend, const ColocationLimits& limits)
+    : backend_(backend), limits_(limits), threads_(0), stop_(false) {}
+
+void ColocationGovernor::start(unsigned int threads) {
+    if (thread_.joinable()) {
+        return;
+    }
+    threads_ = threads;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = false;
+        sample_ = ColocationSample();
+        sample_.enabled = true;
+        sample_.workers = threads;
+        sample_.threads = threads;
+    }
+    thread_ = std::thread(&ColocationGovernor::run, this);
+}
+
+void ColocationGovernor::set_thread_count(unsigned int threads) {
+    threads_ = threads;
+}
+
+void ColocationGovernor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+ColocationSample ColocationGovernor::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sample_;
+}
+
+ColocationGovernor::Counters ColocationGovernor::read_counters() const {
+    Counters counters;
+    counters.cpu_stall_us = read_psi_total(limits_.psi_dir, "cpu");
+    counters.memory_stall_us = read_psi_total(limits_.psi_dir, "memory");
+    if (!read_steal(counters.steal_ticks, counters.cpu_ticks)) {
+        counters.steal_ticks = -1;
+        counters.cpu_ticks = 0;
+    }
+    return counters;
+}
+
+void ColocationGovernor::run() {
+    Counters last = read_counters();
+    auto last_time = std::chrono::steady_clock::now();
+    unsigned int workers = threads_.load();
+    int calm_samples = 0;
+    backend_.set_worker_limit(workers);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cv_.wait_for(lock, std::chrono::milliseconds(COLOCATION_INTERVAL_MS), [this]() { return stop_; })) {
+        lock.unlock();
+        Counters now = read_counters();
+        auto now_time = std::chrono::steady_clock::now();
+        double elapsed_us = std::chrono::duration<double, std::micro>(now_time - last_time).count();
+
+        ColocationSample sample;
+        sample.enabled = true;
+        if (now.cpu_stall_us >= 0 && last.cpu_stall_us >= 0 && elapsed_us > 0) {
+            sample.cpu_pressure = 100.0 * (now.cpu_stall_us - last.cpu_stall_us) / elapsed_us;
+        }
+        if (now.memory_stall_us >= 0 && last.memory_stall_us >= 0 && elapsed_us > 0) {
+            sample.memory_pressure = 100.0 * (now.memory_stall_us - last.memory_stall_us) / elapsed_us;
+        }
+        if (now.steal_ticks >= 0 && last.steal_ticks >= 0 && now.cpu_ticks > last.cpu_ticks) {
+            sample.steal = 100.0 * (now.steal_ticks - last.steal_ticks) / (double)(now.cpu_ticks - last.cpu_ticks);
+        }
+        if (!limits_.signal_path.empty()) {
+            sample.signal = read_signal(limits_.signal_path);
+        }
+        last = now;
+        last_time = now_time;
+
+        // The signal furthest over (or closest to) its limit
+        double worst = 0;
+        std::ostringstream reason;
+        auto weigh = [&](const char* name, double value, double limit, const char* unit) {
+            if (limit > 0 && value >= 0 && value / limit > worst) {
+                worst = value / limit;
+                reason.str("");
+                reason << name << " " << value << unit << " over " << limit << unit;
+            }
+        };
+        reason.precision(3);
+        weigh("cpu pressure", sample.cpu_pressure, limits_.cpu_pressure, "%");
+        weigh("memory pressure", sample.memory_pressure, limits_.memory_pressure, "%");
+        weigh("steal", sample.steal, limits_.steal, "%");
+        weigh("load signal", sample.signal, limits_.signal_limit, "");
+
+        const unsigned int threads = threads_.load();
+        unsigned int target = std::min(workers, threads);
+        if (worst > 1.0) {
+            target = worst > 2.0 ? target / 2 : (target > 0 ? target - 1 : 0);
+            calm_samples = 0;
+        } else if (worst < COLOCATION_RESUME_FRACTION) {
+            if (++calm_samples >= COLOCATION_RESUME_SAMPLES && target < threads) {
+                target++;
+                calm_samples = 0;
+            }
+        } else {
+            calm_samples = 0;
+        }
+
+        if (target != workers) {
+            backend_.set_worker_limit(target);
+            if (target < workers) {
+                LOG_INFO_STREAM("Co-location: " << target << "/" << threads << " workers (" << reason.str() << ")");
+            } else {
+                LOG_DEBUG_STREAM("Co-location: " << target << "/" << threads << " workers (resumed)");
+            }
+        }
+
+        lock.lock();
+        sample.throttles = sample_.throttles + (target < workers ? 1 : 0);
+        sample.reason = target < workers ? reason.str() : sample_.reason;
+        sample.workers = target;
+        sample.threads = threads;
+        sample_ = sample;
+        workers = target;
+    }
+    lock.unlock();
+    // Hand every worker back: whoever stops the governor keeps mining at full strength
+    backend_.set_worker_limit(threads_.load());
+}
@@ -0,0 +1,101 @@
+#ifndef COLOCATION_GOVERNOR_H
+#define COLOCATION_GOVERNOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class MiningBackend;
+
+// How often the governor samples its signals (milliseconds)
+static const int COLOCATION_INTERVAL_MS = 250;
+// Workers come back one at a time, each after this many samples in a row
+// with every signal under COLOCATION_RESUME_FRACTION of its limit
+static const int COLOCATION_RESUME_SAMPLES = 8;
+static const double COLOCATION_RESUME_FRACTION = 0.5;
+
+// The signals and limits the governor holds the host to. Pressures and
+// steal are percentages of wall time over one sample interval; 0 turns a
+// signal off.
+struct ColocationLimits {
+    double cpu_pressure;        // PSI cpu "some": time a task waited for a CPU
+    double memory_pressure;     // PSI memory "some": time a task stalled on reclaim
+    double steal;               // CPU steal time on a VM, share of all CPU time
+    // /proc/pressure, or a cgroup directory (cpu.pressure, memory.pressure):
+    // pointed at the services' cgroup, the miner's own waits don't count
+    std::string psi_dir;
+    // A file whose first number is an outside load figure (e.g. written by
+    // the service's exporter), held under signal_limit; empty = none
+    std::string signal_path;
+    double signal_limit;
+
+    ColocationLimits()
+        : cpu_pressure(10), memory_pressure(5), steal(5), psi_dir("/proc/pressure"), signal_limit(0) {}
+};
+
+// What the governor last saw and did. A signal it can't read is -1.
+struct ColocationSample {
+    bool enabled;
+    double cpu_pressure;
+    double memory_pressure;
+    double steal;
+    double signal;
+    unsigned int workers;       // Allowed to hash
+    unsigned int threads;       // Of this many
+    uint64_t throttles;         // Times it took workers away
+    std::string reason;         // The signal over its limit at the last throttle
+
+    ColocationSample()
+        : enabled(false), cpu_pressure(-1), memory_pressure(-1), steal(-1), signal(-1), workers(0), threads(0)
+        , throttles(0) {}
+};
+
+// Adaptive co-location: mines on the idle cycles of a host that runs
+// latency-sensitive services. A thread samples PSI CPU and memory pressure,
+// steal time and the optional outside signal every COLOCATION_INTERVAL_MS.
+// When one is over its limit it idles workers through the backend's
+// set_worker_limit: one at a time, or half of them at once past twice the
+// limit. Once everything has stayed well under the limits, it resumes them
+// one by one. Idled workers keep their VMs, so both directions take effect
+// within a few hashes.
+class ColocationGovernor {
+public:
+    ColocationGovernor(MiningBackend& backend, const ColocationLimits& limits);
+    ~ColocationGovernor() { stop(); }
+
+    ColocationGovernor(const ColocationGovernor&) = delete;
+    ColocationGovernor& operator=(const ColocationGovernor&) = delete;
+
+    // threads: the backend's worker count; call again whenever it changes
+    void start(unsigned int threads);
+    void set_thread_count(unsigned int threads);
+    void stop();
+
+    ColocationSample snapshot() const;
+
+private:
+    // Cumulative counters behind the rates
+    struct Counters {
+        int64_t cpu_stall_us;       // -1 if unreadable
+        int64_t memory_stall_us;
+        int64_t steal_ticks;        // -1 if unreadable
+        int64_t cpu_ticks;
+    };
+
+    MiningBackend& backend_;
+    ColocationLimits limits_;
+    std::atomic<unsigned int> threads_;
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_;                     // Guarded by mutex_
+    ColocationSample sample_;       // Guarded by mutex_
+
+    void run();
+    Counters read_counters() const;
+};
+
+#endif // COLOCATION_GOVERNOR_H
@@ -1,7 +1,11 @@
 #include "config.h"
+#include "cpu_topology.h"
+#include "trace_recorder.h"
+#include "telemetry_journal.h"
 #include <iostream>
 #include <cstring>
 #include <cstdlib>
+#include <sstream>
 
 void print_usage(const char* program_name) {
     std::cout << "Juno Cash RandomX Miner" << std::endl;
@@ -9,18 +13,102 @@ void print_usage(const char* program_name) {
     std::cout << "Usage: " << program_name << " [OPTIONS]" << std::endl;
     std::cout << std::endl;
     std::cout << "Options:" << std::endl;
-    std::cout << "  --rpc-url URL          RPC server URL (default: http://127.0.0.1:8232)" << std::endl;
+    std::cout << "  --rpc-url URL          RPC server URL, or unix:///path for a Unix socket (default: http://127.0.0.1:8232);" << std::endl;
+    std::cout << "                         repeat for more nodes: the first to show a new block wins, failed nodes are skipped" << std::endl;
     std::cout << "  --rpc-user USER        RPC username" << std::endl;
     std::cout << "  --rpc-password PASS    RPC password" << std::endl;
+    std::cout << "  --pool URL             Mine for a pool instead: stratum+tcp://host:port or stratum+ssl://host:port" << std::endl;
+    std::cout << "  --pool-user USER       Pool login (usually the payout address)" << std::endl;
+    std::cout << "  --pool-password PASS   Pool password (default: none)" << std::endl;
+    std::cout << "  --proxy HOST:PORT      Don't mine: serve the node's work to rigs running --pool stratum+tcp://this-host:PORT" << std::endl;
+    std::cout << "  --share-bits N         Count pseudo-shares (hashes with N leading zero bits) to verify the effective hashrate;" << std::endl;
+    std::cout << "                         with --proxy, the share target rigs submit at (default: off)" << std::endl;
+    std::cout << "  --share-verify PCT     With --proxy, recompute the hash of PCT% of pseudo-shares (default: 100)" << std::endl;
     std::cout << "  --threads N            Number of mining threads (default: auto-detect)" << std::endl;
     std::cout << "  --update-interval N    Stats update interval in seconds (default: 5)" << std::endl;
     std::cout << "  --block-check N        Block check interval in seconds (default: 2)" << std::endl;
+    std::cout << "  --outage-grace N       Keep mining the last template for N seconds while no node answers (default: 120)" << std::endl;
     std::cout << "  --zmq-url URL          ZMQ endpoint for instant block notifications (e.g., tcp://127.0.0.1:28332)" << std::endl;
+    std::cout << "  --spy-url URL          On a block announcement, mine an empty block from this node (one with an" << std::endl;
+    std::cout << "                         empty mempool) until the full template arrives" << std::endl;
+    std::cout << "  --no-longpoll          Don't hold a getblocktemplate long poll open (poll for blocks instead)" << std::endl;
+    std::cout << "  --template-refresh N   Without a long poll, refetch the template for new transactions every N seconds, 0 = never (default: 300)" << std::endl;
+    std::cout << "  --no-ntime-roll        Don't keep the header time current while mining one template" << std::endl;
+    std::cout << "  --backend NAME         Mining backend: cpu (default: cpu)" << std::endl;
     std::cout << "  --fast-mode            Use full RandomX dataset (~2GB shared) for 2x hashrate" << std::endl;
+    std::cout << "  --medium-mode MB       Keep MB of the dataset resident, compute the rest (also the fast-mode fallback)" << std::endl;
+    std::cout << "  --huge-pages           Use 2MB huge pages for dataset, cache and scratchpads" << std::endl;
+    std::cout << "  --1gb-pages            Use 1GB huge pages for the dataset (implies --huge-pages)" << std::endl;
+    std::cout << "  --no-huge-page-reserve Don't size the huge page pools per NUMA node as root (report shortfalls only)" << std::endl;
+    std::cout << "  --no-numa-replicas     Fast mode: share one dataset across NUMA nodes (saves 2GB per extra node)" << std::endl;
+    std::cout << "  --cpus LIST            Pin mining threads to these CPUs, e.g. 0-7,16-23 (default: by L3/SMT topology)" << std::endl;
+    std::cout << "  --no-affinity          Do not pin mining threads to CPUs" << std::endl;
+    std::cout << "  --housekeeping-cpus L  Run the non-hashing threads on CPU list L, or auto (one core on 8+ cores)" << std::endl;
+    std::cout << "  --sched-idle           Run mining threads under SCHED_IDLE: only CPU time nothing else wants (Linux)" << std::endl;
+    std::cout << "  --adaptive             Idle and resume mining threads by the host's CPU/memory pressure and steal time" << std::endl;
+    std::cout << "  --adaptive-limits SPEC Limits in percent, e.g. cpu=10,memory=5,steal=5 (the defaults); 0 = ignore (implies --adaptive)" << std::endl;
+    std::cout << "  --adaptive-psi DIR     Read PSI from DIR, e.g. the services' cgroup (default: /proc/pressure)" << std::endl;
+    std::cout << "  --adaptive-signal F:L  Also idle threads while the first number in file F is over L" << std::endl;
+    std::cout << "  --cache-partition      Hold mining threads to the L3 ways their scratchpads need (resctrl, Linux, root)" << std::endl;
+    std::cout << "  --cache-partition-mask M  Fixed L3 way mask in hex instead (implies --cache-partition)" << std::endl;
+    std::cout << "  --cache-partition-mba N   Also limit their memory bandwidth (percent on Intel; implies --cache-partition)" << std::endl;
+    std::cout << "  --power-cap W          Idle mining threads to hold CPU package power under W watts (RAPL, Linux)" << std::endl;
+    std::cout << "  --max-efficiency       Run the thread count with the most hashes per joule (RAPL, Linux)" << std::endl;
+    std::cout << "  --memory-budget MB     RAM for dataset, caches, scratchpads and spare epochs (default: what is free)" << std::endl;
+    std::cout << "  --no-epoch-prefetch    Don't build the next epoch's dataset in the background" << std::endl;
+    std::cout << "  --epoch-memory-mb N    Extra memory for the next epoch (default: auto from free RAM)" << std::endl;
+    std::cout << "  --epoch-retain-mb N    Memory for keeping previous epochs for reorgs, 0 = none (default: auto)" << std::endl;
+    std::cout << "  --dataset-cache DIR    Fast mode: keep built datasets in DIR for quick restarts (default: ~/.cache/juno-miner)" << std::endl;
+    std::cout << "  --no-dataset-cache     Don't load or save datasets on disk" << std::endl;
+    std::cout << "  --no-speculative-init  Don't start building the last run's epoch before the first template" << std::endl;
+    std::cout << "  --dataset-share        Fast mode: share one dataset with other miner processes on this host" << std::endl;
+    std::cout << "  --dataset-serve HOST:PORT  Fast mode or --proxy: build each next epoch ahead and serve the dataset cache to rigs" << std::endl;
+    std::cout << "  --dataset-source URL   Fast mode: download each next epoch from a --dataset-serve builder (http://HOST:PORT)" << std::endl;
+    std::cout << "  --upgrade-socket PATH  Take over from the miner on PATH at startup, then serve it (zero-downtime upgrades)" << std::endl;
+    std::cout << "  --no-light-start       Fast mode: don't mine in light mode while the dataset builds" << std::endl;
+    std::cout << "  --low-memory           Free caches the active mode doesn't use; no prefetch, warm-up or retained epochs" << std::endl;
+    std::cout << "  --no-memory-fallback   Fast/medium mode: don't drop to a smaller dataset under memory pressure" << std::endl;
+    std::cout << "  --lock-dataset         Lock the dataset in RAM (mlock) so it is never swapped out" << std::endl;
+    std::cout << "  --gpu-dataset          Build the fast/medium-mode dataset on a GPU (OpenCL), CPU on failure" << std::endl;
+    std::cout << "  --gpu-device N         GPU for --gpu-dataset, counted over all OpenCL platforms (default: 0)" << std::endl;
+    std::cout << "  --no-pipeline          Disable pipelined hashing (hash one nonce at a time)" << std::endl;
+    std::cout << "  --secure-jit           Never map JIT code writable and executable at once (W^X)" << std::endl;
+    std::cout << "  --jit-profile NAME     JIT code generation profile: auto, generic, skylake, intel, zen, skzen, nta, load" << std::endl;
+    std::cout << "  --soft-aes NAME        Software AES used without AES-NI: auto, table, compact" << std::endl;
+    std::cout << "  --no-scratchpad-coloring  Give each huge-page scratchpad pages of its own (no cache set staggering)" << std::endl;
+    std::cout << "  --msr-profile P        Tune the hardware prefetchers of the mining CPUs (Linux, root): auto, intel," << std::endl;
+    std::cout << "                         ryzen17h, ryzen19h, ryzen19h_zen4, ryzen1ah or REG:VALUE[:MASK],... in hex" << std::endl;
+    std::cout << "  --instance-id N        Rig ID for a disjoint nonce range per rig (default: random)" << std::endl;
+    std::cout << "  --deterministic-nonce  Use a repeatable nonce sequence (for reproducible benchmarks)" << std::endl;
+    std::cout << "  --benchmark            Measure the hashrate offline (no node) on a fixed seed and synthetic header, then exit" << std::endl;
+    std::cout << "  --benchmark-seconds N  Benchmark for N seconds once hashing at full speed (default: 30)" << std::endl;
+    std::cout << "  --benchmark-hashes N   Benchmark until N hashes instead" << std::endl;
+    std::cout << "  --benchmark-json FILE  Also write the benchmark report as JSON to FILE (- = stdout)" << std::endl;
+    std::cout << "  --benchmark-perf       Benchmark with hardware counters: IPC, cache, TLB, DRAM and branch misses (Linux)" << std::endl;
+    std::cout << "  --autotune             Find the best mode, thread count and huge page setting for this host, save it and exit" << std::endl;
+    std::cout << "  --autotune-seconds N   Measure each configuration for N seconds (default: 10)" << std::endl;
+    std::cout << "  --autotune-target T    What --autotune maximizes: hashrate or efficiency (hashes per joule)" << std::endl;
+    std::cout << "  --no-profile           Ignore the profile --autotune saved for this host" << std::endl;
+    std::cout << "  --verify-blocks A-B    Re-verify the proof of work of blocks A to B on the node with all cores, then exit" << std::endl;
+    std::cout << "  --record FILE          Save every node answer and ZMQ block announcement to FILE, timestamped" << std::endl;
+    std::cout << "  --replay FILE          Mine against a --record file instead of a node (benchmarks; blocks are not really submitted)" << std::endl;
+    std::cout << "  --replay-speed X       Play the recording X times faster than it was recorded (default: 1)" << std::endl;
     std::cout << "  --no-balance           Skip wallet balance checks (don't query or display balance)" << std::endl;
     std::cout << "  --debug                Enable debug logging" << std::endl;
     std::cout << "  --log-file FILE        Write debug logs to file (default: juno-miner.log)" << std::endl;
     std::cout << "  --log-console          Write debug logs to console (in addition to UI)" << std::endl;
+    std::cout << "  --metrics HOST:PORT    Serve Prometheus metrics at http://HOST:PORT/metrics" << std::endl;
+    std::cout << "  --control HOST:PORT    Serve the control API (GET /status, POST /control) at http://HOST:PORT" << std::endl;
+    std::cout << "  --control-token TOKEN  Bearer token every control API request must carry (required with --control)" << std::endl;
+    std::cout << "  --trace FILE           Write Chrome/Perfetto timeline traces to FILE, started by SIGUSR2 or the control API" << std::endl;
+    std::cout << "  --trace-seconds N      How long a trace records (default: 10)" << std::endl;
+    std::cout << "  --journal DIR          Keep a binary telemetry journal (hashes per thread per second, switches, power," << std::endl;
+    std::cout << "                         temperature, RPC calls) in DIR; export it with juno-journal" << std::endl;
+    std::cout << "  --journal-segment-mb N Size of each journal file (default: " << JOURNAL_DEFAULT_SEGMENT_MB << ")" << std::endl;
+    std::cout << "  --journal-max-mb N     Delete the oldest journal files past this total (default: " << JOURNAL_DEFAULT_MAX_MB << ")" << std::endl;
+    std::cout << "  --headless             Run as a daemon: no terminal UI, status lines in the log on stdout," << std::endl;
+    std::cout << "                         systemd notifications, SIGHUP reopens the log, SIGUSR1 logs full stats" << std::endl;
+    std::cout << "  --status-interval N    With --headless, log a status line every N seconds (default: 60)" << std::endl;
     std::cout << "  --help                 Show this help message" << std::endl;
     std::cout << std::endl;
     std::cout << "Example:" << std::endl;
@@ -35,6 +123,7 @@ void print_usage(const char* program_name) {
 }
 
 bool parse_config(int argc, char* argv[], MinerConfig& config) {
+    bool rpc_url_given = false;
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
 
@@ -46,7 +135,12 @@ bool parse_config(int argc, char* argv[], MinerConfig& config) {
                 std::cerr << "Error: --rpc-url requires an argument" << std::endl;
                 return false;
             }
-            config.rpc_url = argv[++i];
+            // The first --rpc-url replaces the default, later ones add nodes
+            if (!rpc_url_given) {
+                config.rpc_urls.clear();
+                rpc_url_given = true;
+            }
+            config.rpc_urls.push_back(argv[++i]);
         } else if (arg == "--rpc-user") {
             if (i + 1 >= argc) {
                 std::cerr << "Error: --rpc-user requires an argument" << std::endl;
@@ -59,6 +153,30 @@ bool parse_config(int argc, char* argv[], MinerConfig& config) {
                 return false;
             }
             config.rpc_password = argv[++i];
+        } else if (arg == "--pool") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --pool requires an argument" << std::endl;
+                return false;
+            }
+            config.pool_url = argv[++i];
+        } else if (arg == "--pool-user") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --pool-user requires an argument" << std::endl;
+                return false;
+            }
+            config.pool_user = argv[++i];
+        } else if (arg == "--pool-password") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --pool-password requires an argument" << std::endl;
+                return false;
+            }
+            config.pool_password = argv[++i];
+        } else if (arg == "--proxy") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --proxy requires an argument" << std::endl;
+                return false;
+            }
+            config.proxy_listen = argv[++i];
         } else if (arg == "--threads") {
             if (i + 1 >= argc) {
                 std::cerr << "Error: --threads requires an argument" << std::endl;
@@ -80,6 +198,30 @@ bool parse_config(int argc, char* argv[], MinerConfig& config) {
                 std::cerr << "Error: invalid update interval" << std::endl;
                 return false;
             }
+        } else if (arg == "--share-bits") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --share-bits requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long bits = std::strtoul(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || bits == 0 || bits > 63) {
+                std::cerr << "Error: --share-bits must be between 1 and 63" << std::endl;
+                return false;
+            }
+            config.share_bits = (unsigned int)bits;
+        } else if (arg == "--share-verify") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --share-verify requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long percent = std::strtoul(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || percent > 100) {
+                std::cerr << "Error: --share-verify must be between 0 and 100" << std::endl;
+                return false;
+            }
+            config.share_verify_percent = (unsigned int)percent;
         } else if (arg == "--block-check") {
             if (i + 1 >= argc) {
                 std::cerr << "Error: --block-check requires an argument" << std::endl;
@@ -90,14 +232,419 @@ bool parse_config(int argc, char* argv[], MinerConfig& config) {
                 std::cerr << "Error: invalid block check interval" << std::endl;
                 return false;
             }
+        } else if (arg == "--outage-grace") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --outage-grace requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long seconds = std::strtoul(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0') {
+                std::cerr << "Error: invalid outage grace period" << std::endl;
+                return false;
+            }
+            config.outage_grace_seconds = (unsigned int)seconds;
         } else if (arg == "--zmq-url") {
             if (i + 1 >= argc) {
                 std::cerr << "Error: --zmq-url requires an argument" << std::endl;
                 return false;
             }
             config.zmq_url = argv[++i];
+        } else if (arg == "--spy-url") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --spy-url requires an argument" << std::endl;
+                return false;
+            }
+            config.spy_url = argv[++i];
+        } else if (arg == "--no-longpoll") {
+            config.longpoll = false;
+        } else if (arg == "--template-refresh") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --template-refresh requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long seconds = std::strtoul(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0') {
+                std::cerr << "Error: invalid template refresh interval" << std::endl;
+                return false;
+            }
+            config.template_refresh_seconds = (unsigned int)seconds;
+        } else if (arg == "--benchmark") {
+            config.benchmark = true;
+        } else if (arg == "--benchmark-seconds" || arg == "--benchmark-hashes") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long long value = std::strtoull(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || value == 0) {
+                std::cerr << "Error: invalid " << (arg == "--benchmark-seconds" ? "benchmark duration" : "hash count")
+                          << std::endl;
+                return false;
+            }
+            if (arg == "--benchmark-seconds") {
+                config.benchmark_seconds = (unsigned int)value;
+            } else {
+                config.benchmark_hashes = value;
+            }
+            config.benchmark = true;
+        } else if (arg == "--benchmark-json") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --benchmark-json requires an argument" << std::endl;
+                return false;
+            }
+            config.benchmark_json = argv[++i];
+            config.benchmark = true;
+        } else if (arg == "--benchmark-perf") {
+            config.benchmark_perf = true;
+            config.benchmark = true;
+        } else if (arg == "--autotune") {
+            config.autotune = true;
+        } else if (arg == "--autotune-seconds") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --autotune-seconds requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long seconds = std::strtoul(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || seconds == 0) {
+                std::cerr << "Error: invalid autotune duration" << std::endl;
+                return false;
+            }
+            config.autotune_seconds = (unsigned int)seconds;
+            config.autotune = true;
+        } else if (arg == "--autotune-target") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --autotune-target requires an argument" << std::endl;
+                return false;
+            }
+            std::string target = argv[++i];
+            if (target != "hashrate" && target != "efficiency") {
+                std::cerr << "Error: invalid autotune target (expected hashrate or efficiency)" << std::endl;
+                return false;
+            }
+            config.autotune_efficiency = target == "efficiency";
+            config.autotune = true;
+        } else if (arg == "--no-profile") {
+            config.use_profile = false;
+        } else if (arg == "--verify-blocks") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --verify-blocks requires an argument" << std::endl;
+                return false;
+            }
+            std::string range = argv[++i];
+            size_t dash = range.find('-');
+            char* end = nullptr;
+            config.verify_from = std::strtoull(range.c_str(), &end, 10);
+            bool valid = end != range.c_str() && (dash == std::string::npos ? *end == '\0' : end == range.c_str() + dash);
+            config.verify_to = config.verify_from;
+            if (valid && dash != std::string::npos) {
+                const char* to = range.c_str() + dash + 1;
+                config.verify_to = std::strtoull(to, &end, 10);
+                valid = end != to && *end == '\0';
+            }
+            if (!valid || config.verify_to < config.verify_from) {
+                std::cerr << "Error: invalid block range (expected FROM-TO heights)" << std::endl;
+                return false;
+            }
+            config.verify_blocks = true;
+        } else if (arg == "--record" || arg == "--replay") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument" << std::endl;
+                return false;
+            }
+            (arg == "--record" ? config.record_file : config.replay_file) = argv[++i];
+        } else if (arg == "--replay-speed") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --replay-speed requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            config.replay_speed = std::strtod(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' || !(config.replay_speed > 0)) {
+                std::cerr << "Error: invalid replay speed" << std::endl;
+                return false;
+            }
+        } else if (arg == "--no-ntime-roll") {
+            config.ntime_roll = false;
         } else if (arg == "--fast-mode") {
             config.fast_mode = true;
+        } else if (arg == "--medium-mode") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --medium-mode requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long mb = std::strtoul(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || mb == 0) {
+                std::cerr << "Error: invalid medium mode size" << std::endl;
+                return false;
+            }
+            config.medium_mode_mb = mb;
+        } else if (arg == "--huge-pages") {
+            config.huge_pages = true;
+        } else if (arg == "--1gb-pages") {
+            config.huge_pages = true;
+            config.huge_pages_1gb = true;
+        } else if (arg == "--no-huge-page-reserve") {
+            config.huge_page_reserve = false;
+        } else if (arg == "--no-numa-replicas") {
+            config.numa_replicas = false;
+        } else if (arg == "--cpus") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --cpus requires an argument" << std::endl;
+                return false;
+            }
+            if (!parse_cpu_list(argv[++i], config.cpu_list)) {
+                std::cerr << "Error: invalid CPU list (expected e.g. 0-7,16-23)" << std::endl;
+                return false;
+            }
+        } else if (arg == "--no-affinity") {
+            config.cpu_affinity = false;
+        } else if (arg == "--housekeeping-cpus") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --housekeeping-cpus requires an argument" << std::endl;
+                return false;
+            }
+            std::string list = argv[++i];
+            config.housekeeping_auto = list == "auto";
+            if (!config.housekeeping_auto && !parse_cpu_list(list, config.housekeeping_cpus)) {
+                std::cerr << "Error: invalid CPU list (expected e.g. 0,16 or auto)" << std::endl;
+                return false;
+            }
+        } else if (arg == "--sched-idle") {
+            config.sched_idle = true;
+        } else if (arg == "--adaptive") {
+            config.adaptive = true;
+        } else if (arg == "--adaptive-limits") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --adaptive-limits requires an argument" << std::endl;
+                return false;
+            }
+            // "cpu=10,memory=5,steal=5", any subset
+            std::stringstream spec(argv[++i]);
+            std::string item;
+            while (std::getline(spec, item, ',')) {
+                size_t equals = item.find('=');
+                std::string name = item.substr(0, equals);
+                char* end = nullptr;
+                double value = equals == std::string::npos ? -1 : std::strtod(item.c_str() + equals + 1, &end);
+                double* limit = name == "cpu" ? &config.colocation.cpu_pressure
+                              : name == "memory" ? &config.colocation.memory_pressure
+                              : name == "steal" ? &config.colocation.steal : nullptr;
+                if (!limit || value < 0 || *end != '\0') {
+                    std::cerr << "Error: invalid adaptive limit '" << item << "' (expected cpu=, memory= or steal=PCT)"
+                              << std::endl;
+                    return false;
+                }
+                *limit = value;
+            }
+            config.adaptive = true;
+        } else if (arg == "--adaptive-psi") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --adaptive-psi requires an argument" << std::endl;
+                return false;
+            }
+            config.colocation.psi_dir = argv[++i];
+            config.adaptive = true;
+        } else if (arg == "--adaptive-signal") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --adaptive-signal requires an argument" << std::endl;
+                return false;
+            }
+            std::string signal = argv[++i];
+            size_t colon = signal.rfind(':');
+            char* end = nullptr;
+            double limit = colon == std::string::npos ? 0 : std::strtod(signal.c_str() + colon + 1, &end);
+            if (colon == std::string::npos || colon == 0 || limit <= 0 || *end != '\0') {
+                std::cerr << "Error: invalid adaptive signal (expected FILE:LIMIT)" << std::endl;
+                return false;
+            }
+            config.colocation.signal_path = signal.substr(0, colon);
+            config.colocation.signal_limit = limit;
+            config.adaptive = true;
+        } else if (arg == "--cache-partition") {
+            config.cache_partition = true;
+        } else if (arg == "--cache-partition-mask") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --cache-partition-mask requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long long mask = std::strtoull(argv[++i], &end, 16);
+            if (end == argv[i] || *end != '\0' || mask == 0) {
+                std::cerr << "Error: invalid L3 way mask (expected hex, e.g. 7f0)" << std::endl;
+                return false;
+            }
+            config.partition.l3_mask = mask;
+            config.cache_partition = true;
+        } else if (arg == "--cache-partition-mba") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --cache-partition-mba requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long mba = std::strtoul(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || mba == 0) {
+                std::cerr << "Error: invalid memory bandwidth limit" << std::endl;
+                return false;
+            }
+            config.partition.mba = (unsigned int)mba;
+            config.cache_partition = true;
+        } else if (arg == "--power-cap") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --power-cap requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            double watts = std::strtod(argv[++i], &end);
+            if (watts <= 0 || *end != '\0') {
+                std::cerr << "Error: invalid power cap (expected watts)" << std::endl;
+                return false;
+            }
+            config.power.cap_watts = watts;
+        } else if (arg == "--max-efficiency") {
+            config.power.efficiency = true;
+        } else if (arg == "--memory-budget") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --memory-budget requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long mb = std::strtoul(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || mb == 0) {
+                std::cerr << "Error: invalid memory budget" << std::endl;
+                return false;
+            }
+            config.memory_budget_mb = mb;
+        } else if (arg == "--no-epoch-prefetch") {
+            config.epoch_prefetch = false;
+        } else if (arg == "--epoch-memory-mb") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --epoch-memory-mb requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long mb = std::strtoul(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0') {
+                std::cerr << "Error: invalid memory budget" << std::endl;
+                return false;
+            }
+            config.epoch_memory_mb = mb;
+        } else if (arg == "--epoch-retain-mb") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --epoch-retain-mb requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long mb = std::strtoul(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0') {
+                std::cerr << "Error: invalid memory budget" << std::endl;
+                return false;
+            }
+            config.epoch_retain_mb = mb;
+            config.epoch_retain_auto = false;
+        } else if (arg == "--dataset-cache") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --dataset-cache requires an argument" << std::endl;
+                return false;
+            }
+            config.dataset_cache_dir = argv[++i];
+            config.dataset_cache = true;
+        } else if (arg == "--no-dataset-cache") {
+            config.dataset_cache = false;
+        } else if (arg == "--no-speculative-init") {
+            config.speculative_init = false;
+        } else if (arg == "--dataset-share") {
+            config.dataset_share = true;
+        } else if (arg == "--dataset-serve") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --dataset-serve requires an argument" << std::endl;
+                return false;
+            }
+            config.dataset_serve = argv[++i];
+        } else if (arg == "--dataset-source") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --dataset-source requires an argument" << std::endl;
+                return false;
+            }
+            config.dataset_source = argv[++i];
+        } else if (arg == "--upgrade-socket") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --upgrade-socket requires an argument" << std::endl;
+                return false;
+            }
+            config.upgrade_socket = argv[++i];
+        } else if (arg == "--no-light-start") {
+            config.light_start = false;
+        } else if (arg == "--low-memory") {
+            config.low_memory = true;
+        } else if (arg == "--no-memory-fallback") {
+            config.memory_fallback = false;
+        } else if (arg == "--lock-dataset") {
+            config.lock_dataset = true;
+        } else if (arg == "--gpu-dataset") {
+            config.gpu_dataset = true;
+        } else if (arg == "--gpu-device") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --gpu-device requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long device = std::strtoul(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || device > 255) {
+                std::cerr << "Error: invalid GPU device" << std::endl;
+                return false;
+            }
+            config.gpu_device = device;
+            config.gpu_dataset = true;
+        } else if (arg == "--no-pipeline") {
+            config.pipelined_hashing = false;
+        } else if (arg == "--secure-jit") {
+            config.secure_jit = true;
+        } else if (arg == "--backend") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --backend requires an argument" << std::endl;
+                return false;
+            }
+            config.backend = argv[++i];
+        } else if (arg == "--jit-profile") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --jit-profile requires an argument" << std::endl;
+                return false;
+            }
+            config.jit_profile = argv[++i];
+        } else if (arg == "--soft-aes") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --soft-aes requires an argument" << std::endl;
+                return false;
+            }
+            config.soft_aes = argv[++i];
+        } else if (arg == "--no-scratchpad-coloring") {
+            config.scratchpad_coloring = false;
+        } else if (arg == "--msr-profile") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --msr-profile requires an argument" << std::endl;
+                return false;
+            }
+            config.msr_profile = argv[++i];
+        } else if (arg == "--instance-id") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --instance-id requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long id = std::strtoul(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || id > 0xffffffffUL) {
+                std::cerr << "Error: invalid instance ID" << std::endl;
+                return false;
+            }
+            config.instance_id = static_cast<unsigned int>(id);
+            config.auto_instance_id = false;
+        } else if (arg == "--deterministic-nonce") {
+            config.deterministic_nonce = true;
         } else if (arg == "--no-balance") {
             config.no_balance = true;
         } else if (arg == "--debug") {
@@ -113,6 +660,70 @@ bool parse_config(int argc, char* argv[], MinerConfig& config) {
             config.log_file = argv[++i];
         } else if (arg == "--log-console") {
             config.log_to_console = true;
+        } else if (arg == "--headless") {
+            config.headless = true;
+        } else if (arg == "--status-interval") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --status-interval requires an argument" << std::endl;
+                return false;
+            }
+            config.status_interval_seconds = std::atoi(argv[++i]);
+            if (config.status_interval_seconds == 0) {
+                std::cerr << "Error: invalid status interval" << std::endl;
+                return false;
+            }
+        } else if (arg == "--metrics") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --metrics requires an argument" << std::endl;
+                return false;
+            }
+            config.metrics_listen = argv[++i];
+        } else if (arg == "--control") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --control requires an argument" << std::endl;
+                return false;
+            }
+            config.control_listen = argv[++i];
+        } else if (arg == "--control-token") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --control-token requires an argument" << std::endl;
+                return false;
+            }
+            config.control_token = argv[++i];
+        } else if (arg == "--trace") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --trace requires an argument" << std::endl;
+                return false;
+            }
+            config.trace_file = argv[++i];
+        } else if (arg == "--trace-seconds") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --trace-seconds requires an argument" << std::endl;
+                return false;
+            }
+            config.trace_seconds = std::atoi(argv[++i]);
+            if (config.trace_seconds == 0 || config.trace_seconds > TRACE_MAX_SECONDS) {
+                std::cerr << "Error: --trace-seconds must be from 1 to " << TRACE_MAX_SECONDS << std::endl;
+                return false;
+            }
+        } else if (arg == "--journal") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --journal requires an argument" << std::endl;
+                return false;
+            }
+            config.journal_dir = argv[++i];
+        } else if (arg == "--journal-segment-mb" || arg == "--journal-max-mb") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            unsigned long long mb = std::strtoull(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || mb == 0) {
+                std::cerr << "Error: " << arg << " must be a size in MB" << std::endl;
+                return false;
+            }
+            (arg == "--journal-segment-mb" ? config.journal_segment_mb : config.journal_max_mb) = mb;
         } else {
             std::cerr << "Error: unknown option: " << arg << std::endl;
             std::cerr << "Use --help for usage information" << std::endl;
@@ -120,5 +731,37 @@ bool parse_config(int argc, char* argv[], MinerConfig& config) {
         }
     }
 
+    if (config.adaptive && config.power.controls()) {
+        std::cerr << "Error: --adaptive and --power-cap/--max-efficiency both set the active thread count; use one"
+                  << std::endl;
+        return false;
+    }
+
+    if (!config.spy_url.empty() && config.zmq_url.empty() && config.replay_file.empty()) {
+        std::cerr << "Error: --spy-url acts on block announcements and needs --zmq-url" << std::endl;
+        return false;
+    }
+
+    if (!config.control_listen.empty() && config.control_token.empty()) {
+        std::cerr << "Error: --control changes how the miner runs and needs --control-token" << std::endl;
+        return false;
+    }
+
+    if ((!config.dataset_serve.empty() || !config.dataset_source.empty()) && !config.dataset_cache) {
+        std::cerr << "Error: --dataset-serve and --dataset-source keep epochs in the dataset cache; "
+                     "drop --no-dataset-cache" << std::endl;
+        return false;
+    }
+
+    if (!config.journal_dir.empty() && !TelemetryJournal::supported()) {
+        std::cerr << "Error: --journal isn't supported on Windows" << std::endl;
+        return false;
+    }
+
+    if (!config.record_file.empty() && !config.replay_file.empty()) {
+        std::cerr << "Error: --record and --replay can't be used together" << std::endl;
+        return false;
+    }
+
     return true;
 }
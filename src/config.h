@@ -2,10 +2,16 @@
 #define CONFIG_H
 
 #include <string>
+#include <vector>
+#include "colocation_governor.h"
+#include "cache_partition.h"
+#include "power_governor.h"
+#include "telemetry_journal.h"
 
 struct MinerConfig {
-    // RPC connection
-    std::string rpc_url;
+    // RPC connection: one or more nodes sharing the credentials, the first
+    // preferred (templates race between them, see main.cpp)
+    std::vector<std::string> rpc_urls;
     std::string rpc_user;
     std::string rpc_password;
 
@@ -19,34 +25,297 @@ struct MinerConfig {
     // Block check interval (how often to check for new blocks)
     unsigned int block_check_interval_seconds;
 
+    // While no node answers, keep mining the last template (usually still
+    // the tip) for this long before stopping, and keep retrying found blocks
+    // for as long; 0 stops at once
+    unsigned int outage_grace_seconds;
+
     // Debug and logging
     bool debug_mode;
     std::string log_file;
     bool log_to_console;
 
+    // Serve Prometheus metrics on this host:port (see MetricsServer), empty = off
+    std::string metrics_listen;
+
+    // Serve the control API on this host:port (see ControlServer), empty =
+    // off; every request needs control_token as a bearer token
+    std::string control_listen;
+    std::string control_token;
+
+    // Write timeline traces here (see TraceRecorder), empty = off. A trace
+    // is started by SIGUSR2 or the control API and lasts trace_seconds.
+    std::string trace_file;
+    unsigned int trace_seconds;
+
+    // Keep a binary telemetry journal here (see TelemetryJournal), empty =
+    // off, in files of journal_segment_mb up to journal_max_mb in all
+    std::string journal_dir;
+    uint64_t journal_segment_mb;
+    uint64_t journal_max_mb;
+
+    // Daemon mode: no terminal UI or keyboard; a status line is logged to
+    // stdout every status_interval_seconds instead, and SIGHUP/SIGUSR1 take
+    // the place of keys
+    bool headless;
+    unsigned int status_interval_seconds;
+
+    // Mining backend (see create_mining_backend), empty = cpu
+    std::string backend;
+
     // RandomX mode
     bool fast_mode;  // Use full dataset (~2GB shared) for 2x hashrate
 
+    // Back dataset, cache and scratchpads with huge pages (hugetlbfs, then THP)
+    bool huge_pages;
+    // Back the fast-mode dataset with 1GB hugetlbfs pages (falls back to 2MB, then normal pages)
+    bool huge_pages_1gb;
+    // Running as root, raise the per-node hugetlb pools to what the miner will allocate (HugePageManager)
+    bool huge_page_reserve;
+
+    // Fast mode on NUMA systems: one dataset replica per node (2GB each) instead of one shared dataset
+    bool numa_replicas;
+
+    // Explicit CPUs for the mining threads (empty = L3/SMT-aware automatic placement)
+    std::vector<int> cpu_list;
+    bool cpu_affinity;  // Pin mining threads to CPUs (default: true)
+    bool sched_idle;    // Mining threads under SCHED_IDLE (Linux)
+    // CPUs for the threads that don't hash, which mining threads then avoid
+    // (empty and not auto = none)
+    bool housekeeping_auto;
+    std::vector<int> housekeeping_cpus;
+
+    // Co-location: idle and resume workers by host pressure (see ColocationGovernor)
+    bool adaptive;
+    ColocationLimits colocation;
+    // Hold the mining workers to their own L3 ways (resctrl)
+    bool cache_partition;
+    CachePartitionConfig partition;
+
+    // Package power: hold a cap or the most hashes per joule by the worker
+    // count (see PowerGovernor)
+    PowerLimits power;
+
+    // RAM for all RandomX memory (see MemoryPlanner), 0 = what is available at startup
+    size_t memory_budget_mb;
+
+    // Build the next epoch's cache/dataset in the background (randomxnextseedhash)
+    bool epoch_prefetch;
+    size_t epoch_memory_mb;  // Extra memory allowed for it, 0 = auto
+    // Previous epochs kept resident for reorgs across the boundary
+    bool epoch_retain_auto;
+    size_t epoch_retain_mb;  // Used when !epoch_retain_auto, 0 = keep none
+
+    // Fast mode: keep built epochs on disk so restarts skip dataset generation
+    bool dataset_cache;
+    std::string dataset_cache_dir;  // Empty = ~/.cache/juno-miner
+    // Start building the last seed's epoch (saved in that directory) while
+    // connecting, before the first template confirms it
+    bool speculative_init;
+
+    // Fast mode: share one dataset per epoch between miner processes on the host
+    bool dataset_share;
+    // Fleet dataset distribution: serve the dataset cache directory on this
+    // host:port, with the next epoch written there ahead of time (see
+    // DatasetServer); and download epochs from such a server (see
+    // DatasetFetcher). Empty = off.
+    std::string dataset_serve;
+    std::string dataset_source;
+
+    // Unix socket for zero-downtime upgrades (take over from / hand over to), empty = off
+    std::string upgrade_socket;
+
+    // Fast mode: mine in light mode while a dataset builds
+    bool light_start;
+
+    // Medium mode: MB of the dataset kept resident in light mode, 0 = off
+    size_t medium_mode_mb;
+
+    // Free every allocation the active mode doesn't hash from (small rigs)
+    bool low_memory;
+
+    // Fast/medium mode: step down to a smaller dataset under memory pressure
+    bool memory_fallback;
+    // mlock() the dataset so it can't be swapped out
+    bool lock_dataset;
+
+    // Build datasets on an OpenCL GPU (index over all platforms) instead of the CPU
+    bool gpu_dataset;
+    unsigned int gpu_device;
+
+    // Pipelined hashing (overlap next nonce's setup with current hash)
+    bool pipelined_hashing;
+
+    // JIT code pages never writable and executable at once (RANDOMX_FLAG_SECURE)
+    bool secure_jit;
+
+    // x86 JIT code generation profile for A/B testing (empty = chosen from CPUID)
+    std::string jit_profile;
+
+    // Software AES implementation when the CPU has no AES-NI (empty = default)
+    std::string soft_aes;
+
+    // Stagger huge-page scratchpads across cache sets (randomx_set_scratchpad_coloring)
+    bool scratchpad_coloring;
+
+    // Hardware prefetcher MSRs on the mining CPUs: a preset, "auto" or custom writes (empty = leave them)
+    std::string msr_profile;
+
+    // Nonce partitioning
+    unsigned int instance_id;   // Rig ID, gives each rig a disjoint nonce range
+    bool auto_instance_id;      // True = random instance ID
+    bool deterministic_nonce;   // Repeatable nonce sequence (benchmarks)
+
     // Skip wallet balance checking
     bool no_balance;
 
     // ZMQ for instant block notifications
     std::string zmq_url;  // e.g., "tcp://127.0.0.1:28332"
+    // Node with an empty mempool whose coinbase-only template is mined from a
+    // block announcement until the full one arrives (empty = off)
+    std::string spy_url;
+
+    // Hold a getblocktemplate long poll open so the node pushes new templates
+    bool longpoll;
+    // Without a long poll, refetch the current tip's template this often for
+    // new transactions (0 = only on a new block)
+    unsigned int template_refresh_seconds;
+    // Roll the header's nTime forward in place while a template is mined
+    bool ntime_roll;
+
+    // Mine for a stratum pool instead of a node (see StratumClient), empty = node
+    std::string pool_url;
+    std::string pool_user;      // Pool login, usually the payout address
+    std::string pool_password;
+
+    // Serve the node's work to rigs on this host:port instead of mining (see WorkProxy)
+    std::string proxy_listen;
+
+    // Pseudo-shares: hashes with this many leading zero bits are counted to
+    // estimate the effective hashrate (one per 2^share_bits hashes), 0 = off.
+    // In proxy mode rigs are sent this target and report each share.
+    unsigned int share_bits;
+    // Proxy mode: percentage of pseudo-shares whose hash is recomputed
+    // (block candidates always are)
+    unsigned int share_verify_percent;
+
+    // Node traffic (see TrafficRecorder, TrafficReplay): save it to
+    // record_file, or answer RPC from replay_file at replay_speed instead of
+    // talking to a node
+    std::string record_file;
+    std::string replay_file;
+    double replay_speed;
+
+    // Offline benchmark (--benchmark): hash a synthetic header on a fixed
+    // seed for benchmark_seconds, or until benchmark_hashes when set, and
+    // report; benchmark_json also writes the report as JSON ("-" = stdout)
+    bool benchmark;
+    unsigned int benchmark_seconds;
+    uint64_t benchmark_hashes;
+    std::string benchmark_json;
+    bool benchmark_perf;  // Also count hardware events per worker (Linux perf)
+
+    // --autotune: benchmark modes, thread counts and huge pages for
+    // autotune_seconds each and save the best as this host's profile;
+    // use_profile: start from the saved profile (see apply_tune_profile)
+    bool autotune;
+    unsigned int autotune_seconds;
+    bool autotune_efficiency;  // Tune for hashes per joule instead of hashrate
+    bool use_profile;
+
+    // --verify-blocks FROM-TO: re-check the proof of work of those blocks
+    // on the node with every core, report blocks per second and exit
+    bool verify_blocks;
+    uint64_t verify_from;
+    uint64_t verify_to;
 
     MinerConfig()
-        : rpc_url("http://127.0.0.1:8232")
+        : rpc_urls(1, "http://127.0.0.1:8232")
         , rpc_user("")
         , rpc_password("")
         , num_threads(0)
         , auto_threads(true)
         , update_interval_seconds(5)
         , block_check_interval_seconds(2)
+        , outage_grace_seconds(120)
         , debug_mode(false)
         , log_file("")
         , log_to_console(false)
+        , metrics_listen("")
+        , control_listen("")
+        , control_token("")
+        , trace_file("")
+        , trace_seconds(10)
+        , journal_dir("")
+        , journal_segment_mb(JOURNAL_DEFAULT_SEGMENT_MB)
+        , journal_max_mb(JOURNAL_DEFAULT_MAX_MB)
+        , headless(false)
+        , status_interval_seconds(60)
+        , backend("")
         , fast_mode(false)
+        , huge_pages(false)
+        , huge_pages_1gb(false)
+        , huge_page_reserve(true)
+        , numa_replicas(true)
+        , cpu_affinity(true)
+        , sched_idle(false)
+        , housekeeping_auto(false)
+        , adaptive(false)
+        , cache_partition(false)
+        , memory_budget_mb(0)
+        , epoch_prefetch(true)
+        , epoch_memory_mb(0)
+        , epoch_retain_auto(true)
+        , epoch_retain_mb(0)
+        , dataset_cache(true)
+        , speculative_init(true)
+        , dataset_share(false)
+        , dataset_serve("")
+        , dataset_source("")
+        , upgrade_socket("")
+        , light_start(true)
+        , medium_mode_mb(0)
+        , low_memory(false)
+        , memory_fallback(true)
+        , lock_dataset(false)
+        , gpu_dataset(false)
+        , gpu_device(0)
+        , pipelined_hashing(true)
+        , secure_jit(false)
+        , jit_profile("")
+        , soft_aes("")
+        , scratchpad_coloring(true)
+        , msr_profile("")
+        , instance_id(0)
+        , auto_instance_id(true)
+        , deterministic_nonce(false)
         , no_balance(false)
-        , zmq_url("") {}
+        , zmq_url("")
+        , spy_url("")
+        , longpoll(true)
+        , template_refresh_seconds(300)
+        , ntime_roll(true)
+        , pool_url("")
+        , pool_user("")
+        , pool_password("")
+        , proxy_listen("")
+        , share_bits(0)
+        , share_verify_percent(100)
+        , record_file("")
+        , replay_file("")
+        , replay_speed(1.0)
+        , benchmark(false)
+        , benchmark_seconds(30)
+        , benchmark_hashes(0)
+        , benchmark_json("")
+        , benchmark_perf(false)
+        , autotune(false)
+        , autotune_seconds(10)
+        , autotune_efficiency(false)
+        , use_profile(true)
+        , verify_blocks(false)
+        , verify_from(0)
+        , verify_to(0) {}
 };
 
 bool parse_config(int argc, char* argv[], MinerConfig& config);
@@ -0,0 +1,407 @@
+#include "control_server.h"
+#include "cpu_topology.h"
+#include "logger.h"
+#include "utils.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+std::string lowercase(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+    return text;
+}
+
+// The value of a header in a request's header block, empty if it isn't there
+std::string header_value(const std::string& headers, const std::string& name) {
+    std::istringstream lines(headers);
+    std::string line;
+    std::getline(lines, line);  // Request line
+    const std::string wanted = lowercase(name) + ":";
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (lowercase(line.substr(0, wanted.size())) == wanted) {
+            size_t start = line.find_first_not_of(" \t", wanted.size());
+            return start == std::string::npos ? std::string() : line.substr(start);
+        }
+    }
+    return std::string();
+}
+
+// Compared in constant time, so the token can't be guessed a byte at a time
+bool same_secret(const std::string& a, const std::string& b) {
+    unsigned char diff = a.size() == b.size() ? 0 : 1;
+    for (size_t i = 0; i < a.size(); i++) {
+        diff |= (unsigned char)(a[i] ^ b[i % std::max<size_t>(1, b.size())]);
+    }
+    return diff == 0;
+}
+
+std::string render(const Json::Value& value) {
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    return Json::writeString(writer, value) + "\n";
+}
+
+std::string error_body(const std::string& error) {
+    Json::Value body;
+    body["ok"] = false;
+    body["error"] = error;
+    return render(body);
+}
+
+}  // namespace
+
+bool parse_control_request(const std::string& body, ControlRequest& request, std::string& error) {
+    Json::CharReaderBuilder builder;
+    Json::Value root;
+    std::string errors;
+    std::istringstream in(body);
+    if (!Json::parseFromStream(builder, in, &root, &errors) || !root.isObject()) {
+        error = "the body must be a JSON object";
+        return false;
+    }
+    for (const std::string& key : root.getMemberNames()) {
+        if (key != "threads" && key != "cpus" && key != "throttle" && key != "mode" && key != "medium_mb" &&
+            key != "upstream" && key != "trace") {
+            error = "unknown field '" + key + "'";
+            return false;
+        }
+    }
+    if (root.isMember("threads")) {
+        const Json::Value& threads = root["threads"];
+        if (!threads.isUInt() || threads.asUInt() < 1 || threads.asUInt() > CONTROL_MAX_THREADS) {
+            error = "threads must be a number from 1 to " + std::to_string(CONTROL_MAX_THREADS);
+            return false;
+        }
+        request.set_threads = true;
+        request.threads = threads.asUInt();
+    }
+    if (root.isMember("cpus")) {
+        const Json::Value& cpus = root["cpus"];
+        request.cpus.clear();
+        if (!cpus.isString() ||
+            (cpus.asString() != "" && cpus.asString() != "auto" && !parse_cpu_list(cpus.asString(), request.cpus))) {
+            error = "cpus must be a CPU list like \"0-7,16\", or \"auto\"";
+            return false;
+        }
+        request.set_cpus = true;
+    }
+    if (root.isMember("throttle")) {
+        const Json::Value& throttle = root["throttle"];
+        if (!throttle.isUInt() || throttle.asUInt() < 1 || throttle.asUInt() > 100) {
+            error = "throttle must be a percentage from 1 to 100";
+            return false;
+        }
+        request.set_throttle = true;
+        request.throttle = throttle.asUInt();
+    }
+    if (root.isMember("mode")) {
+        const std::string mode = root["mode"].isString() ? lowercase(root["mode"].asString()) : std::string();
+        const Json::Value& medium_mb = root["medium_mb"];
+        if (mode == "fast" || mode == "light") {
+            request.mode = MiningMode(mode == "fast");
+        } else if (mode == "medium" && medium_mb.isUInt() && medium_mb.asUInt() > 0) {
+            request.mode = MiningMode(false, medium_mb.asUInt());
+        } else {
+            error = mode == "medium" ? "medium mode needs medium_mb, the MB of dataset to keep"
+                                     : "mode must be fast, medium or light";
+            return false;
+        }
+        request.set_mode = true;
+    } else if (root.isMember("medium_mb")) {
+        error = "medium_mb goes with \"mode\": \"medium\"";
+        return false;
+    }
+    if (root.isMember("upstream")) {
+        const Json::Value& upstream = root["upstream"];
+        if (upstream.isUInt()) {
+            request.upstream = std::to_string(upstream.asUInt());
+        } else if (upstream.isString() && !upstream.asString().empty()) {
+            request.upstream = upstream.asString();
+        } else {
+            error = "upstream must be a node URL or its index";
+            return false;
+        }
+    }
+    if (root.isMember("trace")) {
+        const Json::Value& trace = root["trace"];
+        if (trace.isUInt() && trace.asUInt() >= 1 && trace.asUInt() <= TRACE_MAX_SECONDS) {
+            request.trace_seconds = trace.asUInt();
+        } else if (!(trace.isString() && lowercase(trace.asString()) == "epoch")) {
+            error = "trace must be a number of seconds from 1 to " + std::to_string(TRACE_MAX_SECONDS) +
+                    ", or \"epoch\"";
+            return false;
+        }
+        request.set_trace = true;
+    }
+    if (!request.set_threads && !request.set_cpus && !request.set_throttle && !request.set_mode &&
+        request.upstream.empty() && !request.set_trace) {
+        error = "nothing to change (threads, cpus, throttle, mode, upstream, trace)";
+        return false;
+    }
+    return true;
+}
+
+ControlServer::ControlServer(const std::string& token, std::function<void()> wake)
+    : token_(token), wake_(std::move(wake)), listen_fd_(-1), stop_(false), next_id_(1) {}
+
+ControlServer::~ControlServer() {
+    stop();
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+    }
+}
+
+bool ControlServer::listen(const std::string& address, std::string& error) {
+    listen_fd_ = utils::listen_tcp(address, error);
+    return listen_fd_ >= 0;
+}
+
+void ControlServer::start() {
+    if (!thread_.joinable() && listen_fd_ >= 0) {
+        thread_ = std::thread(&ControlServer::run, this);
+    }
+}
+
+void ControlServer::stop() {
+    stop_ = true;
+    events_.wake();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void ControlServer::publish_status(const Json::Value& status) {
+    std::string body = render(status);
+    std::lock_guard<std::mutex> lock(mutex_);
+    status_.swap(body);
+}
+
+bool ControlServer::take(ControlRequest& request) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (requests_.empty()) {
+        return false;
+    }
+    request = requests_.front();
+    requests_.pop_front();
+    return true;
+}
+
+void ControlServer::answer(uint64_t id, bool ok, const std::string& error, const std::vector<std::string>& changes) {
+    Json::Value body;
+    body["ok"] = ok;
+    if (!ok) {
+        body["error"] = error;
+    }
+    body["changes"] = Json::Value(Json::arrayValue);
+    for (const std::string& change : changes) {
+        body["changes"].append(change);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        answers_[id] = std::make_pair(ok, render(body));
+    }
+    events_.wake();
+}
+
+void ControlServer::run() {
+    while (!stop_.load()) {
+        // Connections waiting on the main loop aren't watched: the answer wakes the loop
+        std::vector<int> fds(1, listen_fd_);
+        for (const Connection& connection : connections_) {
+            if (!connection.waiting) {
+                fds.push_back(connection.fd);
+            }
+        }
+        events_.watch_fds(fds);
+        events_.wait(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+
+        accept_connections();
+        auto now = std::chrono::steady_clock::now();
+        for (Connection& connection : connections_) {
+            bool open = true;
+            if (connection.waiting) {
+                std::pair<bool, std::string> answer;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    auto found = answers_.find(connection.waiting);
+                    if (found != answers_.end()) {
+                        answer.swap(found->second);
+                        answers_.erase(found);
+                    }
+                }
+                if (!answer.second.empty()) {
+                    send_response(connection, answer.first ? "200 OK" : "409 Conflict", answer.second);
+                    open = false;
+                } else if (now - connection.opened >= std::chrono::seconds(CONTROL_APPLY_TIMEOUT_SECONDS)) {
+                    send_response(connection, "504 Gateway Timeout", error_body("still being applied"));
+                    open = false;
+                }
+            } else {
+                open = read_request(connection) &&
+                       now - connection.opened < std::chrono::seconds(CONTROL_REQUEST_TIMEOUT_SECONDS);
+            }
+            if (!open) {
+                close(connection.fd);
+                connection.fd = -1;
+            }
+        }
+        connections_.erase(std::remove_if(connections_.begin(), connections_.end(),
+                                          [](const Connection& connection) { return connection.fd < 0; }),
+                           connections_.end());
+    }
+    for (const Connection& connection : connections_) {
+        close(connection.fd);
+    }
+    connections_.clear();
+}
+
+void ControlServer::accept_connections() {
+    for (;;) {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            return;  // EAGAIN: nobody else waiting
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        timeval timeout;
+        timeout.tv_sec = CONTROL_REQUEST_TIMEOUT_SECONDS;
+        timeout.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        Connection connection;
+        connection.fd = fd;
+        connection.opened = std::chrono::steady_clock::now();
+        connection.waiting = 0;
+        connections_.push_back(std::move(connection));
+    }
+}
+
+bool ControlServer::read_request(Connection& connection) {
+    char buffer[2048];
+    for (;;) {
+        ssize_t n = recv(connection.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        connection.request.append(buffer, n);
+        if (connection.request.size() > CONTROL_MAX_REQUEST) {
+            send_response(connection, "413 Payload Too Large", error_body("request too large"));
+            return false;
+        }
+    }
+    size_t header_end = connection.request.find("\r\n\r\n");
+    size_t separator = 4;
+    if (header_end == std::string::npos) {
+        header_end = connection.request.find("\n\n");
+        separator = 2;
+    }
+    if (header_end == std::string::npos) {
+        return true;
+    }
+    const std::string length = header_value(connection.request.substr(0, header_end), "Content-Length");
+    if (connection.request.size() < header_end + separator + std::strtoul(length.c_str(), nullptr, 10)) {
+        return true;  // The rest of the body is still on its way
+    }
+    return handle(connection, header_end);
+}
+
+bool ControlServer::authorized(const std::string& headers) const {
+    const std::string authorization = header_value(headers, "Authorization");
+    return lowercase(authorization.substr(0, 7)) == "bearer " && same_secret(authorization.substr(7), token_);
+}
+
+bool ControlServer::handle(Connection& connection, size_t header_end) {
+    const std::string headers = connection.request.substr(0, header_end);
+    std::istringstream request_line(headers.substr(0, headers.find('\n')));
+    std::string method;
+    std::string target;
+    request_line >> method >> target;
+    const std::string path = target.substr(0, target.find('?'));
+
+    if (!authorized(headers)) {
+        LOG_WARNING("Control: request without the right token refused");
+        send_response(connection, "401 Unauthorized", error_body("missing or wrong bearer token"),
+                      "WWW-Authenticate: Bearer\r\n");
+        return false;
+    }
+    if (path == "/status") {
+        if (method != "GET") {
+            send_response(connection, "405 Method Not Allowed", error_body("GET /status"), "Allow: GET\r\n");
+            return false;
+        }
+        std::string body;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            body = status_;
+        }
+        if (body.empty()) {
+            send_response(connection, "503 Service Unavailable", error_body("not mining yet"));
+        } else {
+            send_response(connection, "200 OK", body);
+        }
+        return false;
+    }
+    if (path != "/control") {
+        send_response(connection, "404 Not Found", error_body("GET /status or POST /control"));
+        return false;
+    }
+    if (method != "POST") {
+        send_response(connection, "405 Method Not Allowed", error_body("POST /control"), "Allow: POST\r\n");
+        return false;
+    }
+
+    const size_t body_start = connection.request.compare(header_end, 4, "\r\n\r\n") == 0 ? header_end + 4
+                                                                                          : header_end + 2;
+    ControlRequest request;
+    std::string error;
+    if (!parse_control_request(connection.request.substr(body_start), request, error)) {
+        send_response(connection, "400 Bad Request", error_body(error));
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        request.id = next_id_++;
+        requests_.push_back(request);
+    }
+    connection.waiting = request.id;
+    connection.opened = std::chrono::steady_clock::now();
+    if (wake_) {
+        wake_();
+    }
+    return true;
+}
+
+void ControlServer::send_response(Connection& connection, const std::string& status, const std::string& body,
+                                  const std::string& extra_headers) {
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\nContent-Type: application/json\r\n" << extra_headers
+             << "Content-Length: " << body.size() << "\r\nConnection: close\r\n\r\n" << body;
+    std::string data = response.str();
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(connection.fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            LOG_DEBUG_STREAM("Control: response dropped: " << std::strerror(errno));
+            return;
+        }
+        sent += n;
+    }
+}
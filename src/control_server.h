@@ -0,0 +1,123 @@
+#ifndef CONTROL_SERVER_H
+#define CONTROL_SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <json/json.h>
+#include "event_loop.h"
+#include "memory_governor.h"
+#include "trace_recorder.h"
+
+// Connections that haven't sent a whole request by then are dropped
+static const int CONTROL_REQUEST_TIMEOUT_SECONDS = 5;
+// A change the main loop hasn't answered by then gets a 504; it may still
+// be applied (a mode change rebuilds the dataset)
+static const int CONTROL_APPLY_TIMEOUT_SECONDS = 600;
+static const size_t CONTROL_MAX_REQUEST = 16384;
+static const unsigned int CONTROL_MAX_THREADS = 1024;
+
+// One change asked for with POST /control; only what the body names changes
+struct ControlRequest {
+    uint64_t id;
+    bool set_threads;
+    unsigned int threads;       // Threads to hash on
+    bool set_cpus;
+    std::vector<int> cpus;      // Empty = automatic placement
+    bool set_throttle;
+    unsigned int throttle;      // Percent of those threads that hash
+    bool set_mode;
+    MiningMode mode;
+    std::string upstream;       // One of the --rpc-url nodes, by URL or index; empty = unchanged
+    bool set_trace;
+    unsigned int trace_seconds; // Trace for this long from now; 0 = the next epoch change (see TraceRecorder)
+
+    ControlRequest()
+        : id(0), set_threads(false), threads(0), set_cpus(false), set_throttle(false), throttle(100)
+        , set_mode(false), set_trace(false), trace_seconds(0) {}
+};
+
+// Parse a POST /control body; false with error set if it isn't a valid change
+bool parse_control_request(const std::string& body, ControlRequest& request, std::string& error);
+
+// The local control API (--control): lets an orchestrator read the miner's
+// state, change its threads, CPUs, throttle, mode and node without a
+// keypress or a restart, and start a trace (--trace). Plain HTTP with JSON
+// bodies from its own thread, every request authenticated with
+// "Authorization: Bearer TOKEN":
+//   GET /status     the JSON the main loop published last (publish_status)
+//   POST /control   a ControlRequest, queued for the main loop (take), which
+//                   applies it and answers (answer); the connection is held
+//                   open until then
+// The server never touches the backend itself: changes are made by the main
+// loop between hashes, the same way the keyboard and the governors make them.
+class ControlServer {
+public:
+    // wake: called when a request is queued, to get the main loop to take it
+    ControlServer(const std::string& token, std::function<void()> wake);
+    ~ControlServer();
+
+    ControlServer(const ControlServer&) = delete;
+    ControlServer& operator=(const ControlServer&) = delete;
+
+    // Listen on host:port (host may be empty or 0.0.0.0 for every interface).
+    // False with error set if the socket can't be bound.
+    bool listen(const std::string& address, std::string& error);
+    void start();
+    void stop();
+    bool running() const { return thread_.joinable(); }
+
+    // The body GET /status returns from now on
+    void publish_status(const Json::Value& status);
+
+    // Main loop: the next queued change, false if none
+    bool take(ControlRequest& request);
+    // Main loop: the response to request id. ok false with error set if it
+    // was refused; changes lists what was done either way.
+    void answer(uint64_t id, bool ok, const std::string& error, const std::vector<std::string>& changes);
+
+private:
+    struct Connection {
+        int fd;
+        std::string request;
+        std::chrono::steady_clock::time_point opened;
+        uint64_t waiting;       // Request ID the main loop is to answer, 0 = none
+    };
+
+    const std::string token_;
+    std::function<void()> wake_;
+    int listen_fd_;
+    EventLoop events_;
+    std::thread thread_;
+    std::atomic<bool> stop_;
+
+    std::mutex mutex_;
+    // Guarded by mutex_
+    std::string status_;
+    std::deque<ControlRequest> requests_;
+    std::map<uint64_t, std::pair<bool, std::string>> answers_;  // ok and body to send, by request ID
+    uint64_t next_id_;
+
+    // Server thread only
+    std::vector<Connection> connections_;
+
+    void run();
+    void accept_connections();
+    // False once the connection is done with (answered, closed or broken)
+    bool read_request(Connection& connection);
+    // Answer a complete request, or queue it and wait; false once answered
+    bool handle(Connection& connection, size_t header_end);
+    bool authorized(const std::string& headers) const;
+    void send_response(Connection& connection, const std::string& status, const std::string& body,
+                       const std::string& extra_headers = std::string());
+};
+
+#endif // CONTROL_SERVER_H
@@ -0,0 +1,777 @@
+#include "cpu_topology.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#include <pthread.h>
+#include <sys/sysctl.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+#if defined(__linux__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+static const std::string SYSFS_CPU = "/sys/devices/system/cpu/";
+static const std::string SYSFS_NODE = "/sys/devices/system/node/";
+
+static bool read_line(const std::string& path, std::string& out) {
+    std::ifstream f(path);
+    if (!f || !std::getline(f, out)) {
+        return false;
+    }
+    return true;
+}
+
+static int read_int(const std::string& path, int fallback) {
+    std::string s;
+    if (!read_line(path, s) || s.empty()) {
+        return fallback;
+    }
+    return std::atoi(s.c_str());
+}
+
+// "32768K" / "32M" -> bytes
+static size_t parse_cache_size(const std::string& s) {
+    char* end = nullptr;
+    unsigned long long v = std::strtoull(s.c_str(), &end, 10);
+    if (end && (*end == 'K' || *end == 'k')) v *= 1024;
+    else if (end && (*end == 'M' || *end == 'm')) v *= 1024 * 1024;
+    return (size_t)v;
+}
+
+bool parse_cpu_list(const std::string& list, std::vector<int>& cpus) {
+    cpus.clear();
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item.erase(std::remove_if(item.begin(), item.end(), ::isspace), item.end());
+        if (item.empty()) continue;
+
+        char* end = nullptr;
+        long first = std::strtol(item.c_str(), &end, 10);
+        long last = first;
+        if (end == item.c_str() || first < 0) return false;
+        if (*end == '-') {
+            const char* second = end + 1;
+            last = std::strtol(second, &end, 10);
+            if (end == second || last < first) return false;
+        }
+        if (*end != '\0') return false;
+        for (long c = first; c <= last; c++) {
+            cpus.push_back((int)c);
+        }
+    }
+    return !cpus.empty();
+}
+
+const char* core_type_name(CoreType type) {
+    switch (type) {
+    case CORE_TYPE_PERFORMANCE: return "P-core";
+    case CORE_TYPE_EFFICIENCY: return "E-core";
+    default: return "";
+    }
+}
+
+const char* core_type_key(CoreType type) {
+    switch (type) {
+    case CORE_TYPE_PERFORMANCE: return "performance";
+    case CORE_TYPE_EFFICIENCY: return "efficiency";
+    default: return "unknown";
+    }
+}
+
+unsigned int L2Cluster::max_threads() const {
+    unsigned int by_cpus = (unsigned int)cpus.size();
+    if (l2_bytes == 0 || cores <= 1) {
+        return by_cpus;  // Unknown, or a core's own L2: SMT siblings are the L3's business
+    }
+    unsigned int by_cache = (unsigned int)(l2_bytes / RANDOMX_L2_PER_THREAD);
+    if (by_cache == 0) by_cache = 1;
+    return std::min(by_cpus, by_cache);
+}
+
+unsigned int L3Domain::max_threads() const {
+    unsigned int by_cpus = (unsigned int)cpus.size();
+    if (l3_bytes == 0) {
+        return by_cpus;  // Unknown L3: do not cap
+    }
+    unsigned int by_cache = (unsigned int)(l3_bytes / RANDOMX_L3_PER_THREAD);
+    if (by_cache == 0) by_cache = 1;
+    return std::min(by_cpus, by_cache);
+}
+
+CpuTopology CpuTopology::detect() {
+    CpuTopology topo;
+#if defined(_WIN32)
+    topo.detect_windows();
+#elif defined(__APPLE__)
+    topo.detect_macos();
+#else
+    topo.detect_sysfs();
+#endif
+    if (topo.cpus_.empty()) {
+        topo.detect_fallback();
+    }
+
+    // Order each domain's CPUs: all first hardware threads (P-cores before
+    // E-cores), then siblings
+    for (const auto& info : topo.cpus_) {
+        topo.domains_[info.l3_domain].cpus.push_back(info.cpu);
+        if (info.l2_cluster >= 0) {
+            topo.clusters_[info.l2_cluster].cpus.push_back(info.cpu);
+        }
+    }
+    auto rank = [&topo](int cpu) {
+        const CpuInfo* info = topo.find_cpu(cpu);
+        return info->smt_index > 0 ? 1 + info->smt_index : info->core_type == CORE_TYPE_EFFICIENCY ? 1 : 0;
+    };
+    for (auto& domain : topo.domains_) {
+        std::stable_sort(domain.cpus.begin(), domain.cpus.end(), [&rank](int a, int b) {
+            return rank(a) < rank(b);
+        });
+    }
+    for (auto& cluster : topo.clusters_) {
+        std::vector<int> cores;
+        for (int cpu : cluster.cpus) {
+            int core = topo.find_cpu(cpu)->core_id;
+            if (std::find(cores.begin(), cores.end(), core) == cores.end()) cores.push_back(core);
+        }
+        cluster.cores = (unsigned int)cores.size();
+    }
+
+    return topo;
+}
+
+void CpuTopology::detect_fallback() {
+    cpus_.clear();
+    domains_.assign(1, L3Domain());
+    domains_[0].l3_bytes = 0;
+    domains_[0].node = 0;
+
+    unsigned int n = std::thread::hardware_concurrency();
+    if (n == 0) n = 1;
+    for (unsigned int c = 0; c < n; c++) {
+        CpuInfo info;
+        info.cpu = (int)c;
+        info.core_id = (int)c;
+        info.package_id = 0;
+        info.node = 0;
+        info.l3_domain = 0;
+        info.l2_cluster = -1;
+        info.smt_index = 0;
+        info.core_type = CORE_TYPE_UNKNOWN;
+        cpus_.push_back(info);
+    }
+}
+
+void CpuTopology::detect_sysfs() {
+    std::string online;
+    std::vector<int> cpu_ids;
+    if (!read_line(SYSFS_CPU + "online", online) || !parse_cpu_list(online, cpu_ids)) {
+        return;
+    }
+
+    // NUMA node of each CPU
+    std::map<int, int> cpu_node;
+    std::string node_list;
+    std::vector<int> nodes;
+    if (read_line(SYSFS_NODE + "online", node_list) && parse_cpu_list(node_list, nodes)) {
+        for (int node : nodes) {
+            std::string list;
+            std::vector<int> node_cpus;
+            if (read_line(SYSFS_NODE + "node" + std::to_string(node) + "/cpulist", list) &&
+                parse_cpu_list(list, node_cpus)) {
+                for (int c : node_cpus) cpu_node[c] = node;
+            }
+        }
+    }
+
+    // L3 domains and L2 clusters keyed by their shared_cpu_list
+    std::map<std::string, int> domain_by_key;
+    std::map<std::string, int> cluster_by_key;
+    std::map<std::pair<int, int>, int> smt_count;  // (package, core) -> threads seen
+
+    for (int c : cpu_ids) {
+        std::string base = SYSFS_CPU + "cpu" + std::to_string(c) + "/";
+        CpuInfo info;
+        info.cpu = c;
+        info.package_id = read_int(base + "topology/physical_package_id", 0);
+        int core = read_int(base + "topology/core_id", c);
+        info.core_id = info.package_id * 65536 + core;
+        info.node = cpu_node.count(c) ? cpu_node[c] : 0;
+
+        int& seen = smt_count[std::make_pair(info.package_id, core)];
+        info.smt_index = seen++;
+
+        // Find the L3 (or, if there is none, the package) and the L2
+        std::string key = "package" + std::to_string(info.package_id);
+        std::string l2_key;
+        size_t l3_bytes = 0, l2_bytes = 0;
+        for (int idx = 0; idx < 16; idx++) {
+            std::string cache = base + "cache/index" + std::to_string(idx) + "/";
+            std::string level;
+            if (!read_line(cache + "level", level)) break;
+            int cache_level = std::atoi(level.c_str());
+            if (cache_level != 2 && cache_level != 3) continue;
+            std::string shared, size;
+            read_line(cache + "shared_cpu_list", shared);
+            read_line(cache + "size", size);
+            if (cache_level == 2) {
+                l2_key = "l2:" + shared;
+                l2_bytes = parse_cache_size(size);
+            } else {
+                if (!shared.empty()) key = "l3:" + shared;
+                l3_bytes = parse_cache_size(size);
+            }
+        }
+
+        info.l2_cluster = -1;
+        if (!l2_key.empty()) {
+            auto cluster = cluster_by_key.find(l2_key);
+            if (cluster == cluster_by_key.end()) {
+                L2Cluster l2;
+                l2.l2_bytes = l2_bytes;
+                l2.cores = 0;
+                clusters_.push_back(l2);
+                cluster = cluster_by_key.emplace(l2_key, (int)clusters_.size() - 1).first;
+            }
+            info.l2_cluster = cluster->second;
+        }
+        info.core_type = CORE_TYPE_UNKNOWN;
+
+        auto it = domain_by_key.find(key);
+        if (it == domain_by_key.end()) {
+            L3Domain domain;
+            domain.l3_bytes = l3_bytes;
+            domain.node = info.node;
+            domains_.push_back(domain);
+            it = domain_by_key.emplace(key, (int)domains_.size() - 1).first;
+        }
+        info.l3_domain = it->second;
+        cpus_.push_back(info);
+    }
+
+    detect_core_types_sysfs();
+    if (!hybrid()) {
+        detect_core_types_cpuid();
+    }
+}
+
+// Intel hybrid parts register one PMU per core type (cpu_core, cpu_atom),
+// each listing its CPUs. ARM kernels give each CPU a cpu_capacity, 1024 for
+// the biggest; cores under half of that are the little ones (mid-size cores
+// of three-tier parts count as big).
+void CpuTopology::detect_core_types_sysfs() {
+    std::string core_list, atom_list;
+    std::vector<int> core_cpus, atom_cpus;
+    if (read_line("/sys/devices/cpu_core/cpus", core_list) && parse_cpu_list(core_list, core_cpus) &&
+        read_line("/sys/devices/cpu_atom/cpus", atom_list) && parse_cpu_list(atom_list, atom_cpus)) {
+        for (auto& info : cpus_) {
+            if (std::find(core_cpus.begin(), core_cpus.end(), info.cpu) != core_cpus.end()) {
+                info.core_type = CORE_TYPE_PERFORMANCE;
+            } else if (std::find(atom_cpus.begin(), atom_cpus.end(), info.cpu) != atom_cpus.end()) {
+                info.core_type = CORE_TYPE_EFFICIENCY;
+            }
+        }
+        return;
+    }
+
+    std::map<int, int> capacity;
+    int top = 0, bottom = INT_MAX;
+    for (const auto& info : cpus_) {
+        int value = read_int(SYSFS_CPU + "cpu" + std::to_string(info.cpu) + "/cpu_capacity", 0);
+        if (value <= 0) return;
+        capacity[info.cpu] = value;
+        top = std::max(top, value);
+        bottom = std::min(bottom, value);
+    }
+    if (cpus_.empty() || bottom * 2 >= top) return;
+    for (auto& info : cpus_) {
+        info.core_type = capacity[info.cpu] * 2 >= top ? CORE_TYPE_PERFORMANCE : CORE_TYPE_EFFICIENCY;
+    }
+}
+
+// Kernels older than the hybrid PMU support: CPUID leaf 0x1A, which reports
+// the type of the core it runs on, so the thread visits each CPU in turn
+void CpuTopology::detect_core_types_cpuid() {
+#if defined(__linux__) && (defined(__x86_64__) || defined(__i386__))
+    unsigned int eax, ebx, ecx, edx;
+    // CPUID.07H:EDX[15] marks a hybrid part
+    if (__get_cpuid_max(0, nullptr) < 0x1a || !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) ||
+        !(edx & (1u << 15))) {
+        return;
+    }
+    cpu_set_t saved;
+    if (sched_getaffinity(0, sizeof(saved), &saved) != 0) return;
+    for (auto& info : cpus_) {
+        if (info.cpu >= CPU_SETSIZE) continue;
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(info.cpu, &one);
+        if (sched_setaffinity(0, sizeof(one), &one) != 0) continue;
+        __cpuid_count(0x1a, 0, eax, ebx, ecx, edx);
+        // Core type in EAX[31:24]: 0x40 Intel Core, 0x20 Intel Atom
+        unsigned int type = eax >> 24;
+        info.core_type = type == 0x40 ? CORE_TYPE_PERFORMANCE : type == 0x20 ? CORE_TYPE_EFFICIENCY : CORE_TYPE_UNKNOWN;
+    }
+    sched_setaffinity(0, sizeof(saved), &saved);
+#endif
+}
+
+#if defined(_WIN32)
+std::vector<int> processor_group_bases() {
+    std::vector<int> bases;
+    int base = 0;
+    WORD groups = GetActiveProcessorGroupCount();
+    for (WORD g = 0; g < groups; g++) {
+        bases.push_back(base);
+        base += (int)GetActiveProcessorCount(g);
+    }
+    return bases;
+}
+
+static void group_mask_cpus(const GROUP_AFFINITY& mask, const std::vector<int>& bases, std::vector<int>& cpus) {
+    if (mask.Group >= bases.size()) return;
+    for (int bit = 0; bit < (int)(8 * sizeof(KAFFINITY)); bit++) {
+        if (mask.Mask & ((KAFFINITY)1 << bit)) {
+            cpus.push_back(bases[mask.Group] + bit);
+        }
+    }
+}
+
+void CpuTopology::detect_windows() {
+    DWORD len = 0;
+    GetLogicalProcessorInformationEx(RelationAll, nullptr, &len);
+    if (len == 0) return;
+    std::vector<char> buffer(len);
+    auto* info = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data());
+    if (!GetLogicalProcessorInformationEx(RelationAll, info, &len)) return;
+
+    // Systems with more than 64 CPUs have several processor groups; CPUs are
+    // numbered globally here and mapped back to (group, bit) when pinning
+    const std::vector<int> bases = processor_group_bases();
+    std::map<int, int> cpu_core, cpu_smt, cpu_package, cpu_node, cpu_domain, cpu_cluster, cpu_class;
+    int core_count = 0;
+    int top_class = 0, bottom_class = INT_MAX;
+    int package_count = 0;
+
+    for (DWORD offset = 0; offset < len;) {
+        auto* entry = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+        std::vector<int> cpus;
+        if (entry->Relationship == RelationProcessorCore) {
+            for (WORD g = 0; g < entry->Processor.GroupCount; g++) {
+                group_mask_cpus(entry->Processor.GroupMask[g], bases, cpus);
+            }
+            // EfficiencyClass: higher is faster, all equal on non-hybrid parts
+            int efficiency = (int)entry->Processor.EfficiencyClass;
+            top_class = std::max(top_class, efficiency);
+            bottom_class = std::min(bottom_class, efficiency);
+            for (size_t i = 0; i < cpus.size(); i++) {
+                cpu_core[cpus[i]] = core_count;
+                cpu_smt[cpus[i]] = (int)i;
+                cpu_class[cpus[i]] = efficiency;
+            }
+            core_count++;
+        } else if (entry->Relationship == RelationProcessorPackage) {
+            for (WORD g = 0; g < entry->Processor.GroupCount; g++) {
+                group_mask_cpus(entry->Processor.GroupMask[g], bases, cpus);
+            }
+            for (int c : cpus) cpu_package[c] = package_count;
+            package_count++;
+        } else if (entry->Relationship == RelationNumaNode) {
+            group_mask_cpus(entry->NumaNode.GroupMask, bases, cpus);
+            for (int c : cpus) cpu_node[c] = (int)entry->NumaNode.NodeNumber;
+        } else if (entry->Relationship == RelationCache && entry->Cache.Level == 3) {
+            group_mask_cpus(entry->Cache.GroupMask, bases, cpus);
+            L3Domain domain;
+            domain.l3_bytes = entry->Cache.CacheSize;
+            domain.node = 0;
+            domains_.push_back(domain);
+            for (int c : cpus) cpu_domain[c] = (int)domains_.size() - 1;
+        } else if (entry->Relationship == RelationCache && entry->Cache.Level == 2 &&
+                   entry->Cache.Type != CacheInstruction) {
+            group_mask_cpus(entry->Cache.GroupMask, bases, cpus);
+            L2Cluster cluster;
+            cluster.l2_bytes = entry->Cache.CacheSize;
+            cluster.cores = 0;
+            clusters_.push_back(cluster);
+            for (int c : cpus) cpu_cluster[c] = (int)clusters_.size() - 1;
+        }
+        offset += entry->Size;
+    }
+
+    for (const auto& core : cpu_core) {
+        CpuInfo info;
+        info.cpu = core.first;
+        info.core_id = core.second;
+        info.smt_index = cpu_smt[core.first];
+        info.package_id = cpu_package.count(core.first) ? cpu_package[core.first] : 0;
+        info.node = cpu_node.count(core.first) ? cpu_node[core.first] : 0;
+        if (!cpu_domain.count(core.first)) {
+            // No L3 reported for this CPU: give its package a domain of unknown size
+            L3Domain domain;
+            domain.l3_bytes = 0;
+            domain.node = info.node;
+            domains_.push_back(domain);
+            for (const auto& other : cpu_package) {
+                if (other.second == info.package_id && !cpu_domain.count(other.first)) {
+                    cpu_domain[other.first] = (int)domains_.size() - 1;
+                }
+            }
+            cpu_domain[core.first] = (int)domains_.size() - 1;
+        }
+        info.l3_domain = cpu_domain[core.first];
+        domains_[info.l3_domain].node = info.node;
+        info.l2_cluster = cpu_cluster.count(core.first) ? cpu_cluster[core.first] : -1;
+        info.core_type = top_class == bottom_class ? CORE_TYPE_UNKNOWN
+                       : cpu_class[core.first] == top_class ? CORE_TYPE_PERFORMANCE : CORE_TYPE_EFFICIENCY;
+        cpus_.push_back(info);
+    }
+}
+#endif
+
+#if defined(__APPLE__)
+static int sysctl_int(const char* name, int fallback) {
+    int64_t value = 0;
+    size_t size = sizeof(value);
+    if (sysctlbyname(name, &value, &size, nullptr, 0) != 0 || value <= 0) {
+        return fallback;
+    }
+    return (int)value;
+}
+
+// macOS does not expose per-CPU topology: assume one package whose logical
+// CPUs are numbered physical cores first, sharing one last-level cache
+void CpuTopology::detect_macos() {
+    int logical = sysctl_int("hw.logicalcpu", 0);
+    if (logical <= 0) return;
+    int physical = sysctl_int("hw.physicalcpu", logical);
+
+    L3Domain domain;
+    domain.l3_bytes = (size_t)sysctl_int("hw.l3cachesize", 0);
+    domain.node = 0;
+    domains_.push_back(domain);
+
+    for (int c = 0; c < logical; c++) {
+        CpuInfo info;
+        info.cpu = c;
+        info.core_id = c % physical;
+        info.package_id = 0;
+        info.node = 0;
+        info.l3_domain = 0;
+        info.l2_cluster = -1;
+        info.smt_index = c / physical;
+        // Apple silicon's performance levels can't be told apart per CPU,
+        // nor threads pinned to them
+        info.core_type = CORE_TYPE_UNKNOWN;
+        cpus_.push_back(info);
+    }
+}
+#endif
+
+const CpuInfo* CpuTopology::find_cpu(int cpu) const {
+    for (const auto& info : cpus_) {
+        if (info.cpu == cpu) return &info;
+    }
+    return nullptr;
+}
+
+bool CpuTopology::hybrid() const {
+    return core_count(CORE_TYPE_PERFORMANCE) > 0 && core_count(CORE_TYPE_EFFICIENCY) > 0;
+}
+
+unsigned int CpuTopology::core_count(CoreType type) const {
+    unsigned int count = 0;
+    for (const auto& info : cpus_) {
+        if (info.smt_index == 0 && info.core_type == type) count++;
+    }
+    return count;
+}
+
+CoreType CpuTopology::core_type(int cpu) const {
+    const CpuInfo* info = find_cpu(cpu);
+    return info ? info->core_type : CORE_TYPE_UNKNOWN;
+}
+
+void CpuTopology::split_fed_cpus(std::vector<std::vector<int>>& fed, std::vector<std::vector<int>>& rest,
+                                 const std::vector<int>& exclude) const {
+    fed.assign(domains_.size(), std::vector<int>());
+    rest.assign(domains_.size(), std::vector<int>());
+    std::vector<unsigned int> cluster_used(clusters_.size(), 0);
+    for (size_t d = 0; d < domains_.size(); d++) {
+        const unsigned int limit = domains_[d].max_threads();
+        for (int cpu : domains_[d].cpus) {
+            if (std::find(exclude.begin(), exclude.end(), cpu) != exclude.end()) continue;
+            const CpuInfo* info = find_cpu(cpu);
+            int cluster = info ? info->l2_cluster : -1;
+            if (fed[d].size() < limit && (cluster < 0 || cluster_used[cluster] < clusters_[cluster].max_threads())) {
+                fed[d].push_back(cpu);
+                if (cluster >= 0) cluster_used[cluster]++;
+            } else {
+                rest[d].push_back(cpu);
+            }
+        }
+    }
+}
+
+unsigned int CpuTopology::max_mining_threads(const std::vector<int>& exclude) const {
+    std::vector<std::vector<int>> fed, rest;
+    split_fed_cpus(fed, rest, exclude);
+    unsigned int total = 0;
+    for (const auto& cpus : fed) {
+        total += (unsigned int)cpus.size();
+    }
+    return total > 0 ? total : 1;
+}
+
+std::vector<int> CpuTopology::place_threads(unsigned int num_threads, const std::vector<int>& override_cpus,
+                                            const std::vector<int>& exclude) const {
+    std::vector<int> placement;
+    placement.reserve(num_threads);
+
+    if (!override_cpus.empty()) {
+        for (unsigned int t = 0; t < num_threads; t++) {
+            placement.push_back(override_cpus[t % override_cpus.size()]);
+        }
+        return placement;
+    }
+    if (domains_.empty()) {
+        return placement;
+    }
+
+    // Round-robin over domains: first over the CPUs each domain's L3 and L2
+    // clusters can feed, then (oversubscribed) over the remaining CPUs, then
+    // wrap around
+    std::vector<std::vector<int>> lists[2];
+    split_fed_cpus(lists[0], lists[1], exclude);
+    for (int pass = 0; pass < 2 && placement.size() < num_threads; pass++) {
+        std::vector<size_t> used(domains_.size(), 0);
+        bool progress = true;
+        while (progress && placement.size() < num_threads) {
+            progress = false;
+            for (size_t d = 0; d < domains_.size() && placement.size() < num_threads; d++) {
+                if (used[d] < lists[pass][d].size()) {
+                    placement.push_back(lists[pass][d][used[d]++]);
+                    progress = true;
+                }
+            }
+        }
+    }
+    for (size_t t = placement.size(), i = 0; t < num_threads && !placement.empty(); t++, i++) {
+        placement.push_back(placement[i]);
+    }
+    return placement;
+}
+
+std::vector<int> CpuTopology::pick_housekeeping_cpus(const std::vector<int>& allowed) const {
+    std::vector<const CpuInfo*> candidates;
+    unsigned int cores = 0;
+    for (const auto& info : cpus_) {
+        if (std::find(allowed.begin(), allowed.end(), info.cpu) == allowed.end()) continue;
+        candidates.push_back(&info);
+        if (info.smt_index == 0) cores++;
+    }
+    std::vector<int> picked;
+    if (cores < HOUSEKEEPING_MIN_CORES) {
+        return picked;
+    }
+    // An E-core hashes at a fraction of a P-core's rate, so it is the cheapest to give up
+    if (hybrid()) {
+        for (const CpuInfo* info : candidates) {
+            if (info->core_type == CORE_TYPE_EFFICIENCY) {
+                picked.push_back(info->cpu);
+                return picked;
+            }
+        }
+    }
+    // The first core also takes most interrupts; its SMT siblings share its L2
+    for (const CpuInfo* info : candidates) {
+        if (info->core_id == candidates[0]->core_id) {
+            picked.push_back(info->cpu);
+        }
+    }
+    return picked;
+}
+
+bool pin_current_thread(int cpu) {
+    if (cpu < 0) return false;
+#if defined(_WIN32)
+    const std::vector<int> bases = processor_group_bases();
+    for (size_t g = bases.size(); g-- > 0;) {
+        if (cpu >= bases[g]) {
+            GROUP_AFFINITY affinity;
+            std::memset(&affinity, 0, sizeof(affinity));
+            affinity.Group = (WORD)g;
+            affinity.Mask = (KAFFINITY)1 << (cpu - bases[g]);
+            return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+        }
+    }
+    return false;
+#elif defined(__APPLE__)
+    // Affinity tags are only a scheduling hint (and unsupported on Apple silicon)
+    thread_affinity_policy_data_t policy = { cpu + 1 };
+    return thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY,
+                             (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT) == KERN_SUCCESS;
+#elif defined(__linux__)
+    // Dynamically sized set, so CPUs above CPU_SETSIZE work too
+    cpu_set_t* set = CPU_ALLOC(cpu + 1);
+    if (!set) return false;
+    size_t size = CPU_ALLOC_SIZE(cpu + 1);
+    CPU_ZERO_S(size, set);
+    CPU_SET_S(cpu, size, set);
+    int rc = pthread_setaffinity_np(pthread_self(), size, set);
+    CPU_FREE(set);
+    return rc == 0;
+#else
+    return false;
+#endif
+}
+
+bool pin_current_thread_cpus(const std::vector<int>& cpus) {
+    if (cpus.empty()) return false;
+#if defined(_WIN32)
+    const std::vector<int> bases = processor_group_bases();
+    GROUP_AFFINITY affinity;
+    std::memset(&affinity, 0, sizeof(affinity));
+    int group = -1;
+    for (int cpu : cpus) {
+        int g = (int)bases.size() - 1;
+        while (g > 0 && cpu < bases[g]) g--;
+        if (group >= 0 && g != group) return false;
+        group = g;
+        affinity.Mask |= (KAFFINITY)1 << (cpu - bases[g]);
+    }
+    affinity.Group = (WORD)group;
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#elif defined(__linux__)
+    int highest = *std::max_element(cpus.begin(), cpus.end());
+    if (highest < 0) return false;
+    cpu_set_t* set = CPU_ALLOC(highest + 1);
+    if (!set) return false;
+    size_t size = CPU_ALLOC_SIZE(highest + 1);
+    CPU_ZERO_S(size, set);
+    for (int cpu : cpus) {
+        if (cpu >= 0) CPU_SET_S(cpu, size, set);
+    }
+    int rc = pthread_setaffinity_np(pthread_self(), size, set);
+    CPU_FREE(set);
+    return rc == 0;
+#else
+    return false;
+#endif
+}
+
+static std::vector<int> housekeeping_set;
+static std::vector<int> hashing_set;
+
+std::vector<int> current_thread_cpus() {
+    std::vector<int> allowed;
+#if defined(__linux__)
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &mask)) allowed.push_back(cpu);
+        }
+    }
+#endif
+    if (allowed.empty()) {
+        for (const auto& info : CpuTopology::detect().cpus()) allowed.push_back(info.cpu);
+    }
+    return allowed;
+}
+
+bool set_housekeeping_cpus(const std::vector<int>& cpus) {
+    // What the process may use (taskset, cpuset), before narrowing it
+    std::vector<int> hashing;
+    for (int cpu : current_thread_cpus()) {
+        if (std::find(cpus.begin(), cpus.end(), cpu) == cpus.end()) hashing.push_back(cpu);
+    }
+    if (hashing.empty() || !pin_current_thread_cpus(cpus)) {
+        return false;
+    }
+    housekeeping_set = cpus;
+    hashing_set = hashing;
+    return true;
+}
+
+const std::vector<int>& housekeeping_cpus() {
+    return housekeeping_set;
+}
+
+const std::vector<int>& hashing_cpus() {
+    return hashing_set;
+}
+
+bool pin_current_thread_to_hashing_cpus() {
+    return hashing_set.empty() || pin_current_thread_cpus(hashing_set);
+}
+
+std::string format_cpu_list(const std::vector<int>& cpus) {
+    std::vector<int> sorted(cpus);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    std::ostringstream out;
+    for (size_t i = 0; i < sorted.size();) {
+        size_t j = i;
+        while (j + 1 < sorted.size() && sorted[j + 1] == sorted[j] + 1) j++;
+        out << (i ? "," : "") << sorted[i];
+        if (j > i) out << "-" << sorted[j];
+        i = j + 1;
+    }
+    return out.str();
+}
+
+int current_cpu() {
+#if defined(_WIN32)
+    PROCESSOR_NUMBER number;
+    GetCurrentProcessorNumberEx(&number);
+    const std::vector<int> bases = processor_group_bases();
+    return number.Group < bases.size() ? bases[number.Group] + number.Number : -1;
+#elif defined(__linux__)
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+std::string CpuTopology::describe() const {
+    std::vector<std::vector<int>> fed, rest;
+    split_fed_cpus(fed, rest);
+    std::ostringstream ss;
+    for (size_t d = 0; d < domains_.size(); d++) {
+        const L3Domain& domain = domains_[d];
+        if (d) ss << "\n";
+        ss << "  L3 domain " << d << " (node " << domain.node << "): " << domain.cpus.size() << " CPUs, ";
+        if (domain.l3_bytes) {
+            ss << domain.l3_bytes / (1024 * 1024) << " MB L3";
+        } else {
+            ss << "L3 size unknown";
+        }
+        if (hybrid()) {
+            unsigned int p_cores = 0, e_cores = 0;
+            for (int cpu : domain.cpus) {
+                const CpuInfo* info = find_cpu(cpu);
+                if (info->smt_index != 0) continue;
+                if (info->core_type == CORE_TYPE_PERFORMANCE) p_cores++;
+                if (info->core_type == CORE_TYPE_EFFICIENCY) e_cores++;
+            }
+            ss << " (" << p_cores << " P-cores, " << e_cores << " E-cores)";
+        }
+        ss << ", up to " << fed[d].size() << " threads";
+    }
+    return ss.str();
+}
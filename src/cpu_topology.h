@@ -0,0 +1,167 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Each RandomX thread wants a 2MB share of L3 for its scratchpad; beyond
+// that, extra threads on the same L3 only evict each other
+static const size_t RANDOMX_L3_PER_THREAD = 2 * 1024 * 1024;
+
+// ...and 256KB of L2 for the scratchpad's L2 level, which matters where
+// cores share an L2 (the E-core clusters of Intel hybrid parts, many ARM
+// clusters)
+static const size_t RANDOMX_L2_PER_THREAD = 256 * 1024;
+
+// Hosts with fewer physical cores than this get no automatic housekeeping
+// CPUs (see pick_housekeeping_cpus): they need every core for hashing
+static const unsigned int HOUSEKEEPING_MIN_CORES = 8;
+
+// Hybrid CPUs (Alder Lake and later, ARM big.LITTLE) mix cores whose
+// RandomX throughput differs two to three times
+enum CoreType {
+    CORE_TYPE_UNKNOWN,       // Not a hybrid CPU, or the OS doesn't say
+    CORE_TYPE_PERFORMANCE,
+    CORE_TYPE_EFFICIENCY
+};
+
+// "P-core", "E-core", "" for CORE_TYPE_UNKNOWN
+const char* core_type_name(CoreType type);
+// "performance", "efficiency", "unknown" (metric labels, JSON keys)
+const char* core_type_key(CoreType type);
+
+struct CpuInfo {
+    int cpu;          // Logical CPU number
+    int core_id;      // Physical core (unique across packages)
+    int package_id;
+    int node;         // NUMA node, 0 if unknown
+    int l3_domain;    // Index into CpuTopology::l3_domains()
+    int l2_cluster;   // Index into CpuTopology::l2_clusters(), -1 if unknown
+    int smt_index;    // 0 = first hardware thread of its core, 1 = sibling, ...
+    CoreType core_type;
+};
+
+// CPUs sharing one L2 (a core and its SMT siblings, or a cluster of small cores)
+struct L2Cluster {
+    size_t l2_bytes;           // 0 if unknown
+    unsigned int cores;        // Physical cores sharing it
+    std::vector<int> cpus;
+
+    // Threads this L2 can feed when several cores share it: l2_bytes /
+    // 256KB, at most one per CPU
+    unsigned int max_threads() const;
+};
+
+// CPUs sharing one L3 slice (a CCX on AMD, a socket on most Intel parts)
+struct L3Domain {
+    size_t l3_bytes;           // 0 if unknown
+    int node;
+    std::vector<int> cpus;     // Physical cores first, then SMT siblings
+
+    // Threads this L3 can feed: l3_bytes / 2MB, at most one per CPU
+    unsigned int max_threads() const;
+};
+
+// Cache and core topology: /sys/devices/system/cpu on Linux,
+// GetLogicalProcessorInformationEx on Windows (all processor groups, CPUs
+// numbered globally), sysctl on macOS. If none of these work the topology
+// degrades to one domain of hardware_concurrency() CPUs with unknown L3
+// size, so callers never need a special case. No libnuma involved.
+class CpuTopology {
+public:
+    static CpuTopology detect();
+
+    const std::vector<CpuInfo>& cpus() const { return cpus_; }
+    const std::vector<L3Domain>& l3_domains() const { return domains_; }
+    const std::vector<L2Cluster>& l2_clusters() const { return clusters_; }
+    const CpuInfo* find_cpu(int cpu) const;
+
+    // Whether both core types were found
+    bool hybrid() const;
+    // Physical cores (first hardware threads) of a type
+    unsigned int core_count(CoreType type) const;
+    // Type of a CPU, CORE_TYPE_UNKNOWN if it isn't in the topology
+    CoreType core_type(int cpu) const;
+
+    // Threads the caches can feed: per L3 domain up to its max_threads(),
+    // less any its shared L2 clusters can't hold, leaving out exclude
+    unsigned int max_mining_threads(const std::vector<int>& exclude = std::vector<int>()) const;
+
+    // CPU for each of num_threads workers. Threads are spread across L3
+    // domains; inside a domain physical cores fill before SMT siblings (on a
+    // hybrid CPU: P-cores, then E-cores, then P-core siblings), and no domain
+    // gets more than its L3 can hold, nor any L2 cluster more than its L2
+    // can, until every domain is full. A non-empty override list is used as
+    // is (cycled if shorter); the automatic placement leaves out exclude.
+    std::vector<int> place_threads(unsigned int num_threads, const std::vector<int>& override_cpus,
+                                   const std::vector<int>& exclude = std::vector<int>()) const;
+
+    // Automatic housekeeping CPUs out of allowed: one E-core on a hybrid
+    // part, else the first physical core with its SMT siblings. Empty with
+    // fewer than HOUSEKEEPING_MIN_CORES cores in allowed.
+    std::vector<int> pick_housekeeping_cpus(const std::vector<int>& allowed) const;
+
+    // One line per L3 domain, for startup output
+    std::string describe() const;
+
+private:
+    void detect_sysfs();
+    void detect_core_types_sysfs();
+    void detect_core_types_cpuid();
+    // Per L3 domain, in placement order, the CPUs its L3 and their L2
+    // clusters can feed, and the rest
+    void split_fed_cpus(std::vector<std::vector<int>>& fed, std::vector<std::vector<int>>& rest,
+                        const std::vector<int>& exclude = std::vector<int>()) const;
+    void detect_windows();
+    void detect_macos();
+    void detect_fallback();
+
+    std::vector<CpuInfo> cpus_;
+    std::vector<L3Domain> domains_;
+    std::vector<L2Cluster> clusters_;
+};
+
+// Pin the calling thread to one CPU (numbered as in CpuTopology). On macOS
+// this is only an affinity hint. Returns false if the OS refused.
+bool pin_current_thread(int cpu);
+
+// Pin the calling thread to a set of CPUs (Linux; on Windows only within
+// one processor group). Returns false if unsupported or refused.
+bool pin_current_thread_cpus(const std::vector<int>& cpus);
+
+// CPUs the calling thread may run on (its affinity mask, within any
+// cpuset); every CPU where the OS can't tell
+std::vector<int> current_thread_cpus();
+
+// Housekeeping CPUs (--housekeeping-cpus): the threads that don't hash (the
+// main loop, RPC, ZMQ and pool clients, logging, the TUI) run there and
+// mining threads are placed elsewhere, so they neither take the workers'
+// time slices nor pollute their L2s. set_housekeeping_cpus moves the calling
+// thread onto cpus; main calls it before starting any thread, and every
+// thread started afterwards inherits it. Threads that hash and aren't pinned
+// to a CPU of their own call pin_current_thread_to_hashing_cpus.
+bool set_housekeeping_cpus(const std::vector<int>& cpus);
+const std::vector<int>& housekeeping_cpus();
+// CPUs the process may run on less the housekeeping ones; empty without any
+const std::vector<int>& hashing_cpus();
+// True (and nothing done) without housekeeping CPUs
+bool pin_current_thread_to_hashing_cpus();
+
+// Kernel-style list of cpus ("0-3,8"), the inverse of parse_cpu_list
+std::string format_cpu_list(const std::vector<int>& cpus);
+
+// CPU the calling thread is running on (numbered as in CpuTopology), -1 if
+// the OS can't tell
+int current_cpu();
+
+#ifdef _WIN32
+// CPU number (as in CpuTopology) of the first logical processor in each
+// processor group: group g's processors follow those of groups 0..g-1
+std::vector<int> processor_group_bases();
+#endif
+
+// Parse a kernel-style CPU list ("0-3,8,10-11"). Returns false on bad syntax.
+bool parse_cpu_list(const std::string& list, std::vector<int>& cpus);
+
+#endif // CPU_TOPOLOGY_H
@@ -0,0 +1,754 @@
+#include "dataset_distribution.h"
+#include "dataset_init.h"
+#include "logger.h"
+#include "trace_recorder.h"
+#include "utils.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <curl/curl.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char DATASET_PATH_PREFIX[] = "/dataset/";
+const char SUMS_SUFFIX[] = "/sums";
+// Sent per sendfile call, so a stop is seen between pieces
+const size_t SEND_PIECE_BYTES = 4 << 20;
+
+bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+void send_status(int fd, const std::string& status, const std::string& body) {
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\nContent-Type: text/plain\r\nContent-Length: " << body.size()
+             << "\r\nConnection: close\r\n\r\n" << body;
+    send_all(fd, response.str());
+}
+
+// "Range: bytes=A-B" or "bytes=A-" within size; false if absent or not one
+// satisfiable range (set invalid for the latter)
+bool parse_range(const std::string& headers, uint64_t size, uint64_t& offset, uint64_t& length, bool& invalid) {
+    std::string lower = headers;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    size_t pos = lower.find("\nrange:");
+    invalid = false;
+    if (pos == std::string::npos) {
+        return false;
+    }
+    std::string value = lower.substr(pos + 7, lower.find('\n', pos + 1) - pos - 7);
+    value.erase(std::remove_if(value.begin(), value.end(), [](unsigned char c) { return std::isspace(c); }),
+                value.end());
+    unsigned long long first = 0;
+    unsigned long long last = 0;
+    int fields = std::sscanf(value.c_str(), "bytes=%llu-%llu", &first, &last);
+    if (fields < 1 || value.find(',') != std::string::npos || first >= size) {
+        invalid = true;
+        return false;
+    }
+    if (fields < 2 || last >= size) {
+        last = size - 1;
+    }
+    if (last < first) {
+        invalid = true;
+        return false;
+    }
+    offset = first;
+    length = last - first + 1;
+    return true;
+}
+
+struct RangeBuffer {
+    std::vector<uint8_t>* data;
+    uint64_t limit;
+};
+
+size_t write_range(void* contents, size_t size, size_t nmemb, void* userp) {
+    RangeBuffer* buffer = (RangeBuffer*)userp;
+    size_t bytes = size * nmemb;
+    if (buffer->data->size() + bytes > buffer->limit) {
+        return 0;  // More than asked for: not the range we want
+    }
+    buffer->data->insert(buffer->data->end(), (const uint8_t*)contents, (const uint8_t*)contents + bytes);
+    return bytes;
+}
+
+int fetch_abort(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    return ((const std::atomic<bool>*)clientp)->load() ? 1 : 0;
+}
+
+}  // namespace
+
+DatasetServer::DatasetServer(const std::string& dir) : listen_fd_(-1), stop_(false) {
+    store_.set_directory(dir);
+}
+
+DatasetServer::~DatasetServer() {
+    stop();
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+    }
+}
+
+bool DatasetServer::listen(const std::string& address, std::string& error) {
+    listen_fd_ = utils::listen_tcp(address, error);
+    return listen_fd_ >= 0;
+}
+
+void DatasetServer::start() {
+    if (!thread_.joinable() && listen_fd_ >= 0) {
+        thread_ = std::thread(&DatasetServer::run, this);
+    }
+}
+
+void DatasetServer::stop() {
+    stop_ = true;
+    events_.wake();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void DatasetServer::run() {
+    TraceRecorder::set_thread_name("dataset server");
+    while (!stop_.load()) {
+        std::vector<int> fds(1, listen_fd_);
+        for (const Connection& connection : connections_) {
+            fds.push_back(connection.fd);
+        }
+        events_.watch_fds(fds);
+        events_.wait(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+
+        reap_transfers(false);
+        accept_connections();
+        auto now = std::chrono::steady_clock::now();
+        for (Connection& connection : connections_) {
+            if (!read_request(connection) ||
+                now - connection.opened >= std::chrono::seconds(DATASET_SERVE_REQUEST_TIMEOUT_SECONDS)) {
+                if (connection.fd >= 0) {
+                    close(connection.fd);
+                }
+                connection.fd = -1;
+            }
+        }
+        connections_.erase(std::remove_if(connections_.begin(), connections_.end(),
+                                          [](const Connection& connection) { return connection.fd < 0; }),
+                           connections_.end());
+    }
+    for (const Connection& connection : connections_) {
+        close(connection.fd);
+    }
+    connections_.clear();
+    reap_transfers(true);
+}
+
+void DatasetServer::accept_connections() {
+    for (;;) {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            return;  // EAGAIN: nobody else waiting
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        timeval timeout;
+        timeout.tv_sec = DATASET_SERVE_SEND_TIMEOUT_SECONDS;
+        timeout.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        Connection connection;
+        connection.fd = fd;
+        connection.opened = std::chrono::steady_clock::now();
+        connections_.push_back(std::move(connection));
+    }
+}
+
+bool DatasetServer::read_request(Connection& connection) {
+    char buffer[2048];
+    for (;;) {
+        ssize_t n = recv(connection.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        connection.request.append(buffer, n);
+        if (connection.request.size() > DATASET_SERVE_MAX_REQUEST) {
+            return false;
+        }
+    }
+    if (connection.request.find("\r\n\r\n") == std::string::npos &&
+        connection.request.find("\n\n") == std::string::npos) {
+        return true;
+    }
+    if (transfers_.size() >= DATASET_SERVE_MAX_TRANSFERS) {
+        send_status(connection.fd, "503 Service Unavailable", "Too many downloads, try again\n");
+        return false;
+    }
+    // Sums and files take seconds to minutes: answered on a thread of their
+    // own, which owns the socket from here (closed here once it is done)
+    Transfer transfer;
+    transfer.fd = connection.fd;
+    transfer.done = std::make_shared<std::atomic<bool>>(false);
+    std::shared_ptr<std::atomic<bool>> done = transfer.done;
+    transfer.thread = std::thread([this, fd = connection.fd, request = connection.request, done]() {
+        serve(fd, request);
+        done->store(true);
+    });
+    transfers_.push_back(std::move(transfer));
+    connection.fd = -1;
+    return false;
+}
+
+void DatasetServer::reap_transfers(bool all) {
+    for (Transfer& transfer : transfers_) {
+        if (all && !transfer.done->load()) {
+            shutdown(transfer.fd, SHUT_RDWR);  // Ends a send in progress
+        }
+        if (all || transfer.done->load()) {
+            transfer.thread.join();
+            close(transfer.fd);
+            transfer.fd = -1;
+        }
+    }
+    transfers_.erase(std::remove_if(transfers_.begin(), transfers_.end(),
+                                    [](const Transfer& transfer) { return transfer.fd < 0; }),
+                     transfers_.end());
+}
+
+void DatasetServer::serve(int fd, std::string request) {
+    TraceRecorder::set_thread_name("dataset transfer");
+    std::istringstream request_line(request.substr(0, request.find('\n')));
+    std::string method;
+    std::string target;
+    request_line >> method >> target;
+    std::string path = target.substr(0, target.find('?'));
+
+    const size_t prefix = sizeof(DATASET_PATH_PREFIX) - 1;
+    const size_t suffix = sizeof(SUMS_SUFFIX) - 1;
+    const bool sums = path.size() == prefix + 64 + suffix && path.compare(prefix + 64, suffix, SUMS_SUFFIX) == 0;
+    std::vector<uint8_t> seed_hash(32);
+    if (method != "GET") {
+        send_status(fd, "405 Method Not Allowed", "Only GET is served\n");
+        return;
+    }
+    if (path.compare(0, prefix, DATASET_PATH_PREFIX) != 0 || (path.size() != prefix + 64 && !sums) ||
+        !utils::hex_decode(path.data() + prefix, seed_hash.size(), seed_hash.data())) {
+        send_status(fd, "404 Not Found", "Epochs are at /dataset/SEEDHASH\n");
+        return;
+    }
+
+    const std::string file = store_.path_for(seed_hash);
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0) {
+        send_status(fd, "404 Not Found", "No dataset for this seed (yet)\n");
+        return;
+    }
+    if (sums) {
+        std::string text;
+        if (!sums_for(file, text)) {
+            send_status(fd, "500 Internal Server Error", "Can't read the dataset\n");
+            return;
+        }
+        std::ostringstream response;
+        response << "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " << text.size()
+                 << "\r\nConnection: close\r\n\r\n" << text;
+        send_all(fd, response.str());
+        return;
+    }
+
+    const uint64_t size = (uint64_t)st.st_size;
+    uint64_t offset = 0;
+    uint64_t length = size;
+    bool invalid = false;
+    const bool range = parse_range(request, size, offset, length, invalid);
+    if (invalid) {
+        std::ostringstream response;
+        response << "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" << size
+                 << "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        send_all(fd, response.str());
+        return;
+    }
+    std::ostringstream response;
+    response << "HTTP/1.1 " << (range ? "206 Partial Content" : "200 OK")
+             << "\r\nContent-Type: application/octet-stream\r\nContent-Length: " << length;
+    if (range) {
+        response << "\r\nContent-Range: bytes " << offset << "-" << offset + length - 1 << "/" << size;
+    }
+    response << "\r\nConnection: close\r\n\r\n";
+    auto t0 = std::chrono::steady_clock::now();
+    if (!send_all(fd, response.str()) || !send_file(fd, file, offset, length)) {
+        LOG_DEBUG_STREAM("Dataset server: transfer of " << file << " dropped: " << std::strerror(errno));
+        return;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    LOG_DEBUG_STREAM("Dataset server: sent " << length / (1024 * 1024) << " MB of " << file << " in " << seconds << "s");
+}
+
+bool DatasetServer::send_file(int fd, const std::string& path, uint64_t offset, uint64_t length) {
+    int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+        return false;
+    }
+    bool ok = true;
+#ifdef __linux__
+    // Straight from the page cache to the socket, no copy through here
+    off_t position = (off_t)offset;
+    uint64_t left = length;
+    while (ok && left > 0 && !stop_.load()) {
+        ssize_t n = sendfile(fd, file, &position, (size_t)std::min<uint64_t>(left, SEND_PIECE_BYTES));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        ok = n > 0;
+        left -= ok ? (uint64_t)n : 0;
+    }
+    ok = ok && left == 0;
+#else
+    std::vector<char> buffer(SEND_PIECE_BYTES);
+    uint64_t done = 0;
+    while (ok && done < length && !stop_.load()) {
+        ssize_t n = pread(file, buffer.data(), (size_t)std::min<uint64_t>(length - done, buffer.size()),
+                          (off_t)(offset + done));
+        ok = n > 0 && send_all(fd, std::string(buffer.data(), n));
+        done += ok ? (uint64_t)n : 0;
+    }
+    ok = ok && done == length;
+#endif
+    close(file);
+    return ok;
+}
+
+bool DatasetServer::sums_for(const std::string& path, std::string& text) {
+    // One request computes them while the others for the file wait
+    std::lock_guard<std::mutex> lock(sums_mutex_);
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    auto it = sums_.find(path);
+    if (it != sums_.end() && it->second.modified == (int64_t)st.st_mtime && it->second.size == (uint64_t)st.st_size) {
+        text = it->second.text;
+        return true;
+    }
+
+    int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+        return false;
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    std::ostringstream out;
+    out << (uint64_t)st.st_size << " " << DATASET_CHUNK_BYTES << "\n" << std::hex << std::setfill('0');
+    std::vector<uint8_t> chunk(DATASET_CHUNK_BYTES);
+    uint64_t done = 0;
+    bool ok = true;
+    while (ok && done < (uint64_t)st.st_size) {
+        const size_t want = (size_t)std::min<uint64_t>(DATASET_CHUNK_BYTES, (uint64_t)st.st_size - done);
+        size_t got = 0;
+        while (got < want) {
+            ssize_t n = pread(file, chunk.data() + got, want - got, (off_t)(done + got));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            got += n;
+        }
+        ok = got == want && !stop_.load();
+        out << std::setw(16) << DatasetStore::checksum(chunk.data(), want) << "\n";
+        done += want;
+    }
+    close(file);
+    if (!ok) {
+        return false;
+    }
+
+    // Forget files the store has pruned since
+    for (auto entry = sums_.begin(); entry != sums_.end();) {
+        std::error_code ec;
+        entry = fs::exists(entry->first, ec) ? std::next(entry) : sums_.erase(entry);
+    }
+    Sums& sums = sums_[path];
+    sums.modified = (int64_t)st.st_mtime;
+    sums.size = (uint64_t)st.st_size;
+    sums.text = out.str();
+    text = sums.text;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    LOG_INFO_STREAM("Dataset server: checksummed " << path << " in " << seconds << "s");
+    return true;
+}
+
+DatasetFetcher::DatasetFetcher(const std::string& url, const std::string& dir)
+    : url_(url.empty() || url.back() != '/' ? url : url.substr(0, url.size() - 1)), state_(FETCH_IDLE)
+    , fetched_(0), stop_(false) {
+    store_.set_directory(dir);
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+DatasetFetcher::~DatasetFetcher() {
+    cancel();
+    curl_global_cleanup();
+}
+
+bool DatasetFetcher::settled(const std::vector<uint8_t>& seed_hash) {
+    if (seed_hash.size() != 32 || !store_.enabled()) {
+        return true;
+    }
+    if (seed_hash != seed_) {
+        // A new next seed (or a reorg changed it): whatever came before is of no use
+        cancel();
+        seed_ = seed_hash;
+        fetched_ = 0;
+        if (store_.contains(seed_hash)) {
+            state_ = FETCH_DONE;
+            return true;
+        }
+        state_ = FETCH_WAITING;
+        thread_ = std::thread(&DatasetFetcher::run, this, seed_hash);
+    }
+    const int state = state_.load();
+    return state == FETCH_DONE || state == FETCH_FAILED;
+}
+
+void DatasetFetcher::finish(const std::vector<uint8_t>& seed_hash) {
+    if (seed_hash != seed_ || !thread_.joinable()) {
+        return;
+    }
+    const auto waited_from = std::chrono::steady_clock::now();
+    for (;;) {
+        const int state = state_.load();
+        if (state == FETCH_DONE || state == FETCH_FAILED) {
+            return;
+        }
+        if (state == FETCH_WAITING) {
+            LOG_INFO_STREAM("Dataset source " << url_ << " hasn't got the new epoch, building it here");
+            cancel();
+            return;
+        }
+        // Downloading: wait if the rest should come in time at the rate so far
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point started;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            started = download_started_;
+        }
+        const double elapsed = std::chrono::duration<double>(now - started).count();
+        const double fetched = (double)fetched_.load();
+        const double left = (double)DatasetStore::file_size() - fetched;
+        const double eta = fetched > 0 ? left * elapsed / fetched : elapsed > 2 ? 1e9 : 0;
+        if (eta > DATASET_FETCH_FINISH_SECONDS ||
+            now - waited_from > std::chrono::seconds(2 * DATASET_FETCH_FINISH_SECONDS)) {
+            LOG_WARNING_STREAM("Dataset download from " << url_ << " is too slow to wait for (" << (int)eta
+                               << "s to go), building the new epoch here");
+            cancel();
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+}
+
+void DatasetFetcher::cancel() {
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        thread_.join();
+    }
+    stop_ = false;
+    if (state_.load() != FETCH_DONE && state_.load() != FETCH_IDLE) {
+        state_ = FETCH_FAILED;
+    }
+}
+
+void DatasetFetcher::run(std::vector<uint8_t> seed_hash) {
+    TraceRecorder::set_thread_name("dataset fetch");
+#ifdef __linux__
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), DATASET_STORE_WRITER_NICE);
+#endif
+    const std::string seed_hex = utils::bytes_to_hex(seed_hash.data(), seed_hash.size());
+    const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(DATASET_FETCH_WAIT_SECONDS);
+    std::string sums;
+    bool reported = false;
+    for (;;) {
+        bool not_found = false;
+        if (fetch_sums(seed_hex, sums, not_found)) {
+            break;
+        }
+        if (stop_.load()) {
+            return;
+        }
+        if (!not_found && !reported) {
+            LOG_WARNING_STREAM("Dataset source " << url_ << " unreachable, asking again every "
+                               << DATASET_FETCH_RETRY_SECONDS << "s");
+            reported = true;
+        }
+        if (std::chrono::steady_clock::now() >= give_up) {
+            LOG_WARNING_STREAM("Dataset source " << url_ << " didn't offer the next epoch in time, building it here");
+            state_ = FETCH_FAILED;
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (wake_.wait_for(lock, std::chrono::seconds(DATASET_FETCH_RETRY_SECONDS), [this]() { return stop_.load(); })) {
+            return;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        download_started_ = std::chrono::steady_clock::now();
+    }
+    state_ = FETCH_DOWNLOADING;
+    LOG_INFO_STREAM("Downloading the next RandomX epoch from " << url_ << " (seed " << seed_hex.substr(0, 16) << "...)");
+    const bool ok = download(seed_hex, sums);
+    state_ = ok ? FETCH_DONE : FETCH_FAILED;
+}
+
+bool DatasetFetcher::fetch_sums(const std::string& seed_hex, std::string& text, bool& not_found) {
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+        return false;
+    }
+    // Sums are far smaller than a chunk; the server may spend seconds on them
+    std::vector<uint8_t> body;
+    RangeBuffer buffer = {&body, 1 << 20};
+    const std::string url = url_ + DATASET_PATH_PREFIX + seed_hex + SUMS_SUFFIX;
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_range);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 120L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, fetch_abort);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, (void*)&stop_);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    CURLcode res = curl_easy_perform(curl);
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_cleanup(curl);
+    not_found = res == CURLE_OK && status == 404;
+    if (res != CURLE_OK || status != 200) {
+        if (res == CURLE_OK && !not_found) {
+            LOG_DEBUG_STREAM("Dataset source: " << url << " answered " << status);
+        }
+        return false;
+    }
+    text.assign(body.begin(), body.end());
+    return true;
+}
+
+bool DatasetFetcher::fetch_range(const std::string& url, uint64_t offset, uint64_t length, std::vector<uint8_t>& data) {
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+        return false;
+    }
+    data.clear();
+    RangeBuffer buffer = {&data, length};
+    const std::string range = std::to_string(offset) + "-" + std::to_string(offset + length - 1);
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_range);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    // A link too slow to beat a local build gives up here
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, DATASET_FETCH_MIN_BYTES_PER_SECOND);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, DATASET_FETCH_SLOW_SECONDS);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, fetch_abort);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, (void*)&stop_);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    CURLcode res = curl_easy_perform(curl);
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_cleanup(curl);
+    if (res != CURLE_OK || status != 206) {
+        if (!stop_.load()) {
+            LOG_WARNING_STREAM("Dataset download: bytes " << range << " failed: "
+                               << (res != CURLE_OK ? curl_easy_strerror(res) : "HTTP " + std::to_string(status)));
+        }
+        return false;
+    }
+    return data.size() == length;
+}
+
+bool DatasetFetcher::download(const std::string& seed_hex, const std::string& sums) {
+    // First line: file size and chunk size, then a checksum per chunk
+    std::istringstream in(sums);
+    uint64_t size = 0;
+    uint64_t chunk = 0;
+    in >> size >> chunk;
+    std::vector<uint64_t> checksums;
+    std::string hex;
+    while (in >> hex) {
+        checksums.push_back(std::strtoull(hex.c_str(), nullptr, 16));
+    }
+    if (size != DatasetStore::file_size() || chunk == 0 || checksums.size() != (size + chunk - 1) / chunk) {
+        LOG_WARNING_STREAM("Dataset source " << url_ << " offers an epoch file of another version or RandomX "
+                           "configuration, building it here");
+        return false;
+    }
+
+    std::error_code ec;
+    const std::string& dir = store_.directory();
+    fs::create_directories(dir, ec);
+    fs::space_info space = fs::space(dir, ec);
+    if (ec || space.available < size + DATASET_STORE_DISK_HEADROOM_MB * 1024 * 1024) {
+        LOG_WARNING_STREAM("Not enough disk space in " << dir << " to download the RandomX epoch");
+        return false;
+    }
+
+    std::vector<uint8_t> seed_hash(32);
+    utils::hex_decode(seed_hex.data(), seed_hash.size(), seed_hash.data());
+    const std::string path = store_.path_for(seed_hash);
+    const std::string tmp = path + ".fetch." + std::to_string(getpid());
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        LOG_WARNING_STREAM("Cannot write dataset file " << tmp);
+        return false;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    const std::string url = url_ + DATASET_PATH_PREFIX + seed_hex;
+    std::vector<uint8_t> data;
+    data.reserve(chunk);
+    bool ok = true;
+    for (size_t i = 0; ok && i < checksums.size(); i++) {
+        const uint64_t offset = i * chunk;
+        const uint64_t length = std::min(chunk, size - offset);
+        ok = false;
+        for (int attempt = 0; attempt < 2 && !ok && !stop_.load(); attempt++) {
+            if (!fetch_range(url, offset, length, data)) {
+                break;  // Too slow or gone: a second try won't do better
+            }
+            ok = DatasetStore::checksum(data.data(), data.size()) == checksums[i];
+            if (!ok) {
+                LOG_WARNING_STREAM("Dataset download: chunk " << i << " failed its checksum"
+                                   << (attempt == 0 ? ", fetching it again" : ""));
+            }
+        }
+        ok = ok && fwrite(data.data(), 1, data.size(), f) == data.size();
+        if (ok) {
+            fetched_ += length;
+        }
+    }
+    ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        fs::remove(tmp, ec);
+        if (!stop_.load()) {
+            LOG_WARNING_STREAM("Downloading the next RandomX epoch from " << url_ << " failed, building it here");
+        }
+        return false;
+    }
+    if (!DatasetStore::check_file(tmp, seed_hash, DATASET_FETCH_CHECK_ITEMS)) {
+        fs::remove(tmp, ec);
+        LOG_WARNING_STREAM("The RandomX epoch from " << url_ << " doesn't match its seed, building it here");
+        return false;
+    }
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        LOG_WARNING_STREAM("Cannot store the downloaded RandomX epoch as " << path << ", building it here");
+        return false;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    LOG_INFO_STREAM("RandomX epoch downloaded to " << path << " in " << seconds << "s ("
+                    << (int)(size / (1024 * 1024) / std::max(seconds, 0.001)) << " MB/s)");
+    store_.prune();
+    return true;
+}
+
+DatasetBuilder::DatasetBuilder(const std::string& dir) : abort_(false) {
+    store_.set_directory(dir);
+}
+
+DatasetBuilder::~DatasetBuilder() {
+    abort_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    store_.cancel();
+}
+
+void DatasetBuilder::build(const std::vector<uint8_t>& seed_hash) {
+    if (seed_hash.size() != 32 || seed_hash == seed_ || !store_.enabled()) {
+        return;
+    }
+    // Only this thread and the builder's own touch the store: the build is
+    // over before the writer is
+    abort_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    abort_ = false;
+    store_.cancel();
+    seed_ = seed_hash;
+    if (store_.contains(seed_hash)) {
+        return;
+    }
+    thread_ = std::thread(&DatasetBuilder::run, this, seed_hash);
+}
+
+void DatasetBuilder::run(std::vector<uint8_t> seed_hash) {
+    TraceRecorder::set_thread_name("dataset build");
+#ifdef __linux__
+    // Inherited by the init workers: the proxy's own work comes first
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), DATASET_STORE_WRITER_NICE);
+#endif
+    auto t0 = std::chrono::steady_clock::now();
+    LOG_INFO_STREAM("Building the RandomX epoch for seed " << utils::bytes_to_hex(seed_hash.data(), 8)
+                    << "... to serve");
+    randomx_cache* cache = randomx_alloc_cache(randomx_get_flags());
+    randomx_dataset* dataset = cache ? randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT) : nullptr;
+    if (!cache || !dataset) {
+        LOG_WARNING("Can't allocate a RandomX dataset to serve (out of memory?)");
+        if (cache) randomx_release_cache(cache);
+        return;
+    }
+    randomx_init_cache(cache, seed_hash.data(), seed_hash.size());
+    DatasetInitializer init(cache);
+    init.set_abort_flag(&abort_);
+    init.add_dataset(dataset, std::vector<int>());
+    init.run();
+    if (abort_.load()) {
+        randomx_release_dataset(dataset);
+        randomx_release_cache(cache);
+        return;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    LOG_INFO_STREAM("RandomX epoch to serve built in " << seconds << "s");
+    // The writer frees both once the file is written
+    store_.save_async(seed_hash, cache, dataset, true, true);
+}
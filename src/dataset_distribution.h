@@ -0,0 +1,186 @@
+#ifndef DATASET_DISTRIBUTION_H
+#define DATASET_DISTRIBUTION_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "dataset_store.h"
+#include "event_loop.h"
+
+// Piece of an epoch file a rig fetches, verifies and (once) fetches again at
+// a time; the server keeps a checksum of each
+static const uint64_t DATASET_CHUNK_BYTES = 64 << 20;
+// Downloads one server sends at once; more get a 503 and ask again
+static const size_t DATASET_SERVE_MAX_TRANSFERS = 8;
+static const int DATASET_SERVE_REQUEST_TIMEOUT_SECONDS = 5;
+static const size_t DATASET_SERVE_MAX_REQUEST = 4096;
+// A rig that takes no data for this long is dropped
+static const int DATASET_SERVE_SEND_TIMEOUT_SECONDS = 30;
+// Rig: while the builder hasn't got the epoch, ask again this often, for
+// at most this long before building it locally
+static const int DATASET_FETCH_RETRY_SECONDS = 30;
+static const int DATASET_FETCH_WAIT_SECONDS = 1800;
+// Rig: a download under this speed for this long is given up on
+static const long DATASET_FETCH_MIN_BYTES_PER_SECOND = 4 << 20;
+static const long DATASET_FETCH_SLOW_SECONDS = 20;
+// Rig: at the epoch change, a download expected to need longer than this
+// is dropped for a local build
+static const int DATASET_FETCH_FINISH_SECONDS = 30;
+// Rig: dataset items recomputed from the seed to check a downloaded epoch
+static const unsigned int DATASET_FETCH_CHECK_ITEMS = 48;
+
+// Serves the epoch files of a dataset store directory to the rigs of a
+// fleet (--dataset-serve), so one builder spends the CPU time on an epoch
+// and the rest download it. Plain HTTP from its own thread:
+//   GET /dataset/SEED        the file, with Range support, sent with
+//                            sendfile from a thread per transfer
+//   GET /dataset/SEED/sums   its size, DATASET_CHUNK_BYTES and one
+//                            DatasetStore::checksum per chunk, in hex
+// SEED is the seed hash in hex. Only complete files are found: the store
+// writes aside and renames. Checksums are computed on the first request
+// for a file and kept while it is unchanged.
+class DatasetServer {
+public:
+    explicit DatasetServer(const std::string& dir);
+    ~DatasetServer();
+
+    DatasetServer(const DatasetServer&) = delete;
+    DatasetServer& operator=(const DatasetServer&) = delete;
+
+    // Listen on host:port (host may be empty or 0.0.0.0 for every interface).
+    // False with error set if the socket can't be bound.
+    bool listen(const std::string& address, std::string& error);
+    void start();
+    void stop();
+    bool running() const { return thread_.joinable(); }
+
+private:
+    struct Connection {
+        int fd;
+        std::string request;
+        std::chrono::steady_clock::time_point opened;
+    };
+    struct Transfer {
+        int fd;
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+    struct Sums {
+        int64_t modified;
+        uint64_t size;
+        std::string text;
+    };
+
+    DatasetStore store_;
+    int listen_fd_;
+    EventLoop events_;
+    std::thread thread_;
+    std::atomic<bool> stop_;
+
+    std::mutex sums_mutex_;
+    std::map<std::string, Sums> sums_;  // By path (guarded by sums_mutex_)
+
+    // Server thread only
+    std::vector<Connection> connections_;
+    std::vector<Transfer> transfers_;
+
+    void run();
+    void accept_connections();
+    // False once the connection is done with (handed over, answered or broken)
+    bool read_request(Connection& connection);
+    // Transfer thread: answer one complete request (fd is closed by reap_transfers)
+    void serve(int fd, std::string request);
+    bool send_file(int fd, const std::string& path, uint64_t offset, uint64_t length);
+    // The sums page for path, computed unless kept; false if it can't be read
+    bool sums_for(const std::string& path, std::string& text);
+    void reap_transfers(bool all);
+};
+
+// Fetch states (DatasetFetcher)
+enum FetchState {
+    FETCH_IDLE,
+    FETCH_WAITING,       // Asking the server until it has the epoch
+    FETCH_DOWNLOADING,
+    FETCH_DONE,          // In the store
+    FETCH_FAILED         // Build it locally
+};
+
+// Rig side of --dataset-source: downloads the next epoch's file from a
+// DatasetServer into the dataset store before the epoch change, where the
+// background build (or update_seed) then maps it in as if built here.
+// Each chunk is checked against the server's checksums and fetched again
+// once if it fails. The finished file is then checked against the seed
+// itself (DatasetStore::check_file), since the checksums come from the same
+// server. Anything that goes wrong (no server, the builder never gets the
+// epoch, a bad chunk twice, a file that doesn't match its seed, a link
+// under DATASET_FETCH_MIN_BYTES_PER_SECOND) leaves the epoch to a local
+// build.
+// Called from the main loop only; the download runs on a thread of its own.
+class DatasetFetcher {
+public:
+    // url: the server's base URL (http://builder:18300)
+    DatasetFetcher(const std::string& url, const std::string& dir);
+    ~DatasetFetcher();
+
+    DatasetFetcher(const DatasetFetcher&) = delete;
+    DatasetFetcher& operator=(const DatasetFetcher&) = delete;
+
+    // Whether the epoch for seed_hash is settled: in the store, or given up
+    // on. Starts fetching it otherwise, dropping a fetch of another seed.
+    bool settled(const std::vector<uint8_t>& seed_hash);
+    // At the change to seed_hash: wait for a download that should finish
+    // within DATASET_FETCH_FINISH_SECONDS, drop any other fetch of it
+    void finish(const std::vector<uint8_t>& seed_hash);
+
+private:
+    const std::string url_;
+    DatasetStore store_;
+    std::vector<uint8_t> seed_;     // Seed of the fetch below
+    std::thread thread_;
+    std::atomic<int> state_;        // FetchState
+    std::atomic<uint64_t> fetched_; // Bytes written so far
+    std::chrono::steady_clock::time_point download_started_;  // Guarded by mutex_
+    std::atomic<bool> stop_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+
+    void cancel();
+    void run(std::vector<uint8_t> seed_hash);
+    // The server's sums page; false with not_found set if it hasn't got the file
+    bool fetch_sums(const std::string& seed_hex, std::string& text, bool& not_found);
+    bool download(const std::string& seed_hex, const std::string& sums);
+    bool fetch_range(const std::string& url, uint64_t offset, uint64_t length, std::vector<uint8_t>& data);
+};
+
+// Builds epochs into a dataset store for a DatasetServer where no miner
+// builds them (--proxy with --dataset-serve): the cache and dataset live
+// only for the build and the write, at the background writer's priority.
+class DatasetBuilder {
+public:
+    explicit DatasetBuilder(const std::string& dir);
+    ~DatasetBuilder();
+
+    DatasetBuilder(const DatasetBuilder&) = delete;
+    DatasetBuilder& operator=(const DatasetBuilder&) = delete;
+
+    // Build and store the epoch for seed_hash unless it is stored or being
+    // built already; a build of another seed is dropped
+    void build(const std::vector<uint8_t>& seed_hash);
+
+private:
+    DatasetStore store_;
+    std::vector<uint8_t> seed_;
+    std::thread thread_;
+    std::atomic<bool> abort_;
+
+    void run(std::vector<uint8_t> seed_hash);
+};
+
+#endif // DATASET_DISTRIBUTION_H
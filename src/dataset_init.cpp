@@ -0,0 +1,128 @@
+#include "dataset_init.h"
+#include "logger.h"
+#include "cpu_topology.h"
+#include "trace_recorder.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+void DatasetInitializer::add_dataset(randomx_dataset* dataset, const std::vector<int>& cpu_ids, unsigned long item_count) {
+    DatasetInitJob job;
+    job.dataset = dataset;
+    job.start_item = 0;
+    job.item_count = item_count ? item_count : randomx_dataset_item_count();
+    job.cpu_ids = cpu_ids;
+    jobs_.push_back(job);
+}
+
+void DatasetInitializer::add_dataset_split(randomx_dataset* dataset, const std::vector<std::vector<int>>& cpu_groups,
+                                           unsigned long item_count) {
+    if (cpu_groups.empty()) {
+        add_dataset(dataset, std::vector<int>(), item_count);
+        return;
+    }
+
+    if (item_count == 0) {
+        item_count = randomx_dataset_item_count();
+    }
+    const unsigned long slices = (item_count + DATASET_INIT_SLICE_ITEMS - 1) / DATASET_INIT_SLICE_ITEMS;
+
+    size_t total_cpus = 0;
+    for (const auto& group : cpu_groups) {
+        total_cpus += group.size();
+    }
+
+    // Parts proportional to each group's CPU count, on slice boundaries
+    unsigned long slice = 0;
+    size_t cpus_so_far = 0;
+    for (size_t g = 0; g < cpu_groups.size(); g++) {
+        cpus_so_far += cpu_groups[g].size();
+        unsigned long end_slice = (g + 1 == cpu_groups.size() || total_cpus == 0)
+            ? slices
+            : (unsigned long)(slices * cpus_so_far / total_cpus);
+        if (end_slice <= slice) {
+            continue;
+        }
+
+        DatasetInitJob job;
+        job.dataset = dataset;
+        job.start_item = slice * DATASET_INIT_SLICE_ITEMS;
+        job.item_count = std::min(end_slice * DATASET_INIT_SLICE_ITEMS, item_count) - job.start_item;
+        job.cpu_ids = cpu_groups[g];
+        jobs_.push_back(job);
+        slice = end_slice;
+    }
+}
+
+unsigned int DatasetInitializer::run() {
+    // One work-queue cursor per job, each on its own cache line
+    struct alignas(64) Cursor {
+        std::atomic<unsigned long> next;
+    };
+    std::unique_ptr<Cursor[]> cursors(new Cursor[jobs_.size()]);
+    for (size_t j = 0; j < jobs_.size(); j++) {
+        cursors[j].next.store(0);
+    }
+
+    unsigned int hw_threads = std::thread::hardware_concurrency();
+    if (hw_threads == 0) hw_threads = 1;
+
+    size_t total_workers = 0;
+    for (const DatasetInitJob& job : jobs_) {
+        total_workers += job.cpu_ids.empty() ? hw_threads : job.cpu_ids.size();
+    }
+    // Each worker fills in its own entry
+    workers_.assign(total_workers, DatasetInitWorker());
+
+    std::vector<std::thread> workers;
+    for (size_t j = 0; j < jobs_.size(); j++) {
+        const DatasetInitJob& job = jobs_[j];
+        size_t num_workers = job.cpu_ids.empty() ? hw_threads : job.cpu_ids.size();
+
+        for (size_t w = 0; w < num_workers; w++) {
+            int cpu_id = job.cpu_ids.empty() ? -1 : job.cpu_ids[w];
+            Cursor* cursor = &cursors[j];
+            randomx_cache* cache = cache_;
+            const std::atomic<bool>* abort = abort_;
+            DatasetInitWorker* stats = &workers_[workers.size()];
+
+            workers.emplace_back([&job, cursor, cache, abort, cpu_id, stats]() {
+                TraceRecorder::set_thread_name(cpu_id >= 0 ? "dataset init on CPU " + std::to_string(cpu_id)
+                                                           : std::string("dataset init"));
+                TraceScope span("init", "dataset init worker");
+                auto t0 = std::chrono::steady_clock::now();
+                if (cpu_id >= 0 && !pin_current_thread(cpu_id)) {
+                    LOG_WARNING_STREAM("Dataset init: failed to pin worker to CPU " << cpu_id);
+                } else if (cpu_id < 0 && !pin_current_thread_to_hashing_cpus()) {
+                    LOG_WARNING("Dataset init: failed to move a worker off the housekeeping CPUs");
+                }
+                unsigned long items = 0;
+                for (;;) {
+                    if (abort && abort->load(std::memory_order_relaxed)) {
+                        break;
+                    }
+                    unsigned long offset = cursor->next.fetch_add(DATASET_INIT_SLICE_ITEMS, std::memory_order_relaxed);
+                    if (offset >= job.item_count) {
+                        break;
+                    }
+                    unsigned long count = std::min(DATASET_INIT_SLICE_ITEMS, job.item_count - offset);
+                    randomx_init_dataset(job.dataset, cache, job.start_item + offset, count);
+                    items += count;
+                }
+                span.set_arg((int64_t)items);
+                stats->cpu_id = cpu_id;
+                stats->items = items;
+                stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            });
+        }
+    }
+
+    for (auto& t : workers) {
+        t.join();
+    }
+
+    LOG_DEBUG_STREAM("Dataset init: " << jobs_.size() << " jobs, " << workers.size() << " workers");
+    return (unsigned int)workers.size();
+}
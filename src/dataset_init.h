@@ -0,0 +1,66 @@
+#ifndef DATASET_INIT_H
+#define DATASET_INIT_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "randomx.h"
+
+// Dataset items handed out per work-queue pull: 32768 * 64 bytes = one 2MB
+// page, so a huge page is always written by a single worker (on one node)
+static const unsigned long DATASET_INIT_SLICE_ITEMS = 32768;
+
+// A range of dataset items and the CPUs that should write it. Memory an
+// untouched mapping receives is placed on the node of the first CPU that
+// touches it, so pinning the writers decides where the pages land.
+struct DatasetInitJob {
+    randomx_dataset* dataset;
+    unsigned long start_item;
+    unsigned long item_count;
+    std::vector<int> cpu_ids;  // Pin one worker to each; empty = one unpinned worker per core
+};
+
+// What one init worker got through
+struct DatasetInitWorker {
+    int cpu_id;              // -1 if unpinned
+    unsigned long items;
+    double seconds;          // From its start until the queue ran dry
+
+    DatasetInitWorker() : cpu_id(-1), items(0), seconds(0) {}
+};
+
+// Builds datasets from a cache with every available core. Each job gets its
+// own pool of pinned workers which pull 2MB slices from the job's queue, so
+// fast cores are not left waiting on a static split. All jobs run at once
+// (e.g. one job per NUMA replica init all replicas concurrently).
+class DatasetInitializer {
+public:
+    explicit DatasetInitializer(randomx_cache* cache) : cache_(cache), abort_(nullptr) {}
+
+    // Workers give up at the next slice once *abort is set; the dataset is then incomplete
+    void set_abort_flag(const std::atomic<bool>* abort) { abort_ = abort; }
+
+    void add_job(const DatasetInitJob& job) { jobs_.push_back(job); }
+    bool empty() const { return jobs_.empty(); }
+
+    // Whole-dataset job; item_count limits it to a partial dataset's leading items
+    void add_dataset(randomx_dataset* dataset, const std::vector<int>& cpu_ids, unsigned long item_count = 0);
+
+    // Split one dataset into contiguous, slice-aligned parts, one per CPU
+    // group, so a shared dataset is spread evenly across NUMA nodes
+    void add_dataset_split(randomx_dataset* dataset, const std::vector<std::vector<int>>& cpu_groups,
+                           unsigned long item_count = 0);
+
+    // Initialize every job; blocks until done. Returns the number of workers used.
+    unsigned int run();
+    // Per worker of the last run, for throughput reports
+    const std::vector<DatasetInitWorker>& workers() const { return workers_; }
+
+private:
+    randomx_cache* cache_;
+    const std::atomic<bool>* abort_;
+    std::vector<DatasetInitJob> jobs_;
+    std::vector<DatasetInitWorker> workers_;
+};
+
+#endif // DATASET_INIT_H
@@ -0,0 +1,254 @@
+#include "dataset_share.h"
+#include "logger.h"
+#include "utils.h"
+#include "randomx.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char DATASET_SHARE_MAGIC[8] = {'J', 'U', 'N', 'O', 'R', 'X', 'S', 'H'};
+const char* DATASET_SHARE_PREFIX = "juno-rx-";
+const char* DATASET_SHARE_LOCK = "juno-rx.lock";
+
+const char* SHM_DIRECTORY = "/dev/shm";
+const char* HUGETLBFS_DIRECTORY = "/dev/hugepages";
+const long HUGETLBFS_MAGIC_NUMBER = 0x958458f6;
+
+uint64_t dataset_bytes() {
+    return (uint64_t)randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE;
+}
+
+#ifdef __linux__
+// hugetlbfs when huge pages are wanted and it is mounted, /dev/shm otherwise.
+// Reports the filesystem's page size.
+std::string segment_directory(bool huge_pages, size_t& page_size) {
+    struct statfs fs_info;
+    if (huge_pages && statfs(HUGETLBFS_DIRECTORY, &fs_info) == 0 &&
+        (long)fs_info.f_type == HUGETLBFS_MAGIC_NUMBER && access(HUGETLBFS_DIRECTORY, W_OK) == 0) {
+        page_size = (size_t)fs_info.f_bsize;
+        return HUGETLBFS_DIRECTORY;
+    }
+    page_size = (size_t)sysconf(_SC_PAGESIZE);
+    return SHM_DIRECTORY;
+}
+
+bool lock_file(int fd, int operation) {
+    while (flock(fd, operation) != 0) {
+        if (errno != EINTR) return false;
+    }
+    return true;
+}
+#endif
+
+} // namespace
+
+bool DatasetShare::supported() {
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+void* DatasetShare::attach(const std::vector<uint8_t>& seed_hash, bool huge_pages,
+                           const std::function<bool(void* memory)>& build) {
+    if (!enabled_ || seed_hash.size() != 32) return nullptr;
+#ifdef __linux__
+    size_t page_size = 0;
+    const std::string dir = segment_directory(huge_pages, page_size);
+    const std::string path = (fs::path(dir) / (DATASET_SHARE_PREFIX + utils::bytes_to_hex(seed_hash.data(), 32))).string();
+    if (mapping_ && path == path_) {
+        return (uint8_t*)mapping_ + data_offset_;
+    }
+    detach();
+
+    const std::string lock_path = (fs::path(dir) / DATASET_SHARE_LOCK).string();
+    int lock = open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (lock < 0) {
+        LOG_WARNING_STREAM("Shared dataset: cannot open " << lock_path << ": " << strerror(errno));
+        return nullptr;
+    }
+    if (flock(lock, LOCK_EX | LOCK_NB) != 0) {
+        std::cout << "Waiting for another miner process to finish the shared dataset..." << std::endl;
+        LOG_INFO("Shared dataset: waiting for another process to release the build lock");
+        if (!lock_file(lock, LOCK_EX)) {
+            LOG_WARNING_STREAM("Shared dataset: cannot lock " << lock_path << ": " << strerror(errno));
+            close(lock);
+            return nullptr;
+        }
+    }
+    prune(dir, path);
+    void* memory = open_segment(path, seed_hash, page_size, build);
+    flock(lock, LOCK_UN);
+    close(lock);
+    return memory;
+#else
+    (void)huge_pages;
+    (void)build;
+    return nullptr;
+#endif
+}
+
+void* DatasetShare::open_segment(const std::string& path, const std::vector<uint8_t>& seed_hash, size_t page_size,
+                                 const std::function<bool(void* memory)>& build) {
+#ifdef __linux__
+    const uint64_t dataset_size = dataset_bytes();
+    const size_t offset = std::max(DATASET_SHARE_DATA_OFFSET, page_size);
+    const size_t size = (size_t)((offset + dataset_size + page_size - 1) / page_size * page_size);
+
+    // Register as a user before looking at the segment. Its last user may
+    // have removed it between our open and our lock: then start a new one.
+    int fd = -1;
+    for (int attempt = 0; fd < 0 && attempt < 3; attempt++) {
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            LOG_WARNING_STREAM("Shared dataset: cannot open " << path << ": " << strerror(errno));
+            return nullptr;
+        }
+        struct stat st;
+        if (!lock_file(fd, LOCK_SH) || fstat(fd, &st) != 0 || st.st_nlink == 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd < 0) {
+        LOG_WARNING_STREAM("Shared dataset: cannot register with " << path);
+        return nullptr;
+    }
+
+    // Built by another process (or a run of ours that exited): map it read-only
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (uint64_t)st.st_size == size) {
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            const DatasetShareHeader* header = (const DatasetShareHeader*)mapping;
+            if (memcmp(header->magic, DATASET_SHARE_MAGIC, sizeof(header->magic)) == 0 &&
+                header->version == DATASET_SHARE_VERSION && header->ready == 1 &&
+                memcmp(header->seed_hash, seed_hash.data(), 32) == 0 && header->dataset_size == dataset_size) {
+                fd_ = fd;
+                mapping_ = mapping;
+                mapping_size_ = size;
+                data_offset_ = offset;
+                path_ = path;
+                std::cout << "Attached to shared RandomX dataset " << path << std::endl;
+                LOG_INFO_STREAM("Shared dataset: attached to " << path);
+                return (uint8_t*)mapping + offset;
+            }
+            munmap(mapping, size);
+        }
+    }
+
+    // Not built yet, or left incomplete by a process that died mid-build. We
+    // hold the build lock, so no other process is using it.
+    auto fail = [&](const char* what) -> void* {
+        LOG_WARNING_STREAM("Shared dataset: " << what << " " << path << ": " << strerror(errno));
+        unlink(path.c_str());
+        close(fd);
+        return nullptr;
+    };
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)size) != 0) {
+        return fail("cannot size");
+    }
+    // Reserve the space now: a full tmpfs would otherwise SIGBUS mid-build
+    int err = posix_fallocate(fd, 0, (off_t)size);
+    if (err != 0 && err != EOPNOTSUPP && err != EINVAL) {
+        errno = err;
+        return fail("not enough space for");
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        return fail("cannot map");
+    }
+    madvise((uint8_t*)mapping + offset, dataset_size, MADV_HUGEPAGE);  // tmpfs: THP if shmem_enabled=advise
+
+    auto t0 = std::chrono::steady_clock::now();
+    if (!build((uint8_t*)mapping + offset)) {
+        munmap(mapping, size);
+        errno = 0;
+        return fail("build failed for");
+    }
+    DatasetShareHeader* header = (DatasetShareHeader*)mapping;
+    memcpy(header->magic, DATASET_SHARE_MAGIC, sizeof(header->magic));
+    header->version = DATASET_SHARE_VERSION;
+    memcpy(header->seed_hash, seed_hash.data(), 32);
+    header->dataset_size = dataset_size;
+    __atomic_store_n(&header->ready, 1u, __ATOMIC_RELEASE);
+    mprotect(mapping, size, PROT_READ);
+
+    fd_ = fd;
+    mapping_ = mapping;
+    mapping_size_ = size;
+    data_offset_ = offset;
+    path_ = path;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    LOG_INFO_STREAM("Shared dataset: built " << path << " in " << seconds << "s");
+    return (uint8_t*)mapping + offset;
+#else
+    (void)path;
+    (void)seed_hash;
+    (void)page_size;
+    (void)build;
+    return nullptr;
+#endif
+}
+
+void DatasetShare::detach() {
+#ifdef __linux__
+    if (mapping_) {
+        munmap(mapping_, mapping_size_);
+        mapping_ = nullptr;
+        mapping_size_ = 0;
+    }
+    if (fd_ >= 0) {
+        // The upgrade to exclusive only succeeds once no other process holds the segment
+        if (flock(fd_, LOCK_EX | LOCK_NB) == 0) {
+            unlink(path_.c_str());
+            LOG_DEBUG_STREAM("Shared dataset: last user, removed " << path_);
+        }
+        close(fd_);
+        fd_ = -1;
+    }
+    path_.clear();
+#endif
+}
+
+void DatasetShare::prune(const std::string& dir, const std::string& keep) const {
+#ifdef __linux__
+    // Segments of earlier epochs whose users all crashed would otherwise pin
+    // 2GB each until reboot; a segment nobody holds is not in use
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        const std::string name = it->path().filename().string();
+        const std::string path = it->path().string();
+        if (name.compare(0, strlen(DATASET_SHARE_PREFIX), DATASET_SHARE_PREFIX) != 0 || path == keep) {
+            continue;
+        }
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+            unlink(path.c_str());
+            LOG_INFO_STREAM("Shared dataset: removed unused segment " << path);
+        }
+        close(fd);
+    }
+#else
+    (void)dir;
+    (void)keep;
+#endif
+}
@@ -0,0 +1,73 @@
+#ifndef DATASET_SHARE_H
+#define DATASET_SHARE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Segment layout version; bump when the layout below changes
+static const uint32_t DATASET_SHARE_VERSION = 1;
+
+// The dataset starts one 2MB page into the segment so it stays huge-page
+// aligned (a whole page on hugetlbfs mounts with larger pages)
+static const size_t DATASET_SHARE_DATA_OFFSET = 2 * 1024 * 1024;
+
+// Segment header, at the start of the segment
+struct DatasetShareHeader {
+    char magic[8];          // "JUNORXSH"
+    uint32_t version;       // DATASET_SHARE_VERSION
+    uint32_t ready;         // Set last, once the dataset is complete
+    uint8_t seed_hash[32];
+    uint64_t dataset_size;  // Must match this build's RandomX parameters
+};
+
+// One fast-mode dataset per epoch, shared by every miner process on the host
+// through a named segment in /dev/shm (or hugetlbfs with huge pages), so N
+// processes cost one 2GB dataset instead of N. The first process to ask for a
+// seed builds the segment while holding a host-wide build lock; the others
+// wait on that lock and map the finished dataset read-only. Each user holds
+// a shared flock on its segment, so the last one to leave (or die) is the
+// one whose exclusive upgrade succeeds, and it removes the segment.
+class DatasetShare {
+public:
+    DatasetShare() : enabled_(false), fd_(-1), mapping_(nullptr), mapping_size_(0), data_offset_(0) {}
+    ~DatasetShare() { detach(); }
+
+    DatasetShare(const DatasetShare&) = delete;
+    DatasetShare& operator=(const DatasetShare&) = delete;
+
+    // Linux only
+    static bool supported();
+
+    void set_enabled(bool enable) { enabled_ = enable && supported(); }
+    bool enabled() const { return enabled_; }
+
+    // Map the dataset for this seed, leaving the previous epoch's segment first.
+    // If no process has built it yet, build(memory) must fill the dataset at
+    // memory and return true. Blocks while another process builds. Returns the
+    // dataset memory, or nullptr if the segment can't be created or mapped.
+    void* attach(const std::vector<uint8_t>& seed_hash, bool huge_pages,
+                 const std::function<bool(void* memory)>& build);
+
+    // Unmap; the last process using the segment removes it
+    void detach();
+
+    bool attached() const { return mapping_ != nullptr; }
+    const std::string& path() const { return path_; }
+
+private:
+    void* open_segment(const std::string& path, const std::vector<uint8_t>& seed_hash, size_t page_size,
+                       const std::function<bool(void* memory)>& build);
+    void prune(const std::string& dir, const std::string& keep) const;
+
+    bool enabled_;
+    int fd_;                // Holds our shared flock while attached
+    void* mapping_;
+    size_t mapping_size_;
+    size_t data_offset_;
+    std::string path_;
+};
+
+#endif // DATASET_SHARE_H
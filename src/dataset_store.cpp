@@ -0,0 +1,510 @@
+#include "dataset_store.h"
+#include "logger.h"
+#include "utils.h"
+#include "configuration.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char DATASET_STORE_MAGIC[8] = {'J', 'U', 'N', 'O', 'R', 'X', 'D', 'S'};
+const char* DATASET_STORE_EXTENSION = ".rxds";
+const char* LAST_SEED_FILE = "last-seed";
+
+// Load verifies and copies in L2-sized pieces so each byte is read from the
+// mapping once; the writer checks for cancellation between larger pieces
+const size_t LOAD_CHUNK_BYTES = 1 << 20;
+const size_t WRITE_CHUNK_BYTES = 64 << 20;
+
+const uint64_t CHECKSUM_BASIS = 0xcbf29ce484222325ULL;
+const uint64_t CHECKSUM_PRIME = 0x100000001b3ULL;
+
+// FNV-1a over 64-bit words in four independent lanes, so it runs at memory
+// speed; catches truncation and bit rot, not tampering
+class Checksum {
+public:
+    Checksum() {
+        for (int l = 0; l < 4; l++) lanes_[l] = CHECKSUM_BASIS ^ (uint64_t)l;
+    }
+
+    // Streaming is exact as long as every call but the last covers a multiple of 32 bytes
+    void update(const uint8_t* data, size_t size) {
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            for (int l = 0; l < 4; l++) {
+                uint64_t word;
+                memcpy(&word, data + i + 8 * l, 8);
+                lanes_[l] = (lanes_[l] ^ word) * CHECKSUM_PRIME;
+            }
+        }
+        for (; i < size; i++) {
+            lanes_[0] = (lanes_[0] ^ data[i]) * CHECKSUM_PRIME;
+        }
+    }
+
+    uint64_t value() const {
+        uint64_t h = CHECKSUM_BASIS;
+        for (int l = 0; l < 4; l++) h = (h ^ lanes_[l]) * CHECKSUM_PRIME;
+        return h;
+    }
+
+private:
+    uint64_t lanes_[4];
+};
+
+uint64_t header_checksum(const DatasetFileHeader& header) {
+    Checksum sum;
+    sum.update((const uint8_t*)&header, offsetof(DatasetFileHeader, header_checksum));
+    return sum.value();
+}
+
+uint64_t cache_bytes() {
+    return (uint64_t)RANDOMX_ARGON_MEMORY * 1024;
+}
+
+uint64_t dataset_bytes() {
+    return (uint64_t)randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE;
+}
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() : data_(nullptr), size_(0) {}
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        size_ = (size_t)size.QuadPart;
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_) {
+            close();
+            return false;
+        }
+        data_ = (const uint8_t*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+        if (!data_) {
+            close();
+            return false;
+        }
+        return true;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        size_ = (size_t)st.st_size;
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE;  // Read the whole file in one sequential sweep
+#endif
+        void* p = mmap(nullptr, size_, PROT_READ, flags, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            size_ = 0;
+            return false;
+        }
+        madvise(p, size_, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+        madvise(p, size_, MADV_HUGEPAGE);  // Honoured only by filesystems with file THP
+#endif
+        data_ = (const uint8_t*)p;
+        return true;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) munmap((void*)data_, size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+};
+
+// Address space for a whole dataset with no memory behind it until an item
+// is written, so single items can be recomputed at their own offsets
+class SparseDataset {
+public:
+    SparseDataset() : memory_(nullptr), view_(nullptr) {
+#ifdef _WIN32
+        memory_ = (uint8_t*)VirtualAlloc(nullptr, dataset_bytes(), MEM_RESERVE, PAGE_NOACCESS);
+#else
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+        flags |= MAP_NORESERVE;
+#endif
+        void* p = mmap(nullptr, dataset_bytes(), PROT_READ | PROT_WRITE, flags, -1, 0);
+        memory_ = p == MAP_FAILED ? nullptr : (uint8_t*)p;
+#endif
+        if (memory_) {
+            view_ = randomx_create_dataset_view(memory_);
+        }
+    }
+
+    ~SparseDataset() {
+        if (view_) randomx_release_dataset(view_);
+#ifdef _WIN32
+        if (memory_) VirtualFree(memory_, 0, MEM_RELEASE);
+#else
+        if (memory_) munmap(memory_, dataset_bytes());
+#endif
+    }
+
+    SparseDataset(const SparseDataset&) = delete;
+    SparseDataset& operator=(const SparseDataset&) = delete;
+
+    bool valid() const { return view_ != nullptr; }
+
+    // randomx_init_dataset's item, null if its page can't be backed
+    const uint8_t* item(randomx_cache* cache, unsigned long index) {
+        uint8_t* at = memory_ + (uint64_t)index * RANDOMX_DATASET_ITEM_SIZE;
+#ifdef _WIN32
+        if (!VirtualAlloc(at, RANDOMX_DATASET_ITEM_SIZE, MEM_COMMIT, PAGE_READWRITE)) return nullptr;
+#endif
+        randomx_init_dataset(view_, cache, index, 1);
+        return at;
+    }
+
+private:
+    uint8_t* memory_;
+    randomx_dataset* view_;
+};
+
+// Copy while checksumming; true if the checksum matches
+bool copy_verified(uint8_t* dst, const uint8_t* src, uint64_t size, uint64_t expected) {
+    Checksum sum;
+    for (uint64_t off = 0; off < size; off += LOAD_CHUNK_BYTES) {
+        size_t n = (size_t)std::min<uint64_t>(LOAD_CHUNK_BYTES, size - off);
+        sum.update(src + off, n);
+        memcpy(dst + off, src + off, n);
+    }
+    return sum.value() == expected;
+}
+
+// Write in pieces, checksumming as we go; false on I/O error or abort
+bool write_checksummed(FILE* f, const uint8_t* src, uint64_t size, Checksum& sum, const std::atomic<bool>& abort) {
+    for (uint64_t off = 0; off < size; off += WRITE_CHUNK_BYTES) {
+        if (abort.load()) return false;
+        size_t n = (size_t)std::min<uint64_t>(WRITE_CHUNK_BYTES, size - off);
+        sum.update(src + off, n);
+        if (fwrite(src + off, 1, n, f) != n) return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+std::string DatasetStore::default_directory() {
+#ifdef _WIN32
+    const char* local = std::getenv("LOCALAPPDATA");
+    if (local && *local) return (fs::path(local) / "juno-miner").string();
+    return std::string();
+#else
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg) return (fs::path(xdg) / "juno-miner").string();
+    const char* home = std::getenv("HOME");
+    if (home && *home) return (fs::path(home) / ".cache" / "juno-miner").string();
+    return std::string();
+#endif
+}
+
+std::string DatasetStore::path_for(const std::vector<uint8_t>& seed_hash) const {
+    return (fs::path(dir_) / (utils::bytes_to_hex(seed_hash.data(), seed_hash.size()) + DATASET_STORE_EXTENSION)).string();
+}
+
+uint64_t DatasetStore::file_size() {
+    return DATASET_STORE_DATA_OFFSET + cache_bytes() + dataset_bytes();
+}
+
+uint64_t DatasetStore::checksum(const uint8_t* data, size_t size) {
+    Checksum sum;
+    sum.update(data, size);
+    return sum.value();
+}
+
+bool DatasetStore::check_file(const std::string& path, const std::vector<uint8_t>& seed_hash, unsigned int items) {
+    MappedFile file;
+    if (seed_hash.size() != 32 || !file.open(path) || file.size() != file_size()) return false;
+    SparseDataset dataset;
+    randomx_flags flags = randomx_get_flags();
+    randomx_cache* cache = randomx_alloc_cache(flags);
+    if (!cache) {
+        flags = (randomx_flags)(flags & ~RANDOMX_FLAG_JIT);
+        cache = randomx_alloc_cache(flags);
+    }
+    if (!cache || !dataset.valid()) {
+        if (cache) randomx_release_cache(cache);
+        LOG_WARNING("Cannot allocate the memory to check a downloaded RandomX epoch");
+        return false;
+    }
+    randomx_init_cache(cache, seed_hash.data(), seed_hash.size());
+
+    const uint8_t* payload = file.data() + DATASET_STORE_DATA_OFFSET;
+    bool ok = memcmp(randomx_get_cache_memory(cache), payload, cache_bytes()) == 0;
+    // Picked here, so a server can't tell which items will be looked at
+    std::mt19937_64 rng(std::random_device{}());
+    std::uniform_int_distribution<unsigned long> pick(0, randomx_dataset_item_count() - 1);
+    for (unsigned int i = 0; ok && i < items; i++) {
+        const unsigned long index = pick(rng);
+        const uint8_t* item = dataset.item(cache, index);
+        ok = item && memcmp(item, payload + cache_bytes() + (uint64_t)index * RANDOMX_DATASET_ITEM_SIZE,
+                            RANDOMX_DATASET_ITEM_SIZE) == 0;
+    }
+    randomx_release_cache(cache);
+    return ok;
+}
+
+bool DatasetStore::contains(const std::vector<uint8_t>& seed_hash) const {
+    if (!enabled() || seed_hash.size() != 32) return false;
+    std::error_code ec;
+    return fs::exists(path_for(seed_hash), ec);
+}
+
+bool DatasetStore::load(const std::vector<uint8_t>& seed_hash, randomx_cache* cache,
+                        const std::vector<randomx_dataset*>& datasets) const {
+    if (!enabled() || !cache || datasets.empty() || seed_hash.size() != 32) return false;
+
+    const std::string path = path_for(seed_hash);
+    auto t0 = std::chrono::steady_clock::now();
+    MappedFile file;
+    if (!file.open(path)) return false;
+
+    const uint64_t cache_size = cache_bytes();
+    const uint64_t dataset_size = dataset_bytes();
+    DatasetFileHeader header;
+    if (file.size() != file_size()) {
+        LOG_WARNING_STREAM("Ignoring dataset file with unexpected size: " << path);
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, DATASET_STORE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != DATASET_STORE_VERSION || header.header_size != sizeof(DatasetFileHeader) ||
+        header.header_checksum != header_checksum(header) ||
+        memcmp(header.seed_hash, seed_hash.data(), 32) != 0 ||
+        header.cache_size != cache_size || header.dataset_size != dataset_size) {
+        LOG_WARNING_STREAM("Ignoring dataset file from another version or RandomX configuration: " << path);
+        return false;
+    }
+
+    const uint8_t* payload = file.data() + DATASET_STORE_DATA_OFFSET;
+    uint8_t* first = (uint8_t*)randomx_get_dataset_memory(datasets[0]);
+    if (!copy_verified((uint8_t*)randomx_get_cache_memory(cache), payload, cache_size, header.cache_checksum) ||
+        !copy_verified(first, payload + cache_size, dataset_size, header.dataset_checksum)) {
+        LOG_WARNING_STREAM("Dataset file failed its checksum, removing it: " << path);
+        file.close();
+        std::error_code ec;
+        fs::remove(path, ec);
+        return false;
+    }
+    for (size_t i = 1; i < datasets.size(); i++) {
+        memcpy(randomx_get_dataset_memory(datasets[i]), first, dataset_size);
+    }
+    randomx_restore_cache(cache, seed_hash.data(), seed_hash.size());
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    LOG_INFO_STREAM("RandomX epoch loaded from " << path << " in " << seconds << "s");
+    return true;
+}
+
+void DatasetStore::save_async(const std::vector<uint8_t>& seed_hash, randomx_cache* cache, randomx_dataset* dataset,
+                              bool release_cache, bool release_dataset) {
+    if (!enabled() || !cache || !dataset || seed_hash.size() != 32) {
+        if (release_cache && cache) randomx_release_cache(cache);
+        if (release_dataset && dataset) randomx_release_dataset(dataset);
+        return;
+    }
+    cancel();
+    writer_ = std::thread([this, seed_hash, cache, dataset, release_cache, release_dataset]() {
+        write_file(seed_hash, cache, dataset);
+        if (release_cache) randomx_release_cache(cache);
+        if (release_dataset) randomx_release_dataset(dataset);
+    });
+}
+
+void DatasetStore::cancel() {
+    if (writer_.joinable()) {
+        abort_.store(true);
+        writer_.join();
+    }
+    abort_.store(false);
+}
+
+void DatasetStore::write_file(std::vector<uint8_t> seed_hash, randomx_cache* cache, randomx_dataset* dataset) {
+#ifdef __linux__
+    // Stay out of the way of the mining threads
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), DATASET_STORE_WRITER_NICE);
+#endif
+    auto t0 = std::chrono::steady_clock::now();
+    const uint64_t cache_size = cache_bytes();
+    const uint64_t dataset_size = dataset_bytes();
+
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+    if (ec) {
+        LOG_WARNING_STREAM("Cannot create dataset cache directory " << dir_ << ": " << ec.message());
+        return;
+    }
+    fs::space_info space = fs::space(dir_, ec);
+    if (ec || space.available < file_size() + DATASET_STORE_DISK_HEADROOM_MB * 1024 * 1024) {
+        LOG_WARNING_STREAM("Not enough disk space in " << dir_ << " to store the RandomX epoch");
+        return;
+    }
+
+    const std::string path = path_for(seed_hash);
+#ifdef _WIN32
+    const std::string tmp = path + ".tmp." + std::to_string(_getpid());
+#else
+    const std::string tmp = path + ".tmp." + std::to_string(getpid());
+#endif
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        LOG_WARNING_STREAM("Cannot write dataset file " << tmp);
+        return;
+    }
+
+    // Header block first (checksums filled in at the end), then the payload
+    DatasetFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DATASET_STORE_MAGIC, sizeof(header.magic));
+    header.version = DATASET_STORE_VERSION;
+    header.header_size = sizeof(DatasetFileHeader);
+    memcpy(header.seed_hash, seed_hash.data(), 32);
+    header.cache_size = cache_size;
+    header.dataset_size = dataset_size;
+
+    std::vector<uint8_t> header_block(DATASET_STORE_DATA_OFFSET, 0);
+    Checksum cache_sum, dataset_sum;
+    bool ok = fwrite(header_block.data(), 1, header_block.size(), f) == header_block.size() &&
+              write_checksummed(f, (const uint8_t*)randomx_get_cache_memory(cache), cache_size, cache_sum, abort_) &&
+              write_checksummed(f, (const uint8_t*)randomx_get_dataset_memory(dataset), dataset_size, dataset_sum, abort_);
+    if (ok) {
+        header.cache_checksum = cache_sum.value();
+        header.dataset_checksum = dataset_sum.value();
+        header.header_checksum = header_checksum(header);
+        ok = fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, 1, sizeof(header), f) == sizeof(header) && fflush(f) == 0;
+#ifndef _WIN32
+        ok = ok && fsync(fileno(f)) == 0;
+#endif
+    }
+    ok = fclose(f) == 0 && ok;
+
+    if (ok) {
+        fs::rename(tmp, path, ec);
+        ok = !ec;
+    }
+    if (!ok) {
+        fs::remove(tmp, ec);
+        if (!abort_.load()) {
+            LOG_WARNING_STREAM("Writing dataset file " << path << " failed");
+        }
+        return;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    LOG_INFO_STREAM("RandomX epoch saved to " << path << " in " << seconds << "s");
+    prune();
+}
+
+void DatasetStore::prune() const {
+    // Keep the newest DATASET_STORE_KEEP epoch files, oldest go first
+    std::vector<std::pair<fs::file_time_type, fs::path>> files;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir_, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() == DATASET_STORE_EXTENSION) {
+            files.emplace_back(fs::last_write_time(it->path(), ec), it->path());
+        }
+    }
+    if (files.size() <= DATASET_STORE_KEEP) return;
+
+    std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    for (size_t i = DATASET_STORE_KEEP; i < files.size(); i++) {
+        LOG_DEBUG_STREAM("Removing old dataset file " << files[i].second.string());
+        fs::remove(files[i].second, ec);
+    }
+}
+
+bool DatasetStore::load_last_seed(const std::string& dir, LastSeed& seed) {
+    if (dir.empty()) return false;
+    // One line: the seed hash in hex and its height
+    std::ifstream in((fs::path(dir) / LAST_SEED_FILE).string());
+    std::string hex;
+    uint64_t height = 0;
+    if (!(in >> hex >> height) || hex.size() != 64) return false;
+    std::vector<uint8_t> seed_hash(32);
+    if (!utils::hex_decode(hex.data(), seed_hash.size(), seed_hash.data())) return false;
+    seed.seed_hash = seed_hash;
+    seed.seed_height = height;
+    return true;
+}
+
+void DatasetStore::save_last_seed(const std::string& dir, const LastSeed& seed) {
+    if (dir.empty() || seed.seed_hash.size() != 32) return;
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    // Written aside and renamed, so a restart never reads half of it
+    const std::string path = (fs::path(dir) / LAST_SEED_FILE).string();
+    const std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp);
+        out << utils::bytes_to_hex(seed.seed_hash.data(), seed.seed_hash.size()) << " " << seed.seed_height << std::endl;
+        if (!out) {
+            LOG_WARNING_STREAM("Can't write " << temp);
+            return;
+        }
+    }
+    fs::rename(temp, path, ec);
+    if (ec) {
+        LOG_WARNING_STREAM("Can't replace " << path << ": " << ec.message());
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef DATASET_STORE_H
+#define DATASET_STORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "randomx.h"
+
+// On-disk file format version; bump when the layout below changes
+static const uint32_t DATASET_STORE_VERSION = 1;
+
+// Payload starts on a page boundary so it can be mapped directly
+static const size_t DATASET_STORE_DATA_OFFSET = 4096;
+
+// Epoch files kept on disk (the current one and the one before)
+static const size_t DATASET_STORE_KEEP = 2;
+
+// Free disk space that must remain after writing an epoch file
+static const uint64_t DATASET_STORE_DISK_HEADROOM_MB = 512;
+
+// Nice level of the background writer (Linux)
+static const int DATASET_STORE_WRITER_NICE = 10;
+
+// The seed the miner last mined on, as saved beside the epoch files
+struct LastSeed {
+    std::vector<uint8_t> seed_hash;
+    uint64_t seed_height;
+
+    LastSeed() : seed_height(0) {}
+};
+
+// File header. The cache memory follows at DATASET_STORE_DATA_OFFSET and the
+// dataset right after it; both are checksummed separately from the header.
+struct DatasetFileHeader {
+    char magic[8];              // "JUNORXDS"
+    uint32_t version;           // DATASET_STORE_VERSION
+    uint32_t header_size;       // sizeof(DatasetFileHeader)
+    uint8_t seed_hash[32];
+    uint64_t cache_size;        // Must match this build's RandomX parameters
+    uint64_t dataset_size;
+    uint64_t cache_checksum;
+    uint64_t dataset_checksum;
+    uint64_t header_checksum;   // Over every field above
+};
+
+// Persists fully built epochs (cache + dataset), keyed by seed hash, so a
+// restarted miner maps the files back in instead of spending tens of seconds
+// in Argon2 and dataset generation. Files are written by a background thread
+// to a temporary name and renamed once complete, so a reader never sees a
+// partial file; loads verify checksums before the data is used.
+class DatasetStore {
+public:
+    DatasetStore() : abort_(false) {}
+    ~DatasetStore() { cancel(); }
+
+    DatasetStore(const DatasetStore&) = delete;
+    DatasetStore& operator=(const DatasetStore&) = delete;
+
+    // $XDG_CACHE_HOME/juno-miner, ~/.cache/juno-miner or %LOCALAPPDATA%\juno-miner
+    static std::string default_directory();
+
+    // Empty disables the store
+    void set_directory(const std::string& dir) { dir_ = dir; }
+    const std::string& directory() const { return dir_; }
+    bool enabled() const { return !dir_.empty(); }
+
+    bool contains(const std::vector<uint8_t>& seed_hash) const;
+    // Where the epoch file for seed_hash is (or would be) kept
+    std::string path_for(const std::vector<uint8_t>& seed_hash) const;
+    // Size of every epoch file this build writes and loads
+    static uint64_t file_size();
+    // The checksum the file uses, over one piece of data (see DatasetServer)
+    static uint64_t checksum(const uint8_t* data, size_t size);
+    // Whether the epoch file at path really is seed_hash's: the cache built
+    // from the seed must match the file's, and so must items dataset items
+    // picked at random and recomputed from it. For files made elsewhere,
+    // which the checksums only protect in transit; costs a cache build.
+    static bool check_file(const std::string& path, const std::vector<uint8_t>& seed_hash, unsigned int items);
+
+    // Restore the cache and copy the dataset into every given dataset.
+    // Returns false (leaving the contents undefined) if there is no valid file.
+    bool load(const std::vector<uint8_t>& seed_hash, randomx_cache* cache,
+              const std::vector<randomx_dataset*>& datasets) const;
+
+    // Write the epoch in the background. The cache and dataset must stay
+    // allocated and unchanged until the write finishes or cancel() returns.
+    // With release_cache (release_dataset) the store owns the cache (the
+    // dataset) and frees it when done.
+    void save_async(const std::vector<uint8_t>& seed_hash, randomx_cache* cache, randomx_dataset* dataset,
+                    bool release_cache = false, bool release_dataset = false);
+
+    // Abort an in-flight write (its temporary file is removed) and wait for it
+    void cancel();
+
+    // The seed last mined on, kept in dir so a restart can start building
+    // its epoch before the node answers. Load is false if none was saved;
+    // save is best effort (a failure is only logged).
+    static bool load_last_seed(const std::string& dir, LastSeed& seed);
+    static void save_last_seed(const std::string& dir, const LastSeed& seed);
+
+    // Remove all but the newest DATASET_STORE_KEEP epoch files
+    void prune() const;
+
+private:
+    void write_file(std::vector<uint8_t> seed_hash, randomx_cache* cache, randomx_dataset* dataset);
+
+    std::string dir_;
+    std::thread writer_;
+    std::atomic<bool> abort_;
+};
+
+#endif // DATASET_STORE_H
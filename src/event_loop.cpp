@@ -0,0 +1,84 @@
+#include "event_loop.h"
+#include "logger.h"
+#include <cerrno>
+#include <cstdint>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+EventLoop::EventLoop() : read_fd_(-1), write_fd_(-1), watch_input_(false) {
+#ifdef __linux__
+    read_fd_ = write_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+    if (read_fd_ < 0) {
+        int fds[2];
+        if (pipe(fds) == 0) {
+            for (int fd : fds) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+            read_fd_ = fds[0];
+            write_fd_ = fds[1];
+        } else {
+            // wait() then degrades to sleeping until the deadline
+            LOG_WARNING("Failed to create the main loop wake-up pipe");
+        }
+    }
+}
+
+EventLoop::~EventLoop() {
+    if (write_fd_ >= 0 && write_fd_ != read_fd_) {
+        close(write_fd_);
+    }
+    if (read_fd_ >= 0) {
+        close(read_fd_);
+    }
+}
+
+void EventLoop::wake() {
+    if (write_fd_ < 0) {
+        return;
+    }
+    // A full pipe or a saturated eventfd already means "wake up"
+    uint64_t one = 1;
+    ssize_t written = write(write_fd_, &one, write_fd_ == read_fd_ ? sizeof(one) : 1);
+    (void)written;
+}
+
+bool EventLoop::wait(std::chrono::steady_clock::time_point deadline) {
+    std::vector<struct pollfd> fds(2 + watch_fds_.size() + writable_fds_.size());
+    nfds_t count = 0;
+    if (read_fd_ >= 0) {
+        fds[count++] = {read_fd_, POLLIN, 0};
+    }
+    int input_index = -1;
+    if (watch_input_) {
+        input_index = static_cast<int>(count);
+        fds[count++] = {STDIN_FILENO, POLLIN, 0};
+    }
+    for (int fd : watch_fds_) {
+        fds[count++] = {fd, POLLIN, 0};
+    }
+    for (int fd : writable_fds_) {
+        fds[count++] = {fd, POLLOUT, 0};
+    }
+
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    // Round up so a wait doesn't return just before its deadline and spin
+    int timeout_ms = remaining <= 0 ? 0 : static_cast<int>(remaining) + 1;
+    int ready = poll(fds.data(), count, timeout_ms);
+    if (ready <= 0) {
+        return false;  // Timeout, or EINTR from a signal (which also calls wake())
+    }
+
+    if (read_fd_ >= 0 && (fds[0].revents & POLLIN)) {
+        uint64_t drained[8];
+        while (read(read_fd_, drained, sizeof(drained)) > 0) {
+        }
+    }
+    return input_index >= 0 && (fds[input_index].revents & POLLIN);
+}
@@ -0,0 +1,46 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <chrono>
+#include <vector>
+
+// What the mining control loop sleeps in: poll() on a wake-up pipe (an
+// eventfd on Linux) and optionally stdin, with the nearest timer as the
+// timeout. Worker threads (a solution), the template threads (long poll,
+// ZMQ) and signal handlers call wake(), so each is handled the moment it
+// happens instead of at the next fixed tick.
+class EventLoop {
+public:
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Also return when stdin has input (keyboard commands)
+    void watch_input(bool enable) { watch_input_ = enable; }
+    // Also return when this descriptor is readable (a socket), -1 for none
+    void watch_fd(int fd) { watch_fds_.assign(fd >= 0 ? 1 : 0, fd); }
+    // Same for several (a listening socket and its connections)
+    void watch_fds(const std::vector<int>& fds) { watch_fds_ = fds; }
+    // Also return when any of these is writable (connections with output
+    // waiting to be sent)
+    void watch_writable_fds(const std::vector<int>& fds) { writable_fds_ = fds; }
+
+    // Make the current (or next) wait return. Safe from any thread and from
+    // signal handlers.
+    void wake();
+
+    // Sleep until woken, input arrives or the deadline passes. Returns true
+    // if stdin is readable.
+    bool wait(std::chrono::steady_clock::time_point deadline);
+
+private:
+    int read_fd_;
+    int write_fd_;  // Same as read_fd_ for an eventfd
+    bool watch_input_;
+    std::vector<int> watch_fds_;
+    std::vector<int> writable_fds_;
+};
+
+#endif // EVENT_LOOP_H
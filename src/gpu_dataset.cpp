@@ -0,0 +1,302 @@
+#include "gpu_dataset.h"
+#include "configuration.h"
+#include "logger.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#ifdef HAVE_OPENCL
+#define CL_TARGET_OPENCL_VERSION 120
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// randomx::calcDatasetItem for one item per work item. The programs come from
+// randomx_get_superscalar_program: per program its first instruction, length
+// and address register in programs[], the instructions in code[].
+static const char* const GPU_DATASET_KERNEL = R"CL(
+typedef struct {
+    uchar opcode;
+    uchar dst;
+    uchar src;
+    uchar shift;
+    uint reserved;
+    ulong imm;
+} superscalar_instr;
+
+__kernel void init_dataset(__global const ulong* cache, __global const superscalar_instr* code,
+                           __global const uint* programs, uint program_count,
+                           ulong cache_line_mask, ulong start_item, __global ulong* out)
+{
+    const ulong item = start_item + get_global_id(0);
+    ulong r[8];
+    r[0] = (item + 1) * 6364136223846793005UL;
+    r[1] = r[0] ^ 9298411001130361340UL;
+    r[2] = r[0] ^ 12065312585734608966UL;
+    r[3] = r[0] ^ 9306329213124626780UL;
+    r[4] = r[0] ^ 5281919268842080866UL;
+    r[5] = r[0] ^ 10536153434571861004UL;
+    r[6] = r[0] ^ 3398623926847679864UL;
+    r[7] = r[0] ^ 9549104520008361294UL;
+
+    ulong register_value = item;
+    for (uint p = 0; p < program_count; ++p) {
+        __global const ulong* mix = cache + (register_value & cache_line_mask) * 8;
+        __global const superscalar_instr* instr = code + programs[3 * p];
+        __global const superscalar_instr* end = instr + programs[3 * p + 1];
+        for (; instr < end; ++instr) {
+            const ulong src = r[instr->src];
+            ulong dst = r[instr->dst];
+            switch (instr->opcode) {
+            case 0: dst -= src; break;
+            case 1: dst ^= src; break;
+            case 2: dst += src << instr->shift; break;
+            case 3: dst *= src; break;
+            case 4: dst = (dst >> instr->shift) | (dst << ((64 - instr->shift) & 63)); break;
+            case 5: case 7: case 9: dst += instr->imm; break;
+            case 6: case 8: case 10: dst ^= instr->imm; break;
+            case 11: dst = mul_hi(dst, src); break;
+            case 12: dst = (ulong)mul_hi((long)dst, (long)src); break;
+            case 13: dst *= instr->imm; break;
+            }
+            r[instr->dst] = dst;
+        }
+        for (int q = 0; q < 8; ++q) {
+            r[q] ^= mix[q];
+        }
+        register_value = r[programs[3 * p + 2]];
+    }
+
+    __global ulong* item_out = out + get_global_id(0) * 8;
+    for (int q = 0; q < 8; ++q) {
+        item_out[q] = r[q];
+    }
+}
+)CL";
+
+static const size_t CACHE_BYTES = (size_t)RANDOMX_ARGON_MEMORY * 1024;
+static const unsigned int SUPERSCALAR_MAX_SIZE = 3 * RANDOMX_SUPERSCALAR_LATENCY + 2;
+
+struct GpuDatasetBuilder::State {
+    cl_context context = nullptr;
+    cl_command_queue queue = nullptr;
+    cl_program program = nullptr;
+    cl_kernel kernel = nullptr;
+    cl_mem cache = nullptr;     // The epoch's cache memory
+    cl_mem code = nullptr;      // Every program's instructions
+    cl_mem programs = nullptr;  // First instruction, length, address register per program
+    cl_mem output = nullptr;    // One batch of items
+
+    ~State() {
+        if (output) clReleaseMemObject(output);
+        if (programs) clReleaseMemObject(programs);
+        if (code) clReleaseMemObject(code);
+        if (cache) clReleaseMemObject(cache);
+        if (kernel) clReleaseKernel(kernel);
+        if (program) clReleaseProgram(program);
+        if (queue) clReleaseCommandQueue(queue);
+        if (context) clReleaseContext(context);
+    }
+};
+
+static std::string cl_error(const char* call, cl_int err) {
+    return std::string(call) + " failed (OpenCL error " + std::to_string(err) + ")";
+}
+
+// The device'th GPU over all platforms
+static bool find_gpu(unsigned int device, cl_device_id& out, std::string& error) {
+    cl_uint platform_count = 0;
+    if (clGetPlatformIDs(0, nullptr, &platform_count) != CL_SUCCESS || platform_count == 0) {
+        error = "no OpenCL platform";
+        return false;
+    }
+    std::vector<cl_platform_id> platforms(platform_count);
+    clGetPlatformIDs(platform_count, platforms.data(), nullptr);
+    unsigned int seen = 0;
+    for (cl_platform_id platform : platforms) {
+        cl_uint count = 0;
+        if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 0, nullptr, &count) != CL_SUCCESS || count == 0) {
+            continue;
+        }
+        std::vector<cl_device_id> devices(count);
+        clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, count, devices.data(), nullptr);
+        if (device < seen + count) {
+            out = devices[device - seen];
+            return true;
+        }
+        seen += count;
+    }
+    error = seen ? "GPU " + std::to_string(device) + " not found (" + std::to_string(seen) + " available)"
+                 : "no OpenCL GPU";
+    return false;
+}
+
+bool GpuDatasetBuilder::supported() {
+    return true;
+}
+
+bool GpuDatasetBuilder::open(unsigned int device, std::string& error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_.reset();
+
+    cl_device_id id;
+    if (!find_gpu(device, id, error)) {
+        return false;
+    }
+    char name[256] = {0};
+    clGetDeviceInfo(id, CL_DEVICE_NAME, sizeof(name) - 1, name, nullptr);
+    cl_ulong memory = 0;
+    clGetDeviceInfo(id, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(memory), &memory, nullptr);
+    const size_t output_bytes = GPU_DATASET_BATCH_ITEMS * RANDOMX_DATASET_ITEM_SIZE;
+    if (memory < CACHE_BYTES + output_bytes) {
+        error = std::string(name) + " has " + std::to_string(memory >> 20) + " MB, needs "
+              + std::to_string((CACHE_BYTES + output_bytes) >> 20) + " MB";
+        return false;
+    }
+
+    std::unique_ptr<State> state(new State);
+    cl_int err;
+    state->context = clCreateContext(nullptr, 1, &id, nullptr, nullptr, &err);
+    if (!state->context) {
+        error = cl_error("clCreateContext", err);
+        return false;
+    }
+    state->queue = clCreateCommandQueue(state->context, id, 0, &err);
+    if (!state->queue) {
+        error = cl_error("clCreateCommandQueue", err);
+        return false;
+    }
+    const char* source = GPU_DATASET_KERNEL;
+    state->program = clCreateProgramWithSource(state->context, 1, &source, nullptr, &err);
+    if (!state->program) {
+        error = cl_error("clCreateProgramWithSource", err);
+        return false;
+    }
+    err = clBuildProgram(state->program, 1, &id, "", nullptr, nullptr);
+    if (err != CL_SUCCESS) {
+        size_t log_size = 0;
+        clGetProgramBuildInfo(state->program, id, CL_PROGRAM_BUILD_LOG, 0, nullptr, &log_size);
+        std::string log(log_size, '\0');
+        clGetProgramBuildInfo(state->program, id, CL_PROGRAM_BUILD_LOG, log_size, &log[0], nullptr);
+        LOG_ERROR_STREAM("GPU dataset kernel build log:\n" << log);
+        error = cl_error("clBuildProgram", err);
+        return false;
+    }
+    state->kernel = clCreateKernel(state->program, "init_dataset", &err);
+    if (!state->kernel) {
+        error = cl_error("clCreateKernel", err);
+        return false;
+    }
+
+    const size_t code_bytes = RANDOMX_CACHE_ACCESSES * SUPERSCALAR_MAX_SIZE * sizeof(randomx_superscalar_instr);
+    const size_t program_bytes = RANDOMX_CACHE_ACCESSES * 3 * sizeof(cl_uint);
+    state->cache = clCreateBuffer(state->context, CL_MEM_READ_ONLY, CACHE_BYTES, nullptr, &err);
+    if (state->cache) state->code = clCreateBuffer(state->context, CL_MEM_READ_ONLY, code_bytes, nullptr, &err);
+    if (state->code) state->programs = clCreateBuffer(state->context, CL_MEM_READ_ONLY, program_bytes, nullptr, &err);
+    if (state->programs) state->output = clCreateBuffer(state->context, CL_MEM_WRITE_ONLY, output_bytes, nullptr, &err);
+    if (!state->output) {
+        error = cl_error("clCreateBuffer", err);
+        return false;
+    }
+
+    device_name_ = name;
+    state_ = std::move(state);
+    return true;
+}
+
+bool GpuDatasetBuilder::build(randomx_cache* cache, randomx_dataset* dataset, unsigned long item_count,
+                              const std::atomic<bool>* abort) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!state_) {
+        return false;
+    }
+    auto t0 = std::chrono::steady_clock::now();
+
+    // The epoch's programs, flattened back to back
+    std::vector<randomx_superscalar_instr> code(RANDOMX_CACHE_ACCESSES * SUPERSCALAR_MAX_SIZE);
+    std::vector<cl_uint> programs;
+    unsigned int used = 0;
+    for (unsigned int p = 0; p < RANDOMX_CACHE_ACCESSES; p++) {
+        unsigned address_register = 0;
+        unsigned size = randomx_get_superscalar_program(cache, p, &code[used], SUPERSCALAR_MAX_SIZE, &address_register);
+        programs.push_back(used);
+        programs.push_back(size);
+        programs.push_back(address_register);
+        used += size;
+    }
+
+    State& s = *state_;
+    cl_int err = clEnqueueWriteBuffer(s.queue, s.cache, CL_TRUE, 0, CACHE_BYTES, randomx_get_cache_memory(cache),
+                                      0, nullptr, nullptr);
+    if (err == CL_SUCCESS) {
+        err = clEnqueueWriteBuffer(s.queue, s.code, CL_TRUE, 0, used * sizeof(randomx_superscalar_instr),
+                                   code.data(), 0, nullptr, nullptr);
+    }
+    if (err == CL_SUCCESS) {
+        err = clEnqueueWriteBuffer(s.queue, s.programs, CL_TRUE, 0, programs.size() * sizeof(cl_uint),
+                                   programs.data(), 0, nullptr, nullptr);
+    }
+    if (err != CL_SUCCESS) {
+        LOG_ERROR_STREAM("GPU dataset: " << cl_error("clEnqueueWriteBuffer", err));
+        return false;
+    }
+
+    const cl_uint program_count = RANDOMX_CACHE_ACCESSES;
+    const cl_ulong cache_line_mask = CACHE_BYTES / RANDOMX_DATASET_ITEM_SIZE - 1;
+    clSetKernelArg(s.kernel, 0, sizeof(cl_mem), &s.cache);
+    clSetKernelArg(s.kernel, 1, sizeof(cl_mem), &s.code);
+    clSetKernelArg(s.kernel, 2, sizeof(cl_mem), &s.programs);
+    clSetKernelArg(s.kernel, 3, sizeof(cl_uint), &program_count);
+    clSetKernelArg(s.kernel, 4, sizeof(cl_ulong), &cache_line_mask);
+    clSetKernelArg(s.kernel, 6, sizeof(cl_mem), &s.output);
+
+    uint8_t* memory = (uint8_t*)randomx_get_dataset_memory(dataset);
+    for (unsigned long start = 0; start < item_count; start += GPU_DATASET_BATCH_ITEMS) {
+        if (abort && abort->load()) {
+            return false;
+        }
+        const size_t count = std::min(GPU_DATASET_BATCH_ITEMS, item_count - start);
+        const cl_ulong start_item = start;
+        clSetKernelArg(s.kernel, 5, sizeof(cl_ulong), &start_item);
+        err = clEnqueueNDRangeKernel(s.queue, s.kernel, 1, nullptr, &count, nullptr, 0, nullptr, nullptr);
+        if (err != CL_SUCCESS) {
+            LOG_ERROR_STREAM("GPU dataset: " << cl_error("clEnqueueNDRangeKernel", err));
+            return false;
+        }
+        err = clEnqueueReadBuffer(s.queue, s.output, CL_TRUE, 0, count * RANDOMX_DATASET_ITEM_SIZE,
+                                  memory + (size_t)start * RANDOMX_DATASET_ITEM_SIZE, 0, nullptr, nullptr);
+        if (err != CL_SUCCESS) {
+            LOG_ERROR_STREAM("GPU dataset: " << cl_error("clEnqueueReadBuffer", err));
+            return false;
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    LOG_INFO_STREAM("RandomX dataset (" << item_count << " items) built on " << device_name_ << " in " << seconds << "s");
+    return true;
+}
+
+#else
+
+struct GpuDatasetBuilder::State {};
+
+bool GpuDatasetBuilder::supported() {
+    return false;
+}
+
+bool GpuDatasetBuilder::open(unsigned int, std::string& error) {
+    error = "built without OpenCL";
+    return false;
+}
+
+bool GpuDatasetBuilder::build(randomx_cache*, randomx_dataset*, unsigned long, const std::atomic<bool>*) {
+    return false;
+}
+
+#endif
+
+GpuDatasetBuilder::GpuDatasetBuilder() {}
+
+GpuDatasetBuilder::~GpuDatasetBuilder() {}
@@ -0,0 +1,47 @@
+#ifndef GPU_DATASET_H
+#define GPU_DATASET_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "randomx.h"
+
+// Dataset items the GPU computes per kernel launch (64MB of output), which is
+// also how often an abort is noticed and the result copied back
+static const unsigned long GPU_DATASET_BATCH_ITEMS = 1UL << 20;
+
+// Builds RandomX datasets on a GPU through OpenCL: the cache and the epoch's
+// SuperscalarHash programs are uploaded, one work item computes one dataset
+// item, and each batch is read back into the host dataset. Without OpenCL at
+// build time (HAVE_OPENCL) open() always fails and callers keep the CPU build.
+class GpuDatasetBuilder {
+public:
+    GpuDatasetBuilder();
+    ~GpuDatasetBuilder();
+
+    GpuDatasetBuilder(const GpuDatasetBuilder&) = delete;
+    GpuDatasetBuilder& operator=(const GpuDatasetBuilder&) = delete;
+
+    static bool supported();
+
+    // Set up the device'th GPU (counted across all OpenCL platforms) and
+    // compile the kernel. On failure error says why.
+    bool open(unsigned int device, std::string& error);
+    bool is_open() const { return state_ != nullptr; }
+    const std::string& device_name() const { return device_name_; }
+
+    // Fill items [0, item_count) of dataset from an initialized cache; blocks
+    // until done. Builds are serialized, so several threads may call it.
+    // False if the device failed or *abort was set (the dataset is then incomplete).
+    bool build(randomx_cache* cache, randomx_dataset* dataset, unsigned long item_count,
+               const std::atomic<bool>* abort = nullptr);
+
+private:
+    struct State;  // OpenCL objects
+    std::unique_ptr<State> state_;
+    std::string device_name_;
+    std::mutex mutex_;
+};
+
+#endif // GPU_DATASET_H
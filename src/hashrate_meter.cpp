@@ -0,0 +1,94 @@
+#include "hashrate_meter.h"
+#include <algorithm>
+#include <cmath>
+
+void RateAverage::add(double rate, double seconds, double time_constant) {
+    double alpha = 1.0 - std::exp(-seconds / time_constant);
+    value_ += alpha * (rate - value_);
+    weight_ += alpha * (1.0 - weight_);
+}
+
+void HashrateMeter::sample(const std::vector<uint64_t>& thread_counts, std::chrono::steady_clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!sampled_) {
+        sampled_ = true;
+        first_ = now;
+        last_ = now;
+    }
+    double seconds = std::chrono::duration<double>(now - last_).count();
+
+    // A new thread count means new workers: their counts start from zero,
+    // and so do their figures here
+    bool restart = thread_counts.size() != threads_.size();
+    if (restart) {
+        threads_.assign(thread_counts.size(), ThreadState());
+        for (size_t i = 0; i < threads_.size(); i++) {
+            threads_[i].last_count = thread_counts[i];
+            threads_[i].hashes = 0;
+            threads_[i].since = now;
+            threads_[i].stalled = false;
+        }
+    }
+    if (restart || seconds <= 0) {
+        last_ = now;
+        return;
+    }
+
+    uint64_t delta_total = 0;
+    for (size_t i = 0; i < threads_.size(); i++) {
+        ThreadState& thread = threads_[i];
+        // Counts only move forward while the thread count stands
+        uint64_t delta = thread_counts[i] >= thread.last_count ? thread_counts[i] - thread.last_count : 0;
+        thread.last_count = thread_counts[i];
+        thread.hashes += delta;
+        delta_total += delta;
+        for (int window = 0; window < HASHRATE_WINDOWS; window++) {
+            thread.rates[window].add(delta / seconds, seconds, HASHRATE_WINDOW_SECONDS[window]);
+        }
+    }
+    total_hashes_ += delta_total;
+    for (int window = 0; window < HASHRATE_WINDOWS; window++) {
+        rates_[window].add(delta_total / seconds, seconds, HASHRATE_WINDOW_SECONDS[window]);
+    }
+    last_ = now;
+    detect_stalls(now);
+}
+
+void HashrateMeter::detect_stalls(std::chrono::steady_clock::time_point now) {
+    auto settle = std::chrono::duration<double>(HASHRATE_WINDOW_SECONDS[HASHRATE_60S]);
+    std::vector<double> rates;
+    for (const ThreadState& thread : threads_) {
+        if (now - thread.since >= settle) {
+            rates.push_back(thread.rates[HASHRATE_60S].get());
+        }
+    }
+    double median = 0.0;
+    if (rates.size() >= 2) {
+        std::nth_element(rates.begin(), rates.begin() + rates.size() / 2, rates.end());
+        median = rates[rates.size() / 2];
+    }
+    for (ThreadState& thread : threads_) {
+        thread.stalled = median > 0 && now - thread.since >= settle &&
+                         thread.rates[HASHRATE_60S].get() < median * HASHRATE_STALL_FRACTION;
+    }
+}
+
+HashrateSnapshot HashrateMeter::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    HashrateSnapshot snapshot;
+    snapshot.total_hashes = total_hashes_;
+    snapshot.seconds = sampled_ ? std::chrono::duration<double>(last_ - first_).count() : 0.0;
+    for (int window = 0; window < HASHRATE_WINDOWS; window++) {
+        snapshot.rates[window] = rates_[window].get();
+    }
+    for (const ThreadState& thread : threads_) {
+        ThreadHashrate entry;
+        entry.hashes = thread.hashes;
+        for (int window = 0; window < HASHRATE_WINDOWS; window++) {
+            entry.rates[window] = thread.rates[window].get();
+        }
+        entry.stalled = thread.stalled;
+        snapshot.threads.push_back(entry);
+    }
+    return snapshot;
+}
@@ -0,0 +1,91 @@
+#ifndef HASHRATE_METER_H
+#define HASHRATE_METER_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// The hashrate windows the meter keeps, each an exponentially weighted
+// average with the time constant in HASHRATE_WINDOW_SECONDS
+enum HashrateWindow {
+    HASHRATE_10S,
+    HASHRATE_60S,
+    HASHRATE_15M,
+    HASHRATE_WINDOWS
+};
+static const double HASHRATE_WINDOW_SECONDS[HASHRATE_WINDOWS] = {10.0, 60.0, 900.0};
+
+// A worker is stalled when its 60 s rate is below this fraction of the
+// median of all workers' (once it has been sampled for a full minute)
+static const double HASHRATE_STALL_FRACTION = 0.5;
+
+// Exponentially weighted average of a rate sampled at uneven intervals.
+// The weight it has built up is tracked and divided out, so it reads true
+// from the first sample instead of ramping up from zero.
+class RateAverage {
+public:
+    RateAverage() : value_(0), weight_(0) {}
+
+    void add(double rate, double seconds, double time_constant);
+    double get() const { return weight_ > 0 ? value_ / weight_ : 0.0; }
+
+private:
+    double value_;
+    double weight_;
+};
+
+struct ThreadHashrate {
+    uint64_t hashes;                    // Since the meter first saw the thread
+    double rates[HASHRATE_WINDOWS];
+    bool stalled;                       // Far below its peers (see HASHRATE_STALL_FRACTION)
+};
+
+struct HashrateSnapshot {
+    uint64_t total_hashes;              // Every hash sampled, across jobs and thread count changes
+    double seconds;                     // From the first sample to the last
+    double rates[HASHRATE_WINDOWS];
+    std::vector<ThreadHashrate> threads;
+
+    double average() const { return seconds > 0 ? total_hashes / seconds : 0.0; }
+};
+
+// Hashrate metrics that outlive a job. The backend's per-job counters start
+// over with every block template; the meter is fed the per-thread counts
+// from get_thread_hash_counts (which run on across jobs) at a regular
+// interval, and keeps lifetime totals, the HASHRATE_WINDOWS averages and
+// stall state per worker and overall. A change in the thread count starts
+// the per-worker figures over; the overall ones carry on.
+class HashrateMeter {
+public:
+    HashrateMeter() : sampled_(false), total_hashes_(0) {}
+
+    HashrateMeter(const HashrateMeter&) = delete;
+    HashrateMeter& operator=(const HashrateMeter&) = delete;
+
+    void sample(const std::vector<uint64_t>& thread_counts,
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+    // Safe to read from any thread
+    HashrateSnapshot snapshot() const;
+
+private:
+    struct ThreadState {
+        uint64_t last_count;
+        uint64_t hashes;
+        std::chrono::steady_clock::time_point since;
+        RateAverage rates[HASHRATE_WINDOWS];
+        bool stalled;
+    };
+
+    void detect_stalls(std::chrono::steady_clock::time_point now);
+
+    mutable std::mutex mutex_;
+    bool sampled_;
+    std::chrono::steady_clock::time_point first_;
+    std::chrono::steady_clock::time_point last_;
+    uint64_t total_hashes_;
+    RateAverage rates_[HASHRATE_WINDOWS];
+    std::vector<ThreadState> threads_;
+};
+
+#endif // HASHRATE_METER_H
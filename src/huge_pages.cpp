@@ -0,0 +1,297 @@
+#include "huge_pages.h"
+#include "logger.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <ntsecapi.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* NODE_SYSFS = "/sys/devices/system/node";
+const char* GLOBAL_SYSFS = "/sys/kernel/mm/hugepages";
+
+bool read_count(const fs::path& path, size_t& value) {
+    std::ifstream file(path);
+    return file && file >> value;
+}
+
+bool write_count(const fs::path& path, size_t value) {
+    std::ofstream file(path);
+    file << value << std::endl;
+    return (bool)file;
+}
+
+fs::path pool_dir(int node, size_t page_kb) {
+    std::string name = "hugepages-" + std::to_string(page_kb) + "kB";
+    return node < 0 ? fs::path(GLOBAL_SYSFS) / name
+                    : fs::path(NODE_SYSFS) / ("node" + std::to_string(node)) / "hugepages" / name;
+}
+
+// Defragment so the pool can grow: per node where the kernel has it
+void compact(int node) {
+    fs::path path = node < 0 ? fs::path("/proc/sys/vm/compact_memory")
+                             : fs::path(NODE_SYSFS) / ("node" + std::to_string(node)) / "compact";
+    write_count(path, 1);
+}
+
+std::string page_name(size_t page_kb) {
+    return page_kb >= HUGE_PAGE_1GB_KB ? "1GB" : std::to_string(page_kb / 1024) + "MB";
+}
+
+#ifdef _WIN32
+std::string windows_error(DWORD code) {
+    char* text = nullptr;
+    FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+                   nullptr, code, 0, (LPSTR)&text, 0, nullptr);
+    std::string message = text ? text : "error " + std::to_string(code);
+    LocalFree(text);
+    while (!message.empty() && (message.back() == '\n' || message.back() == '\r' || message.back() == '.')) {
+        message.pop_back();
+    }
+    return message;
+}
+
+// Enable SeLockMemoryPrivilege in the process token; ERROR_NOT_ALL_ASSIGNED
+// if the account doesn't hold the right
+DWORD enable_lock_memory_privilege() {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+        return GetLastError();
+    }
+    TOKEN_PRIVILEGES privileges;
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    DWORD error = ERROR_SUCCESS;
+    if (!LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid) ||
+        !AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr)) {
+        error = GetLastError();
+    } else {
+        error = GetLastError();  // ERROR_NOT_ALL_ASSIGNED despite success
+    }
+    CloseHandle(token);
+    return error;
+}
+
+// Give the process's account the right for later sign-ins
+bool grant_lock_memory_right(std::string& why) {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
+        why = windows_error(GetLastError());
+        return false;
+    }
+    DWORD size = 0;
+    GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+    std::vector<BYTE> user(size);
+    bool ok = size > 0 && GetTokenInformation(token, TokenUser, user.data(), size, &size);
+    CloseHandle(token);
+    if (!ok) {
+        why = "can't read the process's account";
+        return false;
+    }
+    LSA_OBJECT_ATTRIBUTES attributes;
+    ZeroMemory(&attributes, sizeof(attributes));
+    LSA_HANDLE policy;
+    NTSTATUS status = LsaOpenPolicy(nullptr, &attributes, POLICY_CREATE_ACCOUNT | POLICY_LOOKUP_NAMES, &policy);
+    if (status == 0) {
+        wchar_t name[] = L"SeLockMemoryPrivilege";
+        LSA_UNICODE_STRING right;
+        right.Buffer = name;
+        right.Length = (USHORT)(wcslen(name) * sizeof(wchar_t));
+        right.MaximumLength = right.Length + sizeof(wchar_t);
+        status = LsaAddAccountRights(policy, reinterpret_cast<TOKEN_USER*>(user.data())->User.Sid, &right, 1);
+        LsaClose(policy);
+    }
+    if (status != 0) {
+        why = windows_error(LsaNtStatusToWinError(status));
+        return false;
+    }
+    return true;
+}
+#endif
+
+}  // namespace
+
+HugePageManager::HugePageManager(const HugePagePlan& plan) : plan_(plan), added_(0) {
+    read_pools();
+}
+
+void HugePageManager::read_pools() {
+    pools_.clear();
+    for (const HugePageNeed& need : plan_) {
+        for (int node : {need.node, -1}) {
+            if (find_pool(node, need.page_kb)) continue;
+            Pool pool = {node, need.page_kb, 0, 0};
+            fs::path dir = pool_dir(node, need.page_kb);
+            if (read_count(dir / "nr_hugepages", pool.total) && read_count(dir / "free_hugepages", pool.free)) {
+                pools_.push_back(pool);
+            }
+        }
+    }
+}
+
+HugePageManager::Pool* HugePageManager::find_pool(int node, size_t page_kb) {
+    for (Pool& pool : pools_) {
+        if (pool.node == node && pool.page_kb == page_kb) return &pool;
+    }
+    return nullptr;
+}
+
+const HugePageManager::Pool* HugePageManager::find_pool(int node, size_t page_kb) const {
+    return const_cast<HugePageManager*>(this)->find_pool(node, page_kb);
+}
+
+bool HugePageManager::grow(Pool& pool, size_t need) {
+    const fs::path dir = pool_dir(pool.node, pool.page_kb);
+    for (int attempt = 0; pool.free < need; attempt++) {
+        if (attempt > HUGE_PAGE_COMPACT_TRIES) {
+            return false;
+        }
+        if (attempt > 0) {
+            compact(pool.node);
+        }
+        // The kernel grants what it can find, possibly less than asked
+        if (!write_count(dir / "nr_hugepages", pool.total + (need - pool.free))) {
+            LOG_WARNING_STREAM("Huge pages: can't write " << (dir / "nr_hugepages").string());
+            return false;
+        }
+        if (!read_count(dir / "nr_hugepages", pool.total) || !read_count(dir / "free_hugepages", pool.free)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool HugePageManager::reserve() {
+#ifdef _WIN32
+    return false;
+#else
+    if (geteuid() != 0 || pools_.empty()) {
+        return false;
+    }
+    // Node pools first; the system-wide pool then only adds what the
+    // kernel-placed allocations lack on top of them
+    std::map<std::pair<int, size_t>, size_t> needs;
+    for (const HugePageNeed& need : plan_) {
+        if (need.node >= 0 && find_pool(need.node, need.page_kb)) {
+            needs[std::make_pair(need.node, need.page_kb)] += need.pages;
+        }
+        needs[std::make_pair(-1, need.page_kb)] += need.pages;
+    }
+    size_t before = 0;
+    for (const Pool& pool : pools_) {
+        if (pool.node < 0) before += pool.total;
+    }
+    bool ok = true;
+    for (int pass = 0; pass < 2; pass++) {
+        for (const auto& entry : needs) {
+            const bool global = entry.first.first < 0;
+            if (global != (pass == 1)) continue;
+            if (global) {
+                read_pools();  // Node pools that grew show up here
+            }
+            Pool* pool = find_pool(entry.first.first, entry.first.second);
+            if (pool && !grow(*pool, entry.second)) {
+                ok = false;
+            }
+        }
+    }
+    read_pools();
+    size_t after = 0;
+    for (const Pool& pool : pools_) {
+        if (pool.node < 0) after += pool.total;
+    }
+    added_ = after > before ? after - before : 0;
+    return ok;
+#endif
+}
+
+std::vector<std::string> HugePageManager::shortfalls() const {
+    // Hand out the free pages in allocation order, as the miner will take them
+    std::map<std::pair<int, size_t>, size_t> left;
+    for (const Pool& pool : pools_) {
+        left[std::make_pair(pool.node, pool.page_kb)] = pool.free;
+    }
+    std::vector<std::string> lines;
+    for (const HugePageNeed& need : plan_) {
+        const bool on_node = need.node >= 0 && find_pool(need.node, need.page_kb);
+        size_t& global = left[std::make_pair(-1, need.page_kb)];
+        size_t available = on_node ? std::min(global, left[std::make_pair(need.node, need.page_kb)]) : global;
+        size_t taken = std::min(available, need.pages);
+        global -= taken;
+        if (on_node) {
+            left[std::make_pair(need.node, need.page_kb)] -= taken;
+        }
+        if (taken < need.pages) {
+            std::ostringstream line;
+            line << need.allocation;
+            if (need.node >= 0) line << " on node " << need.node;
+            line << ": " << need.pages - taken << " of " << need.pages << " " << page_name(need.page_kb) << " pages short";
+            lines.push_back(line.str());
+        }
+    }
+    return lines;
+}
+
+std::string HugePageManager::describe() const {
+    std::map<size_t, std::map<int, size_t>> totals;
+    for (const HugePageNeed& need : plan_) {
+        totals[need.page_kb][need.node] += need.pages;
+    }
+    std::ostringstream text;
+    for (const auto& size : totals) {
+        size_t sum = 0;
+        for (const auto& node : size.second) sum += node.second;
+        text << (text.tellp() > 0 ? ", " : "") << sum << " " << page_name(size.first) << " pages";
+        if (size.second.size() > 1 || size.second.begin()->first >= 0) {
+            text << " (";
+            bool first = true;
+            for (const auto& node : size.second) {
+                text << (first ? "" : ", ") << (node.first < 0 ? std::string("any node") : "node " + std::to_string(node.first))
+                     << ": " << node.second;
+                first = false;
+            }
+            text << ")";
+        }
+    }
+    return text.str();
+}
+
+bool enable_large_pages(std::string& why) {
+#ifdef _WIN32
+    if (GetLargePageMinimum() == 0) {
+        why = "this CPU or Windows version has no large pages";
+        return false;
+    }
+    DWORD error = enable_lock_memory_privilege();
+    if (error == ERROR_SUCCESS) {
+        LOG_DEBUG_STREAM("Large pages: SeLockMemoryPrivilege enabled, " << GetLargePageMinimum() / 1024 << " KB pages");
+        return true;
+    }
+    if (error != ERROR_NOT_ALL_ASSIGNED) {
+        why = "can't enable SeLockMemoryPrivilege: " + windows_error(error);
+        return false;
+    }
+    std::string grant_error;
+    if (grant_lock_memory_right(grant_error)) {
+        why = "granted this account the \"Lock pages in memory\" right; sign out and back in (or restart the "
+              "service) for large pages to work";
+    } else {
+        why = "this account lacks the \"Lock pages in memory\" right and it couldn't be granted (" + grant_error +
+              "); run once as administrator, or add it in secpol.msc under Local Policies > User Rights Assignment";
+    }
+    return false;
+#else
+    (void)why;
+    return true;
+#endif
+}
@@ -0,0 +1,87 @@
+#ifndef HUGE_PAGES_H
+#define HUGE_PAGES_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Huge page sizes, as the kernel names its pools (hugepages-<kB>kB)
+static const size_t HUGE_PAGE_2MB_KB = 2048;
+static const size_t HUGE_PAGE_1GB_KB = 1048576;
+
+// JIT code per VM in the shared arena chunks (randomx JitCodeArena, whose
+// chunks give up one 4 KB page to shared code): the program alone in fast
+// mode, with the SuperscalarHash code in light mode
+static const size_t HUGE_PAGE_JIT_FAST_KB = 16;
+static const size_t HUGE_PAGE_JIT_LIGHT_KB = 80;
+
+// Passes of compaction before giving up on a pool that won't grow
+static const int HUGE_PAGE_COMPACT_TRIES = 2;
+
+// Pages one allocation wants from one pool
+struct HugePageNeed {
+    std::string allocation;   // "dataset", "cache", "scratchpads", "jit"
+    int node;                 // NUMA node, -1 where the kernel picks
+    size_t page_kb;           // HUGE_PAGE_2MB_KB or HUGE_PAGE_1GB_KB
+    size_t pages;
+
+    HugePageNeed(const std::string& what, int numa_node, size_t size_kb, size_t count)
+        : allocation(what), node(numa_node), page_kb(size_kb), pages(count) {}
+};
+
+// What a miner will allocate on huge pages, in allocation order (see
+// MiningBackend::huge_page_plan)
+typedef std::vector<HugePageNeed> HugePagePlan;
+
+// Provisioning of the hugetlb pools for a plan (Linux). The pools are read
+// per NUMA node from /sys/devices/system/node/node*/hugepages and
+// system-wide from /sys/kernel/mm/hugepages. Running as root, reserve()
+// raises nr_hugepages on each node by what its free pages lack (the
+// system-wide pool for allocations the kernel places), compacting memory
+// and trying again where a raise falls short. Pages reserved stay in the
+// pool after the miner exits, as with a reservation made by hand.
+class HugePageManager {
+public:
+    explicit HugePageManager(const HugePagePlan& plan);
+
+    // False if not root or the pools can't be written; what it got is in
+    // shortfalls() either way
+    bool reserve();
+
+    // One line per allocation the free pages don't cover, e.g. "cache on
+    // node 1: 40 of 128 2MB pages short"; empty if everything fits
+    std::vector<std::string> shortfalls() const;
+
+    // Pages reserve() added to the pools, 0 when they needed none or it
+    // was not called
+    size_t pages_added() const { return added_; }
+    // "1299 2MB pages (node 0: 650, node 1: 649)"
+    std::string describe() const;
+
+private:
+    struct Pool {
+        int node;        // -1: system-wide
+        size_t page_kb;
+        size_t total;
+        size_t free;
+    };
+
+    void read_pools();
+    Pool* find_pool(int node, size_t page_kb);
+    const Pool* find_pool(int node, size_t page_kb) const;
+    // Raise a pool's nr_hugepages until need pages are free; false if it fell short
+    bool grow(Pool& pool, size_t need);
+
+    HugePagePlan plan_;
+    std::vector<Pool> pools_;
+    size_t added_;
+};
+
+// Windows: large pages need the account's "Lock pages in memory" right
+// (SeLockMemoryPrivilege) enabled in the process token. Enables it, first
+// granting the account the right through LSA if it lacks it, which needs an
+// elevated process and takes effect at the next sign-in. False with why set
+// if large pages can't be had now. Always true elsewhere.
+bool enable_large_pages(std::string& why);
+
+#endif // HUGE_PAGES_H
@@ -1,15 +1,49 @@
 #include "logger.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
-#include <ctime>
+
+namespace {
+
+// Marks the ring of an exiting thread, so the writer can let it go once
+// it has been drained
+template <typename Ring>
+struct RingHolder {
+    std::shared_ptr<Ring> ring;
+
+    ~RingHolder() {
+        if (ring) {
+            ring->orphaned.store(true, std::memory_order_release);
+        }
+    }
+};
+
+} // namespace
 
 Logger::Logger()
     : min_level_(LogLevel::INFO)
+    , debug_mode_(false)
+    , sinks_(false)
     , console_enabled_(false)
     , file_enabled_(false)
-    , debug_mode_(false) {
+    , cached_second_(-1)
+    , dropped_total_(0)
+    , stop_(false) {
+    cached_timestamp_[0] = '\0';
 }
 
 Logger::~Logger() {
+    if (writer_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        writer_.join();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    drain_locked();
     if (log_file_.is_open()) {
         log_file_.close();
     }
@@ -21,36 +55,78 @@ Logger& Logger::instance() {
 }
 
 void Logger::set_log_level(LogLevel level) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    min_level_ = level;
+    min_level_.store(level, std::memory_order_relaxed);
 }
 
 void Logger::enable_file_logging(const std::string& filename) {
     std::lock_guard<std::mutex> lock(mutex_);
+    drain_locked();
     if (log_file_.is_open()) {
         log_file_.close();
     }
+    log_filename_ = filename;
     log_file_.open(filename, std::ios::out | std::ios::app);
     if (log_file_.is_open()) {
         file_enabled_ = true;
         log_file_ << "\n=== Logging session started at " << get_timestamp() << " ===\n";
         log_file_.flush();
+        last_file_flush_ = std::chrono::steady_clock::now();
+        start_writer();
     } else {
         std::cerr << "Failed to open log file: " << filename << std::endl;
         file_enabled_ = false;
     }
+    sinks_.store(console_enabled_ || file_enabled_, std::memory_order_relaxed);
+}
+
+void Logger::reopen_file() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (log_filename_.empty()) {
+        return;
+    }
+    // What was logged before the reopen belongs in the old file
+    drain_locked();
+    if (log_file_.is_open()) {
+        log_file_.close();
+    }
+    log_file_.open(log_filename_, std::ios::out | std::ios::app);
+    file_enabled_ = log_file_.is_open();
+    sinks_.store(console_enabled_ || file_enabled_, std::memory_order_relaxed);
 }
 
 void Logger::enable_console_logging(bool enable) {
     std::lock_guard<std::mutex> lock(mutex_);
+    drain_locked();
     console_enabled_ = enable;
+    if (enable) {
+        start_writer();
+    }
+    sinks_.store(console_enabled_ || file_enabled_, std::memory_order_relaxed);
 }
 
 void Logger::set_debug_mode(bool enable) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    debug_mode_ = enable;
+    debug_mode_.store(enable, std::memory_order_relaxed);
     if (enable) {
-        min_level_ = LogLevel::DEBUG;
+        min_level_.store(LogLevel::DEBUG, std::memory_order_relaxed);
+    }
+}
+
+bool Logger::enabled(LogLevel level) const {
+    if (!sinks_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    if (level == LogLevel::DEBUG && !debug_mode_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    return static_cast<int>(level) >= static_cast<int>(min_level_.load(std::memory_order_relaxed));
+}
+
+void Logger::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    drain_locked();
+    if (log_file_.is_open()) {
+        log_file_.flush();
+        last_file_flush_ = std::chrono::steady_clock::now();
     }
 }
 
@@ -69,7 +145,7 @@ std::string Logger::get_timestamp() {
     return oss.str();
 }
 
-std::string Logger::level_to_string(LogLevel level) {
+const char* Logger::level_to_string(LogLevel level) {
     switch (level) {
         case LogLevel::DEBUG:   return "DEBUG";
         case LogLevel::INFO:    return "INFO ";
@@ -79,63 +155,207 @@ std::string Logger::level_to_string(LogLevel level) {
     }
 }
 
-bool Logger::should_log(LogLevel level) {
-    if (!debug_mode_ && level == LogLevel::DEBUG) {
+Logger::Ring& Logger::thread_ring() {
+    static thread_local RingHolder<Ring> holder;
+    if (!holder.ring) {
+        holder.ring = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        rings_.push_back(holder.ring);
+    }
+    return *holder.ring;
+}
+
+bool Logger::push(Ring& ring, Entry& entry) {
+    size_t head = ring.head.load(std::memory_order_relaxed);
+    size_t queued = head - ring.tail.load(std::memory_order_acquire);
+    if (queued >= LOG_RING_SLOTS) {
         return false;
     }
-    return static_cast<int>(level) >= static_cast<int>(min_level_);
+    ring.slots[head % LOG_RING_SLOTS] = std::move(entry);
+    ring.head.store(head + 1, std::memory_order_release);
+    // Don't leave a filling ring for the next timed pass
+    if (queued + 1 == LOG_RING_SLOTS / 2) {
+        wake_.notify_one();
+    }
+    return true;
 }
 
-void Logger::log(LogLevel level, const std::string& message,
-                 const char* file, int line) {
-    if (!should_log(level)) {
+void Logger::start_writer() {
+    if (!writer_.joinable()) {
+        writer_ = std::thread(&Logger::writer_loop, this);
+    }
+}
+
+void Logger::writer_loop() {
+    std::unique_lock<std::mutex> wake_lock(wake_mutex_);
+    while (!stop_) {
+        wake_.wait_for(wake_lock, std::chrono::milliseconds(LOG_WRITE_INTERVAL_MS));
+        wake_lock.unlock();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            drain_locked();
+        }
+        wake_lock.lock();
+    }
+}
+
+void Logger::drain_locked() {
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        rings = rings_;
+    }
+
+    bool urgent = false;
+    for (const std::shared_ptr<Ring>& ring : rings) {
+        // Read before head, so a ring seen orphaned here is drained for good below
+        bool orphaned = ring->orphaned.load(std::memory_order_acquire);
+
+        uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            Entry notice;
+            notice.time = std::chrono::system_clock::now();
+            notice.level = LogLevel::WARNING;
+            notice.file = nullptr;
+            notice.line = 0;
+            notice.message = "Logger dropped " + std::to_string(dropped) + " lines, the log writer fell behind";
+            batch_.push_back(std::move(notice));
+        }
+
+        size_t tail = ring->tail.load(std::memory_order_relaxed);
+        size_t head = ring->head.load(std::memory_order_acquire);
+        for (; tail != head; tail++) {
+            Entry& entry = ring->slots[tail % LOG_RING_SLOTS];
+            urgent = urgent || entry.level >= LogLevel::WARNING;
+            batch_.push_back(std::move(entry));
+        }
+        ring->tail.store(head, std::memory_order_release);
+
+        if (orphaned) {
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            rings_.erase(std::remove(rings_.begin(), rings_.end(), ring), rings_.end());
+        }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    bool flush_due = now - last_file_flush_ >= std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS);
+    if (batch_.empty()) {
+        if (flush_due && file_enabled_ && log_file_.is_open()) {
+            log_file_.flush();
+            last_file_flush_ = now;
+        }
         return;
     }
 
-    std::lock_guard<std::mutex> lock(mutex_);
+    // Each ring is in order already; merge them by time
+    std::stable_sort(batch_.begin(), batch_.end(), [](const Entry& a, const Entry& b) {
+        return a.time < b.time;
+    });
+    buffer_.clear();
+    for (const Entry& entry : batch_) {
+        format_entry(entry, buffer_);
+    }
+    batch_.clear();
 
-    std::ostringstream log_line;
-    log_line << "[" << get_timestamp() << "] "
-             << "[" << level_to_string(level) << "] "
-             << message;
+    if (console_enabled_) {
+        std::cout.write(buffer_.data(), (std::streamsize)buffer_.size());
+        std::cout.flush();
+    }
+    if (file_enabled_ && log_file_.is_open()) {
+        log_file_.write(buffer_.data(), (std::streamsize)buffer_.size());
+        if (urgent || flush_due) {
+            log_file_.flush();
+            last_file_flush_ = now;
+        }
+    }
+}
+
+void Logger::format_entry(const Entry& entry, std::string& out) {
+    // localtime_r only once a second; the lines in between share the text
+    std::time_t second = std::chrono::system_clock::to_time_t(entry.time);
+    if (second != cached_second_) {
+        std::tm tm;
+        localtime_r(&second, &tm);
+        std::strftime(cached_timestamp_, sizeof(cached_timestamp_), "%Y-%m-%d %H:%M:%S", &tm);
+        cached_second_ = second;
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        entry.time.time_since_epoch()).count() % 1000;
+    char millis[8];
+    std::snprintf(millis, sizeof(millis), ".%03d", (int)ms);
+
+    out += '[';
+    out += cached_timestamp_;
+    out += millis;
+    out += "] [";
+    out += level_to_string(entry.level);
+    out += "] ";
+    out += entry.message;
 
     // Add file and line info for debug messages
-    if (level == LogLevel::DEBUG && file != nullptr) {
-        // Extract just the filename from the full path
-        std::string filename(file);
-        size_t last_slash = filename.find_last_of("/\\");
-        if (last_slash != std::string::npos) {
-            filename = filename.substr(last_slash + 1);
+    if (entry.level == LogLevel::DEBUG && entry.file != nullptr) {
+        // Just the filename, not the full path
+        const char* filename = entry.file;
+        for (const char* c = entry.file; *c; c++) {
+            if (*c == '/' || *c == '\\') {
+                filename = c + 1;
+            }
         }
-        log_line << " (" << filename << ":" << line << ")";
+        out += " (";
+        out += filename;
+        out += ':';
+        out += std::to_string(entry.line);
+        out += ')';
     }
+    out += '\n';
+}
 
-    std::string final_message = log_line.str();
+void Logger::log(LogLevel level, std::string message,
+                 const char* file, int line) {
+    if (!enabled(level)) {
+        return;
+    }
 
-    // Write to console if enabled
-    if (console_enabled_) {
-        std::cout << final_message << std::endl;
+    Entry entry;
+    entry.time = std::chrono::system_clock::now();
+    entry.level = level;
+    entry.file = file;
+    entry.line = line;
+    entry.message = std::move(message);
+
+    Ring& ring = thread_ring();
+    if (push(ring, entry)) {
+        if (level >= LogLevel::WARNING) {
+            wake_.notify_one();
+        }
+        return;
     }
 
-    // Write to file if enabled
-    if (file_enabled_ && log_file_.is_open()) {
-        log_file_ << final_message << std::endl;
-        log_file_.flush(); // Ensure immediate write
+    // The writer fell behind. Debug and info lines are the ones to lose.
+    if (level < LogLevel::WARNING) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        dropped_total_.fetch_add(1, std::memory_order_relaxed);
+        return;
     }
+    // Warnings and errors wait for the rings to drain instead, which makes
+    // room in this thread's ring (it is the only one filling it)
+    std::lock_guard<std::mutex> lock(mutex_);
+    drain_locked();
+    push(ring, entry);
 }
 
-void Logger::debug(const std::string& message, const char* file, int line) {
-    log(LogLevel::DEBUG, message, file, line);
+void Logger::debug(std::string message, const char* file, int line) {
+    log(LogLevel::DEBUG, std::move(message), file, line);
 }
 
-void Logger::info(const std::string& message) {
-    log(LogLevel::INFO, message);
+void Logger::info(std::string message) {
+    log(LogLevel::INFO, std::move(message));
 }
 
-void Logger::warning(const std::string& message) {
-    log(LogLevel::WARNING, message);
+void Logger::warning(std::string message) {
+    log(LogLevel::WARNING, std::move(message));
 }
 
-void Logger::error(const std::string& message) {
-    log(LogLevel::ERROR, message);
+void Logger::error(std::string message) {
+    log(LogLevel::ERROR, std::move(message));
 }
@@ -7,6 +7,13 @@
 #include <sstream>
 #include <chrono>
 #include <iomanip>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <thread>
+#include <vector>
 
 enum class LogLevel {
     DEBUG,
@@ -15,6 +22,18 @@ enum class LogLevel {
     ERROR
 };
 
+// Lines a thread can have waiting for the writer before it starts dropping
+static const size_t LOG_RING_SLOTS = 1024;
+// How often the writer thread drains the rings, and how often it flushes the file
+static const int LOG_WRITE_INTERVAL_MS = 50;
+static const int LOG_FLUSH_INTERVAL_MS = 1000;
+
+// Logging is asynchronous: a thread's log call only timestamps the message
+// and queues it in that thread's own ring, without a lock. A writer thread
+// formats what the rings hold, merged in time order, and writes it in
+// batches. When a ring is full, debug and info lines are dropped and
+// counted (the writer then reports how many); warnings and errors instead
+// drain the rings on the calling thread, so they are never lost.
 class Logger {
 public:
     static Logger& instance();
@@ -22,17 +41,26 @@ public:
     // Configuration
     void set_log_level(LogLevel level);
     void enable_file_logging(const std::string& filename);
+    // Close and reopen the log file (after logrotate moved it away)
+    void reopen_file();
     void enable_console_logging(bool enable);
     void set_debug_mode(bool enable);
 
+    // Whether a message at this level would go anywhere
+    bool enabled(LogLevel level) const;
+    // Write out everything logged so far
+    void flush();
+    // Lines dropped so far because a thread's ring was full
+    uint64_t dropped() const { return dropped_total_.load(std::memory_order_relaxed); }
+
     // Logging methods
-    void log(LogLevel level, const std::string& message,
+    void log(LogLevel level, std::string message,
              const char* file = nullptr, int line = 0);
 
-    void debug(const std::string& message, const char* file = nullptr, int line = 0);
-    void info(const std::string& message);
-    void warning(const std::string& message);
-    void error(const std::string& message);
+    void debug(std::string message, const char* file = nullptr, int line = 0);
+    void info(std::string message);
+    void warning(std::string message);
+    void error(std::string message);
 
 private:
     Logger();
@@ -42,16 +70,60 @@ private:
     Logger(const Logger&) = delete;
     Logger& operator=(const Logger&) = delete;
 
+    struct Entry {
+        std::chrono::system_clock::time_point time;
+        LogLevel level;
+        const char* file;
+        int line;
+        std::string message;
+    };
+
+    // Single producer (the owning thread), single consumer (whoever holds
+    // mutex_). head and tail only ever grow; a slot is head % LOG_RING_SLOTS.
+    struct Ring {
+        Entry slots[LOG_RING_SLOTS];
+        alignas(64) std::atomic<size_t> head;
+        alignas(64) std::atomic<size_t> tail;
+        std::atomic<uint64_t> dropped;
+        std::atomic<bool> orphaned;  // The thread has exited
+
+        Ring() : head(0), tail(0), dropped(0), orphaned(false) {}
+    };
+
+    Ring& thread_ring();
+    bool push(Ring& ring, Entry& entry);
+    void start_writer();
+    void writer_loop();
+    // Move every queued line out to the sinks; mutex_ must be held
+    void drain_locked();
+    void format_entry(const Entry& entry, std::string& out);
     std::string get_timestamp();
-    std::string level_to_string(LogLevel level);
-    bool should_log(LogLevel level);
+    const char* level_to_string(LogLevel level);
+
+    std::atomic<LogLevel> min_level_;
+    std::atomic<bool> debug_mode_;
+    std::atomic<bool> sinks_;  // console_enabled_ || file_enabled_
 
-    LogLevel min_level_;
+    // Guarded by mutex_, which also makes its holder the rings' consumer
+    std::mutex mutex_;
     bool console_enabled_;
     bool file_enabled_;
-    bool debug_mode_;
     std::ofstream log_file_;
-    std::mutex mutex_;
+    std::string log_filename_;
+    std::chrono::steady_clock::time_point last_file_flush_;
+    std::vector<Entry> batch_;
+    std::string buffer_;
+    std::time_t cached_second_;     // The second cached_timestamp_ is for
+    char cached_timestamp_[32];     // "%Y-%m-%d %H:%M:%S" of it
+
+    std::mutex rings_mutex_;
+    std::vector<std::shared_ptr<Ring>> rings_;  // Guarded by rings_mutex_
+    std::atomic<uint64_t> dropped_total_;
+
+    std::thread writer_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool stop_;  // Guarded by wake_mutex_
 };
 
 // Convenience macros for debug logging with file and line info
@@ -60,33 +132,41 @@ private:
 #define LOG_WARNING(msg) Logger::instance().warning(msg)
 #define LOG_ERROR(msg) Logger::instance().error(msg)
 
-// Stream-style logging macros
+// Stream-style logging macros; the message is only built if it goes anywhere
 #define LOG_DEBUG_STREAM(expr) \
     do { \
-        std::ostringstream oss; \
-        oss << expr; \
-        Logger::instance().debug(oss.str(), __FILE__, __LINE__); \
+        if (Logger::instance().enabled(LogLevel::DEBUG)) { \
+            std::ostringstream oss; \
+            oss << expr; \
+            Logger::instance().debug(oss.str(), __FILE__, __LINE__); \
+        } \
     } while(0)
 
 #define LOG_INFO_STREAM(expr) \
     do { \
-        std::ostringstream oss; \
-        oss << expr; \
-        Logger::instance().info(oss.str()); \
+        if (Logger::instance().enabled(LogLevel::INFO)) { \
+            std::ostringstream oss; \
+            oss << expr; \
+            Logger::instance().info(oss.str()); \
+        } \
     } while(0)
 
 #define LOG_WARNING_STREAM(expr) \
     do { \
-        std::ostringstream oss; \
-        oss << expr; \
-        Logger::instance().warning(oss.str()); \
+        if (Logger::instance().enabled(LogLevel::WARNING)) { \
+            std::ostringstream oss; \
+            oss << expr; \
+            Logger::instance().warning(oss.str()); \
+        } \
     } while(0)
 
 #define LOG_ERROR_STREAM(expr) \
     do { \
-        std::ostringstream oss; \
-        oss << expr; \
-        Logger::instance().error(oss.str()); \
+        if (Logger::instance().enabled(LogLevel::ERROR)) { \
+            std::ostringstream oss; \
+            oss << expr; \
+            Logger::instance().error(oss.str()); \
+        } \
     } while(0)
 
 #endif // LOGGER_H
@@ -6,8 +6,14 @@
 #include <thread>
 #include <chrono>
 #include <deque>
+#include <map>
+#include <mutex>
 #include <ctime>
+#include <fstream>
+#include <future>
 #include <limits>
+#include <algorithm>
+#include <cmath>
 #include <termios.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -18,22 +24,63 @@
 #include "utils.h"
 #include "rpc_client.h"
 #include "miner.h"
+#include "dataset_store.h"
+#include "dataset_distribution.h"
+#include "mining_backend.h"
+#include "upgrade_handoff.h"
+#include "template_longpoll.h"
+#include "network_stats.h"
+#include "event_loop.h"
+#include "block_submitter.h"
+#include "stratum_client.h"
+#include "work_proxy.h"
+#include "node_traffic.h"
+#include "switch_trace.h"
+#include "telemetry_journal.h"
+#include "hashrate_meter.h"
+#include "metrics_server.h"
+#include "control_server.h"
+#include "systemd_notify.h"
+#include "benchmark.h"
+#include "perf_counters.h"
+#include "autotune.h"
+#include "block_verifier.h"
+#include "colocation_governor.h"
+#include "cache_partition.h"
+#include "memory_governor.h"
+#include "memory_planner.h"
+#include "power_governor.h"
+#include "msr_profile.h"
 #include "logger.h"
+#include "trace_recorder.h"
 
 std::atomic<bool> running(true);
 std::atomic<bool> refresh_ui(false);
 std::atomic<bool> zmq_block_notification(false);
-Miner* global_miner = nullptr;
+// Headless controls: SIGHUP reloads, SIGUSR1 dumps statistics to the log,
+// SIGUSR2 starts a trace (--trace)
+std::atomic<bool> reload_requested(false);
+std::atomic<bool> dump_requested(false);
+std::atomic<bool> trace_requested(false);
+MiningBackend* global_miner = nullptr;
+EventLoop* global_event_loop = nullptr;
+// The last block announced over ZMQ, for the main loop to mark the running
+// job stale as soon as it hears of it rather than once the template is in
+std::mutex announced_mutex;
+std::string announced_block;
 
 struct termios orig_termios;
+bool terminal_configured = false;  // orig_termios holds the settings to restore
 
 void restore_terminal() {
-    tcsetattr(STDIN_FILENO, TCSANOW, &orig_termios);
+    if (terminal_configured) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &orig_termios);
+    }
 }
 
 void set_nonblocking_input() {
     struct termios new_termios;
-    tcgetattr(STDIN_FILENO, &orig_termios);
+    terminal_configured = tcgetattr(STDIN_FILENO, &orig_termios) == 0;
     new_termios = orig_termios;
     new_termios.c_lflag &= ~(ICANON | ECHO);
     tcsetattr(STDIN_FILENO, TCSANOW, &new_termios);
@@ -57,6 +104,16 @@ void signal_handler(int signal) {
     running = false;
     // Don't call miner->stop() here as it blocks on thread.join()
     // The main loop will handle cleanup when it sees running == false
+    if (global_event_loop) {
+        global_event_loop->wake();
+    }
+}
+
+void control_signal_handler(int signal) {
+    (signal == SIGHUP ? reload_requested : signal == SIGUSR2 ? trace_requested : dump_requested) = true;
+    if (global_event_loop) {
+        global_event_loop->wake();
+    }
 }
 
 void clear_screen() {
@@ -162,97 +219,11 @@ static void drawCentered(const std::string& text, const std::string& color = "",
     std::cout << "│" << std::endl;
 }
 
-// Forward declaration
-void add_update_message(const std::string& msg);
-
-int get_thread_count_input(const utils::SystemResources& resources) {
-    // Small delay to ensure the 'T' keypress is fully processed
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-    // First, flush any pending input from the non-blocking stdin
-    tcflush(STDIN_FILENO, TCIFLUSH);
-
-    // Restore terminal to blocking mode and configure for line input
-    struct termios input_termios;
-    tcgetattr(STDIN_FILENO, &input_termios);
-    input_termios.c_lflag |= (ICANON | ECHO);  // Enable canonical mode and echo
-    tcsetattr(STDIN_FILENO, TCSANOW, &input_termios);
-
-    // Set stdin to blocking mode
-    int flags = fcntl(STDIN_FILENO, F_GETFL, 0);
-    fcntl(STDIN_FILENO, F_SETFL, flags & ~O_NONBLOCK);
-
-    show_cursor();
-
-    // Calculate recommended max threads based on mode
-    // Note: This function doesn't know the mode, so we show both recommendations
-    unsigned int light_mode_max = utils::calculate_optimal_threads(resources, false);
-    unsigned int fast_mode_max = utils::calculate_optimal_threads(resources, true);
-
-    std::cout << "\n\n";
-    drawBoxTop("ADJUST THREAD COUNT");
-    drawRow("CPU Cores", std::to_string(resources.cpu_cores));
-    drawRow("Available RAM", std::to_string(resources.available_ram_mb) + " MB");
-    drawRow("Light Mode Max", std::to_string(light_mode_max) + " threads");
-    if (fast_mode_max > 0) {
-        drawRow("Fast Mode Max", std::to_string(fast_mode_max) + " threads");
-    } else {
-        drawRow("Fast Mode", "Insufficient RAM (<2.5GB)");
-    }
-    drawCentered("(Light: ~256MB shared, Fast: ~2GB shared)", "\e[0;37m");
-    drawBoxBottom();
-    std::cout << std::endl;
-    std::cout << "Enter thread count (1-" << resources.cpu_cores << "): ";
-    std::cout << std::flush;
-
-    // Read input using direct read() in a loop until newline
-    char input_buffer[32];
-    int pos = 0;
-    while (pos < 31) {
-        char c;
-        ssize_t n = read(STDIN_FILENO, &c, 1);
-        if (n <= 0) {
-            add_update_message("Failed to read input - thread count unchanged");
-            set_nonblocking_input();
-            hide_cursor();
-            return -1;
-        }
-        if (c == '\n') {
-            input_buffer[pos] = '\0';
-            break;
-        }
-        input_buffer[pos++] = c;
-    }
-    input_buffer[pos] = '\0';
-
-    // Restore non-blocking input
-    set_nonblocking_input();
-
-    // Clear stdin buffer after switching back to non-blocking
-    tcflush(STDIN_FILENO, TCIFLUSH);
-
-    hide_cursor();
-
-    // Parse input
-    int thread_count = 0;
-    if (sscanf(input_buffer, "%d", &thread_count) != 1) {
-        add_update_message("Invalid input - thread count unchanged");
-        return -1;
-    }
-
-    if (thread_count < 1) {
-        add_update_message("Invalid thread count (minimum 1)");
-        return -1;
-    }
-
-    if (thread_count > static_cast<int>(resources.cpu_cores)) {
-        std::ostringstream msg;
-        msg << "Warning: " << thread_count << " threads exceeds "
-            << resources.cpu_cores << " CPU cores";
-        add_update_message(msg.str());
-    }
-
-    return thread_count;
+// The T key's prompt as the controls box shows it while open: typed into
+// below the status screen while the workers keep hashing
+std::string thread_prompt_line(const std::string& input, unsigned int cpu_cores) {
+    return "Threads (1-" + std::to_string(cpu_cores) + "): \e[1;37m" + input + "_\e[0m  " +
+           "\e[1;37m[ENTER]\e[0m Apply  \e[1;37m[ESC]\e[0m Cancel";
 }
 
 std::string format_hashrate(double hashrate) {
@@ -268,6 +239,34 @@ std::string format_hashrate(double hashrate) {
     return ss.str();
 }
 
+// The Effective Hashrate row (--share-bits): what the pseudo-shares say the
+// workers really compute, and the part of the network's hashrate that is
+std::string format_effective_hashrate(const MiningBackend& miner, double network_hashrate) {
+    double effective = miner.get_effective_hashrate();
+    std::ostringstream ss;
+    ss << format_hashrate(effective) << " (" << miner.get_share_count() << " shares";
+    if (network_hashrate > 0) {
+        ss << ", " << std::setprecision(3) << 100.0 * effective / network_hashrate << "% of network";
+    }
+    ss << ")";
+    return ss.str();
+}
+
+// The Power row: package power, the efficiency it buys and, while the
+// power governor holds workers back, how many are hashing
+std::string format_power(const PowerSample& power) {
+    if (!power.available || power.watts <= 0) {
+        return std::string();
+    }
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(1) << power.watts << " W, " << std::setprecision(3)
+       << power.hashes_per_joule << " H/J";
+    if (power.workers < power.threads) {
+        ss << " (" << power.workers << "/" << power.threads << " threads active)";
+    }
+    return ss.str();
+}
+
 // Global update log for scrolling messages
 std::deque<std::string> update_log;
 const size_t MAX_UPDATE_LINES = 4;
@@ -294,8 +293,7 @@ void print_status_screen(
     uint64_t current_height,
     uint64_t seed_height,
     const std::vector<uint8_t>& seed_hash,
-    double local_hashrate,
-    uint64_t hash_count,
+    const HashrateSnapshot& hashrate,
     double network_hashrate,
     double difficulty,
     double mature_balance,
@@ -303,10 +301,14 @@ void print_status_screen(
     double total_balance,
     uint64_t blocks_mined,
     int uptime_seconds,
-    unsigned int num_threads,
-    bool fast_mode,
+    const std::string& threads,
+    const std::string& mode,
     bool no_balance,
-    const std::string& status = "ACTIVE"
+    const std::string& status = "ACTIVE",
+    const std::string& found_label = "Blocks Mined",
+    const std::string& effective = "",
+    const std::string& power = "",
+    const std::string& prompt = ""
 ) {
     std::cout << "\033[H"; // Move cursor to home
 
@@ -348,12 +350,20 @@ void print_status_screen(
     }
     drawRow("RandomX Epoch", epoch_display);
 
-    std::string mode_display = fast_mode ? "\e[1;32mFAST\e[0m" : "\e[1;33mLIGHT\e[0m";
+    std::string mode_display = (mode == "FAST" ? "\e[1;32m" : "\e[1;33m") + mode + "\e[0m";
     drawRow("Mode", mode_display);
-    drawRow("Threads", std::to_string(num_threads));
-    drawRow("Local Hashrate", format_hashrate(local_hashrate));
-    drawRow("Hashes", std::to_string(hash_count));
-    drawRow("Blocks Mined", std::to_string(blocks_mined));
+    drawRow("Threads", threads);
+    drawRow("Local Hashrate", format_hashrate(hashrate.rates[HASHRATE_10S]) + " (60s " +
+                              format_hashrate(hashrate.rates[HASHRATE_60S]) + ", 15m " +
+                              format_hashrate(hashrate.rates[HASHRATE_15M]) + ")");
+    if (!effective.empty()) {
+        drawRow("Effective Hashrate", effective);
+    }
+    if (!power.empty()) {
+        drawRow("Power", power);
+    }
+    drawRow("Hashes", std::to_string(hashrate.total_hashes));
+    drawRow(found_label, std::to_string(blocks_mined));
     drawBoxBottom();
     std::cout << std::endl;
 
@@ -404,26 +414,203 @@ void print_status_screen(
 
     // Controls footer
     drawBoxTop("CONTROLS");
-    drawCentered("\e[1;37m[SPACE]\e[0m Refresh  \e[1;37m[T]\e[0m Adjust Threads  \e[1;37m[Ctrl+C]\e[0m Stop");
+    if (prompt.empty()) {
+        drawCentered("\e[1;37m[SPACE]\e[0m Refresh  \e[1;37m[T]\e[0m Adjust Threads  \e[1;37m[Ctrl+C]\e[0m Stop");
+    } else {
+        drawCentered(prompt);
+    }
     drawBoxBottom();
 
     std::cout << "\033[K"; // Clear to end of line
     std::flush(std::cout);
 }
 
+// How often the memory locality report behind /metrics is refreshed
+static const int LOCALITY_REFRESH_SECONDS = 60;
+
+// Seconds an empty block from --spy-url is mined before its full template is
+// fetched by the main loop, if none has arrived
+static const int SPY_FALLBACK_SECONDS = 2;
+
+// Lines of hashrate per NUMA node the threads' CPUs are on, to go with a
+// locality report; empty on a single node
+std::string describe_node_hashrates(const HashrateSnapshot& hashrate, const MemoryLocality& locality) {
+    if (locality.nodes <= 1) {
+        return std::string();
+    }
+    std::map<int, std::pair<double, unsigned int>> nodes;  // Hashrate and threads
+    for (size_t i = 0; i < hashrate.threads.size() && i < locality.threads.size(); i++) {
+        std::pair<double, unsigned int>& node = nodes[locality.threads[i].cpu_node];
+        node.first += hashrate.threads[i].rates[HASHRATE_60S];
+        node.second++;
+    }
+    std::ostringstream ss;
+    for (const auto& node : nodes) {
+        ss << "\n  Node ";
+        if (node.first >= 0) {
+            ss << node.first;
+        } else {
+            ss << "?";
+        }
+        ss << ": " << format_hashrate(node.second.first) << " from " << node.second.second << " threads";
+    }
+    return ss.str();
+}
+
+// Pseudo-shares arrive at random, so n of them pin the effective hashrate
+// down to about 1/sqrt(n). A rate more than three of those below the counted
+// one means hashes are counted that aren't really computed (or are computed
+// wrong): warn once, and again only after it has recovered.
+static const uint64_t EFFECTIVE_CHECK_MIN_SHARES = 100;
+
+void check_effective_hashrate(const MiningBackend& miner, bool& low) {
+    uint64_t shares = miner.get_share_count();
+    double counted = miner.get_hashrate();
+    if (shares < EFFECTIVE_CHECK_MIN_SHARES || counted <= 0) {
+        return;
+    }
+    double effective = miner.get_effective_hashrate();
+    bool now_low = effective < counted * (1.0 - 3.0 / std::sqrt((double)shares));
+    if (now_low && !low) {
+        add_update_message("\e[1;31mEffective hashrate " + format_hashrate(effective) + " is below the counted " +
+                           format_hashrate(counted) + "\e[0m");
+        LOG_WARNING_STREAM("Effective hashrate " << format_hashrate(effective) << " from " << shares
+                           << " pseudo-shares is well below the counted " << format_hashrate(counted));
+    }
+    low = now_low;
+}
+
+// A worker far below its peers (see HASHRATE_STALL_FRACTION) is reported
+// once, and again once it has caught up. Workers from active_workers on are
+// idled on purpose (co-location) and never count as stalled.
+void check_stalled_threads(const HashrateSnapshot& hashrate, std::vector<bool>& stalled, unsigned int active_workers) {
+    stalled.resize(hashrate.threads.size(), false);
+    for (size_t i = 0; i < hashrate.threads.size(); i++) {
+        if (i >= active_workers) {
+            stalled[i] = false;
+            continue;
+        }
+        const ThreadHashrate& thread = hashrate.threads[i];
+        if (thread.stalled && !stalled[i]) {
+            add_update_message("\e[1;31mThread " + std::to_string(i) + " stalled at " +
+                               format_hashrate(thread.rates[HASHRATE_60S]) + "\e[0m");
+            LOG_WARNING_STREAM("Thread " << i << " stalled: " << format_hashrate(thread.rates[HASHRATE_60S])
+                               << " over 60s, against " << format_hashrate(hashrate.rates[HASHRATE_60S])
+                               << " for all " << hashrate.threads.size() << " threads");
+        } else if (!thread.stalled && stalled[i]) {
+            add_update_message("Thread " + std::to_string(i) + " recovered");
+            LOG_INFO_STREAM("Thread " << i << " recovered: " << format_hashrate(thread.rates[HASHRATE_60S]));
+        }
+        stalled[i] = thread.stalled;
+    }
+}
+
 void print_system_info(const utils::SystemResources& resources) {
     drawBoxTop("SYSTEM RESOURCES");
     drawRow("CPU Cores", std::to_string(resources.cpu_cores));
     drawRow("Total RAM", std::to_string(resources.total_ram_mb) + " MB");
     drawRow("Available RAM", std::to_string(resources.available_ram_mb) + " MB");
     drawRow("Optimal Threads", std::to_string(resources.optimal_threads));
+    std::string limits = utils::describe_resource_limits(resources);
+    if (!limits.empty()) {
+        drawRow("Limited By", limits);
+    }
     drawBoxBottom();
     std::cout << std::endl;
 }
 
+// A block was announced (block_hash, or empty if unknown) at noticed: tell
+// the main loop, then fetch the template that builds on it and leave it in
+// the inbox. With a spy node, its coinbase-only template goes in first.
+void fetch_announced_template(RPCClient& rpc, RPCClient* spy, const std::string& block_hash, TemplateInbox& inbox,
+                              const char* source, std::chrono::steady_clock::time_point noticed) {
+    if (!block_hash.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(announced_mutex);
+            announced_block = block_hash;
+        }
+        if (global_event_loop) {
+            global_event_loop->wake();
+        }
+    }
+    BlockTemplate empty_block;
+    if (spy && !block_hash.empty() && spy->get_block_template(empty_block, "")) {
+        // A spy node that hasn't got the block yet would have us mine the old tip
+        if (empty_block.previous_block_hash == block_hash) {
+            LOG_DEBUG_STREAM(source << ": empty block for height " << empty_block.height << " from the spy node in "
+                             << spy->get_call_stats("getblocktemplate").last_ms << " ms");
+            empty_block.spy = true;
+            empty_block.longpollid.clear();  // The spy node's, not the one to follow
+            empty_block.times.noticed = noticed;
+            inbox.push(std::make_shared<const BlockTemplate>(std::move(empty_block)), "spy node");
+        } else {
+            LOG_DEBUG_STREAM(source << ": spy node is still on " << empty_block.previous_block_hash);
+        }
+    } else if (spy && !block_hash.empty()) {
+        LOG_WARNING_STREAM(source << ": spy node template fetch failed (" << spy->get_last_error() << ")");
+    }
+    BlockTemplate block_template;
+    if (!rpc.get_block_template(block_template, "")) {
+        // Let the main loop check the tip and fetch through its own connection
+        LOG_WARNING_STREAM(source << ": template fetch failed (" << rpc.get_last_error() << ")");
+        zmq_block_notification.store(true);
+        return;
+    }
+    if (!block_hash.empty() && block_template.previous_block_hash != block_hash) {
+        LOG_DEBUG_STREAM(source << ": template builds on " << block_template.previous_block_hash
+                         << ", not the announced block");
+    }
+    LOG_DEBUG_STREAM(source << ": template for height " << block_template.height << " fetched in "
+                     << rpc.get_call_stats("getblocktemplate").last_ms << " ms");
+    block_template.times.noticed = noticed;
+    inbox.push(std::make_shared<const BlockTemplate>(std::move(block_template)), source);
+}
+
+// Replay mode (--replay): plays the recorded block announcements as the
+// ZMQ subscriber would have received them, without needing libzmq or a
+// publisher, and ends the run where the recording ends
+void replay_driver_thread(const MinerConfig& config, TemplateInbox& inbox) {
+    RPCClient rpc(config.rpc_urls[0], config.rpc_user, config.rpc_password);
+    std::unique_ptr<RPCClient> spy;
+    if (!config.spy_url.empty()) {
+        spy.reset(new RPCClient(config.spy_url, config.rpc_user, config.rpc_password));
+    }
+    auto wait_for = [](uint64_t time_ms) {
+        while (running.load()) {
+            auto remaining = traffic_replay->until(time_ms);
+            if (remaining == std::chrono::steady_clock::duration::zero()) {
+                return true;
+            }
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+                remaining, std::chrono::milliseconds(100)));
+        }
+        return false;
+    };
+    for (const TrafficEvent* event : traffic_replay->hashblocks()) {
+        if (!wait_for(event->time_ms)) {
+            return;
+        }
+        LOG_DEBUG_STREAM("Replay: block announcement " << event->body);
+        fetch_announced_template(rpc, spy.get(), event->body, inbox, "ZMQ (replay)",
+                                 std::chrono::steady_clock::now());
+    }
+    if (wait_for(traffic_replay->duration_ms())) {
+        LOG_INFO("Replay: end of the recording");
+        std::cout << std::endl << "End of the recording, shutting down..." << std::endl;
+        running = false;
+        if (global_event_loop) {
+            global_event_loop->wake();
+        }
+    }
+}
+
 #ifdef HAVE_ZMQ
-// ZMQ subscriber thread for instant block notifications
-void zmq_subscriber_thread(const std::string& zmq_url) {
+// ZMQ subscriber thread for instant block notifications. On each hashblock it
+// fetches the new template itself, on its own RPC connection, and leaves it in
+// the inbox: the block is one round trip away from being mined instead of
+// waiting for the main loop to check the tip and then fetch.
+void zmq_subscriber_thread(const MinerConfig& config, TemplateInbox& inbox) {
+    const std::string& zmq_url = config.zmq_url;
     void* context = zmq_ctx_new();
     if (!context) {
         LOG_ERROR("Failed to create ZMQ context");
@@ -452,10 +639,17 @@ void zmq_subscriber_thread(const std::string& zmq_url) {
     }
 
     LOG_INFO_STREAM("ZMQ subscriber connected to " << zmq_url);
+    // The notifying node is taken to be the first one
+    RPCClient rpc(config.rpc_urls[0], config.rpc_user, config.rpc_password);
+    std::unique_ptr<RPCClient> spy;
+    if (!config.spy_url.empty()) {
+        spy.reset(new RPCClient(config.spy_url, config.rpc_user, config.rpc_password));
+    }
 
     char topic[64];
     char body[64];
 
+    TraceRecorder::set_thread_name("zmq");
     while (running.load()) {
         // Receive topic (e.g., "hashblock")
         int topic_len = zmq_recv(subscriber, topic, sizeof(topic) - 1, 0);
@@ -470,11 +664,17 @@ void zmq_subscriber_thread(const std::string& zmq_url) {
         if (body_len < 0) {
             continue;
         }
+        auto noticed = std::chrono::steady_clock::now();
         body[body_len] = '\0';
 
-        // Signal that a new block was found
-        zmq_block_notification.store(true);
-        LOG_DEBUG("ZMQ: New block notification received");
+        std::string block_hash = body_len == 32
+            ? utils::bytes_to_hex(reinterpret_cast<const uint8_t*>(body), 32) : std::string();
+        LOG_DEBUG_STREAM("ZMQ: New block notification received " << block_hash);
+        TraceRecorder::instance().instant("zmq", topic);
+        if (traffic_recorder) {
+            traffic_recorder->record("hashblock", 0, true, block_hash);
+        }
+        fetch_announced_template(rpc, spy.get(), block_hash, inbox, "ZMQ", noticed);
     }
 
     zmq_close(subscriber);
@@ -483,303 +683,2232 @@ void zmq_subscriber_thread(const std::string& zmq_url) {
 }
 #endif
 
-int main(int argc, char* argv[]) {
-    // Parse configuration
-    MinerConfig config;
-    if (!parse_config(argc, argv, config)) {
+// Proxy mode (--proxy): nothing is hashed here. Templates come from the
+// first node as when mining (long poll, ZMQ, a timed check) and each new
+// one is published to the rigs through a WorkProxy; blocks they find go to
+// every node through warm submitters.
+int run_proxy(const MinerConfig& config) {
+    EventLoop event_loop;
+    global_event_loop = &event_loop;
+    TemplateInbox inbox([&event_loop]() { event_loop.wake(); });
+
+    RPCClient rpc(config.rpc_urls[0], config.rpc_user, config.rpc_password);
+    std::cout << "Fetching a block template from " << config.rpc_urls[0] << "..." << std::endl;
+    BlockTemplate fetched;
+    if (!rpc.get_block_template(fetched, "")) {
+        std::cerr << "Failed to get a block template: " << rpc.get_last_error() << std::endl;
+        LOG_ERROR_STREAM("Proxy: failed to get a block template: " << rpc.get_last_error());
         return 1;
     }
-
-    // Initialize logger
-    if (config.debug_mode || !config.log_file.empty()) {
-        Logger::instance().set_debug_mode(config.debug_mode);
-        if (!config.log_file.empty()) {
-            Logger::instance().enable_file_logging(config.log_file);
-        }
-        if (config.log_to_console) {
-            Logger::instance().enable_console_logging(true);
-        }
-        LOG_INFO("=== Juno Miner Starting ===");
-        if (config.debug_mode) {
-            LOG_DEBUG("Debug logging enabled");
-        }
+    BlockTemplatePtr current = std::make_shared<const BlockTemplate>(std::move(fetched));
+
+    std::vector<std::unique_ptr<BlockSubmitter>> submitters;
+    for (size_t i = 0; i < config.rpc_urls.size(); i++) {
+        submitters.emplace_back(new BlockSubmitter(i, config.rpc_urls[i], config.rpc_user, config.rpc_password,
+                                                   [&event_loop]() { event_loop.wake(); }));
+        submitters.back()->set_retry_window(std::chrono::seconds(config.outage_grace_seconds));
+        submitters.back()->start();
     }
-
-    // Set up signal handlers
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
-
-    // Set up non-blocking keyboard input
-    set_nonblocking_input();
-    atexit(restore_terminal);
-
-    drawBoxTop("");
-    drawCentered("JUNO CASH RANDOMX MINER", "\e[1;33m");
-    drawCentered("Privacy Money for All", "\e[1;36m");
-    drawBoxBottom();
-    std::cout << std::endl;
-
-    // Detect system resources
-    LOG_DEBUG("Detecting system resources");
-    utils::SystemResources resources = utils::detect_system_resources();
-    print_system_info(resources);
-    LOG_DEBUG_STREAM("System: " << resources.cpu_cores << " cores, "
-                     << (resources.total_ram_mb / 1024.0) << " GB RAM, optimal threads: "
-                     << resources.optimal_threads);
-
-    // Check fast mode feasibility
-    bool fast_mode = config.fast_mode;
-    if (fast_mode) {
-        unsigned int fast_mode_threads = utils::calculate_optimal_threads(resources, true);
-        if (fast_mode_threads == 0) {
-            std::cout << "Warning: Insufficient RAM for fast mode (need ~2.5GB)" << std::endl;
-            std::cout << "Falling back to light mode" << std::endl;
-            fast_mode = false;
+    WorkProxy proxy([&submitters](std::shared_ptr<const std::string> block_hex, uint32_t height,
+                                  std::string block_hash_hex) {
+        for (auto& submitter : submitters) {
+            submitter->submit(block_hex, height, block_hash_hex);
         }
-    }
-
-    // Determine thread count based on mode
-    unsigned int optimal_threads = utils::calculate_optimal_threads(resources, fast_mode);
-    unsigned int num_threads = config.auto_threads ? optimal_threads : config.num_threads;
-    LOG_DEBUG_STREAM("Thread count: " << num_threads << " (auto: " << (config.auto_threads ? "yes" : "no") << ")");
-    LOG_DEBUG_STREAM("Mode: " << (fast_mode ? "FAST" : "LIGHT"));
-
-    if (num_threads > resources.cpu_cores) {
-        std::cout << "Warning: Requested " << num_threads << " threads, but only "
-                  << resources.cpu_cores << " CPU cores available" << std::endl;
-    }
-
-    std::string mode_str = fast_mode ? "FAST (2x hashrate)" : "LIGHT";
-    std::cout << "Mode: " << mode_str << std::endl;
-    std::cout << "Using " << num_threads << " mining thread(s)" << std::endl;
-    std::cout << std::endl;
-
-    // Initialize RPC client
-    LOG_DEBUG_STREAM("Initializing RPC client: " << config.rpc_url);
-    RPCClient rpc(config.rpc_url, config.rpc_user, config.rpc_password);
-
-    // Test RPC connection
-    std::cout << "Testing RPC connection to " << config.rpc_url << "..." << std::endl;
-    Json::Value blockchain_info;
-    if (!rpc.get_blockchain_info(blockchain_info)) {
-        std::cerr << "Failed to connect to RPC server" << std::endl;
-        std::cerr << "Please check your RPC URL, username, and password" << std::endl;
-        LOG_ERROR("RPC connection failed");
+    });
+    std::string listen_error;
+    if (!proxy.listen(config.proxy_listen, listen_error)) {
+        std::cerr << "Proxy: " << listen_error << std::endl;
+        LOG_ERROR_STREAM("Proxy: " << listen_error);
         return 1;
     }
-
-    std::cout << "Connected to node:" << std::endl;
-    std::cout << "  Chain: " << blockchain_info["chain"].asString() << std::endl;
-    std::cout << "  Block: " << blockchain_info["blocks"].asUInt() << std::endl;
-    std::cout << std::endl;
-    LOG_INFO_STREAM("Connected to " << blockchain_info["chain"].asString()
-                    << " at block " << blockchain_info["blocks"].asUInt());
-
-    // Get initial block template to determine seed
-    std::cout << "Fetching initial block template to determine RandomX seed..." << std::endl;
-    LOG_DEBUG("Requesting initial block template");
-    Json::Value initial_template_data;
-    if (!rpc.get_block_template(initial_template_data, "")) {
-        std::cerr << "Failed to get initial block template" << std::endl;
-        LOG_ERROR("Failed to get initial block template");
-        return 1;
+    if (config.share_bits) {
+        proxy.set_share_bits(config.share_bits);
     }
-
-    // Parse initial template to get seed
-    BlockTemplate initial_template = parse_block_template(initial_template_data);
-    LOG_DEBUG_STREAM("Initial template: height=" << initial_template.height
-                     << " seed_height=" << initial_template.seed_height);
-
-    // Initialize miner with seed
-    LOG_DEBUG("Initializing miner and RandomX cache");
-    Miner miner(num_threads, fast_mode);
-    global_miner = &miner;
-    if (!miner.initialize(initial_template.seed_hash)) {
-        std::cerr << "Failed to initialize miner" << std::endl;
-        LOG_ERROR("Miner initialization failed");
-        return 1;
+    proxy.set_share_verify(config.share_verify_percent);
+    proxy.publish(current);
+    proxy.start();
+    std::cout << "Serving height " << current->height << " to rigs on " << config.proxy_listen << std::endl;
+    LOG_INFO_STREAM("Proxy listening on " << config.proxy_listen << " at height " << current->height);
+
+    // Fleet dataset distribution: the proxy builds each next epoch itself
+    // and serves it to rigs running --dataset-source
+    const std::string dataset_dir = config.dataset_cache_dir.empty() ? DatasetStore::default_directory()
+                                                                     : config.dataset_cache_dir;
+    DatasetServer dataset_server(dataset_dir);
+    std::unique_ptr<DatasetBuilder> dataset_builder;
+    if (!config.dataset_serve.empty()) {
+        if (!dataset_server.listen(config.dataset_serve, listen_error)) {
+            std::cerr << "Error: " << listen_error << std::endl;
+            LOG_ERROR_STREAM("Dataset server: " << listen_error);
+            return 1;
+        }
+        dataset_server.start();
+        dataset_builder.reset(new DatasetBuilder(dataset_dir));
+        dataset_builder->build(current->next_seed_hash);
+        std::cout << "Serving RandomX epochs from " << dataset_dir << " on " << config.dataset_serve << std::endl;
+        LOG_INFO_STREAM("Serving RandomX epochs from " << dataset_dir << " at http://" << config.dataset_serve
+                        << "/dataset/");
     }
-    LOG_INFO("Miner initialized successfully");
-
-    std::cout << std::endl;
-    std::cout << "Starting mining..." << std::endl;
-    std::cout << std::endl;
-
-    // Initialize status variables
-    uint64_t blocks_mined = 0;
-    auto start_time = std::chrono::steady_clock::now();
-    auto last_stats_update = std::chrono::steady_clock::now();
-    const int stats_update_interval = 10; // Update network stats every 10 seconds
-    uint64_t current_block_height = 0;
-    std::vector<uint8_t> current_seed_hash = initial_template.seed_hash;
-    double network_hashrate = 0.0;
-    double difficulty = 0.0;
-    double mature_balance = 0.0;
-    double immature_balance = 0.0;
-    double total_balance = 0.0;
-    bool ui_initialized = false;
-
-    // Add initial update message
-    add_update_message("Mining started");
 
-    // Start ZMQ subscriber thread if configured
+    TemplateLongPoll longpoll(config.rpc_urls[0], config.rpc_user, config.rpc_password, inbox);
+    if (config.longpoll) {
+        longpoll.follow(current->longpollid);
+    }
 #ifdef HAVE_ZMQ
     std::thread zmq_thread;
     if (!config.zmq_url.empty()) {
-        LOG_INFO_STREAM("Starting ZMQ subscriber for instant block notifications: " << config.zmq_url);
-        add_update_message("ZMQ block notifications enabled");
-        zmq_thread = std::thread(zmq_subscriber_thread, config.zmq_url);
+        zmq_thread = std::thread(zmq_subscriber_thread, std::cref(config), std::ref(inbox));
     }
 #endif
+    std::thread replay_thread;
+    if (traffic_replay) {
+        replay_thread = std::thread(replay_driver_thread, std::cref(config), std::ref(inbox));
+    }
 
-    // Track connection state for reconnection messages
-    bool was_disconnected = false;
-
-    // Main mining loop
+    const auto report_interval = std::chrono::seconds(60);
+    auto last_check = std::chrono::steady_clock::now();
+    auto last_report = last_check;
     while (running.load()) {
-        // Initialize UI on first iteration
-        if (!ui_initialized) {
-            std::cout << "Requesting block template..." << std::endl;
-            clear_screen();
-            hide_cursor();
-            ui_initialized = true;
+        unsigned int check_interval = longpoll.active()
+            ? std::max<unsigned int>(config.block_check_interval_seconds, LONGPOLL_BACKUP_CHECK_SECONDS)
+            : config.block_check_interval_seconds;
+        event_loop.wait(std::min(last_check + std::chrono::seconds(check_interval), last_report + report_interval));
+        auto now = std::chrono::steady_clock::now();
+
+        SubmitResult submitted;
+        for (auto& submitter : submitters) {
+            while (submitter->take_result(submitted)) {
+                std::cout << "Block at height " << submitted.height << " " << submitted.block_hash_hex
+                          << (submitted.accepted ? " accepted by " : " rejected by ")
+                          << config.rpc_urls[submitted.node] << ": " << submitted.result << std::endl;
+                LOG_INFO_STREAM("Proxy: block at height " << submitted.height << " "
+                                << (submitted.accepted ? "accepted" : "rejected") << " by "
+                                << config.rpc_urls[submitted.node] << " (" << submitted.result << ")");
+            }
         }
 
-        // Get block template (node will use wallet's default address for coinbase)
-        Json::Value template_data;
-        if (!rpc.get_block_template(template_data, "")) {
-            add_update_message(rpc.get_last_error());
-
-            // Update the display to show the error
-            auto now = std::chrono::steady_clock::now();
-            auto uptime = std::chrono::duration_cast<std::chrono::seconds>(now - start_time).count();
-            print_status_screen(
-                current_block_height,
-                RandomX_SeedHeight(current_block_height > 0 ? current_block_height : 0),
-                current_seed_hash,
-                0.0, // hashrate
-                miner.get_hash_count(),
-                network_hashrate,
-                difficulty,
-                mature_balance,
-                immature_balance,
-                total_balance,
-                blocks_mined,
-                uptime,
-                num_threads,
-                fast_mode,
-                config.no_balance,
-                "DISCONNECTED"
-            );
-
-            was_disconnected = true;
-            std::this_thread::sleep_for(std::chrono::seconds(5));
-            continue;
+        // Pushed templates first; otherwise the timed check fetches one
+        BlockTemplatePtr next;
+        std::string source;
+        if (!inbox.take(next, source) &&
+            (zmq_block_notification.exchange(false) || now - last_check >= std::chrono::seconds(check_interval))) {
+            BlockTemplate polled;
+            if (rpc.get_block_template(polled, "")) {
+                next = std::make_shared<const BlockTemplate>(std::move(polled));
+                source = "polling";
+            } else {
+                LOG_WARNING_STREAM("Proxy: template fetch failed (" << rpc.get_last_error() << ")");
+            }
+            last_check = now;
         }
 
-        // Check if we just reconnected
-        if (was_disconnected) {
-            add_update_message("RPC reconnected - resuming mining");
-            LOG_INFO("RPC connection restored, resuming mining");
-            was_disconnected = false;
+        // Rigs move on for a new block, or for new transactions the long poll
+        // brought for this one
+        bool new_block = next && next->height >= current->height &&
+                         next->previous_block_hash != current->previous_block_hash;
+        bool refreshed = next && next->height == current->height && !new_block &&
+                         !next->longpollid.empty() && next->longpollid != current->longpollid;
+        if (new_block || refreshed) {
+            current = next;
+            proxy.publish(current);
+            if (dataset_builder) {
+                dataset_builder->build(current->next_seed_hash);
+            }
+            if (config.longpoll) {
+                longpoll.follow(current->longpollid);
+            }
+            if (new_block) {
+                std::cout << "New block: serving height " << current->height << " (" << source << ") to "
+                          << proxy.rig_count() << " rigs" << std::endl;
+            }
+            LOG_INFO_STREAM("Proxy: published height " << current->height << " (" << source << ", "
+                            << (new_block ? "new block" : "new transactions") << ") to "
+                            << proxy.rig_count() << " rigs");
         }
 
-        // Parse template
-        BlockTemplate block_template = parse_block_template(template_data);
-        current_block_height = block_template.height;
-
-        // Check if epoch changed (seed hash changed)
-        if (block_template.seed_hash != current_seed_hash) {
-            uint64_t old_epoch = RandomX_SeedHeight(current_block_height - 1);
-            uint64_t new_epoch = RandomX_SeedHeight(current_block_height);
-
-            std::ostringstream msg;
-            msg << "EPOCH TRANSITION: " << old_epoch << " -> " << new_epoch;
-            add_update_message(msg.str());
-            add_update_message("Updating RandomX cache...");
-            LOG_INFO_STREAM("Epoch transition detected: " << old_epoch << " -> " << new_epoch);
-            LOG_DEBUG_STREAM("Old seed: " << utils::bytes_to_hex(current_seed_hash.data(), 32));
-            LOG_DEBUG_STREAM("New seed: " << utils::bytes_to_hex(block_template.seed_hash.data(), 32));
-
-            if (!miner.update_seed(block_template.seed_hash)) {
-                std::cerr << "Failed to update seed for new epoch" << std::endl;
-                add_update_message("ERROR: Failed to update seed for new epoch!");
-                LOG_ERROR("Failed to update RandomX seed for new epoch");
-                return 1;
+        if (now - last_report >= report_interval) {
+            std::cout << proxy.rig_count() << " rigs connected, height " << current->height << std::endl;
+            // Each rig's effective hashrate, from the pseudo-shares it sent
+            if (config.share_bits) {
+                for (const ProxyRigStats& rig : proxy.rig_stats()) {
+                    std::cout << "  " << rig.address << " (instance " << rig.instance_id << "): "
+                              << format_hashrate(rig.effective_hashrate) << " effective, " << rig.shares
+                              << " shares, " << rig.invalid_shares << " wrong" << std::endl;
+                    LOG_INFO_STREAM("Proxy: rig " << rig.address << " (instance " << rig.instance_id << ") "
+                                    << format_hashrate(rig.effective_hashrate) << " effective from "
+                                    << rig.shares << " shares, " << rig.invalid_shares << " wrong");
+                }
             }
+            last_report = now;
+        }
+    }
 
-            current_seed_hash = block_template.seed_hash;
-            add_update_message("Epoch transition complete!");
-            LOG_INFO("Epoch transition completed successfully");
+    longpoll.stop();
+    proxy.stop();
+    for (auto& submitter : submitters) {
+        submitter->stop();
+    }
+#ifdef HAVE_ZMQ
+    if (zmq_thread.joinable()) {
+        zmq_thread.join();
+    }
+#endif
+    if (replay_thread.joinable()) {
+        replay_thread.join();
+    }
+    global_event_loop = nullptr;
+    LOG_INFO_STREAM("Proxy stopped\n" << rpc.describe_call_stats());
+    return 0;
+}
 
-            // Don't reinitialize UI - just continue with updated cache
+// Upper bound in ticks of the phase histogram bucket holding quantile q
+static uint64_t phase_quantile_ticks(const randomx_phase_stats& stats, double q) {
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < RANDOMX_PHASE_BUCKETS; bucket++) {
+        seen += stats.buckets[bucket];
+        if (seen > 0 && seen >= q * stats.count) {
+            return 2ULL << bucket;
+        }
+    }
+    return 2ULL << (RANDOMX_PHASE_BUCKETS - 1);
+}
+
+// Benchmark mode (--benchmark): the real backend, with the thread
+// placement, NUMA, huge page and mode settings given, hashing a synthetic
+// header on a fixed seed with no node. The clock starts once the workers
+// hash at full speed (after the light-mode warm-up in fast mode), so init
+// and the hashrate are reported apart.
+// --msr-profile on the CPUs the workers hash on. CPUs it can't write keep
+// their registers, with a warning; the miner hashes either way. Called again
+// after the threads move, for the CPUs they moved to.
+bool apply_msr(const MinerConfig& config, const MiningBackend& miner, bool announce) {
+    MsrProfile profile;
+    std::string error;
+    if (config.msr_profile.empty() || !parse_msr_profile(config.msr_profile, profile, error)) {
+        return false;  // Parsed at startup already
+    }
+    std::vector<int> cpus = miner.get_thread_cpus();
+    if (!apply_msr_profile(profile, cpus, error)) {
+        std::cout << "Warning: MSR profile " << profile.name << ": " << error << std::endl;
+        LOG_WARNING_STREAM("MSR profile " << profile.name << ": " << error);
+    }
+    if (active_msr_profile().empty()) {
+        return false;
+    }
+    if (announce) {
+        std::cout << "MSR profile " << profile.name << " on CPUs " << format_cpu_list(cpus) << std::endl;
+    }
+    LOG_INFO_STREAM("MSR profile " << profile.name << " on CPUs " << format_cpu_list(cpus));
+    return true;
+}
+
+int run_benchmark(const MinerConfig& config, unsigned int num_threads, bool fast_mode, const std::string& mode_name) {
+    std::cout << "Benchmark: " << mode_name << " mode, " << num_threads << " thread(s), "
+              << (config.benchmark_hashes ? std::to_string(config.benchmark_hashes) + " hashes"
+                                          : std::to_string(config.benchmark_seconds) + " s")
+              << std::endl << std::endl;
+
+    BenchmarkResult result;
+    std::string error;
+    std::unique_ptr<MiningBackend> backend = create_benchmark_backend(config, num_threads, fast_mode, result, error);
+    if (!backend) {
+        std::cerr << "Error: " << error << std::endl;
+        LOG_ERROR_STREAM("Benchmark: " << error);
+        return 1;
+    }
+    MiningBackend& miner = *backend;
+    global_miner = &miner;
+    auto progress = [](double elapsed, uint64_t hashes) {
+        std::cout << "  " << std::fixed << std::setprecision(0) << elapsed << " s: " << hashes << " hashes, "
+                  << std::setprecision(1) << hashes / elapsed << " H/s" << std::endl;
+    };
+    // With an MSR profile, the stock prefetchers are measured first for its
+    // effect (over the warm-up, if any)
+    BenchmarkResult stock;
+    stock.init_seconds = result.init_seconds;
+    if (!config.msr_profile.empty()) {
+        std::cout << "Stock prefetchers:" << std::endl;
+        measure_hashrate(miner, config.benchmark_seconds, config.benchmark_hashes, running, stock, progress);
+        if (!apply_msr(config, miner, true)) {
+            stock.hashrate = 0;
+        }
+    }
+    measure_hashrate(miner, config.benchmark_seconds, config.benchmark_hashes, running, result, progress,
+                     config.benchmark_perf);
+    if (!config.msr_profile.empty()) {
+        result.ready_seconds = stock.ready_seconds;
+    }
+    double init_seconds = result.init_seconds;
+    double ready_seconds = result.ready_seconds;
+    double elapsed = result.seconds;
+    uint64_t hashes = result.hashes;
+
+    Json::Value report;
+    report["mode"] = mode_name;
+    report["threads"] = num_threads;
+    report["init_seconds"] = init_seconds;
+    report["ready_seconds"] = ready_seconds;
+    report["seconds"] = elapsed;
+    report["hashes"] = (Json::UInt64)hashes;
+    report["hashrate"] = result.hashrate;
+    report["thread_hashrates"] = Json::Value(Json::arrayValue);
+    for (double thread_hashrate : result.thread_hashrates) {
+        report["thread_hashrates"].append(thread_hashrate);
+    }
+    // Per core type on a hybrid CPU, to weigh what the E-cores add
+    for (const CoreTypeHashrate& type : hashrate_by_core_type(result)) {
+        Json::Value& entry = report["core_types"][core_type_key(type.type)];
+        entry["threads"] = type.threads;
+        entry["hashrate"] = type.hashrate;
+        entry["per_thread"] = type.per_thread();
+    }
+    // Package power, where RAPL is readable
+    if (result.watts > 0) {
+        report["watts"] = result.watts;
+        report["hashes_per_joule"] = result.hashes_per_joule();
+    }
+    // Phase histograms per thread; bucket b counts samples of [2^b, 2^(b+1)) ticks
+    HashPhaseProfile all_phases;
+    if (!result.thread_phases.empty()) {
+        Json::Value& phases = report["hash_phases"];
+        phases["timer_hz"] = result.phase_timer_hz;
+        phases["threads"] = Json::Value(Json::arrayValue);
+        for (const HashPhaseProfile& thread : result.thread_phases) {
+            Json::Value entry;
+            for (int phase = 0; phase < RANDOMX_PHASE_COUNT; phase++) {
+                const randomx_phase_stats& stats = thread.phases[phase];
+                Json::Value& out = entry[HASH_PHASE_NAMES[phase]];
+                out["count"] = (Json::UInt64)stats.count;
+                out["ticks"] = (Json::UInt64)stats.ticks;
+                out["buckets"] = Json::Value(Json::arrayValue);
+                for (int bucket = 0; bucket < RANDOMX_PHASE_BUCKETS; bucket++) {
+                    out["buckets"].append((Json::UInt64)stats.buckets[bucket]);
+                }
+                all_phases.phases[phase].count += stats.count;
+                all_phases.phases[phase].ticks += stats.ticks;
+                for (int bucket = 0; bucket < RANDOMX_PHASE_BUCKETS; bucket++) {
+                    all_phases.phases[phase].buckets[bucket] += stats.buckets[bucket];
+                }
+            }
+            phases["threads"].append(entry);
+        }
+    }
+    // Hardware counters: raw counts, IPC and events per hash, per thread and in total
+    PerfCounts all_perf;
+    auto perf_json = [](const PerfCounts& counts, uint64_t thread_hashes) {
+        Json::Value out;
+        for (int event = 0; event < PERF_EVENTS; event++) {
+            if (counts.counted[event]) {
+                out["counts"][PERF_EVENT_NAMES[event]] = (Json::UInt64)counts.values[event];
+                if (event != PERF_CYCLES && event != PERF_INSTRUCTIONS && thread_hashes) {
+                    out["per_hash"][PERF_EVENT_NAMES[event]] = (double)counts.values[event] / thread_hashes;
+                }
+            }
+        }
+        if (counts.counted[PERF_CYCLES] && counts.counted[PERF_INSTRUCTIONS] && counts.values[PERF_CYCLES]) {
+            out["ipc"] = (double)counts.values[PERF_INSTRUCTIONS] / counts.values[PERF_CYCLES];
+        }
+        return out;
+    };
+    if (config.benchmark_perf) {
+        Json::Value& perf = report["perf"];
+        if (result.thread_perf.empty()) {
+            perf["error"] = result.perf_error;
+        } else {
+            perf["threads"] = Json::Value(Json::arrayValue);
+            for (size_t i = 0; i < result.thread_perf.size(); i++) {
+                const PerfCounts& counts = result.thread_perf[i];
+                perf["threads"].append(perf_json(counts, i < result.thread_hashes.size() ? result.thread_hashes[i] : 0));
+                for (int event = 0; event < PERF_EVENTS; event++) {
+                    all_perf.values[event] += counts.values[event];
+                    all_perf.counted[event] = all_perf.counted[event] || counts.counted[event];
+                }
+            }
+            perf["total"] = perf_json(all_perf, hashes);
+        }
+    }
+    size_t resident_mb = 0;
+    size_t peak_mb = 0;
+    if (utils::process_memory_mb(resident_mb, peak_mb)) {
+        report["resident_mb"] = (Json::UInt64)resident_mb;
+        report["peak_resident_mb"] = (Json::UInt64)peak_mb;
+    }
+    std::string huge_pages = miner.huge_page_summary();
+    if (config.huge_pages && !huge_pages.empty()) {
+        report["huge_pages"] = huge_pages;
+    }
+    const std::string msr_profile = active_msr_profile();
+    if (!msr_profile.empty() && stock.hashrate > 0) {
+        Json::Value& msr = report["msr_profile"];
+        msr["name"] = msr_profile;
+        msr["stock_hashrate"] = stock.hashrate;
+        msr["gain"] = result.hashrate / stock.hashrate - 1.0;
+    }
+    InitTiming init_timing = miner.get_init_timing();
+    if (!init_timing.trigger.empty()) {
+        Json::Value& init_phases = report["init_phases"];
+        for (int phase = 0; phase < INIT_PHASES; phase++) {
+            init_phases[INIT_PHASE_NAMES[phase]] = init_timing.seconds[phase];
+        }
+        init_phases["background"] = init_timing.background;
+        if (init_timing.dataset_workers > 0) {
+            init_phases["dataset_workers"] = init_timing.dataset_workers;
+            init_phases["dataset_items"] = (Json::UInt64)init_timing.dataset_items;
+            init_phases["worker_items_per_second"] = Json::Value(Json::arrayValue);
+            for (double rate : init_timing.worker_items_per_second) {
+                init_phases["worker_items_per_second"].append(rate);
+            }
+        }
+    }
+    MemoryLocality locality = miner.memory_locality();
+    if (locality.supported) {
+        Json::Value& memory_locality = report["memory_locality"];
+        memory_locality["summary"] = locality.summary();
+        memory_locality["remote_threads"] = (Json::UInt64)locality.remote_threads();
+    }
+
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(2);
+    text << "Init: " << init_seconds << " s";
+    if (ready_seconds - init_seconds >= 0.01) {
+        text << ", full speed after " << ready_seconds << " s";
+    }
+    if (!init_timing.trigger.empty()) {
+        text << "\nInit phases: " << init_timing.describe();
+    }
+    text << "\nHashrate: " << report["hashrate"].asDouble() << " H/s (" << hashes << " hashes in "
+         << elapsed << " s)";
+    for (Json::ArrayIndex i = 0; i < report["thread_hashrates"].size(); i++) {
+        text << "\n  Thread " << i << ": " << report["thread_hashrates"][i].asDouble() << " H/s";
+        if (i < result.thread_core_types.size()) {
+            text << " (" << core_type_name(result.thread_core_types[i]) << ")";
+        }
+    }
+    for (const CoreTypeHashrate& type : hashrate_by_core_type(result)) {
+        text << "\n  " << (type.type == CORE_TYPE_UNKNOWN ? "Other" : core_type_name(type.type)) << "s: "
+             << type.threads << " threads, " << type.hashrate << " H/s (" << type.per_thread() << " H/s each)";
+    }
+    if (result.watts > 0) {
+        text << "\nPower: " << result.watts << " W package, " << std::setprecision(3) << result.hashes_per_joule()
+             << " H/J" << std::setprecision(2);
+    }
+    if (report.isMember("hash_phases")) {
+        uint64_t total_ticks = 0;
+        for (int phase = 0; phase < RANDOMX_PHASE_COUNT; phase++) {
+            total_ticks += all_phases.phases[phase].ticks;
+        }
+        text << "\nHash phases (all threads, timer at " << result.phase_timer_hz / 1e9 << " GHz):";
+        for (int phase = 0; phase < RANDOMX_PHASE_COUNT; phase++) {
+            const randomx_phase_stats& stats = all_phases.phases[phase];
+            if (stats.count == 0) {
+                continue;
+            }
+            double per_hash = hashes ? (double)stats.ticks / hashes : 0.0;
+            text << "\n  " << std::left << std::setw(17) << HASH_PHASE_NAMES[phase] << std::right
+                 << std::setw(6) << 100.0 * stats.ticks / std::max<uint64_t>(total_ticks, 1) << "%  "
+                 << std::setprecision(0) << per_hash << " ticks/hash";
+            if (result.phase_timer_hz > 0) {
+                text << " (" << std::setprecision(2) << per_hash / result.phase_timer_hz * 1e6 << " us)";
+            }
+            text << ", " << std::setprecision(1) << (double)stats.count / std::max<uint64_t>(hashes, 1)
+                 << " per hash, p50 < " << phase_quantile_ticks(stats, 0.5)
+                 << ", p99 < " << phase_quantile_ticks(stats, 0.99) << std::setprecision(2);
+        }
+    }
+    if (report.isMember("perf")) {
+        const Json::Value& perf = report["perf"];
+        if (perf.isMember("error")) {
+            text << "\nHardware counters: unavailable, " << perf["error"].asString();
+        } else {
+            // One line in total, one per thread: IPC, then each event per hash
+            auto perf_line = [&](const Json::Value& counts) {
+                std::ostringstream line;
+                line << std::fixed << std::setprecision(2);
+                line << "IPC " << (counts.isMember("ipc") ? counts["ipc"].asDouble() : 0.0);
+                for (int event = PERF_L1D_MISSES; event < PERF_EVENTS; event++) {
+                    const Json::Value& per_hash = counts["per_hash"][PERF_EVENT_NAMES[event]];
+                    line << ", " << PERF_EVENT_NAMES[event] << " ";
+                    if (per_hash.isNull()) {
+                        line << "n/a";
+                    } else {
+                        line << std::setprecision(0) << per_hash.asDouble() << std::setprecision(2);
+                    }
+                }
+                return line.str();
+            };
+            text << "\nHardware counters per hash: " << perf_line(perf["total"]);
+            for (Json::ArrayIndex i = 0; i < perf["threads"].size(); i++) {
+                text << "\n  Thread " << i << ": " << perf_line(perf["threads"][i]);
+            }
+        }
+    }
+    if (report.isMember("resident_mb")) {
+        text << "\nMemory: " << resident_mb << " MB resident, " << peak_mb << " MB peak";
+    }
+    if (report.isMember("huge_pages")) {
+        text << "\nHuge pages: " << huge_pages;
+    }
+    if (report.isMember("msr_profile")) {
+        text << "\nMSR profile: " << msr_profile << ", " << std::showpos << std::setprecision(1)
+             << 100.0 * report["msr_profile"]["gain"].asDouble() << std::noshowpos << "% over "
+             << stock.hashrate << " H/s with the stock prefetchers" << std::setprecision(2);
+    }
+    if (locality.supported) {
+        text << "\nMemory locality: " << locality.describe();
+    }
+    std::cout << std::endl << text.str() << std::endl;
+    LOG_INFO_STREAM("Benchmark:\n" << text.str());
+
+    if (!config.benchmark_json.empty()) {
+        Json::StreamWriterBuilder writer;
+        writer["indentation"] = "  ";
+        std::string json = Json::writeString(writer, report);
+        if (config.benchmark_json == "-") {
+            std::cout << json << std::endl;
+        } else {
+            std::ofstream out(config.benchmark_json);
+            out << json << std::endl;
+            if (!out) {
+                std::cerr << "Error: can't write " << config.benchmark_json << std::endl;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Autotune mode (--autotune): search this host's best configuration with
+// the benchmark engine and save it as the profile later runs start from
+int run_autotune(const MinerConfig& config, const utils::SystemResources& resources) {
+    std::string host_key = autotune_host_key();
+    std::cout << "Autotuning " << host_key << " for " << (config.autotune_efficiency ? "hashes per joule" : "hashrate")
+              << " (" << config.autotune_seconds << " s per measurement)" << std::endl << std::endl;
+    LOG_INFO_STREAM("Autotuning " << host_key);
+
+    TuneProfile profile;
+    std::string error;
+    if (!autotune(config, resources, config.autotune_seconds, running, profile, error)) {
+        std::cerr << "Autotune failed: " << error << std::endl;
+        LOG_ERROR_STREAM("Autotune failed: " << error);
+        return 1;
+    }
+    std::ostringstream result;
+    result << profile.mode << " mode";
+    if (profile.mode == "medium") {
+        result << " (" << profile.medium_mb << " MB)";
+    }
+    result << ", " << profile.threads << " threads" << (profile.huge_pages ? ", huge pages" : "")
+           << (profile.msr_profile.empty() ? "" : ", MSR profile " + profile.msr_profile) << ": "
+           << std::fixed << std::setprecision(1) << profile.hashrate << " H/s";
+    if (profile.watts > 0) {
+        result << ", " << profile.watts << " W, " << std::setprecision(3) << profile.hashrate / profile.watts << " H/J";
+    }
+    std::cout << std::endl << "Best: " << result.str() << std::endl;
+    LOG_INFO_STREAM("Autotune result: " << result.str());
+
+    std::string path = default_profile_path();
+    if (!save_tune_profile(path, host_key, profile, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+    std::cout << "Saved to " << path << "; runs on this host type now start from it (--no-profile to ignore)"
+              << std::endl;
+    return 0;
+}
+
+// Verification mode (--verify-blocks): re-check a range of blocks' proof of
+// work on the node with every core and report the throughput
+int run_block_verification(const MinerConfig& config, const utils::SystemResources& resources) {
+    BlockVerifyOptions options;
+    options.from_height = config.verify_from;
+    options.to_height = config.verify_to;
+    options.threads = config.auto_threads ? resources.cpu_cores : config.num_threads;
+    options.allow_dataset = utils::calculate_optimal_threads(resources, true) > 0;
+    options.running = &running;
+    const uint64_t total = options.to_height - options.from_height + 1;
+    std::cout << "Verifying blocks " << options.from_height << " to " << options.to_height << " (" << total
+              << ") with " << options.threads << " threads" << std::endl;
+    LOG_INFO_STREAM("Verifying blocks " << options.from_height << " to " << options.to_height);
+
+    RPCClient rpc(config.rpc_urls[0], config.rpc_user, config.rpc_password);
+    BlockVerifyReport report;
+    std::string error;
+    auto last_progress = std::chrono::steady_clock::now();
+    bool ok = verify_blocks(rpc, options, report, error, [&last_progress](uint64_t done, uint64_t all) {
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_progress >= std::chrono::seconds(5)) {
+            last_progress = now;
+            std::cout << "  " << done << " / " << all << " blocks" << std::endl;
+        }
+    });
+
+    std::cout << std::fixed << std::setprecision(1);
+    for (const EpochVerifyStats& epoch : report.epochs) {
+        std::cout << "Epoch seeded at " << epoch.seed_height << ": " << epoch.blocks << " blocks, "
+                  << (epoch.dataset ? "dataset" : "cache") << " in " << epoch.init_seconds << " s, "
+                  << (epoch.hash_seconds > 0 ? epoch.blocks / epoch.hash_seconds : 0.0) << " blocks/s hashing"
+                  << std::endl;
+    }
+    std::cout << "Verified " << report.blocks << " blocks in " << report.seconds << " s: "
+              << report.blocks_per_second() << " blocks/s (" << report.fetch_wait_seconds
+              << " s waiting on the node)" << std::endl;
+    std::cout << report.valid << " valid, " << report.failures.size() << " invalid" << std::endl;
+    const size_t SHOWN_FAILURES = 20;
+    for (size_t i = 0; i < report.failures.size() && i < SHOWN_FAILURES; i++) {
+        std::cout << "  Block " << report.failures[i].height << ": " << report.failures[i].reason << std::endl;
+    }
+    if (report.failures.size() > SHOWN_FAILURES) {
+        std::cout << "  ... and " << report.failures.size() - SHOWN_FAILURES << " more (see the log)" << std::endl;
+    }
+    for (const BlockVerifyFailure& failure : report.failures) {
+        LOG_WARNING_STREAM("Block " << failure.height << " failed verification: " << failure.reason);
+    }
+    LOG_INFO_STREAM("Verified " << report.blocks << " blocks: " << report.valid << " valid, "
+                    << report.failures.size() << " invalid, " << report.blocks_per_second() << " blocks/s");
+    if (!ok) {
+        std::cerr << "Verification stopped: " << error << std::endl;
+        LOG_ERROR_STREAM("Verification stopped: " << error);
+        return 1;
+    }
+    return report.failures.empty() && report.blocks == total ? 0 : 1;
+}
+
+// A startup epoch build for the seed the last run mined on, running while
+// main connects to the node. If main leaves without taking its result, the
+// build is abandoned and waited for before the miner goes away.
+class SpeculativeInit {
+public:
+    explicit SpeculativeInit(MiningBackend& miner) : miner_(miner) {}
+    ~SpeculativeInit() {
+        if (result_.valid()) {
+            miner_.abandon_initialize();
+            result_.wait();
+        }
+    }
+
+    void start(const std::vector<uint8_t>& seed_hash) {
+        seed_hash_ = seed_hash;
+        started_ = std::chrono::steady_clock::now();
+        result_ = std::async(std::launch::async, [this]() { return miner_.initialize(seed_hash_); });
+    }
+    bool running() const { return result_.valid(); }
+    const std::vector<uint8_t>& seed_hash() const { return seed_hash_; }
+    std::chrono::steady_clock::time_point started() const { return started_; }
+    // Wait for the build; what initialize returned
+    bool finish() { return result_.get(); }
+
+private:
+    MiningBackend& miner_;
+    std::vector<uint8_t> seed_hash_;
+    std::chrono::steady_clock::time_point started_;
+    std::future<bool> result_;
+};
+
+int main(int argc, char* argv[]) {
+    // Parse configuration
+    MinerConfig config;
+    if (!parse_config(argc, argv, config)) {
+        return 1;
+    }
+    if (!config.msr_profile.empty()) {
+        MsrProfile msr;
+        std::string error;
+        if (!parse_msr_profile(config.msr_profile, msr, error)) {
+            std::cerr << "Error: --msr-profile: " << error << std::endl;
+            return 1;
+        }
+    }
+
+    // Housekeeping CPUs come first: every thread started from here on (the
+    // logger, RPC, ZMQ and pool clients) inherits them, and only the threads
+    // that hash move off
+    std::vector<int> housekeeping = config.housekeeping_cpus;
+    if (config.housekeeping_auto) {
+        housekeeping = CpuTopology::detect().pick_housekeeping_cpus(current_thread_cpus());
+    }
+    const bool housekeeping_set = !housekeeping.empty() && set_housekeeping_cpus(housekeeping);
+
+    // Initialize logger
+    if (config.debug_mode || !config.log_file.empty() || config.headless) {
+        Logger::instance().set_debug_mode(config.debug_mode);
+        if (!config.log_file.empty()) {
+            Logger::instance().enable_file_logging(config.log_file);
+        }
+        // A daemon's log goes to stdout, for the journal or the container runtime
+        if (config.log_to_console || config.headless) {
+            Logger::instance().enable_console_logging(true);
+        }
+        LOG_INFO("=== Juno Miner Starting ===");
+        if (config.debug_mode) {
+            LOG_DEBUG("Debug logging enabled");
+        }
+    }
+
+    if (housekeeping_set) {
+        std::cout << "Housekeeping CPUs: " << format_cpu_list(housekeeping) << " (mining on "
+                  << format_cpu_list(hashing_cpus()) << ")" << std::endl;
+        LOG_INFO_STREAM("Housekeeping CPUs " << format_cpu_list(housekeeping) << ", mining on "
+                        << format_cpu_list(hashing_cpus()));
+    } else if (!housekeeping.empty()) {
+        std::cout << "Warning: can't move to housekeeping CPUs " << format_cpu_list(housekeeping)
+                  << ", mining threads use every CPU" << std::endl;
+        LOG_WARNING_STREAM("Can't use housekeeping CPUs " << format_cpu_list(housekeeping));
+    } else if (config.housekeeping_auto) {
+        LOG_INFO_STREAM("No housekeeping CPUs: fewer than " << HOUSEKEEPING_MIN_CORES << " cores");
+    }
+
+    // Record node traffic, or answer from a recording instead of the node
+    TrafficRecorder recorder;
+    TrafficReplay replay;
+    if (!config.record_file.empty() || !config.replay_file.empty()) {
+        std::string error;
+        bool replaying = !config.replay_file.empty();
+        if (replaying ? !replay.load(config.replay_file, error) : !recorder.open(config.record_file, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        if (replaying) {
+            replay.start(config.replay_speed);
+            traffic_replay = &replay;
+            LOG_INFO_STREAM("Replaying " << replay.event_count() << " node events from " << config.replay_file
+                            << " at " << config.replay_speed << "x");
+        } else {
+            traffic_recorder = &recorder;
+            LOG_INFO_STREAM("Recording node traffic to " << config.record_file);
+        }
+    }
+
+    // Binary telemetry for the long run: every component writes to it
+    // through telemetry_journal
+    TelemetryJournal journal;
+    if (!config.journal_dir.empty()) {
+        std::string error;
+        if (!journal.open(config.journal_dir, config.journal_segment_mb, config.journal_max_mb, error)) {
+            std::cerr << "Error: journal: " << error << std::endl;
+            return 1;
+        }
+        telemetry_journal = &journal;
+        LOG_INFO_STREAM("Journaling telemetry to " << config.journal_dir << " (" << config.journal_segment_mb
+                        << " MB files, " << config.journal_max_mb << " MB kept)");
+    }
+
+    // Set up signal handlers
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    signal(SIGUSR1, control_signal_handler);
+    signal(SIGUSR2, control_signal_handler);
+    TraceRecorder::set_thread_name("main");
+    if (!config.trace_file.empty()) {
+        TraceRecorder::enable();
+    }
+
+    if (config.headless) {
+        // No terminal at all; SIGHUP (from systemctl reload) reloads
+        signal(SIGHUP, control_signal_handler);
+    } else {
+        // Set up non-blocking keyboard input
+        set_nonblocking_input();
+        atexit(restore_terminal);
+
+        drawBoxTop("");
+        drawCentered("JUNO CASH RANDOMX MINER", "\e[1;33m");
+        drawCentered("Privacy Money for All", "\e[1;36m");
+        drawBoxBottom();
+        std::cout << std::endl;
+    }
+
+    if (!config.proxy_listen.empty()) {
+        return run_proxy(config);
+    }
+
+    // A profile --autotune saved for this kind of host fills in whatever
+    // the command line left at its defaults
+    if (config.use_profile && !config.autotune) {
+        TuneProfile profile;
+        if (load_tune_profile(default_profile_path(), autotune_host_key(), profile)) {
+            std::string applied = apply_tune_profile(profile, config);
+            if (!applied.empty()) {
+                std::cout << "Tuned profile: " << applied << std::endl;
+                LOG_INFO_STREAM("Tuned profile applied: " << applied);
+            }
+        }
+    }
+
+    // Detect system resources
+    LOG_DEBUG("Detecting system resources");
+    utils::SystemResources resources = utils::detect_system_resources();
+    if (!config.headless) {
+        print_system_info(resources);
+    }
+    LOG_DEBUG_STREAM("System: " << resources.cpu_cores << " cores, "
+                     << (resources.total_ram_mb / 1024.0) << " GB RAM, optimal threads: "
+                     << resources.optimal_threads);
+    std::string resource_limits = utils::describe_resource_limits(resources);
+    if (!resource_limits.empty()) {
+        LOG_INFO_STREAM("Resources limited to " << resources.cpu_cores << " CPUs, " << resources.available_ram_mb
+                        << " MB available (" << resource_limits << ")");
+    }
+    if (config.autotune) {
+        return run_autotune(config, resources);
+    }
+    if (config.verify_blocks) {
+        return run_block_verification(config, resources);
+    }
+
+    // Fast or medium mode that the memory budget can't hold gets the miner
+    // OOM-killed while building its dataset: step down to the largest share
+    // of the dataset that fits beside the cache and scratchpads (the backend
+    // plans replicas and the spare epochs the same way once it knows the
+    // NUMA placement)
+    bool fast_mode = config.fast_mode;
+    const MemoryBudget memory_budget = resolve_memory_budget(config.memory_budget_mb, resources);
+    {
+        MemoryPlanner planner;
+        planner.set_budget(memory_budget);
+        MemoryDemand demand;
+        demand.fast = fast_mode;
+        demand.medium_mb = config.medium_mode_mb;
+        demand.threads = config.auto_threads ? resources.cpu_cores : config.num_threads;
+        MemoryPlan plan = planner.plan(demand);
+        if (!plan.mode_change.empty()) {
+            std::cout << "Warning: Memory: " << plan.mode_change << std::endl;
+            LOG_WARNING_STREAM("Memory: " << plan.mode_change);
+            fast_mode = plan.fast;
+            config.medium_mode_mb = plan.medium_mb;
+        }
+        LOG_DEBUG_STREAM("Memory budget: " << memory_budget.mb << " MB (" << memory_budget.source << ")");
+    }
+
+    // The hugetlb cgroup charges huge pages when they are first touched, so
+    // an allocation past its limit succeeds and then dies with SIGBUS; use
+    // normal pages for whatever the budget can't cover
+    if (config.huge_pages) {
+        const size_t MB = 1024 * 1024;
+        const size_t cache_mb = 256;
+        const size_t dataset_mb = fast_mode ? randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE / MB
+                                            : config.medium_mode_mb;
+        if (config.huge_pages_1gb && dataset_mb && resources.huge_page_1gb_budget_mb < dataset_mb) {
+            config.huge_pages_1gb = false;
+            std::cout << "Warning: cgroup allows " << resources.huge_page_1gb_budget_mb
+                      << " MB of 1GB pages, not using them" << std::endl;
+        }
+        size_t need_mb = cache_mb + (config.huge_pages_1gb ? 0 : dataset_mb);
+        if (resources.huge_page_budget_mb < need_mb) {
+            config.huge_pages = false;
+            config.huge_pages_1gb = false;
+            std::cout << "Warning: cgroup allows " << resources.huge_page_budget_mb << " MB of huge pages, "
+                      << need_mb << " MB needed; using normal pages" << std::endl;
+        }
+    }
+
+    // Determine thread count based on mode
+    unsigned int optimal_threads = utils::calculate_optimal_threads(resources, fast_mode);
+    if (optimal_threads == 0) {
+        // Fast mode kept by --memory-budget over what is free now
+        optimal_threads = utils::calculate_optimal_threads(resources, false);
+    }
+    unsigned int num_threads = config.auto_threads ? optimal_threads : config.num_threads;
+    if (config.auto_threads && !config.cpu_list.empty()) {
+        num_threads = config.cpu_list.size();  // One thread per listed CPU
+    }
+    LOG_DEBUG_STREAM("Thread count: " << num_threads << " (auto: " << (config.auto_threads ? "yes" : "no") << ")");
+    // Changed at runtime by the memory governor
+    std::string mode_name = fast_mode ? "FAST" : config.medium_mode_mb ? "MEDIUM" : "LIGHT";
+    LOG_DEBUG_STREAM("Mode: " << mode_name);
+
+    if (num_threads > resources.cpu_cores) {
+        std::cout << "Warning: Requested " << num_threads << " threads, but only "
+                  << resources.cpu_cores << " CPU cores available" << std::endl;
+    }
+
+    std::string mode_str = fast_mode ? "FAST (2x hashrate)"
+                         : config.medium_mode_mb ? "MEDIUM (" + std::to_string(config.medium_mode_mb) + " MB of dataset)"
+                         : "LIGHT";
+    std::cout << "Mode: " << mode_str << std::endl;
+    std::cout << "Using " << num_threads << " mining thread(s)" << std::endl;
+    std::cout << std::endl;
+
+    if (config.benchmark) {
+        return run_benchmark(config, num_threads, fast_mode, mode_name);
+    }
+
+    // The control loop sleeps here; submission results, pushed templates,
+    // keystrokes and signals wake it
+    EventLoop event_loop;
+    event_loop.watch_input(!config.headless);
+    global_event_loop = &event_loop;
+
+    // Templates fetched by the long poll, ZMQ and pool threads
+    TemplateInbox inbox([&event_loop]() { event_loop.wake(); });
+
+    // The backend comes up before the node or pool is reached, so a restart
+    // can start on its epoch straight away
+    LOG_DEBUG("Initializing miner and RandomX cache");
+    std::string backend_error;
+    std::unique_ptr<MiningBackend> backend = create_mining_backend(config, num_threads, fast_mode, backend_error);
+    if (!backend) {
+        std::cerr << "Error: " << backend_error << std::endl;
+        return 1;
+    }
+    MiningBackend& miner = *backend;
+    global_miner = &miner;
+    apply_msr(config, miner, true);
+
+    // Most restarts land in the epoch the last run mined on: build it while
+    // connecting instead of after the first template names the seed, and
+    // abandon it if the template disagrees. An upgrade gets its seed from
+    // the running miner instead.
+    const std::string seed_dir = !config.dataset_cache ? std::string()
+                               : config.dataset_cache_dir.empty() ? DatasetStore::default_directory()
+                               : config.dataset_cache_dir;
+    SpeculativeInit speculative(miner);
+    LastSeed last_seed;
+    if (config.speculative_init && config.upgrade_socket.empty() && DatasetStore::load_last_seed(seed_dir, last_seed)) {
+        std::cout << "Building RandomX for the last run's seed (height " << last_seed.seed_height
+                  << ") while connecting..." << std::endl;
+        LOG_INFO_STREAM("Speculative init for the last seed "
+                        << utils::bytes_to_hex(last_seed.seed_hash.data(), last_seed.seed_hash.size())
+                        << " (height " << last_seed.seed_height << ")");
+        speculative.start(last_seed.seed_hash);
+    }
+    auto remember_seed = [&](const BlockTemplate& block_template) {
+        LastSeed seed;
+        seed.seed_hash = block_template.seed_hash;
+        seed.seed_height = block_template.seed_height;
+        DatasetStore::save_last_seed(seed_dir, seed);
+    };
+
+    // Pool mode: jobs come from the pool and shares go back to it; the node
+    // options are unused
+    std::unique_ptr<StratumClient> pool;
+    if (!config.pool_url.empty()) {
+        if (!config.upgrade_socket.empty()) {
+            std::cout << "Zero-downtime upgrades are not supported in pool mode, ignoring --upgrade-socket" << std::endl;
+            config.upgrade_socket.clear();
+        }
+        pool.reset(new StratumClient(config.pool_url, config.pool_user, config.pool_password, inbox,
+                                     [&event_loop]() { event_loop.wake(); }));
+        pool->start();
+    }
+
+    // One RPC client per node; the main loop talks to the active one and
+    // moves on to the next when it fails
+    std::vector<std::unique_ptr<RPCClient>> node_rpcs;
+    for (const std::string& url : config.rpc_urls) {
+        LOG_DEBUG_STREAM("Initializing RPC client: " << url);
+        node_rpcs.emplace_back(new RPCClient(url, config.rpc_user, config.rpc_password));
+    }
+    unsigned int active_node = 0;
+    auto fail_over = [&]() {
+        if (node_rpcs.size() < 2) return;
+        active_node = (active_node + 1) % node_rpcs.size();
+        add_update_message("Switching to node " + config.rpc_urls[active_node]);
+        LOG_WARNING_STREAM("Failing over to node " << config.rpc_urls[active_node]);
+    };
+
+    // Test RPC connection (the first node that answers starts out active)
+    Json::Value blockchain_info;
+    bool connected = false;
+    for (size_t i = 0; i < node_rpcs.size() && !connected && !pool; i++) {
+        std::cout << "Testing RPC connection to " << config.rpc_urls[i] << "..." << std::endl;
+        connected = node_rpcs[i]->get_blockchain_info(blockchain_info);
+        if (connected) {
+            active_node = i;
+        } else {
+            LOG_WARNING_STREAM("Node " << config.rpc_urls[i] << " unreachable: " << node_rpcs[i]->get_last_error());
+        }
+    }
+    if (!connected && !pool) {
+        std::cerr << "Failed to connect to RPC server" << std::endl;
+        std::cerr << "Please check your RPC URL, username, and password" << std::endl;
+        LOG_ERROR("RPC connection failed");
+        return 1;
+    }
+
+    if (pool) {
+        std::cout << "Connecting to pool " << config.pool_url << "..." << std::endl;
+    } else {
+        std::cout << "Connected to node:" << std::endl;
+        std::cout << "  Chain: " << blockchain_info["chain"].asString() << std::endl;
+        std::cout << "  Block: " << blockchain_info["blocks"].asUInt() << std::endl;
+        std::cout << std::endl;
+        LOG_INFO_STREAM("Connected to " << blockchain_info["chain"].asString()
+                        << " at block " << blockchain_info["blocks"].asUInt());
+    }
+
+    // Upgrade: a miner already running here hands over its template (and so
+    // its seed and shared dataset) and nonce position, then keeps mining until
+    // this process is hashing
+    UpgradeHandoff upgrade;
+    UpgradeState inherited;
+    bool taking_over = !config.upgrade_socket.empty() && upgrade.take_over(config.upgrade_socket, inherited);
+    if (taking_over) {
+        std::cout << "Taking over from the miner on " << config.upgrade_socket << "..." << std::endl;
+    }
+
+    // Get initial block template to determine seed
+    std::cout << "Fetching initial block template to determine RandomX seed..." << std::endl;
+    LOG_DEBUG("Requesting initial block template");
+    BlockTemplatePtr initial_template;
+    BlockTemplate fetched_initial;
+    if (pool) {
+        initial_template = pool->wait_for_job(std::chrono::seconds(STRATUM_TIMEOUT_SECONDS));
+        if (!initial_template) {
+            std::cerr << "Failed to get a job from the pool: " << pool->get_last_error() << std::endl;
+            LOG_ERROR_STREAM("No job from the pool: " << pool->get_last_error());
+            return 1;
+        }
+    } else if (taking_over) {
+        initial_template = std::make_shared<const BlockTemplate>(parse_block_template(inherited.block_template));
+    } else if (node_rpcs[active_node]->get_block_template(fetched_initial, "")) {
+        initial_template = std::make_shared<const BlockTemplate>(std::move(fetched_initial));
+    } else {
+        std::cerr << "Failed to get initial block template" << std::endl;
+        LOG_ERROR("Failed to get initial block template");
+        return 1;
+    }
+    LOG_DEBUG_STREAM("Initial template: height=" << initial_template->height
+                     << " seed_height=" << initial_template->seed_height);
+
+    // Settle a speculative build before anything else touches the miner:
+    // keep it if the template confirms its seed, else move to the right one
+    const bool speculative_used = speculative.running();
+    const auto speculative_started = speculative.started();
+    if (speculative_used) {
+        const bool confirmed = speculative.seed_hash() == initial_template->seed_hash;
+        if (confirmed) {
+            LOG_INFO("Speculative init confirmed by the first template");
+        } else {
+            std::cout << "The seed has changed since the last run, building the new epoch" << std::endl;
+            LOG_INFO("Speculative init abandoned: the first template has another seed");
+            miner.abandon_initialize();
+        }
+        if (!speculative.finish() || (!confirmed && !miner.update_seed(initial_template->seed_hash))) {
+            std::cerr << "Failed to initialize miner" << std::endl;
+            LOG_ERROR("Miner initialization failed");
+            return 1;
+        }
+    }
+
+    NonceAllocator nonces(config.deterministic_nonce, config.auto_instance_id, config.instance_id);
+    if (taking_over) {
+        nonces.resume(inherited.instance_id, inherited.job_sequence + UPGRADE_JOB_SEQUENCE_GAP, inherited.salt.data());
+    }
+    miner.set_nonce_allocator(nonces);
+    LOG_INFO_STREAM("Nonce space: instance ID " << miner.get_nonce_allocator().get_instance_id()
+                    << (config.deterministic_nonce ? " (deterministic)" : ""));
+    // Co-location: give the host's services back the workers they need
+    ColocationGovernor governor(miner, config.colocation);
+    if (config.adaptive) {
+        governor.start(num_threads);
+        LOG_INFO_STREAM("Adaptive co-location on: PSI from " << config.colocation.psi_dir << ", limits cpu "
+                        << config.colocation.cpu_pressure << "%, memory " << config.colocation.memory_pressure
+                        << "%, steal " << config.colocation.steal << "%"
+                        << (config.colocation.signal_path.empty() ? std::string()
+                            : ", " + config.colocation.signal_path + " under "
+                              + std::to_string(config.colocation.signal_limit)));
+    }
+    // The workers' own L3 ways, sized for those the governors let hash
+    CachePartition partition;
+    if (config.cache_partition) {
+        std::string error;
+        if (partition.open(config.partition, error)) {
+            LOG_INFO_STREAM("Cache partition on: resctrl group " << RESCTRL_GROUP
+                            << (config.partition.l3_mask ? ", fixed L3 mask" : ", L3 ways sized for the active workers"));
+        } else {
+            std::cout << "Warning: Cache partition unavailable: " << error << std::endl;
+            LOG_WARNING_STREAM("Cache partition unavailable: " << error);
+        }
+    }
+    if (config.sched_idle) {
+        LOG_INFO("Mining threads run under SCHED_IDLE");
+    }
+    // Memory pressure: a dataset paged out to swap hashes slower than light
+    // mode, so step down to a smaller one (and back once there is room)
+    const MiningMode configured_mode(fast_mode, config.medium_mode_mb);
+    MiningMode current_mode = configured_mode;
+    // Building an epoch steps down by itself when a dataset can't be
+    // allocated (initialize, epoch changes, mode switches)
+    auto follow_mode = [&]() {
+        MiningMode mode(miner.is_fast_mode(), miner.medium_mode_mb());
+        // Medium mode keeps whole 2MB init slices of what it was asked for
+        if (mode.fast == current_mode.fast && mode.dataset_mb() + 2 >= current_mode.dataset_mb()) return;
+        std::string msg = std::string("Mining in ") + mode.name() + " mode: out of memory for " + current_mode.name();
+        current_mode = mode;
+        mode_name = current_mode.name();
+        add_update_message(msg);
+        LOG_WARNING(msg);
+    };
+    std::unique_ptr<MemoryGovernor> memory_governor;
+    if (config.memory_fallback && configured_mode.dataset_mb() > 0) {
+        memory_governor.reset(new MemoryGovernor(configured_mode));
+        LOG_DEBUG_STREAM("Memory fallback on for " << configured_mode.name() << " mode ("
+                         << configured_mode.dataset_mb() << " MB dataset)");
+    }
+    // Package power: always reported where it can be read, held to
+    // --power-cap or --max-efficiency if asked
+    PowerGovernor power(miner, config.power);
+    if (power.start(num_threads)) {
+        LOG_INFO_STREAM("Package power from " << power.source()
+                        << (config.power.cap_watts > 0 ? ", capped at " + std::to_string((int)config.power.cap_watts) + " W"
+                            : std::string())
+                        << (config.power.efficiency ? ", thread count for the most hashes per joule" : ""));
+    } else if (config.power.controls()) {
+        std::cerr << "Error: --power-cap and --max-efficiency need CPU package power (RAPL or amd_energy, as root)"
+                  << std::endl;
+        LOG_ERROR("Package power can't be read for --power-cap/--max-efficiency");
+        return 1;
+    } else {
+        LOG_DEBUG("Package power can't be read (no RAPL or amd_energy, or not root)");
+    }
+    // Package temperatures for the journal, where hwmon has them
+    CpuTemperature temperature;
+    if (telemetry_journal && !temperature.open()) {
+        LOG_DEBUG("No CPU temperature sensors for the journal (coretemp, k10temp or zenpower)");
+    }
+    // What the control API asks of the workers: hash on control_threads of
+    // them (the T key and added workers reset it to all), and on
+    // control_throttle percent of those. Workers above sleep with their VMs
+    // kept, so both ways take effect within a few hashes; with a governor on
+    // it is the governor's ceiling instead.
+    unsigned int control_threads = num_threads;
+    unsigned int control_throttle = 100;
+    std::vector<int> control_cpus = config.cpu_list;
+    auto apply_worker_ceiling = [&]() -> unsigned int {
+        unsigned int ceiling = std::min(control_threads, num_threads);
+        ceiling = std::max(1u, (ceiling * control_throttle + 99) / 100);
+        governor.set_thread_count(ceiling);
+        power.set_thread_count(ceiling);
+        if (!config.adaptive && !config.power.controls()) {
+            miner.set_worker_limit(ceiling);
+        }
+        return ceiling;
+    };
+    // Readiness, reloads, status and watchdog for a systemd service
+    SystemdNotifier notifier;
+    notifier.notify("STATUS=Initializing RandomX");
+
+    // Prometheus metrics: the page is refreshed with each status update
+    MetricsServer metrics_server;
+    if (!config.metrics_listen.empty()) {
+        std::string listen_error;
+        if (!metrics_server.listen(config.metrics_listen, listen_error)) {
+            std::cerr << "Error: " << listen_error << std::endl;
+            LOG_ERROR_STREAM("Metrics: " << listen_error);
+            return 1;
+        }
+        metrics_server.start();
+        LOG_INFO_STREAM("Serving metrics at http://" << config.metrics_listen << "/metrics");
+    }
+    // Fleet dataset distribution: a builder serves its dataset cache, where
+    // the background build also writes each next epoch; a rig downloads the
+    // next epoch before building it (see prepare_next_seed below)
+    DatasetServer dataset_server(seed_dir);
+    if (!config.dataset_serve.empty()) {
+        std::string listen_error;
+        if (!dataset_server.listen(config.dataset_serve, listen_error)) {
+            std::cerr << "Error: " << listen_error << std::endl;
+            LOG_ERROR_STREAM("Dataset server: " << listen_error);
+            return 1;
+        }
+        dataset_server.start();
+        LOG_INFO_STREAM("Serving RandomX epochs from " << seed_dir << " at http://" << config.dataset_serve
+                        << "/dataset/");
+        if (!fast_mode) {
+            LOG_WARNING("Only fast mode builds the epochs --dataset-serve offers; serving what the cache holds");
+        }
+    }
+    std::unique_ptr<DatasetFetcher> dataset_fetcher;
+    if (!config.dataset_source.empty()) {
+        dataset_fetcher.reset(new DatasetFetcher(config.dataset_source, seed_dir));
+    }
+    // Control API: changes are queued for the main loop, which applies them
+    // between hashes (see apply_control)
+    ControlServer control(config.control_token, [&event_loop]() { event_loop.wake(); });
+    if (!config.control_listen.empty()) {
+        std::string listen_error;
+        if (!control.listen(config.control_listen, listen_error)) {
+            std::cerr << "Error: " << listen_error << std::endl;
+            LOG_ERROR_STREAM("Control: " << listen_error);
+            return 1;
+        }
+        control.start();
+        LOG_INFO_STREAM("Serving the control API at http://" << config.control_listen);
+    }
+    // Timeline traces (--trace): SIGUSR2 or the control API starts one for
+    // trace_seconds, or arms one that starts at the next epoch change and
+    // runs trace_seconds past it. The main loop writes it out at the end.
+    bool trace_epoch_armed = false;
+    auto trace_until = std::chrono::steady_clock::now();
+    auto start_trace = [&](unsigned int seconds) {
+        TraceRecorder::instance().start();
+        trace_until = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+        add_update_message("Trace: recording for " + std::to_string(seconds) + " s");
+        LOG_INFO_STREAM("Trace: recording for " << seconds << " s");
+    };
+    // A trace asked for with SIGUSR2 or the control API: seconds long, or
+    // 0 for the next epoch change. False with error set if it can't be.
+    auto request_trace = [&](unsigned int seconds, std::string& error) -> bool {
+        if (config.trace_file.empty()) {
+            error = "no trace file to write to (--trace)";
+            return false;
+        }
+        if (TraceRecorder::active() || trace_epoch_armed) {
+            error = "a trace is already running";
+            return false;
+        }
+        if (seconds) {
+            start_trace(seconds);
+        } else {
+            trace_epoch_armed = true;
+            add_update_message("Trace: armed for the next epoch change");
+            LOG_INFO("Trace: armed for the next epoch change");
+        }
+        return true;
+    };
+    auto finish_trace = [&]() {
+        TraceSummary summary;
+        std::string error;
+        if (!TraceRecorder::instance().stop_and_write(config.trace_file, summary, error)) {
+            add_update_message("Trace: " + error);
+            LOG_ERROR_STREAM("Trace: " << error);
+            return;
+        }
+        std::ostringstream msg;
+        msg << "Trace: " << summary.events << " events from " << summary.threads << " threads over "
+            << std::fixed << std::setprecision(1) << summary.seconds << " s written to " << config.trace_file;
+        if (summary.dropped) {
+            msg << " (" << summary.dropped << " dropped)";
+        }
+        add_update_message(msg.str());
+        LOG_INFO(msg.str());
+    };
+
+    // Epoch initializations, for the metrics
+    uint64_t epoch_inits = 0;
+    double epoch_init_seconds = 0.0;
+    double last_epoch_init_seconds = 0.0;
+    auto count_epoch_init = [&](std::chrono::steady_clock::time_point started) {
+        last_epoch_init_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        epoch_init_seconds += last_epoch_init_seconds;
+        epoch_inits++;
+    };
+
+    // Initialize miner with seed, unless the speculative build already has
+    auto init_started = speculative_started;
+    if (!speculative_used) {
+        init_started = std::chrono::steady_clock::now();
+        if (!miner.initialize(initial_template->seed_hash)) {
+            std::cerr << "Failed to initialize miner" << std::endl;
+            LOG_ERROR("Miner initialization failed");
+            return 1;
+        }
+    }
+    count_epoch_init(init_started);
+    remember_seed(*initial_template);
+    LOG_INFO("Miner initialized successfully");
+    follow_mode();
+    if (!config.upgrade_socket.empty() && !taking_over) {
+        upgrade.listen(config.upgrade_socket);
+    }
+
+    // What a successor started with the same --upgrade-socket takes over
+    auto publish_upgrade_state = [&](const BlockTemplate& block_template) {
+        if (config.upgrade_socket.empty()) return;
+        UpgradeState state;
+        state.block_template = block_template_to_json(block_template);
+        const NonceAllocator& allocator = miner.get_nonce_allocator();
+        state.instance_id = allocator.get_instance_id();
+        state.job_sequence = allocator.get_job_sequence();
+        state.salt.assign(allocator.get_salt(), allocator.get_salt() + NONCE_SALT_SIZE);
+        upgrade.publish(state);
+    };
+
+    std::cout << std::endl;
+    std::cout << "Starting mining..." << std::endl;
+    std::cout << std::endl;
+
+    // Initialize status variables
+    uint64_t blocks_mined = 0;
+    uint64_t shares_accepted = 0;  // Pool mode
+    uint64_t shares_rejected = 0;
+    uint64_t blocks_rejected = 0;
+    std::atomic<uint64_t> solutions_submitted(0);  // Counted on the workers
+    auto start_time = std::chrono::steady_clock::now();
+    const int stats_update_interval = 10; // Update network stats every 10 seconds
+    uint64_t current_block_height = 0;
+    std::string current_previous_hash;  // Identify the template being mined,
+    std::string current_longpollid;     // to skip pushed copies of it
+    unsigned int current_node = 0;      // and its node, whose refreshes it takes
+    std::string current_job_id;         // (pool mode) and pool job
+    BlockTemplatePtr current_template;  // The template itself, for rolling nTime
+    auto template_fetched_at = start_time;
+    // Pool jobs keep the pool's nTime: it rebuilds the header from its blob
+    const bool roll_ntime = config.ntime_roll && !pool;
+    std::vector<uint8_t> current_seed_hash = initial_template->seed_hash;
+    bool ui_initialized = false;
+    // The T key's prompt: open, and what has been typed
+    bool thread_prompt = false;
+    std::string thread_input;
+    bool huge_pages_reported = !config.huge_pages;
+    // Where the memory landed against the workers' CPUs: reported once the
+    // scratchpads are faulted in after the start, a thread count change or
+    // an epoch change, and refreshed quietly for /metrics in between
+    MemoryLocality locality;
+    auto locality_due = start_time + std::chrono::seconds(stats_update_interval);
+    bool locality_announce = true;
+    bool effective_hashrate_low = false;
+    // Hashrate across jobs, sampled with every status update
+    HashrateMeter hashrate_meter;
+    std::vector<bool> stalled_threads;
+
+    // Add initial update message
+    add_update_message("Mining started");
+
+    // Solutions are serialized on the worker that finds them and submitted
+    // from their own thread and connection while the other workers go on
+    // hashing, so submission doesn't wait for the main loop or a pool restart.
+    // Each node has a warm submitter and every block goes to all of them at
+    // once, the node whose template it was built on first, so more of the
+    // network sees it sooner. That node's submitter also fetches the template
+    // on top of our block as soon as it is accepted, while the workers keep
+    // hashing the found job. In pool mode every share goes to the pool.
+    std::vector<std::unique_ptr<BlockSubmitter>> submitters;
+    for (size_t i = 0; i < config.rpc_urls.size() && !pool; i++) {
+        submitters.emplace_back(new BlockSubmitter(i, config.rpc_urls[i], config.rpc_user, config.rpc_password,
+                                                   [&event_loop]() { event_loop.wake(); }));
+        submitters.back()->set_retry_window(std::chrono::seconds(config.outage_grace_seconds));
+        submitters.back()->set_next_template_inbox(&inbox);
+        submitters.back()->start();
+    }
+    miner.set_every_solution(pool != nullptr);
+    miner.set_share_bits(config.share_bits);
+    // Every block switch is timed from notice to each worker's first hash
+    SwitchTrace switch_trace;
+    miner.set_switch_trace(&switch_trace);
+    miner.set_solution_handler([&submitters, &pool, &solutions_submitted](const uint8_t* header, const uint8_t* hash,
+                                                                           const BlockTemplate& block_template) {
+        solutions_submitted.fetch_add(1, std::memory_order_relaxed);
+        if (pool) {
+            pool->submit(header, hash, block_template);
+            return;
+        }
+        auto block_hex = std::make_shared<const std::string>(
+            utils::format_block(header, hash, block_template.block_body_hex));
+        // In Juno Cash, the block hash IS the RandomX PoW hash (stored in nSolution)
+        // See CBlockHeader::GetHash() in src/primitives/block.cpp
+        std::string block_hash_hex = utils::bytes_to_hex_reversed(hash, 32);
+        submitters[block_template.node]->submit(block_hex, block_template.height, block_hash_hex, true);
+        for (size_t i = 0; i < submitters.size(); i++) {
+            if (i != block_template.node) {
+                submitters[i]->submit(block_hex, block_template.height, block_hash_hex);
+            }
+        }
+    });
+
+    // The next submission any node's submitter finished
+    auto take_submit_result = [&submitters, &pool](SubmitResult& result) {
+        if (pool) {
+            return pool->take_result(result);
+        }
+        for (auto& submitter : submitters) {
+            if (submitter->take_result(result)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Refresh the page the metrics server hands out (on the main thread, so
+    // a scrape never waits on the miner)
+    auto publish_metrics = [&]() {
+        if (!metrics_server.running()) {
+            return;
+        }
+        MinerMetrics metrics;
+        metrics.height = current_block_height;
+        metrics.threads = miner.get_thread_count();
+        metrics.warming_up = miner.is_warming_up();
+        metrics.mode = mode_name;
+        metrics.mode_switches = memory_governor ? memory_governor->switches() : 0;
+        metrics.hashrate = hashrate_meter.snapshot();
+        metrics.thread_nodes = miner.get_thread_numa_nodes();
+        metrics.thread_core_types = miner.get_thread_core_types();
+        metrics.colocation = governor.snapshot();
+        metrics.power = power.snapshot();
+        metrics.stale_hashes = miner.get_stale_hash_count();
+        metrics.thread_phases = miner.get_thread_phase_profiles();
+        metrics.locality = locality;
+        metrics.block_switches = switch_trace.switches();
+        for (int stage = 0; stage < SWITCH_STAGES; stage++) {
+            metrics.switch_latency[stage] = switch_trace.histogram((SwitchStage)stage);
+        }
+        for (size_t i = 0; i < node_rpcs.size() && !pool; i++) {
+            metrics.rpc.emplace_back(config.rpc_urls[i], node_rpcs[i]->get_all_call_stats());
+        }
+        metrics.epoch_inits = epoch_inits;
+        metrics.epoch_init_seconds = epoch_init_seconds;
+        metrics.last_epoch_init_seconds = last_epoch_init_seconds;
+        metrics.init_timing = miner.get_init_timing();
+        utils::process_memory_mb(metrics.resident_mb, metrics.peak_mb);
+        utils::process_huge_page_mb(metrics.hugetlb_mb, metrics.transparent_huge_mb);
+        metrics.memory = miner.memory_usage();
+        metrics.memory_budget = miner.memory_budget();
+        metrics.blocks_submitted = solutions_submitted.load(std::memory_order_relaxed);
+        metrics.blocks_accepted = pool ? shares_accepted : blocks_mined;
+        metrics.blocks_rejected = pool ? shares_rejected : blocks_rejected;
+        metrics.log_dropped = Logger::instance().dropped();
+        metrics_server.publish(render_metrics(metrics));
+    };
+    // Same for GET /status on the control API
+    auto publish_control_status = [&](const char* state) {
+        if (!control.running()) {
+            return;
+        }
+        Json::Value status;
+        status["state"] = state;
+        status["height"] = (Json::UInt64)current_block_height;
+        status["mode"] = current_mode.fast ? "fast" : current_mode.medium_mb ? "medium" : "light";
+        status["medium_mb"] = (Json::UInt64)current_mode.medium_mb;
+        status["threads"] = control_threads;
+        status["workers"] = num_threads;
+        status["active"] = miner.get_worker_limit();
+        status["throttle"] = control_throttle;
+        status["cpus"] = control_cpus.empty() ? std::string("auto") : format_cpu_list(control_cpus);
+        status["upstream"] = pool ? config.pool_url : config.rpc_urls[active_node];
+        status["nodes"] = Json::Value(Json::arrayValue);
+        for (size_t i = 0; i < config.rpc_urls.size() && !pool; i++) {
+            status["nodes"].append(config.rpc_urls[i]);
+        }
+        HashrateSnapshot hashrate = hashrate_meter.snapshot();
+        status["hashrate"]["10s"] = hashrate.rates[HASHRATE_10S];
+        status["hashrate"]["60s"] = hashrate.rates[HASHRATE_60S];
+        status["hashrate"]["15m"] = hashrate.rates[HASHRATE_15M];
+        status["hashes"] = (Json::UInt64)hashrate.total_hashes;
+        status["uptime"] = (Json::Int64)std::chrono::duration_cast<std::chrono::seconds>(
+                               std::chrono::steady_clock::now() - start_time).count();
+        status["blocks_accepted"] = (Json::UInt64)(pool ? shares_accepted : blocks_mined);
+        status["blocks_rejected"] = (Json::UInt64)(pool ? shares_rejected : blocks_rejected);
+        control.publish_status(status);
+    };
+
+    // Headless: a status line in the log every --status-interval, the same
+    // as the service status, full statistics on SIGUSR1 and the watchdog
+    // kept fed. Called with each status update.
+    auto last_status_line = std::chrono::steady_clock::time_point();
+    bool service_ready = false;
+    auto headless_tick = [&](std::chrono::steady_clock::time_point now, const char* state) {
+        notifier.watchdog(now);
+        bool dump = dump_requested.exchange(false);
+        if (!config.headless && !dump) {
+            return;
+        }
+        HashrateSnapshot hashrate = hashrate_meter.snapshot();
+        if (dump || now - last_status_line >= std::chrono::seconds(config.status_interval_seconds)) {
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(2) << "Status: state=" << state
+                 << " height=" << current_block_height
+                 << " hashrate_10s=" << hashrate.rates[HASHRATE_10S]
+                 << " hashrate_60s=" << hashrate.rates[HASHRATE_60S]
+                 << " hashrate_15m=" << hashrate.rates[HASHRATE_15M]
+                 << " hashes=" << hashrate.total_hashes << " stale=" << miner.get_stale_hash_count()
+                 << " threads=" << miner.get_thread_count()
+                 << (config.adaptive || config.power.controls() ? " active=" + std::to_string(miner.get_worker_limit())
+                     : std::string())
+                 << " mode=" << mode_name
+                 << " accepted=" << (pool ? shares_accepted : blocks_mined)
+                 << " rejected=" << (pool ? shares_rejected : blocks_rejected)
+                 << " uptime=" << std::chrono::duration_cast<std::chrono::seconds>(now - start_time).count();
+            PowerSample power_sample = power.snapshot();
+            if (power_sample.available) {
+                line << " power=" << power_sample.watts << " h_per_j=" << std::setprecision(3)
+                     << power_sample.hashes_per_joule;
+            }
+            LOG_INFO(line.str());
+            notifier.notify("STATUS=" + std::string(state) + ", height " + std::to_string(current_block_height) +
+                            ", " + format_hashrate(hashrate.rates[HASHRATE_60S]));
+            last_status_line = now;
+        }
+        if (dump) {
+            for (size_t i = 0; i < hashrate.threads.size(); i++) {
+                const ThreadHashrate& thread = hashrate.threads[i];
+                LOG_INFO_STREAM("Thread " << i << ": " << thread.hashes << " hashes, "
+                                << format_hashrate(thread.rates[HASHRATE_10S]) << " / "
+                                << format_hashrate(thread.rates[HASHRATE_60S]) << " / "
+                                << format_hashrate(thread.rates[HASHRATE_15M])
+                                << (thread.stalled ? ", stalled" : ""));
+            }
+            for (size_t i = 0; i < node_rpcs.size() && !pool; i++) {
+                LOG_INFO_STREAM("RPC latency (" << config.rpc_urls[i] << "):\n" << node_rpcs[i]->describe_call_stats());
+            }
+            LOG_INFO_STREAM("Block switches: " << switch_trace.switches() << "\n" << switch_trace.describe());
+            std::string huge_pages = miner.huge_page_summary();
+            if (!huge_pages.empty()) {
+                LOG_INFO_STREAM("Huge pages: " << huge_pages);
+            }
+            locality = miner.memory_locality();
+            LOG_INFO_STREAM("Memory locality: " << locality.describe() << describe_node_hashrates(hashrate, locality));
+        }
+    };
+
+    // Per block hash, how many nodes have answered and whether one accepted
+    struct SubmitTally {
+        size_t answered = 0;
+        bool accepted = false;
+        bool next_template = false;  // Fetched by a submitter already
+    };
+    std::map<std::string, SubmitTally> submit_tallies;
+
+    // Report what the submitters finished; true if a block was accepted and
+    // the template on top of it still has to be fetched. The first node to
+    // accept a block counts it; it is rejected only once every node has
+    // turned it down. Pool shares are only counted: the pool sends
+    // the next job itself.
+    auto report_submissions = [&]() -> bool {
+        bool any_accepted = false;
+        SubmitResult submitted;
+        while (take_submit_result(submitted)) {
+            if (pool) {
+                if (submitted.accepted) {
+                    shares_accepted++;
+                    LOG_INFO_STREAM("Share accepted (" << submitted.result << ") at height " << submitted.height
+                                    << ", answered " << submitted.submit_ms << " ms after it was found");
+                } else {
+                    shares_rejected++;
+                    add_update_message("Share rejected: " + submitted.result);
+                    LOG_WARNING_STREAM("Share rejected: " << submitted.result << " (hash "
+                                       << submitted.block_hash_hex << ")");
+                }
+                continue;
+            }
+            SubmitTally& tally = submit_tallies[submitted.block_hash_hex];
+            tally.next_template = tally.next_template || submitted.next_template;
+            tally.answered++;
+            bool all_answered = tally.answered >= submitters.size();
+            bool first_acceptance = submitted.accepted && !tally.accepted;
+            bool rejected_everywhere = all_answered && !tally.accepted && !submitted.accepted;
+            tally.accepted = tally.accepted || submitted.accepted;
+            bool next_template_fetched = tally.next_template;
+            if (all_answered) {
+                submit_tallies.erase(submitted.block_hash_hex);
+            }
+            if (submitters.size() > 1) {
+                LOG_INFO_STREAM("Node " << config.rpc_urls[submitted.node] << " answered "
+                                << submitted.result << " for height " << submitted.height << " after "
+                                << submitted.submit_ms << " ms");
+            }
+            if (!first_acceptance && !rejected_everywhere) {
+                continue;
+            }
+
+            std::ostringstream hash_msg;
+            hash_msg << "Block hash: " << submitted.block_hash_hex;
+            if (submitted.accepted) {
+                blocks_mined++;
+                // Unless its submitter left the next template in the inbox
+                any_accepted = any_accepted || !next_template_fetched;
+                // Format success message with block details
+                std::ostringstream msg;
+                msg << "BLOCK ACCEPTED";
+                if (submitted.result != "accepted") {
+                    msg << " (" << submitted.result << ")";
+                }
+                msg << "! Height " << submitted.height
+                    << " (Total: " << blocks_mined << ")";
+                add_update_message(msg.str());
+                add_update_message(hash_msg.str());
+
+                LOG_INFO_STREAM("BLOCK ACCEPTED (" << submitted.result << ")! Height: " << submitted.height
+                               << " Total mined: " << blocks_mined << ", submitted "
+                               << submitted.submit_ms << " ms after it was found");
+                LOG_INFO_STREAM("  Block hash (RandomX): " << submitted.block_hash_hex);
+            } else {
+                blocks_rejected++;
+                add_update_message("Block rejected: " + submitted.result);
+                add_update_message(hash_msg.str());
+
+                LOG_WARNING_STREAM("Block rejected: " << submitted.result);
+                LOG_WARNING_STREAM("  Block hash (RandomX): " << submitted.block_hash_hex);
+            }
+        }
+        return any_accepted;
+    };
+
+    // Network hashrate, difficulty and balance, refreshed off the main loop
+    NetworkStatsPoller network_stats(config.rpc_urls[0], config.rpc_user, config.rpc_password,
+                                     !config.no_balance, stats_update_interval);
+    if (!pool) {
+        network_stats.start();
+    }
+
+    // Start ZMQ subscriber thread if configured
+#ifdef HAVE_ZMQ
+    std::thread zmq_thread;
+    if (!config.zmq_url.empty() && !pool) {
+        LOG_INFO_STREAM("Starting ZMQ subscriber for instant block notifications: " << config.zmq_url);
+        add_update_message("ZMQ block notifications enabled");
+        zmq_thread = std::thread(zmq_subscriber_thread, std::cref(config), std::ref(inbox));
+    }
+#endif
+    std::thread replay_thread;
+    if (traffic_replay && !pool) {
+        add_update_message("Replaying " + config.replay_file);
+        replay_thread = std::thread(replay_driver_thread, std::cref(config), std::ref(inbox));
+    }
+
+    // Track connection state for reconnection messages
+    bool was_disconnected = false;
+
+    // A long poll per node on its own connection. The one for the node being
+    // mined starts once its template carries a longpollid; the others start
+    // right away, so whichever node hears of a block first delivers it.
+    std::vector<std::unique_ptr<TemplateLongPoll>> longpolls;
+    for (unsigned int node = 0; node < config.rpc_urls.size(); node++) {
+        longpolls.emplace_back(new TemplateLongPoll(config.rpc_urls[node], config.rpc_user, config.rpc_password,
+                                                    inbox, node));
+        if (config.longpoll && node != active_node && !pool) {
+            longpolls.back()->start();
+        }
+    }
+    auto follow_longpoll = [&](const BlockTemplate& block_template) {
+        if (config.longpoll) {
+            longpolls[block_template.node]->follow(block_template.longpollid);
+        }
+    };
+
+    // With --dataset-source the next epoch is downloaded first, and the
+    // background build then maps it in from the dataset cache (or builds it,
+    // if the download was given up on)
+    auto prepare_next_seed = [&](const std::vector<uint8_t>& next_seed_hash) {
+        if (dataset_fetcher && miner.is_fast_mode() && !dataset_fetcher->settled(next_seed_hash)) {
+            return;
+        }
+        miner.prepare_next_seed(next_seed_hash);
+    };
+
+    // Hot-swap: point the running workers at a newer template without stopping
+    // them. False if the outer loop has to restart instead (an epoch change).
+    auto switch_template = [&](const BlockTemplatePtr& next_template) -> bool {
+        TraceScope span("switch", "switch template", (int64_t)next_template->height);
+        prepare_next_seed(next_template->next_seed_hash);
+        // Epoch changes still go through update_seed in the outer loop
+        if (next_template->seed_hash != current_seed_hash || !miner.update_job(next_template)) {
+            return false;
+        }
+        current_block_height = next_template->height;
+        current_previous_hash = next_template->previous_block_hash;
+        current_longpollid = next_template->longpollid;
+        current_job_id = next_template->job_id;
+        current_template = next_template;
+        template_fetched_at = std::chrono::steady_clock::now();
+        // The node that delivered the new tip first is the one to follow
+        current_node = next_template->node;
+        active_node = current_node;
+        publish_upgrade_state(*next_template);
+        follow_longpoll(*next_template);
+        return true;
+    };
+
+    auto active_rpc = [&]() -> RPCClient& { return *node_rpcs[active_node]; };
+
+    // After the workers moved: the MSR profile follows them to their CPUs,
+    // and memory placement is reported again once they have hashed a while
+    auto after_relayout = [&]() {
+        apply_msr(config, miner, false);
+        locality_due = std::chrono::steady_clock::now() + std::chrono::seconds(stats_update_interval);
+        locality_announce = true;
+        follow_mode();
+    };
+    // Hash on count threads. Within the running workers the change is live:
+    // the rest sleep with their VMs kept. More adds workers next to the
+    // cache and dataset (see MiningBackend::set_thread_count), which needs
+    // the workers stopped first and resume_mining after. False if they
+    // couldn't be added.
+    auto set_threads = [&](unsigned int count) -> bool {
+        if (count > num_threads) {
+            if (!miner.set_thread_count(count)) {
+                return false;
+            }
+            num_threads = count;
+            after_relayout();
+        }
+        control_threads = count;
+        apply_worker_ceiling();
+        return true;
+    };
+    // Restart the workers on the template being mined, after adding
+    // workers, moving them or switching modes, rather than going round the
+    // outer loop for a fresh template
+    auto resume_mining = [&]() {
+        switch_trace.retarget(current_template);
+        miner.start_mining(current_template);
+    };
+    // The status screen's thread count: "6 of 8" while a throttle or
+    // governor holds workers back
+    auto threads_label = [&]() {
+        unsigned int active = std::min(num_threads, miner.get_worker_limit());
+        return active < num_threads ? std::to_string(active) + " of " + std::to_string(num_threads)
+                                    : std::to_string(num_threads);
+    };
+    auto prompt_line = [&]() {
+        return thread_prompt ? thread_prompt_line(thread_input, resources.cpu_cores) : std::string();
+    };
+
+    // A control API change. Threads and throttle within the running workers
+    // and a node switch are made live (worker limit, hot-swap). More
+    // workers, other CPUs or another mode stop the workers and resume them
+    // on the current template, as the T key does. False with error set at
+    // the first part that failed; changes lists what was done up to there.
+    // restart is set when the main loop has to restart mining with a fresh
+    // template: after a failure with the workers stopped, or a node switch
+    // into a new epoch.
+    auto apply_control = [&](const ControlRequest& request, std::vector<std::string>& changes, std::string& error,
+                             bool& restart) -> bool {
+        unsigned int upstream_node = active_node;
+        if (!request.upstream.empty()) {
+            if (pool) {
+                error = "pool mode has one upstream (--pool)";
+                return false;
+            }
+            bool found = false;
+            for (unsigned int node = 0; node < config.rpc_urls.size() && !found; node++) {
+                found = request.upstream == config.rpc_urls[node] || request.upstream == std::to_string(node);
+                upstream_node = node;
+            }
+            if (!found) {
+                error = "upstream " + request.upstream + " is not one of the --rpc-url nodes";
+                return false;
+            }
+        }
+
+        // First, so that the trace shows the rest of the change
+        if (request.set_trace) {
+            if (!request_trace(request.trace_seconds, error)) {
+                return false;
+            }
+            changes.push_back(request.trace_seconds ? "trace for " + std::to_string(request.trace_seconds) + " s"
+                                                    : std::string("trace the next epoch change"));
+        }
+
+        const bool move = request.set_cpus && request.cpus != control_cpus;
+        const bool stop = move || (request.set_threads && request.threads > num_threads) ||
+                          (request.set_mode && request.mode != current_mode);
+        if (stop) {
+            miner.stop();
+        }
+        if (move) {
+            if (!miner.set_cpus(request.cpus)) {
+                error = "failed to move the threads to CPUs " + format_cpu_list(request.cpus);
+                restart = true;
+                return false;
+            }
+            control_cpus = request.cpus;
+            after_relayout();
+            changes.push_back("cpus " + (control_cpus.empty() ? std::string("auto") : format_cpu_list(control_cpus)));
+        }
+        if (request.set_threads) {
+            const unsigned int workers = num_threads;
+            if (!set_threads(request.threads)) {
+                error = "failed to add workers";
+                restart = true;
+                return false;
+            }
+            if (num_threads != workers) {
+                changes.push_back("workers " + std::to_string(workers) + " -> " + std::to_string(num_threads));
+            }
+        }
+        if (request.set_throttle) {
+            control_throttle = request.throttle;
+        }
+        if (request.set_threads || request.set_throttle || move) {
+            unsigned int ceiling = apply_worker_ceiling();
+            changes.push_back("hashing on " + std::to_string(ceiling) + " of " + std::to_string(num_threads) +
+                              " threads (" + std::to_string(control_threads) + " at " +
+                              std::to_string(control_throttle) + "%)");
+        }
+        if (request.set_mode) {
+            // Also what the memory governor steps back up to
+            if (memory_governor) {
+                memory_governor->set_configured(request.mode);
+            }
+            if (request.mode != current_mode) {
+                if (!miner.set_mode(request.mode.fast, request.mode.medium_mb)) {
+                    error = std::string("failed to switch to ") + request.mode.name() + " mode";
+                    restart = true;
+                    return false;
+                }
+                current_mode = request.mode;
+                mode_name = current_mode.name();
+                follow_mode();
+            }
+            changes.push_back(std::string("mode ") + mode_name);
+        }
+        if (stop) {
+            resume_mining();
+        }
+        if (!request.upstream.empty()) {
+            // Hot-swap to the node's template, unless it is an epoch change
+            // the restart has to build
+            BlockTemplate fetched;
+            if (!node_rpcs[upstream_node]->get_block_template(fetched, "")) {
+                error = "node " + config.rpc_urls[upstream_node] + " didn't answer: " +
+                        node_rpcs[upstream_node]->get_last_error();
+                return false;
+            }
+            fetched.node = upstream_node;
+            if (!switch_template(std::make_shared<const BlockTemplate>(std::move(fetched)))) {
+                miner.stop();
+                restart = true;
+            }
+            active_node = upstream_node;
+            changes.push_back("upstream " + config.rpc_urls[upstream_node]);
+        }
+        return true;
+    };
+    size_t failed_nodes = 0;  // Nodes that failed in a row fetching a template
+
+    // Main mining loop
+    while (running.load()) {
+        // Initialize UI on first iteration
+        if (!ui_initialized && !config.headless) {
+            std::cout << "Requesting block template..." << std::endl;
+            clear_screen();
+            hide_cursor();
+            ui_initialized = true;
+        }
+
+        // Get block template (node will use wallet's default address for
+        // coinbase), or in pool mode the pool's newest job
+        BlockTemplate fetched_template;
+        BlockTemplatePtr block_template;
+        bool fetched = false;
+        if (pool) {
+            if (pool->connected()) {
+                block_template = pool->wait_for_job(std::chrono::seconds(0));
+            }
+            fetched = block_template != nullptr;
+        } else {
+            fetched = active_rpc().get_block_template(fetched_template, "");
+        }
+        if (!fetched) {
+            add_update_message(pool ? "Pool: " + pool->get_last_error() : active_rpc().get_last_error());
+
+            // Another node may be fine: try the next one at once, and only
+            // wait once every node has failed in a row
+            if (!pool) {
+                fail_over();
+                if (++failed_nodes < node_rpcs.size()) {
+                    continue;
+                }
+                failed_nodes = 0;
+            }
+
+            // Update the display to show the error
+            auto now = std::chrono::steady_clock::now();
+            auto uptime = std::chrono::duration_cast<std::chrono::seconds>(now - start_time).count();
+            NetworkStats stats = network_stats.snapshot();
+            hashrate_meter.sample(miner.get_thread_hash_counts(), now);
+            publish_metrics();
+            headless_tick(now, "DISCONNECTED");
+            if (!config.headless) {
+                print_status_screen(
+                    current_block_height,
+                    RandomX_SeedHeight(current_block_height > 0 ? current_block_height : 0),
+                    current_seed_hash,
+                    hashrate_meter.snapshot(),
+                    stats.network_hashrate,
+                    stats.difficulty,
+                    stats.mature_balance,
+                    stats.immature_balance,
+                    stats.total_balance,
+                    pool ? shares_accepted : blocks_mined,
+                    uptime,
+                    threads_label(),
+                    mode_name,
+                    config.no_balance || pool,
+                    "DISCONNECTED",
+                    pool ? "Shares Accepted" : "Blocks Mined",
+                    "",
+                    "",
+                    prompt_line()
+                );
+            }
+
+            was_disconnected = true;
+            event_loop.wait(now + std::chrono::seconds(5));
+            continue;
+        }
+
+        // Check if we just reconnected
+        if (was_disconnected) {
+            add_update_message(pool ? "Pool reconnected - resuming mining" : "RPC reconnected - resuming mining");
+            LOG_INFO(pool ? "Pool connection restored, resuming mining" : "RPC connection restored, resuming mining");
+            was_disconnected = false;
+        }
+
+        failed_nodes = 0;
+        if (!pool) {
+            fetched_template.node = active_node;
+            block_template = std::make_shared<const BlockTemplate>(std::move(fetched_template));
+        }
+        current_block_height = block_template->height;
+        current_previous_hash = block_template->previous_block_hash;
+        current_longpollid = block_template->longpollid;
+        current_job_id = block_template->job_id;
+        current_node = block_template->node;
+        current_template = block_template;
+        template_fetched_at = std::chrono::steady_clock::now();
+        prepare_next_seed(block_template->next_seed_hash);
+
+        // Check if epoch changed (seed hash changed)
+        if (block_template->seed_hash != current_seed_hash) {
+            uint64_t old_epoch = RandomX_SeedHeight(current_block_height - 1);
+            uint64_t new_epoch = RandomX_SeedHeight(current_block_height);
+
+            std::ostringstream msg;
+            msg << "EPOCH TRANSITION: " << old_epoch << " -> " << new_epoch;
+            add_update_message(msg.str());
+            add_update_message("Updating RandomX cache...");
+            LOG_INFO_STREAM("Epoch transition detected: " << old_epoch << " -> " << new_epoch);
+            LOG_DEBUG_STREAM("Old seed: " << utils::bytes_to_hex(current_seed_hash.data(), 32));
+            LOG_DEBUG_STREAM("New seed: " << utils::bytes_to_hex(block_template->seed_hash.data(), 32));
+
+            const bool epoch_trace = trace_epoch_armed;
+            if (epoch_trace) {
+                trace_epoch_armed = false;
+                start_trace(config.trace_seconds);
+            }
+            auto seed_started = std::chrono::steady_clock::now();
+            if (dataset_fetcher && miner.is_fast_mode()) {
+                dataset_fetcher->finish(block_template->seed_hash);
+            }
+            if (!miner.update_seed(block_template->seed_hash)) {
+                std::cerr << "Failed to update seed for new epoch" << std::endl;
+                add_update_message("ERROR: Failed to update seed for new epoch!");
+                LOG_ERROR("Failed to update RandomX seed for new epoch");
+                return 1;
+            }
+            count_epoch_init(seed_started);
+            follow_mode();
+            remember_seed(*block_template);
+
+            current_seed_hash = block_template->seed_hash;
+            locality_due = std::chrono::steady_clock::now() + std::chrono::seconds(stats_update_interval);
+            locality_announce = true;
+            add_update_message("Epoch transition complete!");
+            LOG_INFO("Epoch transition completed successfully");
+            if (epoch_trace) {
+                trace_until = std::chrono::steady_clock::now() + std::chrono::seconds(config.trace_seconds);
+            }
+
+            // Don't reinitialize UI - just continue with updated cache
+        }
+
+        // Start mining in background threads
+        // A WorkProxy gives each rig a nonce instance of its own
+        uint32_t assigned_instance = 0;
+        if (pool && pool->assigned_instance_id(assigned_instance) &&
+            assigned_instance != miner.get_nonce_allocator().get_instance_id()) {
+            miner.set_nonce_allocator(NonceAllocator(config.deterministic_nonce, false, assigned_instance));
+            LOG_INFO_STREAM("Nonce space: instance ID " << assigned_instance << " (assigned by the pool)");
+        }
+        switch_trace.retarget(block_template);
+        miner.start_mining(block_template);
+        publish_upgrade_state(*block_template);
+        follow_longpoll(*block_template);
+        if (taking_over) {
+            // Hashing now: let the old process go, then serve the socket ourselves
+            upgrade.complete_take_over();
+            upgrade.listen(config.upgrade_socket);
+            taking_over = false;
+            add_update_message("Took over from the previous miner process");
         }
 
-        // Start mining in background threads
-        miner.start_mining(block_template);
-
         // Progress reporting
         auto last_update = std::chrono::steady_clock::now();
         auto last_block_check = std::chrono::steady_clock::now();
-        bool block_changed = false;
-        int consecutive_rpc_failures = 0;
-        const int max_rpc_failures = 2; // Stop mining after 2 consecutive failures
+        // Outage policy: while no node answers, the last template is most
+        // likely still the tip, so keep hashing it for the grace period.
+        // Mining stops early only once a newer block is known for certain.
+        bool rpc_outage = false;
+        auto rpc_outage_start = last_block_check;
+
+        auto mining_state = [&]() {
+            return rpc_outage ? "NODE UNREACHABLE" : miner.is_warming_up() ? "WARMING UP" : "ACTIVE";
+        };
+        auto draw_status = [&](const HashrateSnapshot& hashrate, const char* state) {
+            auto uptime = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::steady_clock::now() - start_time).count();
+            NetworkStats stats = network_stats.snapshot();
+            print_status_screen(
+                current_block_height,
+                RandomX_SeedHeight(current_block_height),
+                current_seed_hash,
+                hashrate,
+                stats.network_hashrate,
+                stats.difficulty,
+                stats.mature_balance,
+                stats.immature_balance,
+                stats.total_balance,
+                pool ? shares_accepted : blocks_mined,
+                uptime,
+                threads_label(),
+                mode_name,
+                config.no_balance || pool,
+                state,
+                pool ? "Shares Accepted" : "Blocks Mined",
+                config.share_bits ? format_effective_hashrate(miner, stats.network_hashrate) : std::string(),
+                format_power(power.snapshot()),
+                prompt_line()
+            );
+        };
+
+        if (!service_ready) {
+            notifier.notify("READY=1\nSTATUS=Mining");
+            service_ready = true;
+        }
 
         while (miner.is_mining() && running.load()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            // Sleep until the next timer (status screen, tip check, huge page
+            // report) unless something wakes the loop first
+            unsigned int block_check_interval = longpolls[current_node]->active()
+                ? std::max<unsigned int>(config.block_check_interval_seconds, LONGPOLL_BACKUP_CHECK_SECONDS)
+                : config.block_check_interval_seconds;
+            auto deadline = std::min(last_update + std::chrono::seconds(1),
+                                     last_block_check + std::chrono::seconds(block_check_interval));
+            if (!huge_pages_reported) {
+                deadline = std::min(deadline, start_time + std::chrono::seconds(stats_update_interval));
+            }
+            bool input_ready = event_loop.wait(deadline);
+            if (!miner.is_mining() || !running.load()) {
+                break;
+            }
+
+            // Our block changes the tip: look for the next template right away
+            // rather than waiting for the poll interval
+            bool check_tip_now = report_submissions();
+
+            // SIGHUP: reopen the log (logrotate moved it away), then check
+            // the tip and refetch the template right now
+            bool reload = reload_requested.exchange(false);
+            if (reload) {
+                notifier.notify("RELOADING=1");
+                Logger::instance().reopen_file();
+                LOG_INFO("Reloading: log file reopened, refetching the block template");
+                check_tip_now = true;
+            }
+
+            // Jobs end with the pool session: wait for the next one
+            if (pool && !pool->connected()) {
+                add_update_message("Pool connection lost - stopping mining");
+                LOG_WARNING("Pool connection lost - stopping mining threads");
+                miner.stop();
+                break;
+            }
+
+            if (upgrade.handed_off()) {
+                add_update_message("Handed over to the new miner process");
+                LOG_INFO("Handed over to the new miner process, exiting");
+                running = false;
+                break;
+            }
+
+            // Control API changes, in the order they came
+            ControlRequest control_request;
+            bool control_restart = false;
+            while (control.take(control_request)) {
+                std::vector<std::string> changes;
+                std::string control_error;
+                bool ok = apply_control(control_request, changes, control_error, control_restart);
+                std::ostringstream summary;
+                for (const std::string& change : changes) {
+                    summary << (summary.tellp() > 0 ? ", " : "") << change;
+                }
+                if (ok) {
+                    add_update_message("Control: " + summary.str());
+                    LOG_INFO_STREAM("Control: " << summary.str());
+                } else {
+                    add_update_message("Control: " + control_error);
+                    LOG_WARNING_STREAM("Control: " << control_error
+                                       << (changes.empty() ? std::string() : " (after " + summary.str() + ")"));
+                }
+                control.answer(control_request.id, ok, control_error, changes);
+            }
+            if (trace_requested.exchange(false)) {
+                std::string trace_error;
+                if (!request_trace(config.trace_seconds, trace_error)) {
+                    add_update_message("Trace: " + trace_error);
+                    LOG_WARNING_STREAM("Trace: " << trace_error);
+                }
+            }
+            if (control_restart) {
+                ui_initialized = false;
+                // Break to get new template and restart mining
+                break;
+            }
 
             // Check for keyboard input
-            char key = check_key_pressed();
-            if (key == ' ') {
+            char key = input_ready ? check_key_pressed() : '\0';
+            if (input_ready && key == '\0') {
+                event_loop.watch_input(false);  // stdin closed, stop polling it
+            }
+            if (thread_prompt && key != '\0') {
+                // The T key's prompt takes the keys until ENTER or ESC; the
+                // workers hash on meanwhile
+                if (key >= '0' && key <= '9') {
+                    if (thread_input.size() < 4) {
+                        thread_input += key;
+                    }
+                } else if ((key == 127 || key == '\b') && !thread_input.empty()) {
+                    thread_input.pop_back();
+                } else if (key == 27) {
+                    thread_prompt = false;
+                    add_update_message("Thread count unchanged");
+                } else if (key == '\n' || key == '\r') {
+                    thread_prompt = false;
+                    int new_thread_count = thread_input.empty() ? 0 : std::atoi(thread_input.c_str());
+                    if (new_thread_count < 1) {
+                        add_update_message("Invalid thread count, unchanged");
+                    } else {
+                        LOG_DEBUG_STREAM("User requested thread count change: " << control_threads
+                                        << " -> " << new_thread_count);
+                        if ((unsigned int)new_thread_count > resources.cpu_cores) {
+                            add_update_message("Warning: more threads than the " + std::to_string(resources.cpu_cores) +
+                                               " CPU cores may reduce performance");
+                        }
+                        // Within the running workers the change is live; more
+                        // are added with the workers stopped and resumed on
+                        // the same template
+                        const bool adding = (unsigned int)new_thread_count > num_threads;
+                        if (adding) {
+                            miner.stop();
+                        }
+                        bool ok = set_threads((unsigned int)new_thread_count);
+                        if (adding) {
+                            resume_mining();
+                        }
+                        if (ok) {
+                            add_update_message("Thread count changed to " + std::to_string(new_thread_count));
+                            LOG_INFO_STREAM("Thread count changed to " << new_thread_count);
+                        } else {
+                            add_update_message("Failed to adjust thread count");
+                            LOG_ERROR("Failed to adjust thread count");
+                        }
+                    }
+                }
+                if (!miner.is_mining()) {
+                    ui_initialized = false;
+                    // Break to get new template and restart mining
+                    break;
+                }
+                draw_status(hashrate_meter.snapshot(), mining_state());
+            } else if (key == ' ') {
                 // Space key: refresh UI
                 clear_screen();
                 ui_initialized = false;
                 add_update_message("UI refreshed by user");
             } else if (key == 't' || key == 'T') {
-                // T key: adjust thread count
-                miner.stop();
-                clear_screen();
+                // T key: ask for a thread count on the status screen
+                thread_prompt = true;
+                thread_input.clear();
+                draw_status(hashrate_meter.snapshot(), mining_state());
+            }
 
-                int new_thread_count = get_thread_count_input(resources);
-                if (new_thread_count > 0) {
-                    LOG_DEBUG_STREAM("User requested thread count change: " << num_threads
-                                    << " -> " << new_thread_count);
-                    if (miner.set_thread_count(static_cast<unsigned int>(new_thread_count))) {
-                        num_threads = static_cast<unsigned int>(new_thread_count);
-                        std::ostringstream msg;
-                        msg << "Thread count changed to " << num_threads;
-                        add_update_message(msg.str());
-                        LOG_INFO_STREAM("Thread count changed to " << num_threads);
-                    } else {
-                        add_update_message("Failed to adjust thread count");
-                        LOG_ERROR("Failed to adjust thread count");
-                    }
-                }
+            auto now = std::chrono::steady_clock::now();
 
-                ui_initialized = false;
-                // Break to get new template and restart mining
-                break;
+            // A template fetched off the main loop: a new block (long poll,
+            // ZMQ or pool), or new transactions for the current one (long
+            // poll) or a new job for it (pool)
+            // A block announced before its template is in: hashes on the
+            // running job are stale from here (unless that block is already
+            // what we mine on)
+            std::string announced;
+            {
+                std::lock_guard<std::mutex> lock(announced_mutex);
+                announced.swap(announced_block);
+            }
+            if (!announced.empty() && announced != current_previous_hash) {
+                miner.mark_job_stale();
             }
 
-            auto now = std::chrono::steady_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - last_update).count();
-            auto block_check_elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - last_block_check).count();
-            auto stats_elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - last_stats_update).count();
-            auto uptime = std::chrono::duration_cast<std::chrono::seconds>(now - start_time).count();
+            BlockTemplatePtr pushed_template;
+            std::string pushed_source;
+            if (inbox.take(pushed_template, pushed_source)) {
+                uint64_t pushed_height = pushed_template->height;
+                bool new_tip = pushed_height > current_block_height ||
+                               (pushed_height == current_block_height &&
+                                pushed_template->previous_block_hash != current_previous_hash);
+                if (new_tip && pushed_source == "own block") {
+                    // Fetched by the submitter right after our block was accepted
+                    LOG_INFO_STREAM("Moving on to height " << pushed_height << " on top of our block");
+                } else if (new_tip) {
+                    std::ostringstream msg;
+                    msg << "New block on network! Height " << current_block_height
+                        << " -> " << pushed_height << " (" << pushed_source << ")";
+                    add_update_message(msg.str());
+                    LOG_INFO_STREAM("New block detected on network: height " << current_block_height
+                                   << " -> " << pushed_height << " (via " << pushed_source << ")");
+                }
+                if (new_tip) {
+                    // The template is already here, so only hashes still in
+                    // flight land on the old job
+                    miner.mark_job_stale();
+                    uint64_t stale_before = miner.get_stale_hash_count();
+                    switch_trace.begin(pushed_template);
+                    if (!switch_template(pushed_template)) {
+                        miner.stop();
+                        break;
+                    }
+                    LOG_INFO_STREAM("Switched to height " << current_block_height << " without stopping ("
+                                   << (miner.get_stale_hash_count() - stale_before)
+                                   << " hashes on the stale job, " << miner.get_stale_hash_count() << " total)");
+                    last_block_check = now;
+                } else if (pushed_height == current_block_height && current_template->spy && !pushed_template->spy) {
+                    // The full template replaces the empty block from any node
+                    if (switch_template(pushed_template)) {
+                        LOG_INFO_STREAM("Full template for height " << current_block_height << " replaced the empty block ("
+                                        << pushed_source << ")");
+                    }
+                } else if (pushed_height == current_block_height && pushed_template->node == current_node &&
+                           (pushed_template->longpollid != current_longpollid ||
+                            pushed_template->job_id != current_job_id) &&
+                           switch_template(pushed_template)) {
+                    LOG_DEBUG_STREAM("Template for the current height refreshed (" << pushed_source << ")");
+                }
+            }
 
             // Check for new blocks on the network
-            // ZMQ notification triggers immediate check, otherwise use polling interval
+            // ZMQ notification triggers immediate check, otherwise use polling
+            // interval (only a slow backstop while the long poll is open)
             bool zmq_triggered = zmq_block_notification.exchange(false);
-            bool poll_triggered = block_check_elapsed >= config.block_check_interval_seconds;
+            bool poll_triggered = check_tip_now ||
+                                  now - last_block_check >= std::chrono::seconds(block_check_interval);
 
-            if (zmq_triggered || poll_triggered) {
+            // The pool pushes a job for every new block
+            if (!pool && (zmq_triggered || poll_triggered)) {
                 if (zmq_triggered) {
                     LOG_DEBUG("Block check triggered by ZMQ notification");
                 }
+                // A timed check takes the tip the stats poller fetched (in its
+                // batch) since the last check, if there is one
+                NetworkStats polled = network_stats.snapshot();
+                bool use_polled_tip = !zmq_triggered && !check_tip_now && polled.tip_time > last_block_check;
                 Json::Value blockchain_info;
-                if (rpc.get_blockchain_info(blockchain_info)) {
-                    consecutive_rpc_failures = 0; // Reset on success
-                    uint64_t network_height = blockchain_info["blocks"].asUInt64();
+                if (use_polled_tip || active_rpc().get_blockchain_info(blockchain_info)) {
+                    auto tip_noticed = use_polled_tip ? polled.tip_time : std::chrono::steady_clock::now();
+                    if (rpc_outage) {
+                        auto outage_seconds = std::chrono::duration_cast<std::chrono::seconds>(
+                            now - rpc_outage_start).count();
+                        add_update_message("Node reachable again after " + std::to_string(outage_seconds) + "s");
+                        LOG_INFO_STREAM("Node reachable again after " << outage_seconds
+                                        << " s; kept mining height " << current_block_height << " throughout");
+                        rpc_outage = false;
+                    }
+                    // The height to mine on the node's tip ("blocks" is the
+                    // tip itself), comparable with template heights
+                    uint64_t network_height = (use_polled_tip ? polled.tip_height
+                                                              : blockchain_info["blocks"].asUInt64()) + 1;
                     if (network_height > current_block_height) {
                         std::ostringstream msg;
                         msg << "New block on network! Height " << current_block_height
@@ -791,19 +2920,52 @@ int main(int argc, char* argv[]) {
                         LOG_INFO_STREAM("New block detected on network: height " << current_block_height
                                        << " -> " << network_height << (zmq_triggered ? " (via ZMQ)" : " (via polling)"));
 
-                        block_changed = true;
-                        miner.stop();
-                        // Don't reinitialize UI - just restart with new template
-                        break;
+                        // Hot-swap: workers keep hashing the old job while the new
+                        // template is fetched, then switch without stopping
+                        miner.mark_job_stale();
+                        uint64_t stale_before = miner.get_stale_hash_count();
+                        BlockTemplate next_template;
+                        bool swapped = false;
+                        if (active_rpc().get_block_template(next_template, "")) {
+                            next_template.node = active_node;
+                            next_template.times.noticed = tip_noticed;
+                            BlockTemplatePtr next = std::make_shared<const BlockTemplate>(std::move(next_template));
+                            switch_trace.begin(next);
+                            swapped = switch_template(next);
+                        }
+                        if (swapped) {
+                            LOG_INFO_STREAM("Switched to height " << current_block_height << " without stopping ("
+                                           << (miner.get_stale_hash_count() - stale_before)
+                                           << " hashes on the stale job during the "
+                                           << active_rpc().get_call_stats("getblocktemplate").last_ms
+                                           << " ms template fetch, "
+                                           << miner.get_stale_hash_count() << " total)");
+                        }
+
+                        if (!swapped) {
+                            miner.stop();
+                            // Don't reinitialize UI - just restart with new template
+                            break;
+                        }
                     }
                 } else {
-                    // RPC failed - track consecutive failures
-                    consecutive_rpc_failures++;
-                    LOG_WARNING_STREAM("RPC check failed (" << consecutive_rpc_failures << "/" << max_rpc_failures << ")");
+                    // RPC failed: keep hashing the last template through the
+                    // grace period, trying the next node on every check
+                    if (!rpc_outage) {
+                        rpc_outage = true;
+                        rpc_outage_start = now;
+                        add_update_message("Node unreachable - mining the last template for up to " +
+                                           std::to_string(config.outage_grace_seconds) + "s");
+                    }
+                    LOG_WARNING_STREAM("RPC check failed (" << active_rpc().get_last_error() << "), "
+                                       << std::chrono::duration_cast<std::chrono::seconds>(
+                                              now - rpc_outage_start).count()
+                                       << " s into the outage");
+                    fail_over();
 
-                    if (consecutive_rpc_failures >= max_rpc_failures) {
+                    if (now - rpc_outage_start >= std::chrono::seconds(config.outage_grace_seconds)) {
                         add_update_message("RPC connection lost - stopping mining");
-                        LOG_WARNING("RPC connection lost - stopping mining threads");
+                        LOG_WARNING("RPC connection lost past the grace period - stopping mining threads");
                         miner.stop();
                         break; // Exit inner loop to try reconnecting in outer loop
                     }
@@ -811,146 +2973,159 @@ int main(int argc, char* argv[]) {
                 last_block_check = now;
             }
 
-            // Update network stats and wallet balance periodically
-            if (stats_elapsed >= stats_update_interval) {
-                // Get mining info (includes network hashrate and difficulty)
-                Json::Value mining_info;
-                if (rpc.get_mining_info(mining_info)) {
-                    if (mining_info.isMember("networksolps")) {
-                        network_hashrate = mining_info["networksolps"].asDouble();
-                    }
-                    if (mining_info.isMember("difficulty")) {
-                        difficulty = mining_info["difficulty"].asDouble();
+            // Without a long poll nothing brings new transactions for the
+            // current block: refetch its template on the slow timer and swap
+            // it in (a new tip is left to the block check). An empty block
+            // from the spy node goes on a short timer, in case the full
+            // template never came.
+            if (!pool && (reload || (config.template_refresh_seconds && !longpolls[current_node]->active() &&
+                now - template_fetched_at >= std::chrono::seconds(config.template_refresh_seconds)) ||
+                (current_template->spy && now - template_fetched_at >= std::chrono::seconds(SPY_FALLBACK_SECONDS)))) {
+                BlockTemplate refreshed;
+                if (active_rpc().get_block_template(refreshed, "")) {
+                    refreshed.node = active_node;
+                    if (refreshed.height == current_block_height &&
+                        refreshed.previous_block_hash == current_previous_hash &&
+                        switch_template(std::make_shared<const BlockTemplate>(std::move(refreshed)))) {
+                        LOG_DEBUG_STREAM("Template for height " << current_block_height << " refreshed on the timer");
                     }
                 }
+                template_fetched_at = now;
+            }
+            if (reload) {
+                notifier.notify("READY=1");
+            }
 
-                // Get wallet balance (skip if --no-balance)
-                if (!config.no_balance) {
-                    Json::Value balance_info;
-                    if (rpc.get_wallet_balance(balance_info)) {
-                        if (balance_info.isMember("transparent_mature")) {
-                            mature_balance = balance_info["transparent_mature"].asInt64() / 100000000.0;
-                        }
-                        if (balance_info.isMember("transparent_immature")) {
-                            immature_balance = balance_info["transparent_immature"].asInt64() / 100000000.0;
-                        }
-                        if (balance_info.isMember("transparent_total")) {
-                            total_balance = balance_info["transparent_total"].asInt64() / 100000000.0;
-                        }
-                    }
+            // Scratchpads on transparent huge pages are only faulted in once
+            // hashing starts, so report the final huge page coverage a while in
+            if (!huge_pages_reported && now - start_time >= std::chrono::seconds(stats_update_interval)) {
+                std::string summary = miner.huge_page_summary();
+                if (!summary.empty()) {
+                    add_update_message("Huge pages: " + summary);
+                    LOG_INFO_STREAM("Huge pages after first hashes: " << summary);
                 }
+                huge_pages_reported = true;
+            }
 
-                last_stats_update = now;
+            if (now >= locality_due) {
+                size_t remote_before = locality.remote_threads();
+                locality = miner.memory_locality();
+                if (locality_announce) {
+                    add_update_message("Memory locality: " + locality.summary());
+                    LOG_INFO_STREAM("Memory locality: " << locality.describe()
+                                    << describe_node_hashrates(hashrate_meter.snapshot(), locality));
+                    locality_announce = false;
+                } else if (locality.remote_threads() > remote_before) {
+                    add_update_message("Memory locality: " + locality.summary());
+                    LOG_WARNING_STREAM("Memory locality changed: " << locality.describe());
+                }
+                locality_due = now + std::chrono::seconds(LOCALITY_REFRESH_SECONDS);
             }
 
             // Update status screen
-            if (elapsed >= 1) {
-                double hashrate = miner.get_hashrate();
-                uint64_t hash_count = miner.get_hash_count();
-                uint64_t current_seed_height = RandomX_SeedHeight(current_block_height);
+            if (now - last_update >= std::chrono::seconds(1)) {
+                // Keep the header time current between templates
+                if (roll_ntime) {
+                    miner.roll_time(rolled_header_time(*current_template, (uint64_t)std::time(nullptr)));
+                }
 
-                print_status_screen(
-                    current_block_height,
-                    current_seed_height,
-                    current_seed_hash,
-                    hashrate,
-                    hash_count,
-                    network_hashrate,
-                    difficulty,
-                    mature_balance,
-                    immature_balance,
-                    total_balance,
-                    blocks_mined,
-                    uptime,
-                    num_threads,
-                    fast_mode,
-                    config.no_balance
-                );
+                std::vector<uint64_t> thread_counts = miner.get_thread_hash_counts();
+                hashrate_meter.sample(thread_counts, now);
+                if (telemetry_journal) {
+                    telemetry_journal->hash_counts(thread_counts);
+                    for (const CpuTemperature::Reading& reading : temperature.read()) {
+                        telemetry_journal->record(JOURNAL_TEMPERATURE, JOURNAL_NO_THREAD,
+                                                  telemetry_journal->name_id(reading.name),
+                                                  (uint64_t)(int64_t)std::llround(reading.celsius * 1000));
+                    }
+                }
+                HashrateSnapshot hashrate = hashrate_meter.snapshot();
+                publish_metrics();
+                const char* state = mining_state();
+                publish_control_status(state);
+                headless_tick(now, state);
+
+                if (!config.headless) {
+                    draw_status(hashrate, state);
+                }
+                if (config.share_bits) {
+                    check_effective_hashrate(miner, effective_hashrate_low);
+                }
+                if (!miner.is_warming_up()) {
+                    check_stalled_threads(hashrate, stalled_threads, miner.get_worker_limit());
+                }
+                if (TraceRecorder::active() && now >= trace_until) {
+                    finish_trace();
+                }
+                if (partition.update(miner.get_thread_os_ids(), miner.get_thread_cpus(),
+                                     std::min(num_threads, miner.get_worker_limit()))) {
+                    LOG_INFO_STREAM("Cache partition: " << partition.describe());
+                }
 
                 last_update = now;
+
+                MiningMode next_mode;
+                std::string mode_reason;
+                if (memory_governor && memory_governor->sample(current_mode, next_mode, mode_reason)) {
+                    std::ostringstream msg;
+                    msg << "Switching to " << next_mode.name() << " mode";
+                    if (!next_mode.fast && next_mode.medium_mb) {
+                        msg << " (" << next_mode.medium_mb << " MB)";
+                    }
+                    msg << ": " << mode_reason;
+                    add_update_message(msg.str());
+                    LOG_WARNING(msg.str());
+                    miner.stop();
+                    if (miner.set_mode(next_mode.fast, next_mode.medium_mb)) {
+                        current_mode = next_mode;
+                        mode_name = current_mode.name();
+                        follow_mode();
+                    } else {
+                        add_update_message("Failed to switch mode");
+                        LOG_ERROR("Failed to switch mining mode");
+                    }
+                    ui_initialized = false;
+                    // Break to get new template and restart mining
+                    break;
+                }
             }
         }
 
-        // If interrupted, stop mining
+        // Interrupted; anything else (a thread count change, an epoch change,
+        // a lost connection) restarts with a fresh template
         if (!running.load()) {
             miner.stop();
-        }
-
-        // If block changed, skip solution check and get new template
-        if (block_changed) {
-            continue;
-        }
-
-        // Get the result
-        std::vector<uint8_t> solution_header;
-        std::vector<uint8_t> solution_hash;
-        BlockTemplate solution_template;
-        if (miner.get_solution(solution_header, solution_hash, solution_template)) {
-            LOG_INFO_STREAM("Solution found! Height: " << solution_template.height
-                           << " PoW hash: " << utils::bytes_to_hex(solution_hash.data(), 32));
-
-            // Serialize the full block (header + nSolution + transactions)
-            std::string block_hex = utils::serialize_block(
-                solution_header,
-                solution_hash,
-                solution_template.coinbase_txn_hex,
-                solution_template.txn_hex
-            );
-            LOG_DEBUG_STREAM("Block serialized, size: " << block_hex.size() << " bytes");
-
-            add_update_message("Submitting block...");
-
-            // In Juno Cash, the block hash IS the RandomX PoW hash (stored in nSolution)
-            // See CBlockHeader::GetHash() in src/primitives/block.cpp
-            std::string block_hash_hex = utils::bytes_to_hex_reversed(solution_hash.data(), 32);
-
-            // Submit block
-            std::string result;
-
-            if (rpc.submit_block(block_hex, result)) {
-                blocks_mined++;
-                // Format success message with block details
-                std::ostringstream msg;
-                msg << "BLOCK ACCEPTED";
-                if (result != "accepted") {
-                    msg << " (" << result << ")";
-                }
-                msg << "! Height " << solution_template.height
-                    << " (Total: " << blocks_mined << ")";
-                add_update_message(msg.str());
-
-                std::ostringstream hash_msg;
-                hash_msg << "Block hash: " << block_hash_hex;
-                add_update_message(hash_msg.str());
-
-                LOG_INFO_STREAM("BLOCK ACCEPTED (" << result << ")! Height: " << solution_template.height
-                               << " Total mined: " << blocks_mined);
-                LOG_INFO_STREAM("  Block hash (RandomX): " << block_hash_hex);
-            } else {
-                // Format rejection message
-                std::ostringstream msg;
-                msg << "Block rejected: " << result;
-                add_update_message(msg.str());
-
-                std::ostringstream hash_msg;
-                hash_msg << "Block hash: " << block_hash_hex;
-                add_update_message(hash_msg.str());
-
-                LOG_WARNING_STREAM("Block rejected: " << result);
-                LOG_WARNING_STREAM("  Block hash (RandomX): " << block_hash_hex);
+            if (TraceRecorder::active()) {
+                finish_trace();  // Cut short
+            }
+            if (!config.headless) {
+                show_cursor();
+                clear_screen();
             }
-
-            // Don't reinitialize UI - just continue mining with new template
-        } else if (!running.load()) {
-            show_cursor();
-            clear_screen();
             std::cout << "Mining stopped" << std::endl;
             break;
         }
     }
 
-    show_cursor();
-    restore_terminal();
+    notifier.notify("STOPPING=1");
+    if (!config.headless) {
+        show_cursor();
+        restore_terminal();
+    }
+    for (auto& longpoll : longpolls) {
+        longpoll->stop();
+    }
+    network_stats.stop();
+    for (auto& submitter : submitters) {
+        submitter->stop();  // Submits anything still queued
+    }
+    if (pool) {
+        pool->stop();
+    }
+    report_submissions();
+    miner.set_solution_handler(nullptr);
+    miner.set_switch_trace(nullptr);
+    global_event_loop = nullptr;
 
     // Wait for ZMQ thread to finish
 #ifdef HAVE_ZMQ
@@ -958,13 +3133,44 @@ int main(int argc, char* argv[]) {
         zmq_thread.join();
     }
 #endif
+    if (replay_thread.joinable()) {
+        replay_thread.join();
+    }
 
     std::cout << std::endl;
     std::cout << "========================================" << std::endl;
     std::cout << "Mining Summary" << std::endl;
     std::cout << "========================================" << std::endl;
-    std::cout << "Blocks mined: " << blocks_mined << std::endl;
+    if (pool) {
+        std::cout << "Shares accepted: " << shares_accepted << ", rejected: " << shares_rejected << std::endl;
+    } else {
+        std::cout << "Blocks mined: " << blocks_mined << std::endl;
+    }
+    HashrateSnapshot hashrate = hashrate_meter.snapshot();
+    std::cout << "Hashes: " << hashrate.total_hashes << " (" << format_hashrate(hashrate.average()) << " on average, "
+              << format_hashrate(hashrate.rates[HASHRATE_15M]) << " over the last 15m)" << std::endl;
     std::cout << std::endl;
+    for (size_t i = 0; i < node_rpcs.size() && !pool; i++) {
+        LOG_INFO_STREAM("RPC latency (" << config.rpc_urls[i] << "):\n" << node_rpcs[i]->describe_call_stats());
+    }
+    if (switch_trace.switches()) {
+        std::ostringstream trace;
+        trace << "Block switches: " << switch_trace.switches() << ", stale hashes: "
+              << miner.get_stale_hash_count() << " of " << hashrate.total_hashes << "\n" << switch_trace.describe();
+        std::cout << trace.str() << std::endl << std::endl;
+        LOG_INFO_STREAM(trace.str());
+    }
+    if (telemetry_journal) {
+        LOG_INFO_STREAM("Journal: " << telemetry_journal->written() << " records written, "
+                        << telemetry_journal->dropped() << " dropped");
+    }
+    if (traffic_recorder) {
+        std::cout << "Recorded " << traffic_recorder->event_count() << " node events to " << config.record_file << std::endl;
+    }
+    if (traffic_replay && !pool) {
+        // The benchmark result: what switching blocks cost against this recording
+        std::cout << "RPC latency (replayed):" << std::endl << node_rpcs[0]->describe_call_stats() << std::endl;
+    }
 
     return 0;
 }
@@ -0,0 +1,115 @@
+#include "memory_governor.h"
+#include "utils.h"
+#include "randomx.h"
+#include "configuration.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+// "avg10=" of the "some" line of /proc/pressure/memory, -1 if unreadable
+double read_memory_pressure() {
+    std::ifstream file("/proc/pressure/memory");
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, 5, "some ") != 0) continue;
+        size_t avg = line.find("avg10=");
+        return avg == std::string::npos ? -1 : std::strtod(line.c_str() + avg + 6, nullptr);
+    }
+    return -1;
+}
+
+// Major page faults of this process so far (field 12 of /proc/self/stat), -1 if unreadable
+int64_t read_major_faults() {
+    std::ifstream file("/proc/self/stat");
+    std::string stat;
+    if (!std::getline(file, stat)) return -1;
+    // The command name may hold spaces; the fields after it don't
+    size_t paren = stat.rfind(')');
+    if (paren == std::string::npos) return -1;
+    std::istringstream fields(stat.substr(paren + 2));
+    std::string field;
+    // state ppid pgrp session tty_nr tpgid flags minflt cminflt majflt
+    for (int index = 3; index <= 12 && fields >> field; index++) {
+        if (index == 12) return std::strtoll(field.c_str(), nullptr, 10);
+    }
+    return -1;
+}
+
+}  // namespace
+
+size_t MiningMode::dataset_mb() const {
+    const size_t full_mb = randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE / (1024 * 1024);
+    return fast ? full_mb : std::min(medium_mb, full_mb);
+}
+
+MemoryGovernor::MemoryGovernor(const MiningMode& configured)
+    : configured_(configured), pressure_samples_(0), calm_samples_(0), settle_samples_(MEMORY_SETTLE_SAMPLES)
+    , last_faults_(-1), switches_(0) {}
+
+void MemoryGovernor::set_configured(const MiningMode& configured) {
+    configured_ = configured;
+    pressure_samples_ = 0;
+    calm_samples_ = 0;
+    settle_samples_ = MEMORY_SETTLE_SAMPLES;
+}
+
+bool MemoryGovernor::sample(const MiningMode& current, MiningMode& next, std::string& reason) {
+    auto now = std::chrono::steady_clock::now();
+    int64_t faults = read_major_faults();
+    signals_.pressure = read_memory_pressure();
+    signals_.available_mb = (double)utils::available_ram_mb();
+    double seconds = std::chrono::duration<double>(now - last_time_).count();
+    signals_.major_faults = faults >= 0 && last_faults_ >= 0 && seconds > 0 ? (faults - last_faults_) / seconds : -1;
+    last_faults_ = faults;
+    last_time_ = now;
+
+    if (settle_samples_ > 0) {
+        settle_samples_--;
+        return false;
+    }
+
+    std::ostringstream why;
+    why.precision(3);
+    if (signals_.pressure >= MEMORY_PRESSURE_LIMIT) {
+        why << "memory pressure " << signals_.pressure << "%";
+    } else if (signals_.available_mb >= 0 && signals_.available_mb < MEMORY_LOW_MB) {
+        why << (size_t)signals_.available_mb << " MB available";
+    } else if (signals_.major_faults >= MEMORY_FAULT_LIMIT) {
+        why << (uint64_t)signals_.major_faults << " major page faults/s";
+    }
+    bool pressure = !why.str().empty();
+    bool calm = signals_.pressure < MEMORY_PRESSURE_LIMIT / 4 && signals_.major_faults < MEMORY_FAULT_LIMIT / 4;
+    pressure_samples_ = pressure ? pressure_samples_ + 1 : 0;
+    calm_samples_ = calm ? calm_samples_ + 1 : 0;
+
+    next = current;
+    if (pressure_samples_ >= MEMORY_DOWNGRADE_SAMPLES && current.dataset_mb() > 0) {
+        // What stepping down frees comes back to the host, less the headroom
+        size_t available = signals_.available_mb > 0 ? (size_t)signals_.available_mb : 0;
+        size_t budget = available + current.dataset_mb();
+        budget = budget > MEMORY_HEADROOM_MB ? budget - MEMORY_HEADROOM_MB : 0;
+        size_t medium = std::min(budget, current.dataset_mb() / 2);
+        next = MiningMode(false, medium >= MEMORY_MEDIUM_MIN_MB ? medium : 0);
+        reason = why.str();
+    } else if (calm_samples_ >= MEMORY_UPGRADE_SAMPLES && current != configured_ &&
+               configured_.dataset_mb() > current.dataset_mb()) {
+        size_t need = configured_.dataset_mb() - current.dataset_mb() + MEMORY_HEADROOM_MB;
+        if (signals_.available_mb >= (double)need) {
+            next = configured_;
+            std::ostringstream room;
+            room << (size_t)signals_.available_mb << " MB available";
+            reason = room.str();
+        }
+    }
+    if (next == current) {
+        return false;
+    }
+    pressure_samples_ = 0;
+    calm_samples_ = 0;
+    settle_samples_ = MEMORY_SETTLE_SAMPLES;
+    switches_++;
+    return true;
+}
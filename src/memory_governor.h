@@ -0,0 +1,83 @@
+#ifndef MEMORY_GOVERNOR_H
+#define MEMORY_GOVERNOR_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Memory pressure: PSI memory "some" avg10 over MEMORY_PRESSURE_LIMIT
+// percent, MemAvailable (within the cgroup budget) under MEMORY_LOW_MB, or
+// the miner taking over MEMORY_FAULT_LIMIT major page faults a second (its
+// dataset being read back from swap)
+static const double MEMORY_PRESSURE_LIMIT = 10.0;
+static const size_t MEMORY_LOW_MB = 256;
+static const double MEMORY_FAULT_LIMIT = 100.0;
+// Samples (about a second each) of pressure before stepping down, and of
+// calm with room for the configured mode before stepping back up
+static const int MEMORY_DOWNGRADE_SAMPLES = 5;
+static const int MEMORY_UPGRADE_SAMPLES = 300;
+// Samples ignored after a switch, while the new mode builds and settles
+static const int MEMORY_SETTLE_SAMPLES = 30;
+// RAM left free beside a dataset the governor sizes or returns to, and the
+// smallest medium-mode dataset worth stepping down to over light mode
+static const size_t MEMORY_HEADROOM_MB = 1024;
+static const size_t MEMORY_MEDIUM_MIN_MB = 256;
+
+// A mining mode: fast, or medium with medium_mb of dataset resident (light
+// mode with 0)
+struct MiningMode {
+    bool fast;
+    size_t medium_mb;
+
+    MiningMode(bool fast_mode = false, size_t medium = 0) : fast(fast_mode), medium_mb(fast_mode ? 0 : medium) {}
+    bool operator==(const MiningMode& other) const { return fast == other.fast && medium_mb == other.medium_mb; }
+    bool operator!=(const MiningMode& other) const { return !(*this == other); }
+    // "FAST", "MEDIUM" or "LIGHT"
+    const char* name() const { return fast ? "FAST" : medium_mb ? "MEDIUM" : "LIGHT"; }
+    // Dataset MB it keeps resident
+    size_t dataset_mb() const;
+};
+
+// What the governor last read; -1 for a signal it can't read
+struct MemorySignals {
+    double pressure;            // PSI memory "some" avg10, percent
+    double available_mb;
+    double major_faults;        // Per second, this process
+
+    MemorySignals() : pressure(-1), available_mb(-1), major_faults(-1) {}
+};
+
+// Runtime mode switching under memory pressure. A dataset that gets paged
+// out hashes slower than light mode, so while memory stays short for
+// MEMORY_DOWNGRADE_SAMPLES the miner steps down: to medium mode with at
+// most half the dataset it had (and no more than free RAM allows), then to
+// light mode. Once there has been room for the configured mode, without
+// pressure, for MEMORY_UPGRADE_SAMPLES, it goes back to it. The main loop
+// polls it and does the switch (MiningBackend::set_mode).
+class MemoryGovernor {
+public:
+    explicit MemoryGovernor(const MiningMode& configured);
+
+    // Call about once a second with the mode in use. True with next and
+    // reason set when the miner should switch.
+    bool sample(const MiningMode& current, MiningMode& next, std::string& reason);
+    // The mode to step back up to from now on (one picked over the control
+    // API); starts a new settle period
+    void set_configured(const MiningMode& configured);
+
+    const MemorySignals& signals() const { return signals_; }
+    uint64_t switches() const { return switches_; }
+
+private:
+    MiningMode configured_;
+    MemorySignals signals_;
+    int pressure_samples_;
+    int calm_samples_;
+    int settle_samples_;
+    int64_t last_faults_;       // -1 before the first sample
+    std::chrono::steady_clock::time_point last_time_;
+    uint64_t switches_;
+};
+
+#endif // MEMORY_GOVERNOR_H
@@ -0,0 +1,197 @@
+#include "memory_planner.h"
+#include "utils.h"
+#include "randomx.h"
+#include "configuration.h"
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+const size_t MB = 1024 * 1024;
+
+size_t cache_bytes() {
+    return (size_t)RANDOMX_ARGON_MEMORY * 1024;
+}
+
+size_t dataset_bytes() {
+    return randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE;
+}
+
+// The seed-dependent part of an epoch: what a second one costs
+size_t epoch_set_bytes(const MemoryUsage& usage) {
+    return usage.bytes[MEMORY_CACHE] + usage.bytes[MEMORY_DATASET] + usage.bytes[MEMORY_PARTIAL] +
+           usage.bytes[MEMORY_REPLICAS];
+}
+
+}  // namespace
+
+const char* memory_component_name(MemoryComponent component) {
+    switch (component) {
+        case MEMORY_CACHE: return "cache";
+        case MEMORY_SCRATCHPADS: return "scratchpads";
+        case MEMORY_DATASET: return "dataset";
+        case MEMORY_PARTIAL: return "partial dataset";
+        case MEMORY_REPLICAS: return "replicas";
+        case MEMORY_NEXT_EPOCH: return "next epoch";
+        case MEMORY_RETAINED: return "retained epochs";
+        default: return "?";
+    }
+}
+
+size_t MemoryUsage::total() const {
+    size_t sum = 0;
+    for (size_t b : bytes) sum += b;
+    return sum;
+}
+
+std::string MemoryUsage::describe() const {
+    std::ostringstream text;
+    for (int c = 0; c < MEMORY_COMPONENTS; c++) {
+        if (bytes[c] == 0) continue;
+        text << memory_component_name((MemoryComponent)c) << " " << bytes[c] / MB << " MB, ";
+    }
+    text << "total " << total() / MB << " MB";
+    return text.str();
+}
+
+MemoryBudget resolve_memory_budget(size_t explicit_mb, const utils::SystemResources& resources) {
+    MemoryBudget budget;
+    if (explicit_mb > 0) {
+        budget.mb = explicit_mb;
+        budget.source = "--memory-budget";
+        return budget;
+    }
+    budget.mb = resources.available_ram_mb > MEMORY_BUDGET_HEADROOM_MB
+              ? resources.available_ram_mb - MEMORY_BUDGET_HEADROOM_MB : 1;
+    budget.source = resources.memory_limit_mb != utils::RESOURCE_UNLIMITED ? "cgroup memory limit" : "MemAvailable";
+    return budget;
+}
+
+void MemoryPlanner::set_budget(const MemoryBudget& budget) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = budget;
+}
+
+MemoryBudget MemoryPlanner::budget() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return budget_;
+}
+
+MemoryUsage MemoryPlanner::epoch_usage(const MemoryDemand& demand) {
+    MemoryUsage usage;
+    const unsigned int nodes = std::max(1u, demand.nodes);
+    // NUMA light and medium mode copy the shared cache to every node
+    usage.bytes[MEMORY_CACHE] = cache_bytes() * (!demand.fast && nodes > 1 ? nodes + 1 : 1);
+    usage.bytes[MEMORY_SCRATCHPADS] = (size_t)demand.threads * RANDOMX_SCRATCHPAD_L3;
+    if (demand.fast) {
+        usage.bytes[MEMORY_DATASET] = dataset_bytes();
+        usage.bytes[MEMORY_REPLICAS] = demand.replicas ? dataset_bytes() * (nodes - 1) : 0;
+    } else {
+        usage.bytes[MEMORY_PARTIAL] = std::min(demand.medium_mb * MB, dataset_bytes());
+    }
+    return usage;
+}
+
+MemoryPlan MemoryPlanner::plan(const MemoryDemand& demand) const {
+    const MemoryBudget budget = this->budget();
+    const size_t limit = budget.mb ? budget.mb * MB : SIZE_MAX;
+    MemoryPlan plan;
+    plan.fast = demand.fast;
+    plan.medium_mb = demand.fast ? 0 : demand.medium_mb;
+    plan.replicas = demand.fast && demand.replicas && demand.nodes > 1;
+    auto within = [&]() {
+        MemoryDemand planned = demand;
+        planned.fast = plan.fast;
+        planned.medium_mb = plan.medium_mb;
+        planned.replicas = plan.replicas;
+        return epoch_usage(planned);
+    };
+    auto why = [&](const std::string& what, size_t need) {
+        std::ostringstream text;
+        text << what << " (needs " << need / MB << " MB, budget " << budget.mb << " MB from " << budget.source << ")";
+        return text.str();
+    };
+    auto note = [&](const std::string& what, size_t need) { plan.changes.push_back(why(what, need)); };
+
+    // Replicas go before the dataset they copy
+    if (plan.replicas && within().total() > limit) {
+        note("one dataset for all NUMA nodes instead of replicas", within().total());
+        plan.replicas = false;
+    }
+    // Then the largest share of the dataset that fits beside the cache and
+    // scratchpads, down to light mode
+    MemoryDemand light = demand;
+    light.fast = false;
+    light.medium_mb = 0;
+    const size_t base = epoch_usage(light).total();
+    size_t room_mb = limit > base ? std::min((limit - base) / MB, dataset_bytes() / MB) : 0;
+    if (room_mb < MEMORY_PLAN_MEDIUM_MIN_MB) {
+        room_mb = 0;
+    }
+    const std::string medium = room_mb ? "medium mode with " + std::to_string(room_mb) + " MB of dataset"
+                                       : std::string("light mode");
+    if (plan.fast && within().total() > limit) {
+        plan.mode_change = why(medium + " instead of fast mode", within().total());
+        plan.fast = false;
+        plan.medium_mb = room_mb;
+    } else if (!plan.fast && plan.medium_mb > room_mb) {
+        plan.mode_change = why(medium + " instead of " + std::to_string(plan.medium_mb) + " MB", within().total());
+        plan.medium_mb = room_mb;
+    }
+
+    // The extras each hold a second epoch's cache and dataset. They take
+    // turns in the same room: the epoch a prefetched one replaces is what
+    // gets retained, and a later prefetch evicts it (see Miner::prepare_next_seed).
+    plan.expected = within();
+    const size_t need = plan.expected.total() + epoch_set_bytes(plan.expected);
+    plan.prefetch = demand.prefetch && need <= limit;
+    if (demand.prefetch && !plan.prefetch) {
+        note("no background next-epoch build", need);
+    }
+    plan.retain = demand.retain && need <= limit;
+    if (demand.retain && !plan.retain) {
+        note("no retained epochs", need);
+    }
+    return plan;
+}
+
+void MemoryPlanner::update(const MemoryUsage& usage) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    usage_ = usage;
+}
+
+MemoryUsage MemoryPlanner::usage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return usage_;
+}
+
+bool MemoryPlanner::fits(MemoryComponent component, size_t mb, size_t headroom_mb, std::string& why) const {
+    const MemoryBudget budget = this->budget();
+    const size_t used_mb = usage().total() / MB;
+    std::ostringstream text;
+    text << memory_component_name(component) << " needs " << mb << " MB";
+    if (budget.mb && used_mb + mb > budget.mb) {
+        text << ", " << used_mb << " of the " << budget.mb << " MB budget (" << budget.source << ") in use";
+        why = text.str();
+        return false;
+    }
+    if (headroom_mb) {
+        const size_t available = utils::available_ram_mb();
+        if (available < mb + headroom_mb) {
+            text << ", " << available << " MB available and " << headroom_mb << " MB kept free";
+            why = text.str();
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string MemoryPlanner::describe() const {
+    const MemoryBudget budget = this->budget();
+    std::ostringstream text;
+    if (budget.mb) {
+        text << "budget " << budget.mb << " MB (" << budget.source << "), ";
+    }
+    text << usage().describe();
+    return text.str();
+}
@@ -0,0 +1,127 @@
+#ifndef MEMORY_PLANNER_H
+#define MEMORY_PLANNER_H
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace utils {
+struct SystemResources;
+}
+
+// RAM the auto budget leaves to the rest of the process and the host beside
+// the RandomX memory
+static const size_t MEMORY_BUDGET_HEADROOM_MB = 256;
+// Smallest medium-mode dataset the planner steps down to instead of light mode
+static const size_t MEMORY_PLAN_MEDIUM_MIN_MB = 64;
+
+// Where the miner's RandomX memory goes. The planner hands the budget out in
+// this order: what mining can't do without first, then the dataset, then
+// the extras that only save time.
+enum MemoryComponent {
+    MEMORY_CACHE,           // Argon2 caches, shared and per NUMA node
+    MEMORY_SCRATCHPADS,     // VM scratchpads, idle VMs and huge-page arenas included
+    MEMORY_DATASET,         // Fast-mode dataset, private or shared between processes
+    MEMORY_PARTIAL,         // Medium-mode partial dataset
+    MEMORY_REPLICAS,        // Fast-mode dataset copies on the other NUMA nodes
+    MEMORY_NEXT_EPOCH,      // Next epoch, built in the background
+    MEMORY_RETAINED,        // Previous epochs kept for reorgs
+    MEMORY_COMPONENTS
+};
+
+// "cache", "scratchpads", "dataset", "partial dataset", "replicas",
+// "next epoch", "retained epochs"
+const char* memory_component_name(MemoryComponent component);
+
+// Bytes per component
+struct MemoryUsage {
+    size_t bytes[MEMORY_COMPONENTS];
+
+    MemoryUsage() { for (size_t& b : bytes) b = 0; }
+    size_t total() const;
+    // "dataset 2080 MB, cache 256 MB, scratchpads 8 MB, total 2344 MB"
+    std::string describe() const;
+};
+
+// The RAM the miner may take, and where that figure came from
+struct MemoryBudget {
+    size_t mb;              // 0 = none
+    std::string source;     // "--memory-budget", "cgroup memory limit", "MemAvailable"
+
+    MemoryBudget() : mb(0) {}
+};
+
+// --memory-budget if given (explicit_mb > 0), else what was available at
+// startup (MemAvailable, or the cgroup's room under its memory limit if
+// that is less; see utils::detect_system_resources) less
+// MEMORY_BUDGET_HEADROOM_MB
+MemoryBudget resolve_memory_budget(size_t explicit_mb, const utils::SystemResources& resources);
+
+// What a configuration would allocate
+struct MemoryDemand {
+    bool fast;
+    size_t medium_mb;       // Light mode with 0 (fast mode ignores it)
+    unsigned int threads;
+    unsigned int nodes;     // NUMA nodes with threads on them, for caches and replicas
+    bool replicas;          // Fast mode: a dataset per node
+    bool prefetch;          // Build the next epoch in the background
+    bool retain;            // Keep previous epochs
+
+    MemoryDemand()
+        : fast(false), medium_mb(0), threads(1), nodes(1), replicas(false), prefetch(false), retain(false) {}
+};
+
+// What the planner turned on: the demand, stepped down where the budget
+// can't hold it
+struct MemoryPlan {
+    bool fast;
+    size_t medium_mb;
+    bool replicas;
+    bool prefetch;
+    bool retain;
+    MemoryUsage expected;                   // The mining memory it leaves resident
+    std::string mode_change;                // Why the mode was stepped down, empty if it wasn't
+    std::vector<std::string> changes;       // One line for each other thing turned down or off
+
+    MemoryPlan() : fast(false), medium_mb(0), replicas(false), prefetch(false), retain(false) {}
+};
+
+// Central accounting of the RandomX memory against one budget. plan()
+// decides up front which of the memory users fit, in MemoryComponent
+// order: the caches and scratchpads, then the dataset (fast mode, or else
+// the largest medium-mode share that fits, or else light mode), NUMA
+// replicas, the next epoch's double buffer and last the retained epochs.
+// While mining, the miner reports what it actually holds (update) and asks
+// before an optional allocation (fits), which also keeps a headroom of
+// MemAvailable free, so the extras give way first when the host runs short.
+class MemoryPlanner {
+public:
+    MemoryPlanner() {}
+
+    void set_budget(const MemoryBudget& budget);
+    MemoryBudget budget() const;
+
+    MemoryPlan plan(const MemoryDemand& demand) const;
+
+    // What one epoch of demand holds, per component (no extras)
+    static MemoryUsage epoch_usage(const MemoryDemand& demand);
+
+    // Record the usage the miner holds now
+    void update(const MemoryUsage& usage);
+    MemoryUsage usage() const;
+
+    // Whether mb more for component fits beside the recorded usage and
+    // leaves headroom_mb of MemAvailable; false with why set if not
+    bool fits(MemoryComponent component, size_t mb, size_t headroom_mb, std::string& why) const;
+
+    // "budget 4096 MB (cgroup memory limit), using 2344 MB: dataset ..."
+    std::string describe() const;
+
+private:
+    mutable std::mutex mutex_;
+    MemoryBudget budget_;
+    MemoryUsage usage_;
+};
+
+#endif // MEMORY_PLANNER_H
@@ -0,0 +1,536 @@
+#include "metrics_server.h"
+#include "logger.h"
+#include "utils.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const char* const WINDOW_LABELS[HASHRATE_WINDOWS] = {"10s", "60s", "15m"};
+// Histogram bounds: every other octave of LatencyHistogram, 16 us to ~4.5 min
+static const unsigned int METRICS_FIRST_BUCKET = 4 * LATENCY_BUCKETS_PER_OCTAVE;
+static const unsigned int METRICS_BUCKET_STEP = 2 * LATENCY_BUCKETS_PER_OCTAVE;
+static const unsigned int METRICS_LAST_BUCKET = 28 * LATENCY_BUCKETS_PER_OCTAVE;
+// Hash phase histogram bounds, in timer ticks: every other power of two, 2^8 to 2^32
+static const int METRICS_FIRST_PHASE_BUCKET = 8;
+static const int METRICS_LAST_PHASE_BUCKET = 32;
+
+namespace {
+
+// Label values may hold a backslash, a quote or a newline only escaped
+std::string escape_label(const std::string& value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+// A node URL without any user:password@ in it
+std::string node_label(const std::string& url) {
+    size_t scheme = url.find("://");
+    size_t start = scheme == std::string::npos ? 0 : scheme + 3;
+    size_t at = url.find('@', start);
+    size_t slash = url.find('/', start);
+    if (at != std::string::npos && (slash == std::string::npos || at < slash)) {
+        return url.substr(0, start) + url.substr(at + 1);
+    }
+    return url;
+}
+
+class MetricsWriter {
+public:
+    MetricsWriter() { out_ << std::setprecision(12); }
+
+    void family(const char* name, const char* type, const char* help) {
+        out_ << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+    }
+    // labels is the inside of the braces, already escaped, or empty
+    void sample(const std::string& name, const std::string& labels, double value) {
+        out_ << name;
+        if (!labels.empty()) {
+            out_ << "{" << labels << "}";
+        }
+        out_ << " " << value << "\n";
+    }
+    void sample(const std::string& name, const std::string& labels, uint64_t value) {
+        out_ << name;
+        if (!labels.empty()) {
+            out_ << "{" << labels << "}";
+        }
+        out_ << " " << value << "\n";
+    }
+    std::string str() const { return out_.str(); }
+
+private:
+    std::ostringstream out_;
+};
+
+std::string thread_labels(const MinerMetrics& metrics, size_t thread) {
+    std::string labels = "thread=\"" + std::to_string(thread) + "\"";
+    if (thread < metrics.thread_nodes.size()) {
+        labels += ",numa_node=\"" + std::to_string(metrics.thread_nodes[thread]) + "\"";
+    }
+    if (thread < metrics.thread_core_types.size()) {
+        labels += std::string(",core_type=\"") + core_type_key(metrics.thread_core_types[thread]) + "\"";
+    }
+    return labels;
+}
+
+}  // namespace
+
+std::string render_metrics(const MinerMetrics& metrics) {
+    const double MB = 1024.0 * 1024.0;
+    const HashrateSnapshot& hashrate = metrics.hashrate;
+    MetricsWriter out;
+
+    out.family("juno_miner_block_height", "gauge", "Height of the block being mined");
+    out.sample("juno_miner_block_height", "", metrics.height);
+    out.family("juno_miner_threads", "gauge", "Mining threads");
+    out.sample("juno_miner_threads", "", (uint64_t)metrics.threads);
+    out.family("juno_miner_warming_up", "gauge", "1 while fast mode mines in light mode until its dataset is built");
+    out.sample("juno_miner_warming_up", "", (uint64_t)metrics.warming_up);
+
+    // Hashing
+    out.family("juno_miner_hashes_total", "counter", "Hashes computed");
+    out.sample("juno_miner_hashes_total", "", hashrate.total_hashes);
+    out.family("juno_miner_stale_hashes_total", "counter", "Hashes spent on jobs already known to be stale");
+    out.sample("juno_miner_stale_hashes_total", "", metrics.stale_hashes);
+    out.family("juno_miner_hashrate", "gauge", "Hashes per second, exponentially weighted over the window");
+    for (int window = 0; window < HASHRATE_WINDOWS; window++) {
+        out.sample("juno_miner_hashrate", std::string("window=\"") + WINDOW_LABELS[window] + "\"",
+                   hashrate.rates[window]);
+    }
+    out.family("juno_miner_thread_hashes_total", "counter",
+               "Hashes computed per thread (restarts when the thread count changes)");
+    for (size_t i = 0; i < hashrate.threads.size(); i++) {
+        out.sample("juno_miner_thread_hashes_total", thread_labels(metrics, i), hashrate.threads[i].hashes);
+    }
+    out.family("juno_miner_thread_hashrate", "gauge", "Hashes per second per thread, exponentially weighted over the window");
+    for (size_t i = 0; i < hashrate.threads.size(); i++) {
+        for (int window = 0; window < HASHRATE_WINDOWS; window++) {
+            out.sample("juno_miner_thread_hashrate",
+                       thread_labels(metrics, i) + ",window=\"" + WINDOW_LABELS[window] + "\"",
+                       hashrate.threads[i].rates[window]);
+        }
+    }
+    out.family("juno_miner_thread_stalled", "gauge", "1 while a thread hashes at under half the median rate of its peers");
+    for (size_t i = 0; i < hashrate.threads.size(); i++) {
+        out.sample("juno_miner_thread_stalled", thread_labels(metrics, i), (uint64_t)hashrate.threads[i].stalled);
+    }
+    if (!metrics.thread_nodes.empty()) {
+        std::map<int, std::array<double, HASHRATE_WINDOWS>> nodes;
+        for (size_t i = 0; i < hashrate.threads.size() && i < metrics.thread_nodes.size(); i++) {
+            std::array<double, HASHRATE_WINDOWS>& node = nodes.emplace(metrics.thread_nodes[i],
+                                                                       std::array<double, HASHRATE_WINDOWS>()).first->second;
+            for (int window = 0; window < HASHRATE_WINDOWS; window++) {
+                node[window] += hashrate.threads[i].rates[window];
+            }
+        }
+        out.family("juno_miner_numa_node_hashrate", "gauge", "Hashes per second of the threads on a NUMA node");
+        for (const auto& node : nodes) {
+            for (int window = 0; window < HASHRATE_WINDOWS; window++) {
+                out.sample("juno_miner_numa_node_hashrate",
+                           "numa_node=\"" + std::to_string(node.first) + "\",window=\"" + WINDOW_LABELS[window] + "\"",
+                           node.second[window]);
+            }
+        }
+    }
+
+    if (!metrics.thread_core_types.empty()) {
+        std::map<CoreType, std::array<double, HASHRATE_WINDOWS>> types;
+        for (size_t i = 0; i < hashrate.threads.size() && i < metrics.thread_core_types.size(); i++) {
+            std::array<double, HASHRATE_WINDOWS>& type = types.emplace(metrics.thread_core_types[i],
+                                                                       std::array<double, HASHRATE_WINDOWS>()).first->second;
+            for (int window = 0; window < HASHRATE_WINDOWS; window++) {
+                type[window] += hashrate.threads[i].rates[window];
+            }
+        }
+        out.family("juno_miner_core_type_hashrate", "gauge",
+                   "Hashes per second of the threads on a core type of a hybrid CPU");
+        for (const auto& type : types) {
+            for (int window = 0; window < HASHRATE_WINDOWS; window++) {
+                out.sample("juno_miner_core_type_hashrate",
+                           std::string("core_type=\"") + core_type_key(type.first) + "\",window=\"" +
+                               WINDOW_LABELS[window] + "\"",
+                           type.second[window]);
+            }
+        }
+    }
+
+    // Adaptive co-location
+    const ColocationSample& colocation = metrics.colocation;
+    if (colocation.enabled) {
+        out.family("juno_miner_colocation_workers", "gauge", "Workers the co-location governor lets hash");
+        out.sample("juno_miner_colocation_workers", "", (uint64_t)colocation.workers);
+        out.family("juno_miner_colocation_throttles_total", "counter", "Times the co-location governor idled workers");
+        out.sample("juno_miner_colocation_throttles_total", "", colocation.throttles);
+        out.family("juno_miner_colocation_signal", "gauge",
+                   "Signals the co-location governor watches: PSI and steal in percent, the outside load as read");
+        const std::pair<const char*, double> signals[] = {{"cpu_pressure", colocation.cpu_pressure},
+                                                          {"memory_pressure", colocation.memory_pressure},
+                                                          {"steal", colocation.steal},
+                                                          {"load", colocation.signal}};
+        for (const auto& signal : signals) {
+            if (signal.second >= 0) {
+                out.sample("juno_miner_colocation_signal", std::string("signal=\"") + signal.first + "\"",
+                           signal.second);
+            }
+        }
+    }
+
+    // Package power and what it buys, over the last POWER_REPORT_WINDOW_S
+    const PowerSample& power = metrics.power;
+    if (power.available) {
+        out.family("juno_miner_power_watts", "gauge", "CPU package power (RAPL)");
+        out.sample("juno_miner_power_watts", "", power.watts);
+        out.family("juno_miner_hashes_per_joule", "gauge", "Hashrate per watt of package power");
+        out.sample("juno_miner_hashes_per_joule", "", power.hashes_per_joule);
+        out.family("juno_miner_power_workers", "gauge", "Workers the power governor lets hash");
+        out.sample("juno_miner_power_workers", "", (uint64_t)power.workers);
+        out.family("juno_miner_power_adjustments_total", "counter", "Worker count changes the power governor made");
+        out.sample("juno_miner_power_adjustments_total", "", power.adjustments);
+    }
+
+    // Mining mode, and the memory governor's switches between them
+    if (!metrics.mode.empty()) {
+        out.family("juno_miner_mode", "gauge", "Mining mode in use (1 for the current mode)");
+        out.sample("juno_miner_mode", "mode=\"" + metrics.mode + "\"", (uint64_t)1);
+        out.family("juno_miner_mode_switches_total", "counter", "Mode switches made under memory pressure");
+        out.sample("juno_miner_mode_switches_total", "", metrics.mode_switches);
+    }
+
+    // Where the memory is against the workers' CPUs
+    const MemoryLocality& locality = metrics.locality;
+    if (locality.supported) {
+        out.family("juno_miner_memory_pages", "gauge",
+                   "Sampled pages of each memory region per NUMA node it is on (node \"none\": not faulted in)");
+        for (const MemoryRegionLocality& region : locality.regions) {
+            std::string owner = region.thread >= 0 ? "thread" + std::to_string(region.thread)
+                              : region.intended_node >= 0 ? "node" + std::to_string(region.intended_node)
+                              : "shared";
+            std::string labels = "region=\"" + region.region + "\",owner=\"" + owner + "\",node=\"";
+            const PagePlacement& placement = region.placement;
+            for (size_t node = 0; node < placement.node_pages.size(); node++) {
+                if (placement.node_pages[node] > 0) {
+                    out.sample("juno_miner_memory_pages", labels + std::to_string(node) + "\"",
+                               (uint64_t)placement.node_pages[node]);
+                }
+            }
+            if (placement.unplaced > 0) {
+                out.sample("juno_miner_memory_pages", labels + "none\"", (uint64_t)placement.unplaced);
+            }
+        }
+        out.family("juno_miner_thread_cpu_node", "gauge", "NUMA node of the CPU a thread last started a job on");
+        for (size_t i = 0; i < locality.threads.size(); i++) {
+            if (locality.threads[i].cpu_node >= 0) {
+                out.sample("juno_miner_thread_cpu_node", thread_labels(metrics, i),
+                           (uint64_t)locality.threads[i].cpu_node);
+            }
+        }
+        out.family("juno_miner_thread_memory_local_ratio", "gauge",
+                   "Share of a thread's scratchpad, JIT buffer or dataset/cache pages on its CPU's NUMA node");
+        for (size_t i = 0; i < locality.threads.size(); i++) {
+            const ThreadLocality& thread = locality.threads[i];
+            const std::pair<const char*, double> shares[] = {
+                {"scratchpad", thread.scratchpad_share}, {"jit", thread.jit_share}, {"data", thread.data_share}
+            };
+            for (const auto& share : shares) {
+                if (share.second >= 0) {
+                    out.sample("juno_miner_thread_memory_local_ratio",
+                               thread_labels(metrics, i) + ",region=\"" + share.first + "\"", share.second);
+                }
+            }
+        }
+        out.family("juno_miner_remote_memory_threads", "gauge",
+                   "Threads whose scratchpad or dataset/cache is mostly on another NUMA node than their CPU");
+        out.sample("juno_miner_remote_memory_threads", "", (uint64_t)locality.remote_threads());
+    }
+
+    // Hash phases (a JUNO_PHASE_PROFILE build)
+    if (!metrics.thread_phases.empty()) {
+        out.family("juno_miner_hash_phase_ticks", "histogram",
+                   "Time each phase of a worker's RandomX hashes took, in TSC (x86) or generic timer (ARM64) ticks");
+        for (size_t i = 0; i < metrics.thread_phases.size(); i++) {
+            for (int phase = 0; phase < RANDOMX_PHASE_COUNT; phase++) {
+                const randomx_phase_stats& stats = metrics.thread_phases[i].phases[phase];
+                std::string labels = thread_labels(metrics, i) + ",phase=\"" + HASH_PHASE_NAMES[phase] + "\"";
+                // Bucket b holds [2^b, 2^(b+1)): everything below 2^limit is in the buckets before limit
+                uint64_t below = 0;
+                int bucket = 0;
+                for (int limit = METRICS_FIRST_PHASE_BUCKET; limit <= METRICS_LAST_PHASE_BUCKET; limit += 2) {
+                    for (; bucket < limit && bucket < RANDOMX_PHASE_BUCKETS; bucket++) {
+                        below += stats.buckets[bucket];
+                    }
+                    out.sample("juno_miner_hash_phase_ticks_bucket",
+                               labels + ",le=\"" + std::to_string(1ULL << limit) + "\"", below);
+                }
+                out.sample("juno_miner_hash_phase_ticks_bucket", labels + ",le=\"+Inf\"", stats.count);
+                out.sample("juno_miner_hash_phase_ticks_sum", labels, stats.ticks);
+                out.sample("juno_miner_hash_phase_ticks_count", labels, stats.count);
+            }
+        }
+    }
+
+    // Block switches (see SwitchTrace)
+    out.family("juno_miner_block_switches_total", "counter", "Switches to a new tip");
+    out.sample("juno_miner_block_switches_total", "", metrics.block_switches);
+    out.family("juno_miner_block_switch_seconds", "histogram",
+               "Block switch latency per leg, from hearing of a block to each worker's first hash on it");
+    for (int stage = 0; stage < SWITCH_STAGES; stage++) {
+        const LatencyHistogram& histogram = metrics.switch_latency[stage];
+        std::string labels = std::string("stage=\"") + SWITCH_STAGE_LABELS[stage] + "\"";
+        for (unsigned int bucket = METRICS_FIRST_BUCKET; bucket <= METRICS_LAST_BUCKET; bucket += METRICS_BUCKET_STEP) {
+            std::ostringstream le;
+            le << LatencyHistogram::bucket_floor_ms(bucket) / 1000.0;
+            out.sample("juno_miner_block_switch_seconds_bucket", labels + ",le=\"" + le.str() + "\"",
+                       histogram.count_below(bucket));
+        }
+        out.sample("juno_miner_block_switch_seconds_bucket", labels + ",le=\"+Inf\"", histogram.count());
+        out.sample("juno_miner_block_switch_seconds_sum", labels, histogram.sum_ms() / 1000.0);
+        out.sample("juno_miner_block_switch_seconds_count", labels, histogram.count());
+    }
+
+    // RPC
+    out.family("juno_miner_rpc_calls_total", "counter", "RPC calls per node and method");
+    out.family("juno_miner_rpc_errors_total", "counter", "RPC calls that failed in transport or returned an error");
+    out.family("juno_miner_rpc_connects_total", "counter", "RPC calls that had to open a new connection");
+    out.family("juno_miner_rpc_seconds_total", "counter", "Time spent in RPC calls");
+    out.family("juno_miner_rpc_last_seconds", "gauge", "Duration of the last RPC call");
+    out.family("juno_miner_rpc_max_seconds", "gauge", "Duration of the slowest RPC call");
+    for (const auto& node : metrics.rpc) {
+        for (const auto& method : node.second) {
+            const RPCCallStats& stats = method.second;
+            std::string labels = "node=\"" + escape_label(node_label(node.first)) + "\",method=\"" +
+                                 escape_label(method.first) + "\"";
+            out.sample("juno_miner_rpc_calls_total", labels, stats.calls);
+            out.sample("juno_miner_rpc_errors_total", labels, stats.failures);
+            out.sample("juno_miner_rpc_connects_total", labels, stats.new_connections);
+            out.sample("juno_miner_rpc_seconds_total", labels, stats.total_ms / 1000.0);
+            out.sample("juno_miner_rpc_last_seconds", labels, stats.last_ms / 1000.0);
+            out.sample("juno_miner_rpc_max_seconds", labels, stats.max_ms / 1000.0);
+        }
+    }
+
+    // Epochs
+    out.family("juno_miner_epoch_inits_total", "counter", "RandomX epoch initializations (startup and every seed change)");
+    out.sample("juno_miner_epoch_inits_total", "", metrics.epoch_inits);
+    out.family("juno_miner_epoch_init_seconds_total", "counter", "Time spent initializing epochs");
+    out.sample("juno_miner_epoch_init_seconds_total", "", metrics.epoch_init_seconds);
+    out.family("juno_miner_epoch_init_last_seconds", "gauge", "Duration of the last epoch initialization");
+    out.sample("juno_miner_epoch_init_last_seconds", "", metrics.last_epoch_init_seconds);
+    const InitTiming& init = metrics.init_timing;
+    if (!init.trigger.empty()) {
+        out.family("juno_miner_epoch_init_phase_seconds", "gauge",
+                   "Time of each step of the last epoch initialization, including any done in the background");
+        for (int phase = 0; phase < INIT_PHASES; phase++) {
+            out.sample("juno_miner_epoch_init_phase_seconds", std::string("phase=\"") + INIT_PHASE_NAMES[phase] + "\"",
+                       init.seconds[phase]);
+        }
+        if (init.dataset_workers > 0) {
+            out.family("juno_miner_epoch_init_dataset_workers", "gauge", "Threads of the last dataset build");
+            out.sample("juno_miner_epoch_init_dataset_workers", "", (uint64_t)init.dataset_workers);
+            out.family("juno_miner_epoch_init_worker_items_per_second", "gauge",
+                       "Dataset items per second of the slowest, median and fastest worker of the last build");
+            const std::pair<const char*, double> stats[] = {{"min", 0}, {"median", 0.5}, {"max", 1}};
+            for (const auto& stat : stats) {
+                out.sample("juno_miner_epoch_init_worker_items_per_second",
+                           std::string("stat=\"") + stat.first + "\"", init.worker_rate(stat.second));
+            }
+        }
+    }
+
+    // Memory
+    out.family("juno_miner_resident_bytes", "gauge", "Resident memory of the process");
+    out.sample("juno_miner_resident_bytes", "", metrics.resident_mb * MB);
+    out.family("juno_miner_resident_peak_bytes", "gauge", "Peak resident memory of the process");
+    out.sample("juno_miner_resident_peak_bytes", "", metrics.peak_mb * MB);
+    out.family("juno_miner_huge_page_bytes", "gauge", "Memory on huge pages, reserved (hugetlbfs) or transparent");
+    out.sample("juno_miner_huge_page_bytes", "kind=\"hugetlb\"", metrics.hugetlb_mb * MB);
+    out.sample("juno_miner_huge_page_bytes", "kind=\"transparent\"", metrics.transparent_huge_mb * MB);
+    if (metrics.memory.total() > 0) {
+        out.family("juno_miner_randomx_memory_bytes", "gauge", "RandomX memory held, by component");
+        for (int c = 0; c < MEMORY_COMPONENTS; c++) {
+            out.sample("juno_miner_randomx_memory_bytes",
+                       std::string("component=\"") + memory_component_name((MemoryComponent)c) + "\"",
+                       (uint64_t)metrics.memory.bytes[c]);
+        }
+    }
+    if (metrics.memory_budget.mb > 0) {
+        out.family("juno_miner_memory_budget_bytes", "gauge", "RAM the RandomX memory is planned within");
+        out.sample("juno_miner_memory_budget_bytes", "source=\"" + metrics.memory_budget.source + "\"",
+                   metrics.memory_budget.mb * MB);
+    }
+
+    // Solutions
+    out.family("juno_miner_blocks_submitted_total", "counter", "Blocks found and submitted (shares in pool mode)");
+    out.sample("juno_miner_blocks_submitted_total", "", metrics.blocks_submitted);
+    out.family("juno_miner_blocks_accepted_total", "counter", "Blocks accepted by a node (shares by the pool)");
+    out.sample("juno_miner_blocks_accepted_total", "", metrics.blocks_accepted);
+    out.family("juno_miner_blocks_rejected_total", "counter", "Blocks every node rejected (shares the pool rejected)");
+    out.sample("juno_miner_blocks_rejected_total", "", metrics.blocks_rejected);
+
+    out.family("juno_miner_log_dropped_total", "counter", "Log lines dropped because the log writer fell behind");
+    out.sample("juno_miner_log_dropped_total", "", metrics.log_dropped);
+    return out.str();
+}
+
+MetricsServer::MetricsServer() : listen_fd_(-1), stop_(false) {}
+
+MetricsServer::~MetricsServer() {
+    stop();
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+    }
+}
+
+bool MetricsServer::listen(const std::string& address, std::string& error) {
+    listen_fd_ = utils::listen_tcp(address, error);
+    return listen_fd_ >= 0;
+}
+
+void MetricsServer::start() {
+    if (!thread_.joinable() && listen_fd_ >= 0) {
+        thread_ = std::thread(&MetricsServer::run, this);
+    }
+}
+
+void MetricsServer::stop() {
+    stop_ = true;
+    events_.wake();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void MetricsServer::publish(std::string page) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    page_.swap(page);
+}
+
+void MetricsServer::run() {
+    while (!stop_.load()) {
+        std::vector<int> fds(1, listen_fd_);
+        for (const Connection& connection : connections_) {
+            fds.push_back(connection.fd);
+        }
+        events_.watch_fds(fds);
+        events_.wait(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+
+        accept_connections();
+        auto now = std::chrono::steady_clock::now();
+        for (Connection& connection : connections_) {
+            if (!read_request(connection) ||
+                now - connection.opened >= std::chrono::seconds(METRICS_REQUEST_TIMEOUT_SECONDS)) {
+                close(connection.fd);
+                connection.fd = -1;
+            }
+        }
+        connections_.erase(std::remove_if(connections_.begin(), connections_.end(),
+                                          [](const Connection& connection) { return connection.fd < 0; }),
+                           connections_.end());
+    }
+    for (const Connection& connection : connections_) {
+        close(connection.fd);
+    }
+    connections_.clear();
+}
+
+void MetricsServer::accept_connections() {
+    for (;;) {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            return;  // EAGAIN: nobody else waiting
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        timeval timeout;
+        timeout.tv_sec = METRICS_REQUEST_TIMEOUT_SECONDS;
+        timeout.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        Connection connection;
+        connection.fd = fd;
+        connection.opened = std::chrono::steady_clock::now();
+        connections_.push_back(std::move(connection));
+    }
+}
+
+bool MetricsServer::read_request(Connection& connection) {
+    char buffer[2048];
+    for (;;) {
+        ssize_t n = recv(connection.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        connection.request.append(buffer, n);
+        if (connection.request.size() > METRICS_MAX_REQUEST) {
+            return false;
+        }
+    }
+    // Only the request line matters; answer once the headers are complete
+    if (connection.request.find("\r\n\r\n") == std::string::npos &&
+        connection.request.find("\n\n") == std::string::npos) {
+        return true;
+    }
+    respond(connection);
+    return false;
+}
+
+void MetricsServer::respond(Connection& connection) {
+    std::istringstream request_line(connection.request.substr(0, connection.request.find('\n')));
+    std::string method;
+    std::string target;
+    request_line >> method >> target;
+    std::string path = target.substr(0, target.find('?'));
+
+    std::string status = "200 OK";
+    std::string body;
+    if (method != "GET" && method != "HEAD") {
+        status = "405 Method Not Allowed";
+        body = "Only GET is served\n";
+    } else if (path != "/metrics") {
+        status = "404 Not Found";
+        body = "Metrics are at /metrics\n";
+    } else {
+        std::lock_guard<std::mutex> lock(mutex_);
+        body = page_;
+    }
+
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\n"
+             << "Content-Type: " << (status[0] == '2' ? "text/plain; version=0.0.4; charset=utf-8" : "text/plain")
+             << "\r\nContent-Length: " << body.size() << "\r\nConnection: close\r\n\r\n";
+    if (method != "HEAD") {
+        response << body;
+    }
+    std::string data = response.str();
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(connection.fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            LOG_DEBUG_STREAM("Metrics: scrape dropped: " << std::strerror(errno));
+            return;
+        }
+        sent += n;
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "event_loop.h"
+#include "hashrate_meter.h"
+#include "colocation_governor.h"
+#include "mining_backend.h"
+#include "power_governor.h"
+#include "rpc_client.h"
+#include "switch_trace.h"
+
+// Connections that haven't sent a whole request by then are dropped
+static const int METRICS_REQUEST_TIMEOUT_SECONDS = 5;
+static const size_t METRICS_MAX_REQUEST = 8192;
+
+// Everything /metrics reports, gathered by the main loop
+struct MinerMetrics {
+    uint64_t height;
+    unsigned int threads;
+    bool warming_up;
+    std::string mode;                   // "FAST", "MEDIUM" or "LIGHT"
+    uint64_t mode_switches;             // Made by the memory governor
+
+    HashrateSnapshot hashrate;
+    std::vector<int> thread_nodes;      // NUMA node per thread, empty if unknown
+    std::vector<CoreType> thread_core_types;  // Core type per thread, empty unless the CPU is hybrid
+    uint64_t stale_hashes;
+    std::vector<HashPhaseProfile> thread_phases;  // JUNO_PHASE_PROFILE builds only
+    MemoryLocality locality;            // Last page placement report, unsupported until the first
+    ColocationSample colocation;        // Adaptive co-location, disabled unless --adaptive
+    PowerSample power;                  // Package power, unavailable without RAPL
+
+    uint64_t block_switches;
+    LatencyHistogram switch_latency[SWITCH_STAGES];
+
+    // Per node URL, per method
+    std::vector<std::pair<std::string, std::map<std::string, RPCCallStats>>> rpc;
+
+    uint64_t epoch_inits;               // initialize and every epoch change since
+    double epoch_init_seconds;          // Their total time
+    double last_epoch_init_seconds;
+    InitTiming init_timing;             // Phases of the last of them
+
+    size_t resident_mb;
+    size_t peak_mb;
+    size_t hugetlb_mb;
+    size_t transparent_huge_mb;
+    MemoryUsage memory;                 // RandomX memory by component (see MemoryPlanner)
+    MemoryBudget memory_budget;
+
+    // Pool shares in pool mode
+    uint64_t blocks_submitted;
+    uint64_t blocks_accepted;
+    uint64_t blocks_rejected;
+
+    uint64_t log_dropped;               // Lines the logger had to drop
+
+    MinerMetrics()
+        : height(0), threads(0), warming_up(false), mode_switches(0), stale_hashes(0), block_switches(0), epoch_inits(0)
+        , epoch_init_seconds(0), last_epoch_init_seconds(0), resident_mb(0), peak_mb(0), hugetlb_mb(0)
+        , transparent_huge_mb(0), blocks_submitted(0), blocks_accepted(0), blocks_rejected(0)
+        , log_dropped(0) {}
+};
+
+// The Prometheus text exposition format (version 0.0.4) of metrics
+std::string render_metrics(const MinerMetrics& metrics);
+
+// Serves /metrics over plain HTTP (--metrics) from its own thread. The main
+// loop renders the page with each status update and hands it over with
+// publish; a scrape only copies the last page under the server's own lock,
+// so it never touches the workers, the backend or an RPC connection.
+class MetricsServer {
+public:
+    MetricsServer();
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    // Listen on host:port (host may be empty or 0.0.0.0 for every interface).
+    // False with error set if the socket can't be bound.
+    bool listen(const std::string& address, std::string& error);
+    void start();
+    void stop();
+    bool running() const { return thread_.joinable(); }
+
+    // The page served from now on
+    void publish(std::string page);
+
+private:
+    struct Connection {
+        int fd;
+        std::string request;
+        std::chrono::steady_clock::time_point opened;
+    };
+
+    int listen_fd_;
+    EventLoop events_;
+    std::thread thread_;
+    std::atomic<bool> stop_;
+
+    std::mutex mutex_;
+    std::string page_;  // Guarded by mutex_
+
+    // Server thread only
+    std::vector<Connection> connections_;
+
+    void run();
+    void accept_connections();
+    // False once the connection is done with (answered, closed or broken)
+    bool read_request(Connection& connection);
+    void respond(Connection& connection);
+};
+
+#endif // METRICS_SERVER_H
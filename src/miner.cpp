@@ -2,30 +2,89 @@
 #include "rpc_client.h"
 #include "utils.h"
 #include "logger.h"
+#include "configuration.h"
+#include "dataset_init.h"
+#include "switch_trace.h"
+#include "trace_recorder.h"
 #include <iostream>
 #include <iomanip>
 #include <cstring>
 #include <algorithm>
-#include <fstream>
+#include <cmath>
 #include <sstream>
+#include <string_view>
+#include <climits>
+#include <cerrno>
 
-#ifdef HAVE_NUMA
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(HAVE_NUMA) && !defined(_WIN32)
 #include <numa.h>
 #include <numaif.h>
 #include <sched.h>
 #endif
 
-Miner::Miner(unsigned int num_threads, bool fast_mode)
+Miner::Miner(unsigned int num_threads, bool fast_mode, bool pipelined)
     : num_threads_(num_threads)
     , fast_mode_(fast_mode)
+    , pipelined_(pipelined)
+    , huge_pages_(false)
+    , huge_pages_1gb_(false)
+    , secure_jit_(false)
     , dataset_(nullptr)
+    , partial_dataset_(nullptr)
+    , partial_items_(0)
     , numa_available_(false)
+    , numa_replicas_(true)
+    , affinity_(true)
+    , sched_idle_(false)
     , num_numa_nodes_(0)
     , legacy_cache_(nullptr)
     , mining_(false)
     , found_(false)
-    , hash_count_(0) {
+    , num_hash_counters_(0)
+    , earlier_stale_(0)
+    , solution_generation_(0)
+    , handled_generation_(0)
+    , every_solution_(false)
+    , share_bits_(0)
+    , share_limbs_()
+    , switch_trace_(nullptr)
+    , job_generation_(0)
+    , stale_generation_(0)
+    , pool_shutdown_(false)
+    , active_workers_(0)
+    , worker_limit_(UINT_MAX)
+    , epoch_prefetch_(true)
+    , epoch_memory_mb_(0)
+    , building_bytes_(0)
+    , prepare_abort_(false)
+    , init_abort_(false)
+    , epoch_retain_mb_(EPOCH_RETAIN_AUTO)
+    , publish_next_epoch_(false)
+    , low_memory_(false)
+    , lock_dataset_(false)
+    , gpu_device_(-1)
+    , light_start_(true)
+    , warming_up_(false)
+    , vm_generation_(0)
+    , warmup_abort_(false)
+    , first_hash_pending_(false) {
+    topology_ = CpuTopology::detect();
+    LOG_DEBUG_STREAM("CPU topology:\n" << topology_.describe());
     detect_numa_topology();
+    assign_threads_to_cpus();
+    reset_hash_counters();
 }
 
 void Miner::detect_numa_topology() {
@@ -65,48 +124,79 @@ void Miner::detect_numa_topology() {
         numa_free_cpumask(cpumask);
         std::cout << "  Node " << node << ": " << numa_nodes_[node].cpu_ids.size() << " CPUs" << std::endl;
     }
+#else
+    numa_available_ = false;
+    num_numa_nodes_ = 1;
+    std::cout << "NUMA support not compiled in, using single-node mode" << std::endl;
+#endif
+}
 
-    // Distribute threads across NUMA nodes and assign to specific CPUs
+void Miner::assign_threads_to_cpus() {
+    // Spread threads over L3 domains (and with them NUMA nodes), physical
+    // cores before SMT siblings, unless the user gave an explicit CPU list.
+    // The housekeeping CPUs are left to the threads that don't hash.
+    std::vector<int> placement = topology_.place_threads(num_threads_, cpu_override_, housekeeping_cpus());
     thread_to_cpu_.resize(num_threads_);
     thread_to_node_.resize(num_threads_);
 
-    // Round-robin distribution across nodes, then within each node
-    std::vector<size_t> node_thread_count(num_numa_nodes_, 0);
     for (unsigned int t = 0; t < num_threads_; t++) {
-        int node = t % num_numa_nodes_;
-        size_t cpu_index = node_thread_count[node] % numa_nodes_[node].cpu_ids.size();
+        int cpu = t < placement.size() ? placement[t] : (int)t;
+        const CpuInfo* info = topology_.find_cpu(cpu);
+        int node = info ? info->node : 0;
+        if (node < 0 || node >= num_numa_nodes_) {
+            node = 0;
+        }
+        thread_to_cpu_[t] = cpu;
         thread_to_node_[t] = node;
-        thread_to_cpu_[t] = numa_nodes_[node].cpu_ids[cpu_index];
-        node_thread_count[node]++;
     }
 
-    LOG_DEBUG_STREAM("NUMA: Distributed " << num_threads_ << " threads across " << num_numa_nodes_ << " nodes");
-#else
-    numa_available_ = false;
-    num_numa_nodes_ = 1;
-    std::cout << "NUMA support not compiled in, using single-node mode" << std::endl;
-#endif
+    LOG_DEBUG_STREAM("Placed " << num_threads_ << " threads across " << topology_.l3_domains().size()
+                     << " L3 domains and " << num_numa_nodes_ << " NUMA nodes");
+}
+
+void Miner::set_cpu_list(const std::vector<int>& cpus) {
+    cpu_override_ = cpus;
+    assign_threads_to_cpus();
 }
 
 bool Miner::set_thread_affinity(int cpu_id) {
-#ifdef HAVE_NUMA
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(cpu_id, &cpuset);
-    int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
-    if (rc != 0) {
-        LOG_ERROR_STREAM("Failed to set thread affinity to CPU " << cpu_id << ": " << strerror(rc));
+    if (!pin_current_thread(cpu_id)) {
+        LOG_ERROR_STREAM("Failed to set thread affinity to CPU " << cpu_id);
         return false;
     }
     return true;
+}
+
+randomx_vm* Miner::get_vm_for_thread(int thread_id) {
+    randomx_vm** slot = vm_slot(thread_id);
+    return slot ? *slot : nullptr;
+}
+
+void Miner::prefer_thread_node(int thread_id) {
+    // Huge-page scratchpads (populated by mmap) and the JIT code are faulted in
+    // while a VM is created, so create each VM with its worker's node preferred.
+    // -1 restores the default policy.
+#ifdef HAVE_NUMA
+    if (numa_available_) {
+        numa_set_preferred(thread_id >= 0 && thread_id < (int)thread_to_node_.size() ? thread_to_node_[thread_id] : -1);
+    }
 #else
-    (void)cpu_id;
-    return false;
+    (void)thread_id;
 #endif
 }
 
-randomx_vm* Miner::get_vm_for_thread(int thread_id) {
-    if (numa_available_ && thread_id < (int)thread_to_node_.size()) {
+bool Miner::numa_layout() const {
+    // Where initialize put the VMs: per NUMA node (light mode, or fast mode
+    // with replicas) or in legacy_vms_
+    return numa_available_ && (!fast_mode_ || numa_replicas_);
+}
+
+template<bool Numa>
+randomx_vm** Miner::vm_slot(int thread_id) {
+    if (Numa) {
+        if (thread_id >= (int)thread_to_node_.size()) {
+            return nullptr;
+        }
         int node = thread_to_node_[thread_id];
         // Find this thread's VM index within its node
         int vm_index = 0;
@@ -116,24 +206,590 @@ randomx_vm* Miner::get_vm_for_thread(int thread_id) {
             }
         }
         if (node < (int)numa_nodes_.size() && vm_index < (int)numa_nodes_[node].vms.size()) {
-            return numa_nodes_[node].vms[vm_index];
+            return &numa_nodes_[node].vms[vm_index];
         }
+        return nullptr;
     }
-    // Fallback to legacy
     if (thread_id < (int)legacy_vms_.size()) {
-        return legacy_vms_[thread_id];
+        return &legacy_vms_[thread_id];
     }
     return nullptr;
 }
 
+randomx_vm** Miner::vm_slot(int thread_id) {
+    return numa_layout() ? vm_slot<true>(thread_id) : vm_slot<false>(thread_id);
+}
+
+// The initialize, update_seed or background epoch build being timed on this
+// thread; phases outside one aren't recorded
+static thread_local InitTiming* current_init_timing = nullptr;
+
+// As last set through set_scratchpad_coloring (RandomX defaults to on)
+static bool scratchpad_coloring = true;
+
+struct InitTimingScope {
+    InitTiming* previous;
+
+    explicit InitTimingScope(InitTiming* timing) : previous(current_init_timing) { current_init_timing = timing; }
+    ~InitTimingScope() { current_init_timing = previous; }
+};
+
+// Adds the time until it goes out of scope to a phase of the current init
+class InitPhaseTimer {
+public:
+    explicit InitPhaseTimer(InitPhase phase) : phase_(phase), start_(std::chrono::steady_clock::now()) {}
+    ~InitPhaseTimer() {
+        auto end = std::chrono::steady_clock::now();
+        if (current_init_timing) {
+            current_init_timing->seconds[phase_] += std::chrono::duration<double>(end - start_).count();
+        }
+        TraceRecorder::instance().complete("init", INIT_PHASE_NAMES[phase_], start_, end);
+    }
+
+private:
+    InitPhase phase_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Fold a dataset build's workers into the current init
+static void add_dataset_workers(const std::vector<DatasetInitWorker>& workers) {
+    InitTiming* timing = current_init_timing;
+    if (!timing) {
+        return;
+    }
+    for (const DatasetInitWorker& worker : workers) {
+        timing->dataset_workers++;
+        timing->dataset_items += worker.items;
+        if (worker.seconds > 0) {
+            timing->worker_items_per_second.push_back(worker.items / worker.seconds);
+        }
+    }
+    std::sort(timing->worker_items_per_second.begin(), timing->worker_items_per_second.end());
+}
+
+// Add work done off the critical path (a prepared epoch, the warm-up's dataset) to an init
+static void add_background_timing(InitTiming& into, const InitTiming& from) {
+    for (int phase = 0; phase < INIT_PHASES; phase++) {
+        into.seconds[phase] += from.seconds[phase];
+    }
+    into.background = true;
+    into.dataset_workers += from.dataset_workers;
+    into.dataset_items += from.dataset_items;
+    into.worker_items_per_second.insert(into.worker_items_per_second.end(), from.worker_items_per_second.begin(),
+                                        from.worker_items_per_second.end());
+    std::sort(into.worker_items_per_second.begin(), into.worker_items_per_second.end());
+}
+
+randomx_cache* Miner::alloc_cache(randomx_flags flags) {
+    InitPhaseTimer timer(INIT_CACHE_ALLOC);
+    if (huge_pages_) {
+        randomx_cache* cache = randomx_alloc_cache(flags | RANDOMX_FLAG_LARGE_PAGES);
+        if (cache) {
+            return cache;
+        }
+        LOG_WARNING("Huge page allocation failed for RandomX cache, using normal pages");
+    }
+    return randomx_alloc_cache(flags);
+}
+
+randomx_dataset* Miner::alloc_dataset(randomx_flags flags, int numa_node, unsigned long item_count) {
+    // item_count 0 = the whole dataset, otherwise a medium-mode partial dataset
+    InitPhaseTimer timer(INIT_DATASET_ALLOC);
+    if (item_count == 0) {
+        item_count = randomx_dataset_item_count();
+    }
+    randomx_dataset* dataset = nullptr;
+    if (huge_pages_1gb_) {
+        // RandomX itself falls back 1GB -> 2MB -> normal pages
+        dataset = randomx_alloc_partial_dataset(flags | RANDOMX_FLAG_1GB_PAGES, numa_node, item_count);
+        if (dataset && !randomx_dataset_has_1gb_pages(dataset)) {
+            LOG_WARNING("No 1GB pages available for RandomX dataset, using smaller pages");
+        }
+    } else if (huge_pages_) {
+        dataset = randomx_alloc_partial_dataset(flags | RANDOMX_FLAG_LARGE_PAGES, numa_node, item_count);
+        if (!dataset) {
+            LOG_WARNING("Huge page allocation failed for RandomX dataset, using normal pages");
+        }
+    }
+    if (!dataset && !huge_pages_1gb_) {
+        dataset = randomx_alloc_partial_dataset(flags, numa_node, item_count);
+    }
+    if (dataset && lock_dataset_) {
+        lock_dataset_memory(dataset, item_count);
+    }
+    return dataset;
+}
+
+void Miner::lock_dataset_memory(randomx_dataset* dataset, unsigned long item_count) {
+#ifndef _WIN32
+    // Faults the whole range in and keeps it out of swap; freeing the dataset unlocks it
+    size_t bytes = (size_t)item_count * RANDOMX_DATASET_ITEM_SIZE;
+    if (mlock(randomx_get_dataset_memory(dataset), bytes) == 0) {
+        LOG_DEBUG_STREAM("Locked " << bytes / (1024 * 1024) << " MB of RandomX dataset in RAM");
+        return;
+    }
+    LOG_WARNING_STREAM("Cannot lock the RandomX dataset in RAM (" << strerror(errno)
+                       << "); raise the memlock limit (ulimit -l, LimitMEMLOCK=) or grant CAP_IPC_LOCK");
+#else
+    (void)dataset;
+    (void)item_count;
+    LOG_WARNING("Locking the RandomX dataset in RAM is not supported on Windows");
+#endif
+}
+
+randomx_vm* Miner::create_vm(randomx_flags flags, randomx_cache* cache, randomx_dataset* dataset, int node) {
+    InitPhaseTimer timer(INIT_VM_CREATE);
+    randomx_vm* vm = nullptr;
+    if (secure_jit_) {
+        flags |= RANDOMX_FLAG_SECURE;
+    }
+    if (huge_pages_) {
+        vm = vm_pool_.acquire(flags | RANDOMX_FLAG_LARGE_PAGES, node, cache, dataset);
+        if (!vm) {
+            LOG_WARNING("Huge page allocation failed for RandomX scratchpad, using normal pages");
+        }
+    }
+    if (!vm) {
+        vm = vm_pool_.acquire(flags, node, cache, dataset);
+    }
+    return vm;
+}
+
+int Miner::thread_node(int thread_id) const {
+    return numa_available_ && thread_id >= 0 && thread_id < (int)thread_to_node_.size() ? thread_to_node_[thread_id] : -1;
+}
+
+void Miner::init_cache(randomx_cache* cache, const std::vector<uint8_t>& seed_hash) {
+    // randomx_init_cache in its two steps, timed apart
+    {
+        InitPhaseTimer timer(INIT_ARGON2);
+        randomx_fill_cache(cache, seed_hash.data(), seed_hash.size());
+    }
+    InitPhaseTimer timer(INIT_SUPERSCALAR);
+    randomx_restore_cache(cache, seed_hash.data(), seed_hash.size());
+}
+
+void Miner::publish_init_timing(InitTiming& timing, std::chrono::steady_clock::time_point started) {
+    timing.total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    {
+        std::lock_guard<std::mutex> lock(init_timing_mutex_);
+        init_timing_ = timing;
+    }
+    // Logged with the first hashes, which complete it
+    first_hash_pending_.store(true);
+}
+
+void Miner::record_first_hash(std::chrono::steady_clock::time_point published) {
+    if (!first_hash_pending_.exchange(false)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(init_timing_mutex_);
+    init_timing_.seconds[INIT_FIRST_HASH] =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - published).count();
+    LOG_INFO_STREAM("Init timing: " << init_timing_.describe());
+}
+
+InitTiming Miner::get_init_timing() const {
+    std::lock_guard<std::mutex> lock(init_timing_mutex_);
+    return init_timing_;
+}
+
+// The code paths these flags select, e.g. "JIT, hardware AES, Argon2 AVX-512, Blake2b avx512"
+static std::string randomx_implementation_summary(randomx_flags flags) {
+    const char* argon2 = (flags & RANDOMX_FLAG_ARGON2_AVX512) ? "AVX-512"
+                       : (flags & RANDOMX_FLAG_ARGON2_AVX2) ? "AVX2"
+                       : (flags & RANDOMX_FLAG_ARGON2_SSSE3) ? "SSSE3" : "reference";
+    std::ostringstream ss;
+    ss << ((flags & RANDOMX_FLAG_JIT) ? ((flags & RANDOMX_FLAG_SECURE) ? "secure JIT" : "JIT") : "interpreter");
+    if (flags & RANDOMX_FLAG_JIT) ss << " (" << randomx_get_jit_profile() << ")";
+    ss << ", " << ((flags & RANDOMX_FLAG_HARD_AES) ? "hardware" : "software") << " AES";
+    if (!(flags & RANDOMX_FLAG_HARD_AES)) ss << " (" << randomx_get_soft_aes() << ")";
+    ss << ", Argon2 " << argon2 << ", Blake2b " << randomx_get_blake2b();
+    return ss.str();
+}
+
+bool Miner::set_jit_profile(const std::string& name) {
+    return randomx_set_jit_profile(name.empty() ? nullptr : name.c_str()) != 0;
+}
+
+bool Miner::set_soft_aes(const std::string& name) {
+    return randomx_set_soft_aes(name.empty() ? nullptr : name.c_str()) != 0;
+}
+
+void Miner::set_scratchpad_coloring(bool enable) {
+    scratchpad_coloring = enable;
+    randomx_set_scratchpad_coloring(enable ? 1 : 0);
+}
+
+std::string Miner::huge_page_summary() const {
+    const size_t MB = 1024 * 1024;
+    std::ostringstream ss;
+
+    std::vector<randomx_dataset*> datasets;
+    if (dataset_) datasets.push_back(dataset_);
+    for (const auto& node : numa_nodes_) {
+        if (node.dataset) datasets.push_back(node.dataset);
+    }
+    if (!datasets.empty()) {
+        const size_t size = randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE;
+        size_t huge = 0;
+        bool all_1gb = true;
+        for (auto dataset : datasets) {
+            huge += utils::huge_page_bytes(randomx_get_dataset_memory(dataset), size);
+            all_1gb = all_1gb && randomx_dataset_has_1gb_pages(dataset);
+        }
+        ss << "dataset " << huge / MB << "/" << datasets.size() * size / MB << " MB";
+        if (all_1gb) ss << " (1GB pages)";
+        ss << ", ";
+    }
+
+    std::vector<randomx_cache*> caches;
+    std::vector<randomx_vm*> vms(legacy_vms_);
+    if (legacy_cache_) caches.push_back(legacy_cache_);
+    for (const auto& node : numa_nodes_) {
+        if (node.cache) caches.push_back(node.cache);
+        vms.insert(vms.end(), node.vms.begin(), node.vms.end());
+    }
+
+    const size_t cache_size = (size_t)RANDOMX_ARGON_MEMORY * 1024;
+    size_t cache_huge = 0;
+    for (auto cache : caches) {
+        cache_huge += utils::huge_page_bytes(randomx_get_cache_memory(cache), cache_size);
+    }
+    ss << "cache " << cache_huge / MB << "/" << caches.size() * cache_size / MB << " MB, ";
+
+    const size_t scratchpad_size = RANDOMX_SCRATCHPAD_L3;
+    size_t scratchpad_huge = 0;
+    size_t vm_count = 0;
+    for (auto vm : vms) {
+        if (!vm) continue;
+        scratchpad_huge += utils::huge_page_bytes(randomx_get_scratchpad(vm), scratchpad_size);
+        vm_count++;
+    }
+    ss << "scratchpads " << scratchpad_huge / MB << "/" << vm_count * scratchpad_size / MB << " MB";
+
+    return ss.str();
+}
+
+HugePagePlan Miner::huge_page_plan() const {
+    HugePagePlan plan;
+    if (!huge_pages_) {
+        return plan;
+    }
+    const size_t page = HUGE_PAGE_2MB_KB * 1024;
+    auto pages_of = [](size_t bytes, size_t page_bytes) { return (bytes + page_bytes - 1) / page_bytes; };
+
+    // Threads (one VM each) per node, or all at -1
+    std::vector<size_t> node_vms(numa_available_ ? num_numa_nodes_ : 1, 0);
+    for (unsigned int t = 0; t < num_threads_; t++) {
+        node_vms[numa_available_ ? thread_to_node_[t] : 0] += 1;
+    }
+    auto node_id = [this](size_t index) { return numa_available_ ? (int)index : -1; };
+
+    const bool replicas = fast_mode_ && numa_available_ && numa_replicas_;
+    if (is_medium_mode() || replicas || (fast_mode_ && !use_dataset_share())) {
+        const size_t bytes = (size_t)(is_medium_mode() ? partial_items_ : randomx_dataset_item_count())
+                             * RANDOMX_DATASET_ITEM_SIZE;
+        const size_t page_kb = huge_pages_1gb_ ? HUGE_PAGE_1GB_KB : HUGE_PAGE_2MB_KB;
+        const size_t pages = pages_of(bytes, page_kb * 1024);
+        for (size_t n = 0; n < node_vms.size(); n++) {
+            if (!replicas) {
+                plan.emplace_back("dataset", -1, page_kb, pages);
+                break;
+            }
+            if (node_vms[n] > 0) plan.emplace_back("dataset", (int)n, page_kb, pages);
+        }
+    }
+
+    const size_t cache_pages = pages_of((size_t)RANDOMX_ARGON_MEMORY * 1024, page);
+    plan.emplace_back("cache", -1, HUGE_PAGE_2MB_KB, cache_pages);
+    if (numa_available_ && !fast_mode_) {
+        for (size_t n = 0; n < node_vms.size(); n++) {
+            if (node_vms[n] > 0) plan.emplace_back("cache", (int)n, HUGE_PAGE_2MB_KB, cache_pages);
+        }
+    }
+
+    // Colored scratchpads share chunks of ScratchpadColors, staggered by
+    // their L1 size, whose pages are faulted in as far as the last one used
+    const size_t colors = 8;
+    const size_t stride = RANDOMX_SCRATCHPAD_L3 + RANDOMX_SCRATCHPAD_L1;
+    const size_t jit_kb = fast_mode_ ? HUGE_PAGE_JIT_FAST_KB : HUGE_PAGE_JIT_LIGHT_KB;
+    for (size_t n = 0; n < node_vms.size(); n++) {
+        const size_t vms = node_vms[n];
+        if (vms == 0) continue;
+        size_t pages = vms * pages_of(RANDOMX_SCRATCHPAD_L3, page);
+        if (scratchpad_coloring) {
+            const size_t full = vms / colors, rest = vms % colors;
+            pages = full * pages_of((colors - 1) * stride + RANDOMX_SCRATCHPAD_L3, page);
+            if (rest) pages += pages_of((rest - 1) * stride + RANDOMX_SCRATCHPAD_L3, page);
+        }
+        plan.emplace_back("scratchpads", node_id(n), HUGE_PAGE_2MB_KB, pages);
+        // 4 KB slots in 2 MB chunks, the first page of each shared
+        const size_t slots = page / 4096 - 1;
+        plan.emplace_back("JIT code", node_id(n), HUGE_PAGE_2MB_KB, pages_of(vms * (jit_kb / 4), slots));
+    }
+    return plan;
+}
+
+MemoryLocality Miner::memory_locality() {
+    MemoryLocality locality;
+    std::vector<bool> cpu_nodes;
+    for (const auto& cpu : topology_.cpus()) {
+        if (cpu.node >= (int)cpu_nodes.size()) cpu_nodes.resize(cpu.node + 1);
+        if (cpu.node >= 0 && !cpu_nodes[cpu.node]) {
+            cpu_nodes[cpu.node] = true;
+            locality.nodes++;
+        }
+    }
+
+    // Shared regions first: the threads' data shares come from these
+    const size_t dataset_size = randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE;
+    const size_t cache_size = (size_t)RANDOMX_ARGON_MEMORY * 1024;
+    std::vector<const void*> region_memory;
+    locality.supported = true;
+    auto add_region = [&](const char* name, const void* memory, size_t size, int thread, int node) {
+        MemoryRegionLocality region;
+        region.region = name;
+        region.thread = thread;
+        region.intended_node = node;
+        if (!query_page_placement(memory, size, region.placement)) {
+            locality.supported = false;
+        }
+        locality.regions.push_back(region);
+        region_memory.push_back(memory);
+    };
+    if (dataset_) add_region("dataset", randomx_get_dataset_memory(dataset_), dataset_size, -1, -1);
+    if (partial_dataset_) {
+        add_region("partial_dataset", randomx_get_dataset_memory(partial_dataset_),
+                   (size_t)partial_items_ * RANDOMX_DATASET_ITEM_SIZE, -1, -1);
+    }
+    if (legacy_cache_) add_region("cache", randomx_get_cache_memory(legacy_cache_), cache_size, -1, -1);
+    for (const auto& node : numa_nodes_) {
+        if (node.dataset) add_region("dataset", randomx_get_dataset_memory(node.dataset), dataset_size, -1, node.node_id);
+        if (node.cache) add_region("cache", randomx_get_cache_memory(node.cache), cache_size, -1, node.node_id);
+        if (!locality.supported) break;
+    }
+    if (!locality.supported) {
+        locality.regions.clear();
+        return locality;
+    }
+    auto share = [](const PagePlacement& placement, int node) {
+        return node < 0 || placement.sampled == placement.unplaced ? -1.0 : placement.share_on(node);
+    };
+
+    // VMs are swapped (warm-up) and light VMs freed under the pool lock
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    const bool numa = numa_layout();
+    for (unsigned int t = 0; t < num_threads_; t++) {
+        ThreadLocality thread;
+        thread.cpu = t < worker_cpus_.size() ? worker_cpus_[t] : -1;
+        if (thread.cpu < 0 && affinity_ && t < thread_to_cpu_.size()) {
+            thread.cpu = thread_to_cpu_[t];
+        }
+        const CpuInfo* info = topology_.find_cpu(thread.cpu);
+        thread.cpu_node = info ? info->node : -1;
+        int node = numa_available_ && t < thread_to_node_.size() ? thread_to_node_[t] : -1;
+        thread.intended_node = node;
+
+        randomx_vm** slot = vm_slot((int)t);
+        randomx_vm* vm = slot ? *slot : nullptr;
+        if (vm) {
+            add_region("scratchpad", randomx_get_scratchpad(vm), RANDOMX_SCRATCHPAD_L3, (int)t, node);
+            thread.scratchpad_share = share(locality.regions.back().placement, thread.cpu_node);
+            size_t code_size = 0;
+            const void* code = randomx_get_jit_code(vm, &code_size);
+            if (code) {
+                add_region("jit", code, code_size, (int)t, node);
+                thread.jit_share = share(locality.regions.back().placement, thread.cpu_node);
+            }
+        }
+
+        // What its VM reads: the node's replica or cache, else the shared
+        // dataset or cache (the cache also while warming up)
+        const void* data = nullptr;
+        if (numa && node >= 0 && node < (int)numa_nodes_.size()) {
+            const NumaNodeResources& resources = numa_nodes_[node];
+            if (fast_mode_ && resources.dataset && !warming_up_.load()) {
+                data = randomx_get_dataset_memory(resources.dataset);
+            } else if (!fast_mode_ && resources.cache) {
+                data = randomx_get_cache_memory(resources.cache);
+            }
+        }
+        if (!data && fast_mode_ && dataset_ && !warming_up_.load()) {
+            data = randomx_get_dataset_memory(dataset_);
+        }
+        if (!data && legacy_cache_) {
+            data = randomx_get_cache_memory(legacy_cache_);
+        }
+        for (size_t r = 0; data && r < region_memory.size(); r++) {
+            if (region_memory[r] == data) {
+                thread.data_share = share(locality.regions[r].placement, thread.cpu_node);
+                break;
+            }
+        }
+        locality.threads.push_back(thread);
+    }
+    return locality;
+}
+
+MemoryUsage Miner::memory_usage() const {
+    // Walks the live pointers, so only from the thread that changes them
+    // (the main thread); the background build is read under its lock
+    const size_t cache_size = (size_t)RANDOMX_ARGON_MEMORY * 1024;
+    const size_t dataset_size = randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE;
+    MemoryUsage usage;
+
+    size_t caches = legacy_cache_ ? 1 : 0;
+    size_t datasets = dataset_ ? 1 : 0;
+    size_t vms = vm_pool_.idle();
+    for (auto vm : legacy_vms_) {
+        if (vm) vms++;
+    }
+    for (const auto& node : numa_nodes_) {
+        if (node.dataset) datasets++;
+        if (node.cache) caches++;
+        for (auto vm : node.vms) {
+            if (vm) vms++;
+        }
+    }
+    usage.bytes[MEMORY_CACHE] = caches * cache_size;
+    usage.bytes[MEMORY_DATASET] = datasets ? dataset_size : 0;
+    usage.bytes[MEMORY_REPLICAS] = datasets > 1 ? (datasets - 1) * dataset_size : 0;
+    usage.bytes[MEMORY_PARTIAL] = partial_dataset_ ? (size_t)partial_items_ * RANDOMX_DATASET_ITEM_SIZE : 0;
+    usage.bytes[MEMORY_SCRATCHPADS] = vms * RANDOMX_SCRATCHPAD_L3;
+    {
+        std::lock_guard<std::mutex> lock(prepare_mutex_);
+        usage.bytes[MEMORY_NEXT_EPOCH] = epoch_bytes(next_epoch_);
+    }
+    usage.bytes[MEMORY_NEXT_EPOCH] += building_bytes_.load();
+    for (const auto& epoch : retained_epochs_) {
+        usage.bytes[MEMORY_RETAINED] += epoch_bytes(epoch);
+    }
+    return usage;
+}
+
+void Miner::track_memory() {
+    memory_planner_.update(memory_usage());
+}
+
+std::string Miner::memory_summary() const {
+    // Resident RandomX memory by component: live epoch, VM scratchpads, and the
+    // prepared or retained epochs kept on the side
+    const size_t MB = 1024 * 1024;
+    MemoryUsage usage = memory_usage();
+    size_t idle = vm_pool_.idle();
+    size_t vms = usage.bytes[MEMORY_SCRATCHPADS] / RANDOMX_SCRATCHPAD_L3;
+
+    std::ostringstream ss;
+    if (usage.bytes[MEMORY_DATASET]) {
+        ss << "dataset " << usage.bytes[MEMORY_DATASET] / MB << " MB" << (dataset_share_.attached() ? " (shared)" : "") << ", ";
+    }
+    if (usage.bytes[MEMORY_REPLICAS]) ss << "replicas " << usage.bytes[MEMORY_REPLICAS] / MB << " MB, ";
+    if (usage.bytes[MEMORY_PARTIAL]) ss << "partial dataset " << usage.bytes[MEMORY_PARTIAL] / MB << " MB, ";
+    ss << "cache " << usage.bytes[MEMORY_CACHE] / MB << " MB, ";
+    ss << "scratchpads " << usage.bytes[MEMORY_SCRATCHPADS] / MB << " MB (" << vms << " VMs";
+    if (idle) ss << ", " << idle << " idle";
+    ss << ")";
+    if (usage.bytes[MEMORY_NEXT_EPOCH]) ss << ", next epoch " << usage.bytes[MEMORY_NEXT_EPOCH] / MB << " MB";
+    if (usage.bytes[MEMORY_RETAINED]) ss << ", retained epochs " << usage.bytes[MEMORY_RETAINED] / MB << " MB";
+    ss << ", total " << usage.total() / MB << " MB";
+    const MemoryBudget budget = memory_planner_.budget();
+    if (budget.mb) ss << " of " << budget.mb << " MB budget";
+    return ss.str();
+}
+
+MemoryPlan Miner::plan_memory() {
+    MemoryDemand demand;
+    demand.fast = fast_mode_;
+    demand.medium_mb = medium_mode_mb();
+    demand.threads = num_threads_;
+    std::vector<bool> nodes = active_numa_nodes();
+    demand.nodes = std::max<unsigned int>(1, (unsigned int)std::count(nodes.begin(), nodes.end(), true));
+    demand.replicas = numa_available_ && numa_replicas_;
+    demand.prefetch = epoch_prefetch_ && !low_memory_ && !use_dataset_share();
+    demand.retain = epoch_retain_mb_ != 0 && !low_memory_ && !use_dataset_share();
+
+    MemoryPlan plan = memory_planner_.plan(demand);
+    if (!plan.mode_change.empty()) {
+        // The caller picked the mode; an allocation that fails steps down (see step_down)
+        LOG_WARNING_STREAM("Memory plan: " << plan.mode_change << "; trying " << (fast_mode_ ? "fast" : "medium")
+                           << " mode anyway");
+        plan.fast = demand.fast;
+        plan.medium_mb = demand.medium_mb;
+    }
+    for (const std::string& change : plan.changes) {
+        std::cout << "Memory plan: " << change << std::endl;
+        LOG_INFO_STREAM("Memory plan: " << change);
+    }
+    if (demand.replicas && !plan.replicas) {
+        numa_replicas_ = false;
+    }
+    if (demand.prefetch && !plan.prefetch) {
+        epoch_prefetch_ = false;
+    }
+    if (demand.retain && !plan.retain) {
+        epoch_retain_mb_ = 0;
+    }
+    LOG_DEBUG_STREAM("Memory plan: " << plan.expected.describe() << " (budget " << memory_planner_.budget().mb
+                     << " MB from " << memory_planner_.budget().source << ")");
+    return plan;
+}
+
+size_t Miner::medium_mode_mb() const {
+    return fast_mode_ ? 0 : (size_t)partial_items_ * RANDOMX_DATASET_ITEM_SIZE / (1024 * 1024);
+}
+
+bool Miner::step_down(const std::vector<uint8_t>& seed_hash, const std::string& failed) {
+    // A dataset allocation failed part way through initialize_epoch: free
+    // what it got and build the epoch again one step smaller, NUMA replicas
+    // -> one dataset -> medium mode with what is free now (at most half the
+    // dataset it had) -> light mode, rather than stop mining
+#ifdef HAVE_NUMA
+    if (numa_available_) numa_set_preferred(-1);
+#endif
+    const size_t MB = 1024 * 1024;
+    const size_t had_mb = fast_mode_ ? randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE / MB : medium_mode_mb();
+    release_resources();
+    std::string next;
+    if (fast_mode_ && numa_available_ && numa_replicas_) {
+        numa_replicas_ = false;
+        next = "one dataset for all NUMA nodes";
+    } else if (had_mb > 0) {
+        size_t room_mb = utils::available_ram_mb();
+        room_mb = room_mb > MEMORY_BUDGET_HEADROOM_MB ? room_mb - MEMORY_BUDGET_HEADROOM_MB : 0;
+        const MemoryBudget budget = memory_planner_.budget();
+        if (budget.mb) {
+            track_memory();
+            const size_t used_mb = memory_planner_.usage().total() / MB;
+            room_mb = std::min(room_mb, budget.mb > used_mb ? budget.mb - used_mb : 0);
+        }
+        room_mb = std::min(room_mb, had_mb / 2);
+        // The VMs of the old mode are of another kind
+        vm_pool_.clear();
+        dataset_share_.detach();
+        fast_mode_ = false;
+        set_partial_dataset_mb(room_mb >= MEMORY_PLAN_MEDIUM_MIN_MB ? room_mb : 0);
+        next = is_medium_mode() ? "medium mode (" + std::to_string(medium_mode_mb()) + " MB)" : "light mode";
+    } else {
+        return false;  // Light mode has nothing left to give up
+    }
+    std::cout << "Failed to allocate " << failed << ", continuing with " << next << std::endl;
+    LOG_WARNING_STREAM("Failed to allocate " << failed << ", continuing with " << next);
+    return initialize_epoch(seed_hash);
+}
+
 Miner::~Miner() {
-    stop();
+    finish_warmup(true);
+    dataset_store_.cancel();
+    discard_next_epoch();
+    shutdown_pool();
+    release_retained_epochs();
 
     // Clean up NUMA-aware resources
     for (auto& node : numa_nodes_) {
         for (auto vm : node.vms) {
             if (vm) {
-                randomx_destroy_vm(vm);
+                vm_pool_.release(vm);
             }
         }
         node.vms.clear();
@@ -141,13 +797,17 @@ Miner::~Miner() {
             randomx_release_cache(node.cache);
             node.cache = nullptr;
         }
+        if (node.dataset) {
+            randomx_release_dataset(node.dataset);
+            node.dataset = nullptr;
+        }
     }
     numa_nodes_.clear();
 
     // Clean up legacy resources
     for (auto vm : legacy_vms_) {
         if (vm) {
-            randomx_destroy_vm(vm);
+            vm_pool_.release(vm);
         }
     }
     legacy_vms_.clear();
@@ -162,10 +822,48 @@ Miner::~Miner() {
         randomx_release_dataset(dataset_);
         dataset_ = nullptr;
     }
+    if (partial_dataset_) {
+        randomx_release_dataset(partial_dataset_);
+        partial_dataset_ = nullptr;
+    }
+
+    // The VMs holding them are gone
+    vm_pool_.clear();
+    for (randomx_phase_profile* profile : phase_profiles_) {
+        randomx_release_phase_profile(profile);
+    }
+    phase_profiles_.clear();
+}
+
+void Miner::set_partial_dataset_mb(size_t mb) {
+    // Whole init slices, so no 2MB page is shared between two init workers
+    const unsigned long total = randomx_dataset_item_count();
+    unsigned long items = (unsigned long)std::min<uint64_t>((uint64_t)mb * 1024 * 1024 / RANDOMX_DATASET_ITEM_SIZE, total);
+    if (items < total) {
+        items -= items % DATASET_INIT_SLICE_ITEMS;
+    }
+    partial_items_ = items;
 }
 
 bool Miner::initialize(const std::vector<uint8_t>& seed_hash) {
-    std::string mode_str = fast_mode_ ? "FAST (full dataset)" : "LIGHT (cache only)";
+    InitTiming timing;
+    timing.trigger = "startup";
+    auto started = std::chrono::steady_clock::now();
+    bool ok;
+    {
+        InitTimingScope scope(&timing);
+        ok = initialize_epoch(seed_hash);
+    }
+    if (ok) {
+        publish_init_timing(timing, started);
+    }
+    return ok;
+}
+
+bool Miner::initialize_epoch(const std::vector<uint8_t>& seed_hash) {
+    std::ostringstream medium;
+    medium << "MEDIUM (" << (uint64_t)partial_items_ * RANDOMX_DATASET_ITEM_SIZE / (1024 * 1024) << " MB of dataset)";
+    std::string mode_str = fast_mode_ ? "FAST (full dataset)" : is_medium_mode() ? medium.str() : "LIGHT (cache only)";
     std::cout << "Initializing RandomX in " << mode_str << " mode..." << std::endl;
     LOG_DEBUG_STREAM("Initializing RandomX with seed: " << utils::bytes_to_hex(seed_hash.data(), 32));
     LOG_DEBUG_STREAM("Mode: " << mode_str);
@@ -186,12 +884,31 @@ bool Miner::initialize(const std::vector<uint8_t>& seed_hash) {
         vm_flags |= RANDOMX_FLAG_FULL_MEM;
     }
     LOG_DEBUG_STREAM("RandomX flags: " << std::hex << flags << " (VM flags: " << vm_flags << ")" << std::dec);
+    std::string implementation = randomx_implementation_summary(secure_jit_ ? flags | RANDOMX_FLAG_SECURE : flags);
+    std::cout << "RandomX: " << implementation << std::endl;
+    LOG_INFO_STREAM("RandomX: " << implementation);
+#ifdef JUNO_PORTABLE
+    LOG_INFO_STREAM("Portable build: hex codec " << utils::hex_codec_name());
+#else
+    LOG_DEBUG_STREAM("Native build: hex codec " << utils::hex_codec_name());
+#endif
 
     current_seed_hash_ = seed_hash;
 
+    if (gpu_device_ >= 0 && (fast_mode_ || is_medium_mode()) && !gpu_dataset_.is_open()) {
+        std::string error;
+        if (gpu_dataset_.open((unsigned int)gpu_device_, error)) {
+            std::cout << "Building datasets on GPU: " << gpu_dataset_.device_name() << std::endl;
+            LOG_INFO_STREAM("Building datasets on GPU " << gpu_device_ << ": " << gpu_dataset_.device_name());
+        } else {
+            std::cout << "GPU dataset build unavailable (" << error << "), using the CPU" << std::endl;
+            LOG_WARNING_STREAM("GPU dataset build unavailable (" << error << "), using the CPU");
+        }
+    }
+
     // In fast mode, we need a single shared dataset (not per-NUMA-node)
     // First allocate cache (needed to initialize dataset)
-    legacy_cache_ = randomx_alloc_cache(flags);
+    legacy_cache_ = alloc_cache(flags);
     if (!legacy_cache_) {
         std::cerr << "Failed to allocate RandomX cache" << std::endl;
         LOG_ERROR("Failed to allocate RandomX cache");
@@ -199,56 +916,69 @@ bool Miner::initialize(const std::vector<uint8_t>& seed_hash) {
     }
     LOG_DEBUG("RandomX cache allocated");
 
-    // Initialize cache with seed
-    randomx_init_cache(legacy_cache_, seed_hash.data(), seed_hash.size());
-    LOG_DEBUG("RandomX cache initialized with seed");
+    // Initialize cache with seed (fast mode fills it with the dataset, which may come from disk)
+    if (!fast_mode_) {
+        init_cache(legacy_cache_, seed_hash);
+        LOG_DEBUG("RandomX cache initialized with seed");
+    }
 
-    if (fast_mode_) {
+    if (is_medium_mode()) {
+        // Medium mode: build the resident part of the dataset; light VMs compute the rest
+        const uint64_t partial_mb = (uint64_t)partial_items_ * RANDOMX_DATASET_ITEM_SIZE / (1024 * 1024);
+        std::cout << "Allocating partial RandomX dataset (" << partial_mb << " MB)..." << std::endl;
+        partial_dataset_ = alloc_dataset(flags, -1, partial_items_);
+        if (!partial_dataset_) {
+            return step_down(seed_hash, "the partial RandomX dataset (" + std::to_string(partial_mb) + " MB)");
+        }
+        std::cout << "Initializing partial RandomX dataset..." << std::endl;
+        init_datasets(capture_epoch(), &init_abort_);
+        std::cout << "Partial dataset initialization complete" << std::endl;
+    }
+
+    // With NUMA, fast mode gets one dataset replica per node (allocated below)
+    // instead of a single shared one that half the threads read remotely
+    bool numa_replicas = numa_available_ && numa_replicas_;
+
+    // Nothing on disk: mine with light VMs while the dataset builds (see start_warmup)
+    bool warmup = use_warmup(seed_hash);
+    if (warmup) {
+        init_cache(legacy_cache_, seed_hash);
+    }
+
+    if (fast_mode_ && numa_replicas && dataset_share_.enabled()) {
+        std::cout << "Dataset sharing needs one dataset for all NUMA nodes (--no-numa-replicas), "
+                  << "building private replicas" << std::endl;
+        LOG_WARNING("Dataset sharing is off while NUMA replicas are in use");
+    }
+    if (fast_mode_ && !numa_replicas && use_dataset_share()) {
+        // Map the epoch another process already built, or build it for all of them
+        if (!attach_shared_dataset(seed_hash)) {
+            std::cout << "Shared dataset unavailable, building a private one" << std::endl;
+            LOG_WARNING("Shared dataset unavailable, building a private one");
+            dataset_share_.set_enabled(false);
+        }
+    }
+
+    if (fast_mode_ && !numa_replicas && !dataset_) {
         // Fast mode: allocate and initialize the full dataset (~2GB)
         std::cout << "Allocating RandomX dataset (~2GB)..." << std::endl;
-        dataset_ = randomx_alloc_dataset(flags);
+        dataset_ = alloc_dataset(flags);
         if (!dataset_) {
-            std::cerr << "Failed to allocate RandomX dataset (need ~2GB RAM)" << std::endl;
-            LOG_ERROR("Failed to allocate RandomX dataset");
-            randomx_release_cache(legacy_cache_);
-            legacy_cache_ = nullptr;
-            return false;
+            return step_down(seed_hash, "the RandomX dataset (~2GB)");
         }
         LOG_DEBUG("RandomX dataset allocated");
 
         // Initialize dataset from cache using multiple threads for speed
-        std::cout << "Initializing RandomX dataset (this may take a moment)..." << std::endl;
-        unsigned long item_count = randomx_dataset_item_count();
-        unsigned int init_threads = std::min(num_threads_, (unsigned int)std::thread::hardware_concurrency());
-        if (init_threads == 0) init_threads = 1;
-
-        // Parallel dataset initialization
-        std::vector<std::thread> init_threads_vec;
-        unsigned long items_per_thread = item_count / init_threads;
-        unsigned long remainder = item_count % init_threads;
-
-        for (unsigned int t = 0; t < init_threads; t++) {
-            unsigned long start = t * items_per_thread;
-            unsigned long count = items_per_thread;
-            if (t == init_threads - 1) {
-                count += remainder;  // Last thread handles remainder
-            }
-            init_threads_vec.emplace_back([this, start, count]() {
-                randomx_init_dataset(dataset_, legacy_cache_, start, count);
-            });
+        if (!warmup) {
+            std::cout << "Initializing RandomX dataset (this may take a moment)..." << std::endl;
+            fill_epoch(capture_epoch(), &init_abort_);
+            std::cout << "Dataset initialization complete" << std::endl;
         }
-
-        // Wait for all init threads to complete
-        for (auto& t : init_threads_vec) {
-            t.join();
-        }
-        LOG_DEBUG_STREAM("RandomX dataset initialized with " << init_threads << " threads");
-        std::cout << "Dataset initialization complete" << std::endl;
     }
 
 #ifdef HAVE_NUMA
-    if (numa_available_ && !fast_mode_) {
-        // NUMA-aware cache mode (only in light mode - fast mode uses shared dataset)
+    if (numa_available_ && (!fast_mode_ || numa_replicas)) {
+        // NUMA-aware mode: per-node cache (light mode) or per-node dataset replica (fast mode)
         std::cout << "Initializing NUMA-aware RandomX (" << num_numa_nodes_ << " nodes)..." << std::endl;
 
         // Count threads per node
@@ -257,7 +987,19 @@ bool Miner::initialize(const std::vector<uint8_t>& seed_hash) {
             threads_per_node[thread_to_node_[t]]++;
         }
 
-        // Allocate cache and VMs for each NUMA node
+        if (!fast_mode_) {
+            // Light mode: allocate every node's cache up front and fill them all
+            // from legacy_cache_ (Argon2 already ran there) before any VM exists
+            for (int node = 0; node < num_numa_nodes_; node++) {
+                if (threads_per_node[node] == 0) continue;
+                numa_set_preferred(node);
+                numa_nodes_[node].cache = alloc_cache(flags);
+            }
+            numa_set_preferred(-1);
+            replicate_cache(capture_epoch());
+        }
+
+        // Allocate dataset replicas and VMs for each NUMA node
         for (int node = 0; node < num_numa_nodes_; node++) {
             if (threads_per_node[node] == 0) {
                 continue;  // No threads assigned to this node
@@ -266,193 +1008,1439 @@ bool Miner::initialize(const std::vector<uint8_t>& seed_hash) {
             // Bind memory allocation to this NUMA node
             numa_set_preferred(node);
 
-            // Allocate cache on this node
-            numa_nodes_[node].cache = randomx_alloc_cache(flags);
-            if (!numa_nodes_[node].cache) {
+            if (fast_mode_) {
+                // Allocate a full dataset replica on this node, built from the shared cache
+                std::cout << "  Node " << node << ": allocating RandomX dataset replica (~2GB)..." << std::endl;
+                numa_nodes_[node].dataset = alloc_dataset(flags, node);
+                if (!numa_nodes_[node].dataset) {
+                    return step_down(seed_hash, "the RandomX dataset replica on NUMA node " + std::to_string(node));
+                }
+            } else if (!numa_nodes_[node].cache) {
                 std::cerr << "Failed to allocate RandomX cache on NUMA node " << node << std::endl;
                 LOG_ERROR_STREAM("Failed to allocate RandomX cache on NUMA node " << node);
+                numa_set_preferred(-1);
                 return false;
             }
 
-            // Initialize cache with seed
-            randomx_init_cache(numa_nodes_[node].cache, seed_hash.data(), seed_hash.size());
+            // Create VMs for threads on this node (fast mode: dataset only, cache can be NULL)
+            numa_nodes_[node].vms.resize(threads_per_node[node]);
+            for (int v = 0; v < threads_per_node[node]; v++) {
+                numa_nodes_[node].vms[v] = create_vm(vm_flags, numa_nodes_[node].cache,
+                                                     fast_mode_ ? numa_nodes_[node].dataset : partial_dataset_, node);
+                if (!numa_nodes_[node].vms[v]) {
+                    std::cerr << "Failed to create RandomX VM on NUMA node " << node << std::endl;
+                    LOG_ERROR_STREAM("Failed to create RandomX VM on NUMA node " << node);
+                    numa_set_preferred(-1);
+                    return false;
+                }
+            }
+
+            std::cout << "  Node " << node << ": " << (fast_mode_ ? "dataset" : "cache") << " + "
+                      << threads_per_node[node] << " VMs allocated" << std::endl;
+        }
+
+        // Reset NUMA policy to default
+        numa_set_preferred(-1);
+
+        if (fast_mode_ && !warmup) {
+            // Build all replicas at once, each by its own node's cores
+            std::cout << "Initializing RandomX dataset replicas (this may take a moment)..." << std::endl;
+            fill_epoch(capture_epoch(), &init_abort_);
+            std::cout << "Dataset initialization complete" << std::endl;
+        }
+
+        std::cout << "NUMA-aware RandomX initialization complete (" << num_threads_ << " threads across "
+                  << num_numa_nodes_ << " nodes)" << std::endl;
+        if (huge_pages_) {
+            std::string summary = huge_page_summary();
+            std::cout << "Huge pages: " << summary << std::endl;
+            LOG_INFO_STREAM("Huge pages: " << summary);
+        }
+        if (warmup) {
+            start_warmup();
+        } else {
+            store_epoch();
+            release_idle_cache();
+        }
+        track_memory();
+        std::string memory = memory_summary();
+        std::cout << "Memory: " << memory << std::endl;
+        LOG_INFO_STREAM("Memory: " << memory);
+        return true;
+    }
+#endif
+
+    // Create VMs for each thread (non-NUMA path or fast mode)
+    legacy_vms_.resize(num_threads_);
+
+    for (unsigned int i = 0; i < num_threads_; i++) {
+        prefer_thread_node((int)i);
+        if (fast_mode_) {
+            // Fast mode: VMs use dataset, cache can be NULL
+            legacy_vms_[i] = create_vm(vm_flags, nullptr, dataset_, thread_node((int)i));
+        } else {
+            // Light mode: VMs use cache, dataset is NULL (medium mode: the partial dataset)
+            legacy_vms_[i] = create_vm(vm_flags, legacy_cache_, partial_dataset_, thread_node((int)i));
+        }
+        if (!legacy_vms_[i]) {
+            prefer_thread_node(-1);
+            std::cerr << "Failed to create RandomX VM #" << i << std::endl;
+            LOG_ERROR_STREAM("Failed to create RandomX VM #" << i);
+            return false;
+        }
+    }
+    prefer_thread_node(-1);
+    LOG_DEBUG_STREAM("Created " << num_threads_ << " RandomX VMs");
+
+    std::cout << "RandomX initialization complete (" << num_threads_ << " threads, " << mode_str << ")" << std::endl;
+    if (huge_pages_) {
+        std::string summary = huge_page_summary();
+        std::cout << "Huge pages: " << summary << std::endl;
+        LOG_INFO_STREAM("Huge pages: " << summary);
+    }
+    if (init_abort_.load()) {
+        LOG_INFO("RandomX initialization abandoned");
+    } else if (warmup) {
+        start_warmup();
+    } else {
+        store_epoch();
+        release_idle_cache();
+    }
+    track_memory();
+    std::string memory = memory_summary();
+    std::cout << "Memory: " << memory << std::endl;
+    LOG_INFO_STREAM("Memory: " << memory);
+    return true;
+}
+
+void Miner::fill_epoch(const EpochResources& epoch, const std::atomic<bool>* abort) {
+    // A dataset saved by an earlier run replaces both Argon2 and the dataset build
+    std::vector<randomx_dataset*> datasets;
+    if (epoch.dataset) datasets.push_back(epoch.dataset);
+    for (auto dataset : epoch.node_datasets) {
+        if (dataset) datasets.push_back(dataset);
+    }
+    if (!datasets.empty()) {
+        InitPhaseTimer timer(INIT_DATASET_LOAD);
+        if (dataset_store_.load(epoch.seed_hash, epoch.cache, datasets)) {
+            return;
+        }
+    }
+
+    init_cache(epoch.cache, epoch.seed_hash);
+    replicate_cache(epoch);
+    init_datasets(epoch, abort);
+}
+
+void Miner::replicate_cache(const EpochResources& epoch) {
+    // Argon2 runs once, into the shared cache. Each node copies the finished
+    // memory with one of its own cores, so the pages are first touched
+    // locally, and only regenerates the superscalar programs and their JIT code
+    if (!epoch.cache) {
+        return;
+    }
+    InitPhaseTimer timer(INIT_CACHE_REPLICATE);
+    auto t0 = std::chrono::steady_clock::now();
+    const size_t cache_size = (size_t)RANDOMX_ARGON_MEMORY * 1024;
+    const void* source = randomx_get_cache_memory(epoch.cache);
+    const std::vector<uint8_t>& seed_hash = epoch.seed_hash;
+
+    std::vector<std::thread> copiers;
+    for (size_t n = 0; n < epoch.node_caches.size(); n++) {
+        randomx_cache* cache = epoch.node_caches[n];
+        if (!cache || cache == epoch.cache) continue;
+        int cpu_id = n < numa_nodes_.size() && !numa_nodes_[n].cpu_ids.empty() ? numa_nodes_[n].cpu_ids[0] : -1;
+
+        copiers.emplace_back([cache, source, cache_size, &seed_hash, cpu_id]() {
+            if (cpu_id >= 0 && !pin_current_thread(cpu_id)) {
+                LOG_WARNING_STREAM("Cache replication: failed to pin copier to CPU " << cpu_id);
+            }
+            memcpy(randomx_get_cache_memory(cache), source, cache_size);
+            randomx_restore_cache(cache, seed_hash.data(), seed_hash.size());
+        });
+    }
+    if (copiers.empty()) {
+        return;
+    }
+    for (auto& t : copiers) {
+        t.join();
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    LOG_DEBUG_STREAM("RandomX cache replicated to " << copiers.size() << " NUMA nodes in " << ms << "ms");
+}
+
+bool Miner::use_warmup(const std::vector<uint8_t>& seed_hash) const {
+    // A stored epoch loads in seconds; light mode only pays off for a real build
+    return fast_mode_ && light_start_ && !low_memory_ && !use_dataset_share() && !dataset_store_.contains(seed_hash);
+}
+
+void Miner::start_warmup() {
+    // Light VMs hash straight from the (already filled) cache
+    randomx_flags flags = randomx_get_flags();
+    flags |= RANDOMX_FLAG_JIT;
+
+    std::vector<randomx_vm*> light(num_threads_, nullptr);
+    bool ok = true;
+    for (unsigned int t = 0; ok && t < num_threads_; t++) {
+        if (get_vm_for_thread((int)t)) {
+            prefer_thread_node((int)t);
+            light[t] = create_vm(flags, legacy_cache_, nullptr, thread_node((int)t));
+            ok = light[t] != nullptr;
+        }
+    }
+    prefer_thread_node(-1);
+    if (!ok) {
+        for (auto vm : light) {
+            if (vm) vm_pool_.release(vm);
+        }
+        LOG_WARNING("Cannot create light-mode VMs for the warm-up, building the dataset first");
+        std::cout << "Initializing RandomX dataset (this may take a moment)..." << std::endl;
+        init_datasets(capture_epoch());
+        std::cout << "Dataset initialization complete" << std::endl;
+        store_epoch();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        fast_vms_.assign(num_threads_, nullptr);
+        light_vms_.assign(num_threads_, nullptr);
+        for (unsigned int t = 0; t < num_threads_; t++) {
+            randomx_vm** slot = vm_slot((int)t);
+            if (slot && *slot) {
+                fast_vms_[t] = *slot;
+                *slot = light[t];
+            }
+        }
+        vm_generation_++;
+    }
+    warming_up_ = true;
+    LOG_INFO("Mining in light mode while the dataset builds in the background");
+    std::cout << "Mining in light mode while the dataset builds..." << std::endl;
+    warmup_thread_ = std::thread(&Miner::warmup_thread, this, capture_epoch());
+}
+
+void Miner::warmup_thread(EpochResources epoch) {
+    TraceRecorder::set_thread_name("dataset warm-up");
+    auto t0 = std::chrono::steady_clock::now();
+    InitTiming timing;
+    {
+        InitTimingScope scope(&timing);
+        init_datasets(epoch, &warmup_abort_);
+    }
+    if (warmup_abort_.load()) {
+        return;  // finish_warmup puts the fast VMs back
+    }
+    {
+        std::lock_guard<std::mutex> lock(init_timing_mutex_);
+        add_background_timing(init_timing_, timing);
+        LOG_INFO_STREAM("Init timing with the warm-up's dataset: " << init_timing_.describe());
+    }
+
+    {
+        // Hand the fast VMs back; each worker switches at its next poll
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        for (size_t t = 0; t < fast_vms_.size(); t++) {
+            if (!fast_vms_[t]) continue;
+            randomx_vm** slot = vm_slot((int)t);
+            light_vms_[t] = *slot;
+            *slot = fast_vms_[t];
+            fast_vms_[t] = nullptr;
+        }
+        vm_generation_++;
+    }
+    warming_up_ = false;
+    pool_cv_.notify_all();  // Cut short any warm-up throttle pause
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    LOG_INFO_STREAM("Dataset ready after " << seconds << "s of light-mode mining, switching to fast mode");
+    std::cout << "Dataset ready, switching to fast mode" << std::endl;
+    store_epoch();
+}
+
+void Miner::finish_warmup(bool abort) {
+    if (warmup_thread_.joinable()) {
+        if (abort) {
+            warmup_abort_ = true;
+        } else if (warming_up_.load()) {
+            LOG_INFO("Waiting for the warm-up dataset build to finish");
+        }
+        warmup_thread_.join();
+        warmup_abort_ = false;
+    }
+
+    bool leftover = false;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        for (size_t t = 0; t < fast_vms_.size(); t++) {
+            leftover = leftover || fast_vms_[t] || light_vms_[t];
+        }
+    }
+    if (!leftover) {
+        return;
+    }
+
+    // Park the workers so no light VM is in use, then free them all
+    stop();
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        for (size_t t = 0; t < fast_vms_.size(); t++) {
+            if (fast_vms_[t]) {
+                randomx_vm** slot = vm_slot((int)t);
+                light_vms_[t] = *slot;
+                *slot = fast_vms_[t];
+            }
+            if (light_vms_[t]) {
+                vm_pool_.release(light_vms_[t]);
+            }
+        }
+        fast_vms_.clear();
+        light_vms_.clear();
+        vm_generation_++;
+    }
+    warming_up_ = false;
+}
+
+template<bool Numa>
+randomx_vm* Miner::refresh_vm(int thread_id, randomx_vm* vm, uint64_t& vm_generation) {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    vm_generation = vm_generation_.load();
+    // A retired light VM is only ever used by its own thread, so it is freed here
+    if (vm && thread_id < (int)light_vms_.size() && light_vms_[thread_id] == vm) {
+        vm_pool_.release(vm);
+        light_vms_[thread_id] = nullptr;
+    }
+    randomx_vm** slot = vm_slot<Numa>(thread_id);
+    return slot ? *slot : nullptr;
+}
+
+void Miner::store_epoch() {
+    randomx_dataset* dataset = dataset_;
+    for (const auto& node : numa_nodes_) {
+        if (!dataset) dataset = node.dataset;
+    }
+    if (!fast_mode_ || !dataset || !legacy_cache_ || dataset_store_.contains(current_seed_hash_)) {
+        return;
+    }
+    // In low-memory mode the writer takes the cache and frees it once written
+    dataset_store_.save_async(current_seed_hash_, legacy_cache_, dataset, low_memory_);
+    if (low_memory_) {
+        legacy_cache_ = nullptr;
+    }
+}
+
+bool Miner::ensure_cache() {
+    // Low-memory mode frees the cache between epochs; the next fill needs it back
+    if (legacy_cache_) {
+        return true;
+    }
+    randomx_flags flags = randomx_get_flags();
+    flags |= RANDOMX_FLAG_JIT;
+    legacy_cache_ = alloc_cache(flags);
+    if (!legacy_cache_) {
+        std::cerr << "Failed to allocate RandomX cache" << std::endl;
+        LOG_ERROR("Failed to allocate RandomX cache");
+        return false;
+    }
+    return true;
+}
+
+void Miner::release_idle_cache() {
+    // Light mode without NUMA hashes straight from legacy_cache_
+    if (!low_memory_ || !legacy_cache_ || (!fast_mode_ && !numa_available_)) {
+        return;
+    }
+    randomx_release_cache(legacy_cache_);
+    legacy_cache_ = nullptr;
+    LOG_DEBUG("Low-memory mode: released the shared RandomX cache");
+}
+
+bool Miner::use_dataset_share() const {
+    return dataset_share_.enabled() && fast_mode_ && !(numa_available_ && numa_replicas_);
+}
+
+bool Miner::attach_shared_dataset(const std::vector<uint8_t>& seed_hash) {
+    // Workers are parked (or there are no VMs yet); the view of the old segment goes first
+    if (dataset_) {
+        randomx_release_dataset(dataset_);
+        dataset_ = nullptr;
+    }
+    bool filled = false;
+    auto t0 = std::chrono::steady_clock::now();
+    void* memory = dataset_share_.attach(seed_hash, huge_pages_, [this, &seed_hash, &filled](void* memory) {
+        randomx_dataset* view = randomx_create_dataset_view(memory);
+        if (!view || !ensure_cache()) {
+            if (view) randomx_release_dataset(view);
+            return false;
+        }
+        EpochResources epoch;
+        epoch.seed_hash = seed_hash;
+        epoch.cache = legacy_cache_;
+        epoch.dataset = view;
+        std::cout << "Initializing shared RandomX dataset (this may take a moment)..." << std::endl;
+        fill_epoch(epoch);
+        std::cout << "Dataset initialization complete" << std::endl;
+        randomx_release_dataset(view);
+        filled = true;
+        return true;
+    });
+    if (memory) {
+        dataset_ = randomx_create_dataset_view(memory);
+    }
+    if (!dataset_) {
+        dataset_share_.detach();
+        return false;
+    }
+
+    // Another process built it: the cache here was never filled, and fast
+    // mode doesn't hash from it (ensure_cache brings it back when needed)
+    if (!filled && legacy_cache_) {
+        randomx_release_cache(legacy_cache_);
+        legacy_cache_ = nullptr;
+    }
+    if (!filled && current_init_timing) {
+        current_init_timing->seconds[INIT_DATASET_LOAD] +=
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+    current_seed_hash_ = seed_hash;
+    for (auto vm : legacy_vms_) {
+        if (vm) {
+            randomx_vm_set_dataset(vm, dataset_);
+        }
+    }
+    return true;
+}
+
+bool Miner::init_datasets_gpu(const EpochResources& epoch, const std::atomic<bool>* abort) {
+    // The GPU builds one full dataset; NUMA replicas are copies of it
+    std::vector<randomx_dataset*> full;
+    if (epoch.dataset) full.push_back(epoch.dataset);
+    for (auto dataset : epoch.node_datasets) {
+        if (dataset) full.push_back(dataset);
+    }
+    const unsigned long item_count = randomx_dataset_item_count();
+    if (!full.empty()) {
+        if (!gpu_dataset_.build(epoch.cache, full[0], item_count, abort)) {
+            return abort && abort->load();
+        }
+        for (size_t i = 1; i < full.size(); i++) {
+            std::memcpy(randomx_get_dataset_memory(full[i]), randomx_get_dataset_memory(full[0]),
+                        (size_t)item_count * RANDOMX_DATASET_ITEM_SIZE);
+        }
+    }
+    if (epoch.partial_dataset && !gpu_dataset_.build(epoch.cache, epoch.partial_dataset, partial_items_, abort)) {
+        return abort && abort->load();
+    }
+    return true;
+}
+
+void Miner::init_datasets(const EpochResources& epoch, const std::atomic<bool>* abort) {
+    InitPhaseTimer timer(INIT_DATASET_BUILD);
+    auto t0 = std::chrono::steady_clock::now();
+    if (gpu_dataset_.is_open()) {
+        if (init_datasets_gpu(epoch, abort)) {
+            return;
+        }
+        LOG_WARNING("GPU dataset build failed, building on the CPU");
+    }
+    DatasetInitializer initializer(epoch.cache);
+    initializer.set_abort_flag(abort);
+
+    // Node-local replicas are written by their own node's cores; a shared
+    // dataset on a NUMA system is split so each node first-touches a share
+    std::vector<std::vector<int>> node_cpus;
+    for (size_t n = 0; n < numa_nodes_.size(); n++) {
+        if (n < epoch.node_datasets.size() && epoch.node_datasets[n]) {
+            initializer.add_dataset(epoch.node_datasets[n], numa_nodes_[n].cpu_ids);
+        }
+        if (!numa_nodes_[n].cpu_ids.empty()) {
+            node_cpus.push_back(numa_nodes_[n].cpu_ids);
+        }
+    }
+    std::vector<int> all_cpus;
+    if (affinity_) {
+        for (const auto& cpu : topology_.cpus()) all_cpus.push_back(cpu.cpu);
+    }
+    if (epoch.dataset) {
+        if (numa_available_) {
+            initializer.add_dataset_split(epoch.dataset, node_cpus);
+        } else {
+            initializer.add_dataset(epoch.dataset, all_cpus);
+        }
+    }
+    if (epoch.partial_dataset) {
+        // Read by the threads of every node, so spread like a shared dataset
+        if (numa_available_) {
+            initializer.add_dataset_split(epoch.partial_dataset, node_cpus, partial_items_);
+        } else {
+            initializer.add_dataset(epoch.partial_dataset, all_cpus, partial_items_);
+        }
+    }
+
+    if (initializer.empty()) {
+        return;  // Light mode: nothing but caches
+    }
+    unsigned int workers = initializer.run();
+    add_dataset_workers(initializer.workers());
+    if (abort && abort->load()) {
+        return;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    LOG_INFO_STREAM("RandomX dataset initialized in " << seconds << "s with " << workers << " workers");
+}
+
+EpochResources Miner::capture_epoch() const {
+    EpochResources epoch;
+    epoch.seed_hash = current_seed_hash_;
+    epoch.cache = legacy_cache_;
+    epoch.dataset = dataset_;
+    epoch.partial_dataset = partial_dataset_;
+    for (const auto& node : numa_nodes_) {
+        epoch.node_caches.push_back(node.cache);
+        epoch.node_datasets.push_back(node.dataset);
+    }
+    return epoch;
+}
+
+void Miner::install_epoch(const EpochResources& epoch) {
+    // Workers must be parked; they keep their VMs, only the memory behind them changes
+    current_seed_hash_ = epoch.seed_hash;
+    legacy_cache_ = epoch.cache;
+    dataset_ = epoch.dataset;
+    partial_dataset_ = epoch.partial_dataset;
+    for (size_t n = 0; n < numa_nodes_.size(); n++) {
+        NumaNodeResources& node = numa_nodes_[n];
+        node.cache = n < epoch.node_caches.size() ? epoch.node_caches[n] : nullptr;
+        node.dataset = n < epoch.node_datasets.size() ? epoch.node_datasets[n] : nullptr;
+        for (auto vm : node.vms) {
+            if (!vm) continue;
+            if (node.dataset) {
+                randomx_vm_set_dataset(vm, node.dataset);
+            } else if (node.cache) {
+                randomx_vm_set_cache(vm, node.cache);
+                randomx_vm_set_partial_dataset(vm, partial_dataset_);
+            }
+        }
+    }
+    for (auto vm : legacy_vms_) {
+        if (!vm) continue;
+        if (dataset_) {
+            randomx_vm_set_dataset(vm, dataset_);
+        } else {
+            randomx_vm_set_cache(vm, legacy_cache_);
+            randomx_vm_set_partial_dataset(vm, partial_dataset_);
+        }
+    }
+}
+
+void Miner::release_epoch(EpochResources& epoch) {
+    for (auto& cache : epoch.node_caches) {
+        if (cache) randomx_release_cache(cache);
+        cache = nullptr;
+    }
+    for (auto& dataset : epoch.node_datasets) {
+        if (dataset) randomx_release_dataset(dataset);
+        dataset = nullptr;
+    }
+    if (epoch.dataset) {
+        randomx_release_dataset(epoch.dataset);
+        epoch.dataset = nullptr;
+    }
+    if (epoch.partial_dataset) {
+        randomx_release_dataset(epoch.partial_dataset);
+        epoch.partial_dataset = nullptr;
+    }
+    if (epoch.cache) {
+        randomx_release_cache(epoch.cache);
+        epoch.cache = nullptr;
+    }
+}
+
+size_t Miner::epoch_bytes(const EpochResources& epoch) const {
+    const size_t cache_size = (size_t)RANDOMX_ARGON_MEMORY * 1024;
+    const size_t dataset_size = randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE;
+    size_t bytes = epoch.cache ? cache_size : 0;
+    if (epoch.dataset) bytes += dataset_size;
+    if (epoch.partial_dataset) bytes += (size_t)partial_items_ * RANDOMX_DATASET_ITEM_SIZE;
+    for (auto cache : epoch.node_caches) {
+        if (cache) bytes += cache_size;
+    }
+    for (auto dataset : epoch.node_datasets) {
+        if (dataset) bytes += dataset_size;
+    }
+    return bytes;
+}
+
+bool Miner::build_epoch(const EpochResources& shape, const std::vector<uint8_t>& seed_hash, EpochResources& out) {
+    randomx_flags flags = randomx_get_flags();
+    flags |= RANDOMX_FLAG_JIT;
+
+    out = EpochResources();
+    out.seed_hash = seed_hash;
+    out.node_caches.assign(shape.node_caches.size(), nullptr);
+    out.node_datasets.assign(shape.node_datasets.size(), nullptr);
+
+    // The shared cache is filled last, together with the node caches and datasets
+    out.cache = alloc_cache(flags);
+    bool ok = out.cache != nullptr;
+    // Counted as the next epoch while it builds (see memory_usage)
+    auto count = [this, &out]() { building_bytes_ = epoch_bytes(out); };
+
+    for (size_t n = 0; ok && n < shape.node_caches.size(); n++) {
+#ifdef HAVE_NUMA
+        if (numa_available_) numa_set_preferred((int)n);
+#endif
+        if (shape.node_caches[n]) {
+            // Filled from the shared cache by fill_epoch
+            out.node_caches[n] = alloc_cache(flags);
+            ok = out.node_caches[n] != nullptr;
+        }
+        if (ok && n < shape.node_datasets.size() && shape.node_datasets[n]) {
+            out.node_datasets[n] = alloc_dataset(flags, (int)n);
+            ok = out.node_datasets[n] != nullptr;
+        }
+        count();
+    }
+#ifdef HAVE_NUMA
+    if (numa_available_) numa_set_preferred(-1);
+#endif
+
+    if (ok && shape.dataset) {
+        out.dataset = alloc_dataset(flags);
+        ok = out.dataset != nullptr;
+    }
+    if (ok && shape.partial_dataset) {
+        out.partial_dataset = alloc_dataset(flags, -1, partial_items_);
+        ok = out.partial_dataset != nullptr;
+    }
+    count();
+
+    if (ok) {
+        fill_epoch(out, &prepare_abort_);
+        ok = !prepare_abort_.load();
+    }
+    if (!ok) {
+        release_epoch(out);
+    }
+    // Published as next_epoch_ (or installed) by the caller from here
+    building_bytes_ = 0;
+    return ok;
+}
+
+void Miner::prepare_epoch_thread(EpochResources shape, std::vector<uint8_t> seed_hash) {
+    TraceRecorder::set_thread_name("next epoch build");
+#ifdef __linux__
+    // Nice is per thread on Linux and inherited by the dataset init workers,
+    // so the build only takes CPU time the miner threads leave over
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), EPOCH_PREPARE_NICE);
+#endif
+    auto t0 = std::chrono::steady_clock::now();
+    EpochResources next;
+    InitTiming timing;
+    bool ok;
+    {
+        InitTimingScope scope(&timing);
+        ok = build_epoch(shape, seed_hash, next);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    if (ok && publish_next_epoch_ && fast_mode_ && dataset_store_.enabled() && !dataset_store_.contains(seed_hash)) {
+        randomx_dataset* dataset = next.dataset;
+        for (randomx_dataset* node_dataset : next.node_datasets) {
+            if (!dataset) dataset = node_dataset;
+        }
+        // Kept allocated until taken or discarded, both of which cancel the write first
+        publish_store_.set_directory(dataset_store_.directory());
+        publish_store_.save_async(seed_hash, next.cache, dataset);
+    }
+
+    std::lock_guard<std::mutex> lock(prepare_mutex_);
+    if (ok) {
+        next_epoch_ = next;
+        next_epoch_timing_ = timing;
+        LOG_INFO_STREAM("Next epoch prepared in background in " << seconds << "s (seed "
+                        << utils::bytes_to_hex(seed_hash.data(), 8) << "...)");
+    } else if (!prepare_abort_.load()) {
+        LOG_WARNING("Background preparation of the next epoch failed (out of memory?)");
+    }
+}
+
+void Miner::prepare_next_seed(const std::vector<uint8_t>& next_seed_hash) {
+    if (!epoch_prefetch_ || low_memory_ || use_dataset_share() || next_seed_hash.size() != 32 || current_seed_hash_.empty() ||
+        next_seed_hash == current_seed_hash_) {
+        return;
+    }
+    for (const auto& epoch : retained_epochs_) {
+        if (epoch.seed_hash == next_seed_hash) {
+            return;  // Still resident, no build needed
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(prepare_mutex_);
+        if (next_epoch_seed_ == next_seed_hash) {
+            return;  // Already built, being built, or skipped for lack of memory
+        }
+    }
+
+    // A different next seed (e.g. after a reorg): drop whatever was prepared
+    discard_next_epoch();
+
+    EpochResources shape = capture_epoch();
+    const size_t need_mb = epoch_bytes(shape) / (1024 * 1024);
+    // Within --epoch-memory-mb if set, else leaving 1GB free; and within
+    // the memory budget either way
+    std::string why;
+    bool fits = false;
+    if (epoch_memory_mb_ > 0 && need_mb > epoch_memory_mb_) {
+        why = "needs " + std::to_string(need_mb) + " MB, over --epoch-memory-mb";
+    } else {
+        // The next epoch comes before the retained ones: evict them, oldest
+        // first, until it fits
+        while (true) {
+            track_memory();
+            fits = memory_planner_.fits(MEMORY_NEXT_EPOCH, need_mb, epoch_memory_mb_ > 0 ? 0 : EPOCH_PREPARE_HEADROOM_MB,
+                                        why);
+            if (fits || retained_epochs_.empty()) break;
+            LOG_DEBUG_STREAM("Releasing retained epoch (seed " << utils::bytes_to_hex(retained_epochs_.front().seed_hash.data(), 8)
+                             << "...) for the next epoch");
+            release_epoch(retained_epochs_.front());
+            retained_epochs_.erase(retained_epochs_.begin());
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(prepare_mutex_);
+    next_epoch_seed_ = next_seed_hash;
+    if (!fits) {
+        LOG_WARNING_STREAM("Not preparing next epoch in background: " << why);
+        return;
+    }
+    LOG_INFO_STREAM("Preparing next epoch in background (" << need_mb << " MB)");
+    prepare_thread_ = std::thread(&Miner::prepare_epoch_thread, this, shape, next_seed_hash);
+}
+
+bool Miner::take_next_epoch(const std::vector<uint8_t>& seed_hash) {
+    {
+        std::lock_guard<std::mutex> lock(prepare_mutex_);
+        if (next_epoch_seed_ != seed_hash) {
+            return false;
+        }
+    }
+
+    // Park the workers first: hashes on the old seed are worthless now, and a
+    // build still in progress then gets every core
+    stop();
+    if (prepare_thread_.joinable()) {
+        LOG_DEBUG("Waiting for background epoch build to finish");
+        prepare_thread_.join();
+    }
+    // Too late to help the rigs; the current-epoch save takes over
+    publish_store_.cancel();
+
+    EpochResources next;
+    InitTiming timing;
+    {
+        std::lock_guard<std::mutex> lock(prepare_mutex_);
+        next = next_epoch_;
+        timing = next_epoch_timing_;
+        next_epoch_ = EpochResources();
+        next_epoch_timing_ = InitTiming();
+        next_epoch_seed_.clear();
+    }
+    if (next.empty()) {
+        return false;  // Skipped or failed: caller rebuilds in line
+    }
+    if (current_init_timing) {
+        add_background_timing(*current_init_timing, timing);
+    }
+
+    EpochResources old = capture_epoch();
+    install_epoch(next);
+    retain_epoch(old);
+    return true;
+}
+
+bool Miner::take_retained_epoch(const std::vector<uint8_t>& seed_hash) {
+    for (size_t i = 0; i < retained_epochs_.size(); i++) {
+        if (retained_epochs_[i].seed_hash != seed_hash) continue;
+
+        stop();
+        EpochResources epoch = retained_epochs_[i];
+        retained_epochs_.erase(retained_epochs_.begin() + i);
+        EpochResources old = capture_epoch();
+        install_epoch(epoch);
+        retain_epoch(old);
+        return true;
+    }
+    return false;
+}
+
+void Miner::retain_epoch(EpochResources& epoch) {
+    if (epoch.empty()) {
+        return;
+    }
+    retained_epochs_.push_back(epoch);
+    epoch = EpochResources();
+
+    // Evict least recently used until back within count and budget
+    while (!retained_epochs_.empty() && !retained_within_budget()) {
+        LOG_DEBUG_STREAM("Releasing retained epoch (seed "
+                         << utils::bytes_to_hex(retained_epochs_.front().seed_hash.data(), 8) << "...)");
+        release_epoch(retained_epochs_.front());
+        retained_epochs_.erase(retained_epochs_.begin());
+    }
+}
+
+bool Miner::can_retain_epoch(const EpochResources& epoch) {
+    // Keeping the current epoch while building the new one costs a full second set
+    if (epoch_retain_mb_ == 0 || low_memory_ || use_dataset_share()) {
+        return false;
+    }
+    const size_t need_mb = epoch_bytes(epoch) / (1024 * 1024);
+    if (epoch_retain_mb_ != EPOCH_RETAIN_AUTO && need_mb > epoch_retain_mb_) {
+        return false;
+    }
+    track_memory();
+    std::string why;
+    if (!memory_planner_.fits(MEMORY_RETAINED, need_mb, EPOCH_PREPARE_HEADROOM_MB, why)) {
+        LOG_DEBUG_STREAM("Not keeping the current epoch: " << why);
+        return false;
+    }
+    return true;
+}
+
+bool Miner::retained_within_budget() const {
+    if (retained_epochs_.size() > EPOCH_RETAIN_MAX) {
+        return false;
+    }
+    // Retained epochs are the first thing over the memory budget to go
+    const MemoryBudget budget = memory_planner_.budget();
+    if (budget.mb && memory_usage().total() / (1024 * 1024) > budget.mb) {
+        return false;
+    }
+    if (epoch_retain_mb_ == EPOCH_RETAIN_AUTO) {
+        // Retained memory is already allocated, so just keep some RAM free
+        utils::SystemResources resources = utils::detect_system_resources();
+        return resources.available_ram_mb >= EPOCH_PREPARE_HEADROOM_MB;
+    }
+    size_t total_mb = 0;
+    for (const auto& epoch : retained_epochs_) {
+        total_mb += epoch_bytes(epoch) / (1024 * 1024);
+    }
+    return total_mb <= epoch_retain_mb_;
+}
+
+void Miner::release_retained_epochs() {
+    for (auto& epoch : retained_epochs_) {
+        release_epoch(epoch);
+    }
+    retained_epochs_.clear();
+}
+
+void Miner::discard_next_epoch() {
+    prepare_abort_ = true;
+    if (prepare_thread_.joinable()) {
+        prepare_thread_.join();
+    }
+    prepare_abort_ = false;
+    publish_store_.cancel();
+
+    std::lock_guard<std::mutex> lock(prepare_mutex_);
+    release_epoch(next_epoch_);
+    next_epoch_ = EpochResources();
+    next_epoch_seed_.clear();
+}
+
+Miner::WorkerEntry Miner::select_engine() const {
+    static const WorkerEntry engines[2][2][2] = {
+        {{&Miner::worker_thread<false, false, false>, &Miner::worker_thread<false, false, true>},
+         {&Miner::worker_thread<false, true, false>, &Miner::worker_thread<false, true, true>}},
+        {{&Miner::worker_thread<true, false, false>, &Miner::worker_thread<true, false, true>},
+         {&Miner::worker_thread<true, true, false>, &Miner::worker_thread<true, true, true>}},
+    };
+    return engines[fast_mode_][numa_layout()][pipelined_];
+}
+
+template<bool Fast, bool Numa, bool Pipelined>
+void Miner::worker_thread(int thread_id) {
+    // One-time setup: the thread, its pinning and its VM live as long as the pool
+    TraceRecorder::set_thread_name("worker " + std::to_string(thread_id));
+#ifdef __linux__
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        worker_os_ids_[thread_id] = (int)syscall(SYS_gettid);
+    }
+#endif
+    // Pin to the CPU chosen by the placement engine (works without libnuma)
+    if (affinity_ && thread_id < (int)thread_to_cpu_.size()) {
+        int cpu_id = thread_to_cpu_[thread_id];
+        if (set_thread_affinity(cpu_id)) {
+            LOG_DEBUG_STREAM("Thread " << thread_id << " pinned to CPU " << cpu_id
+                           << " (NUMA node " << thread_to_node_[thread_id] << ")");
+        }
+    } else if (!pin_current_thread_to_hashing_cpus()) {
+        // Unpinned, but not left on the housekeeping CPUs it was started from
+        LOG_WARNING_STREAM("Thread " << thread_id << ": failed to leave the housekeeping CPUs");
+    }
+
+#ifdef __linux__
+    // Only cycles nothing else on the host wants
+    if (sched_idle_) {
+        struct sched_param param;
+        param.sched_priority = 0;
+        if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0) {
+            LOG_WARNING_STREAM("Thread " << thread_id << ": could not switch to SCHED_IDLE");
+        }
+    }
+#endif
+
+    // Get the VM for this thread (NUMA-aware or legacy); the warm-up may swap it later
+    uint64_t vm_generation = 0;
+    randomx_vm* vm = refresh_vm<Numa>(thread_id, nullptr, vm_generation);
+    if (!vm) {
+        LOG_ERROR_STREAM("No VM available for thread " << thread_id);
+        return;
+    }
+
+    uint64_t generation = 0;
+    for (;;) {
+        {
+            // Sleep until a job newer than the last one we mined is published
+            std::unique_lock<std::mutex> lock(pool_mutex_);
+            pool_cv_.wait(lock, [&]() {
+                return pool_shutdown_ || (mining_.load() && job_generation_.load() != generation);
+            });
+            if (pool_shutdown_) {
+                return;
+            }
+            generation = job_generation_.load();
+            worker_cpus_[thread_id] = current_cpu();
+            active_workers_++;
+            jobs_[generation & 1].readers++;
+        }
+
+        mine_job<Fast, Numa, Pipelined>(thread_id, vm, vm_generation, jobs_[generation & 1], generation);
+
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            active_workers_--;
+            jobs_[generation & 1].readers--;
+        }
+        pool_cv_.notify_all();
+    }
+}
+
+template<bool Fast, bool Numa, bool Pipelined>
+void Miner::mine_job(int thread_id, randomx_vm*& vm, uint64_t& vm_generation, const MiningJob& job, uint64_t generation) {
+    // Our own reference: the template stays alive for the whole job even if
+    // the slot is reused
+    const BlockTemplatePtr template_ref = job.block_template;
+    const BlockTemplate& block_template = *template_ref;
+    TraceOpenSpan job_span("job", "job", (int64_t)block_template.height);
+
+    // Following the exact approach of the internal miner (src/miner.cpp:915-918):
+    // 1. Serialize CEquihashInput (header without nonce/solution): version(4) + prevhash(32) +
+    //    merkleroot(32) + commitments(32) + time(4) + bits(4) = 108 bytes
+    // 2. Append nNonce (32 bytes)
+    // 3. Hash the combined 140 bytes
+    //
+    // Everything lives in one stack-resident, cache-line-aligned 140-byte buffer.
+    // The nonce is updated in place at offset 108, so the hot loop never copies
+    // or allocates.
+    alignas(64) uint8_t hash_input[BLOCK_HEADER_SIZE];
+    std::memcpy(hash_input, block_template.header_base.data(), NONCE_OFFSET);
+    uint8_t* nonce = hash_input + NONCE_OFFSET;
+
+    // Initial nonce comes from the nonce allocator: a disjoint range per thread
+    // (and per rig via the instance ID), with bytes 30-31 kept clear like the
+    // node's internal miner (nonce <<= 32; nonce >>= 16)
+    nonce_allocator_.initial_nonce(thread_id, job.job_sequence, nonce);
+
+    alignas(8) uint8_t hash[32];
+
+    // Blake2b state after the header's first 128 bytes, which only nTime
+    // changes within a job: the nonce counter lies past them
+    alignas(8) uint8_t midstate[RANDOMX_MIDSTATE_SIZE];
+
+    // nTime can be rolled forward while the job runs (roll_time); it goes
+    // into the header between hashes, at the same polls as the job check
+    uint32_t header_time = block_template.time;
+    auto check_time = [&]() {
+        uint32_t time = job.time.load(std::memory_order_relaxed);
+        if (time != header_time) {
+            header_time = time;
+            utils::write_le32(hash_input + TIME_OFFSET, time);
+            randomx_calculate_midstate(hash_input, sizeof(hash_input), midstate);
+        }
+    };
+    randomx_calculate_midstate(hash_input, sizeof(hash_input), midstate);
+    check_time();
+
+    // Hashes are counted locally and published to this thread's own padded slot
+    // every HASH_COUNT_FLUSH_INTERVAL hashes. Only this thread writes the slot,
+    // so a relaxed load/store pair is enough (no locked read-modify-write).
+    std::atomic<uint64_t>& hash_counter = hash_counters_[thread_id].count;
+    std::atomic<uint64_t>& stale_counter = hash_counters_[thread_id].stale;
+    std::atomic<uint64_t>& share_counter = hash_counters_[thread_id].shares;
+    uint64_t pending_hashes = 0;
+    auto flush_hash_count = [&]() {
+        hash_counter.store(hash_counter.load(std::memory_order_relaxed) + pending_hashes,
+                           std::memory_order_relaxed);
+        if (generation <= stale_generation_.load(std::memory_order_relaxed)) {
+            stale_counter.store(stale_counter.load(std::memory_order_relaxed) + pending_hashes,
+                                std::memory_order_relaxed);
+        }
+        pending_hashes = 0;
+    };
+
+    // Keep hashing while mining and no newer job has been published
+    auto job_current = [&]() {
+        return mining_.load(std::memory_order_relaxed) &&
+               job_generation_.load(std::memory_order_relaxed) == generation;
+    };
+
+    // Switch to a VM swapped in since we last looked (end of the light-mode
+    // warm-up, which only fast mode runs)
+    randomx_phase_profile* phase_profile =
+        thread_id < (int)phase_profiles_.size() ? phase_profiles_[thread_id] : nullptr;
+    auto check_vm = [&]() {
+        if (Fast && vm_generation_.load(std::memory_order_acquire) != vm_generation) {
+            vm = refresh_vm<Numa>(thread_id, vm, vm_generation);
+            if (phase_profile) {
+                randomx_vm_set_phase_profile(vm, phase_profile);
+            }
+        }
+    };
+    if (phase_profile) {
+        randomx_vm_set_phase_profile(vm, phase_profile);
+    }
+    check_vm();
+
+    // Light-mode warm-up: after each stretch of hashing, pause for
+    // LIGHT_WARMUP_DUTY - 1 times as long (woken early by a new job, a stop or
+    // the end of the warm-up)
+    bool throttling = false;
+    std::chrono::steady_clock::time_point stretch_start;
+    auto throttle = [&]() {
+        if (!Fast || !warming_up_.load(std::memory_order_relaxed)) {
+            throttling = false;
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (throttling) {
+            std::unique_lock<std::mutex> lock(pool_mutex_);
+            pool_cv_.wait_for(lock, (now - stretch_start) * (LIGHT_WARMUP_DUTY - 1), [&]() {
+                return !job_current() || !warming_up_.load();
+            });
+            now = std::chrono::steady_clock::now();
+        }
+        throttling = true;
+        stretch_start = now;
+    };
+    throttle();
+
+    // Co-location: a worker past the limit sleeps until it rises, the job
+    // changes or mining stops (then the warm-up duty cycle starts over)
+    auto park = [&]() {
+        if ((unsigned int)thread_id < worker_limit_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        flush_hash_count();
+        std::unique_lock<std::mutex> lock(pool_mutex_);
+        pool_cv_.wait(lock, [&]() {
+            return !job_current() || (unsigned int)thread_id < worker_limit_.load();
+        });
+        throttling = false;
+    };
+    park();
+
+    // Block switch tracing: once this worker's first hashes on the job are
+    // done (the first poll of a pipelined search)
+    SwitchTrace* const trace = switch_trace_;
+    bool trace_first_hash = trace != nullptr;
+    // Likewise the first hashes after an init, for its timing
+    bool init_first_hash = first_hash_pending_.load(std::memory_order_relaxed);
+
+    // Record the winning nonce and hash (only the first thread to find one wins).
+    // The solution buffers are fixed-size members, so nothing is allocated here.
+    // Returns true if this worker should keep hashing the job.
+    auto report_solution = [&](const uint8_t* winning_nonce) {
+        if (solution_handler_ && every_solution_) {
+            // Shares: each one goes out and the job stays current
+            solution_handler_(hash_input, hash, block_template);
+            return true;
+        }
+        if (solution_handler_) {
+            // Submit from here, without parking anyone: the first finder of
+            // the job hands it over and marks the job stale, everybody keeps
+            // hashing until the next template arrives
+            uint64_t handled = handled_generation_.load();
+            while (handled < generation) {
+                if (handled_generation_.compare_exchange_weak(handled, generation)) {
+                    stale_generation_.store(generation);
+                    solution_handler_(hash_input, hash, block_template);
+                    break;
+                }
+            }
+            return true;
+        }
+
+        bool expected = false;
+        if (found_.compare_exchange_strong(expected, true)) {
+            // We're the first to find it
+            std::memcpy(solution_header_, hash_input, NONCE_OFFSET);
+            std::memcpy(solution_header_ + NONCE_OFFSET, winning_nonce, NONCE_SIZE);
+            std::memcpy(solution_hash_, hash, sizeof(solution_hash_));
+            solution_generation_ = generation;
+
+            // Signal all threads to stop
+            mining_ = false;
+        }
+        return false;
+    };
+
+    // With pseudo-shares on, search at the share target when it is the
+    // easier one: each hit is counted and only checked against the block
+    // target then (a pool's share target may already be easier)
+    const bool count_shares = share_bits_ != 0 &&
+                              utils::hash_meets_target_full(block_template.target.data(), share_limbs_);
+    const utils::TargetLimbs& search_limbs = count_shares ? share_limbs_ : block_template.target_limbs;
+    // Returns true if this worker should keep hashing the job
+    auto report_hit = [&](const uint8_t* winning_nonce) {
+        if (count_shares) {
+            share_counter.store(share_counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (!utils::hash_meets_target(hash, block_template.target_limbs)) {
+                return true;
+            }
+        }
+        return report_solution(winning_nonce);
+    };
+
+    if (Pipelined) {
+        // Pipelined loop: randomx_search_nonce_midstate() runs the
+        // hash_first/next/last pipeline inside the library, feeding nonce N+1
+        // while the hash of nonce N finishes, and does the target compare and
+        // counter increment itself. Each hash's Blake2b starts from the midstate.
+        // We get control back every JOB_POLL_INTERVAL nonces (light VMs: every
+        // nonce) to publish the hash count and check for a new job or stop. The
+        // library keeps the next nonce in flight between calls, so polling
+        // costs no pipeline slot; only a new header starts it over. On a hit
+        // the library rewrites the nonce in hash_input to the winning one.
+        const uint8_t* target = count_shares ? share_target_.data() : block_template.target.data();
+
+        while (job_current()) {
+            uint64_t done = 0;
+            const uint64_t poll_interval = (Fast && !warming_up_.load(std::memory_order_relaxed))
+                                               ? JOB_POLL_INTERVAL : LIGHT_JOB_POLL_INTERVAL;
+            int hit = randomx_search_nonce_midstate(vm, midstate, hash_input, sizeof(hash_input), NONCE_OFFSET,
+                                                    nonce, poll_interval, target, hash, &done);
+            pending_hashes += done;
+            flush_hash_count();
+            if (trace_first_hash && done) {
+                trace->first_hash(&block_template, job.published_at);
+                trace_first_hash = false;
+            }
+            if (init_first_hash && done) {
+                record_first_hash(job.published_at);
+                init_first_hash = false;
+            }
+
+            if (hit) {
+                if (!report_hit(nonce)) {
+                    break;
+                }
+                next_nonce(nonce);  // The library left the winning nonce in place
+            }
+            if (nonce_range_done(nonce)) {
+                break;
+            }
+            check_vm();
+            check_time();
+            throttle();
+            park();
+        }
+        return;
+    }
+
+    while (job_current()) {
+        // Calculate RandomX hash (matching internal miner's RandomX_Hash_Block call)
+        randomx_calculate_hash(vm, hash_input, sizeof(hash_input), hash);
+        if (trace_first_hash) {
+            trace->first_hash(&block_template, job.published_at);
+            trace_first_hash = false;
+        }
+        if (init_first_hash) {
+            record_first_hash(job.published_at);
+            init_first_hash = false;
+        }
+
+        ++pending_hashes;
 
-            // Create VMs for threads on this node
-            numa_nodes_[node].vms.resize(threads_per_node[node]);
-            for (int v = 0; v < threads_per_node[node]; v++) {
-                numa_nodes_[node].vms[v] = randomx_create_vm(vm_flags, numa_nodes_[node].cache, nullptr);
-                if (!numa_nodes_[node].vms[v]) {
-                    std::cerr << "Failed to create RandomX VM on NUMA node " << node << std::endl;
-                    LOG_ERROR_STREAM("Failed to create RandomX VM on NUMA node " << node);
-                    return false;
-                }
+        // Check if hash meets target (matching internal miner's UintToArith256(hash) <= hashTarget)
+        if (utils::hash_meets_target(hash, search_limbs)) {
+            // Found a solution (or a pseudo-share)!
+            if (!report_hit(nonce)) {
+                break;
             }
+        }
 
-            std::cout << "  Node " << node << ": cache + " << threads_per_node[node] << " VMs allocated" << std::endl;
+        // Only once the hash has been checked: check_time() rewrites nTime in
+        // hash_input, and a hit must be reported with the header it hashed
+        if (pending_hashes == HASH_COUNT_FLUSH_INTERVAL) {
+            flush_hash_count();
+            check_vm();
+            check_time();
+            throttle();
+            park();
         }
 
-        // Reset NUMA policy to default
-        numa_set_preferred(-1);
+        next_nonce(nonce);
+        if (nonce_range_done(nonce)) {
+            break;
+        }
+    }
+    flush_hash_count();
+}
 
-        std::cout << "NUMA-aware RandomX initialization complete (" << num_threads_ << " threads across "
-                  << num_numa_nodes_ << " nodes)" << std::endl;
-        return true;
+void Miner::start_pool() {
+    if (!threads_.empty()) {
+        return;
     }
-#endif
+    pool_shutdown_ = false;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        worker_os_ids_.assign(num_threads_, 0);
+        worker_cpus_.assign(num_threads_, -1);
+    }
+    WorkerEntry engine = select_engine();
+    for (unsigned int i = 0; i < num_threads_; i++) {
+        threads_.emplace_back(engine, this, (int)i);
+    }
+    LOG_DEBUG_STREAM("Started worker pool: " << num_threads_ << " threads"
+                    << (pipelined_ ? " (pipelined)" : ""));
+}
 
-    // Create VMs for each thread (non-NUMA path or fast mode)
-    legacy_vms_.resize(num_threads_);
+void Miner::set_worker_limit(unsigned int limit) {
+    {
+        // Under the pool lock, so a worker can't miss the wake-up between
+        // checking the limit and going to sleep
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        worker_limit_ = limit;
+    }
+    pool_cv_.notify_all();
+}
 
-    for (unsigned int i = 0; i < num_threads_; i++) {
-        if (fast_mode_) {
-            // Fast mode: VMs use dataset, cache can be NULL
-            legacy_vms_[i] = randomx_create_vm(vm_flags, nullptr, dataset_);
-        } else {
-            // Light mode: VMs use cache, dataset is NULL
-            legacy_vms_[i] = randomx_create_vm(vm_flags, legacy_cache_, nullptr);
+unsigned int Miner::get_worker_limit() const {
+    return std::min(worker_limit_.load(), num_threads_);
+}
+
+void Miner::shutdown_pool() {
+    stop();
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        pool_shutdown_ = true;
+    }
+    pool_cv_.notify_all();
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
         }
-        if (!legacy_vms_[i]) {
-            std::cerr << "Failed to create RandomX VM #" << i << std::endl;
-            LOG_ERROR_STREAM("Failed to create RandomX VM #" << i);
-            return false;
+    }
+    threads_.clear();
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    worker_os_ids_.clear();
+    worker_cpus_.clear();
+}
+
+void Miner::reset_hash_counters() {
+    // Only called while no worker threads are running
+    for (unsigned int i = 0; i < num_hash_counters_; i++) {
+        earlier_stale_.fetch_add(hash_counters_[i].stale.exchange(0, std::memory_order_relaxed),
+                                 std::memory_order_relaxed);
+    }
+    if (num_hash_counters_ != num_threads_) {
+        hash_counters_.reset(new ThreadHashCounter[num_threads_]);
+        num_hash_counters_ = num_threads_;
+    }
+    while (phase_profiles_.size() < num_threads_) {
+        randomx_phase_profile* profile = randomx_alloc_phase_profile();
+        if (!profile) {
+            break;
         }
+        phase_profiles_.push_back(profile);
     }
-    LOG_DEBUG_STREAM("Created " << num_threads_ << " RandomX VMs");
+    for (unsigned int i = 0; i < num_hash_counters_; i++) {
+        // Moved to earlier after clearing: a reader in between sees too few
+        // hashes for a moment, never too many
+        uint64_t count = hash_counters_[i].count.exchange(0, std::memory_order_relaxed);
+        hash_counters_[i].earlier.fetch_add(count, std::memory_order_relaxed);
+        hash_counters_[i].shares.store(0, std::memory_order_relaxed);
+    }
+}
 
-    std::cout << "RandomX initialization complete (" << num_threads_ << " threads, " << mode_str << ")" << std::endl;
-    return true;
+void Miner::set_share_bits(unsigned int zero_bits) {
+    share_bits_ = zero_bits;
+    share_target_ = utils::leading_zero_target(zero_bits);
+    share_limbs_ = utils::target_to_limbs(share_target_);
 }
 
-void Miner::worker_thread(int thread_id, const BlockTemplate& block_template) {
-    // Set CPU affinity if NUMA is available
-    if (numa_available_ && thread_id < (int)thread_to_cpu_.size()) {
-        int cpu_id = thread_to_cpu_[thread_id];
-        if (set_thread_affinity(cpu_id)) {
-            LOG_DEBUG_STREAM("Thread " << thread_id << " pinned to CPU " << cpu_id
-                           << " (NUMA node " << thread_to_node_[thread_id] << ")");
-        }
+uint64_t Miner::get_share_count() const {
+    uint64_t total = 0;
+    for (unsigned int i = 0; i < num_hash_counters_; i++) {
+        total += hash_counters_[i].shares.load(std::memory_order_relaxed);
     }
+    return total;
+}
 
-    // Get the VM for this thread (NUMA-aware or legacy)
-    randomx_vm* vm = get_vm_for_thread(thread_id);
-    if (!vm) {
-        LOG_ERROR_STREAM("No VM available for thread " << thread_id);
-        return;
+uint64_t Miner::get_stale_hash_count() const {
+    uint64_t total = earlier_stale_.load(std::memory_order_relaxed);
+    for (unsigned int i = 0; i < num_hash_counters_; i++) {
+        total += hash_counters_[i].stale.load(std::memory_order_relaxed);
     }
+    return total;
+}
 
-    // Following the exact approach of the internal miner (src/miner.cpp:915-918):
-    // 1. Serialize CEquihashInput (header without nonce/solution): version(4) + prevhash(32) +
-    //    merkleroot(32) + commitments(32) + time(4) + bits(4) = 108 bytes
-    // 2. Append nNonce (32 bytes)
-    // 3. Hash the combined 140 bytes
+std::vector<int> Miner::get_thread_numa_nodes() const {
+    return thread_to_node_;
+}
 
-    // Extract header_base (first 108 bytes = header without nonce)
-    std::vector<uint8_t> header_without_nonce(block_template.header_base.begin(),
-                                              block_template.header_base.begin() + 108);
-
-    // Initialize nonce exactly like the node's internal miner:
-    // 1. Generate random 256-bit nonce
-    // 2. Clear bottom 16 bits (bytes 0-1) and top 16 bits (bytes 30-31)
-    // This gives 224 random bits, making collisions between threads/instances
-    // astronomically unlikely (~10^-47 probability)
-    std::vector<uint8_t> nonce(32, 0);
-    std::ifstream urandom("/dev/urandom", std::ios::binary);
-    if (urandom) {
-        urandom.read(reinterpret_cast<char*>(nonce.data()), 32);
-    }
-    // Clear bottom 16 bits (bytes 0-1) and top 16 bits (bytes 30-31)
-    // matching node's: nonce <<= 32; nonce >>= 16;
-    nonce[0] = 0;
-    nonce[1] = 0;
-    nonce[30] = 0;
-    nonce[31] = 0;
-
-    // Buffer for full input: header (108 bytes) + nonce (32 bytes) = 140 bytes
-    std::vector<uint8_t> hash_input(140);
-    std::copy(header_without_nonce.begin(), header_without_nonce.end(), hash_input.begin());
-
-    uint8_t hash[32];
-
-    while (mining_.load() && !found_.load()) {
-        // Copy nonce into hash input at position 108 (matching internal miner's approach)
-        std::copy(nonce.begin(), nonce.end(), hash_input.begin() + 108);
+std::vector<CoreType> Miner::get_thread_core_types() const {
+    std::vector<CoreType> types;
+    if (!topology_.hybrid()) {
+        return types;
+    }
+    for (int cpu : thread_to_cpu_) {
+        types.push_back(topology_.core_type(cpu));
+    }
+    return types;
+}
 
-        // Calculate RandomX hash (matching internal miner's RandomX_Hash_Block call)
-        randomx_calculate_hash(vm, hash_input.data(), hash_input.size(), hash);
+uint64_t Miner::get_hash_count() const {
+    uint64_t total = 0;
+    for (unsigned int i = 0; i < num_hash_counters_; i++) {
+        total += hash_counters_[i].count.load(std::memory_order_relaxed);
+    }
+    return total;
+}
 
-        // Increment hash count
-        hash_count_.fetch_add(1);
+std::vector<int> Miner::get_thread_os_ids() const {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    return worker_os_ids_;
+}
 
-        // Check if hash meets target (matching internal miner's UintToArith256(hash) <= hashTarget)
-        if (utils::hash_meets_target(hash, block_template.target)) {
-            // Found a solution!
-            bool expected = false;
-            if (found_.compare_exchange_strong(expected, true)) {
-                // We're the first to find it
-                solution_nonce_ = nonce;
-                solution_hash_.assign(hash, hash + 32);
-
-                // Store the full 140-byte header (header_without_nonce + nonce)
-                std::vector<uint8_t> header_with_nonce(140);
-                std::copy(header_without_nonce.begin(), header_without_nonce.end(), header_with_nonce.begin());
-                std::copy(nonce.begin(), nonce.end(), header_with_nonce.begin() + 108);
-                solution_header_ = header_with_nonce;
-                solution_template_ = block_template;
-
-                // Signal all threads to stop
-                mining_ = false;
-            }
-            break;
-        }
+std::vector<int> Miner::get_thread_cpus() const {
+    if (!affinity_) {
+        return hashing_cpus().empty() ? current_thread_cpus() : hashing_cpus();
+    }
+    std::vector<int> cpus(thread_to_cpu_);
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
 
-        // Increment full 256-bit nonce by 1 (same as node's internal miner)
-        bool carry = true;
-        for (int i = 0; i < 32 && carry; i++) {
-            if (nonce[i] == 255) {
-                nonce[i] = 0;
-            } else {
-                nonce[i]++;
-                carry = false;
-            }
-        }
-        // Full 256-bit overflow is astronomically unlikely and harmless
+std::vector<HashPhaseProfile> Miner::get_thread_phase_profiles() const {
+    std::vector<HashPhaseProfile> profiles(std::min((size_t)num_hash_counters_, phase_profiles_.size()));
+    for (size_t i = 0; i < profiles.size(); i++) {
+        randomx_read_phase_profile(phase_profiles_[i], profiles[i].phases);
     }
+    return profiles;
 }
 
-void Miner::start_mining(const BlockTemplate& block_template) {
-    // Stop any existing mining
-    stop();
+std::vector<uint64_t> Miner::get_thread_hash_counts() const {
+    std::vector<uint64_t> counts(num_hash_counters_);
+    for (unsigned int i = 0; i < num_hash_counters_; i++) {
+        counts[i] = hash_counters_[i].earlier.load(std::memory_order_relaxed) +
+                    hash_counters_[i].count.load(std::memory_order_relaxed);
+    }
+    return counts;
+}
 
-    LOG_DEBUG_STREAM("Starting mining: height=" << block_template.height
-                    << " target=" << block_template.target_hex.substr(0, 16) << "...");
+void Miner::start_mining(BlockTemplatePtr block_template) {
+    // Park the workers (no thread is joined; the pool stays up)
+    stop();
+    start_pool();
+
+    LOG_DEBUG_STREAM("Starting mining: height=" << block_template->height
+                    << " target=" << block_template->target_hex.substr(0, 16) << "..."
+                    << " job=" << (nonce_allocator_.get_job_sequence() + 1));
+
+    // Fill the slot the next generation maps to. Every worker is parked, so
+    // nobody reads either slot. Workers reference the slot for the whole
+    // job, so the caller may drop its reference and the solution can be
+    // serialized from it later.
+    uint64_t generation = job_generation_.load() + 1;
+    MiningJob& job = jobs_[generation & 1];
+    job.block_template = std::move(block_template);
+    job.time.store(job.block_template->time, std::memory_order_relaxed);
+    nonce_allocator_.next_job();
+    job.job_sequence = nonce_allocator_.get_job_sequence();
 
-    mining_ = true;
     found_ = false;
-    hash_count_ = 0;
-    solution_nonce_.clear();
-    solution_hash_.clear();
-    solution_header_.clear();
-
+    reset_hash_counters();
     start_time_ = std::chrono::steady_clock::now();
+    job.published_at = start_time_;
 
-    // Start worker threads
-    threads_.clear();
-    for (unsigned int i = 0; i < num_threads_; i++) {
-        threads_.emplace_back(&Miner::worker_thread, this, i, std::cref(block_template));
+    // Publish: workers wake, pick up the new generation and start hashing
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        job_generation_.store(generation);
+        mining_ = true;
+    }
+    pool_cv_.notify_all();
+    TraceRecorder::instance().instant("switch", "start mining", (int64_t)job.job_sequence);
+}
+
+bool Miner::update_job(BlockTemplatePtr block_template) {
+    std::unique_lock<std::mutex> lock(pool_mutex_);
+    if (found_.load()) {
+        return false;  // Don't drop a solution nobody has collected yet
+    }
+    if (!mining_.load() || threads_.empty()) {
+        lock.unlock();
+        start_mining(std::move(block_template));
+        return true;
+    }
+
+    // The slot for the next generation last held the job before the current
+    // one; wait until every worker has moved off it (they re-check the
+    // generation every few hashes, so this is short)
+    uint64_t generation = job_generation_.load() + 1;
+    MiningJob& job = jobs_[generation & 1];
+    pool_cv_.wait(lock, [&job]() { return job.readers == 0; });
+    if (found_.load()) {
+        return false;
     }
-    LOG_DEBUG_STREAM("Started " << num_threads_ << " worker threads");
+
+    LOG_DEBUG_STREAM("Switching job: height=" << block_template->height
+                    << " job=" << (nonce_allocator_.get_job_sequence() + 1));
+    // Publishing is a pointer swap. The template two jobs back is released
+    // after unlocking, so freeing a large one doesn't hold up the pool.
+    BlockTemplatePtr previous = std::move(job.block_template);
+    job.block_template = std::move(block_template);
+    job.time.store(job.block_template->time, std::memory_order_relaxed);
+    nonce_allocator_.next_job();
+    job.job_sequence = nonce_allocator_.get_job_sequence();
+
+    // Hashes still finishing on the old job from here on are stale. Workers
+    // drop it at their next poll and pick the new generation without sleeping.
+    job.published_at = std::chrono::steady_clock::now();
+    stale_generation_.store(generation - 1);
+    job_generation_.store(generation);
+    lock.unlock();
+    pool_cv_.notify_all();
+    TraceRecorder::instance().instant("switch", "update job", (int64_t)job.job_sequence);
+    return true;
 }
 
-bool Miner::get_solution(std::vector<uint8_t>& solution_header, std::vector<uint8_t>& solution_hash, BlockTemplate& template_out) {
+bool Miner::get_solution(std::vector<uint8_t>& solution_header, std::vector<uint8_t>& solution_hash, BlockTemplatePtr& template_out) {
     // Wait for threads to finish if still mining
     if (mining_.load()) {
         stop();
     }
 
-    if (found_.load() && !solution_header_.empty()) {
-        solution_header = solution_header_;
-        solution_hash = solution_hash_;
-        template_out = solution_template_;
+    if (found_.load()) {
+        solution_header.assign(solution_header_, solution_header_ + BLOCK_HEADER_SIZE);
+        solution_hash.assign(solution_hash_, solution_hash_ + sizeof(solution_hash_));
+        template_out = jobs_[solution_generation_ & 1].block_template;
         return true;
     }
 
@@ -460,26 +2448,68 @@ bool Miner::get_solution(std::vector<uint8_t>& solution_header, std::vector<uint
 }
 
 void Miner::stop() {
-    // Signal threads to stop
+    TraceScope span("switch", "stop workers");
+    // Signal threads to stop, then wait until every worker is parked again
+    std::unique_lock<std::mutex> lock(pool_mutex_);
     mining_ = false;
-
-    // Wait for all threads to finish with timeout
-    for (auto& thread : threads_) {
-        if (thread.joinable()) {
-            thread.join();
-        }
-    }
-    threads_.clear();
+    pool_cv_.notify_all();  // Wakes workers pausing in the warm-up throttle
+    pool_cv_.wait(lock, [this]() { return active_workers_ == 0; });
 }
 
 double Miner::get_hashrate() const {
     auto now = std::chrono::steady_clock::now();
     auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - start_time_).count();
     if (elapsed == 0) return 0.0;
-    return static_cast<double>(hash_count_.load()) / elapsed;
+    return static_cast<double>(get_hash_count()) / elapsed;
+}
+
+void Miner::roll_time(uint32_t header_time) {
+    // Only the main loop publishes jobs, so the current slot can't change
+    // under us; workers read the new time at their next poll
+    jobs_[job_generation_.load() & 1].time.store(header_time, std::memory_order_relaxed);
+}
+
+double Miner::get_effective_hashrate() const {
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - start_time_).count();
+    if (elapsed == 0 || share_bits_ == 0) return 0.0;
+    return std::ldexp(static_cast<double>(get_share_count()), (int)share_bits_) / elapsed;
 }
 
 bool Miner::update_seed(const std::vector<uint8_t>& new_seed_hash) {
+    TraceScope span("init", "update_seed");
+    const bool changed = new_seed_hash != current_seed_hash_;
+    InitTiming timing;
+    timing.trigger = "epoch change";
+    auto started = std::chrono::steady_clock::now();
+    bool ok;
+    {
+        InitTimingScope scope(&timing);
+        if (changed) {
+            // A warm-up build has to finish before its epoch is replaced, and the
+            // store may still be writing the current epoch. An abandoned
+            // startup epoch is neither finished nor kept.
+            bool abandoned = init_abort_.exchange(false);
+            finish_warmup(abandoned);
+            dataset_store_.cancel();
+            if (abandoned) {
+                current_seed_hash_.clear();
+            }
+        }
+        ok = switch_seed(new_seed_hash);
+    }
+    if (ok && changed) {
+        publish_init_timing(timing, started);
+    }
+    if (ok && !warmup_thread_.joinable()) {
+        store_epoch();  // A warm-up stores the epoch itself once built
+        release_idle_cache();
+    }
+    track_memory();
+    return ok;
+}
+
+bool Miner::switch_seed(const std::vector<uint8_t>& new_seed_hash) {
     LOG_DEBUG_STREAM("Updating RandomX seed: " << utils::bytes_to_hex(new_seed_hash.data(), 32));
 
     if (new_seed_hash.size() != 32) {
@@ -494,42 +2524,105 @@ bool Miner::update_seed(const std::vector<uint8_t>& new_seed_hash) {
         return true; // Nothing to do
     }
 
-    // Stop mining if active
-    bool was_mining = mining_.load();
-    if (was_mining) {
-        LOG_DEBUG("Stopping mining for seed update");
-        stop();
+    // Prepared in the background: swap it in, no rebuild and no VM churn
+    if (take_next_epoch(new_seed_hash)) {
+        LOG_INFO("Switched to the background-prepared epoch");
+        std::cout << "Switched to pre-built RandomX epoch" << std::endl;
+        return true;
     }
 
-    randomx_flags flags = randomx_get_flags();
-    flags |= RANDOMX_FLAG_JIT;
+    // Still resident from before (a reorg flipped back across the boundary)
+    if (take_retained_epoch(new_seed_hash)) {
+        LOG_INFO("Switched back to a retained epoch");
+        std::cout << "Switched back to resident RandomX epoch" << std::endl;
+        return true;
+    }
 
-    randomx_flags vm_flags = flags;
-    if (fast_mode_) {
-        vm_flags |= RANDOMX_FLAG_FULL_MEM;
+    // If memory allows, build into fresh memory and keep the current epoch
+    // resident, so flipping back later is instant
+    EpochResources current = capture_epoch();
+    if (!current.empty() && !current.seed_hash.empty() && can_retain_epoch(current)) {
+        LOG_DEBUG("Building new epoch alongside the current one");
+        std::cout << "Building RandomX epoch for new seed..." << std::endl;
+        stop();
+        EpochResources next;
+        if (build_epoch(current, new_seed_hash, next)) {
+            install_epoch(next);
+            retain_epoch(current);
+            std::cout << "Epoch build complete" << std::endl;
+            return true;
+        }
+        LOG_WARNING("Building new epoch alongside the current one failed, rebuilding in place");
+    }
+
+    // Rebuild in place. Workers only need to be parked: every VM is kept and
+    // rebound to the rebuilt cache or dataset, so no scratchpad or JIT buffer
+    // is reallocated
+    LOG_DEBUG("Stopping mining for seed update");
+    stop();
+    if (use_dataset_share()) {
+        // Leave the old epoch's segment (its last user frees it) and join the new one
+        if (attach_shared_dataset(new_seed_hash)) {
+            return true;
+        }
+        std::cout << "Shared dataset unavailable, building a private one" << std::endl;
+        LOG_WARNING("Shared dataset unavailable, building a private one");
+        dataset_share_.set_enabled(false);
+        randomx_flags flags = randomx_get_flags();
+        flags |= RANDOMX_FLAG_JIT;
+        dataset_ = alloc_dataset(flags);
+        if (!dataset_) {
+            // The VMs go with the rest; start_mining brings the pool back up
+            shutdown_pool();
+            current_seed_hash_ = new_seed_hash;
+            return step_down(new_seed_hash, "a private RandomX dataset (~2GB)");
+        }
+    }
+    if (!ensure_cache()) {
+        return false;
     }
 
 #ifdef HAVE_NUMA
+    if (numa_available_ && fast_mode_ && numa_replicas_ && legacy_cache_) {
+        // Fast mode with per-node replicas: rebuild every replica from the shared cache
+        LOG_DEBUG("Reinitializing NUMA dataset replicas with new seed");
+        current_seed_hash_ = new_seed_hash;
+        if (use_warmup(new_seed_hash)) {
+            // VMs keep pointing at their replicas; light VMs mine until rebuilt
+            init_cache(legacy_cache_, new_seed_hash);
+            start_warmup();
+            return true;
+        }
+        std::cout << "Reinitializing dataset replicas for new epoch..." << std::endl;
+
+        fill_epoch(capture_epoch());
+        for (auto& node : numa_nodes_) {
+            if (!node.dataset) continue;
+
+            for (auto vm : node.vms) {
+                if (vm) {
+                    randomx_vm_set_dataset(vm, node.dataset);
+                }
+            }
+        }
+        std::cout << "Dataset reinitialization complete" << std::endl;
+        return true;
+    }
+
     if (numa_available_ && !fast_mode_) {
-        // NUMA path only for light mode
+        // NUMA path for light mode
         LOG_DEBUG("Reinitializing NUMA-aware RandomX caches with new seed");
         current_seed_hash_ = new_seed_hash;
 
+        // One Argon2 pass into the shared cache, copied to every node
+        fill_epoch(capture_epoch());
         for (auto& node : numa_nodes_) {
             if (!node.cache) continue;
 
-            // Reinitialize cache
-            randomx_init_cache(node.cache, new_seed_hash.data(), new_seed_hash.size());
-
-            // Recreate VMs
-            for (size_t i = 0; i < node.vms.size(); i++) {
-                if (node.vms[i]) {
-                    randomx_destroy_vm(node.vms[i]);
-                }
-                node.vms[i] = randomx_create_vm(vm_flags, node.cache, nullptr);
-                if (!node.vms[i]) {
-                    std::cerr << "Failed to recreate RandomX VM on NUMA node " << node.node_id << std::endl;
-                    return false;
+            // Rebind (and re-JIT) the node's VMs
+            for (auto vm : node.vms) {
+                if (vm) {
+                    randomx_vm_set_cache(vm, node.cache);
                 }
             }
         }
@@ -540,37 +2633,21 @@ bool Miner::update_seed(const std::vector<uint8_t>& new_seed_hash) {
     // Legacy/fast mode path
     if (legacy_cache_) {
         LOG_DEBUG("Reinitializing RandomX cache with new seed");
-        randomx_init_cache(legacy_cache_, new_seed_hash.data(), new_seed_hash.size());
         current_seed_hash_ = new_seed_hash;
 
-        // In fast mode, reinitialize the dataset from the updated cache
+        if (fast_mode_ && dataset_ && use_warmup(new_seed_hash)) {
+            // Mine with light VMs on the new cache while the dataset is rebuilt in place
+            init_cache(legacy_cache_, new_seed_hash);
+            start_warmup();
+            return true;
+        }
+
+        // In fast mode, reinitialize the cache and dataset together
         if (fast_mode_ && dataset_) {
             LOG_DEBUG("Reinitializing RandomX dataset with new seed");
             std::cout << "Reinitializing dataset for new epoch..." << std::endl;
 
-            unsigned long item_count = randomx_dataset_item_count();
-            unsigned int init_threads = std::min(num_threads_, (unsigned int)std::thread::hardware_concurrency());
-            if (init_threads == 0) init_threads = 1;
-
-            // Parallel dataset reinitialization
-            std::vector<std::thread> init_threads_vec;
-            unsigned long items_per_thread = item_count / init_threads;
-            unsigned long remainder = item_count % init_threads;
-
-            for (unsigned int t = 0; t < init_threads; t++) {
-                unsigned long start = t * items_per_thread;
-                unsigned long count = items_per_thread;
-                if (t == init_threads - 1) {
-                    count += remainder;
-                }
-                init_threads_vec.emplace_back([this, start, count]() {
-                    randomx_init_dataset(dataset_, legacy_cache_, start, count);
-                });
-            }
-
-            for (auto& t : init_threads_vec) {
-                t.join();
-            }
+            fill_epoch(capture_epoch());
             LOG_DEBUG("RandomX dataset reinitialized");
             std::cout << "Dataset reinitialization complete" << std::endl;
 
@@ -581,16 +2658,12 @@ bool Miner::update_seed(const std::vector<uint8_t>& new_seed_hash) {
                 }
             }
         } else {
-            // Light mode: recreate VMs with new cache
-            LOG_DEBUG_STREAM("Recreating " << legacy_vms_.size() << " RandomX VMs");
-            for (size_t i = 0; i < legacy_vms_.size(); i++) {
-                if (legacy_vms_[i]) {
-                    randomx_destroy_vm(legacy_vms_[i]);
-                }
-                legacy_vms_[i] = randomx_create_vm(vm_flags, legacy_cache_, nullptr);
-                if (!legacy_vms_[i]) {
-                    std::cerr << "Failed to recreate RandomX VM #" << i << std::endl;
-                    return false;
+            // Light mode: rebind the VMs to the reinitialized cache (and partial dataset)
+            fill_epoch(capture_epoch());
+            LOG_DEBUG_STREAM("Rebinding " << legacy_vms_.size() << " RandomX VMs");
+            for (auto vm : legacy_vms_) {
+                if (vm) {
+                    randomx_vm_set_cache(vm, legacy_cache_);
                 }
             }
         }
@@ -610,34 +2683,134 @@ bool Miner::set_thread_count(unsigned int new_thread_count) {
     if (new_thread_count == num_threads_) {
         return true; // Nothing to change
     }
+    return relayout(new_thread_count, cpu_override_);
+}
 
-    // Stop mining if active
-    bool was_mining = mining_.load();
-    if (was_mining) {
-        stop();
+bool Miner::set_cpus(const std::vector<int>& cpus) {
+    if (cpus == cpu_override_) {
+        return true;
+    }
+    return relayout(num_threads_, cpus);
+}
+
+bool Miner::relayout(unsigned int new_thread_count, const std::vector<int>& cpus) {
+    // Stop mining and retire the worker pool (it is respawned with the new
+    // size and pinning); a warm-up in flight has to finish first, its
+    // dataset is kept
+    finish_warmup(false);
+    shutdown_pool();
+
+    unsigned int old_thread_count = num_threads_;
+    std::vector<bool> old_nodes = active_numa_nodes();
+    num_threads_ = new_thread_count;
+    cpu_override_ = cpus;
+    reset_hash_counters();
+
+    // Redistribute threads across L3 domains and NUMA nodes
+    assign_threads_to_cpus();
+
+    if (current_seed_hash_.empty()) {
+        return true;  // Not initialized yet
+    }
+
+    // Same NUMA nodes in use: cache, dataset and the epochs prepared or
+    // retained for them all still fit, only the VMs change
+    if (active_numa_nodes() == old_nodes && resize_vms()) {
+        vm_pool_.trim(num_threads_);
+        if (old_thread_count != num_threads_) {
+            LOG_INFO_STREAM("Thread count " << old_thread_count << " -> " << num_threads_
+                            << ", cache and dataset kept");
+        } else {
+            LOG_INFO("Threads moved to other CPUs, cache and dataset kept");
+        }
+        return true;
     }
 
+    // A node gained its first or lost its last thread: rebuild everything for
+    // the new layout. Prepared and retained epochs have the old shape.
+    LOG_INFO("NUMA node usage changed, reinitializing RandomX for the new thread layout");
+    dataset_store_.cancel();
+    discard_next_epoch();
+    release_retained_epochs();
+
     // Save current seed hash for re-initialization
     std::vector<uint8_t> saved_seed = current_seed_hash_;
 
-    // Clean up all existing resources
+    release_resources();
+
+    // Re-initialize with the saved seed; the VMs released above are reused
+    bool ok = initialize(saved_seed);
+    vm_pool_.trim(num_threads_);
+    return ok;
+}
+
+bool Miner::set_mode(bool fast, size_t medium_mb) {
+    unsigned long old_items = partial_items_;
+    set_partial_dataset_mb(fast ? 0 : medium_mb);
+    if (fast == fast_mode_ && partial_items_ == old_items) {
+        return true;
+    }
+    const char* old_mode = fast_mode_ ? "fast" : old_items ? "medium" : "light";
+
+    // Everything built has the old mode's shape: a warm-up's dataset, the
+    // prepared and retained epochs and a pending disk write go with it
+    finish_warmup(true);
+    shutdown_pool();
+    dataset_store_.cancel();
+    discard_next_epoch();
+    release_retained_epochs();
+    std::vector<uint8_t> saved_seed = current_seed_hash_;
+    release_resources();
+    // The other mode's VMs are of another kind, and memory is what a switch
+    // is usually made for
+    vm_pool_.clear();
+    dataset_share_.detach();  // Unmapped here; the segment lives on while other processes use it
+    fast_mode_ = fast;
+    LOG_DEBUG_STREAM("Switching from " << old_mode << " to " << (fast ? "fast" : is_medium_mode() ? "medium" : "light")
+                     << " mode");
+
+    if (saved_seed.empty()) {
+        return true;  // Not initialized yet
+    }
+    // Back to fast mode, the light-mode warm-up mines while the dataset builds
+    InitTiming timing;
+    timing.trigger = "mode switch";
+    auto started = std::chrono::steady_clock::now();
+    bool ok;
+    {
+        InitTimingScope scope(&timing);
+        ok = initialize_epoch(saved_seed);
+    }
+    if (ok) {
+        publish_init_timing(timing, started);
+    }
+    return ok;
+}
+
+void Miner::release_resources() {
+    // Only with the pool shut down: every VM, cache and dataset of the
+    // current epoch, for initialize to build afresh
 #ifdef HAVE_NUMA
     if (numa_available_) {
         for (auto& node : numa_nodes_) {
             for (auto vm : node.vms) {
-                if (vm) randomx_destroy_vm(vm);
+                if (vm) vm_pool_.release(vm);
             }
             node.vms.clear();
             if (node.cache) {
                 randomx_release_cache(node.cache);
                 node.cache = nullptr;
             }
+            if (node.dataset) {
+                randomx_release_dataset(node.dataset);
+                node.dataset = nullptr;
+            }
         }
     }
 #endif
 
     for (auto vm : legacy_vms_) {
-        if (vm) randomx_destroy_vm(vm);
+        if (vm) vm_pool_.release(vm);
     }
     legacy_vms_.clear();
 
@@ -646,38 +2819,80 @@ bool Miner::set_thread_count(unsigned int new_thread_count) {
         legacy_cache_ = nullptr;
     }
 
-    // Clean up dataset (fast mode) - will be recreated by initialize()
     if (dataset_) {
         randomx_release_dataset(dataset_);
         dataset_ = nullptr;
     }
+    if (partial_dataset_) {
+        randomx_release_dataset(partial_dataset_);
+        partial_dataset_ = nullptr;
+    }
+}
 
-    // Update thread count and re-detect NUMA topology for new distribution
-    num_threads_ = new_thread_count;
+std::vector<bool> Miner::active_numa_nodes() const {
+    std::vector<bool> nodes;
+    if (!numa_available_) {
+        return nodes;
+    }
+    nodes.assign(num_numa_nodes_, false);
+    for (unsigned int t = 0; t < num_threads_ && t < thread_to_node_.size(); t++) {
+        nodes[thread_to_node_[t]] = true;
+    }
+    return nodes;
+}
 
-#ifdef HAVE_NUMA
-    if (numa_available_) {
-        // Redistribute threads across NUMA nodes
-        thread_to_cpu_.resize(num_threads_);
-        thread_to_node_.resize(num_threads_);
+bool Miner::resize_vms() {
+    // Only called with the pool shut down. New VMs attach to the memory the
+    // existing ones use; surplus VMs are destroyed.
+    randomx_flags vm_flags = randomx_get_flags();
+    vm_flags |= RANDOMX_FLAG_JIT;
+    if (fast_mode_) {
+        vm_flags |= RANDOMX_FLAG_FULL_MEM;
+    }
 
-        std::vector<size_t> node_thread_count(num_numa_nodes_, 0);
+#ifdef HAVE_NUMA
+    if (numa_available_ && legacy_vms_.empty()) {
+        // NUMA-aware layout: one VM per thread on that thread's node
+        std::vector<size_t> threads_per_node(num_numa_nodes_, 0);
         for (unsigned int t = 0; t < num_threads_; t++) {
-            int node = t % num_numa_nodes_;
-            size_t cpu_index = node_thread_count[node] % numa_nodes_[node].cpu_ids.size();
-            thread_to_node_[t] = node;
-            thread_to_cpu_[t] = numa_nodes_[node].cpu_ids[cpu_index];
-            node_thread_count[node]++;
+            threads_per_node[thread_to_node_[t]]++;
+        }
+        bool ok = true;
+        for (int n = 0; ok && n < num_numa_nodes_; n++) {
+            NumaNodeResources& node = numa_nodes_[n];
+            while (node.vms.size() > threads_per_node[n]) {
+                if (node.vms.back()) vm_pool_.release(node.vms.back());
+                node.vms.pop_back();
+            }
+            if (node.vms.size() < threads_per_node[n]) {
+                numa_set_preferred(n);  // Scratchpads on the node
+            }
+            while (ok && node.vms.size() < threads_per_node[n]) {
+                randomx_vm* vm = create_vm(vm_flags, node.cache, fast_mode_ ? node.dataset : partial_dataset_, n);
+                ok = vm != nullptr;
+                if (ok) node.vms.push_back(vm);
+            }
         }
+        numa_set_preferred(-1);
+        return ok;
     }
 #endif
 
-    // Re-initialize with the saved seed
-    if (!saved_seed.empty()) {
-        return initialize(saved_seed);
+    while (legacy_vms_.size() > num_threads_) {
+        if (legacy_vms_.back()) vm_pool_.release(legacy_vms_.back());
+        legacy_vms_.pop_back();
     }
-
-    return true;
+    bool ok = true;
+    while (ok && legacy_vms_.size() < num_threads_) {
+        prefer_thread_node((int)legacy_vms_.size());
+        int node = thread_node((int)legacy_vms_.size());
+        randomx_vm* vm = fast_mode_ ? create_vm(vm_flags, nullptr, dataset_, node)
+                                    : create_vm(vm_flags, legacy_cache_, partial_dataset_, node);
+        ok = vm != nullptr;
+        if (ok) legacy_vms_.push_back(vm);
+    }
+    prefer_thread_node(-1);
+    return ok;
 }
 
 // Rewritten from scratch to exactly match the internal miner's approach:
@@ -702,6 +2917,16 @@ bool Miner::set_thread_count(unsigned int new_thread_count) {
 //   - blockcommitmentshash: DISPLAY order (GetHex()) - must REVERSE
 //   - randomxseedhash: INTERNAL order (HexStr(begin, end)) - use AS-IS
 
+// The string inside a Json::Value without copying it (empty if it isn't one)
+static std::string_view json_string_view(const Json::Value& value) {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    if (!value.isString() || !value.getString(&begin, &end)) {
+        return std::string_view();
+    }
+    return std::string_view(begin, static_cast<size_t>(end - begin));
+}
+
 BlockTemplate parse_block_template(const Json::Value& template_data) {
     BlockTemplate bt;
 
@@ -720,6 +2945,8 @@ BlockTemplate parse_block_template(const Json::Value& template_data) {
         throw std::runtime_error("Missing curtime in block template");
     }
     bt.time = template_data["curtime"].asUInt();
+    bt.min_time = template_data.get("mintime", 0).asUInt();
+    bt.max_time = template_data.get("maxtime", 0).asUInt();
 
     if (!template_data.isMember("bits")) {
         throw std::runtime_error("Missing bits in block template");
@@ -755,11 +2982,12 @@ BlockTemplate parse_block_template(const Json::Value& template_data) {
         }
     }
 
-    // Parse target
-    bt.target = utils::compact_to_target(bt.bits);
     if (template_data.isMember("target")) {
         bt.target_hex = template_data["target"].asString();
     }
+    if (template_data.isMember("longpollid")) {
+        bt.longpollid = template_data["longpollid"].asString();
+    }
 
     // Parse merkle root from defaultroots
     if (template_data.isMember("defaultroots") &&
@@ -768,9 +2996,6 @@ BlockTemplate parse_block_template(const Json::Value& template_data) {
     } else {
         throw std::runtime_error("Missing defaultroots.merkleroot in block template");
     }
-    if (bt.merkle_root.length() != 64) {
-        throw std::runtime_error("Invalid merkleroot length");
-    }
 
     // Parse block commitments hash from defaultroots
     if (template_data.isMember("defaultroots") &&
@@ -781,27 +3006,52 @@ BlockTemplate parse_block_template(const Json::Value& template_data) {
     } else {
         throw std::runtime_error("Missing blockcommitmentshash in block template");
     }
-    if (bt.block_commitments_hash.length() != 64) {
-        throw std::runtime_error("Invalid blockcommitmentshash length");
+
+    // A template from block_template_to_json carries its body ready-made
+    if (template_data.isMember("blockbodyhex")) {
+        bt.block_body_hex = template_data["blockbodyhex"].asString();
+        complete_block_template(bt);
+        return bt;
     }
 
     // Parse coinbase transaction
+    std::string_view coinbase_hex;
     if (template_data.isMember("coinbasetxn") &&
         template_data["coinbasetxn"].isMember("data")) {
-        bt.coinbase_txn_hex = template_data["coinbasetxn"]["data"].asString();
+        coinbase_hex = json_string_view(template_data["coinbasetxn"]["data"]);
     } else {
         throw std::runtime_error("Missing coinbasetxn.data in block template");
     }
 
-    // Parse other transactions
+    // Parse other transactions (views into template_data, nothing is copied)
+    std::vector<std::string_view> txn_hex;
     if (template_data.isMember("transactions") && template_data["transactions"].isArray()) {
         const Json::Value& txns = template_data["transactions"];
+        txn_hex.reserve(txns.size());
         for (Json::ArrayIndex i = 0; i < txns.size(); i++) {
             if (txns[i].isMember("data")) {
-                bt.txn_hex.push_back(txns[i]["data"].asString());
+                txn_hex.push_back(json_string_view(txns[i]["data"]));
             }
         }
     }
+    // All transactions go into one buffer, serialized now, so a solution only
+    // has to prepend its header
+    bt.block_body_hex = utils::serialize_block_body(coinbase_hex, txn_hex);
+
+    complete_block_template(bt);
+    return bt;
+}
+
+void complete_block_template(BlockTemplate& bt) {
+    if (bt.merkle_root.length() != 64) {
+        throw std::runtime_error("Invalid merkleroot length");
+    }
+    if (bt.block_commitments_hash.length() != 64) {
+        throw std::runtime_error("Invalid blockcommitmentshash length");
+    }
+
+    bt.target = utils::compact_to_target(bt.bits);
+    bt.target_limbs = utils::target_to_limbs(bt.target);
 
     // Build the 140-byte block header exactly as CEquihashInput does when serialized
     // This MUST match the daemon's CBlockHeader serialization format EXACTLY.
@@ -821,39 +3071,35 @@ BlockTemplate parse_block_template(const Json::Value& template_data) {
     bt.header_base.resize(140);
     size_t offset = 0;
 
+    // Decode a 32-byte hash straight into the header, then flip it from
+    // DISPLAY to internal order
+    auto put_reversed_hash = [&](const std::string& hex, const char* error) {
+        uint8_t* out = &bt.header_base[offset];
+        if (hex.size() != 64) {
+            throw std::runtime_error(error);
+        }
+        if (!utils::hex_decode(hex.data(), 32, out)) {
+            throw std::invalid_argument("invalid hex string");
+        }
+        std::reverse(out, out + 32);
+        offset += 32;
+    };
+
     // nVersion (4 bytes, little-endian)
     utils::write_le32(&bt.header_base[offset], bt.version);
     offset += 4;
 
     // hashPrevBlock (32 bytes, internal order)
     // getblocktemplate returns this in DISPLAY order, so REVERSE it
-    std::vector<uint8_t> prev_hash_bytes = utils::hex_to_bytes(bt.previous_block_hash);
-    if (prev_hash_bytes.size() != 32) {
-        throw std::runtime_error("Invalid previousblockhash size");
-    }
-    std::reverse(prev_hash_bytes.begin(), prev_hash_bytes.end());
-    std::copy(prev_hash_bytes.begin(), prev_hash_bytes.end(), bt.header_base.begin() + offset);
-    offset += 32;
+    put_reversed_hash(bt.previous_block_hash, "Invalid previousblockhash size");
 
     // hashMerkleRoot (32 bytes, internal order)
     // getblocktemplate returns this in DISPLAY order, so REVERSE it
-    std::vector<uint8_t> merkle_bytes = utils::hex_to_bytes(bt.merkle_root);
-    if (merkle_bytes.size() != 32) {
-        throw std::runtime_error("Invalid merkleroot size");
-    }
-    std::reverse(merkle_bytes.begin(), merkle_bytes.end());
-    std::copy(merkle_bytes.begin(), merkle_bytes.end(), bt.header_base.begin() + offset);
-    offset += 32;
+    put_reversed_hash(bt.merkle_root, "Invalid merkleroot size");
 
     // hashBlockCommitments (32 bytes, internal order)
     // getblocktemplate returns this in DISPLAY order, so REVERSE it
-    std::vector<uint8_t> commitments_bytes = utils::hex_to_bytes(bt.block_commitments_hash);
-    if (commitments_bytes.size() != 32) {
-        throw std::runtime_error("Invalid blockcommitmentshash size");
-    }
-    std::reverse(commitments_bytes.begin(), commitments_bytes.end());
-    std::copy(commitments_bytes.begin(), commitments_bytes.end(), bt.header_base.begin() + offset);
-    offset += 32;
+    put_reversed_hash(bt.block_commitments_hash, "Invalid blockcommitmentshash size");
 
     // nTime (4 bytes, little-endian)
     utils::write_le32(&bt.header_base[offset], bt.time);
@@ -871,6 +3117,39 @@ BlockTemplate parse_block_template(const Json::Value& template_data) {
     // nNonce (32 bytes) will be filled by miner threads at offset 108-139
     // For now, zero it out
     std::fill(bt.header_base.begin() + offset, bt.header_base.end(), 0);
+}
 
-    return bt;
+uint32_t rolled_header_time(const BlockTemplate& bt, uint64_t now) {
+    uint64_t latest = bt.max_time ? bt.max_time
+                    : bt.min_time ? (uint64_t)bt.min_time - 1 + MAX_FUTURE_BLOCK_TIME_MTP
+                    : (uint64_t)bt.time + NTIME_ROLL_MAX_SECONDS;
+    return (uint32_t)std::max<uint64_t>(bt.time, std::min(now, latest));
+}
+
+Json::Value block_template_to_json(const BlockTemplate& bt) {
+    Json::Value template_data;
+    template_data["version"] = bt.version;
+    template_data["previousblockhash"] = bt.previous_block_hash;
+    template_data["curtime"] = bt.time;
+    if (bt.min_time) {
+        template_data["mintime"] = bt.min_time;
+    }
+    if (bt.max_time) {
+        template_data["maxtime"] = bt.max_time;
+    }
+    std::ostringstream bits;
+    bits << std::hex << std::setw(8) << std::setfill('0') << bt.bits;
+    template_data["bits"] = bits.str();
+    template_data["height"] = bt.height;
+    template_data["randomxseedheight"] = static_cast<Json::UInt64>(bt.seed_height);
+    template_data["randomxseedhash"] = utils::bytes_to_hex(bt.seed_hash.data(), bt.seed_hash.size());
+    if (!bt.next_seed_hash.empty()) {
+        template_data["randomxnextseedhash"] = utils::bytes_to_hex(bt.next_seed_hash.data(), bt.next_seed_hash.size());
+    }
+    template_data["target"] = bt.target_hex;
+    template_data["longpollid"] = bt.longpollid;
+    template_data["defaultroots"]["merkleroot"] = bt.merkle_root;
+    template_data["defaultroots"]["blockcommitmentshash"] = bt.block_commitments_hash;
+    template_data["blockbodyhex"] = bt.block_body_hex;
+    return template_data;
 }
@@ -6,11 +6,23 @@
 #include <atomic>
 #include <thread>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
 #include <cstdint>
 #include <json/json.h>
 #include "randomx.h"
+#include "utils.h"
+#include "nonce_allocator.h"
+#include "cpu_topology.h"
+#include "dataset_store.h"
+#include "dataset_share.h"
+#include "gpu_dataset.h"
+#include "mining_backend.h"
+#include "vm_pool.h"
 
-#ifdef HAVE_NUMA
+#if defined(HAVE_NUMA) && defined(_WIN32)
+#include "numa_windows.h"
+#elif defined(HAVE_NUMA)
 #include <numa.h>
 #include <sched.h>
 #endif
@@ -31,97 +43,487 @@ inline uint64_t RandomX_SeedHeight(uint64_t height) {
     return (height - RANDOMX_SEEDHASH_EPOCH_LAG - 1) & ~(RANDOMX_SEEDHASH_EPOCH_BLOCKS - 1);
 }
 
-struct BlockTemplate {
-    uint32_t version;
-    std::string previous_block_hash;
-    std::string merkle_root;
-    std::string block_commitments_hash;
-    uint32_t time;
-    uint32_t bits;
-    std::vector<uint8_t> target;      // 256-bit target (converted from bits)
-    std::string target_hex;           // Hex string for display only
-    uint32_t height;
-    uint64_t seed_height;             // Height of seed block (NEW: from randomxseedheight)
-    std::vector<uint8_t> seed_hash;   // RandomX seed hash (32 bytes, from randomxseedhash)
-    std::vector<uint8_t> next_seed_hash; // Next epoch's seed (32 bytes, from randomxnextseedhash, optional)
-    std::vector<uint8_t> header_base; // Header without nonce
-    std::string coinbase_txn_hex;     // Coinbase transaction (hex)
-    std::vector<std::string> txn_hex; // Other transactions (hex)
-};
-
 // NUMA node resources - each node gets its own cache and VMs for local memory access
 struct NumaNodeResources {
     int node_id;
-    randomx_cache* cache;
+    randomx_cache* cache;       // Light mode: node-local cache
+    randomx_dataset* dataset;   // Fast mode: node-local dataset replica
     std::vector<randomx_vm*> vms;
     std::vector<int> cpu_ids;  // CPUs belonging to this node
 
-    NumaNodeResources() : node_id(-1), cache(nullptr) {}
+    NumaNodeResources() : node_id(-1), cache(nullptr), dataset(nullptr) {}
+};
+
+// One epoch's seed-dependent memory, in the same shape as the live resources:
+// the shared cache (dataset builder / light-mode cache), an optional shared
+// dataset or medium-mode partial dataset, and per-NUMA-node caches or dataset replicas
+struct EpochResources {
+    std::vector<uint8_t> seed_hash;
+    randomx_cache* cache;
+    randomx_dataset* dataset;
+    randomx_dataset* partial_dataset;             // Medium mode: leading items, built from cache
+    std::vector<randomx_cache*> node_caches;      // Indexed like Miner::numa_nodes_
+    std::vector<randomx_dataset*> node_datasets;
+
+    EpochResources() : cache(nullptr), dataset(nullptr), partial_dataset(nullptr) {}
+    bool empty() const { return cache == nullptr; }
+};
+
+// Nice value of the background next-epoch build (and its init workers)
+static const int EPOCH_PREPARE_NICE = 10;
+// RAM that must stay free after a background epoch build when no budget is set
+static const size_t EPOCH_PREPARE_HEADROOM_MB = 1024;
+
+// Previous epochs kept resident for reorgs across the seed boundary
+static const size_t EPOCH_RETAIN_MAX = 2;
+static const size_t EPOCH_RETAIN_AUTO = (size_t)-1;  // Budget: keep while 1GB stays free
+
+// Per-thread hash counter padded to a full cache line, so each worker writes
+// to its own line and the counters never bounce between cores or sockets
+struct alignas(64) ThreadHashCounter {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> stale;  // Subset of count spent on a job already known to be stale
+    std::atomic<uint64_t> shares; // Pseudo-shares found (see set_share_bits)
+    std::atomic<uint64_t> earlier; // Hashed on earlier jobs (count starts over with each)
+
+    ThreadHashCounter() : count(0), stale(0), shares(0), earlier(0) {}
+};
+
+// Consensus limit on a block's time past the median time of the last 11
+// blocks, and how far past curtime nTime is rolled when the node gives no
+// bounds
+static const uint32_t MAX_FUTURE_BLOCK_TIME_MTP = 90 * 60;
+static const uint32_t NTIME_ROLL_MAX_SECONDS = 60 * 60;
+
+// Number of hashes a worker accumulates locally before publishing to its counter
+static const uint64_t HASH_COUNT_FLUSH_INTERVAL = 16;
+
+// Hashes a pipelined worker runs between checks for a new job or stop. The
+// search carries its pipeline from one call to the next, so this only bounds
+// how late a worker sees a new job
+static const uint64_t JOB_POLL_INTERVAL = 4;
+// Light VMs poll after every hash to keep stop() and epoch swaps within one
+// light hash (about 22 ms; 64 would be 1.4 s). Since the search carries its
+// pipeline over, a poll no longer refills the scratchpad (hash_first, about
+// 70 us or 0.3% of a light hash) and costs only the call itself
+static const uint64_t LIGHT_JOB_POLL_INTERVAL = 1;
+
+// During the light-mode warm-up a worker hashes 1/N of the time and sleeps the
+// rest: light hashes are several times slower than fast ones, so CPU taken
+// from the dataset build would cost more than it earns
+static const unsigned int LIGHT_WARMUP_DUTY = 8;
+
+// One published job. Miner keeps two and alternates between them by job
+// generation, so the next job can be written while workers read the current one.
+struct MiningJob {
+    BlockTemplatePtr block_template;
+    uint32_t job_sequence;  // Nonce allocator job field for this job
+    unsigned int readers;   // Workers still mining this slot (guarded by pool_mutex_)
+    std::atomic<uint32_t> time;  // nTime workers put in the header (rolled by roll_time)
+    std::chrono::steady_clock::time_point published_at;  // For SwitchTrace
+
+    MiningJob() : job_sequence(0), readers(0), time(0) {}
 };
 
-class Miner {
+// The CPU backend: RandomX VMs on a persistent worker pool, in fast, light
+// or medium mode, with per-NUMA-node caches or dataset replicas
+class Miner : public MiningBackend {
 public:
-    Miner(unsigned int num_threads, bool fast_mode = false);
-    ~Miner();
+    Miner(unsigned int num_threads, bool fast_mode = false, bool pipelined = true);
+    ~Miner() override;
+
+    const char* name() const override { return "cpu"; }
 
-    bool initialize(const std::vector<uint8_t>& seed_hash);
-    void start_mining(const BlockTemplate& block_template);
-    void stop();
-    bool is_mining() const { return mining_.load(); }
-    bool get_solution(std::vector<uint8_t>& solution_header, std::vector<uint8_t>& solution_hash, BlockTemplate& template_out);
+    bool initialize(const std::vector<uint8_t>& seed_hash) override;
+    // Cuts the dataset build short and skips the warm-up and the dataset
+    // cache; update_seed then drops the unfinished epoch instead of keeping it
+    void abandon_initialize() override { init_abort_ = true; }
+    void start_mining(BlockTemplatePtr block_template) override;
+    // Switch a running miner to a new template without stopping: workers keep
+    // hashing the current job until the new one is published. Falls back to
+    // start_mining when not mining. Returns false (and changes nothing) if a
+    // solution is waiting to be collected with get_solution.
+    bool update_job(BlockTemplatePtr block_template) override;
+    // Declare the current job stale (e.g. a new block was seen) so hashes spent
+    // on it until the next update_job are counted by get_stale_hash_count
+    // (attributed per counter flush, so a few hashes either side may be off)
+    void mark_job_stale() override { stale_generation_.store(job_generation_.load()); }
+    void roll_time(uint32_t header_time) override;
+    void stop() override;
+    bool is_mining() const override { return mining_.load(); }
+    bool get_solution(std::vector<uint8_t>& solution_header, std::vector<uint8_t>& solution_hash, BlockTemplatePtr& template_out) override;
+    void set_solution_handler(SolutionHandler handler) override { solution_handler_ = std::move(handler); }
+    void set_every_solution(bool every_solution) override { every_solution_ = every_solution; }
+    // Workers search at the share target whenever it is easier than the job's
+    // and check the block target only on a hit, so the common-case reject
+    // is still one compare
+    void set_share_bits(unsigned int zero_bits) override;
+    void set_switch_trace(SwitchTrace* trace) override { switch_trace_ = trace; }
 
     // Seed management
-    bool update_seed(const std::vector<uint8_t>& new_seed_hash);
-    const std::vector<uint8_t>& get_current_seed() const { return current_seed_hash_; }
+    bool update_seed(const std::vector<uint8_t>& new_seed_hash) override;
+    // Build the next epoch's cache/dataset in the background (low priority, while
+    // mining continues) so update_seed to that seed becomes a pointer swap.
+    // No-op if disabled, already prepared or over the memory budget.
+    void prepare_next_seed(const std::vector<uint8_t>& next_seed_hash) override;
+    void set_epoch_prefetch(bool enable) { epoch_prefetch_ = enable; }
+    // Max extra MB for the background epoch; 0 = auto (MemAvailable minus headroom)
+    void set_epoch_memory_budget(size_t mb) { epoch_memory_mb_ = mb; }
+    // Memory for previous epochs kept resident (up to EPOCH_RETAIN_MAX), so a
+    // reorg back across the seed boundary is a swap, not a rebuild.
+    // 0 = keep none, EPOCH_RETAIN_AUTO = keep while 1GB of RAM stays free.
+    void set_epoch_retain_budget(size_t mb) { epoch_retain_mb_ = mb; }
+    // RAM budget for all RandomX memory (see MemoryPlanner); none = only
+    // MemAvailable limits the extras. Set before plan_memory.
+    void set_memory_budget(const MemoryBudget& budget) { memory_planner_.set_budget(budget); }
+    // Check the mode, threads and NUMA placement set now against the budget
+    // and turn off what doesn't fit, replicas first, then the background
+    // next-epoch build and retained epochs (call before initialize). The
+    // mode itself is left to the caller; a dataset that doesn't fit is only
+    // reported, and stepped down from if its allocation fails.
+    MemoryPlan plan_memory();
+    MemoryUsage memory_usage() const override;
+    MemoryBudget memory_budget() const override { return memory_planner_.budget(); }
+    // Fast mode: load built epochs from / save them to this directory, so a
+    // restart skips dataset generation. Empty disables (the default).
+    void set_dataset_cache_dir(const std::string& dir) { dataset_store_.set_directory(dir); }
+    // Fast mode: also save each next epoch the background build prepares to
+    // that directory, for rigs downloading it from a DatasetServer
+    // (--dataset-serve) before the epoch change
+    void set_publish_next_epoch(bool enable) { publish_next_epoch_ = enable; }
+    // Fast mode: while a dataset builds (startup, or an epoch change with nothing
+    // prepared), mine with light-mode VMs and move each worker to its fast VM
+    // once the dataset is ready (default on)
+    void set_light_start(bool enable) { light_start_ = enable; }
+    // Low-memory mode: free the shared cache whenever the active mode doesn't
+    // hash from it (fast mode, NUMA light mode) and rebuild it at the next epoch
+    // change. Also turns off the warm-up, background prefetch and retained
+    // epochs, which each keep a cache or a second epoch resident.
+    void set_low_memory(bool enable) { low_memory_ = enable; }
+    // mlock every dataset (full, replica or partial) as it is allocated, so
+    // memory pressure can't page it out. Needs a memlock limit the size of
+    // the dataset or CAP_IPC_LOCK; on failure the dataset is used unlocked.
+    void set_lock_dataset(bool enable) { lock_dataset_ = enable; }
+    // Fast mode: share one dataset per epoch with the other miner processes on
+    // this host (see DatasetShare) instead of building a private copy. Needs the
+    // single shared dataset layout, so NUMA replicas turn it off. Processes that
+    // attach skip the build and hold no cache; the warm-up, background prefetch
+    // and retained epochs are off, since each would keep a private dataset.
+    void set_dataset_share(bool enable) { dataset_share_.set_enabled(enable); }
+    // Build datasets (fast mode, medium mode) on this OpenCL GPU instead of the
+    // CPU cores, falling back to the CPU if it fails. -1 = off (the default).
+    void set_gpu_dataset(int device) { gpu_device_ = device; }
+    bool is_warming_up() const override { return warming_up_.load(); }
+    const std::vector<uint8_t>& get_current_seed() const override { return current_seed_hash_; }
 
     // Statistics
-    uint64_t get_hash_count() const { return hash_count_.load(); }
-    double get_hashrate() const;
+    uint64_t get_hash_count() const override;
+    std::vector<uint64_t> get_thread_hash_counts() const override;
+    uint64_t get_stale_hash_count() const override;
+    std::vector<int> get_thread_numa_nodes() const override;
+    std::vector<CoreType> get_thread_core_types() const override;
+    std::vector<int> get_thread_os_ids() const override;
+    std::vector<int> get_thread_cpus() const override;
+    std::vector<HashPhaseProfile> get_thread_phase_profiles() const override;
+    double get_hashrate() const override;
+    uint64_t get_share_count() const override;
+    double get_effective_hashrate() const override;
 
-    // Thread management
-    bool set_thread_count(unsigned int new_thread_count);
-    unsigned int get_thread_count() const { return num_threads_; }
+    // Thread management. Adds or removes VMs and re-places the threads; the
+    // cache and dataset are only rebuilt if a NUMA node gains its first or
+    // loses its last thread. Mining must be restarted afterwards.
+    bool set_thread_count(unsigned int new_thread_count) override;
+    unsigned int get_thread_count() const override { return num_threads_; }
+    // Re-pin the threads to cpus (as set_cpu_list; empty = automatic), the
+    // same way: VMs follow, the cache and dataset only if the nodes change
+    bool set_cpus(const std::vector<int>& cpus) override;
+    void set_worker_limit(unsigned int limit) override;
+    unsigned int get_worker_limit() const override;
+    // Rebuild the current epoch in another mode (see MiningBackend::set_mode):
+    // everything of the old mode is freed first, prepared and retained epochs
+    // included. Back to fast mode, the light-mode warm-up covers the build.
+    bool set_mode(bool fast, size_t medium_mb) override;
+
+    // Nonce partitioning (call before start_mining)
+    void set_nonce_allocator(const NonceAllocator& allocator) override { nonce_allocator_ = allocator; }
+    const NonceAllocator& get_nonce_allocator() const override { return nonce_allocator_; }
+
+    // Huge pages for dataset, cache and scratchpads (call before initialize)
+    void set_huge_pages(bool enable) { huge_pages_ = enable; }
+    bool is_huge_pages() const { return huge_pages_; }
+    void set_huge_pages_1gb(bool enable) { huge_pages_1gb_ = enable; }
+    bool is_huge_pages_1gb() const { return huge_pages_1gb_; }
+    // Create VMs with RANDOMX_FLAG_SECURE: JIT code is written and run through
+    // separate read-write and read-execute views (call before initialize)
+    void set_secure_jit(bool enable) { secure_jit_ = enable; }
+    // Force a JIT codegen profile, empty = auto (call before initialize); false if unknown
+    static bool set_jit_profile(const std::string& name);
+    // Software AES implementation (table/compact), empty = default; false if unknown
+    static bool set_soft_aes(const std::string& name);
+    // Scratchpads in huge pages staggered across cache sets (default: on)
+    static void set_scratchpad_coloring(bool enable);
+    // Which allocations are actually backed by huge pages, e.g. "dataset 2080/2080 MB, ..."
+    std::string huge_page_summary() const override;
+    // Dataset (replicas), caches, scratchpads and JIT arena chunks for the
+    // mode, threads and NUMA placement set now; the next-epoch prefetch,
+    // retained epochs and the warm-up's light VMs are not in it
+    HugePagePlan huge_page_plan() const override;
+    // Sampled page placement of the dataset, caches, scratchpads and JIT
+    // buffers against where each worker last ran (takes the pool lock)
+    MemoryLocality memory_locality() override;
+    // Phase times of the last initialize or epoch change; first_hash fills
+    // in once a worker has hashed the first job after it
+    InitTiming get_init_timing() const override;
+
+    // Fast mode on NUMA systems: one dataset replica per node (default) vs. one shared dataset
+    void set_numa_replicas(bool enable) { numa_replicas_ = enable; }
+    bool is_numa_replicas() const { return numa_replicas_; }
+
+    // Explicit CPUs for the mining threads (thread i -> cpus[i % size]); empty = automatic placement
+    void set_cpu_list(const std::vector<int>& cpus);
+    const CpuTopology& get_topology() const { return topology_; }
+    // Pin mining threads to their CPUs (default on); NUMA dataset init stays node-pinned regardless
+    void set_affinity(bool enable) { affinity_ = enable; }
+    // Run mining threads under SCHED_IDLE (Linux): they only get CPU time no
+    // other task wants. Set before the workers start.
+    void set_sched_idle(bool enable) { sched_idle_ = enable; }
+
+    // Medium mode (light mode only): keep this many MB of the dataset resident
+    // and compute the remaining items from the cache, for a hashrate between
+    // light and fast mode. 0 = plain light mode (default).
+    void set_partial_dataset_mb(size_t mb);
 
     // Mode info
-    bool is_fast_mode() const { return fast_mode_; }
+    bool is_fast_mode() const override { return fast_mode_; }
+    size_t medium_mode_mb() const override;
+    bool is_medium_mode() const { return !fast_mode_ && partial_items_ > 0; }
+    bool is_pipelined() const { return pipelined_; }
 
 private:
     unsigned int num_threads_;
     bool fast_mode_;  // True = full dataset mode, False = light/cache mode
-    std::vector<std::thread> threads_;
+    bool pipelined_;  // True = overlap next nonce's setup with current hash (hash_first/next)
+    bool huge_pages_; // True = try RANDOMX_FLAG_LARGE_PAGES first (hugetlbfs, then THP)
+    bool huge_pages_1gb_; // True = try RANDOMX_FLAG_1GB_PAGES first for the dataset
+    bool secure_jit_;     // True = VMs get RANDOMX_FLAG_SECURE
+    std::vector<std::thread> threads_;  // Persistent worker pool (see start_pool)
     std::vector<uint8_t> current_seed_hash_;
 
     // Dataset for fast mode (shared across all threads)
     randomx_dataset* dataset_;
 
+    // Medium mode: the first partial_items_ dataset items, shared by every light VM
+    randomx_dataset* partial_dataset_;
+    unsigned long partial_items_;
+
     // NUMA-aware resources
     std::vector<NumaNodeResources> numa_nodes_;
-    std::vector<int> thread_to_cpu_;      // Maps thread_id -> CPU id
+    std::vector<int> thread_to_cpu_;      // Maps thread_id -> CPU id (always set, NUMA or not)
     std::vector<int> thread_to_node_;     // Maps thread_id -> NUMA node index
+    CpuTopology topology_;
+    std::vector<int> cpu_override_;
     bool numa_available_;
+    bool numa_replicas_;  // True = fast mode allocates a dataset per NUMA node
+    bool affinity_;       // True = pin threads to thread_to_cpu_
+    bool sched_idle_;     // True = workers run under SCHED_IDLE
     int num_numa_nodes_;
 
     // Legacy single-node fallback (used when NUMA not available)
     randomx_cache* legacy_cache_;
     std::vector<randomx_vm*> legacy_vms_;
 
+    // Every VM comes from and goes back to the pool; it keeps up to a full
+    // set of idle ones for the next thread count change, mode switch or
+    // warm-up
+    VmPool vm_pool_;
+
     std::atomic<bool> mining_;
     std::atomic<bool> found_;
-    std::atomic<uint64_t> hash_count_;
 
-    std::vector<uint8_t> solution_nonce_;
-    std::vector<uint8_t> solution_hash_;
-    std::vector<uint8_t> solution_header_;
-    BlockTemplate solution_template_;  // Store template for block serialization
+    // One padded counter slot per worker thread (summed by get_hash_count)
+    std::unique_ptr<ThreadHashCounter[]> hash_counters_;
+    unsigned int num_hash_counters_;
+    std::atomic<uint64_t> earlier_stale_;  // Stale hashes of earlier jobs, whatever the thread count
+    // Per thread slot, attached to whichever VM the worker hashes with. Only
+    // ever grows, so no VM is left pointing at a released one. Empty unless
+    // built with JUNO_PHASE_PROFILE.
+    std::vector<randomx_phase_profile*> phase_profiles_;
+
+    // Fixed-size solution buffers, written by the winning worker without allocating
+    uint8_t solution_hash_[32];
+    uint8_t solution_header_[BLOCK_HEADER_SIZE];
+    uint64_t solution_generation_;  // Job generation the solution belongs to
+    SolutionHandler solution_handler_;
+    std::atomic<uint64_t> handled_generation_;  // Last job whose solution went to solution_handler_
+    bool every_solution_;                       // Pool shares: every solution goes to solution_handler_
+    unsigned int share_bits_;                   // Pseudo-share leading zero bits, 0 = off
+    std::vector<uint8_t> share_target_;         // The pseudo-share target and its limbs
+    utils::TargetLimbs share_limbs_;
+    SwitchTrace* switch_trace_;                 // Told of each worker's first hashes on a job, or null
+
+    // Worker pool: workers sleep on pool_cv_ until job_generation_ moves past
+    // the last job they mined, then hash jobs_[generation & 1]
+    MiningJob jobs_[2];
+    std::atomic<uint64_t> job_generation_;
+    std::atomic<uint64_t> stale_generation_;  // Jobs up to this generation are stale
+    mutable std::mutex pool_mutex_;
+    std::condition_variable pool_cv_;
+    bool pool_shutdown_;
+    unsigned int active_workers_;  // Workers currently inside mine_job
+    std::atomic<unsigned int> worker_limit_;  // Workers from this index on sleep (set_worker_limit)
+    std::vector<int> worker_os_ids_;  // Per worker, its OS thread ID once running (pool_mutex_)
+    std::vector<int> worker_cpus_;    // Per worker, its CPU at the last job start, -1 before (pool_mutex_)
+    NonceAllocator nonce_allocator_;
 
     std::chrono::steady_clock::time_point start_time_;
 
-    void worker_thread(int thread_id, const BlockTemplate& block_template);
+    // Background next-epoch build (see prepare_next_seed)
+    bool epoch_prefetch_;
+    size_t epoch_memory_mb_;
+    std::thread prepare_thread_;
+    mutable std::mutex prepare_mutex_;
+    std::vector<uint8_t> next_epoch_seed_;  // Seed built, being built or skipped (guarded)
+    EpochResources next_epoch_;             // Ready resources for next_epoch_seed_ (guarded)
+    std::atomic<size_t> building_bytes_;    // Allocated so far by a build_epoch in progress
+    InitTiming next_epoch_timing_;          // How next_epoch_ was built (guarded)
+    std::atomic<bool> prepare_abort_;
+    // See abandon_initialize; cleared by the update_seed that replaces the epoch
+    std::atomic<bool> init_abort_;
+
+    // Previous epochs by seed, least recently used first (main thread only)
+    size_t epoch_retain_mb_;
+    std::vector<EpochResources> retained_epochs_;
+
+    // Built epochs persisted across restarts (fast mode)
+    DatasetStore dataset_store_;
+    // Writes the next epoch (set_publish_next_epoch); used by the build thread,
+    // and by the main thread only once that has been joined
+    bool publish_next_epoch_;
+    DatasetStore publish_store_;
+
+    // Epoch datasets shared between processes (fast mode); dataset_ is then a view of it
+    DatasetShare dataset_share_;
+
+    // What the RandomX memory may take and what it holds (see plan_memory)
+    MemoryPlanner memory_planner_;
+    void track_memory();
+    bool step_down(const std::vector<uint8_t>& seed_hash, const std::string& failed);
+
+    bool low_memory_;  // See set_low_memory
+    bool lock_dataset_;  // See set_lock_dataset
+
+    // GPU dataset builds (see set_gpu_dataset), opened by initialize
+    int gpu_device_;
+    GpuDatasetBuilder gpu_dataset_;
+
+    // Light-mode warm-up (see set_light_start). While the dataset builds, the
+    // VM slots hold light VMs and fast_vms_ the real ones; the build thread
+    // swaps them back and bumps vm_generation_, and each worker then picks up
+    // its new VM at its next poll and frees the light one it was using.
+    // Slots, fast_vms_ and light_vms_ are guarded by pool_mutex_.
+    bool light_start_;
+    std::atomic<bool> warming_up_;
+    std::atomic<uint64_t> vm_generation_;
+    std::vector<randomx_vm*> fast_vms_;   // Per thread: fast VM parked during warm-up
+    std::vector<randomx_vm*> light_vms_;  // Per thread: light VM retired but maybe in use
+    std::thread warmup_thread_;
+    std::atomic<bool> warmup_abort_;
+
+    // CPU engines: start_pool runs every worker on the instantiation for the
+    // mode (fast/light), the VM layout (NUMA nodes/legacy) and the hash loop
+    // (pipelined or not), so none of them is tested per hash
+    typedef void (Miner::*WorkerEntry)(int thread_id);
+    WorkerEntry select_engine() const;
+    template<bool Fast, bool Numa, bool Pipelined>
+    void worker_thread(int thread_id);
+    template<bool Fast, bool Numa, bool Pipelined>
+    void mine_job(int thread_id, randomx_vm*& vm, uint64_t& vm_generation, const MiningJob& job, uint64_t generation);
+    template<bool Numa>
+    randomx_vm* refresh_vm(int thread_id, randomx_vm* vm, uint64_t& vm_generation);
+    bool use_warmup(const std::vector<uint8_t>& seed_hash) const;
+    void start_warmup();
+    void warmup_thread(EpochResources epoch);
+    void finish_warmup(bool abort);
+    void start_pool();
+    void shutdown_pool();
+    void reset_hash_counters();
+    void init_datasets(const EpochResources& epoch, const std::atomic<bool>* abort = nullptr);
+    bool init_datasets_gpu(const EpochResources& epoch, const std::atomic<bool>* abort);
+
+    // Epoch resources: snapshot the live pointers, swap a set in (repointing
+    // every VM), free a set, or allocate and build one shaped like another
+    EpochResources capture_epoch() const;
+    void install_epoch(const EpochResources& epoch);
+    void release_epoch(EpochResources& epoch);
+    bool build_epoch(const EpochResources& shape, const std::vector<uint8_t>& seed_hash, EpochResources& out);
+    size_t epoch_bytes(const EpochResources& epoch) const;
+    void prepare_epoch_thread(EpochResources shape, std::vector<uint8_t> seed_hash);
+    bool take_next_epoch(const std::vector<uint8_t>& seed_hash);
+    void discard_next_epoch();
+    bool initialize_epoch(const std::vector<uint8_t>& seed_hash);
+    bool switch_seed(const std::vector<uint8_t>& new_seed_hash);
+    void fill_epoch(const EpochResources& epoch, const std::atomic<bool>* abort = nullptr);
+    void replicate_cache(const EpochResources& epoch);
+    bool ensure_cache();
+    bool use_dataset_share() const;
+    bool attach_shared_dataset(const std::vector<uint8_t>& seed_hash);
+    void release_idle_cache();
+    std::string memory_summary() const;
+    void store_epoch();
+    bool take_retained_epoch(const std::vector<uint8_t>& seed_hash);
+    void retain_epoch(EpochResources& epoch);
+    bool can_retain_epoch(const EpochResources& epoch);
+    bool retained_within_budget() const;
+    void release_retained_epochs();
     void detect_numa_topology();
+    void assign_threads_to_cpus();
     bool set_thread_affinity(int cpu_id);
     randomx_vm* get_vm_for_thread(int thread_id);
+    randomx_vm** vm_slot(int thread_id);
+    template<bool Numa>
+    randomx_vm** vm_slot(int thread_id);
+    bool numa_layout() const;
+    std::vector<bool> active_numa_nodes() const;
+    bool resize_vms();
+    // set_thread_count and set_cpus: respawn the pool for this count and
+    // pinning, keeping what the NUMA layout still fits
+    bool relayout(unsigned int new_thread_count, const std::vector<int>& cpus);
+    void release_resources();
+
+    // Allocation wrappers that try huge pages first when enabled
+    randomx_cache* alloc_cache(randomx_flags flags);
+    randomx_dataset* alloc_dataset(randomx_flags flags, int numa_node = -1, unsigned long item_count = 0);
+    void lock_dataset_memory(randomx_dataset* dataset, unsigned long item_count);
+    // From vm_pool_; node (-1 = none) is the NUMA node whose policy is set
+    randomx_vm* create_vm(randomx_flags flags, randomx_cache* cache, randomx_dataset* dataset, int node);
+    int thread_node(int thread_id) const;
+    // randomx_init_cache, timed as its Argon2 and SuperscalarHash steps
+    void init_cache(randomx_cache* cache, const std::vector<uint8_t>& seed_hash);
+
+    // Init timing (see get_init_timing). publish_init_timing stores a finished
+    // init and arms record_first_hash, which the first worker to hash afterwards
+    // completes and logs it with.
+    mutable std::mutex init_timing_mutex_;
+    InitTiming init_timing_;
+    std::atomic<bool> first_hash_pending_;
+    void publish_init_timing(InitTiming& timing, std::chrono::steady_clock::time_point started);
+    void record_first_hash(std::chrono::steady_clock::time_point published);
+    void prefer_thread_node(int thread_id);
 };
 
+// Build a template from a getblocktemplate result (or from
+// block_template_to_json); throws std::runtime_error if it isn't usable
 BlockTemplate parse_block_template(const Json::Value& template_data);
+// Derive the target and the header (nonce zeroed) from a template's fields;
+// the last step of parse_block_template and of BlockTemplateParser
+void complete_block_template(BlockTemplate& bt);
+// nTime for a header built on bt at wall-clock time now: now, but never
+// before curtime and never past what the node accepts (maxtime; without it,
+// MAX_FUTURE_BLOCK_TIME_MTP past the median time mintime implies, or
+// NTIME_ROLL_MAX_SECONDS past curtime if the node gave neither)
+uint32_t rolled_header_time(const BlockTemplate& bt, uint64_t now);
+// A template as JSON that parse_block_template reads back, with the body
+// already serialized (for handing it to another process)
+Json::Value block_template_to_json(const BlockTemplate& bt);
 
 #endif // MINER_H
@@ -0,0 +1,144 @@
+#include "mining_backend.h"
+#include "miner.h"
+#include "config.h"
+#include "logger.h"
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+HashPhaseProfile HashPhaseProfile::since(const HashPhaseProfile& earlier) const {
+    HashPhaseProfile delta;
+    for (int phase = 0; phase < RANDOMX_PHASE_COUNT; phase++) {
+        delta.phases[phase].count = phases[phase].count - earlier.phases[phase].count;
+        delta.phases[phase].ticks = phases[phase].ticks - earlier.phases[phase].ticks;
+        for (int bucket = 0; bucket < RANDOMX_PHASE_BUCKETS; bucket++) {
+            delta.phases[phase].buckets[bucket] = phases[phase].buckets[bucket] - earlier.phases[phase].buckets[bucket];
+        }
+    }
+    return delta;
+}
+
+double InitTiming::worker_rate(double quantile) const {
+    if (worker_items_per_second.empty()) {
+        return 0;
+    }
+    return worker_items_per_second[(size_t)(quantile * (worker_items_per_second.size() - 1) + 0.5)];
+}
+
+std::string InitTiming::describe() const {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2) << trigger << " " << total_seconds << " s"
+       << (background ? " (partly in the background)" : "") << ":";
+    bool first = true;
+    for (int phase = 0; phase < INIT_PHASES; phase++) {
+        if (seconds[phase] <= 0) continue;
+        ss << (first ? " " : ", ") << INIT_PHASE_NAMES[phase] << " " << seconds[phase] << " s";
+        first = false;
+    }
+    if (first) {
+        ss << " nothing to build";
+    }
+    if (dataset_workers > 0 && seconds[INIT_DATASET_BUILD] > 0) {
+        ss << std::setprecision(0) << "; dataset " << dataset_items / seconds[INIT_DATASET_BUILD] << " items/s from "
+           << dataset_workers << " workers, per worker " << worker_rate(0) << " / " << worker_rate(0.5) << " / "
+           << worker_rate(1) << " (min / median / max)";
+    }
+    return ss.str();
+}
+
+// Size the hugetlb pools for what the backend will allocate before it
+// does, and name each allocation that will fall back to smaller pages
+static void provision_huge_pages(const MinerConfig& config, const MiningBackend& backend) {
+#ifdef _WIN32
+    // Windows has no pools to size: large pages come straight from free
+    // physical memory once enable_large_pages has the privilege
+    (void)config;
+    (void)backend;
+    return;
+#endif
+    HugePagePlan plan = backend.huge_page_plan();
+    if (plan.empty()) {
+        return;
+    }
+    HugePageManager manager(plan);
+    LOG_DEBUG_STREAM("Huge pages needed: " << manager.describe());
+    bool reserved = config.huge_page_reserve && manager.reserve();
+    if (manager.pages_added() > 0) {
+        std::cout << "Huge pages: reserved " << manager.pages_added() << " more for " << manager.describe() << std::endl;
+        LOG_INFO_STREAM("Huge pages: reserved " << manager.pages_added() << " more for " << manager.describe());
+    }
+    std::vector<std::string> shortfalls = manager.shortfalls();
+    for (const std::string& line : shortfalls) {
+        std::cout << "Warning: Huge pages: " << line << std::endl;
+        LOG_WARNING_STREAM("Huge pages: " << line);
+    }
+    if (!shortfalls.empty() && !reserved) {
+        std::cout << "  These fall back to transparent huge pages or normal pages; raise vm.nr_hugepages (per node "
+                  << "on NUMA systems)" << (config.huge_page_reserve ? " or run as root" : "") << std::endl;
+    }
+}
+
+static std::unique_ptr<MiningBackend> create_cpu_backend(const MinerConfig& config, unsigned int num_threads,
+                                                         bool fast_mode, std::string& error) {
+    if (!Miner::set_jit_profile(config.jit_profile)) {
+        error = "unknown JIT profile: " + config.jit_profile;
+        return nullptr;
+    }
+    if (!Miner::set_soft_aes(config.soft_aes)) {
+        error = "unknown software AES implementation: " + config.soft_aes;
+        return nullptr;
+    }
+    Miner::set_scratchpad_coloring(config.scratchpad_coloring);
+
+    std::unique_ptr<Miner> miner(new Miner(num_threads, fast_mode, config.pipelined_hashing));
+    std::string large_pages_error;
+    bool huge_pages = config.huge_pages;
+    if (huge_pages && !enable_large_pages(large_pages_error)) {
+        std::cout << "Warning: Large pages unavailable: " << large_pages_error << std::endl;
+        LOG_WARNING_STREAM("Large pages unavailable: " << large_pages_error);
+        huge_pages = false;
+    }
+    miner->set_huge_pages(huge_pages);
+    miner->set_huge_pages_1gb(huge_pages && config.huge_pages_1gb);
+    miner->set_secure_jit(config.secure_jit);
+    miner->set_numa_replicas(config.numa_replicas);
+    miner->set_cpu_list(config.cpu_list);
+    miner->set_affinity(config.cpu_affinity);
+    miner->set_sched_idle(config.sched_idle);
+    miner->set_epoch_prefetch(config.epoch_prefetch);
+    miner->set_epoch_memory_budget(config.epoch_memory_mb);
+    miner->set_epoch_retain_budget(config.epoch_retain_auto ? EPOCH_RETAIN_AUTO : config.epoch_retain_mb);
+    miner->set_light_start(config.light_start);
+    miner->set_low_memory(config.low_memory);
+    miner->set_lock_dataset(config.lock_dataset);
+    if (config.dataset_share && !DatasetShare::supported()) {
+        std::cout << "Dataset sharing is not supported on this platform, ignoring --dataset-share" << std::endl;
+    }
+    // Handing over a fast-mode miner without rebuilding needs the shared dataset
+    miner->set_dataset_share(config.dataset_share || (fast_mode && !config.upgrade_socket.empty()));
+    if (!fast_mode) {
+        miner->set_partial_dataset_mb(config.medium_mode_mb);
+    }
+    miner->set_gpu_dataset(config.gpu_dataset ? (int)config.gpu_device : -1);
+    if (config.dataset_cache) {
+        miner->set_dataset_cache_dir(config.dataset_cache_dir.empty() ? DatasetStore::default_directory()
+                                                                      : config.dataset_cache_dir);
+        miner->set_publish_next_epoch(!config.dataset_serve.empty());
+    }
+    // With the mode, threads and extras set: drop the extras the budget can't hold
+    miner->set_memory_budget(resolve_memory_budget(config.memory_budget_mb, utils::detect_system_resources()));
+    miner->plan_memory();
+    if (huge_pages) {
+        provision_huge_pages(config, *miner);
+    }
+    return std::unique_ptr<MiningBackend>(miner.release());
+}
+
+std::unique_ptr<MiningBackend> create_mining_backend(const MinerConfig& config, unsigned int num_threads,
+                                                     bool fast_mode, std::string& error) {
+    if (config.backend.empty() || config.backend == "cpu") {
+        return create_cpu_backend(config, num_threads, fast_mode, error);
+    }
+    error = "unknown backend: " + config.backend;
+    return nullptr;
+}
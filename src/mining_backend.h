@@ -0,0 +1,263 @@
+#ifndef MINING_BACKEND_H
+#define MINING_BACKEND_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include "randomx.h"
+#include "utils.h"
+#include "nonce_allocator.h"
+#include "numa_locality.h"
+#include "cpu_topology.h"
+#include "huge_pages.h"
+#include "memory_planner.h"
+
+struct MinerConfig;
+class SwitchTrace;
+struct BlockTemplate;
+
+// Receives a solution on the worker that found it: the full header (nonce
+// included, BLOCK_HEADER_SIZE bytes), the 32-byte PoW hash and the job's
+// template, all valid only for the duration of the call
+typedef std::function<void(const uint8_t* header, const uint8_t* hash, const BlockTemplate& block_template)>
+    SolutionHandler;
+
+// Serialized header layout: CEquihashInput (108 bytes) followed by nNonce (32 bytes)
+static const size_t TIME_OFFSET = 100;  // nTime, little-endian, inside CEquihashInput
+static const size_t NONCE_OFFSET = 108;
+static const size_t NONCE_SIZE = 32;
+static const size_t BLOCK_HEADER_SIZE = NONCE_OFFSET + NONCE_SIZE;
+
+// When the block behind a template was heard of, and when the template was
+// requested, received and parsed (unset where it doesn't apply, e.g. a long
+// poll answer is itself the news). SwitchTrace reports the gaps.
+struct TemplateTimes {
+    std::chrono::steady_clock::time_point noticed;
+    std::chrono::steady_clock::time_point requested;
+    std::chrono::steady_clock::time_point received;
+    std::chrono::steady_clock::time_point parsed;
+};
+
+struct BlockTemplate {
+    uint32_t version;
+    std::string previous_block_hash;
+    std::string merkle_root;
+    std::string block_commitments_hash;
+    uint32_t time;                    // curtime: nTime in header_base
+    uint32_t min_time = 0;            // nTime bounds the node gave (mintime, maxtime), 0 if not
+    uint32_t max_time = 0;
+    uint32_t bits;
+    std::vector<uint8_t> target;      // 256-bit target (converted from bits)
+    utils::TargetLimbs target_limbs;  // Same target as native limbs for the hot-loop check
+    std::string target_hex;           // Hex string for display only
+    uint32_t height;
+    uint64_t seed_height;             // Height of seed block (NEW: from randomxseedheight)
+    std::vector<uint8_t> seed_hash;   // RandomX seed hash (32 bytes, from randomxseedhash)
+    std::vector<uint8_t> next_seed_hash; // Next epoch's seed (32 bytes, from randomxnextseedhash, optional)
+    std::vector<uint8_t> header_base; // Header without nonce
+    std::string block_body_hex;       // Transaction count, coinbase and other transactions, serialized once
+    std::string longpollid;           // BIP22 long poll ID, empty if the node doesn't long poll
+    unsigned int node = 0;            // Which node served it (index into MinerConfig::rpc_urls)
+    std::string job_id;               // Pool job it came from (see StratumClient), empty from a node
+    bool spy = false;                 // Coinbase only, from --spy-url: mined until the full template arrives
+    TemplateTimes times;
+
+    BlockTemplate() = default;
+    // Move-only: the body can be megabytes, so jobs share one immutable
+    // template through BlockTemplatePtr instead of copying it
+    BlockTemplate(BlockTemplate&&) = default;
+    BlockTemplate& operator=(BlockTemplate&&) = default;
+    BlockTemplate(const BlockTemplate&) = delete;
+    BlockTemplate& operator=(const BlockTemplate&) = delete;
+};
+
+typedef std::shared_ptr<const BlockTemplate> BlockTemplatePtr;
+
+// Labels of the randomx_phase values, for reports
+static const char* const HASH_PHASE_NAMES[RANDOMX_PHASE_COUNT] = {
+    "blake2b", "fill_scratchpad", "generate_program", "compile", "execute", "dataset_read", "final_hash"
+};
+
+// One worker's histograms of the time each phase of its hashes took, in
+// randomx_phase_timer ticks (see randomx_alloc_phase_profile)
+struct HashPhaseProfile {
+    randomx_phase_stats phases[RANDOMX_PHASE_COUNT];
+
+    HashPhaseProfile() : phases() {}
+    // What was recorded since earlier was read
+    HashPhaseProfile since(const HashPhaseProfile& earlier) const;
+};
+
+// Steps of bringing up an epoch's RandomX state (initialize, update_seed)
+enum InitPhase {
+    INIT_CACHE_ALLOC,
+    INIT_ARGON2,            // Argon2 fill of the cache
+    INIT_SUPERSCALAR,       // SuperscalarHash programs and their JIT code
+    INIT_CACHE_REPLICATE,   // Copies to the NUMA nodes' caches
+    INIT_DATASET_ALLOC,
+    INIT_DATASET_LOAD,      // From the dataset cache file or a shared segment instead of a build
+    INIT_DATASET_BUILD,
+    INIT_VM_CREATE,
+    INIT_FIRST_HASH,        // First job published after the init -> a worker's first hashes on it
+    INIT_PHASES
+};
+
+static const char* const INIT_PHASE_NAMES[INIT_PHASES] = {
+    "cache_alloc", "argon2", "superscalar_jit", "cache_replicate", "dataset_alloc", "dataset_load",
+    "dataset_build", "vm_create", "first_hash"
+};
+
+// Where the time of the last initialize or epoch change went. Phases are
+// summed over everything of their kind (every node's dataset, every VM) and
+// are 0 where skipped. Work done off the critical path (a next epoch
+// prepared in the background, a dataset built during the light-mode
+// warm-up) is included, with background set.
+struct InitTiming {
+    std::string trigger;            // "startup" or "epoch change", empty before the first
+    double seconds[INIT_PHASES];
+    double total_seconds;           // Wall time of the call itself, which kept the miner from hashing
+    bool background;
+    unsigned int dataset_workers;   // Of the CPU dataset build
+    uint64_t dataset_items;
+    std::vector<double> worker_items_per_second;  // Per dataset init worker, sorted
+
+    InitTiming() : seconds(), total_seconds(0), background(false), dataset_workers(0), dataset_items(0) {}
+    // Slowest, median or fastest worker at quantile 0, 0.5 or 1; 0 without workers
+    double worker_rate(double quantile) const;
+    // One line, e.g. "startup 14.2 s: argon2 0.61 s, superscalar_jit 0.02 s, ..."
+    std::string describe() const;
+};
+
+// What the main loop drives: something that holds an epoch's RandomX state,
+// searches nonces for a published job and reports what it found. The CPU
+// miner (Miner) is one; other engines plug in through create_mining_backend
+// without main.cpp knowing which one it talks to.
+class MiningBackend {
+public:
+    virtual ~MiningBackend() {}
+
+    // Short name, as accepted by --backend
+    virtual const char* name() const = 0;
+
+    // Epochs: build the state for a seed, swap to another seed, or build the
+    // next epoch in the background so the swap is cheap
+    virtual bool initialize(const std::vector<uint8_t>& seed_hash) = 0;
+    virtual bool update_seed(const std::vector<uint8_t>& new_seed_hash) = 0;
+    virtual void prepare_next_seed(const std::vector<uint8_t>& next_seed_hash) = 0;
+    virtual const std::vector<uint8_t>& get_current_seed() const = 0;
+    // Give up on the epoch initialize is building, from another thread while
+    // it runs or after it returned: it returns early and the state is only
+    // good for an update_seed to another seed, which rebuilds it. For a
+    // startup build of a guessed seed that turned out wrong.
+    virtual void abandon_initialize() {}
+    // Hashing at reduced speed while the epoch finishes building
+    virtual bool is_warming_up() const { return false; }
+
+    // Jobs and search (see Miner for the exact semantics)
+    virtual void start_mining(BlockTemplatePtr block_template) = 0;
+    virtual bool update_job(BlockTemplatePtr block_template) = 0;
+    virtual void mark_job_stale() = 0;
+    // Move the current job's nTime to header_time in place: workers rewrite
+    // it in their header at their next job check, without a restart or a
+    // new template (see rolled_header_time for the bounds)
+    virtual void roll_time(uint32_t header_time) = 0;
+    virtual void stop() = 0;
+    virtual bool is_mining() const = 0;
+    virtual bool get_solution(std::vector<uint8_t>& solution_header, std::vector<uint8_t>& solution_hash,
+                              BlockTemplatePtr& template_out) = 0;
+    // Hand each job's first solution to handler on the finding worker instead
+    // of stopping: the job is marked stale and the workers keep hashing it
+    // until update_job moves them on, and get_solution finds nothing. The
+    // handler must not block. Set before start_mining; empty restores stopping.
+    virtual void set_solution_handler(SolutionHandler handler) = 0;
+    // Pool shares: hand every solution to the handler and leave the job
+    // current, not just the first. Set before start_mining.
+    virtual void set_every_solution(bool every_solution) = 0;
+    // Pseudo-shares: also count hashes with zero_bits leading zero bits (an
+    // easier target than the block's), 0 = off. They cost nothing extra to
+    // spot and show whether the hashes counted are really being computed.
+    // Set before start_mining.
+    virtual void set_share_bits(unsigned int zero_bits) = 0;
+    // Block switch tracing: report each worker's first hashes on every job
+    // to trace (null = off). Set before start_mining.
+    virtual void set_switch_trace(SwitchTrace* trace) { (void)trace; }
+
+    // Workers; mining must be restarted after a change
+    virtual bool set_thread_count(unsigned int new_thread_count) = 0;
+    virtual unsigned int get_thread_count() const = 0;
+    // Mining threads' CPUs (thread i -> cpus[i % size], empty = automatic
+    // placement); mining must be restarted after a change. False if the
+    // backend has no CPU placement or it failed.
+    virtual bool set_cpus(const std::vector<int>& cpus) { (void)cpus; return false; }
+    // Co-location (see ColocationGovernor): only workers below limit hash,
+    // the others sleep with their VMs kept until it rises again. Takes
+    // effect within a few hashes, without restarting mining; every worker
+    // hashes by default. Safe from any thread.
+    virtual void set_worker_limit(unsigned int limit) { (void)limit; }
+    virtual unsigned int get_worker_limit() const { return get_thread_count(); }
+    // Memory mode (see MemoryGovernor): rebuild the current epoch in fast
+    // mode, or else in medium mode with medium_mb of dataset resident (0 =
+    // light mode). Mining must be restarted afterwards. False if the backend
+    // has no such modes or the rebuild failed.
+    virtual bool set_mode(bool fast, size_t medium_mb) { (void)fast; (void)medium_mb; return false; }
+    // The mode in use, which can be below the one asked for: initialize,
+    // set_mode and epoch changes step down when a dataset can't be allocated
+    virtual bool is_fast_mode() const { return false; }
+    virtual size_t medium_mode_mb() const { return 0; }
+
+    // Nonce partitioning (call before start_mining)
+    virtual void set_nonce_allocator(const NonceAllocator& allocator) = 0;
+    virtual const NonceAllocator& get_nonce_allocator() const = 0;
+
+    // Statistics
+    virtual uint64_t get_hash_count() const = 0;
+    // Hashes spent on jobs already known to be stale, across jobs
+    virtual uint64_t get_stale_hash_count() const = 0;
+    virtual double get_hashrate() const = 0;
+    // Pseudo-shares found since the counters were last reset, and the
+    // hashrate they imply (2^share_bits hashes each); 0 with no share target
+    virtual uint64_t get_share_count() const = 0;
+    virtual double get_effective_hashrate() const = 0;
+    // Hashes per worker thread, across jobs, since the thread count was
+    // last set (see HashrateMeter); empty if the backend doesn't count per
+    // thread
+    virtual std::vector<uint64_t> get_thread_hash_counts() const { return std::vector<uint64_t>(); }
+    // The NUMA node each worker thread runs on, empty if unknown
+    virtual std::vector<int> get_thread_numa_nodes() const { return std::vector<int>(); }
+    // The core type each worker thread runs on; empty unless the CPU is hybrid
+    virtual std::vector<CoreType> get_thread_core_types() const { return std::vector<CoreType>(); }
+    // Per worker thread, its OS thread ID (0 until it runs), for profilers
+    virtual std::vector<int> get_thread_os_ids() const { return std::vector<int>(); }
+    // The CPUs the workers hash on: each one's own when they are pinned,
+    // else every CPU they may run on; empty if unknown
+    virtual std::vector<int> get_thread_cpus() const { return std::vector<int>(); }
+    // Per worker thread, the phase histograms of its hashes; empty unless
+    // built with JUNO_PHASE_PROFILE
+    virtual std::vector<HashPhaseProfile> get_thread_phase_profiles() const {
+        return std::vector<HashPhaseProfile>();
+    }
+    // Huge page coverage of the backend's memory, empty if it has none to report
+    virtual std::string huge_page_summary() const { return std::string(); }
+    // The huge pages initialize will ask for, per allocation and NUMA node
+    // (see HugePageManager); empty if the backend uses none
+    virtual HugePagePlan huge_page_plan() const { return HugePagePlan(); }
+    // RandomX memory held per component, and the budget it is planned
+    // against (see MemoryPlanner); empty if the backend doesn't account it
+    virtual MemoryUsage memory_usage() const { return MemoryUsage(); }
+    virtual MemoryBudget memory_budget() const { return MemoryBudget(); }
+    // Phase times of the last initialize or epoch change
+    virtual InitTiming get_init_timing() const { return InitTiming(); }
+    // Which NUMA node the backend's memory is on against the workers' CPUs
+    virtual MemoryLocality memory_locality() { return MemoryLocality(); }
+};
+
+// Create and configure the backend named by config.backend ("cpu" by
+// default). Returns nullptr with a message in error on an unknown backend
+// or option.
+std::unique_ptr<MiningBackend> create_mining_backend(const MinerConfig& config, unsigned int num_threads,
+                                                     bool fast_mode, std::string& error);
+
+#endif // MINING_BACKEND_H
@@ -0,0 +1,253 @@
+#include "msr_profile.h"
+#include "logger.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct Preset {
+    const char* name;
+    std::vector<MsrWrite> writes;
+};
+
+// Bit 5 of 0xC0011021 is left alone: it isn't a prefetcher control
+const uint64_t AMD_KEEP_BIT5 = ~0x20ULL;
+
+const std::vector<Preset>& presets() {
+    static const std::vector<Preset> list = {
+        {"intel", {MsrWrite(0x1a4, 0xf, 0xf)}},
+        {"ryzen17h", {MsrWrite(0xc0011020, 0), MsrWrite(0xc0011021, 0x40, AMD_KEEP_BIT5),
+                      MsrWrite(0xc0011022, 0x1510000), MsrWrite(0xc001102b, 0x2000cc16)}},
+        {"ryzen19h", {MsrWrite(0xc0011020, 0x4480000000000), MsrWrite(0xc0011021, 0x1c000200000040, AMD_KEEP_BIT5),
+                      MsrWrite(0xc0011022, 0xc000000401570000), MsrWrite(0xc001102b, 0x2000cc10)}},
+        {"ryzen19h_zen4", {MsrWrite(0xc0011020, 0x4400000000000), MsrWrite(0xc0011021, 0x4000000000040, AMD_KEEP_BIT5),
+                           MsrWrite(0xc0011022, 0x8680000401570000), MsrWrite(0xc001102b, 0x2040cc10)}},
+        {"ryzen1ah", {MsrWrite(0xc0011020, 0x4400000000000), MsrWrite(0xc0011021, 0x4000000000040, AMD_KEEP_BIT5),
+                      MsrWrite(0xc0011022, 0x8680000401570000), MsrWrite(0xc001102b, 0x2040cc10)}},
+    };
+    return list;
+}
+
+// The preset for this CPU from /proc/cpuinfo, empty if none fits
+std::string auto_preset() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line, vendor;
+    int family = -1, model = -1;
+    while (std::getline(cpuinfo, line) && (vendor.empty() || family < 0 || model < 0)) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string key = line.substr(0, line.find_last_not_of(" \t", colon - 1) + 1);
+        std::string value = colon + 2 <= line.size() ? line.substr(colon + 2) : std::string();
+        if (key == "vendor_id") vendor = value;
+        else if (key == "cpu family") family = std::atoi(value.c_str());
+        else if (key == "model") model = std::atoi(value.c_str());
+    }
+    if (vendor == "GenuineIntel") {
+        return "intel";
+    }
+    if (vendor != "AuthenticAMD" && vendor != "HygonGenuine") {
+        return std::string();
+    }
+    if (family == 0x17 || family == 0x18) {
+        return "ryzen17h";
+    }
+    if (family == 0x19) {
+        bool zen4 = (model >= 0x10 && model <= 0x1f) || (model >= 0x60 && model <= 0x7f) || (model >= 0xa0 && model <= 0xaf);
+        return zen4 ? "ryzen19h_zen4" : "ryzen19h";
+    }
+    return family == 0x1a ? "ryzen1ah" : std::string();
+}
+
+bool parse_hex(const std::string& text, uint64_t& value) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoull(text.c_str(), &end, 16);
+    return end && *end == '\0' && errno == 0;
+}
+
+// What apply_msr_profile changed, for the crash handler too: it only reads
+// these, with pwrite, which is async-signal-safe
+struct SavedMsr {
+    int cpu;
+    int fd;
+    uint32_t reg;
+    uint64_t original;
+};
+
+std::mutex msr_mutex;
+std::vector<SavedMsr> saved_msrs;
+std::vector<int> tuned_cpus;
+std::string active_profile;
+
+#ifdef __linux__
+// In reverse order, in case a register was written twice
+void write_back_saved() {
+    for (auto saved = saved_msrs.rbegin(); saved != saved_msrs.rend(); ++saved) {
+        (void)!pwrite(saved->fd, &saved->original, sizeof(saved->original), saved->reg);
+    }
+}
+
+void crash_handler(int sig) {
+    write_back_saved();
+    // Installed with SA_RESETHAND: the default action (a core dump) follows
+    raise(sig);
+}
+
+void install_restore_handlers() {
+    static bool installed = false;
+    if (installed) return;
+    installed = true;
+    std::atexit(restore_msr_profile);
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = crash_handler;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    for (int sig : {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT}) {
+        sigaction(sig, &action, nullptr);
+    }
+}
+#endif
+
+}  // namespace
+
+bool parse_msr_profile(const std::string& spec, MsrProfile& profile, std::string& error) {
+    std::string name = spec == "auto" ? auto_preset() : spec;
+    if (name.empty()) {
+        error = "no MSR preset for this CPU; give the registers as REG:VALUE[:MASK]";
+        return false;
+    }
+    for (const Preset& preset : presets()) {
+        if (name == preset.name) {
+            profile.name = preset.name;
+            profile.writes = preset.writes;
+            return true;
+        }
+    }
+    profile.name = "custom";
+    profile.writes.clear();
+    std::stringstream list(spec);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        std::vector<std::string> fields;
+        std::stringstream parts(item);
+        std::string field;
+        while (std::getline(parts, field, ':')) {
+            fields.push_back(field);
+        }
+        uint64_t reg = 0, value = 0, mask = ~0ULL;
+        if (fields.size() < 2 || fields.size() > 3 || !parse_hex(fields[0], reg) || reg > 0xffffffffULL ||
+            !parse_hex(fields[1], value) || (fields.size() == 3 && !parse_hex(fields[2], mask))) {
+            error = "invalid MSR write '" + item + "' (expected a preset or hex REG:VALUE[:MASK])";
+            return false;
+        }
+        profile.writes.push_back(MsrWrite((uint32_t)reg, value, mask));
+    }
+    if (profile.writes.empty()) {
+        error = "empty MSR profile";
+        return false;
+    }
+    return true;
+}
+
+bool apply_msr_profile(const MsrProfile& profile, const std::vector<int>& cpus, std::string& error) {
+#ifdef __linux__
+    std::string active = active_msr_profile();
+    if (!active.empty() && active != profile.name) {
+        restore_msr_profile();
+    }
+    std::lock_guard<std::mutex> lock(msr_mutex);
+    install_restore_handlers();
+    // Reserved up front: the crash handler may walk it while CPUs are added
+    saved_msrs.reserve(saved_msrs.size() + cpus.size() * profile.writes.size());
+    int failed = 0;
+    for (int cpu : cpus) {
+        if (std::find(tuned_cpus.begin(), tuned_cpus.end(), cpu) != tuned_cpus.end()) {
+            continue;
+        }
+        std::string path = "/dev/cpu/" + std::to_string(cpu) + "/msr";
+        int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            if (failed++ == 0) {
+                error = path + ": " + strerror(errno) +
+                        (errno == ENOENT ? " (load the msr module: modprobe msr)" : errno == EACCES || errno == EPERM
+                         ? " (needs root)" : "");
+            }
+            continue;
+        }
+        bool ok = true;
+        const size_t saved_before = saved_msrs.size();
+        for (const MsrWrite& write : profile.writes) {
+            uint64_t original = 0;
+            if (pread(fd, &original, sizeof(original), write.reg) != sizeof(original)) {
+                ok = false;
+                continue;
+            }
+            uint64_t value = (original & ~write.mask) | (write.value & write.mask);
+            if (value == original) continue;
+            if (pwrite(fd, &value, sizeof(value), write.reg) != sizeof(value)) {
+                ok = false;
+                continue;
+            }
+            saved_msrs.push_back({cpu, fd, write.reg, original});
+        }
+        if (!ok && failed++ == 0) {
+            std::ostringstream message;
+            message << "CPU " << cpu << ": cannot read or write the registers (" << strerror(errno) << ")";
+            error = message.str();
+        }
+        if (saved_msrs.size() == saved_before) {
+            close(fd);  // Nothing to put back here
+        }
+        tuned_cpus.push_back(cpu);
+    }
+    if (!tuned_cpus.empty()) {
+        active_profile = profile.name;
+    }
+    LOG_DEBUG_STREAM("MSR profile " << profile.name << ": " << saved_msrs.size() << " registers changed on "
+                     << tuned_cpus.size() << " CPUs");
+    return failed == 0;
+#else
+    (void)profile;
+    (void)cpus;
+    error = "MSR profiles are only supported on Linux";
+    return false;
+#endif
+}
+
+void restore_msr_profile() {
+#ifdef __linux__
+    std::lock_guard<std::mutex> lock(msr_mutex);
+    if (!saved_msrs.empty()) {
+        LOG_DEBUG_STREAM("Restoring " << saved_msrs.size() << " MSRs changed by profile " << active_profile);
+    }
+    write_back_saved();
+    std::vector<int> fds;
+    for (const SavedMsr& saved : saved_msrs) {
+        if (std::find(fds.begin(), fds.end(), saved.fd) == fds.end()) fds.push_back(saved.fd);
+    }
+    for (int fd : fds) {
+        close(fd);
+    }
+    saved_msrs.clear();
+    tuned_cpus.clear();
+    active_profile.clear();
+#endif
+}
+
+std::string active_msr_profile() {
+    std::lock_guard<std::mutex> lock(msr_mutex);
+    return active_profile;
+}
@@ -0,0 +1,46 @@
+#ifndef MSR_PROFILE_H
+#define MSR_PROFILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One model-specific register write: the bits set in mask take value's, the
+// rest keep what the register held
+struct MsrWrite {
+    uint32_t reg;
+    uint64_t value;
+    uint64_t mask;
+
+    MsrWrite(uint32_t msr, uint64_t bits, uint64_t keep_mask = ~0ULL) : reg(msr), value(bits), mask(keep_mask) {}
+};
+
+// Hardware prefetcher settings for RandomX. Its dataset reads are random
+// and its scratchpad accesses mostly so, which the L2 streamer and adjacent
+// line prefetchers turn into wasted bandwidth and evictions; turning them
+// off is worth a few percent on most parts.
+struct MsrProfile {
+    std::string name;           // Preset name, or "custom"
+    std::vector<MsrWrite> writes;
+};
+
+// Presets: "intel" (MSR 0x1A4, all four prefetchers off), "ryzen17h" (Zen,
+// Zen 2), "ryzen19h" (Zen 3), "ryzen19h_zen4" and "ryzen1ah" (Zen 5); "auto"
+// picks one by CPU vendor and family. Anything else is a custom list of
+// hex "REG:VALUE[:MASK]" writes, comma separated. False with error set if
+// it can't be parsed or auto knows no preset for this CPU.
+bool parse_msr_profile(const std::string& spec, MsrProfile& profile, std::string& error);
+
+// Write profile on each of cpus through /dev/cpu/N/msr (Linux, root, the
+// msr module loaded), saving what each register held first. CPUs already
+// done are skipped, so it can be called again after the mining threads move;
+// a different profile restores the last one first. The saved values are
+// written back by restore_msr_profile, at exit and on a crash signal
+// (SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT). False with error set if any
+// CPU couldn't be written; the CPUs that could keep the profile.
+bool apply_msr_profile(const MsrProfile& profile, const std::vector<int>& cpus, std::string& error);
+void restore_msr_profile();
+// Name of the profile in effect, empty if none
+std::string active_msr_profile();
+
+#endif // MSR_PROFILE_H
@@ -0,0 +1,76 @@
+#include "network_stats.h"
+#include "trace_recorder.h"
+#include <chrono>
+
+NetworkStatsPoller::NetworkStatsPoller(const std::string& url, const std::string& user, const std::string& password,
+                                       bool query_balance, int interval_seconds)
+    : rpc_(url, user, password), query_balance_(query_balance), interval_seconds_(interval_seconds),
+      stop_(false) {
+    rpc_.set_abort_flag(&stop_);
+}
+
+void NetworkStatsPoller::start() {
+    if (!thread_.joinable()) {
+        thread_ = std::thread(&NetworkStatsPoller::run, this);
+    }
+}
+
+void NetworkStatsPoller::stop() {
+    stop_ = true;
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+NetworkStats NetworkStatsPoller::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void NetworkStatsPoller::run() {
+    TraceRecorder::set_thread_name("network stats");
+    std::vector<RPCBatchCall> calls;
+    calls.emplace_back("getmininginfo");
+    calls.emplace_back("getblockchaininfo");
+    if (query_balance_) {
+        // Skipped with --no-balance
+        calls.emplace_back("getwalletinfo");
+    }
+
+    while (!stop_.load()) {
+        NetworkStats stats = snapshot();
+
+        if (rpc_.call_batch(calls)) {
+            // Mining info (includes network hashrate and difficulty)
+            const Json::Value& mining_info = calls[0].result;
+            if (calls[0].ok) {
+                if (mining_info.isMember("networksolps")) {
+                    stats.network_hashrate = mining_info["networksolps"].asDouble();
+                }
+                if (mining_info.isMember("difficulty")) {
+                    stats.difficulty = mining_info["difficulty"].asDouble();
+                }
+            }
+
+            const Json::Value& blockchain_info = calls[1].result;
+            if (calls[1].ok && blockchain_info.isMember("blocks")) {
+                stats.tip_height = blockchain_info["blocks"].asUInt64();
+                stats.tip_time = std::chrono::steady_clock::now();
+            }
+
+            // Wallet balance: balance is mature (1000+ confirmations for
+            // coinbase), immature_balance the rest
+            if (query_balance_ && calls[2].ok) {
+                const Json::Value& wallet_info = calls[2].result;
+                stats.mature_balance = wallet_info["balance"].asDouble();
+                stats.immature_balance = wallet_info["immature_balance"].asDouble();
+                stats.total_balance = stats.mature_balance + stats.immature_balance;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        stats_ = stats;
+        cv_.wait_for(lock, std::chrono::seconds(interval_seconds_), [&]() { return stop_.load(); });
+    }
+}
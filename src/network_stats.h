@@ -0,0 +1,57 @@
+#ifndef NETWORK_STATS_H
+#define NETWORK_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "rpc_client.h"
+
+// Figures for the status screen that come from the node
+struct NetworkStats {
+    double network_hashrate = 0.0;
+    double difficulty = 0.0;
+    double mature_balance = 0.0;
+    double immature_balance = 0.0;
+    double total_balance = 0.0;
+    uint64_t tip_height = 0;                         // The node's best height (getblockchaininfo)
+    std::chrono::steady_clock::time_point tip_time;  // When tip_height was fetched (epoch if never)
+};
+
+// Refreshes NetworkStats every interval on its own thread and RPC
+// connection, so a slow wallet call never holds up the main loop in the
+// middle of a block change. getmininginfo, getwalletinfo and
+// getblockchaininfo go out as one batched request; the main loop's timed
+// tip check uses that tip instead of asking again.
+class NetworkStatsPoller {
+public:
+    NetworkStatsPoller(const std::string& url, const std::string& user, const std::string& password,
+                       bool query_balance, int interval_seconds);
+    ~NetworkStatsPoller() { stop(); }
+
+    NetworkStatsPoller(const NetworkStatsPoller&) = delete;
+    NetworkStatsPoller& operator=(const NetworkStatsPoller&) = delete;
+
+    void start();
+    void stop();
+
+    // The latest figures (zeros until the first refresh)
+    NetworkStats snapshot() const;
+
+private:
+    RPCClient rpc_;
+    bool query_balance_;
+    int interval_seconds_;
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    NetworkStats stats_;  // Guarded by mutex_
+    std::atomic<bool> stop_;
+
+    void run();
+};
+
+#endif // NETWORK_STATS_H
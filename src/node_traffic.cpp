@@ -0,0 +1,291 @@
+#include "node_traffic.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+TrafficRecorder* traffic_recorder = nullptr;
+TrafficReplay* traffic_replay = nullptr;
+
+// Held long polls and latencies re-check the abort flag this often
+static const auto REPLAY_WAIT_SLICE = std::chrono::milliseconds(100);
+
+TrafficRecorder::TrafficRecorder() : file_(nullptr), events_(0) {}
+
+TrafficRecorder::~TrafficRecorder() {
+    if (file_) {
+        fclose(file_);
+    }
+}
+
+bool TrafficRecorder::open(const std::string& path, std::string& error) {
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_) {
+        error = "can't create " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    fprintf(file_, "%s\n", NODE_TRAFFIC_MAGIC);
+    fflush(file_);
+    start_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+void TrafficRecorder::record(const std::string& kind, double latency_ms, bool ok, const std::string& body) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_) {
+        return;
+    }
+    unsigned long long time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start_).count();
+    unsigned long long latency_us = (unsigned long long)(latency_ms * 1000.0);
+    std::string& last = last_body_[kind];
+    if (ok && events_ && last == body) {
+        fprintf(file_, "%llu %s %llu ok -1\n", time_ms, kind.c_str(), latency_us);
+    } else {
+        fprintf(file_, "%llu %s %llu %s %zu\n", time_ms, kind.c_str(), latency_us, ok ? "ok" : "fail", body.size());
+        fwrite(body.data(), 1, body.size(), file_);
+        fputc('\n', file_);
+        if (ok) {
+            last = body;
+        }
+    }
+    // A recording cut short by a crash still replays up to that point
+    fflush(file_);
+    events_++;
+}
+
+size_t TrafficRecorder::event_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return events_;
+}
+
+// The longpollid of a getblocktemplate answer, empty if it has none
+static std::string answer_longpollid(const std::string& body) {
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    Json::Value response;
+    std::string errors;
+    if (!reader->parse(body.data(), body.data() + body.size(), &response, &errors) || !response.isObject()) {
+        return std::string();
+    }
+    const Json::Value& id = response["result"]["longpollid"];
+    return id.isString() ? id.asString() : std::string();
+}
+
+bool TrafficReplay::load(const std::string& path, std::string& error) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        error = "can't open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    std::string data;
+    char buffer[1 << 16];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.append(buffer, n);
+    }
+    fclose(file);
+
+    size_t pos = data.find('\n');
+    if (pos == std::string::npos || data.compare(0, pos, NODE_TRAFFIC_MAGIC) != 0) {
+        error = path + " is not a node traffic recording";
+        return false;
+    }
+    pos++;
+
+    std::map<std::string, size_t> last_of_kind;
+    while (pos < data.size()) {
+        size_t end = data.find('\n', pos);
+        if (end == std::string::npos) {
+            break;  // Cut short mid-line: replay what came before
+        }
+        std::istringstream line(data.substr(pos, end - pos));
+        TrafficEvent event;
+        std::string status;
+        long long length = 0;
+        if (!(line >> event.time_ms >> event.kind >> event.latency_us >> status >> length)) {
+            error = path + ": malformed event at byte " + std::to_string(pos);
+            return false;
+        }
+        event.ok = status == "ok";
+        pos = end + 1;
+        auto last = last_of_kind.find(event.kind);
+        if (length < 0) {
+            if (last == last_of_kind.end()) {
+                error = path + ": repeat of a " + event.kind + " answer never recorded";
+                return false;
+            }
+            event.body = events_[last->second].body;
+            event.longpollid = events_[last->second].longpollid;
+        } else {
+            if (pos + (size_t)length > data.size()) {
+                break;
+            }
+            event.body = data.substr(pos, (size_t)length);
+            pos += (size_t)length + 1;
+            if (event.ok && event.kind == "getblocktemplate") {
+                event.longpollid = answer_longpollid(event.body);
+            }
+        }
+        if (event.ok) {
+            last_of_kind[event.kind] = events_.size();
+        }
+        by_kind_[event.kind].push_back(events_.size());
+        events_.push_back(std::move(event));
+    }
+    // Answers from several connections interleave; keep each kind in time order
+    for (auto& entry : by_kind_) {
+        std::stable_sort(entry.second.begin(), entry.second.end(), [this](size_t a, size_t b) {
+            return events_[a].time_ms < events_[b].time_ms;
+        });
+    }
+    return true;
+}
+
+void TrafficReplay::start(double speed) {
+    speed_ = speed > 0 ? speed : 1.0;
+    start_ = std::chrono::steady_clock::now();
+}
+
+uint64_t TrafficReplay::now_ms() const {
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+    return (uint64_t)(elapsed * speed_);
+}
+
+std::chrono::steady_clock::duration TrafficReplay::until(uint64_t time_ms) const {
+    uint64_t now = now_ms();
+    if (time_ms <= now) {
+        return std::chrono::steady_clock::duration::zero();
+    }
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double, std::milli>((time_ms - now) / speed_));
+}
+
+bool TrafficReplay::wait_until(uint64_t time_ms, const std::atomic<bool>* abort) const {
+    for (;;) {
+        if (abort && abort->load()) {
+            return false;
+        }
+        auto remaining = until(time_ms);
+        if (remaining == std::chrono::steady_clock::duration::zero()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(remaining, REPLAY_WAIT_SLICE));
+    }
+}
+
+std::vector<const TrafficEvent*> TrafficReplay::hashblocks() const {
+    std::vector<const TrafficEvent*> result;
+    auto it = by_kind_.find("hashblock");
+    if (it != by_kind_.end()) {
+        for (size_t index : it->second) {
+            result.push_back(&events_[index]);
+        }
+    }
+    return result;
+}
+
+bool TrafficReplay::respond(const std::string& label, const Json::Value& request, const std::atomic<bool>* abort,
+                            std::string& body, double& latency_ms, std::string& error) {
+    const TrafficEvent* event = nullptr;
+    auto kind = by_kind_.find(label);
+    if (label == "submitblock") {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (kind != by_kind_.end() && next_submit_ < kind->second.size()) {
+            event = &events_[kind->second[next_submit_++]];
+        }
+    } else if (kind == by_kind_.end()) {
+        error = "No " + label + " answers in the recording";
+        return false;
+    } else {
+        // The node's state now: the last answer recorded by this time
+        const std::vector<size_t>& indices = kind->second;
+        uint64_t now = now_ms();
+        size_t current = 0;
+        while (current + 1 < indices.size() && events_[indices[current + 1]].time_ms <= now) {
+            current++;
+        }
+        event = &events_[indices[current]];
+
+        // A long poll is answered once the template moves on
+        std::string longpollid;
+        if (request.isObject() && request["params"].isArray() && request["params"].size() > 0 &&
+            request["params"][0].isObject() && request["params"][0]["longpollid"].isString()) {
+            longpollid = request["params"][0]["longpollid"].asString();
+        }
+        if (!longpollid.empty()) {
+            size_t next = current;
+            while (next < indices.size() && (!events_[indices[next]].ok ||
+                                             events_[indices[next]].longpollid == longpollid)) {
+                next++;
+            }
+            if (next == indices.size()) {
+                // Nothing newer was ever recorded: hold it like the node would
+                while (!(abort && abort->load())) {
+                    std::this_thread::sleep_for(REPLAY_WAIT_SLICE);
+                }
+                error = "Long poll aborted";
+                return false;
+            }
+            event = &events_[indices[next]];
+            if (!wait_until(event->time_ms, abort)) {
+                error = "Long poll aborted";
+                return false;
+            }
+        }
+    }
+
+    if (!event) {
+        // More blocks than the recording submitted: the node takes them
+        latency_ms = 0;
+        body = "{\"result\":null,\"error\":null,\"id\":" + std::to_string(request.isObject() ? request["id"].asInt64() : 0) + "}";
+        return true;
+    }
+    latency_ms = event->latency_us / 1000.0 / speed_;
+    auto answered = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(latency_ms));
+    while (std::chrono::steady_clock::now() < answered) {
+        if (abort && abort->load()) {
+            error = "Aborted";
+            return false;
+        }
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+            answered - std::chrono::steady_clock::now(), REPLAY_WAIT_SLICE));
+    }
+    if (!event->ok) {
+        error = event->body;
+        return false;
+    }
+    body = event->body;
+
+    // A batch's answers are matched to its calls by id: renumber them from
+    // this request's first id
+    if (request.isArray() && request.size() > 0) {
+        Json::CharReaderBuilder builder;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        Json::Value answers;
+        std::string errors;
+        if (reader->parse(body.data(), body.data() + body.size(), &answers, &errors) && answers.isArray()) {
+            Json::Int64 first = -1;
+            for (const Json::Value& answer : answers) {
+                if (answer["id"].isIntegral() && (first < 0 || answer["id"].asInt64() < first)) {
+                    first = answer["id"].asInt64();
+                }
+            }
+            Json::Int64 offset = request[0]["id"].asInt64() - first;
+            for (Json::Value& answer : answers) {
+                if (answer["id"].isIntegral()) {
+                    answer["id"] = answer["id"].asInt64() + offset;
+                }
+            }
+            Json::StreamWriterBuilder writer;
+            writer["indentation"] = "";
+            body = Json::writeString(writer, answers);
+        }
+    }
+    return true;
+}
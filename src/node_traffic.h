@@ -0,0 +1,107 @@
+#ifndef NODE_TRAFFIC_H
+#define NODE_TRAFFIC_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <json/json.h>
+
+// Recording and replaying what the node says (--record, --replay), so block
+// switch latency, epoch transitions and submission can be benchmarked end
+// to end, repeatably and without a live node.
+//
+// The file is text framing around raw response bodies: a header line, then
+// per event "<ms> <kind> <latency_us> <ok|fail> <length>", a newline and
+// length bytes of body plus a newline. kind is the RPC label (the method,
+// or the methods of a batch joined by '+') or "hashblock" for a ZMQ block
+// announcement, whose body is the block hash. A body identical to the last
+// one of its kind is written as length -1 and no body, so the repeated
+// templates and tip checks that make up most traffic cost one line each.
+
+static const char NODE_TRAFFIC_MAGIC[] = "juno-miner-traffic 1";
+
+struct TrafficEvent {
+    uint64_t time_ms;        // Since the recording started, when the answer arrived
+    std::string kind;
+    uint64_t latency_us;     // How long the node took to answer
+    bool ok;                 // False: the call failed in transport, body is the error
+    std::string body;
+    std::string longpollid;  // getblocktemplate answers: the template's longpollid
+};
+
+// Appends events to a file as they happen; every RPCClient and the ZMQ
+// subscriber write to the one recorder
+class TrafficRecorder {
+public:
+    TrafficRecorder();
+    ~TrafficRecorder();
+
+    TrafficRecorder(const TrafficRecorder&) = delete;
+    TrafficRecorder& operator=(const TrafficRecorder&) = delete;
+
+    bool open(const std::string& path, std::string& error);
+    void record(const std::string& kind, double latency_ms, bool ok, const std::string& body);
+
+    size_t event_count() const;
+
+private:
+    mutable std::mutex mutex_;
+    FILE* file_;
+    std::chrono::steady_clock::time_point start_;
+    std::map<std::string, std::string> last_body_;  // By kind, for the repeat marker
+    size_t events_;
+};
+
+// Answers RPC calls from a recording instead of a node. The recording's
+// clock runs at speed times real time from start(): a call gets the last
+// answer of its kind recorded by then (the node's state at that moment),
+// after the recorded latency; a long poll is held until an answer with a
+// different longpollid; submitblock answers come in recorded order, and
+// are null (accepted) once the recorded ones run out.
+class TrafficReplay {
+public:
+    TrafficReplay() : speed_(1.0), next_submit_(0) {}
+
+    TrafficReplay(const TrafficReplay&) = delete;
+    TrafficReplay& operator=(const TrafficReplay&) = delete;
+
+    bool load(const std::string& path, std::string& error);
+    void start(double speed);
+
+    // The response body for request (labelled as RPCClient labels it), or
+    // false with error set if the recording has nothing for it. Waits as the
+    // node did; gives up early once *abort is set.
+    bool respond(const std::string& label, const Json::Value& request, const std::atomic<bool>* abort,
+                 std::string& body, double& latency_ms, std::string& error);
+
+    // Block announcements, in order
+    std::vector<const TrafficEvent*> hashblocks() const;
+    // Real time until the replay clock reaches t (0 if it has)
+    std::chrono::steady_clock::duration until(uint64_t time_ms) const;
+    // Recording time of the last event
+    uint64_t duration_ms() const { return events_.empty() ? 0 : events_.back().time_ms; }
+    size_t event_count() const { return events_.size(); }
+
+private:
+    std::vector<TrafficEvent> events_;
+    std::map<std::string, std::vector<size_t>> by_kind_;  // Event indices, in time order
+    std::chrono::steady_clock::time_point start_;
+    double speed_;
+
+    std::mutex mutex_;
+    size_t next_submit_;  // Guarded by mutex_
+
+    uint64_t now_ms() const;
+    bool wait_until(uint64_t time_ms, const std::atomic<bool>* abort) const;
+};
+
+// The recorder or replay every RPCClient uses (null = talk to the node as usual)
+extern TrafficRecorder* traffic_recorder;
+extern TrafficReplay* traffic_replay;
+
+#endif // NODE_TRAFFIC_H
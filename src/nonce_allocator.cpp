@@ -0,0 +1,49 @@
+#include "nonce_allocator.h"
+#include "utils.h"
+#include <cstring>
+#include <random>
+
+NonceAllocator::NonceAllocator() {
+    init(false, true, 0);
+}
+
+NonceAllocator::NonceAllocator(bool deterministic, bool auto_instance_id, uint32_t instance_id) {
+    init(deterministic, auto_instance_id, instance_id);
+}
+
+void NonceAllocator::init(bool deterministic, bool auto_instance_id, uint32_t instance_id) {
+    deterministic_ = deterministic;
+    job_sequence_ = 0;
+    std::memset(salt_, 0, sizeof(salt_));
+
+    if (deterministic_) {
+        // Repeatable: no randomness anywhere, instance ID defaults to 0
+        instance_id_ = auto_instance_id ? 0 : instance_id;
+        return;
+    }
+
+    // Draw the randomness once per process instead of once per template
+    std::random_device rd;
+    instance_id_ = auto_instance_id ? static_cast<uint32_t>(rd()) : instance_id;
+    for (size_t i = 0; i < NONCE_SALT_SIZE; i += 4) {
+        utils::write_le32(salt_ + i, static_cast<uint32_t>(rd()));
+    }
+}
+
+void NonceAllocator::resume(uint32_t instance_id, uint32_t job_sequence, const uint8_t* salt) {
+    instance_id_ = instance_id;
+    job_sequence_ = job_sequence;
+    std::memcpy(salt_, salt, NONCE_SALT_SIZE);
+}
+
+void NonceAllocator::initial_nonce(unsigned int thread_id, uint32_t job_sequence, uint8_t* nonce) const {
+    std::memset(nonce, 0, 32);
+    nonce[NONCE_THREAD_OFFSET] = thread_id & 0xff;
+    nonce[NONCE_THREAD_OFFSET + 1] = (thread_id >> 8) & 0xff;
+    utils::write_le32(nonce + NONCE_INSTANCE_OFFSET, instance_id_);
+    utils::write_le32(nonce + NONCE_JOB_OFFSET, job_sequence);
+    std::memcpy(nonce + NONCE_SALT_OFFSET, salt_, NONCE_SALT_HEAD_SIZE);
+    // Counter (bytes 20-27) starts at zero
+    std::memcpy(nonce + NONCE_SALT_TAIL_OFFSET, salt_ + NONCE_SALT_HEAD_SIZE, NONCE_SALT_SIZE - NONCE_SALT_HEAD_SIZE);
+    // Bytes 30-31 stay zero
+}
@@ -0,0 +1,83 @@
+#ifndef NONCE_ALLOCATOR_H
+#define NONCE_ALLOCATOR_H
+
+#include <cstdint>
+#include <cstddef>
+#include "utils.h"
+
+// Partitions the 256-bit nNonce so every thread of every rig searches a
+// disjoint range. Layout (little-endian byte offsets within the nonce):
+//
+//   bytes  0-1   thread index
+//   bytes  2-5   instance ID (configured per rig, or random)
+//   bytes  6-9   job sequence (bumped on every start_mining)
+//   bytes 10-19  salt, first 10 bytes (random per process, zero in deterministic mode)
+//   bytes 20-27  per-thread counter, starts at 0 and is incremented by the worker
+//   bytes 28-29  salt, last 2 bytes
+//   bytes 30-31  always zero (matching the node's nonce >>= 16)
+//
+// The nonce sits at header offset 108, so only the counter lies past the
+// first 128-byte Blake2b block of the header: that block stays the same for
+// a thread's whole job and its compression is done once (see
+// randomx_search_nonce_midstate). The counter has 64 bits and never carries
+// into the salt: a thread stops on a job once it wraps, and two (instance,
+// thread) pairs never overlap on the same job.
+// In deterministic mode (and with a fixed instance ID) the nonces each thread
+// hashes depend only on the thread index and job sequence, which makes
+// benchmark runs comparable bit for bit.
+
+static const size_t NONCE_THREAD_OFFSET   = 0;
+static const size_t NONCE_INSTANCE_OFFSET = 2;
+static const size_t NONCE_JOB_OFFSET      = 6;
+static const size_t NONCE_SALT_OFFSET     = 10;
+static const size_t NONCE_COUNTER_OFFSET  = 20;
+static const size_t NONCE_SALT_TAIL_OFFSET = 28;
+static const size_t NONCE_SALT_SIZE       = 12;
+static const size_t NONCE_SALT_HEAD_SIZE  = NONCE_COUNTER_OFFSET - NONCE_SALT_OFFSET;
+
+// A thread's next nonce: its counter plus one
+inline void next_nonce(uint8_t* nonce) {
+    utils::write_le64(nonce + NONCE_COUNTER_OFFSET, utils::read_le64(nonce + NONCE_COUNTER_OFFSET) + 1);
+}
+
+// Whether the counter has wrapped back to zero, i.e. the thread has hashed its
+// whole range of the job (only meaningful once it has stepped past the first nonce)
+inline bool nonce_range_done(const uint8_t* nonce) {
+    return utils::read_le64(nonce + NONCE_COUNTER_OFFSET) == 0;
+}
+
+class NonceAllocator {
+public:
+    // Random instance ID and salt (default)
+    NonceAllocator();
+    NonceAllocator(bool deterministic, bool auto_instance_id, uint32_t instance_id);
+
+    // Advance to the next job; must be called before worker threads start
+    void next_job() { job_sequence_++; }
+
+    // Write the first nonce for a thread on the current job (32 bytes)
+    void initial_nonce(unsigned int thread_id, uint8_t* nonce) const {
+        initial_nonce(thread_id, job_sequence_, nonce);
+    }
+    // Same, for an explicit job sequence (a job published earlier)
+    void initial_nonce(unsigned int thread_id, uint32_t job_sequence, uint8_t* nonce) const;
+
+    // Continue another process's nonce space (zero-downtime upgrade): its
+    // instance ID and salt, with jobs numbered from job_sequence on
+    void resume(uint32_t instance_id, uint32_t job_sequence, const uint8_t* salt);
+
+    bool is_deterministic() const { return deterministic_; }
+    uint32_t get_instance_id() const { return instance_id_; }
+    uint32_t get_job_sequence() const { return job_sequence_; }
+    const uint8_t* get_salt() const { return salt_; }
+
+private:
+    bool deterministic_;
+    uint32_t instance_id_;
+    uint32_t job_sequence_;
+    uint8_t salt_[NONCE_SALT_SIZE];
+
+    void init(bool deterministic, bool auto_instance_id, uint32_t instance_id);
+};
+
+#endif // NONCE_ALLOCATOR_H
@@ -0,0 +1,163 @@
+#include "numa_locality.h"
+#include <cstdint>
+#include <sstream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+int PagePlacement::majority_node() const {
+    int node = -1;
+    for (size_t n = 0; n < node_pages.size(); n++) {
+        if (node_pages[n] > 0 && (node < 0 || node_pages[n] > node_pages[node])) {
+            node = (int)n;
+        }
+    }
+    return node;
+}
+
+double PagePlacement::share_on(int node) const {
+    size_t placed = sampled - unplaced;
+    if (placed == 0 || node < 0 || node >= (int)node_pages.size()) {
+        return 0;
+    }
+    return (double)node_pages[node] / placed;
+}
+
+std::string PagePlacement::describe() const {
+    if (sampled == unplaced) {
+        return "not faulted in";
+    }
+    std::ostringstream ss;
+    bool first = true;
+    for (size_t n = 0; n < node_pages.size(); n++) {
+        if (node_pages[n] == 0) continue;
+        ss << (first ? "" : ", ") << "node " << n << " " << (int)(share_on((int)n) * 100 + 0.5) << "%";
+        first = false;
+    }
+    return ss.str();
+}
+
+#ifdef __linux__
+
+bool query_page_placement(const void* address, size_t size, PagePlacement& placement) {
+    placement = PagePlacement();
+    if (!address || size == 0) {
+        return true;
+    }
+    const uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t first = (uintptr_t)address & ~(page_size - 1);
+    const size_t total = (size_t)(((uintptr_t)address + size - first + page_size - 1) / page_size);
+    const size_t count = total < LOCALITY_SAMPLE_PAGES ? total : LOCALITY_SAMPLE_PAGES;
+
+    std::vector<void*> pages(count);
+    std::vector<int> status(count, -ENOENT);
+    for (size_t i = 0; i < count; i++) {
+        pages[i] = (void*)(first + (uintptr_t)(i * total / count) * page_size);
+    }
+    // No target nodes: only report where each page is
+    if (syscall(SYS_move_pages, 0, (unsigned long)count, pages.data(), nullptr, status.data(), 0) != 0) {
+        return false;
+    }
+    placement.sampled = count;
+    for (int node : status) {
+        if (node < 0) {
+            placement.unplaced++;
+            continue;
+        }
+        if ((size_t)node >= placement.node_pages.size()) {
+            placement.node_pages.resize(node + 1);
+        }
+        placement.node_pages[node]++;
+    }
+    return true;
+}
+
+#else
+
+bool query_page_placement(const void* address, size_t size, PagePlacement& placement) {
+    (void)address;
+    (void)size;
+    placement = PagePlacement();
+    return false;
+}
+
+#endif
+
+bool ThreadLocality::local() const {
+    return cpu_node < 0 || ((scratchpad_share < 0 || scratchpad_share >= 0.5) && (data_share < 0 || data_share >= 0.5));
+}
+
+size_t MemoryLocality::remote_threads() const {
+    size_t remote = 0;
+    for (const ThreadLocality& thread : threads) {
+        if (!thread.local()) remote++;
+    }
+    return remote;
+}
+
+static std::string share_text(double share) {
+    if (share < 0) {
+        return "?";
+    }
+    return std::to_string((int)(share * 100 + 0.5)) + "%";
+}
+
+std::string MemoryLocality::describe() const {
+    std::ostringstream ss;
+    ss << summary();
+    if (!supported) {
+        return ss.str();
+    }
+    for (const MemoryRegionLocality& region : regions) {
+        if (region.thread >= 0) continue;  // Shown with their threads
+        ss << "\n  " << region.region;
+        if (region.intended_node >= 0) {
+            ss << " (node " << region.intended_node << " replica)";
+        }
+        ss << ": " << region.placement.describe();
+        int majority = region.placement.majority_node();
+        if (region.intended_node >= 0 && majority >= 0 && majority != region.intended_node) {
+            ss << " MISPLACED";
+        }
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        const ThreadLocality& thread = threads[t];
+        ss << "\n  Thread " << t << " on CPU ";
+        if (thread.cpu >= 0) {
+            ss << thread.cpu << " (node " << thread.cpu_node << ")";
+        } else {
+            ss << "?";
+        }
+        ss << ": scratchpad " << share_text(thread.scratchpad_share) << ", JIT " << share_text(thread.jit_share)
+           << ", dataset/cache " << share_text(thread.data_share) << " local";
+        if (thread.intended_node >= 0 && thread.cpu_node >= 0 && thread.cpu_node != thread.intended_node) {
+            ss << ", placed for node " << thread.intended_node;
+        }
+        if (!thread.local()) {
+            ss << " REMOTE";
+        }
+    }
+    return ss.str();
+}
+
+std::string MemoryLocality::summary() const {
+    if (!supported) {
+        return "page placement unavailable (no NUMA support in this kernel or OS)";
+    }
+    std::ostringstream ss;
+    if (nodes <= 1) {
+        ss << "single NUMA node";
+    } else {
+        size_t remote = remote_threads();
+        if (remote == 0) {
+            ss << "all " << threads.size() << " threads local";
+        } else {
+            ss << remote << " of " << threads.size() << " threads with remote memory";
+        }
+        ss << " across " << nodes << " nodes";
+    }
+    return ss.str();
+}
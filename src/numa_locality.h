@@ -0,0 +1,74 @@
+#ifndef NUMA_LOCALITY_H
+#define NUMA_LOCALITY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Pages looked at per memory region. The dataset is half a million 4 KB
+// pages; an even spread of a few hundred tells where it lives just as well.
+static const size_t LOCALITY_SAMPLE_PAGES = 512;
+
+// Where the pages of one memory region actually are, from an even sample
+// of them
+struct PagePlacement {
+    std::vector<size_t> node_pages;  // Sampled pages per NUMA node
+    size_t sampled;
+    size_t unplaced;                 // Not faulted in yet (or not queryable)
+
+    PagePlacement() : sampled(0), unplaced(0) {}
+    // Node holding the most sampled pages, -1 if none is placed
+    int majority_node() const;
+    // Share of the placed samples on node, 0 to 1
+    double share_on(int node) const;
+    // "node 0 100%", "node 0 75%, node 1 25%" or "not faulted in"
+    std::string describe() const;
+};
+
+// Ask the kernel (move_pages in query mode, so nothing moves; no libnuma
+// needed) which node each sampled page of [address, address + size) is on.
+// False if it can't tell: not Linux, or a kernel without NUMA support.
+bool query_page_placement(const void* address, size_t size, PagePlacement& placement);
+
+// One of the miner's memory regions
+struct MemoryRegionLocality {
+    std::string region;   // "dataset", "partial_dataset", "cache", "scratchpad" or "jit"
+    int thread;           // Worker owning a scratchpad or JIT buffer, -1 if shared
+    int intended_node;    // Node it was allocated on, -1 if none in particular
+    PagePlacement placement;
+
+    MemoryRegionLocality() : thread(-1), intended_node(-1) {}
+};
+
+// A worker's CPU against the memory it hashes with. The shares are of the
+// region's placed pages on the CPU's node, -1 where unknown.
+struct ThreadLocality {
+    int cpu;              // Where the worker last picked up a job, -1 if unknown
+    int cpu_node;
+    int intended_node;    // Where the placement meant it to run
+    double scratchpad_share;
+    double jit_share;
+    double data_share;    // The dataset, or the cache in light mode
+
+    ThreadLocality()
+        : cpu(-1), cpu_node(-1), intended_node(-1), scratchpad_share(-1), jit_share(-1), data_share(-1) {}
+    // Scratchpad and data mostly (at least half) on the CPU's node
+    bool local() const;
+};
+
+struct MemoryLocality {
+    bool supported;       // False: the kernel can't report page placement
+    int nodes;            // NUMA nodes with CPUs
+    std::vector<MemoryRegionLocality> regions;
+    std::vector<ThreadLocality> threads;
+
+    MemoryLocality() : supported(false), nodes(0) {}
+    // Threads whose memory isn't local
+    size_t remote_threads() const;
+    // A line per region and per thread, for the log
+    std::string describe() const;
+    // "all 8 threads local", "2 of 8 threads with remote memory", ...
+    std::string summary() const;
+};
+
+#endif // NUMA_LOCALITY_H
@@ -0,0 +1,60 @@
+#include "numa_windows.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <algorithm>
+#include "cpu_topology.h"
+#include "virtual_memory.h"
+
+int numa_available() {
+    ULONG highest = 0;
+    return GetNumaHighestNodeNumber(&highest) ? 0 : -1;
+}
+
+int numa_num_configured_nodes() {
+    ULONG highest = 0;
+    return GetNumaHighestNodeNumber(&highest) ? (int)highest + 1 : 1;
+}
+
+int numa_num_configured_cpus() {
+    return (int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+}
+
+struct bitmask* numa_allocate_cpumask() {
+    struct bitmask* mask = new bitmask;
+    mask->bits.assign(numa_num_configured_cpus(), false);
+    return mask;
+}
+
+void numa_free_cpumask(struct bitmask* mask) {
+    delete mask;
+}
+
+int numa_bitmask_isbitset(const struct bitmask* mask, unsigned int n) {
+    return n < mask->bits.size() && mask->bits[n];
+}
+
+int numa_node_to_cpus(int node, struct bitmask* mask) {
+    GROUP_AFFINITY affinity;
+    if (node < 0 || !GetNumaNodeProcessorMaskEx((USHORT)node, &affinity)) {
+        return -1;
+    }
+    const std::vector<int> bases = processor_group_bases();
+    if (affinity.Group >= bases.size()) {
+        return -1;
+    }
+    std::fill(mask->bits.begin(), mask->bits.end(), false);
+    for (int bit = 0; bit < (int)(8 * sizeof(KAFFINITY)); bit++) {
+        size_t cpu = (size_t)(bases[affinity.Group] + bit);
+        if ((affinity.Mask & ((KAFFINITY)1 << bit)) && cpu < mask->bits.size()) {
+            mask->bits[cpu] = true;
+        }
+    }
+    return 0;
+}
+
+void numa_set_preferred(int node) {
+    setPreferredMemoryNode(node);
+}
+
+#endif // _WIN32
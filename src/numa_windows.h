@@ -0,0 +1,30 @@
+#ifndef NUMA_WINDOWS_H
+#define NUMA_WINDOWS_H
+
+#ifdef _WIN32
+#include <vector>
+
+// The part of libnuma the miner uses, on the Windows NUMA API, so the
+// HAVE_NUMA paths (per-node caches, dataset replicas and VMs) run unchanged
+// on Windows. CPUs are numbered across processor groups as in CpuTopology.
+// numa_set_preferred makes the calling thread's later RandomX allocations
+// (large-page dataset, caches and scratchpads, JIT code) come from that node
+// through VirtualAllocExNuma (randomx setPreferredMemoryNode); -1 clears it.
+
+struct bitmask {
+    std::vector<bool> bits;
+};
+
+int numa_available();
+int numa_num_configured_nodes();
+int numa_num_configured_cpus();
+struct bitmask* numa_allocate_cpumask();
+void numa_free_cpumask(struct bitmask* mask);
+int numa_bitmask_isbitset(const struct bitmask* mask, unsigned int n);
+// The node's processors (Windows keeps a node within one processor group)
+int numa_node_to_cpus(int node, struct bitmask* mask);
+void numa_set_preferred(int node);
+
+#endif // _WIN32
+
+#endif // NUMA_WINDOWS_H
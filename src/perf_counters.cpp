@@ -0,0 +1,171 @@
+#include "perf_counters.h"
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+uint64_t cache_event(uint64_t cache, uint64_t op, uint64_t result) {
+    return cache | (op << 8) | (result << 16);
+}
+
+// type and config of each PerfEvent
+void event_config(int event, __u32& type, __u64& config) {
+    switch (event) {
+        case PERF_CYCLES:
+            type = PERF_TYPE_HARDWARE;
+            config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            type = PERF_TYPE_HARDWARE;
+            config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_L1D_MISSES:
+            type = PERF_TYPE_HW_CACHE;
+            config = cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        case PERF_LLC_MISSES:
+            type = PERF_TYPE_HW_CACHE;
+            config = cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        case PERF_DTLB_MISSES:
+            type = PERF_TYPE_HW_CACHE;
+            config = cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        case PERF_DRAM_READS:
+            type = PERF_TYPE_HW_CACHE;
+            config = cache_event(PERF_COUNT_HW_CACHE_NODE, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_ACCESS);
+            break;
+        case PERF_REMOTE_DRAM_READS:
+            type = PERF_TYPE_HW_CACHE;
+            config = cache_event(PERF_COUNT_HW_CACHE_NODE, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        default:
+            type = PERF_TYPE_HARDWARE;
+            config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+}
+
+int open_event(int event, int thread_id) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    event_config(event, attr.type, attr.config);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, (pid_t)thread_id, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+} // namespace
+
+PerfCounters::~PerfCounters() {
+    close_all();
+}
+
+void PerfCounters::close_all() {
+    for (auto& thread : fds_) {
+        for (int fd : thread) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+    fds_.clear();
+}
+
+bool PerfCounters::open(const std::vector<int>& thread_ids, std::string& error) {
+    close_all();
+    int opened = 0;
+    int first_errno = 0;
+    for (int thread_id : thread_ids) {
+        std::array<int, PERF_EVENTS> fds;
+        fds.fill(-1);
+        for (int event = 0; event < PERF_EVENTS && thread_id > 0; event++) {
+            fds[event] = open_event(event, thread_id);
+            if (fds[event] >= 0) {
+                opened++;
+            } else if (!first_errno) {
+                first_errno = errno;
+            }
+        }
+        fds_.push_back(fds);
+    }
+    if (opened == 0) {
+        error = std::string("perf_event_open failed: ") + std::strerror(first_errno ? first_errno : ESRCH);
+        if (first_errno == EACCES || first_errno == EPERM) {
+            error += " (check /proc/sys/kernel/perf_event_paranoid)";
+        } else if (first_errno == ENOENT || first_errno == EOPNOTSUPP) {
+            error += " (no hardware counters here, e.g. a VM without a virtual PMU)";
+        }
+        close_all();
+        return false;
+    }
+    return true;
+}
+
+void PerfCounters::start() {
+    for (const auto& thread : fds_) {
+        for (int fd : thread) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+}
+
+void PerfCounters::stop() {
+    for (const auto& thread : fds_) {
+        for (int fd : thread) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+    }
+}
+
+std::vector<PerfCounts> PerfCounters::read() const {
+    std::vector<PerfCounts> counts(fds_.size());
+    for (size_t i = 0; i < fds_.size(); i++) {
+        for (int event = 0; event < PERF_EVENTS; event++) {
+            uint64_t data[3];  // value, time enabled, time running
+            int fd = fds_[i][event];
+            if (fd < 0 || ::read(fd, data, sizeof(data)) != (ssize_t)sizeof(data) || data[2] == 0) {
+                continue;
+            }
+            counts[i].values[event] = data[2] < data[1] ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+            counts[i].counted[event] = true;
+        }
+    }
+    return counts;
+}
+
+#else
+
+PerfCounters::~PerfCounters() {}
+
+void PerfCounters::close_all() {}
+
+bool PerfCounters::open(const std::vector<int>& thread_ids, std::string& error) {
+    (void)thread_ids;
+    error = "hardware counters are only supported on Linux";
+    return false;
+}
+
+void PerfCounters::start() {}
+
+void PerfCounters::stop() {}
+
+std::vector<PerfCounts> PerfCounters::read() const {
+    return std::vector<PerfCounts>();
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Hardware events counted per worker thread. The kernel's generic events
+// only: L2 has none that works across vendors, so it is left out. DRAM
+// reads are the "node" cache events (perf's node-loads and
+// node-load-misses): every DRAM read, and those served by another node.
+enum PerfEvent {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_DRAM_READS,
+    PERF_REMOTE_DRAM_READS,
+    PERF_BRANCH_MISSES,
+    PERF_EVENTS
+};
+
+static const char* const PERF_EVENT_NAMES[PERF_EVENTS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "dram_reads", "remote_dram_reads",
+    "branch_misses"
+};
+
+// One thread's counts, scaled up where the kernel had to multiplex the
+// counters. counted is false for events it couldn't count at all.
+struct PerfCounts {
+    std::array<uint64_t, PERF_EVENTS> values;
+    std::array<bool, PERF_EVENTS> counted;
+
+    PerfCounts() : values(), counted() {}
+};
+
+// perf_event_open counters on a set of threads (user space only, so the
+// default perf_event_paranoid of 2 allows them), each event counted on its
+// own and multiplexed by the kernel if there are more than the PMU holds.
+class PerfCounters {
+public:
+    PerfCounters() {}
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Open the events on each thread (Linux thread IDs). False with error set
+    // if no event could be opened on any thread; events that only some
+    // threads or none could count are just missing from their counts.
+    bool open(const std::vector<int>& thread_ids, std::string& error);
+    // Zero and start every counter
+    void start();
+    void stop();
+    // Per thread, in the order given to open
+    std::vector<PerfCounts> read() const;
+
+private:
+    std::vector<std::array<int, PERF_EVENTS>> fds_;
+
+    void close_all();
+};
+
+#endif // PERF_COUNTERS_H
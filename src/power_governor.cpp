@@ -0,0 +1,347 @@
+#include "power_governor.h"
+#include "logger.h"
+#include "mining_backend.h"
+#include "telemetry_journal.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+bool read_line(const fs::path& path, std::string& line) {
+    std::ifstream file(path);
+    return file && std::getline(file, line);
+}
+
+bool read_u64(const fs::path& path, uint64_t& value) {
+    std::ifstream file(path);
+    return file && file >> value;
+}
+
+}  // namespace
+
+bool PowerMeter::open() {
+    counters_.clear();
+    std::error_code ec;
+    for (const fs::directory_entry& entry : fs::directory_iterator("/sys/class/powercap", ec)) {
+        // Top-level zones only: intel-rapl:0, not its core and dram subzones
+        // (intel-rapl:0:0), which the package already counts
+        std::string zone = entry.path().filename().string();
+        if (zone.compare(0, 11, "intel-rapl:") != 0 || zone.find(':', 11) != std::string::npos) {
+            continue;
+        }
+        std::string name;
+        // "psys" is the whole platform, on top of the packages
+        if (!read_line(entry.path() / "name", name) || name.compare(0, 7, "package") != 0) {
+            continue;
+        }
+        Counter counter;
+        counter.path = (entry.path() / "energy_uj").string();
+        counter.total = 0;
+        if (!read_u64(entry.path() / "max_energy_range_uj", counter.range)) {
+            counter.range = 0;
+        }
+        if (read_u64(counter.path, counter.last)) {
+            counters_.push_back(counter);
+        }
+    }
+    if (!counters_.empty()) {
+        source_ = "RAPL, " + std::to_string(counters_.size()) + (counters_.size() == 1 ? " package" : " packages");
+        return true;
+    }
+
+    for (const fs::directory_entry& entry : fs::directory_iterator("/sys/class/hwmon", ec)) {
+        std::string name;
+        if (!read_line(entry.path() / "name", name) || name != "amd_energy") {
+            continue;
+        }
+        // One counter per core and one per socket ("Esocket0"); the sockets
+        // are what RAPL calls packages. 64-bit, accumulated by the driver.
+        for (int index = 1; index < 1024; index++) {
+            std::string label;
+            fs::path input = entry.path() / ("energy" + std::to_string(index) + "_input");
+            if (!read_line(entry.path() / ("energy" + std::to_string(index) + "_label"), label)) {
+                break;
+            }
+            Counter counter;
+            counter.path = input.string();
+            counter.range = 0;
+            counter.total = 0;
+            if (label.compare(0, 7, "Esocket") == 0 && read_u64(input, counter.last)) {
+                counters_.push_back(counter);
+            }
+        }
+    }
+    if (!counters_.empty()) {
+        source_ = "amd_energy, " + std::to_string(counters_.size()) + (counters_.size() == 1 ? " socket" : " sockets");
+        return true;
+    }
+    source_.clear();
+    return false;
+}
+
+double PowerMeter::joules() {
+    double total = 0;
+    for (Counter& counter : counters_) {
+        uint64_t value;
+        if (read_u64(counter.path, value)) {
+            uint64_t delta = value >= counter.last ? value - counter.last
+                           : counter.range > counter.last ? counter.range - counter.last + value : 0;
+            counter.total += delta / 1e6;
+            counter.last = value;
+        }
+        total += counter.total;
+    }
+    return total;
+}
+
+bool CpuTemperature::open() {
+    sensors_.clear();
+    std::error_code ec;
+    std::vector<fs::path> hwmons;
+    for (const fs::directory_entry& entry : fs::directory_iterator("/sys/class/hwmon", ec)) {
+        hwmons.push_back(entry.path());
+    }
+    std::sort(hwmons.begin(), hwmons.end());
+    std::map<std::string, int> seen;
+    for (const fs::path& hwmon : hwmons) {
+        std::string driver;
+        if (!read_line(hwmon / "name", driver) ||
+            (driver != "coretemp" && driver != "k10temp" && driver != "zenpower")) {
+            continue;
+        }
+        for (int index = 1; index < 256; index++) {
+            std::string label;
+            fs::path input = hwmon / ("temp" + std::to_string(index) + "_input");
+            if (!read_line(hwmon / ("temp" + std::to_string(index) + "_label"), label)) {
+                if (!fs::exists(input, ec)) {
+                    break;
+                }
+                continue;
+            }
+            // The package, not each core
+            if (label.compare(0, 10, "Package id") != 0 && label != "Tctl" && label != "Tdie") {
+                continue;
+            }
+            uint64_t value;
+            if (!read_u64(input, value)) {
+                continue;
+            }
+            // One k10temp per socket, all with the same labels
+            Sensor sensor;
+            sensor.name = driver + " " + label;
+            int count = seen[sensor.name]++;
+            if (count > 0) {
+                sensor.name += " " + std::to_string(count);
+            }
+            sensor.path = input.string();
+            sensors_.push_back(sensor);
+        }
+    }
+    return !sensors_.empty();
+}
+
+std::vector<CpuTemperature::Reading> CpuTemperature::read() const {
+    std::vector<Reading> readings;
+    for (const Sensor& sensor : sensors_) {
+        std::string line;
+        if (read_line(sensor.path, line)) {
+            readings.push_back(Reading{sensor.name, std::atof(line.c_str()) / 1000.0});
+        }
+    }
+    return readings;
+}
+
+PowerGovernor::PowerGovernor(MiningBackend& backend, const PowerLimits& limits)
+    : backend_(backend), limits_(limits), threads_(0), stop_(false) {}
+
+bool PowerGovernor::start(unsigned int threads) {
+    if (thread_.joinable()) {
+        return true;
+    }
+    if (!meter_.open()) {
+        return false;
+    }
+    threads_ = threads;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = false;
+        sample_ = PowerSample();
+        sample_.workers = threads;
+        sample_.threads = threads;
+    }
+    thread_ = std::thread(&PowerGovernor::run, this);
+    return true;
+}
+
+void PowerGovernor::set_thread_count(unsigned int threads) {
+    threads_ = threads;
+}
+
+void PowerGovernor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+PowerSample PowerGovernor::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sample_;
+}
+
+void PowerGovernor::run() {
+    struct Point {
+        std::chrono::steady_clock::time_point time;
+        double joules;
+        uint64_t hashes;
+    };
+    const bool controls = limits_.controls();
+    std::deque<Point> window;
+    window.push_back({std::chrono::steady_clock::now(), meter_.joules(), backend_.get_hash_count()});
+
+    unsigned int threads = threads_.load();
+    unsigned int workers = threads;
+    unsigned int ceiling = threads;                     // Highest count the cap allows for now
+    std::chrono::steady_clock::time_point ceiling_until;
+    int calm_samples = 0;
+    int settle = POWER_SETTLE_SAMPLES;
+    double measure_joules = 0;
+    uint64_t measure_hashes = 0;
+    int measure_samples = 0;
+    int windows_at_count = 0;
+    std::map<unsigned int, double> efficiency;          // Hashes per joule by worker count
+    if (controls) {
+        backend_.set_worker_limit(workers);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cv_.wait_for(lock, std::chrono::milliseconds(POWER_INTERVAL_MS), [this]() { return stop_; })) {
+        lock.unlock();
+        Point point = {std::chrono::steady_clock::now(), meter_.joules(), backend_.get_hash_count()};
+        const Point& last = window.back();
+        double seconds = std::chrono::duration<double>(point.time - last.time).count();
+        double joules = point.joules - last.joules;
+        // The counters start over when the pool is rebuilt
+        uint64_t hashes = point.hashes >= last.hashes ? point.hashes - last.hashes : 0;
+        double watts = seconds > 0 ? joules / seconds : 0;
+        if (telemetry_journal) {
+            telemetry_journal->record(JOURNAL_POWER, JOURNAL_NO_THREAD, 0, (uint64_t)(watts * 1000));
+        }
+        window.push_back(point);
+        while (point.time - window.front().time > std::chrono::seconds(POWER_REPORT_WINDOW_S)) {
+            window.pop_front();
+        }
+
+        unsigned int target = workers;
+        if (threads_.load() != threads) {
+            // New pool: every count measured so far is out of date
+            threads = threads_.load();
+            target = ceiling = threads;
+            efficiency.clear();
+        } else if (controls) {
+            if (ceiling < threads && point.time >= ceiling_until) {
+                ceiling = threads;
+            }
+            if (limits_.cap_watts > 0 && watts > limits_.cap_watts) {
+                if (workers > 1) {
+                    target = ceiling = workers - 1;
+                    ceiling_until = point.time + std::chrono::seconds(POWER_CAP_HOLD_S);
+                    LOG_INFO_STREAM("Power: " << target << "/" << threads << " workers (" << (int)watts
+                                    << " W over the " << limits_.cap_watts << " W cap)");
+                }
+            } else if (limits_.efficiency) {
+                if (settle > 0) {
+                    settle--;
+                } else {
+                    measure_joules += joules;
+                    measure_hashes += hashes;
+                    if (++measure_samples >= POWER_EFFICIENCY_WINDOW) {
+                        efficiency[workers] = measure_joules > 0 ? measure_hashes / measure_joules : 0;
+                        measure_joules = 0;
+                        measure_hashes = 0;
+                        measure_samples = 0;
+                        if (++windows_at_count >= POWER_EFFICIENCY_REPROBE) {
+                            efficiency.erase(workers - 1);
+                            efficiency.erase(workers + 1);
+                            windows_at_count = 0;
+                        }
+                        // Walk to the best measured neighbour; from the best,
+                        // measure a neighbour not yet known, fewer first
+                        unsigned int best = workers;
+                        bool unknown_lower = workers > 1 && !efficiency.count(workers - 1);
+                        bool unknown_upper = workers < ceiling && !efficiency.count(workers + 1);
+                        for (unsigned int neighbour : {workers - 1, workers + 1}) {
+                            if (neighbour >= 1 && neighbour <= ceiling && efficiency.count(neighbour) &&
+                                efficiency[neighbour] > efficiency[best]) {
+                                best = neighbour;
+                            }
+                        }
+                        target = best != workers ? best
+                               : unknown_lower ? workers - 1
+                               : unknown_upper ? workers + 1 : workers;
+                        if (target != workers) {
+                            LOG_DEBUG_STREAM("Power: " << workers << " workers at " << efficiency[workers]
+                                             << " H/J, trying " << target);
+                        }
+                    }
+                }
+            }
+            if (limits_.cap_watts > 0 && target == workers && !limits_.efficiency) {
+                // Under the cap with room to spare: give a worker back
+                if (watts < limits_.cap_watts * (1.0 - POWER_CAP_MARGIN)) {
+                    if (++calm_samples >= POWER_CAP_RESUME_SAMPLES && workers < ceiling) {
+                        target = workers + 1;
+                    }
+                } else {
+                    calm_samples = 0;
+                }
+            }
+        }
+
+        bool changed = target != workers;
+        if (changed) {
+            if (controls) {
+                backend_.set_worker_limit(target);
+            }
+            workers = target;
+            calm_samples = 0;
+            settle = POWER_SETTLE_SAMPLES;
+            measure_joules = 0;
+            measure_hashes = 0;
+            measure_samples = 0;
+            windows_at_count = 0;
+        }
+
+        PowerSample sample;
+        sample.available = true;
+        double span = std::chrono::duration<double>(point.time - window.front().time).count();
+        uint64_t span_hashes = point.hashes >= window.front().hashes ? point.hashes - window.front().hashes : 0;
+        if (span > 0) {
+            sample.watts = (point.joules - window.front().joules) / span;
+            sample.hashrate = span_hashes / span;
+            sample.hashes_per_joule = sample.watts > 0 ? sample.hashrate / sample.watts : 0;
+        }
+        sample.workers = controls ? workers : backend_.get_worker_limit();
+        sample.threads = threads;
+
+        lock.lock();
+        sample.adjustments = sample_.adjustments + (changed && controls ? 1 : 0);
+        sample_ = sample;
+    }
+    lock.unlock();
+    // Hand every worker back, as ColocationGovernor does
+    if (controls) {
+        backend_.set_worker_limit(threads_.load());
+    }
+}
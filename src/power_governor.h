@@ -0,0 +1,144 @@
+#ifndef POWER_GOVERNOR_H
+#define POWER_GOVERNOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class MiningBackend;
+
+// How often the governor samples package power (milliseconds)
+static const int POWER_INTERVAL_MS = 1000;
+// Span the reported power and efficiency are averaged over (seconds)
+static const int POWER_REPORT_WINDOW_S = 10;
+// Power cap: a worker comes back after this many samples in a row at least
+// POWER_CAP_MARGIN under the cap; a count that went over is not tried again
+// for POWER_CAP_HOLD_S
+static const int POWER_CAP_RESUME_SAMPLES = 3;
+static const double POWER_CAP_MARGIN = 0.05;
+static const int POWER_CAP_HOLD_S = 60;
+// Efficiency search: after a change, samples skipped while the package
+// settles, then samples measured per worker count; the neighbours of the
+// chosen count are measured again after POWER_EFFICIENCY_REPROBE windows
+static const int POWER_SETTLE_SAMPLES = 3;
+static const int POWER_EFFICIENCY_WINDOW = 20;
+static const int POWER_EFFICIENCY_REPROBE = 15;
+
+// CPU package energy. Linux only: the powercap RAPL zones
+// (/sys/class/powercap/intel-rapl:N, which also covers AMD Zen since 5.8),
+// else the amd_energy hwmon driver. Since 5.10 the counters are readable
+// by root only.
+class PowerMeter {
+public:
+    PowerMeter() {}
+
+    // Find the package counters; false if there are none readable
+    bool open();
+    bool available() const { return !counters_.empty(); }
+    // "RAPL, 2 packages" or "amd_energy, 1 socket"
+    const std::string& source() const { return source_; }
+    // Joules all packages used since open(). RAPL counters wrap (every few
+    // minutes on a busy server), so call at least once a minute.
+    double joules();
+
+private:
+    struct Counter {
+        std::string path;       // energy_uj or energyN_input, in microjoules
+        uint64_t range;         // Value it wraps at, 0 = never
+        uint64_t last;
+        double total;
+    };
+
+    std::vector<Counter> counters_;
+    std::string source_;
+};
+
+// CPU package temperatures from hwmon (coretemp's "Package id N", the
+// Tctl/Tdie of k10temp and zenpower), for the journal. Linux only.
+class CpuTemperature {
+public:
+    struct Reading {
+        std::string name;       // "coretemp Package id 0"
+        double celsius;
+    };
+
+    // Find the sensors; false if there are none readable
+    bool open();
+    bool available() const { return !sensors_.empty(); }
+    std::vector<Reading> read() const;
+
+private:
+    struct Sensor {
+        std::string name;
+        std::string path;       // tempN_input, in millidegrees
+    };
+
+    std::vector<Sensor> sensors_;
+};
+
+// What to hold the package to; neither set = only measure
+struct PowerLimits {
+    double cap_watts;           // Hold package power under this, 0 = no cap
+    bool efficiency;            // Run the worker count with the most hashes per joule
+
+    PowerLimits() : cap_watts(0), efficiency(false) {}
+    bool controls() const { return cap_watts > 0 || efficiency; }
+};
+
+// Power and efficiency over the last POWER_REPORT_WINDOW_S
+struct PowerSample {
+    bool available;             // Package power could be read
+    double watts;
+    double hashrate;
+    double hashes_per_joule;    // H/s per watt
+    unsigned int workers;       // Allowed to hash
+    unsigned int threads;       // Of this many
+    uint64_t adjustments;       // Worker count changes made
+
+    PowerSample() : available(false), watts(0), hashrate(0), hashes_per_joule(0), workers(0), threads(0)
+        , adjustments(0) {}
+};
+
+// Samples package power once a second and sets the backend's worker limit
+// (see MiningBackend::set_worker_limit) to meet PowerLimits. A cap takes a
+// worker away whenever power is over it and gives one back once it stays
+// clear; the efficiency target measures hashes per joule at the current
+// count and its neighbours and walks to the best, within the cap. Never
+// fewer than one worker: the package draws most of its idle power anyway.
+// Without limits it only measures, for the status screen and metrics.
+class PowerGovernor {
+public:
+    PowerGovernor(MiningBackend& backend, const PowerLimits& limits);
+    ~PowerGovernor() { stop(); }
+
+    PowerGovernor(const PowerGovernor&) = delete;
+    PowerGovernor& operator=(const PowerGovernor&) = delete;
+
+    // threads: the backend's worker count; call again whenever it changes.
+    // False if package power can't be read.
+    bool start(unsigned int threads);
+    void set_thread_count(unsigned int threads);
+    void stop();
+
+    const std::string& source() const { return meter_.source(); }
+    PowerSample snapshot() const;
+
+private:
+    MiningBackend& backend_;
+    PowerLimits limits_;
+    PowerMeter meter_;
+    std::atomic<unsigned int> threads_;
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_;                     // Guarded by mutex_
+    PowerSample sample_;            // Guarded by mutex_
+
+    void run();
+};
+
+#endif // POWER_GOVERNOR_H
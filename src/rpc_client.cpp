@@ -1,77 +1,250 @@
 #include "rpc_client.h"
 #include "logger.h"
+#include "template_parser.h"
+#include "node_traffic.h"
+#include "trace_recorder.h"
+#include "telemetry_journal.h"
 #include <curl/curl.h>
 #include <iostream>
+#include <iomanip>
 #include <sstream>
 
 // Callback for CURL to write received data
-static size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
-    ((std::string*)userp)->append((char*)contents, size * nmemb);
-    return size * nmemb;
+size_t RPCClient::write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    RPCClient* client = (RPCClient*)userp;
+    size_t bytes = size * nmemb;
+    if (!client->stream_parser_ || traffic_recorder) {
+        // A recording needs the body even when it is parsed as it streams
+        client->response_.append((char*)contents, bytes);
+    }
+    if (!client->stream_parser_) {
+        return bytes;
+    }
+    if (client->stream_parser_->bytes_fed() == 0) {
+        // First chunk: size the parser's buffers for the whole response
+        curl_off_t length = -1;
+        curl_easy_getinfo(client->curl_, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+        if (length > 0) {
+            client->stream_parser_->reserve((size_t)length);
+        }
+    }
+    // A malformed response ends the transfer here rather than after the whole body
+    return client->stream_parser_->feed((const char*)contents, bytes) ? bytes : 0;
 }
 
+static const char UNIX_SOCKET_SCHEME[] = "unix://";
+
 RPCClient::RPCClient(const std::string& url, const std::string& user, const std::string& password)
-    : url_(url), user_(user), password_(password), request_id_(0) {
+    : url_(url), user_(user), password_(password), request_id_(0), curl_(nullptr), headers_(nullptr)
+    , stream_parser_(nullptr), timeout_(30), abort_(nullptr) {
     curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (url.compare(0, sizeof(UNIX_SOCKET_SCHEME) - 1, UNIX_SOCKET_SCHEME) == 0) {
+        // The socket decides where requests go; the host name is only for the Host header
+        socket_path_ = url.substr(sizeof(UNIX_SOCKET_SCHEME) - 1);
+        url_ = "http://localhost/";
+    }
 }
 
 RPCClient::~RPCClient() {
+    if (curl_) {
+        curl_easy_cleanup(curl_);
+    }
+    curl_slist_free_all(headers_);
     curl_global_cleanup();
 }
 
-bool RPCClient::call(const std::string& method, const Json::Value& params, Json::Value& result) {
-    last_error_.clear(); // Clear previous error
-    LOG_DEBUG_STREAM("RPC call: " << method);
+// Progress callback: a non-zero return makes curl abort the transfer
+static int abort_callback(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    const std::atomic<bool>* abort = (const std::atomic<bool>*)clientp;
+    return abort && abort->load() ? 1 : 0;
+}
+
+void RPCClient::set_timeout(long seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    timeout_ = seconds;
+    if (curl_) {
+        curl_easy_setopt(curl_, CURLOPT_TIMEOUT, timeout_);
+    }
+}
 
+bool RPCClient::setup_handle() {
     CURL* curl = curl_easy_init();
     if (!curl) {
-        last_error_ = "Failed to initialize CURL";
-        LOG_ERROR("Failed to initialize CURL");
         return false;
     }
+    if (!headers_) {
+        headers_ = curl_slist_append(headers_, "Content-Type: application/json");
+        // A large submitblock would otherwise wait for "100 Continue" first
+        headers_ = curl_slist_append(headers_, "Expect:");
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, url_.c_str());
+    if (!socket_path_.empty()) {
+        curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, socket_path_.c_str());
+    }
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers_);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
+    curl_easy_setopt(curl, CURLOPT_HTTPAUTH, CURLAUTH_BASIC);
+    curl_easy_setopt(curl, CURLOPT_USERNAME, user_.c_str());
+    curl_easy_setopt(curl, CURLOPT_PASSWORD, password_.c_str());
+
+    // Keep the connection open between calls; small requests go out at once
+    curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+    // Set timeouts to prevent hanging
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);  // 10 seconds to connect
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout_);    // 30 seconds total unless set_timeout
+    if (abort_) {
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, abort_callback);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, (void*)abort_);
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    }
+
+    curl_ = curl;
+    return true;
+}
+
+void RPCClient::record_call(const std::string& method, bool ok, double ms, bool new_connection) {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    RPCCallStats& stats = stats_[method];
+    stats.calls++;
+    if (!ok) {
+        stats.failures++;
+    }
+    stats.last_ms = ms;
+    stats.total_ms += stats.last_ms;
+    if (stats.last_ms > stats.max_ms) {
+        stats.max_ms = stats.last_ms;
+    }
+    if (new_connection) {
+        stats.new_connections++;
+    }
+    LOG_DEBUG_STREAM("RPC " << method << ": " << std::fixed << std::setprecision(1) << stats.last_ms << " ms"
+                     << (new_connection ? " (new connection)" : ""));
+    if (telemetry_journal) {
+        telemetry_journal->record(JOURNAL_RPC, JOURNAL_NO_THREAD, telemetry_journal->name_id(method),
+                                  (uint64_t)(ms * 1000), 0,
+                                  (ok ? 0 : JOURNAL_RPC_FAILED) | (new_connection ? JOURNAL_RPC_CONNECTED : 0));
+    }
+}
+
+RPCCallStats RPCClient::get_call_stats(const std::string& method) const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    auto it = stats_.find(method);
+    return it != stats_.end() ? it->second : RPCCallStats();
+}
+
+std::map<std::string, RPCCallStats> RPCClient::get_all_call_stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+std::string RPCClient::describe_call_stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    for (const auto& entry : stats_) {
+        const RPCCallStats& stats = entry.second;
+        out << entry.first << ": " << stats.calls << " calls, avg " << stats.average_ms()
+            << " ms, last " << stats.last_ms << " ms, max " << stats.max_ms << " ms, "
+            << stats.new_connections << " connects";
+        if (stats.failures) {
+            out << ", " << stats.failures << " failed";
+        }
+        out << "\n";
+    }
+    return out.str();
+}
 
-    // Build JSON-RPC request
+// The message of an RPC error object, or the whole object if it has none
+static std::string rpc_error_message(const Json::Value& error) {
+    if (error.isMember("message") && error["message"].isString()) {
+        return error["message"].asString();
+    }
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    return Json::writeString(writer, error);
+}
+
+Json::Value RPCClient::make_request(const std::string& method, const Json::Value& params) {
     Json::Value request;
     request["jsonrpc"] = "1.0";
     request["id"] = ++request_id_;
     request["method"] = method;
     request["params"] = params;
+    return request;
+}
+
+bool RPCClient::perform(const std::string& label, const Json::Value& request) {
+    TraceScope span("rpc", label.c_str());
+    last_error_.clear(); // Clear previous error
+    LOG_DEBUG_STREAM("RPC call: " << label);
+    response_.clear();
+
+    if (traffic_replay) {
+        // Answered from the recording, through the same parsing as a node's
+        std::string body;
+        double ms = 0;
+        bool ok = traffic_replay->respond(label, request, abort_, body, ms, last_error_);
+        record_call(label, ok, ms, false);
+        if (!ok) {
+            return false;
+        }
+        if (!stream_parser_) {
+            response_ = std::move(body);
+            return true;
+        }
+        stream_parser_->reserve(body.size());
+        return stream_parser_->feed(body.data(), body.size());
+    }
+
+    if (!curl_ && !setup_handle()) {
+        last_error_ = "Failed to initialize CURL";
+        LOG_ERROR("Failed to initialize CURL");
+        return false;
+    }
 
     Json::StreamWriterBuilder writer;
     std::string request_str = Json::writeString(writer, request);
     LOG_DEBUG_STREAM("RPC request: " << request_str.substr(0, 200)
                     << (request_str.size() > 200 ? "..." : ""));
 
-    // Set up CURL options
-    std::string response_str;
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-
-    curl_easy_setopt(curl, CURLOPT_URL, url_.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request_str.c_str());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_str);
-    curl_easy_setopt(curl, CURLOPT_HTTPAUTH, CURLAUTH_BASIC);
-    curl_easy_setopt(curl, CURLOPT_USERNAME, user_.c_str());
-    curl_easy_setopt(curl, CURLOPT_PASSWORD, password_.c_str());
-
-    // Set timeouts to prevent hanging
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);  // 10 seconds to connect
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);         // 30 seconds total timeout
-
-    // Perform request
-    CURLcode res = curl_easy_perform(curl);
-
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+    // The handle keeps everything else (and its connection) from the last call
+    curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, request_str.c_str());
+    curl_easy_setopt(curl_, CURLOPT_POSTFIELDSIZE, (long)request_str.size());
+
+    // Perform request; curl reconnects by itself if the node closed the connection
+    CURLcode res = curl_easy_perform(curl_);
+    long http_status = 0;
+    curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &http_status);
+    double seconds = 0;
+    long connects = 0;
+    curl_easy_getinfo(curl_, CURLINFO_TOTAL_TIME, &seconds);
+    curl_easy_getinfo(curl_, CURLINFO_NUM_CONNECTS, &connects);
+    record_call(label, res == CURLE_OK && http_status < 400, seconds * 1000.0, connects > 0);
+    if (traffic_recorder) {
+        traffic_recorder->record(label, seconds * 1000.0, res == CURLE_OK,
+                                 res == CURLE_OK ? response_ : std::string(curl_easy_strerror(res)));
+    }
 
     if (res != CURLE_OK) {
         last_error_ = std::string("RPC request failed: ") + curl_easy_strerror(res);
         LOG_ERROR_STREAM("RPC request failed: " << curl_easy_strerror(res));
         return false;
     }
+    return true;
+}
+
+bool RPCClient::call(const std::string& method, const Json::Value& params, Json::Value& result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!perform(method, make_request(method, params))) {
+        return false;
+    }
 
+    const std::string& response_str = response_;
     LOG_DEBUG_STREAM("RPC response received, size: " << response_str.size() << " bytes");
 
     // Parse response
@@ -87,16 +260,9 @@ bool RPCClient::call(const std::string& method, const Json::Value& params, Json:
     }
 
     if (response.isMember("error") && !response["error"].isNull()) {
-        // Extract error message from RPC error response
-        Json::Value error = response["error"];
-        if (error.isMember("message") && error["message"].isString()) {
-            last_error_ = "RPC error: " + error["message"].asString();
-            LOG_WARNING_STREAM("RPC error from " << method << ": " << error["message"].asString());
-        } else {
-            Json::StreamWriterBuilder writer;
-            writer["indentation"] = "";
-            last_error_ = "RPC error: " + Json::writeString(writer, error);
-        }
+        std::string message = rpc_error_message(response["error"]);
+        last_error_ = "RPC error: " + message;
+        LOG_WARNING_STREAM("RPC error from " << method << ": " << message);
         return false;
     }
 
@@ -109,7 +275,8 @@ bool RPCClient::call(const std::string& method, const Json::Value& params, Json:
     return true;
 }
 
-bool RPCClient::get_block_template(Json::Value& result, const std::string& mining_address) {
+bool RPCClient::get_block_template(BlockTemplate& result, const std::string& mining_address,
+                                   const std::string& longpollid) {
     Json::Value params(Json::arrayValue);
 
     // Request parameters
@@ -118,6 +285,10 @@ bool RPCClient::get_block_template(Json::Value& result, const std::string& minin
     request_obj["capabilities"].append("coinbasetxn");
     request_obj["capabilities"].append("workid");
     request_obj["capabilities"].append("coinbase/append");
+    if (!longpollid.empty()) {
+        request_obj["capabilities"].append("longpoll");
+        request_obj["longpollid"] = longpollid;
+    }
 
     // Note: mining_address parameter is ignored
     // The node automatically uses the wallet's keypool address for coinbase
@@ -125,7 +296,32 @@ bool RPCClient::get_block_template(Json::Value& result, const std::string& minin
 
     params.append(request_obj);
 
-    return call("getblocktemplate", params, result);
+    // Multi-megabyte responses: parse as curl delivers them, no DOM
+    std::lock_guard<std::mutex> lock(mutex_);
+    BlockTemplateParser parser;
+    stream_parser_ = &parser;
+    auto requested = std::chrono::steady_clock::now();
+    bool sent = perform("getblocktemplate", make_request("getblocktemplate", params));
+    auto received = std::chrono::steady_clock::now();
+    stream_parser_ = nullptr;
+
+    if (!sent) {
+        // The parser cutting the transfer short is the real reason it failed
+        if (!parser.error().empty()) {
+            last_error_ = parser.error();
+        }
+        return false;
+    }
+    LOG_DEBUG_STREAM("RPC response received, size: " << parser.bytes_fed() << " bytes");
+    if (!parser.finish(result)) {
+        last_error_ = parser.error();
+        LOG_WARNING_STREAM("getblocktemplate: " << last_error_);
+        return false;
+    }
+    result.times.requested = requested;
+    result.times.received = received;
+    result.times.parsed = std::chrono::steady_clock::now();
+    return true;
 }
 
 bool RPCClient::submit_block(const std::string& hex_data, std::string& result) {
@@ -271,3 +467,60 @@ bool RPCClient::get_block_hash(uint64_t height, std::string& block_hash) {
     block_hash = result.asString();
     return true;
 }
+
+bool RPCClient::call_batch(std::vector<RPCBatchCall>& calls) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Json::Value batch(Json::arrayValue);
+    std::string label;
+    int first_id = request_id_ + 1;
+    for (RPCBatchCall& call : calls) {
+        batch.append(make_request(call.method, call.params));
+        label += (label.empty() ? "" : "+") + call.method;
+        call.ok = false;
+        call.result = Json::Value();
+        call.error = "No response to this call";
+    }
+
+    bool ok = perform(label, batch);
+    Json::Value response;
+    if (ok) {
+        Json::CharReaderBuilder reader;
+        std::string errors;
+        std::istringstream response_stream(response_);
+        if (!Json::parseFromStream(reader, response_stream, &response, &errors)) {
+            last_error_ = "Failed to parse JSON response: " + errors;
+            ok = false;
+        } else if (!response.isArray()) {
+            // A node without batch support answers with a single error
+            last_error_ = response.isMember("error") && !response["error"].isNull()
+                ? "RPC error: " + rpc_error_message(response["error"]) : "Invalid RPC response: not a batch";
+            ok = false;
+        }
+    }
+    if (!ok) {
+        LOG_WARNING_STREAM("RPC batch " << label << " failed: " << last_error_);
+        for (RPCBatchCall& call : calls) {
+            call.error = last_error_;
+        }
+        return false;
+    }
+
+    // Answers may come in any order; ids say which call each belongs to
+    for (const Json::Value& answer : response) {
+        int index = answer["id"].isInt() ? answer["id"].asInt() - first_id : -1;
+        if (index < 0 || index >= (int)calls.size()) {
+            continue;
+        }
+        RPCBatchCall& call = calls[index];
+        if (answer.isMember("error") && !answer["error"].isNull()) {
+            call.error = "RPC error: " + rpc_error_message(answer["error"]);
+        } else if (!answer.isMember("result")) {
+            call.error = "Invalid RPC response: no result field";
+        } else {
+            call.ok = true;
+            call.result = answer["result"];
+            call.error.clear();
+        }
+    }
+    return true;
+}
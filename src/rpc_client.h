@@ -3,16 +3,54 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
 #include <cstdint>
+#include <map>
+#include <mutex>
 #include <json/json.h>
 
+struct curl_slist;
+struct BlockTemplate;
+class BlockTemplateParser;
+
+// Latency of one RPC method over this client's lifetime
+struct RPCCallStats {
+    uint64_t calls;
+    uint64_t failures;         // Transport failures and RPC errors
+    uint64_t new_connections;  // Calls that had to open a connection (not reused)
+    double last_ms;
+    double total_ms;
+    double max_ms;
+
+    RPCCallStats() : calls(0), failures(0), new_connections(0), last_ms(0), total_ms(0), max_ms(0) {}
+    double average_ms() const { return calls ? total_ms / calls : 0.0; }
+};
+
+// One call of a JSON-RPC batch; call_batch fills in result or error
+struct RPCBatchCall {
+    std::string method;
+    Json::Value params;
+    bool ok;
+    Json::Value result;
+    std::string error;
+
+    explicit RPCBatchCall(const std::string& method_name, const Json::Value& call_params = Json::Value(Json::arrayValue))
+        : method(method_name), params(call_params), ok(false) {}
+};
+
 class RPCClient {
 public:
+    // url is http(s)://host:port, or unix:///path for HTTP over a Unix domain
+    // socket (a node or proxy on this host, skipping loopback TCP)
     RPCClient(const std::string& url, const std::string& user, const std::string& password);
     ~RPCClient();
 
     // RPC methods
-    bool get_block_template(Json::Value& result, const std::string& mining_address);
+    // With a longpollid (BIP22), the node holds the request until the tip or
+    // the mempool moves past that template. The response is parsed as it
+    // arrives, straight into the template (see BlockTemplateParser).
+    bool get_block_template(BlockTemplate& result, const std::string& mining_address,
+                            const std::string& longpollid = "");
     bool submit_block(const std::string& hex_data, std::string& result);
     bool create_new_account(int& account_id);
     bool get_address_for_account(int account_id, std::string& address);
@@ -21,16 +59,56 @@ public:
     bool get_wallet_balance(Json::Value& result);
     bool get_block_hash(uint64_t height, std::string& block_hash);
 
+    // Several calls in one HTTP request (a JSON-RPC batch): one round trip,
+    // one authentication and one response to parse. False if the request as
+    // a whole failed; otherwise each call's ok says how it fared.
+    bool call_batch(std::vector<RPCBatchCall>& calls);
+
+    // Total time allowed per call in seconds, 0 = no limit (default 30)
+    void set_timeout(long seconds);
+    // A call in progress gives up once *abort is set (call before the first request)
+    void set_abort_flag(const std::atomic<bool>* abort) { abort_ = abort; }
+
     // Get the last error message
     std::string get_last_error() const { return last_error_; }
 
+    // Latency so far for a method, e.g. "getblocktemplate"
+    RPCCallStats get_call_stats(const std::string& method) const;
+    // Every method's so far, by method
+    std::map<std::string, RPCCallStats> get_all_call_stats() const;
+    // One line per method: calls, average/last/max ms, new connections
+    std::string describe_call_stats() const;
+
 private:
     std::string url_;
+    std::string socket_path_;  // Set for unix:// URLs
     std::string user_;
     std::string password_;
     int request_id_;
     std::string last_error_;
 
+    // One keep-alive connection: the easy handle, its headers and the
+    // response buffer live as long as the client, so calls after the first
+    // skip the TCP connect. Calls are serialized on mutex_.
+    void* curl_;
+    struct curl_slist* headers_;
+    std::string response_;
+    BlockTemplateParser* stream_parser_;  // Takes the response instead of response_ when set
+    mutable std::mutex mutex_;
+    // Stats have a lock of their own, so reading them never waits for a
+    // call in flight (a long poll can take minutes)
+    mutable std::mutex stats_mutex_;
+    std::map<std::string, RPCCallStats> stats_;
+    long timeout_;
+    const std::atomic<bool>* abort_;
+
+    static size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp);
+    bool setup_handle();
+    void record_call(const std::string& method, bool ok, double ms, bool new_connection);
+    // Send a request (one call or a batch) and receive the response body
+    // (mutex_ held); label names it in the call stats
+    Json::Value make_request(const std::string& method, const Json::Value& params);
+    bool perform(const std::string& label, const Json::Value& request);
     bool call(const std::string& method, const Json::Value& params, Json::Value& result);
 };
 
@@ -0,0 +1,193 @@
+#include "share_verifier.h"
+#include "logger.h"
+#include "trace_recorder.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstring>
+
+ShareVerifier::Epoch::~Epoch() {
+    if (cache) {
+        randomx_release_cache(cache);
+    }
+}
+
+ShareVerifier::ShareVerifier(std::function<void()> done)
+    : done_(std::move(done)), flags_(randomx_get_flags()), stop_(false) {}
+
+ShareVerifier::~ShareVerifier() {
+    stop();
+}
+
+void ShareVerifier::start(unsigned int threads) {
+    if (!threads_.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = false;
+    }
+    for (unsigned int i = 0; i < std::max(1u, threads); i++) {
+        threads_.emplace_back(&ShareVerifier::run, this);
+    }
+}
+
+void ShareVerifier::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.clear();
+    epochs_.clear();
+}
+
+std::shared_ptr<ShareVerifier::Epoch> ShareVerifier::epoch(const std::vector<uint8_t>& seed) {
+    auto it = std::find_if(epochs_.begin(), epochs_.end(),
+                           [&seed](const std::shared_ptr<Epoch>& epoch) { return epoch->seed == seed; });
+    std::shared_ptr<Epoch> found;
+    if (it != epochs_.end()) {
+        found = *it;
+        epochs_.erase(it);
+    } else {
+        found = std::make_shared<Epoch>();
+        found->seed = seed;
+    }
+    epochs_.push_front(found);
+    // Tasks and VMs still holding an older one keep it until they are done
+    while (epochs_.size() > SHARE_VERIFY_EPOCHS) {
+        epochs_.pop_back();
+    }
+    return found;
+}
+
+void ShareVerifier::prepare(const std::vector<uint8_t>& seed) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Task task;
+        task.ticket = 0;
+        task.epoch = epoch(seed);
+        task.hash = false;
+        tasks_.push_back(std::move(task));
+    }
+    wake_.notify_one();
+}
+
+bool ShareVerifier::verify(uint64_t ticket, const std::vector<uint8_t>& seed, const uint8_t* header, bool urgent) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!urgent && tasks_.size() >= SHARE_VERIFY_MAX_QUEUED) {
+            return false;
+        }
+        Task task;
+        task.ticket = ticket;
+        task.epoch = epoch(seed);
+        task.hash = true;
+        std::memcpy(task.header, header, BLOCK_HEADER_SIZE);
+        if (urgent) {
+            tasks_.push_front(std::move(task));
+        } else {
+            tasks_.push_back(std::move(task));
+        }
+    }
+    wake_.notify_one();
+    return true;
+}
+
+std::vector<ShareVerifier::Result> ShareVerifier::take_results() {
+    std::vector<Result> results;
+    std::lock_guard<std::mutex> lock(mutex_);
+    results.swap(results_);
+    return results;
+}
+
+void ShareVerifier::build(Epoch& epoch) {
+    TraceScope span("verify", "share cache");
+    epoch.flags = flags_;
+    epoch.cache = randomx_alloc_cache(flags_);
+    if (!epoch.cache) {
+        epoch.flags = (randomx_flags)(flags_ & ~RANDOMX_FLAG_JIT);
+        epoch.cache = randomx_alloc_cache(epoch.flags);
+    }
+    if (!epoch.cache) {
+        LOG_ERROR("Cannot allocate a RandomX cache to verify shares");
+        return;
+    }
+    randomx_init_cache(epoch.cache, epoch.seed.data(), epoch.seed.size());
+    LOG_DEBUG_STREAM("Share verification cache ready for seed "
+                     << utils::bytes_to_hex(epoch.seed.data(), epoch.seed.size()));
+}
+
+void ShareVerifier::run() {
+    TraceRecorder::set_thread_name("share verifier");
+    // This thread's VM on each epoch it has hashed in
+    std::vector<std::pair<std::shared_ptr<Epoch>, randomx_vm*>> vms;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        wake_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+        if (stop_) {
+            break;
+        }
+        Task task = std::move(tasks_.front());
+        tasks_.pop_front();
+        lock.unlock();
+
+        Epoch& epoch = *task.epoch;
+        std::call_once(epoch.built, [this, &epoch]() { build(epoch); });
+        Result result;
+        result.ticket = task.ticket;
+        result.hashed = false;
+        if (task.hash && epoch.cache) {
+            auto it = std::find_if(vms.begin(), vms.end(),
+                                   [&task](const std::pair<std::shared_ptr<Epoch>, randomx_vm*>& vm) {
+                                       return vm.first == task.epoch;
+                                   });
+            randomx_vm* vm = it != vms.end() ? it->second : nullptr;
+            if (!vm) {
+                vm = randomx_create_vm(epoch.flags, epoch.cache, nullptr);
+                if (!vm) {
+                    vm = randomx_create_vm((randomx_flags)(epoch.flags & ~RANDOMX_FLAG_JIT), epoch.cache, nullptr);
+                }
+                if (vm) {
+                    vms.emplace_back(task.epoch, vm);
+                } else {
+                    LOG_ERROR("Cannot create a RandomX VM to verify shares");
+                }
+            }
+            if (vm) {
+                TraceScope span("verify", "share");
+                randomx_calculate_hash(vm, task.header, BLOCK_HEADER_SIZE, result.hash);
+                result.hashed = true;
+            }
+        }
+        task.epoch.reset();
+
+        lock.lock();
+        // VMs on epochs no longer kept go, and with the last of them the cache
+        for (auto& vm : vms) {
+            if (std::find(epochs_.begin(), epochs_.end(), vm.first) == epochs_.end()) {
+                randomx_destroy_vm(vm.second);
+                vm.second = nullptr;
+            }
+        }
+        vms.erase(std::remove_if(vms.begin(), vms.end(),
+                                 [](const std::pair<std::shared_ptr<Epoch>, randomx_vm*>& vm) {
+                                     return vm.second == nullptr;
+                                 }),
+                  vms.end());
+        if (task.hash) {
+            results_.push_back(result);
+            lock.unlock();
+            done_();
+            lock.lock();
+        }
+    }
+    lock.unlock();
+    for (auto& vm : vms) {
+        randomx_destroy_vm(vm.second);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef SHARE_VERIFIER_H
+#define SHARE_VERIFIER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "mining_backend.h"
+#include "randomx.h"
+
+// Caches kept: the current epoch and the one before, for shares on a job
+// from before an epoch change
+static const size_t SHARE_VERIFY_EPOCHS = 2;
+// Headers waiting beyond this are turned away, except block candidates
+static const size_t SHARE_VERIFY_MAX_QUEUED = 4096;
+
+// Recomputes the RandomX hash of headers rigs submitted, on threads of its
+// own so the work proxy keeps serving jobs meanwhile. Hashing is in light
+// mode: one cache per seed, built on first use (about a second of Argon2),
+// and one VM per thread and seed.
+class ShareVerifier {
+public:
+    struct Result {
+        uint64_t ticket;
+        bool hashed;                    // False if no cache or VM could be made
+        uint8_t hash[RANDOMX_HASH_SIZE];
+    };
+
+    // done is called from a verifier thread whenever results are ready
+    explicit ShareVerifier(std::function<void()> done);
+    ~ShareVerifier();
+
+    ShareVerifier(const ShareVerifier&) = delete;
+    ShareVerifier& operator=(const ShareVerifier&) = delete;
+
+    void start(unsigned int threads);
+    void stop();
+
+    // Build seed's cache now, ahead of the first share on it
+    void prepare(const std::vector<uint8_t>& seed);
+    // Queue header to be hashed under seed; the result comes back with
+    // ticket. Urgent headers (block candidates) go first and are always
+    // taken; others are refused (false) while the queue is full.
+    bool verify(uint64_t ticket, const std::vector<uint8_t>& seed, const uint8_t* header, bool urgent);
+    // Results since the last call
+    std::vector<Result> take_results();
+
+private:
+    struct Epoch {
+        std::vector<uint8_t> seed;
+        randomx_flags flags;            // What the cache was allocated with
+        randomx_cache* cache;           // Null until built, or if it can't be
+        std::once_flag built;
+
+        Epoch() : flags(RANDOMX_FLAG_DEFAULT), cache(nullptr) {}
+        ~Epoch();
+    };
+    struct Task {
+        uint64_t ticket;
+        std::shared_ptr<Epoch> epoch;
+        bool hash;                      // False: only build the cache
+        uint8_t header[BLOCK_HEADER_SIZE];
+    };
+
+    std::function<void()> done_;
+    const randomx_flags flags_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_;                                 // Guarded by mutex_
+    std::deque<std::shared_ptr<Epoch>> epochs_; // Guarded by mutex_; most recently used first
+    std::deque<Task> tasks_;                    // Guarded by mutex_
+    std::vector<Result> results_;               // Guarded by mutex_
+
+    std::shared_ptr<Epoch> epoch(const std::vector<uint8_t>& seed);
+    void build(Epoch& epoch);
+    void run();
+};
+
+#endif // SHARE_VERIFIER_H
@@ -0,0 +1,555 @@
+#include "stratum_client.h"
+#include "logger.h"
+#include "trace_recorder.h"
+#include "miner.h"
+#include "utils.h"
+#include <curl/curl.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <memory>
+#include <poll.h>
+
+// What the pool sees of us in the login
+static const char STRATUM_AGENT[] = "juno-miner/1.0";
+// A line longer than this without a newline is not a stratum message
+static const size_t STRATUM_MAX_LINE = 1 << 20;
+
+static const char* const STRATUM_TLS_SCHEMES[] = {"stratum+ssl://", "stratum+tls://", "ssl://", "tls://"};
+static const char* const STRATUM_TCP_SCHEMES[] = {"stratum+tcp://", "tcp://"};
+
+static bool strip_scheme(const std::string& url, const char* scheme, std::string& rest) {
+    size_t length = std::strlen(scheme);
+    if (url.compare(0, length, scheme) != 0) {
+        return false;
+    }
+    rest = url.substr(length);
+    return true;
+}
+
+// Display-order hex of a 32-byte hash stored in internal order
+static std::string display_hash(const uint8_t* data) {
+    return utils::bytes_to_hex_reversed(data, 32);
+}
+
+static bool decode_hash(const Json::Value& value, std::vector<uint8_t>& out) {
+    if (!value.isString() || value.asString().size() != 64) {
+        return false;
+    }
+    out.resize(32);
+    return utils::hex_decode(value.asCString(), 32, out.data());
+}
+
+static std::string error_text(const Json::Value& error) {
+    if (error.isObject() && error["message"].isString()) {
+        return error["message"].asString();
+    }
+    if (error.isString()) {
+        return error.asString();
+    }
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    return Json::writeString(writer, error);
+}
+
+bool parse_stratum_job(const Json::Value& job, BlockTemplate& result, std::string& error) {
+    if (!job.isObject() || !job["job_id"].isString() || job["job_id"].asString().empty()) {
+        error = "missing job_id";
+        return false;
+    }
+    const Json::Value& blob = job["blob"];
+    if (!blob.isString() || blob.asString().size() != NONCE_OFFSET * 2) {
+        error = "blob is not a " + std::to_string(NONCE_OFFSET) + "-byte header";
+        return false;
+    }
+    result.header_base.assign(BLOCK_HEADER_SIZE, 0);
+    if (!utils::hex_decode(blob.asCString(), NONCE_OFFSET, result.header_base.data())) {
+        error = "invalid hex in blob";
+        return false;
+    }
+    if (!job["height"].isIntegral()) {
+        error = "missing height";
+        return false;
+    }
+    if (!decode_hash(job["seed_hash"], result.seed_hash)) {
+        error = "missing or invalid seed_hash";
+        return false;
+    }
+    if (job.isMember("next_seed_hash") && !decode_hash(job["next_seed_hash"], result.next_seed_hash)) {
+        error = "invalid next_seed_hash";
+        return false;
+    }
+
+    // The share target: a full target in display order, or its top 32 or 64
+    // bits little-endian with everything below them set
+    const std::string target = job["target"].isString() ? job["target"].asString() : std::string();
+    std::vector<uint8_t> target_bytes;
+    if (target.size() == 64) {
+        target_bytes = utils::hex_to_bytes(target);
+        std::reverse(target_bytes.begin(), target_bytes.end());
+    } else if (target.size() == 8 || target.size() == 16) {
+        size_t top = target.size() / 2;
+        target_bytes.assign(32, 0xff);
+        if (!utils::hex_decode(target.data(), top, &target_bytes[32 - top])) {
+            target_bytes.clear();
+        }
+    }
+    if (target_bytes.size() != 32) {
+        error = "invalid target";
+        return false;
+    }
+
+    // Everything else is read back from the header the pool built
+    const uint8_t* header = result.header_base.data();
+    result.job_id = job["job_id"].asString();
+    result.version = utils::read_le32(header);
+    result.previous_block_hash = display_hash(header + 4);
+    result.merkle_root = display_hash(header + 36);
+    result.block_commitments_hash = display_hash(header + 68);
+    result.time = utils::read_le32(header + 100);
+    result.bits = utils::read_le32(header + 104);
+    result.height = job["height"].asUInt();
+    result.seed_height = job["seed_height"].isIntegral() ? job["seed_height"].asUInt64()
+                                                         : RandomX_SeedHeight(result.height);
+    result.target = target_bytes;
+    result.target_limbs = utils::target_to_limbs(result.target);
+    result.target_hex = utils::bytes_to_hex_reversed(result.target.data(), 32);
+    return true;
+}
+
+Json::Value make_stratum_job(const BlockTemplate& block_template, const std::string& job_id,
+                             const std::vector<uint8_t>& target) {
+    Json::Value job;
+    job["job_id"] = job_id;
+    job["blob"] = utils::bytes_to_hex(block_template.header_base.data(), NONCE_OFFSET);
+    job["target"] = utils::bytes_to_hex_reversed(target.data(), target.size());
+    job["height"] = block_template.height;
+    job["seed_height"] = (Json::UInt64)block_template.seed_height;
+    job["seed_hash"] = utils::bytes_to_hex(block_template.seed_hash.data(), block_template.seed_hash.size());
+    if (!block_template.next_seed_hash.empty()) {
+        job["next_seed_hash"] = utils::bytes_to_hex(block_template.next_seed_hash.data(),
+                                                    block_template.next_seed_hash.size());
+    }
+    return job;
+}
+
+StratumClient::StratumClient(const std::string& url, const std::string& user, const std::string& password,
+                             TemplateInbox& inbox, std::function<void()> on_result)
+    : user_(user), password_(password), inbox_(inbox), on_result_(std::move(on_result)), curl_(nullptr)
+    , socket_(-1), stop_(false), connected_(false), has_instance_id_(false), instance_id_(0), request_id_(0)
+    , login_request_(0) {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    // curl only opens the connection (and for TLS does the handshake); the
+    // scheme just picks which
+    std::string host_port;
+    for (const char* scheme : STRATUM_TLS_SCHEMES) {
+        if (strip_scheme(url, scheme, host_port)) {
+            url_ = "https://" + host_port;
+        }
+    }
+    for (const char* scheme : STRATUM_TCP_SCHEMES) {
+        if (strip_scheme(url, scheme, host_port)) {
+            url_ = "http://" + host_port;
+        }
+    }
+    if (url_.empty() && url.find("://") == std::string::npos) {
+        url_ = "http://" + url;
+    }
+}
+
+StratumClient::~StratumClient() {
+    stop();
+    curl_global_cleanup();
+}
+
+void StratumClient::start() {
+    if (!thread_.joinable()) {
+        thread_ = std::thread(&StratumClient::run, this);
+    }
+}
+
+void StratumClient::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    job_cv_.notify_all();
+    events_.wake();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+BlockTemplatePtr StratumClient::wait_for_job(std::chrono::seconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    job_cv_.wait_for(lock, timeout, [this]() { return job_ || stop_.load(); });
+    return job_;
+}
+
+bool StratumClient::assigned_instance_id(uint32_t& instance_id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    instance_id = instance_id_;
+    return has_instance_id_;
+}
+
+std::string StratumClient::get_last_error() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_error_;
+}
+
+void StratumClient::set_error(const std::string& error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_error_ = error;
+}
+
+void StratumClient::submit(const uint8_t* header, const uint8_t* hash, const BlockTemplate& job) {
+    PendingShare share;
+    share.job_id = job.job_id;
+    share.nonce_hex = utils::bytes_to_hex(header + NONCE_OFFSET, NONCE_SIZE);
+    share.hash_hex = utils::bytes_to_hex(hash, 32);
+    share.block_hash_hex = display_hash(hash);
+    share.height = job.height;
+    share.found = std::chrono::steady_clock::now();
+    if (!connected_.load()) {
+        add_result(share, false, "not connected to the pool");
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(share));
+    }
+    events_.wake();
+}
+
+bool StratumClient::take_result(SubmitResult& result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (results_.empty()) {
+        return false;
+    }
+    result = std::move(results_.front());
+    results_.pop_front();
+    return true;
+}
+
+void StratumClient::add_result(const PendingShare& share, bool accepted, const std::string& answer) {
+    SubmitResult result;
+    result.node = 0;
+    result.height = share.height;
+    result.block_hash_hex = share.block_hash_hex;
+    result.accepted = accepted;
+    result.result = answer;
+    result.submit_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - share.found).count();
+    result.next_template = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        results_.push_back(std::move(result));
+    }
+    if (on_result_) {
+        on_result_();
+    }
+}
+
+void StratumClient::run() {
+    TraceRecorder::set_thread_name("pool");
+    while (!stop_.load()) {
+        if (open_session()) {
+            LOG_INFO("Logged in to the pool");
+            auto last_send = std::chrono::steady_clock::now();
+            while (!stop_.load() && session_step(last_send)) {
+            }
+        }
+        close_session();
+        if (stop_.load()) {
+            break;
+        }
+        LOG_WARNING_STREAM("Pool connection failed (" << get_last_error() << "), retrying in "
+                           << STRATUM_RETRY_SECONDS << "s");
+        auto retry = std::chrono::steady_clock::now() + std::chrono::seconds(STRATUM_RETRY_SECONDS);
+        while (!stop_.load() && std::chrono::steady_clock::now() < retry) {
+            events_.wait(retry);
+        }
+    }
+}
+
+bool StratumClient::open_session() {
+    if (url_.empty()) {
+        set_error("unsupported pool URL scheme");
+        return false;
+    }
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+        set_error("Failed to initialize CURL");
+        return false;
+    }
+    curl_ = curl;
+    curl_easy_setopt(curl, CURLOPT_URL, url_.c_str());
+    curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    CURLcode res = curl_easy_perform(curl);
+    if (res != CURLE_OK) {
+        set_error(std::string("connect failed: ") + curl_easy_strerror(res));
+        return false;
+    }
+    curl_socket_t socket = CURL_SOCKET_BAD;
+    if (curl_easy_getinfo(curl, CURLINFO_ACTIVESOCKET, &socket) != CURLE_OK || socket == CURL_SOCKET_BAD) {
+        set_error("no socket for the pool connection");
+        return false;
+    }
+    socket_ = (int)socket;
+    events_.watch_fd(socket_);
+
+    Json::Value params;
+    params["login"] = user_;
+    params["pass"] = password_;
+    params["agent"] = STRATUM_AGENT;
+    if (!send_request("login", params)) {
+        return false;
+    }
+    login_request_ = request_id_;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(STRATUM_TIMEOUT_SECONDS);
+    while (session_id_.empty()) {
+        if (stop_.load()) {
+            return false;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            set_error("the pool did not answer the login");
+            return false;
+        }
+        events_.wait(deadline);
+        if (!read_messages()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StratumClient::close_session() {
+    connected_ = false;
+    events_.watch_fd(-1);
+    socket_ = -1;
+    if (curl_) {
+        curl_easy_cleanup((CURL*)curl_);
+        curl_ = nullptr;
+    }
+    session_id_.clear();
+    read_buffer_.clear();
+
+    // Job IDs belong to the session: nothing unanswered can be sent again
+    std::deque<PendingShare> queued;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued.swap(queue_);
+    }
+    for (const auto& entry : in_flight_) {
+        add_result(entry.second, false, "connection lost before the pool answered");
+    }
+    for (const PendingShare& share : queued) {
+        add_result(share, false, "connection lost before the share was sent");
+    }
+    in_flight_.clear();
+}
+
+bool StratumClient::session_step(std::chrono::steady_clock::time_point& last_send) {
+    using std::chrono::steady_clock;
+    auto deadline = last_send + std::chrono::seconds(STRATUM_KEEPALIVE_SECONDS);
+    for (const auto& entry : in_flight_) {
+        deadline = std::min(deadline, entry.second.found + std::chrono::seconds(STRATUM_TIMEOUT_SECONDS));
+    }
+    events_.wait(deadline);
+    if (!read_messages()) {
+        return false;
+    }
+
+    std::deque<PendingShare> queued;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued.swap(queue_);
+    }
+    for (PendingShare& share : queued) {
+        Json::Value params;
+        params["id"] = session_id_;
+        params["job_id"] = share.job_id;
+        params["nonce"] = share.nonce_hex;
+        params["result"] = share.hash_hex;
+        if (!send_request("submit", params)) {
+            return false;
+        }
+        in_flight_[request_id_] = std::move(share);
+        last_send = steady_clock::now();
+    }
+
+    auto now = steady_clock::now();
+    for (const auto& entry : in_flight_) {
+        if (now - entry.second.found >= std::chrono::seconds(STRATUM_TIMEOUT_SECONDS)) {
+            set_error("the pool stopped answering shares");
+            return false;
+        }
+    }
+    if (now - last_send >= std::chrono::seconds(STRATUM_KEEPALIVE_SECONDS)) {
+        Json::Value params;
+        params["id"] = session_id_;
+        if (!send_request("keepalived", params)) {
+            return false;
+        }
+        last_send = now;
+    }
+    return true;
+}
+
+bool StratumClient::send_request(const std::string& method, const Json::Value& params) {
+    Json::Value request;
+    request["id"] = (Json::UInt64)++request_id_;
+    request["jsonrpc"] = "2.0";
+    request["method"] = method;
+    request["params"] = params;
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    std::string line = Json::writeString(writer, request) + "\n";
+    LOG_DEBUG_STREAM("Stratum request: " << method);
+
+    size_t offset = 0;
+    while (offset < line.size()) {
+        size_t sent = 0;
+        CURLcode res = curl_easy_send((CURL*)curl_, line.data() + offset, line.size() - offset, &sent);
+        if (res == CURLE_AGAIN) {
+            struct pollfd writable = {socket_, POLLOUT, 0};
+            if (poll(&writable, 1, STRATUM_TIMEOUT_SECONDS * 1000) <= 0) {
+                set_error("timed out sending to the pool");
+                return false;
+            }
+            continue;
+        }
+        if (res != CURLE_OK) {
+            set_error(std::string("send failed: ") + curl_easy_strerror(res));
+            return false;
+        }
+        offset += sent;
+    }
+    return true;
+}
+
+bool StratumClient::read_messages() {
+    char buffer[16384];
+    for (;;) {
+        size_t received = 0;
+        CURLcode res = curl_easy_recv((CURL*)curl_, buffer, sizeof(buffer), &received);
+        if (res == CURLE_AGAIN) {
+            break;
+        }
+        if (res != CURLE_OK) {
+            set_error(std::string("receive failed: ") + curl_easy_strerror(res));
+            return false;
+        }
+        if (received == 0) {
+            set_error("the pool closed the connection");
+            return false;
+        }
+        read_buffer_.append(buffer, received);
+    }
+
+    size_t start = 0;
+    size_t end;
+    while ((end = read_buffer_.find('\n', start)) != std::string::npos) {
+        const char* line = read_buffer_.data() + start;
+        size_t length = end - start;
+        start = end + 1;
+        if (std::all_of(line, line + length, [](char c) { return std::isspace((unsigned char)c); })) {
+            continue;
+        }
+
+        Json::CharReaderBuilder builder;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        Json::Value message;
+        std::string errors;
+        if (!reader->parse(line, line + length, &message, &errors)) {
+            set_error("invalid message from the pool: " + errors);
+            return false;
+        }
+        if (!handle_message(message)) {
+            return false;
+        }
+    }
+    read_buffer_.erase(0, start);
+    if (read_buffer_.size() > STRATUM_MAX_LINE) {
+        set_error("oversized message from the pool");
+        return false;
+    }
+    return true;
+}
+
+bool StratumClient::handle_message(const Json::Value& message) {
+    if (!message.isObject()) {
+        return true;
+    }
+    // Notifications: only new jobs matter
+    if (message["method"].isString()) {
+        if (message["method"].asString() == "job") {
+            return take_job(message["params"]);
+        }
+        LOG_DEBUG_STREAM("Ignoring pool notification " << message["method"].asString());
+        return true;
+    }
+    if (!message["id"].isIntegral()) {
+        return true;
+    }
+    uint64_t id = message["id"].asUInt64();
+    const Json::Value& error = message["error"];
+    const Json::Value& result = message["result"];
+
+    if (id == login_request_) {
+        if (!error.isNull()) {
+            set_error("login rejected: " + error_text(error));
+            return false;
+        }
+        if (!result["id"].isString() || result["id"].asString().empty()) {
+            set_error("login answer without a session id");
+            return false;
+        }
+        session_id_ = result["id"].asString();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            has_instance_id_ = result["instance_id"].isUInt();
+            instance_id_ = has_instance_id_ ? result["instance_id"].asUInt() : 0;
+        }
+        // Connected before the job lands in the inbox, so the main loop
+        // woken by it starts mining
+        connected_ = true;
+        return take_job(result["job"]);
+    }
+
+    auto share = in_flight_.find(id);
+    if (share == in_flight_.end()) {
+        return true;  // keepalived
+    }
+    if (error.isNull()) {
+        add_result(share->second, true, result["status"].isString() ? result["status"].asString() : "OK");
+    } else {
+        add_result(share->second, false, error_text(error));
+    }
+    in_flight_.erase(share);
+    return true;
+}
+
+bool StratumClient::take_job(const Json::Value& job) {
+    BlockTemplate block_template;
+    std::string error;
+    if (!parse_stratum_job(job, block_template, error)) {
+        set_error("unusable job from the pool: " + error);
+        return false;
+    }
+    LOG_DEBUG_STREAM("Pool job " << block_template.job_id << " for height " << block_template.height
+                     << ", share target " << block_template.target_hex.substr(0, 16) << "...");
+    BlockTemplatePtr shared = std::make_shared<const BlockTemplate>(std::move(block_template));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_ = shared;
+    }
+    job_cv_.notify_all();
+    inbox_.push(shared, "pool");
+    return true;
+}
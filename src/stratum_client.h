@@ -0,0 +1,128 @@
+#ifndef STRATUM_CLIENT_H
+#define STRATUM_CLIENT_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <json/json.h>
+#include "block_submitter.h"
+#include "event_loop.h"
+#include "template_inbox.h"
+
+// Seconds between reconnect attempts after the pool connection drops
+static const int STRATUM_RETRY_SECONDS = 5;
+// Seconds of silence after which a keepalived goes out
+static const int STRATUM_KEEPALIVE_SECONDS = 60;
+// Seconds a pool gets to answer the login (and a share)
+static const int STRATUM_TIMEOUT_SECONDS = 30;
+
+// Turn a pool job into a template. The pool does the block building: blob is
+// the 108-byte header without its nonce (CEquihashInput, hex), target the
+// share target, either a full 256-bit target (64 digits, display order like
+// getblocktemplate's) or the top 32 or 64 bits of one in little-endian
+// (8 or 16 digits, as RandomX pools send them). The template has no block
+// body; job_id identifies it in shares. False, with error set, if the job is
+// unusable.
+bool parse_stratum_job(const Json::Value& job, BlockTemplate& result, std::string& error);
+// The job parse_stratum_job reads back as block_template under job_id, with
+// target (full, little-endian) as its share target: what WorkProxy sends its
+// rigs
+Json::Value make_stratum_job(const BlockTemplate& block_template, const std::string& job_id,
+                             const std::vector<uint8_t>& target);
+
+// Pool mining over a stratum-style JSON-RPC connection: newline-delimited
+// JSON on one persistent TCP or TLS connection, with the login / job /
+// submit / keepalived methods RandomX pools speak. The pool pushes jobs,
+// which go to the main loop's TemplateInbox like long poll templates do;
+// mining workers call submit() with each share, and a dedicated thread sends
+// it and hands the pool's answer back through take_result() (on_result runs
+// after each, as for BlockSubmitter).
+//
+// URLs are stratum+tcp://host:port, or stratum+ssl://host:port for TLS.
+class StratumClient {
+public:
+    StratumClient(const std::string& url, const std::string& user, const std::string& password,
+                  TemplateInbox& inbox, std::function<void()> on_result);
+    ~StratumClient();
+
+    StratumClient(const StratumClient&) = delete;
+    StratumClient& operator=(const StratumClient&) = delete;
+
+    void start();
+    void stop();
+
+    // The pool's newest job, waiting up to timeout for the first one; null
+    // if there is none yet
+    BlockTemplatePtr wait_for_job(std::chrono::seconds timeout);
+
+    // Logged in, with a job to mine
+    bool connected() const { return connected_.load(); }
+    // The nonce instance ID the pool assigned this session (a WorkProxy
+    // gives each rig its own), false if it assigned none
+    bool assigned_instance_id(uint32_t& instance_id) const;
+    std::string get_last_error() const;
+
+    // Queue a share; never blocks on the network (called on mining workers)
+    void submit(const uint8_t* header, const uint8_t* hash, const BlockTemplate& job);
+
+    bool take_result(SubmitResult& result);
+
+private:
+    struct PendingShare {
+        std::string job_id;
+        std::string nonce_hex;       // The header's 32 nonce bytes
+        std::string hash_hex;        // As hashed, for the pool
+        std::string block_hash_hex;  // Display order, for messages
+        uint32_t height;
+        std::chrono::steady_clock::time_point found;
+    };
+
+    std::string url_;      // As curl wants it (http:// or https:// with CONNECT_ONLY)
+    std::string user_;
+    std::string password_;
+    TemplateInbox& inbox_;
+    std::function<void()> on_result_;
+    void* curl_;           // CURLOPT_CONNECT_ONLY handle of the open session
+    int socket_;
+    EventLoop events_;     // The session thread sleeps here; submit() and stop() wake it
+    std::thread thread_;
+    std::atomic<bool> stop_;
+    std::atomic<bool> connected_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable job_cv_;
+    BlockTemplatePtr job_;              // Guarded by mutex_
+    std::deque<PendingShare> queue_;    // Guarded by mutex_
+    std::deque<SubmitResult> results_;  // Guarded by mutex_
+    std::string last_error_;            // Guarded by mutex_
+    bool has_instance_id_;              // Guarded by mutex_
+    uint32_t instance_id_;              // Guarded by mutex_
+
+    // Session state, only touched by the session thread
+    std::string session_id_;
+    std::string read_buffer_;
+    uint64_t request_id_;
+    uint64_t login_request_;
+    std::map<uint64_t, PendingShare> in_flight_;  // Shares sent, by request id
+
+    void run();
+    bool open_session();
+    void close_session();
+    bool session_step(std::chrono::steady_clock::time_point& last_send);
+    bool send_request(const std::string& method, const Json::Value& params);
+    bool read_messages();
+    bool handle_message(const Json::Value& message);
+    bool take_job(const Json::Value& job);
+    void add_result(const PendingShare& share, bool accepted, const std::string& result);
+    void set_error(const std::string& error);
+};
+
+#endif // STRATUM_CLIENT_H
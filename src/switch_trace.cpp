@@ -0,0 +1,153 @@
+#include "switch_trace.h"
+#include "telemetry_journal.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+typedef std::chrono::steady_clock::time_point TimePoint;
+
+static double ms_between(TimePoint from, TimePoint to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+void LatencyHistogram::add(double ms) {
+    double us = ms * 1000.0;
+    unsigned int bucket = 0;
+    if (us > 1.0) {
+        bucket = (unsigned int)(std::log2(us) * LATENCY_BUCKETS_PER_OCTAVE);
+        if (bucket >= LATENCY_BUCKETS) {
+            bucket = LATENCY_BUCKETS - 1;
+        }
+    }
+    buckets_[bucket]++;
+    count_++;
+    sum_ms_ += ms;
+    if (ms > max_ms_) {
+        max_ms_ = ms;
+    }
+}
+
+double LatencyHistogram::percentile(double fraction) const {
+    if (count_ == 0) {
+        return 0.0;
+    }
+    uint64_t rank = (uint64_t)std::ceil(fraction * count_);
+    uint64_t seen = 0;
+    for (unsigned int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += buckets_[bucket];
+        if (seen >= rank && buckets_[bucket]) {
+            // The bucket's geometric middle, never past the largest sample
+            double us = std::exp2((bucket + 0.5) / LATENCY_BUCKETS_PER_OCTAVE);
+            return std::min(us / 1000.0, max_ms_);
+        }
+    }
+    return max_ms_;
+}
+
+uint64_t LatencyHistogram::count_below(unsigned int bucket) const {
+    uint64_t below = 0;
+    for (unsigned int i = 0; i < bucket && i < LATENCY_BUCKETS; i++) {
+        below += buckets_[i];
+    }
+    return below;
+}
+
+double LatencyHistogram::bucket_floor_ms(unsigned int bucket) {
+    return std::exp2((double)bucket / LATENCY_BUCKETS_PER_OCTAVE) / 1000.0;
+}
+
+void SwitchTrace::begin(const BlockTemplatePtr& block_template) {
+    TimePoint now = std::chrono::steady_clock::now();
+    const TemplateTimes& times = block_template->times;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (telemetry_journal) {
+        // Looked up here, so the workers' first_hash never takes the journal's lock
+        for (int stage = 0; stage < SWITCH_STAGES; stage++) {
+            if (!journal_ids_[stage]) {
+                journal_ids_[stage] = telemetry_journal->name_id(std::string("switch.") + SWITCH_STAGE_LABELS[stage]);
+            }
+        }
+        telemetry_journal->record(JOURNAL_JOB_SWITCH, JOURNAL_NO_THREAD, block_template->height, 0);
+    }
+
+    // Heard of through the template itself: the answer's arrival is the news
+    noticed_ = times.noticed != TimePoint() ? times.noticed
+             : times.received != TimePoint() ? times.received
+             : times.parsed != TimePoint() ? times.parsed : now;
+    if (times.noticed != TimePoint() && times.requested != TimePoint()) {
+        // Clamped: a tip check may land while a fetch is already under way
+        add(SWITCH_NOTICE_TO_REQUEST, std::max(0.0, ms_between(times.noticed, times.requested)));
+        add(SWITCH_FETCH, ms_between(times.requested, times.received));
+    }
+    if (times.received != TimePoint() && times.parsed != TimePoint()) {
+        add(SWITCH_PARSE, ms_between(times.received, times.parsed));
+    }
+    if (times.parsed != TimePoint()) {
+        add(SWITCH_QUEUE, ms_between(times.parsed, now));
+    }
+    pending_ = block_template;
+    begun_ = now;
+    published_ = false;
+    switches_++;
+}
+
+void SwitchTrace::retarget(const BlockTemplatePtr& block_template) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_ && !published_ && pending_ != block_template) {
+        pending_ = block_template;
+    }
+}
+
+void SwitchTrace::first_hash(const BlockTemplate* block_template, TimePoint published) {
+    TimePoint now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.get() != block_template) {
+        return;
+    }
+    if (!published_) {
+        add(SWITCH_PUBLISH, ms_between(begun_, published));
+        published_ = true;
+    }
+    add(SWITCH_FIRST_HASH, ms_between(published, now));
+    add(SWITCH_TOTAL, ms_between(noticed_, now));
+}
+
+void SwitchTrace::add(SwitchStage stage, double ms) {
+    stages_[stage].add(ms);
+    if (telemetry_journal && journal_ids_[stage]) {
+        telemetry_journal->latency(journal_ids_[stage], ms);
+    }
+}
+
+uint64_t SwitchTrace::switches() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return switches_;
+}
+
+LatencyHistogram SwitchTrace::histogram(SwitchStage stage) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stages_[stage];
+}
+
+std::string SwitchTrace::describe() const {
+    static const char* const names[SWITCH_STAGES] = {
+        "notice -> request", "template fetch", "parse", "queue to main loop",
+        "publish to workers", "first hash per worker", "notice -> first hash"
+    };
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    for (int stage = 0; stage < SWITCH_STAGES; stage++) {
+        const LatencyHistogram& histogram = stages_[stage];
+        if (stage) {
+            out << "\n";
+        }
+        out << std::left << std::setw(22) << names[stage] << std::right << " n=" << histogram.count();
+        if (histogram.count()) {
+            out << ", p50 " << histogram.percentile(0.5) << " ms, p99 " << histogram.percentile(0.99)
+                << " ms, max " << histogram.max_ms() << " ms";
+        }
+    }
+    return out.str();
+}
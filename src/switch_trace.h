@@ -0,0 +1,99 @@
+#ifndef SWITCH_TRACE_H
+#define SWITCH_TRACE_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include "mining_backend.h"
+
+// Latency histogram on a log scale: LATENCY_BUCKETS_PER_OCTAVE buckets per
+// power of two from 1 us up, so a percentile read from it is within about
+// 10% of the true value whether switches take microseconds or seconds
+static const unsigned int LATENCY_BUCKETS_PER_OCTAVE = 4;
+static const unsigned int LATENCY_BUCKETS = 32 * LATENCY_BUCKETS_PER_OCTAVE;  // Up to ~70 minutes
+
+class LatencyHistogram {
+public:
+    LatencyHistogram() : buckets_(), count_(0), sum_ms_(0), max_ms_(0) {}
+
+    void add(double ms);
+    uint64_t count() const { return count_; }
+    double sum_ms() const { return sum_ms_; }
+    double max_ms() const { return max_ms_; }
+    // Latency below which fraction (0..1] of the samples fall, 0 if none
+    double percentile(double fraction) const;
+    // Samples in the buckets below bucket, i.e. under bucket_floor_ms(bucket)
+    // (the first bucket also takes everything under 1 us)
+    uint64_t count_below(unsigned int bucket) const;
+    static double bucket_floor_ms(unsigned int bucket);
+
+private:
+    std::array<uint64_t, LATENCY_BUCKETS> buckets_;
+    uint64_t count_;
+    double sum_ms_;
+    double max_ms_;
+};
+
+// The legs of a block switch, in order (see SwitchTrace)
+enum SwitchStage {
+    SWITCH_NOTICE_TO_REQUEST,  // Block heard of (ZMQ, tip check) -> template requested
+    SWITCH_FETCH,              // Template requested -> answer received
+    SWITCH_PARSE,              // Answer received -> template parsed
+    SWITCH_QUEUE,              // Parsed -> main loop starts the switch
+    SWITCH_PUBLISH,            // Main loop starts the switch -> job published to the workers
+    SWITCH_FIRST_HASH,         // Job published -> a worker's first hashes on it (one sample per worker)
+    SWITCH_TOTAL,              // Block heard of -> a worker's first hashes on it (one sample per worker)
+    SWITCH_STAGES
+};
+
+// Short names of the legs, for metrics labels and the journal
+static const char* const SWITCH_STAGE_LABELS[SWITCH_STAGES] = {
+    "notice_to_request", "fetch", "parse", "queue", "publish", "first_hash", "total"
+};
+
+// Block switch tracing: how long it takes from hearing of a new block to
+// every worker hashing on top of it. Templates carry their own timestamps
+// (TemplateTimes); the main loop calls begin when it starts switching to one
+// and the backend calls first_hash from each worker, so the whole path is
+// timed per event and kept as a histogram per leg. A block heard of through
+// the template itself (a long poll answer, a pool job) starts at its arrival.
+class SwitchTrace {
+public:
+    SwitchTrace() : published_(false), switches_(0), journal_ids_() {}
+
+    SwitchTrace(const SwitchTrace&) = delete;
+    SwitchTrace& operator=(const SwitchTrace&) = delete;
+
+    // The main loop starts switching to block_template, a new tip
+    void begin(const BlockTemplatePtr& block_template);
+    // The switch fell back to a full restart (an epoch change, a failed
+    // hot-swap): time it through to the template the restart mines instead,
+    // unless a worker is already hashing the one begun
+    void retarget(const BlockTemplatePtr& block_template);
+    // Called by the backend on each worker, after its first hashes on a job
+    // published at published (any job; only the traced switch counts)
+    void first_hash(const BlockTemplate* block_template, std::chrono::steady_clock::time_point published);
+
+    uint64_t switches() const;
+    // A copy of one leg's histogram
+    LatencyHistogram histogram(SwitchStage stage) const;
+    // One line per leg: samples, p50, p99 and max
+    std::string describe() const;
+
+private:
+    mutable std::mutex mutex_;
+    BlockTemplatePtr pending_;  // The switch in flight, kept until the next one
+    std::chrono::steady_clock::time_point noticed_;
+    std::chrono::steady_clock::time_point begun_;
+    bool published_;            // SWITCH_PUBLISH recorded for pending_
+    uint64_t switches_;
+    LatencyHistogram stages_[SWITCH_STAGES];
+    uint32_t journal_ids_[SWITCH_STAGES];  // Latency names in the journal, 0 = not looked up
+
+    // A sample of one leg, also journaled with --journal (mutex_ held)
+    void add(SwitchStage stage, double ms);
+};
+
+#endif // SWITCH_TRACE_H
@@ -0,0 +1,59 @@
+#include "systemd_notify.h"
+#include "logger.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+SystemdNotifier::SystemdNotifier() : fd_(-1), watchdog_interval_(0) {
+    const char* socket_path = std::getenv("NOTIFY_SOCKET");
+    if (!socket_path || (socket_path[0] != '/' && socket_path[0] != '@') ||
+        std::strlen(socket_path) >= sizeof(sockaddr_un::sun_path)) {
+        return;
+    }
+    fd_ = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+        return;
+    }
+    path_ = socket_path;
+
+    const char* usec = std::getenv("WATCHDOG_USEC");
+    const char* pid = std::getenv("WATCHDOG_PID");
+    if (usec && (!pid || std::strtol(pid, nullptr, 10) == (long)getpid())) {
+        watchdog_interval_ = std::chrono::microseconds(std::strtoull(usec, nullptr, 10));
+    }
+}
+
+SystemdNotifier::~SystemdNotifier() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+void SystemdNotifier::notify(const std::string& state) {
+    if (fd_ < 0) {
+        return;
+    }
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path_.data(), path_.size());
+    if (address.sun_path[0] == '@') {
+        address.sun_path[0] = '\0';  // Abstract namespace
+    }
+    socklen_t length = (socklen_t)(offsetof(sockaddr_un, sun_path) + path_.size());
+    if (sendto(fd_, state.data(), state.size(), MSG_NOSIGNAL, (sockaddr*)&address, length) < 0) {
+        LOG_DEBUG_STREAM("systemd notification failed: " << std::strerror(errno));
+    }
+}
+
+void SystemdNotifier::watchdog(std::chrono::steady_clock::time_point now) {
+    if (fd_ < 0 || watchdog_interval_.count() == 0 || now - last_watchdog_ < watchdog_interval_ / 2) {
+        return;
+    }
+    notify("WATCHDOG=1");
+    last_watchdog_ = now;
+}
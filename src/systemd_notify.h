@@ -0,0 +1,35 @@
+#ifndef SYSTEMD_NOTIFY_H
+#define SYSTEMD_NOTIFY_H
+
+#include <chrono>
+#include <string>
+
+// The service manager's notification socket (the sd_notify protocol, spoken
+// directly so libsystemd isn't needed): readiness, reloads, status text and
+// watchdog keep-alives for a Type=notify unit. Does nothing outside systemd
+// (no NOTIFY_SOCKET in the environment).
+class SystemdNotifier {
+public:
+    // Reads NOTIFY_SOCKET and WATCHDOG_USEC (if WATCHDOG_PID is ours)
+    SystemdNotifier();
+    ~SystemdNotifier();
+
+    SystemdNotifier(const SystemdNotifier&) = delete;
+    SystemdNotifier& operator=(const SystemdNotifier&) = delete;
+
+    bool enabled() const { return fd_ >= 0; }
+    // Send newline-separated assignments, e.g. "READY=1\nSTATUS=Mining"
+    void notify(const std::string& state);
+    // WatchdogSec of the unit, 0 if the watchdog is off
+    std::chrono::microseconds watchdog_interval() const { return watchdog_interval_; }
+    // Send WATCHDOG=1 if half the interval has passed since the last one
+    void watchdog(std::chrono::steady_clock::time_point now);
+
+private:
+    int fd_;
+    std::string path_;  // Leading '@' for an abstract socket
+    std::chrono::microseconds watchdog_interval_;
+    std::chrono::steady_clock::time_point last_watchdog_;
+};
+
+#endif // SYSTEMD_NOTIFY_H
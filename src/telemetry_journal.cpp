@@ -0,0 +1,307 @@
+#include "telemetry_journal.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+TelemetryJournal* telemetry_journal = nullptr;
+
+namespace {
+
+int64_t unix_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+TelemetryJournal::TelemetryJournal()
+    : segment_bytes_(0), max_bytes_(0), current_(nullptr), written_(0), dropped_(0), sequence_(0), stop_(false) {}
+
+TelemetryJournal::~TelemetryJournal() {
+    close();
+}
+
+bool TelemetryJournal::supported() {
+#ifndef _WIN32
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool TelemetryJournal::open(const std::string& dir, uint64_t segment_mb, uint64_t max_mb, std::string& error) {
+    dir_ = dir;
+    segment_bytes_ = std::max<uint64_t>(1, segment_mb) << 20;
+    max_bytes_ = std::max<uint64_t>(max_mb, 2 * std::max<uint64_t>(1, segment_mb)) << 20;
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+    Segment* segment = create_segment(error);
+    if (!segment) {
+        return false;
+    }
+    current_.store(segment, std::memory_order_release);
+    prune();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = false;
+    }
+    thread_ = std::thread(&TelemetryJournal::run, this);
+    return true;
+}
+
+void TelemetryJournal::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    for (Segment* segment : retired_) {
+        release(segment);
+    }
+    retired_.clear();
+    Segment* segment = current_.exchange(nullptr);
+    if (segment) {
+        release(segment);
+        prune();
+    }
+}
+
+TelemetryJournal::Segment* TelemetryJournal::create_segment(std::string& error) {
+#ifndef _WIN32
+    const time_t now = std::time(nullptr);
+    tm utc;
+    gmtime_r(&now, &utc);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &utc);
+    // Named to sort in the order written; a restart within the second
+    // carries on from an unused number
+    int fd = -1;
+    std::string path;
+    for (int attempt = 0; attempt < 1000 && fd < 0; attempt++) {
+        char name[64];
+        std::snprintf(name, sizeof(name), "journal-%s-%06llu%s", stamp, (unsigned long long)sequence_++,
+                      JOURNAL_EXTENSION);
+        path = (fs::path(dir_) / name).string();
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0 && errno != EEXIST) {
+            break;
+        }
+    }
+    if (fd < 0) {
+        error = "can't create " + path + ": " + std::strerror(errno);
+        return nullptr;
+    }
+    // Sparse until written
+    if (ftruncate(fd, (off_t)segment_bytes_) != 0) {
+        error = "can't size " + path + ": " + std::strerror(errno);
+        ::close(fd);
+        unlink(path.c_str());
+        return nullptr;
+    }
+    void* data = mmap(nullptr, segment_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        error = "can't map " + path + ": " + std::strerror(errno);
+        ::close(fd);
+        unlink(path.c_str());
+        return nullptr;
+    }
+
+    Segment* segment = new Segment();
+    segment->path = path;
+    segment->fd = fd;
+    segment->records = static_cast<JournalRecord*>(data);
+    segment->capacity = segment_bytes_ / sizeof(JournalRecord);
+    segment->next.store(1);
+    uint8_t* header = reinterpret_cast<uint8_t*>(segment->records);
+    const uint32_t record_size = sizeof(JournalRecord);
+    const int64_t started = unix_us();
+    std::memcpy(header, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    std::memcpy(header + 8, &JOURNAL_VERSION, sizeof(JOURNAL_VERSION));
+    std::memcpy(header + 12, &record_size, sizeof(record_size));
+    std::memcpy(header + 16, &started, sizeof(started));
+    return segment;
+#else
+    error = "the journal isn't supported on Windows";
+    return nullptr;
+#endif
+}
+
+void TelemetryJournal::put(Segment* segment, JournalRecordType type, uint16_t thread, uint32_t value, uint64_t a,
+                           uint64_t b, uint8_t flags) {
+    const uint64_t slot = segment->next.fetch_add(1, std::memory_order_relaxed);
+    if (slot >= segment->capacity) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    JournalRecord& record = segment->records[slot];
+    record.flags = flags;
+    record.thread = thread;
+    record.value = value;
+    record.time_us = unix_us();
+    record.a = a;
+    record.b = b;
+    // A reader of the file (even after a crash) sees a type only on a
+    // filled record
+    __atomic_store_n(&record.type, (uint8_t)type, __ATOMIC_RELEASE);
+    written_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TelemetryJournal::record(JournalRecordType type, uint16_t thread, uint32_t value, uint64_t a, uint64_t b,
+                              uint8_t flags) {
+    Segment* segment = current_.load(std::memory_order_acquire);
+    if (segment) {
+        put(segment, type, thread, value, a, b, flags);
+    }
+}
+
+void TelemetryJournal::put_name(Segment* segment, const std::string& name, uint32_t id) {
+    const size_t length = std::min(name.size(), JOURNAL_NAME_SIZE);
+    for (uint16_t part = 0; part * 16 < length; part++) {
+        char text[16] = {};
+        std::memcpy(text, name.data() + part * 16, std::min<size_t>(16, length - part * 16));
+        uint64_t a;
+        uint64_t b;
+        std::memcpy(&a, text, 8);
+        std::memcpy(&b, text + 8, 8);
+        put(segment, JOURNAL_NAME, part, id, a, b, 0);
+    }
+}
+
+uint32_t TelemetryJournal::name_id(const std::string& name) {
+    std::lock_guard<std::mutex> lock(names_mutex_);
+    auto it = names_.find(name);
+    if (it != names_.end()) {
+        return it->second;
+    }
+    const uint32_t id = (uint32_t)names_.size() + 1;
+    names_[name] = id;
+    Segment* segment = current_.load(std::memory_order_acquire);
+    if (segment) {
+        put_name(segment, name, id);
+    }
+    return id;
+}
+
+void TelemetryJournal::hash_counts(const std::vector<uint64_t>& counts) {
+    const auto now = std::chrono::steady_clock::now();
+    // A new pool starts its counts over: take them as the new baseline
+    if (counts.size() == last_counts_.size()) {
+        const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(now - last_counted_).count();
+        for (size_t i = 0; i < counts.size(); i++) {
+            const uint64_t hashes = counts[i] >= last_counts_[i] ? counts[i] - last_counts_[i] : counts[i];
+            record(JOURNAL_HASHES, (uint16_t)std::min<size_t>(i, JOURNAL_NO_THREAD - 1), 0, hashes, us);
+        }
+    }
+    last_counts_ = counts;
+    last_counted_ = now;
+}
+
+void TelemetryJournal::rotate() {
+    std::string error;
+    Segment* next = create_segment(error);
+    if (!next) {
+        static bool warned = false;
+        if (!warned) {
+            LOG_WARNING_STREAM("Journal: " << error << "; records are dropped once " << dir_ << " fills");
+            warned = true;
+        }
+        return;
+    }
+    Segment* previous;
+    {
+        // Every name is in the new segment before anything refers to it there
+        std::lock_guard<std::mutex> lock(names_mutex_);
+        for (const auto& name : names_) {
+            put_name(next, name.first, name.second);
+        }
+        previous = current_.exchange(next, std::memory_order_acq_rel);
+    }
+    if (previous) {
+        previous->retired = std::chrono::steady_clock::now();
+        retired_.push_back(previous);
+    }
+    prune();
+}
+
+void TelemetryJournal::release(Segment* segment) {
+#ifndef _WIN32
+    const uint64_t used = std::min(segment->next.load(), segment->capacity);
+    munmap(segment->records, segment_bytes_);
+    // Cut to what was written: only the live segment is full size
+    if (ftruncate(segment->fd, (off_t)(used * sizeof(JournalRecord))) != 0) {
+        LOG_DEBUG_STREAM("Journal: can't truncate " << segment->path << ": " << std::strerror(errno));
+    }
+    ::close(segment->fd);
+#endif
+    delete segment;
+}
+
+void TelemetryJournal::prune() {
+    std::vector<std::pair<std::string, uint64_t>> files;
+    uint64_t total = 0;
+    std::error_code ec;
+    for (const fs::directory_entry& entry : fs::directory_iterator(dir_, ec)) {
+        const std::string name = entry.path().filename().string();
+        if (name.compare(0, 8, "journal-") != 0 || entry.path().extension() != JOURNAL_EXTENSION) {
+            continue;
+        }
+        const uint64_t size = entry.file_size(ec);
+        if (!ec) {
+            files.emplace_back(entry.path().string(), size);
+            total += size;
+        }
+    }
+    // Oldest first; the live and retired segments stay
+    std::sort(files.begin(), files.end());
+    Segment* live = current_.load();
+    for (const auto& file : files) {
+        if (total <= max_bytes_) {
+            break;
+        }
+        bool open = live && file.first == live->path;
+        for (const Segment* retired : retired_) {
+            open = open || file.first == retired->path;
+        }
+        if (!open && fs::remove(file.first, ec)) {
+            LOG_DEBUG_STREAM("Journal: removed " << file.first);
+            total -= file.second;
+        }
+    }
+}
+
+void TelemetryJournal::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!wake_.wait_for(lock, std::chrono::milliseconds(JOURNAL_CHECK_MS), [this]() { return stop_; })) {
+        lock.unlock();
+        Segment* segment = current_.load(std::memory_order_acquire);
+        if (segment && segment->next.load(std::memory_order_relaxed) >= segment->capacity * JOURNAL_ROTATE_FILL) {
+            rotate();
+        }
+        const auto now = std::chrono::steady_clock::now();
+        bool released = false;
+        while (!retired_.empty() && now - retired_.front()->retired >= std::chrono::seconds(JOURNAL_RETIRE_SECONDS)) {
+            release(retired_.front());
+            retired_.pop_front();
+            released = true;
+        }
+        if (released) {
+            prune();
+        }
+        lock.lock();
+    }
+}
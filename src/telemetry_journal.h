@@ -0,0 +1,157 @@
+#ifndef TELEMETRY_JOURNAL_H
+#define TELEMETRY_JOURNAL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Journal files: DIR/journal-YYYYMMDD-HHMMSS-N.jnl, each a header record
+// then JournalRecords
+static const char JOURNAL_MAGIC[8] = {'J', 'U', 'N', 'O', 'J', 'N', 'L', '\0'};
+static const uint32_t JOURNAL_VERSION = 1;
+static const char JOURNAL_EXTENSION[] = ".jnl";
+static const uint64_t JOURNAL_DEFAULT_SEGMENT_MB = 64;
+static const uint64_t JOURNAL_DEFAULT_MAX_MB = 4096;
+// A segment is replaced once this much of it is taken; writers only drop
+// records if the rest fills before the maintenance thread's next look
+static const double JOURNAL_ROTATE_FILL = 0.75;
+static const int JOURNAL_CHECK_MS = 200;
+// A replaced segment stays mapped this long for writers that picked it
+// just before the switch, then is cut to what was written and closed
+static const int JOURNAL_RETIRE_SECONDS = 30;
+// Names (RPC methods, latency kinds, sensors) are cut to this; a name
+// takes a JOURNAL_NAME record per 16 bytes
+static const size_t JOURNAL_NAME_SIZE = 64;
+static const uint16_t JOURNAL_NO_THREAD = 0xffff;
+
+// What a record holds; stored in a byte, 0 = a slot never written (a
+// writer that crashed between taking and filling it, or the unused end of
+// the live segment)
+enum JournalRecordType {
+    JOURNAL_EMPTY = 0,
+    JOURNAL_NAME,           // value: the ID; thread: which 16 bytes of the name a and b hold, NUL-padded
+    JOURNAL_HASHES,         // thread; a: hashes since its last record; b: microseconds that covers
+    JOURNAL_JOB_SWITCH,     // value: the height switched to
+    JOURNAL_LATENCY,        // value: name ID of what was timed; a: nanoseconds
+    JOURNAL_POWER,          // a: package milliwatts over the last second
+    JOURNAL_TEMPERATURE,    // value: name ID of the sensor; a: millidegrees Celsius (signed)
+    JOURNAL_RPC,            // value: name ID of the call; flags: JOURNAL_RPC_*; a: microseconds
+    JOURNAL_TYPES
+};
+
+static const char* const JOURNAL_TYPE_NAMES[JOURNAL_TYPES] = {
+    "empty", "name", "hashes", "job_switch", "latency", "power", "temperature", "rpc"};
+
+// JOURNAL_RPC flags
+static const uint8_t JOURNAL_RPC_FAILED = 1;
+static const uint8_t JOURNAL_RPC_CONNECTED = 2;     // Opened a new connection
+
+// One fixed-size record, host byte order; the file header takes the first
+// slot (magic, version, record size, start time)
+struct JournalRecord {
+    uint8_t type;           // JournalRecordType, stored last
+    uint8_t flags;
+    uint16_t thread;        // Worker index, JOURNAL_NO_THREAD if none
+    uint32_t value;
+    int64_t time_us;        // Unix time
+    uint64_t a;
+    uint64_t b;
+};
+static_assert(sizeof(JournalRecord) == 32, "journal records are 32 bytes");
+
+// Append-only binary telemetry (--journal DIR): per-thread hash counts,
+// job switches, latency samples, package power and temperature and RPC
+// calls, at a cost small enough to keep weeks of per-second history.
+//
+// Records go straight into a memory-mapped segment file. A writer takes a
+// slot with one fetch_add on the segment's cursor and fills it, storing
+// the type byte last: no lock, no system call, no waiting on other
+// writers, so worker threads may write. The page cache writes the file
+// out; a crash loses at most what the kernel had not flushed. Once a
+// segment is JOURNAL_ROTATE_FILL full, the maintenance thread maps the
+// next one and swaps it in, and deletes the oldest files to keep the
+// directory under the size limit. juno-journal exports the files to CSV.
+class TelemetryJournal {
+public:
+    TelemetryJournal();
+    ~TelemetryJournal();
+
+    TelemetryJournal(const TelemetryJournal&) = delete;
+    TelemetryJournal& operator=(const TelemetryJournal&) = delete;
+
+    // False on Windows, which has no journal
+    static bool supported();
+
+    // Start journaling to a new segment in dir; false with error set if it
+    // can't be created
+    bool open(const std::string& dir, uint64_t segment_mb, uint64_t max_mb, std::string& error);
+    void close();
+
+    // The ID (never 0) to record name under, registered and written on
+    // first use. Takes a lock: worker threads look their names up beforehand.
+    uint32_t name_id(const std::string& name);
+
+    // Wait-free
+    void record(JournalRecordType type, uint16_t thread, uint32_t value, uint64_t a, uint64_t b = 0,
+                uint8_t flags = 0);
+    void latency(uint32_t name, double ms) { record(JOURNAL_LATENCY, JOURNAL_NO_THREAD, name, (uint64_t)(ms * 1e6)); }
+
+    // Main loop: the backend's per-thread hash counts (which run on across
+    // jobs); records each thread's hashes since the last call
+    void hash_counts(const std::vector<uint64_t>& counts);
+
+    uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Segment {
+        std::string path;
+        int fd;
+        JournalRecord* records;
+        uint64_t capacity;                  // Records, header included
+        std::atomic<uint64_t> next;         // Next free slot
+        std::chrono::steady_clock::time_point retired;
+    };
+
+    std::string dir_;
+    uint64_t segment_bytes_;
+    uint64_t max_bytes_;
+    std::atomic<Segment*> current_;
+    std::atomic<uint64_t> written_;
+    std::atomic<uint64_t> dropped_;
+    uint64_t sequence_;                     // Segments opened (maintenance thread and open)
+
+    std::mutex names_mutex_;
+    std::map<std::string, uint32_t> names_; // Guarded by names_mutex_
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_;                             // Guarded by mutex_
+    std::deque<Segment*> retired_;          // Maintenance thread only
+
+    // Main loop only
+    std::vector<uint64_t> last_counts_;
+    std::chrono::steady_clock::time_point last_counted_;
+
+    Segment* create_segment(std::string& error);
+    void put(Segment* segment, JournalRecordType type, uint16_t thread, uint32_t value, uint64_t a, uint64_t b,
+             uint8_t flags);
+    void put_name(Segment* segment, const std::string& name, uint32_t id);
+    void rotate();
+    void release(Segment* segment);
+    void prune();
+    void run();
+};
+
+// The journal the miner's components write to (null = off)
+extern TelemetryJournal* telemetry_journal;
+
+#endif // TELEMETRY_JOURNAL_H
@@ -0,0 +1,26 @@
+#include "template_inbox.h"
+
+void TemplateInbox::push(BlockTemplatePtr block_template, const char* source) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_ && block_template->height < pending_->height) {
+            return;
+        }
+        pending_ = std::move(block_template);
+        source_ = source;
+    }
+    if (on_push_) {
+        on_push_();
+    }
+}
+
+bool TemplateInbox::take(BlockTemplatePtr& block_template, std::string& source) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pending_) {
+        return false;
+    }
+    block_template = std::move(pending_);
+    pending_.reset();
+    source = source_;
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef TEMPLATE_INBOX_H
+#define TEMPLATE_INBOX_H
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include "mining_backend.h"
+
+// Where templates fetched and parsed off the main loop (the long poll, the
+// ZMQ fetcher) are left for it. on_push runs after each push (the main loop
+// wakes its EventLoop there), so a pushed template is acted on as soon as it
+// arrives.
+class TemplateInbox {
+public:
+    explicit TemplateInbox(std::function<void()> on_push = nullptr)
+        : on_push_(std::move(on_push)), source_("") {}
+
+    TemplateInbox(const TemplateInbox&) = delete;
+    TemplateInbox& operator=(const TemplateInbox&) = delete;
+
+    // Leave a template, labelled with where it came from (for messages). An
+    // uncollected template for a higher height is not replaced by a lower one.
+    void push(BlockTemplatePtr block_template, const char* source);
+
+    // The newest template pushed since the last take
+    bool take(BlockTemplatePtr& block_template, std::string& source);
+
+private:
+    std::function<void()> on_push_;
+    std::mutex mutex_;
+    BlockTemplatePtr pending_;
+    const char* source_;
+};
+
+#endif // TEMPLATE_INBOX_H
@@ -0,0 +1,91 @@
+#include "template_longpoll.h"
+#include "logger.h"
+#include "trace_recorder.h"
+#include <chrono>
+
+TemplateLongPoll::TemplateLongPoll(const std::string& url, const std::string& user, const std::string& password,
+                                   TemplateInbox& inbox, unsigned int node)
+    : rpc_(url, user, password), inbox_(inbox), node_(node), stop_(false), active_(false) {
+    // The node holds the request open until something changes
+    rpc_.set_timeout(0);
+    rpc_.set_abort_flag(&stop_);
+}
+
+void TemplateLongPoll::follow(const std::string& longpollid) {
+    if (longpollid.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        longpollid_ = longpollid;
+    }
+    if (!thread_.joinable()) {
+        LOG_INFO("Node supports long polling, waiting for templates on a dedicated connection");
+        thread_ = std::thread(&TemplateLongPoll::run, this);
+    }
+}
+
+void TemplateLongPoll::start() {
+    if (!thread_.joinable()) {
+        thread_ = std::thread(&TemplateLongPoll::run, this);
+    }
+}
+
+void TemplateLongPoll::stop() {
+    stop_ = true;
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    active_ = false;
+}
+
+void TemplateLongPoll::run() {
+    TraceRecorder::set_thread_name("long poll");
+    while (!stop_.load()) {
+        std::string longpollid;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            longpollid = longpollid_;
+        }
+
+        active_ = !longpollid.empty();
+        BlockTemplate block_template;
+        if (rpc_.get_block_template(block_template, "", longpollid)) {
+            block_template.node = node_;
+            std::unique_lock<std::mutex> lock(mutex_);
+            // The main loop may have moved on already (polling or ZMQ) and
+            // passed a newer id to follow; this answer is then for an old one
+            if (longpollid_ != longpollid) {
+                continue;
+            }
+            const std::string next = block_template.longpollid;
+            bool held = !next.empty() && next != longpollid;
+            if (held) {
+                longpollid_ = next;
+            }
+            lock.unlock();
+            // Answers to a long poll, and whatever a request without an id got
+            if (held || longpollid.empty()) {
+                inbox_.push(std::make_shared<const BlockTemplate>(std::move(block_template)), "long poll");
+            }
+            if (!held) {
+                // Answered at once with nothing new: the node doesn't hold
+                // requests, so don't spin on it
+                lock.lock();
+                cv_.wait_for(lock, std::chrono::seconds(LONGPOLL_RETRY_SECONDS), [&]() { return stop_.load(); });
+            }
+            continue;
+        }
+
+        if (stop_.load()) {
+            break;
+        }
+        active_ = false;
+        LOG_WARNING_STREAM("Long poll failed (" << rpc_.get_last_error() << "), retrying in "
+                           << LONGPOLL_RETRY_SECONDS << "s");
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_for(lock, std::chrono::seconds(LONGPOLL_RETRY_SECONDS), [&]() { return stop_.load(); });
+    }
+    active_ = false;
+}
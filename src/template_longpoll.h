@@ -0,0 +1,59 @@
+#ifndef TEMPLATE_LONGPOLL_H
+#define TEMPLATE_LONGPOLL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "rpc_client.h"
+#include "template_inbox.h"
+
+// Seconds between reconnect attempts after a failed long poll
+static const int LONGPOLL_RETRY_SECONDS = 5;
+// While a long poll is open the main loop still checks the tip this often
+// (seconds), in case the connection died without an error
+static const int LONGPOLL_BACKUP_CHECK_SECONDS = 60;
+
+// BIP22 long polling on a dedicated RPC connection: a background thread
+// keeps a getblocktemplate request open with the newest template's
+// longpollid, and the node answers it the moment the tip or the mempool
+// changes. Answers go to the main loop's TemplateInbox, so a new block
+// costs no getblockchaininfo poll and no second round trip. With several
+// nodes each has its own long poll, and templates are tagged with node.
+class TemplateLongPoll {
+public:
+    TemplateLongPoll(const std::string& url, const std::string& user, const std::string& password,
+                     TemplateInbox& inbox, unsigned int node = 0);
+    ~TemplateLongPoll() { stop(); }
+
+    TemplateLongPoll(const TemplateLongPoll&) = delete;
+    TemplateLongPoll& operator=(const TemplateLongPoll&) = delete;
+
+    // Wait for templates newer than the one with this longpollid. Starts the
+    // thread on first use; a node that sends no longpollid leaves it off.
+    void follow(const std::string& longpollid);
+    // Start without a longpollid: the node's current template is pushed at
+    // once and its ID followed from there. A node that sends no longpollid
+    // is polled every LONGPOLL_RETRY_SECONDS instead.
+    void start();
+    void stop();
+
+    // True while a long poll is open, i.e. polling for blocks is redundant
+    bool active() const { return active_.load(); }
+
+private:
+    RPCClient rpc_;
+    TemplateInbox& inbox_;
+    unsigned int node_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::string longpollid_;  // Guarded by mutex_
+    std::atomic<bool> stop_;
+    std::atomic<bool> active_;
+
+    void run();
+};
+
+#endif // TEMPLATE_LONGPOLL_H
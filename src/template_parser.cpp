@@ -0,0 +1,536 @@
+#include "template_parser.h"
+#include "miner.h"
+#include "utils.h"
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+
+// Deepest nesting accepted (JsonCpp's default stack limit)
+static const size_t MAX_DEPTH = 1000;
+
+// Field names for error messages, by slot
+static const char* const SLOT_NAMES[] = {
+    "", "", "result", "error", "error.message", "version", "previousblockhash", "curtime", "mintime", "maxtime",
+    "bits", "height", "randomxseedheight", "randomxseedhash", "randomxnextseedhash", "target", "longpollid",
+    "blockcommitmentshash",
+    "defaultroots", "defaultroots.merkleroot", "defaultroots.blockcommitmentshash", "coinbasetxn",
+    "coinbasetxn.data", "transactions", "transactions", "transactions.data"
+};
+
+BlockTemplateParser::BlockTemplateParser() {
+    static_assert(sizeof(SLOT_NAMES) / sizeof(SLOT_NAMES[0]) == SLOT_COUNT, "one name per slot");
+    reset();
+}
+
+void BlockTemplateParser::reset() {
+    state_ = STATE_VALUE;
+    stack_.clear();
+    value_slot_ = SLOT_ENVELOPE;
+    reading_key_ = false;
+    token_.clear();
+    hex_out_ = nullptr;
+    hex_start_ = 0;
+    unicode_ = 0;
+    unicode_digits_ = 0;
+    high_surrogate_ = 0;
+    error_.clear();
+    bytes_fed_ = 0;
+
+    template_ = BlockTemplate();
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        numbers_[i] = 0;
+        seen_[i] = false;
+        strings_[i].clear();
+    }
+    rpc_error_ = false;
+    coinbase_hex_.clear();
+    transactions_hex_.clear();
+    transaction_count_ = 0;
+}
+
+void BlockTemplateParser::reserve(size_t response_bytes) {
+    // The transactions are most of a large response
+    transactions_hex_.reserve(response_bytes);
+}
+
+bool BlockTemplateParser::fail(const std::string& message) {
+    if (state_ != STATE_FAILED) {
+        error_ = message;
+        state_ = STATE_FAILED;
+    }
+    return false;
+}
+
+BlockTemplateParser::Slot BlockTemplateParser::key_slot(Slot container, const std::string& key) const {
+    switch (container) {
+    case SLOT_ENVELOPE:
+        if (key == "result") return SLOT_RESULT;
+        if (key == "error") return SLOT_ERROR;
+        break;
+    case SLOT_ERROR:
+        if (key == "message") return SLOT_ERROR_MESSAGE;
+        break;
+    case SLOT_RESULT:
+        if (key == "version") return SLOT_VERSION;
+        if (key == "previousblockhash") return SLOT_PREVIOUS_HASH;
+        if (key == "curtime") return SLOT_CURTIME;
+        if (key == "mintime") return SLOT_MINTIME;
+        if (key == "maxtime") return SLOT_MAXTIME;
+        if (key == "bits") return SLOT_BITS;
+        if (key == "height") return SLOT_HEIGHT;
+        if (key == "randomxseedheight") return SLOT_SEED_HEIGHT;
+        if (key == "randomxseedhash") return SLOT_SEED_HASH;
+        if (key == "randomxnextseedhash") return SLOT_NEXT_SEED_HASH;
+        if (key == "target") return SLOT_TARGET;
+        if (key == "longpollid") return SLOT_LONGPOLLID;
+        if (key == "blockcommitmentshash") return SLOT_COMMITMENTS;
+        if (key == "defaultroots") return SLOT_DEFAULT_ROOTS;
+        if (key == "coinbasetxn") return SLOT_COINBASE;
+        if (key == "transactions") return SLOT_TRANSACTIONS;
+        break;
+    case SLOT_DEFAULT_ROOTS:
+        if (key == "merkleroot") return SLOT_ROOT_MERKLE;
+        if (key == "blockcommitmentshash") return SLOT_ROOT_COMMITMENTS;
+        break;
+    case SLOT_COINBASE:
+        if (key == "data") return SLOT_COINBASE_DATA;
+        break;
+    case SLOT_TRANSACTION:
+        if (key == "data") return SLOT_TRANSACTION_DATA;
+        break;
+    default:
+        break;
+    }
+    return SLOT_SKIP;
+}
+
+bool BlockTemplateParser::number_slot(Slot slot) {
+    return slot == SLOT_VERSION || slot == SLOT_CURTIME || slot == SLOT_MINTIME || slot == SLOT_MAXTIME ||
+           slot == SLOT_HEIGHT || slot == SLOT_SEED_HEIGHT;
+}
+
+bool BlockTemplateParser::string_slot(Slot slot) {
+    switch (slot) {
+    case SLOT_ERROR_MESSAGE: case SLOT_PREVIOUS_HASH: case SLOT_BITS: case SLOT_SEED_HASH:
+    case SLOT_NEXT_SEED_HASH: case SLOT_TARGET: case SLOT_LONGPOLLID: case SLOT_COMMITMENTS:
+    case SLOT_ROOT_MERKLE: case SLOT_ROOT_COMMITMENTS: case SLOT_COINBASE_DATA: case SLOT_TRANSACTION_DATA:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool BlockTemplateParser::begin_value(char c) {
+    Slot slot = value_slot_;
+
+    if (c == '{' || c == '[') {
+        if (stack_.size() >= MAX_DEPTH) {
+            return fail("Failed to parse JSON response: nested too deeply");
+        }
+        if (number_slot(slot) || string_slot(slot)) {
+            return fail(std::string("Invalid ") + SLOT_NAMES[slot] + " in block template");
+        }
+        bool object = c == '{';
+        if (slot == SLOT_ERROR) {
+            rpc_error_ = true;
+        } else if (slot == SLOT_ENVELOPE && !object) {
+            return fail("Failed to parse JSON response: not an object");
+        }
+        // A container of the wrong kind is skipped, as parse_block_template ignores it
+        bool wanted = slot == SLOT_TRANSACTIONS ? !object : object;
+        if (!wanted) {
+            slot = SLOT_SKIP;
+        }
+        seen_[slot] = true;
+        stack_.push_back(Frame{slot, object});
+        state_ = object ? STATE_FIRST_KEY : STATE_FIRST_ELEMENT;
+        return true;
+    }
+
+    if (c == '"') {
+        if (number_slot(slot)) {
+            return fail(std::string("Invalid ") + SLOT_NAMES[slot] + " in block template");
+        }
+        reading_key_ = false;
+        token_.clear();
+        hex_out_ = nullptr;
+        if (slot == SLOT_COINBASE_DATA) {
+            coinbase_hex_.clear();
+            hex_out_ = &coinbase_hex_;
+        } else if (slot == SLOT_TRANSACTION_DATA) {
+            hex_out_ = &transactions_hex_;
+        }
+        if (hex_out_) {
+            hex_start_ = hex_out_->size();
+        }
+        state_ = STATE_STRING;
+        return true;
+    }
+
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        token_.assign(1, c);
+        state_ = STATE_NUMBER;
+        return true;
+    }
+    if (c == 't' || c == 'f' || c == 'n') {
+        token_.assign(1, c);
+        state_ = STATE_LITERAL;
+        return true;
+    }
+    return fail(std::string("Failed to parse JSON response: unexpected '") + c + "'");
+}
+
+void BlockTemplateParser::end_value() {
+    state_ = stack_.empty() ? STATE_DONE : STATE_AFTER_VALUE;
+}
+
+void BlockTemplateParser::end_string() {
+    if (reading_key_) {
+        reading_key_ = false;
+        state_ = STATE_COLON;
+        return;
+    }
+    if (hex_out_) {
+        if ((hex_out_->size() - hex_start_) % 2 != 0) {
+            fail("Odd-length transaction hex in block template");
+            return;
+        }
+        if (value_slot_ == SLOT_TRANSACTION_DATA) {
+            transaction_count_++;
+        }
+        hex_out_ = nullptr;
+        seen_[value_slot_] = true;
+    } else if (value_slot_ == SLOT_ERROR) {
+        rpc_error_ = true;
+        strings_[SLOT_ERROR_MESSAGE].swap(token_);
+    } else if (value_slot_ == SLOT_ENVELOPE) {
+        fail("Failed to parse JSON response: not an object");
+        return;
+    } else if (string_slot(value_slot_)) {
+        strings_[value_slot_].swap(token_);
+        seen_[value_slot_] = true;
+    }
+    end_value();
+}
+
+bool BlockTemplateParser::end_scalar() {
+    Slot slot = value_slot_;
+    if (state_ == STATE_LITERAL) {
+        if (token_ != "true" && token_ != "false" && token_ != "null") {
+            return fail("Failed to parse JSON response: unknown literal " + token_);
+        }
+        if (slot == SLOT_ENVELOPE) {
+            return fail("Failed to parse JSON response: not an object");
+        }
+        if (token_ != "null") {
+            if (slot == SLOT_ERROR) {
+                rpc_error_ = true;
+            } else if (number_slot(slot) || string_slot(slot)) {
+                return fail(std::string("Invalid ") + SLOT_NAMES[slot] + " in block template");
+            }
+        }
+        // null leaves a field missing
+        end_value();
+        return true;
+    }
+
+    if (number_slot(slot)) {
+        // Only unsigned integers fit these fields
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long value = std::strtoull(token_.c_str(), &end, 10);
+        if (token_[0] == '-' || *end != '\0' || errno == ERANGE) {
+            return fail(std::string("Invalid ") + SLOT_NAMES[slot] + " in block template");
+        }
+        numbers_[slot] = value;
+        seen_[slot] = true;
+    } else if (slot == SLOT_ERROR) {
+        rpc_error_ = true;
+    } else if (slot == SLOT_ENVELOPE) {
+        return fail("Failed to parse JSON response: not an object");
+    } else if (string_slot(slot)) {
+        return fail(std::string("Invalid ") + SLOT_NAMES[slot] + " in block template");
+    }
+    end_value();
+    return true;
+}
+
+void BlockTemplateParser::append_code_point(uint32_t code_point) {
+    if (code_point >= 0xd800 && code_point < 0xdc00) {
+        high_surrogate_ = code_point;
+        return;
+    }
+    if (code_point >= 0xdc00 && code_point < 0xe000 && high_surrogate_) {
+        code_point = 0x10000 + ((high_surrogate_ - 0xd800) << 10) + (code_point - 0xdc00);
+    }
+    high_surrogate_ = 0;
+    if (code_point < 0x80) {
+        token_ += static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+        token_ += static_cast<char>(0xc0 | (code_point >> 6));
+        token_ += static_cast<char>(0x80 | (code_point & 0x3f));
+    } else if (code_point < 0x10000) {
+        token_ += static_cast<char>(0xe0 | (code_point >> 12));
+        token_ += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+        token_ += static_cast<char>(0x80 | (code_point & 0x3f));
+    } else {
+        token_ += static_cast<char>(0xf0 | (code_point >> 18));
+        token_ += static_cast<char>(0x80 | ((code_point >> 12) & 0x3f));
+        token_ += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+        token_ += static_cast<char>(0x80 | (code_point & 0x3f));
+    }
+}
+
+bool BlockTemplateParser::feed(const char* data, size_t len) {
+    bytes_fed_ += len;
+    const char* p = data;
+    const char* end = data + len;
+    while (p < end) {
+        char c = *p;
+        switch (state_) {
+        case STATE_FAILED:
+            return false;
+
+        case STATE_STRING:
+            if (hex_out_) {
+                // Transaction hex: checked and copied in bulk, and may end in a later chunk
+                p += utils::append_hex_lower(p, static_cast<size_t>(end - p), *hex_out_);
+                if (p == end) {
+                    break;
+                }
+                if (*p != '"') {
+                    return fail("Invalid transaction hex in block template");
+                }
+                p++;
+                end_string();
+            } else {
+                const char* q = p;
+                while (q < end && *q != '"' && *q != '\\') {
+                    q++;
+                }
+                if (reading_key_ || value_slot_ != SLOT_SKIP) {
+                    token_.append(p, static_cast<size_t>(q - p));
+                }
+                p = q;
+                if (p == end) {
+                    break;
+                }
+                if (*p++ == '"') {
+                    end_string();
+                } else {
+                    state_ = STATE_ESCAPE;
+                }
+            }
+            break;
+
+        case STATE_ESCAPE: {
+            char unescaped;
+            switch (c) {
+            case '"': case '\\': case '/': unescaped = c; break;
+            case 'b': unescaped = '\b'; break;
+            case 'f': unescaped = '\f'; break;
+            case 'n': unescaped = '\n'; break;
+            case 'r': unescaped = '\r'; break;
+            case 't': unescaped = '\t'; break;
+            case 'u':
+                unicode_ = 0;
+                unicode_digits_ = 0;
+                state_ = STATE_UNICODE;
+                p++;
+                continue;
+            default:
+                return fail("Failed to parse JSON response: bad escape in string");
+            }
+            token_ += unescaped;
+            state_ = STATE_STRING;
+            p++;
+            break;
+        }
+
+        case STATE_UNICODE: {
+            int digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+            else return fail("Failed to parse JSON response: bad \\u escape in string");
+            unicode_ = (unicode_ << 4) | static_cast<uint32_t>(digit);
+            if (++unicode_digits_ == 4) {
+                append_code_point(unicode_);
+                state_ = STATE_STRING;
+            }
+            p++;
+            break;
+        }
+
+        case STATE_NUMBER:
+            if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+                token_ += c;
+                p++;
+            } else if (!end_scalar()) {
+                return false;
+            }
+            break;
+
+        case STATE_LITERAL:
+            if (c >= 'a' && c <= 'z') {
+                token_ += c;
+                p++;
+            } else if (!end_scalar()) {
+                return false;
+            }
+            break;
+
+        default:
+            p++;
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                break;
+            }
+            switch (state_) {
+            case STATE_VALUE:
+                if (!begin_value(c)) return false;
+                break;
+            case STATE_FIRST_ELEMENT:
+                if (c == ']') {
+                    stack_.pop_back();
+                    end_value();
+                    break;
+                }
+                value_slot_ = stack_.back().slot == SLOT_TRANSACTIONS ? SLOT_TRANSACTION : SLOT_SKIP;
+                if (!begin_value(c)) return false;
+                break;
+            case STATE_FIRST_KEY:
+                if (c == '}') {
+                    stack_.pop_back();
+                    end_value();
+                    break;
+                }
+                // fall through
+            case STATE_KEY:
+                if (c != '"') {
+                    return fail("Failed to parse JSON response: expected a key");
+                }
+                reading_key_ = true;
+                token_.clear();
+                hex_out_ = nullptr;
+                state_ = STATE_STRING;
+                break;
+            case STATE_COLON:
+                if (c != ':') {
+                    return fail("Failed to parse JSON response: expected ':'");
+                }
+                value_slot_ = key_slot(stack_.back().slot, token_);
+                state_ = STATE_VALUE;
+                break;
+            case STATE_AFTER_VALUE: {
+                const Frame& top = stack_.back();
+                if (c == ',') {
+                    if (top.object) {
+                        state_ = STATE_KEY;
+                    } else {
+                        value_slot_ = top.slot == SLOT_TRANSACTIONS ? SLOT_TRANSACTION : SLOT_SKIP;
+                        state_ = STATE_VALUE;
+                    }
+                } else if (c == (top.object ? '}' : ']')) {
+                    stack_.pop_back();
+                    end_value();
+                } else {
+                    return fail(std::string("Failed to parse JSON response: unexpected '") + c + "'");
+                }
+                break;
+            }
+            case STATE_DONE:
+                return fail("Failed to parse JSON response: data after the end");
+            default:
+                break;
+            }
+            break;
+        }
+    }
+    return state_ != STATE_FAILED;
+}
+
+bool BlockTemplateParser::finish(BlockTemplate& result) {
+    // A number at the very end has nothing after it to end it
+    if ((state_ == STATE_NUMBER || state_ == STATE_LITERAL) && stack_.empty() && !end_scalar()) {
+        return false;
+    }
+    if (state_ == STATE_FAILED) {
+        return false;
+    }
+    if (state_ != STATE_DONE) {
+        return fail("Failed to parse JSON response: incomplete");
+    }
+    if (rpc_error_) {
+        const std::string& message = strings_[SLOT_ERROR_MESSAGE];
+        return fail(message.empty() ? std::string("RPC error") : "RPC error: " + message);
+    }
+    if (!seen_[SLOT_RESULT]) {
+        return fail("Invalid RPC response: no result field");
+    }
+
+    // The same checks, in the same order, as parse_block_template
+    try {
+        auto require = [this](Slot slot) {
+            if (!seen_[slot]) {
+                throw std::runtime_error(std::string("Missing ") + SLOT_NAMES[slot] + " in block template");
+            }
+        };
+        auto number32 = [this, &require](Slot slot) {
+            require(slot);
+            if (numbers_[slot] > std::numeric_limits<uint32_t>::max()) {
+                throw std::runtime_error(std::string("Invalid ") + SLOT_NAMES[slot] + " in block template");
+            }
+            return static_cast<uint32_t>(numbers_[slot]);
+        };
+
+        BlockTemplate& bt = template_;
+        bt.version = number32(SLOT_VERSION);
+        require(SLOT_PREVIOUS_HASH);
+        bt.previous_block_hash = std::move(strings_[SLOT_PREVIOUS_HASH]);
+        bt.time = number32(SLOT_CURTIME);
+        bt.min_time = seen_[SLOT_MINTIME] ? number32(SLOT_MINTIME) : 0;
+        bt.max_time = seen_[SLOT_MAXTIME] ? number32(SLOT_MAXTIME) : 0;
+        require(SLOT_BITS);
+        bt.bits = std::stoul(strings_[SLOT_BITS], nullptr, 16);
+        bt.height = number32(SLOT_HEIGHT);
+        require(SLOT_SEED_HEIGHT);
+        bt.seed_height = numbers_[SLOT_SEED_HEIGHT];
+
+        require(SLOT_SEED_HASH);
+        if (strings_[SLOT_SEED_HASH].length() != 64) {
+            throw std::runtime_error("Invalid randomxseedhash length");
+        }
+        bt.seed_hash = utils::hex_to_bytes(strings_[SLOT_SEED_HASH]);
+        if (strings_[SLOT_NEXT_SEED_HASH].length() == 64) {
+            bt.next_seed_hash = utils::hex_to_bytes(strings_[SLOT_NEXT_SEED_HASH]);
+        }
+        bt.target_hex = std::move(strings_[SLOT_TARGET]);
+        bt.longpollid = std::move(strings_[SLOT_LONGPOLLID]);
+
+        require(SLOT_ROOT_MERKLE);
+        bt.merkle_root = std::move(strings_[SLOT_ROOT_MERKLE]);
+        if (seen_[SLOT_ROOT_COMMITMENTS]) {
+            bt.block_commitments_hash = std::move(strings_[SLOT_ROOT_COMMITMENTS]);
+        } else {
+            require(SLOT_COMMITMENTS);
+            bt.block_commitments_hash = std::move(strings_[SLOT_COMMITMENTS]);
+        }
+        require(SLOT_COINBASE_DATA);
+
+        // Transaction count and coinbase go in front of the other transactions,
+        // which already sit in the buffer that becomes the body
+        std::string count = utils::encode_varint(1 + transaction_count_);
+        std::string prefix = utils::bytes_to_hex(reinterpret_cast<const uint8_t*>(count.data()), count.size());
+        prefix += coinbase_hex_;
+        transactions_hex_.insert(0, prefix);
+        bt.block_body_hex = std::move(transactions_hex_);
+
+        complete_block_template(bt);
+    } catch (const std::exception& e) {
+        return fail(e.what());
+    }
+
+    result = std::move(template_);
+    return true;
+}
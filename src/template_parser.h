@@ -0,0 +1,122 @@
+#ifndef TEMPLATE_PARSER_H
+#define TEMPLATE_PARSER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mining_backend.h"
+
+// Parses a getblocktemplate JSON-RPC response as it arrives, chunk by chunk,
+// straight into BlockTemplate fields. No DOM is built: the header fields are
+// kept as they pass, transaction hex is checked and appended to one buffer
+// that becomes the block body, and everything else is skipped. The result is
+// what parse_block_template gives for the same response.
+class BlockTemplateParser {
+public:
+    BlockTemplateParser();
+
+    // Forget everything fed so far, ready for the next response
+    void reset();
+
+    // Expected response size (e.g. Content-Length), to size the body buffer
+    void reserve(size_t response_bytes);
+
+    // Consume the next part of the response. False once it is not valid
+    // JSON; error() then says why and later calls do nothing.
+    bool feed(const char* data, size_t len);
+
+    // After the last chunk: the template. False, with error() set, if the
+    // response is incomplete, an RPC error or not a usable template.
+    bool finish(BlockTemplate& result);
+
+    const std::string& error() const { return error_; }
+    size_t bytes_fed() const { return bytes_fed_; }
+
+private:
+    // What the value being read is, from the keys leading to it
+    enum Slot {
+        SLOT_SKIP,
+        SLOT_ENVELOPE,        // The response object
+        SLOT_RESULT,
+        SLOT_ERROR,
+        SLOT_ERROR_MESSAGE,
+        SLOT_VERSION,
+        SLOT_PREVIOUS_HASH,
+        SLOT_CURTIME,
+        SLOT_MINTIME,
+        SLOT_MAXTIME,
+        SLOT_BITS,
+        SLOT_HEIGHT,
+        SLOT_SEED_HEIGHT,
+        SLOT_SEED_HASH,
+        SLOT_NEXT_SEED_HASH,
+        SLOT_TARGET,
+        SLOT_LONGPOLLID,
+        SLOT_COMMITMENTS,     // blockcommitmentshash outside defaultroots
+        SLOT_DEFAULT_ROOTS,
+        SLOT_ROOT_MERKLE,
+        SLOT_ROOT_COMMITMENTS,
+        SLOT_COINBASE,
+        SLOT_COINBASE_DATA,
+        SLOT_TRANSACTIONS,
+        SLOT_TRANSACTION,
+        SLOT_TRANSACTION_DATA,
+        SLOT_COUNT
+    };
+
+    enum State {
+        STATE_VALUE,          // Expecting a value
+        STATE_FIRST_KEY,      // After '{': a key or '}'
+        STATE_KEY,            // After ',' in an object
+        STATE_COLON,
+        STATE_FIRST_ELEMENT,  // After '[': a value or ']'
+        STATE_AFTER_VALUE,    // ',' or the end of the container
+        STATE_STRING,
+        STATE_ESCAPE,         // After a backslash
+        STATE_UNICODE,        // In the four digits of \uXXXX
+        STATE_NUMBER,
+        STATE_LITERAL,
+        STATE_DONE,
+        STATE_FAILED
+    };
+
+    struct Frame {
+        Slot slot;
+        bool object;
+    };
+
+    State state_;
+    std::vector<Frame> stack_;
+    Slot value_slot_;      // Slot of the value about to be read
+    bool reading_key_;     // The string being read is an object key
+    std::string token_;    // Key, number, literal or small string being read
+    std::string* hex_out_; // Where the digits of a hex string go (else token_)
+    size_t hex_start_;     // hex_out_->size() when that string began
+    uint32_t unicode_;     // \uXXXX being read
+    int unicode_digits_;
+    uint32_t high_surrogate_;
+    std::string error_;
+    size_t bytes_fed_;
+
+    // What has been read
+    BlockTemplate template_;
+    uint64_t numbers_[SLOT_COUNT];
+    bool seen_[SLOT_COUNT];
+    std::string strings_[SLOT_COUNT];
+    bool rpc_error_;
+    std::string coinbase_hex_;
+    std::string transactions_hex_;  // The other transactions, concatenated
+    uint64_t transaction_count_;
+
+    static bool number_slot(Slot slot);
+    static bool string_slot(Slot slot);  // Hex included
+    bool fail(const std::string& message);
+    Slot key_slot(Slot container, const std::string& key) const;
+    bool begin_value(char c);
+    void end_value();
+    void end_string();
+    bool end_scalar();
+    void append_code_point(uint32_t code_point);
+};
+
+#endif // TEMPLATE_PARSER_H
@@ -0,0 +1,250 @@
+#include "trace_recorder.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <new>
+#include <json/json.h>
+
+namespace fs = std::filesystem;
+
+std::atomic<bool> TraceRecorder::active_(false);
+std::atomic<bool> TraceRecorder::enabled_(false);
+
+static int64_t steady_ns(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+TraceRecorder::ThreadBuffer::ThreadBuffer()
+    : tid(0), session(0), count(0), dropped(0), exited(false), open_start_ns(0), open_category(nullptr)
+    , open_name(nullptr), open_arg(-1) {
+    for (auto& chunk : chunks) {
+        chunk.store(nullptr);
+    }
+}
+
+TraceRecorder::ThreadBuffer::~ThreadBuffer() {
+    for (auto& chunk : chunks) {
+        delete[] chunk.load();
+    }
+}
+
+// The calling thread's registration; marks its buffer for freeing when the
+// thread exits
+struct TraceRecorder::ThreadHandle {
+    ThreadBuffer* buffer = nullptr;
+    std::string name;
+
+    ~ThreadHandle() {
+        if (buffer) {
+            buffer->exited.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local TraceRecorder::ThreadHandle TraceRecorder::thread_;
+
+TraceRecorder& TraceRecorder::instance() {
+    static TraceRecorder instance;
+    return instance;
+}
+
+void TraceRecorder::set_thread_name(const std::string& name) {
+    thread_.name = name;
+    if (thread_.buffer) {
+        TraceRecorder& recorder = instance();
+        std::lock_guard<std::mutex> lock(recorder.mutex_);
+        thread_.buffer->name = name;
+    }
+}
+
+void TraceRecorder::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Buffers of threads gone since the last trace (their events went with it)
+    buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(), [](const std::unique_ptr<ThreadBuffer>& buffer) {
+        return buffer->exited.load(std::memory_order_acquire);
+    }), buffers_.end());
+    started_ = std::chrono::steady_clock::now();
+    // Each thread empties its own buffer when it sees the new session
+    session_.fetch_add(1, std::memory_order_release);
+    active_.store(true, std::memory_order_release);
+}
+
+TraceRecorder::ThreadBuffer* TraceRecorder::buffer() {
+    if (thread_.buffer) {
+        return thread_.buffer;
+    }
+    std::unique_ptr<ThreadBuffer> buffer(new (std::nothrow) ThreadBuffer());
+    if (!buffer) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffer->tid = next_tid_++;
+    buffer->name = thread_.name.empty() ? "thread " + std::to_string(buffer->tid) : thread_.name;
+    thread_.buffer = buffer.get();
+    buffers_.push_back(std::move(buffer));
+    return thread_.buffer;
+}
+
+void TraceRecorder::record(char phase, const char* category, const char* name,
+                           std::chrono::steady_clock::time_point start, std::chrono::steady_clock::duration duration,
+                           int64_t arg) {
+    ThreadBuffer* buffer = this->buffer();
+    if (!buffer) {
+        return;
+    }
+    // Only this thread writes the buffer: plain loads and stores, published
+    // with count for stop_and_write to read
+    const uint64_t session = session_.load(std::memory_order_acquire);
+    if (buffer->session.load(std::memory_order_relaxed) != session) {
+        buffer->count.store(0, std::memory_order_relaxed);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+        buffer->session.store(session, std::memory_order_release);
+    }
+    const size_t n = buffer->count.load(std::memory_order_relaxed);
+    const size_t chunk = n / TRACE_CHUNK_EVENTS;
+    TraceEvent* events = chunk < TRACE_MAX_CHUNKS ? buffer->chunks[chunk].load(std::memory_order_relaxed) : nullptr;
+    if (chunk < TRACE_MAX_CHUNKS && !events) {
+        events = new (std::nothrow) TraceEvent[TRACE_CHUNK_EVENTS];
+        buffer->chunks[chunk].store(events, std::memory_order_release);
+    }
+    if (!events) {
+        buffer->dropped.store(buffer->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    TraceEvent& event = events[n % TRACE_CHUNK_EVENTS];
+    event.category = category;
+    std::strncpy(event.name, name, TRACE_NAME_SIZE - 1);
+    event.name[TRACE_NAME_SIZE - 1] = '\0';
+    event.phase = phase;
+    event.start_ns = steady_ns(start);
+    event.duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    event.arg = arg;
+    buffer->count.store(n + 1, std::memory_order_release);
+}
+
+void TraceRecorder::complete(const char* category, const char* name, std::chrono::steady_clock::time_point start,
+                             std::chrono::steady_clock::time_point end, int64_t arg) {
+    if (active()) {
+        record('X', category, name, start, end - start, arg);
+    }
+}
+
+void TraceRecorder::instant(const char* category, const char* name, int64_t arg) {
+    if (active()) {
+        record('i', category, name, std::chrono::steady_clock::now(), std::chrono::steady_clock::duration::zero(), arg);
+    }
+}
+
+void TraceRecorder::open_span(const char* category, const char* name, int64_t arg) {
+    ThreadBuffer* buffer = this->buffer();
+    if (!buffer) {
+        return;
+    }
+    buffer->open_start_ns.store(0, std::memory_order_relaxed);
+    buffer->open_category.store(category, std::memory_order_relaxed);
+    buffer->open_name.store(name, std::memory_order_relaxed);
+    buffer->open_arg.store(arg, std::memory_order_relaxed);
+    buffer->open_start_ns.store(steady_ns(std::chrono::steady_clock::now()), std::memory_order_release);
+}
+
+void TraceRecorder::close_span() {
+    ThreadBuffer* buffer = thread_.buffer;
+    if (!buffer) {
+        return;
+    }
+    const int64_t start_ns = buffer->open_start_ns.load(std::memory_order_relaxed);
+    buffer->open_start_ns.store(0, std::memory_order_relaxed);
+    if (start_ns && active()) {
+        const auto start = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(start_ns));
+        record('X', buffer->open_category.load(std::memory_order_relaxed),
+               buffer->open_name.load(std::memory_order_relaxed), start, std::chrono::steady_clock::now() - start,
+               buffer->open_arg.load(std::memory_order_relaxed));
+    }
+}
+
+bool TraceRecorder::stop_and_write(const std::string& path, TraceSummary& summary, std::string& error) {
+    active_.store(false, std::memory_order_release);
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint64_t session = session_.load();
+    const int64_t origin_ns = steady_ns(started_);
+    const auto stopped = std::chrono::steady_clock::now();
+    summary = TraceSummary();
+    summary.seconds = std::chrono::duration<double>(stopped - started_).count();
+
+    // Written aside and renamed, so a viewer never opens half of it
+    const std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp);
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+            << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"juno-miner\"}}";
+        for (const auto& buffer : buffers_) {
+            std::vector<TraceEvent> events;
+            if (buffer->session.load(std::memory_order_acquire) == session) {
+                const size_t count = buffer->count.load(std::memory_order_acquire);
+                summary.dropped += buffer->dropped.load(std::memory_order_relaxed);
+                for (size_t i = 0; i < count; i++) {
+                    events.push_back(
+                        buffer->chunks[i / TRACE_CHUNK_EVENTS].load(std::memory_order_acquire)[i % TRACE_CHUNK_EVENTS]);
+                }
+            }
+            // The span still open, cut here; read again if it changed meanwhile
+            const int64_t open_ns = buffer->open_start_ns.load(std::memory_order_acquire);
+            if (open_ns && !buffer->exited.load()) {
+                TraceEvent event;
+                event.category = buffer->open_category.load(std::memory_order_relaxed);
+                std::strncpy(event.name, buffer->open_name.load(std::memory_order_relaxed), TRACE_NAME_SIZE - 1);
+                event.name[TRACE_NAME_SIZE - 1] = '\0';
+                event.phase = 'X';
+                event.start_ns = open_ns;
+                event.duration_ns = steady_ns(stopped) - open_ns;
+                event.arg = buffer->open_arg.load(std::memory_order_relaxed);
+                if (buffer->open_start_ns.load(std::memory_order_acquire) == open_ns) {
+                    events.push_back(event);
+                }
+            }
+            if (events.empty()) {
+                continue;
+            }
+            summary.threads++;
+            summary.events += events.size();
+            out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"args\":{\"name\":" << Json::valueToQuotedString(buffer->name.c_str()) << "}}";
+            for (const TraceEvent& event : events) {
+                // Spans already running when the trace started are cut at its start
+                int64_t start_ns = event.start_ns - origin_ns;
+                int64_t duration_ns = event.duration_ns;
+                if (start_ns < 0) {
+                    duration_ns = std::max<int64_t>(0, duration_ns + start_ns);
+                    start_ns = 0;
+                }
+                out << ",\n{\"name\":" << Json::valueToQuotedString(event.name) << ",\"cat\":\"" << event.category
+                    << "\",\"ph\":\"" << event.phase << "\",\"ts\":" << start_ns / 1000.0;
+                if (event.phase == 'X') {
+                    out << ",\"dur\":" << duration_ns / 1000.0;
+                } else {
+                    out << ",\"s\":\"t\"";
+                }
+                out << ",\"pid\":1,\"tid\":" << buffer->tid;
+                if (event.arg >= 0) {
+                    out << ",\"args\":{\"n\":" << event.arg << "}";
+                }
+                out << "}";
+            }
+        }
+        out << "\n]}\n";
+        if (!out) {
+            error = "can't write " + temp;
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temp, path, ec);
+    if (ec) {
+        error = "can't replace " + path + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,176 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Events a thread's buffer grows by at a time, and the most it holds in one
+// trace (the rest are dropped and counted)
+static const size_t TRACE_CHUNK_EVENTS = 256;
+static const size_t TRACE_MAX_CHUNKS = 64;
+// Longest event name kept; longer ones are cut
+static const size_t TRACE_NAME_SIZE = 40;
+// Longest window a trace may be asked for
+static const unsigned int TRACE_MAX_SECONDS = 3600;
+
+struct TraceEvent {
+    const char* category;           // A string literal
+    char name[TRACE_NAME_SIZE];
+    char phase;                     // 'X' a span, 'i' an instant
+    int64_t start_ns;               // steady_clock
+    int64_t duration_ns;
+    int64_t arg;                    // Shown as "n" in the event's args, -1 = none
+};
+
+// What a trace left behind
+struct TraceSummary {
+    size_t events;
+    size_t threads;
+    size_t dropped;
+    double seconds;
+
+    TraceSummary() : events(0), threads(0), dropped(0), seconds(0) {}
+};
+
+// Timeline recorder for deep dives (--trace): the lifecycle of the miner
+// (init phases, dataset init workers, VM creation, RPC calls, ZMQ
+// announcements, template switches and each worker's job spans) as Chrome
+// trace JSON, which chrome://tracing and ui.perfetto.dev open.
+//
+// Recording is off until start(). While off, recording an event costs one
+// relaxed load. While on, each thread appends to a buffer of its own, which
+// no other thread writes: no lock is taken on the way, only the first event
+// a thread records after its birth registers the buffer. stop_and_write
+// reads the buffers after the window, up to the events each had published.
+// A thread's buffer is kept for its next trace and freed once the thread
+// has exited and a new trace starts.
+//
+// A span recorded at its end is missed by a trace that ends first, which
+// would leave out the job a worker is on. Long spans are therefore kept
+// open in the thread's buffer from their start (open_span, once enable()
+// was called) and written cut at the end of the trace if still running.
+class TraceRecorder {
+public:
+    static TraceRecorder& instance();
+
+    static bool active() { return active_.load(std::memory_order_relaxed); }
+    // Traces may be taken (--trace): open spans are kept from here on
+    static void enable() { enabled_.store(true); }
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // Start a trace: events from here on are kept, the last trace's dropped
+    void start();
+    bool running() const { return active(); }
+    // End the trace and write it to path; false with error set if the file
+    // can't be written
+    bool stop_and_write(const std::string& path, TraceSummary& summary, std::string& error);
+
+    // A span from start to end on the calling thread
+    void complete(const char* category, const char* name, std::chrono::steady_clock::time_point start,
+                  std::chrono::steady_clock::time_point end, int64_t arg = -1);
+    // A moment on the calling thread
+    void instant(const char* category, const char* name, int64_t arg = -1);
+    // The calling thread's long span (one at a time), recorded when closed
+    // or cut at the end of a trace it outlasts; no-ops unless enabled
+    void open_span(const char* category, const char* name, int64_t arg = -1);
+    void close_span();
+
+    // How the calling thread shows in traces ("worker 3"); call it before
+    // the thread records anything
+    static void set_thread_name(const std::string& name);
+
+private:
+    struct ThreadBuffer {
+        uint32_t tid;
+        std::string name;                               // Guarded by mutex_
+        std::atomic<uint64_t> session;                  // The trace its events belong to
+        std::atomic<size_t> count;                      // Events published
+        std::atomic<size_t> dropped;
+        std::atomic<TraceEvent*> chunks[TRACE_MAX_CHUNKS];
+        std::atomic<bool> exited;
+        // The open span; start 0 = none. Written by the thread, start last.
+        std::atomic<int64_t> open_start_ns;
+        std::atomic<const char*> open_category;
+        std::atomic<const char*> open_name;
+        std::atomic<int64_t> open_arg;
+
+        ThreadBuffer();
+        ~ThreadBuffer();
+    };
+    struct ThreadHandle;
+
+    static std::atomic<bool> active_;
+    static std::atomic<bool> enabled_;
+    static thread_local ThreadHandle thread_;
+
+    std::mutex mutex_;
+    // Guarded by mutex_
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+    uint32_t next_tid_;
+    std::chrono::steady_clock::time_point started_;
+    std::atomic<uint64_t> session_;
+
+    TraceRecorder() : next_tid_(1), session_(0) {}
+
+    // The calling thread's buffer, registered on first use; null if it
+    // can't be
+    ThreadBuffer* buffer();
+    void record(char phase, const char* category, const char* name, std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::duration duration, int64_t arg);
+};
+
+// Records the span from construction to destruction if a trace is running
+// at its end; one that began before the trace is cut at the trace's start.
+// Costs a clock read either way, so it goes around work, not single hashes.
+class TraceScope {
+public:
+    TraceScope(const char* category, const char* name, int64_t arg = -1)
+        : category_(category), name_(name), arg_(arg), start_(std::chrono::steady_clock::now()) {}
+    ~TraceScope() {
+        if (TraceRecorder::active()) {
+            TraceRecorder::instance().complete(category_, name_, start_, std::chrono::steady_clock::now(), arg_);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    // Change the number shown with the span (known only at its end)
+    void set_arg(int64_t arg) { arg_ = arg; }
+
+private:
+    const char* category_;
+    const char* name_;
+    int64_t arg_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// The calling thread's open span (TraceRecorder::open_span) for as long as
+// it is in scope; category and name must be string literals
+class TraceOpenSpan {
+public:
+    TraceOpenSpan(const char* category, const char* name, int64_t arg = -1) : on_(TraceRecorder::enabled()) {
+        if (on_) {
+            TraceRecorder::instance().open_span(category, name, arg);
+        }
+    }
+    ~TraceOpenSpan() {
+        if (on_) {
+            TraceRecorder::instance().close_span();
+        }
+    }
+
+    TraceOpenSpan(const TraceOpenSpan&) = delete;
+    TraceOpenSpan& operator=(const TraceOpenSpan&) = delete;
+
+private:
+    bool on_;
+};
+
+#endif // TRACE_RECORDER_H
@@ -0,0 +1,281 @@
+#include "upgrade_handoff.h"
+#include "logger.h"
+#include "utils.h"
+#include "nonce_allocator.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char* UPGRADE_HELLO = "TAKEOVER";
+const char* UPGRADE_DONE = "DONE";
+
+// Replies are one JSON line; a template with many transactions is still far below this
+const size_t UPGRADE_MAX_LINE = 64 << 20;
+const int UPGRADE_REPLY_TIMEOUT_SECONDS = 10;
+
+#ifndef _WIN32
+bool socket_address(const std::string& path, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        LOG_WARNING_STREAM("Upgrade socket path is empty or too long: " << path);
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+void set_timeout(int fd, int seconds) {
+    timeval tv;
+    tv.tv_sec = seconds;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+bool send_line(int fd, const std::string& line) {
+    std::string data = line + "\n";
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += (size_t)n;
+    }
+    return true;
+}
+
+// False on EOF, timeout or error before a full line
+bool read_line(int fd, std::string& line) {
+    line.clear();
+    char buffer[4096];
+    while (line.size() < UPGRADE_MAX_LINE) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        line.append(buffer, (size_t)n);
+        size_t end = line.find('\n');
+        if (end != std::string::npos) {
+            line.resize(end);
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+std::string state_to_json(const UpgradeState& state) {
+    Json::Value root;
+    root["version"] = UPGRADE_PROTOCOL_VERSION;
+    root["template"] = state.block_template;
+    root["instance_id"] = state.instance_id;
+    root["job_sequence"] = state.job_sequence;
+    root["salt"] = utils::bytes_to_hex(state.salt.data(), state.salt.size());
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    return Json::writeString(writer, root);
+}
+
+bool state_from_json(const std::string& text, UpgradeState& state) {
+    Json::CharReaderBuilder reader;
+    Json::Value root;
+    std::string errors;
+    std::istringstream stream(text);
+    if (!Json::parseFromStream(reader, stream, &root, &errors) || !root.isObject()) {
+        return false;
+    }
+    if (root["version"].asUInt() != UPGRADE_PROTOCOL_VERSION) {
+        LOG_WARNING_STREAM("Running miner speaks upgrade protocol " << root["version"].asUInt()
+                           << ", expected " << UPGRADE_PROTOCOL_VERSION);
+        return false;
+    }
+    state.block_template = root["template"];
+    state.instance_id = root["instance_id"].asUInt();
+    state.job_sequence = root["job_sequence"].asUInt();
+    state.salt = utils::hex_to_bytes(root["salt"].asString());
+    return state.salt.size() == NONCE_SALT_SIZE && state.block_template.isObject();
+}
+
+} // namespace
+
+bool UpgradeHandoff::supported() {
+#ifndef _WIN32
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool UpgradeHandoff::take_over(const std::string& path, UpgradeState& state) {
+#ifndef _WIN32
+    sockaddr_un addr;
+    if (!socket_address(path, addr)) return false;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    if (connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+        // No miner to take over from (or a stale socket it left behind)
+        close(fd);
+        return false;
+    }
+    set_timeout(fd, UPGRADE_REPLY_TIMEOUT_SECONDS);
+    std::string reply;
+    if (!send_line(fd, std::string(UPGRADE_HELLO) + " " + std::to_string(UPGRADE_PROTOCOL_VERSION)) ||
+        !read_line(fd, reply) || !state_from_json(reply, state)) {
+        LOG_WARNING_STREAM("Miner on " << path << " did not hand over its state, starting cold");
+        close(fd);
+        return false;
+    }
+    client_fd_ = fd;
+    LOG_INFO_STREAM("Upgrade: took state from the miner on " << path << " (job " << state.job_sequence << ")");
+    return true;
+#else
+    (void)path;
+    (void)state;
+    return false;
+#endif
+}
+
+void UpgradeHandoff::complete_take_over() {
+#ifndef _WIN32
+    if (client_fd_ < 0) return;
+    // The old process removes its socket before closing our connection, so
+    // EOF means the path is free
+    std::string ignored;
+    if (send_line(client_fd_, UPGRADE_DONE)) {
+        read_line(client_fd_, ignored);
+    }
+    close(client_fd_);
+    client_fd_ = -1;
+    LOG_INFO("Upgrade: previous miner process released");
+#endif
+}
+
+bool UpgradeHandoff::listen(const std::string& path) {
+#ifndef _WIN32
+    sockaddr_un addr;
+    if (listen_fd_ >= 0 || !socket_address(path, addr)) return false;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    bool bound = bind(fd, (const sockaddr*)&addr, sizeof(addr)) == 0;
+    if (!bound && errno == EADDRINUSE) {
+        // Left behind by a miner that crashed, unless one still answers on it
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = probe >= 0 && connect(probe, (const sockaddr*)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        if (live) {
+            LOG_WARNING_STREAM("Another miner is listening on " << path << ", upgrades will not reach this one");
+            close(fd);
+            return false;
+        }
+        unlink(path.c_str());
+        bound = bind(fd, (const sockaddr*)&addr, sizeof(addr)) == 0;
+    }
+    if (!bound || ::listen(fd, 1) != 0) {
+        LOG_WARNING_STREAM("Cannot listen on upgrade socket " << path << ": " << strerror(errno));
+        close(fd);
+        return false;
+    }
+    listen_fd_ = fd;
+    path_ = path;
+    stop_ = false;
+    thread_ = std::thread(&UpgradeHandoff::serve_thread, this);
+    LOG_INFO_STREAM("Upgrade: listening on " << path);
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+void UpgradeHandoff::publish(const UpgradeState& state) {
+    std::string json = state_to_json(state);
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_.swap(json);
+}
+
+void UpgradeHandoff::stop() {
+#ifndef _WIN32
+    stop_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        unlink(path_.c_str());
+    }
+    if (client_fd_ >= 0) {
+        close(client_fd_);
+        client_fd_ = -1;
+    }
+#endif
+}
+
+void UpgradeHandoff::serve_thread() {
+#ifndef _WIN32
+    while (!stop_.load() && !handed_off_.load()) {
+        pollfd pfd;
+        pfd.fd = listen_fd_;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 500) <= 0) continue;
+        int client = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) continue;
+        if (serve_client(client)) {
+            // Leave the socket to the successor first, then let it go
+            close(listen_fd_);
+            listen_fd_ = -1;
+            unlink(path_.c_str());
+            handed_off_ = true;
+        }
+        close(client);
+    }
+#endif
+}
+
+bool UpgradeHandoff::serve_client(int fd) {
+#ifndef _WIN32
+    std::string line;
+    set_timeout(fd, UPGRADE_REPLY_TIMEOUT_SECONDS);
+    if (!read_line(fd, line) || line.compare(0, strlen(UPGRADE_HELLO), UPGRADE_HELLO) != 0) {
+        return false;
+    }
+    std::string state;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        state = state_;
+    }
+    if (state.empty() || !send_line(fd, state)) {
+        return false;
+    }
+    LOG_INFO("Upgrade: state handed to a new miner process, mining until it is ready");
+
+    // Keep mining while the successor maps the dataset; it says DONE once hashing
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(UPGRADE_TAKEOVER_TIMEOUT_SECONDS);
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    while (!stop_.load() && std::chrono::steady_clock::now() < deadline && poll(&pfd, 1, 500) == 0) {
+    }
+    if (stop_.load() || !(pfd.revents & (POLLIN | POLLHUP)) || !read_line(fd, line) || line != UPGRADE_DONE) {
+        LOG_WARNING("Upgrade: the new miner process went away before taking over, still mining");
+        return false;
+    }
+    LOG_INFO("Upgrade: new miner process is hashing, shutting down");
+    return true;
+#else
+    (void)fd;
+    return false;
+#endif
+}
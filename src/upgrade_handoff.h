@@ -0,0 +1,84 @@
+#ifndef UPGRADE_HANDOFF_H
+#define UPGRADE_HANDOFF_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <json/json.h>
+
+// Handoff protocol version; bump when the state fields below change
+static const uint32_t UPGRADE_PROTOCOL_VERSION = 2;
+
+// The old process may still start a few jobs between sending its state and
+// exiting; its successor numbers its jobs from this far past the handed one
+static const uint32_t UPGRADE_JOB_SEQUENCE_GAP = 1 << 16;
+
+// How long the old process keeps mining while its successor gets ready
+// (seconds); a successor that misses this or dies leaves the old one running
+static const int UPGRADE_TAKEOVER_TIMEOUT_SECONDS = 600;
+
+// What a running miner hands to its replacement
+struct UpgradeState {
+    Json::Value block_template;  // Template being mined (and its seed), see block_template_to_json
+    uint32_t instance_id;
+    uint32_t job_sequence;
+    std::vector<uint8_t> salt;   // NONCE_SALT_SIZE bytes
+
+    UpgradeState() : instance_id(0), job_sequence(0) {}
+};
+
+// Zero-downtime binary upgrade over a Unix socket. A miner with an upgrade
+// socket listens on it once initialized. A newly started miner first
+// connects to it: if a miner answers, the new one takes that miner's
+// template (and so its seed) and nonce position, maps the same shared
+// dataset (see DatasetShare), starts hashing, and only then tells the old
+// process to exit. The old process mines until that moment; the new one then takes over
+// the socket for the next upgrade.
+class UpgradeHandoff {
+public:
+    UpgradeHandoff() : listen_fd_(-1), client_fd_(-1), stop_(false), handed_off_(false) {}
+    ~UpgradeHandoff() { stop(); }
+
+    UpgradeHandoff(const UpgradeHandoff&) = delete;
+    UpgradeHandoff& operator=(const UpgradeHandoff&) = delete;
+
+    // Unix only
+    static bool supported();
+
+    // New process: fetch the state of the miner listening on path. False if
+    // none answers, which is an ordinary (cold) start.
+    bool take_over(const std::string& path, UpgradeState& state);
+
+    // New process, once hashing: release the old process and wait until it
+    // has left the socket
+    void complete_take_over();
+
+    // Running process: serve the socket from a background thread
+    bool listen(const std::string& path);
+
+    // Running process: the state a successor gets (call whenever it changes)
+    void publish(const UpgradeState& state);
+
+    // True once a successor is hashing; this process should exit
+    bool handed_off() const { return handed_off_.load(); }
+
+    void stop();
+
+private:
+    void serve_thread();
+    bool serve_client(int fd);
+
+    std::string path_;
+    int listen_fd_;
+    int client_fd_;  // Connection to the old process until complete_take_over
+    std::thread thread_;
+    std::atomic<bool> stop_;
+    std::atomic<bool> handed_off_;
+    std::mutex mutex_;
+    std::string state_;  // Published state, serialized (guarded by mutex_)
+};
+
+#endif // UPGRADE_HANDOFF_H
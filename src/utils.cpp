@@ -1,4 +1,5 @@
 #include "utils.h"
+#include "cpu_topology.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -6,12 +7,258 @@
 #include <algorithm>
 #include <thread>
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cctype>
+#include <stdexcept>
 #include <chrono>
+#include <cerrno>
+#include <fcntl.h>
+#include <sched.h>
+#include <netdb.h>
+#include <sys/socket.h>
 #include <sys/sysinfo.h>
+#include <unistd.h>
 #include <openssl/sha.h>
+#include "cpu.hpp"
+
+// SIMD hex codecs. A native build has the ones its -march allows; a portable
+// build (JUNO_PORTABLE, baseline x86-64) compiles each for its own
+// instruction set and hex_encode/hex_decode pick the widest the CPU has.
+#if defined(JUNO_PORTABLE) && defined(__GNUC__) && defined(__x86_64__)
+#define HEX_TARGET(isa) __attribute__((target(isa)))
+#define HEX_SSSE3 1
+#define HEX_AVX2 1
+#define HEX_AVX512 1
+#else
+#define HEX_TARGET(isa)
+#if defined(__SSSE3__)
+#define HEX_SSSE3 1
+#endif
+#if defined(__AVX2__)
+#define HEX_AVX2 1
+#endif
+#if defined(__AVX512BW__)
+#define HEX_AVX512 1
+#endif
+#endif
+#if defined(HEX_SSSE3)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 namespace utils {
 
+static const uint64_t MB_BYTES = 1024 * 1024;
+
+// cgroup v1 writes "no limit" as a huge page-aligned number instead of "max"
+static const uint64_t CGROUP_V1_UNLIMITED = 1ULL << 60;
+
+static std::vector<std::string> split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    std::istringstream iss(text);
+    std::string part;
+    while (std::getline(iss, part, separator)) parts.push_back(part);
+    return parts;
+}
+
+static bool read_first_line(const std::string& path, std::string& line) {
+    std::ifstream file(path);
+    return file && std::getline(file, line);
+}
+
+// A cgroup control file holding one number, or "max" (then false, as for a
+// missing file or a v1 "unlimited")
+static bool read_cgroup_limit(const std::string& path, uint64_t& value) {
+    std::string line;
+    if (!read_first_line(path, line) || line.compare(0, 3, "max") == 0) return false;
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long parsed = std::strtoull(line.c_str(), &end, 10);
+    if (errno != 0 || end == line.c_str() || parsed >= CGROUP_V1_UNLIMITED) return false;
+    value = parsed;
+    return true;
+}
+
+// A "key value" line of a memory.stat file, 0 if absent
+static uint64_t read_cgroup_stat(const std::string& path, const std::string& key) {
+    std::ifstream file(path);
+    std::string name;
+    uint64_t value;
+    while (file >> name >> value) {
+        if (name == key) return value;
+    }
+    return 0;
+}
+
+// The process's cgroup directories for controller ("" = the v2 unified
+// hierarchy), innermost first, up to the hierarchy's mount point: a limit set
+// on any of them applies, and in a pod it's often the parent's. Found from
+// /proc/self/cgroup and the matching mount in /proc/self/mountinfo; when the
+// cgroup path isn't under the mount's root (a container without a cgroup
+// namespace sees only its own cgroup mounted), the mount point is the cgroup.
+static std::vector<std::string> cgroup_dirs(const std::string& controller) {
+    std::vector<std::string> dirs;
+    std::ifstream cgroups("/proc/self/cgroup");
+    std::string line, path;
+    bool found = false;
+    while (!found && std::getline(cgroups, line)) {
+        // "hierarchy-id:controller,list:/path", v2 as "0::/path"
+        size_t first = line.find(':');
+        size_t second = first == std::string::npos ? first : line.find(':', first + 1);
+        if (second == std::string::npos) continue;
+        std::vector<std::string> controllers = split(line.substr(first + 1, second - first - 1), ',');
+        if (controller.empty()) {
+            found = controllers.empty() && line.compare(0, first, "0") == 0;
+        } else {
+            found = std::find(controllers.begin(), controllers.end(), controller) != controllers.end();
+        }
+        if (found) path = line.substr(second + 1);
+    }
+    if (!found) return dirs;
+
+    std::ifstream mountinfo("/proc/self/mountinfo");
+    while (std::getline(mountinfo, line)) {
+        // "id parent major:minor root mount-point options ... - fstype source super-options"
+        size_t dash = line.find(" - ");
+        if (dash == std::string::npos) continue;
+        std::vector<std::string> fields = split(line.substr(0, dash), ' ');
+        std::vector<std::string> fs = split(line.substr(dash + 3), ' ');
+        if (fields.size() < 5 || fs.size() < 3) continue;
+        if (controller.empty()) {
+            if (fs[0] != "cgroup2") continue;
+        } else {
+            std::vector<std::string> options = split(fs[2], ',');
+            if (fs[0] != "cgroup" || std::find(options.begin(), options.end(), controller) == options.end()) continue;
+        }
+        const std::string& root = fields[3];
+        const std::string& mount = fields[4];
+        std::string relative;
+        if (root == "/") {
+            relative = path;
+        } else if (path.compare(0, root.size(), root) == 0 &&
+                   (path.size() == root.size() || path[root.size()] == '/')) {
+            relative = path.substr(root.size());
+        }
+        while (!relative.empty() && relative != "/") {
+            dirs.push_back(mount + relative);
+            relative = relative.substr(0, relative.rfind('/'));
+        }
+        dirs.push_back(mount);
+        return dirs;
+    }
+    return dirs;
+}
+
+// Tightest cgroup limits found, in bytes
+struct CgroupLimits {
+    double cpu_quota = 0;
+    bool memory = false, huge = false, huge_1gb = false;
+    uint64_t memory_budget = 0, memory_limit = 0, huge_budget = 0, huge_1gb_budget = 0;
+};
+
+// Narrows budget and limit to the tightest over dirs: limit file minus what
+// the cgroup already uses (usage file, less inactive_file from stat_file when
+// given, since that page cache is reclaimed before anything is killed), and
+// the plain limit. limited is set if any dir has one.
+static void cgroup_budget(const std::vector<std::string>& dirs, const char* limit_file, const char* usage_file,
+                          const char* stat_file, const char* inactive_key, bool& limited, uint64_t& budget_bytes,
+                          uint64_t& limit_bytes) {
+    for (const std::string& dir : dirs) {
+        uint64_t limit;
+        if (!read_cgroup_limit(dir + "/" + limit_file, limit)) continue;
+        uint64_t usage = 0;
+        read_cgroup_limit(dir + "/" + usage_file, usage);
+        if (stat_file) {
+            uint64_t inactive = read_cgroup_stat(dir + "/" + stat_file, inactive_key);
+            usage -= std::min(usage, inactive);
+        }
+        uint64_t budget = limit > usage ? limit - usage : 0;
+        if (!limited || budget < budget_bytes) budget_bytes = budget;
+        if (!limited || limit < limit_bytes) limit_bytes = limit;
+        limited = true;
+    }
+}
+
+static void tighten_cpu_quota(double cpus, double& quota) {
+    if (quota == 0 || cpus < quota) quota = cpus;
+}
+
+// Limits of the v2 unified hierarchy. A controller that isn't enabled there
+// (on a hybrid host it is still on v1) simply has no files.
+static bool read_cgroup_v2_limits(CgroupLimits& limits) {
+    std::vector<std::string> dirs = cgroup_dirs("");
+    CgroupLimits before = limits;
+    uint64_t unused = 0;
+    for (const std::string& dir : dirs) {
+        std::string line;
+        double max_us, period_us;
+        if (read_first_line(dir + "/cpu.max", line) &&
+            std::sscanf(line.c_str(), "%lf %lf", &max_us, &period_us) == 2 && period_us > 0) {
+            tighten_cpu_quota(max_us / period_us, limits.cpu_quota);
+        }
+    }
+    // Past memory.high the cgroup is throttled into reclaim, nearly as bad as the OOM killer
+    cgroup_budget(dirs, "memory.max", "memory.current", "memory.stat", "inactive_file", limits.memory,
+                  limits.memory_budget, limits.memory_limit);
+    cgroup_budget(dirs, "memory.high", "memory.current", "memory.stat", "inactive_file", limits.memory,
+                  limits.memory_budget, limits.memory_limit);
+    cgroup_budget(dirs, "hugetlb.2MB.max", "hugetlb.2MB.current", nullptr, nullptr, limits.huge, limits.huge_budget,
+                  unused);
+    cgroup_budget(dirs, "hugetlb.1GB.max", "hugetlb.1GB.current", nullptr, nullptr, limits.huge_1gb,
+                  limits.huge_1gb_budget, unused);
+    return limits.cpu_quota != before.cpu_quota || limits.memory != before.memory || limits.huge != before.huge ||
+           limits.huge_1gb != before.huge_1gb;
+}
+
+static bool read_cgroup_v1_limits(CgroupLimits& limits) {
+    CgroupLimits before = limits;
+    uint64_t unused = 0;
+    for (const std::string& dir : cgroup_dirs("cpu")) {
+        // cfs_quota_us is -1 without a quota, which read_cgroup_limit rejects
+        uint64_t quota_us, period_us;
+        if (read_cgroup_limit(dir + "/cpu.cfs_quota_us", quota_us) &&
+            read_cgroup_limit(dir + "/cpu.cfs_period_us", period_us) && period_us > 0) {
+            tighten_cpu_quota((double)quota_us / period_us, limits.cpu_quota);
+        }
+    }
+    cgroup_budget(cgroup_dirs("memory"), "memory.limit_in_bytes", "memory.usage_in_bytes", "memory.stat",
+                  "total_inactive_file", limits.memory, limits.memory_budget, limits.memory_limit);
+    std::vector<std::string> hugetlb = cgroup_dirs("hugetlb");
+    cgroup_budget(hugetlb, "hugetlb.2MB.limit_in_bytes", "hugetlb.2MB.usage_in_bytes", nullptr, nullptr, limits.huge,
+                  limits.huge_budget, unused);
+    cgroup_budget(hugetlb, "hugetlb.1GB.limit_in_bytes", "hugetlb.1GB.usage_in_bytes", nullptr, nullptr,
+                  limits.huge_1gb, limits.huge_1gb_budget, unused);
+    return limits.cpu_quota != before.cpu_quota || limits.memory != before.memory || limits.huge != before.huge ||
+           limits.huge_1gb != before.huge_1gb;
+}
+
+// Applies the cgroup limits of the process to resources: the CPU quota, the
+// memory limit and the hugetlb limits, which are charged when a page is first
+// touched so exceeding them is a SIGBUS rather than a failed allocation. Both
+// hierarchies are read, as hybrid hosts split the controllers between them.
+static void apply_cgroup_limits(SystemResources& resources) {
+    CgroupLimits limits;
+    if (read_cgroup_v2_limits(limits)) resources.cgroup_version = 2;
+    if (read_cgroup_v1_limits(limits)) resources.cgroup_version = 1;
+
+    if (limits.cpu_quota > 0) {
+        resources.cpu_quota = limits.cpu_quota;
+        // A fractional CPU still gets a thread: the quota is spent either way
+        unsigned int quota_cpus = std::max(1u, (unsigned int)std::ceil(limits.cpu_quota - 0.01));
+        resources.cpu_cores = std::min(resources.cpu_cores, quota_cpus);
+    }
+    if (limits.memory) {
+        resources.memory_limit_mb = limits.memory_limit / MB_BYTES;
+        resources.total_ram_mb = std::min<size_t>(resources.total_ram_mb, resources.memory_limit_mb);
+        resources.available_ram_mb = std::min<size_t>(resources.available_ram_mb, limits.memory_budget / MB_BYTES);
+    }
+    if (limits.huge) resources.huge_page_budget_mb = limits.huge_budget / MB_BYTES;
+    if (limits.huge_1gb) resources.huge_page_1gb_budget_mb = limits.huge_1gb_budget / MB_BYTES;
+}
+
 SystemResources detect_system_resources() {
     SystemResources resources;
 
@@ -20,6 +267,21 @@ SystemResources detect_system_resources() {
     if (resources.cpu_cores == 0) {
         resources.cpu_cores = 1;
     }
+    resources.host_cpus = resources.cpu_cores;
+
+    // The affinity mask (taskset, or a cpuset, which the kernel keeps it within)
+    cpu_set_t affinity;
+    CPU_ZERO(&affinity);
+    if (sched_getaffinity(0, sizeof(affinity), &affinity) == 0 && CPU_COUNT(&affinity) > 0) {
+        resources.affinity_cpus = CPU_COUNT(&affinity);
+        resources.cpu_cores = std::min(resources.cpu_cores, resources.affinity_cpus);
+    }
+    // The main thread sits on the housekeeping CPUs (see set_housekeeping_cpus);
+    // mining gets the rest of the process's mask
+    if (!hashing_cpus().empty()) {
+        resources.affinity_cpus = (unsigned int)(hashing_cpus().size() + housekeeping_cpus().size());
+        resources.cpu_cores = std::min(resources.host_cpus, (unsigned int)hashing_cpus().size());
+    }
 
     // Get RAM information from /proc/meminfo
     std::ifstream meminfo("/proc/meminfo");
@@ -52,6 +314,11 @@ SystemResources detect_system_resources() {
         }
     }
 
+    apply_cgroup_limits(resources);
+
+    // Each thread needs a 2MB L3 share for its scratchpad
+    resources.l3_thread_limit = CpuTopology::detect().max_mining_threads(housekeeping_cpus());
+
     // Default optimal_threads to CPU cores (will be recalculated based on mode)
     resources.optimal_threads = resources.cpu_cores;
     if (resources.optimal_threads == 0) {
@@ -61,6 +328,61 @@ SystemResources detect_system_resources() {
     return resources;
 }
 
+size_t available_ram_mb() {
+    SystemResources resources;
+    std::ifstream meminfo("/proc/meminfo");
+    std::string line;
+    while (std::getline(meminfo, line)) {
+        if (line.find("MemAvailable:") == 0) {
+            std::istringstream iss(line);
+            std::string label;
+            size_t value;
+            iss >> label >> value;
+            resources.available_ram_mb = value / 1024;
+        } else if (line.find("MemTotal:") == 0) {
+            std::istringstream iss(line);
+            std::string label;
+            size_t value;
+            iss >> label >> value;
+            resources.total_ram_mb = value / 1024;
+        }
+    }
+    apply_cgroup_limits(resources);
+    return resources.available_ram_mb;
+}
+
+std::string describe_resource_limits(const SystemResources& resources) {
+    std::ostringstream cgroup;
+    const char* separator = "";
+    if (resources.cpu_quota > 0) {
+        cgroup << (resources.cgroup_version == 2 ? "cpu.max " : "cfs quota ") << std::fixed << std::setprecision(2)
+               << resources.cpu_quota << " CPUs";
+        separator = ", ";
+    }
+    if (resources.memory_limit_mb != RESOURCE_UNLIMITED) {
+        cgroup << separator << (resources.cgroup_version == 2 ? "memory.max " : "memory limit ")
+               << resources.memory_limit_mb << " MB";
+        separator = ", ";
+    }
+    if (resources.huge_page_budget_mb != RESOURCE_UNLIMITED) {
+        cgroup << separator << "hugetlb 2MB " << resources.huge_page_budget_mb << " MB free";
+        separator = ", ";
+    }
+    if (resources.huge_page_1gb_budget_mb != RESOURCE_UNLIMITED) {
+        cgroup << separator << "hugetlb 1GB " << resources.huge_page_1gb_budget_mb << " MB free";
+    }
+
+    std::ostringstream text;
+    if (!cgroup.str().empty()) {
+        text << "cgroup v" << resources.cgroup_version << ": " << cgroup.str();
+    }
+    if (resources.affinity_cpus > 0 && resources.affinity_cpus < resources.host_cpus) {
+        text << (text.str().empty() ? "" : "; ") << "affinity " << resources.affinity_cpus << " of "
+             << resources.host_cpus << " CPUs";
+    }
+    return text.str();
+}
+
 unsigned int calculate_optimal_threads(const SystemResources& resources, bool fast_mode) {
     unsigned int max_threads;
 
@@ -102,6 +424,11 @@ unsigned int calculate_optimal_threads(const SystemResources& resources, bool fa
         }
     }
 
+    // Threads beyond what the L3 caches can hold only evict each other's scratchpads
+    if (resources.l3_thread_limit > 0 && max_threads > resources.l3_thread_limit) {
+        max_threads = resources.l3_thread_limit;
+    }
+
     // Ensure at least 1 thread
     if (max_threads == 0) {
         max_threads = 1;
@@ -110,29 +437,390 @@ unsigned int calculate_optimal_threads(const SystemResources& resources, bool fa
     return max_threads;
 }
 
-std::string bytes_to_hex(const uint8_t* data, size_t len) {
-    std::ostringstream oss;
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+// Value of each hex digit character, 0xff for anything else
+static const struct HexValues {
+    uint8_t value[256];
+    HexValues() {
+        std::memset(value, 0xff, sizeof(value));
+        for (int i = 0; i < 10; i++) value['0' + i] = static_cast<uint8_t>(i);
+        for (int i = 0; i < 6; i++) {
+            value['a' + i] = static_cast<uint8_t>(10 + i);
+            value['A' + i] = static_cast<uint8_t>(10 + i);
+        }
+    }
+} hex_values;
+
+static void hex_encode_scalar(const uint8_t* data, size_t len, char* out) {
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i] = HEX_DIGITS[data[i] >> 4];
+        out[2 * i + 1] = HEX_DIGITS[data[i] & 0xf];
+    }
+}
+
+static bool hex_decode_scalar(const char* hex, size_t len, uint8_t* out) {
+    uint8_t invalid = 0;
     for (size_t i = 0; i < len; i++) {
-        oss << std::hex << std::setw(2) << std::setfill('0') << (int)data[i];
+        uint8_t hi = hex_values.value[static_cast<unsigned char>(hex[2 * i])];
+        uint8_t lo = hex_values.value[static_cast<unsigned char>(hex[2 * i + 1])];
+        invalid |= hi | lo;
+        out[i] = static_cast<uint8_t>((hi << 4) | (lo & 0xf));
+    }
+    return (invalid & 0xf0) == 0;
+}
+
+#if defined(HEX_SSSE3)
+// 16 bytes -> 32 digits: split into nibbles, look each up with pshufb and
+// interleave high/low
+HEX_TARGET("ssse3") static inline void hex_encode16_ssse3(const uint8_t* data, char* out) {
+    const __m128i digits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(HEX_DIGITS));
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+    __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, mask));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), _mm_unpackhi_epi8(hi, lo));
+}
+
+// Digit values of 16 characters; all-ones lanes in *valid for hex digits
+HEX_TARGET("ssse3") static inline __m128i hex_values16_ssse3(__m128i chars, __m128i* valid) {
+    __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+    __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+                                     _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+    __m128i is_letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                      _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    *valid = _mm_or_si128(is_digit, is_letter);
+    __m128i digit_value = _mm_and_si128(is_digit, _mm_sub_epi8(chars, _mm_set1_epi8('0')));
+    __m128i letter_value = _mm_and_si128(is_letter, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10)));
+    return _mm_or_si128(digit_value, letter_value);
+}
+
+// 32 digits -> 16 bytes; false on a non-hex character
+HEX_TARGET("ssse3") static inline bool hex_decode16_ssse3(const char* hex, uint8_t* out) {
+    __m128i valid_a, valid_b;
+    __m128i a = hex_values16_ssse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex)), &valid_a);
+    __m128i b = hex_values16_ssse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + 16)), &valid_b);
+    // Each digit pair (high first) becomes high * 16 + low in a 16-bit lane
+    const __m128i weights = _mm_set1_epi16(0x0110);
+    __m128i bytes = _mm_packus_epi16(_mm_maddubs_epi16(a, weights), _mm_maddubs_epi16(b, weights));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), bytes);
+    return _mm_movemask_epi8(_mm_and_si128(valid_a, valid_b)) == 0xffff;
+}
+#endif
+
+#if defined(HEX_AVX2)
+// 32 bytes -> 64 digits, as hex_encode16_ssse3 per 128-bit lane
+HEX_TARGET("avx2") static inline void hex_encode32_avx2(const uint8_t* data, char* out) {
+    const __m256i digits = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(HEX_DIGITS)));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    __m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask));
+    __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(bytes, mask));
+    // unpack works within lanes: put bytes 0-15 and 16-31 back in order
+    __m256i first = _mm256_unpacklo_epi8(hi, lo);
+    __m256i second = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 32), _mm256_permute2x128_si256(first, second, 0x31));
+}
+
+HEX_TARGET("avx2") static inline __m256i hex_values32_avx2(__m256i chars, __m256i* valid) {
+    __m256i lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+    __m256i is_digit = _mm256_andnot_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8('0'), chars),
+                                           _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chars));
+    __m256i is_letter = _mm256_andnot_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8('a'), lower),
+                                            _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+    *valid = _mm256_or_si256(is_digit, is_letter);
+    __m256i digit_value = _mm256_and_si256(is_digit, _mm256_sub_epi8(chars, _mm256_set1_epi8('0')));
+    __m256i letter_value = _mm256_and_si256(is_letter, _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10)));
+    return _mm256_or_si256(digit_value, letter_value);
+}
+
+// 64 digits -> 32 bytes; false on a non-hex character
+HEX_TARGET("avx2") static inline bool hex_decode32_avx2(const char* hex, uint8_t* out) {
+    __m256i valid_a, valid_b;
+    __m256i a = hex_values32_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hex)), &valid_a);
+    __m256i b = hex_values32_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hex + 32)), &valid_b);
+    const __m256i weights = _mm256_set1_epi16(0x0110);
+    // packus interleaves lanes (a.lo, b.lo, a.hi, b.hi); restore the order
+    __m256i packed = _mm256_packus_epi16(_mm256_maddubs_epi16(a, weights), _mm256_maddubs_epi16(b, weights));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_permute4x64_epi64(packed, 0xd8));
+    return _mm256_movemask_epi8(_mm256_and_si256(valid_a, valid_b)) == -1;
+}
+#endif
+
+#if defined(HEX_AVX512)
+// 64 bytes -> 128 digits, as hex_encode32_avx2 with four 128-bit lanes
+HEX_TARGET("avx512f,avx512bw") static inline void hex_encode64_avx512(const uint8_t* data, char* out) {
+    const __m512i digits = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(HEX_DIGITS)));
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    __m512i bytes = _mm512_loadu_si512(data);
+    __m512i hi = _mm512_shuffle_epi8(digits, _mm512_and_si512(_mm512_srli_epi16(bytes, 4), mask));
+    __m512i lo = _mm512_shuffle_epi8(digits, _mm512_and_si512(bytes, mask));
+    // Lane k of first holds bytes 16k..16k+7, of second 16k+8..16k+15
+    __m512i first = _mm512_unpacklo_epi8(hi, lo);
+    __m512i second = _mm512_unpackhi_epi8(hi, lo);
+    _mm512_storeu_si512(out, _mm512_permutex2var_epi64(first, _mm512_setr_epi64(0, 1, 8, 9, 2, 3, 10, 11), second));
+    _mm512_storeu_si512(out + 64, _mm512_permutex2var_epi64(first, _mm512_setr_epi64(4, 5, 12, 13, 6, 7, 14, 15), second));
+}
+
+HEX_TARGET("avx512f,avx512bw") static inline __m512i hex_values64_avx512(__m512i chars, __mmask64* valid) {
+    __m512i lower = _mm512_or_si512(chars, _mm512_set1_epi8(0x20));
+    __m512i digit_value = _mm512_sub_epi8(chars, _mm512_set1_epi8('0'));
+    __m512i letter_value = _mm512_sub_epi8(lower, _mm512_set1_epi8('a'));
+    __mmask64 is_digit = _mm512_cmplt_epu8_mask(digit_value, _mm512_set1_epi8(10));
+    __mmask64 is_letter = _mm512_cmplt_epu8_mask(letter_value, _mm512_set1_epi8(6));
+    *valid = is_digit | is_letter;
+    return _mm512_mask_blend_epi8(is_digit, _mm512_add_epi8(letter_value, _mm512_set1_epi8(10)), digit_value);
+}
+
+// 128 digits -> 64 bytes; false on a non-hex character
+HEX_TARGET("avx512f,avx512bw") static inline bool hex_decode64_avx512(const char* hex, uint8_t* out) {
+    __mmask64 valid_a, valid_b;
+    __m512i a = hex_values64_avx512(_mm512_loadu_si512(hex), &valid_a);
+    __m512i b = hex_values64_avx512(_mm512_loadu_si512(hex + 64), &valid_b);
+    const __m512i weights = _mm512_set1_epi16(0x0110);
+    // packus interleaves lanes (a0, b0, a1, b1, ...); restore the order
+    __m512i packed = _mm512_packus_epi16(_mm512_maddubs_epi16(a, weights), _mm512_maddubs_epi16(b, weights));
+    _mm512_storeu_si512(out, _mm512_permutexvar_epi64(_mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7), packed));
+    return (valid_a & valid_b) == ~0ULL;
+}
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+// 16 bytes -> 32 digits: table lookup per nibble, interleaving store
+static inline void hex_encode16_neon(const uint8_t* data, char* out) {
+    const uint8x16_t digits = vld1q_u8(reinterpret_cast<const uint8_t*>(HEX_DIGITS));
+    uint8x16_t bytes = vld1q_u8(data);
+    uint8x16x2_t chars;
+    chars.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(bytes, 4));
+    chars.val[1] = vqtbl1q_u8(digits, vandq_u8(bytes, vdupq_n_u8(0x0f)));
+    vst2q_u8(reinterpret_cast<uint8_t*>(out), chars);
+}
+
+static inline uint8x16_t hex_values16_neon(uint8x16_t chars, uint8x16_t* valid) {
+    uint8x16_t lower = vorrq_u8(chars, vdupq_n_u8(0x20));
+    uint8x16_t digit_value = vsubq_u8(chars, vdupq_n_u8('0'));
+    uint8x16_t letter_value = vsubq_u8(lower, vdupq_n_u8('a'));
+    uint8x16_t is_digit = vcltq_u8(digit_value, vdupq_n_u8(10));
+    uint8x16_t is_letter = vcltq_u8(letter_value, vdupq_n_u8(6));
+    *valid = vorrq_u8(is_digit, is_letter);
+    return vbslq_u8(is_digit, digit_value, vaddq_u8(letter_value, vdupq_n_u8(10)));
+}
+
+// 32 digits -> 16 bytes; false on a non-hex character
+static inline bool hex_decode16_neon(const char* hex, uint8_t* out) {
+    uint8x16x2_t chars = vld2q_u8(reinterpret_cast<const uint8_t*>(hex));  // Splits high/low digits
+    uint8x16_t valid_hi, valid_lo;
+    uint8x16_t hi = hex_values16_neon(chars.val[0], &valid_hi);
+    uint8x16_t lo = hex_values16_neon(chars.val[1], &valid_lo);
+    vst1q_u8(out, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+    return vminvq_u8(vandq_u8(valid_hi, valid_lo)) == 0xff;
+}
+#endif
+
+enum HexCodec { HEX_CODEC_SCALAR, HEX_CODEC_NEON, HEX_CODEC_SSSE3, HEX_CODEC_AVX2, HEX_CODEC_AVX512 };
+
+static HexCodec detect_hex_codec() {
+#if defined(HEX_SSSE3)
+    randomx::Cpu cpu;
+#if defined(HEX_AVX512)
+    if (cpu.hasAvx512Bw()) return HEX_CODEC_AVX512;
+#endif
+#if defined(HEX_AVX2)
+    if (cpu.hasAvx2()) return HEX_CODEC_AVX2;
+#endif
+    if (cpu.hasSsse3()) return HEX_CODEC_SSSE3;
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    return HEX_CODEC_NEON;  // Part of the aarch64 baseline
+#endif
+    return HEX_CODEC_SCALAR;
+}
+
+static HexCodec active_hex_codec() {
+    static const HexCodec codec = detect_hex_codec();
+    return codec;
+}
+
+// Whole blocks for the widest codec first, then narrower ones; each returns
+// the bytes it did and leaves the tail to the scalar loop
+#if defined(HEX_SSSE3)
+HEX_TARGET("ssse3") static size_t hex_encode_ssse3(const uint8_t* data, size_t len, char* out) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        hex_encode16_ssse3(data + i, out + 2 * i);
     }
-    return oss.str();
+    return i;
+}
+
+HEX_TARGET("ssse3") static bool hex_decode_ssse3(const char* hex, size_t len, uint8_t* out, size_t* done) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        if (!hex_decode16_ssse3(hex + 2 * i, out + i)) {
+            return false;
+        }
+    }
+    *done = i;
+    return true;
+}
+#endif
+
+#if defined(HEX_AVX2)
+HEX_TARGET("avx2") static size_t hex_encode_avx2(const uint8_t* data, size_t len, char* out) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        hex_encode32_avx2(data + i, out + 2 * i);
+    }
+    for (; i + 16 <= len; i += 16) {
+        hex_encode16_ssse3(data + i, out + 2 * i);
+    }
+    return i;
+}
+
+HEX_TARGET("avx2") static bool hex_decode_avx2(const char* hex, size_t len, uint8_t* out, size_t* done) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        if (!hex_decode32_avx2(hex + 2 * i, out + i)) {
+            return false;
+        }
+    }
+    for (; i + 16 <= len; i += 16) {
+        if (!hex_decode16_ssse3(hex + 2 * i, out + i)) {
+            return false;
+        }
+    }
+    *done = i;
+    return true;
+}
+#endif
+
+#if defined(HEX_AVX512)
+HEX_TARGET("avx512f,avx512bw,avx2") static size_t hex_encode_avx512(const uint8_t* data, size_t len, char* out) {
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        hex_encode64_avx512(data + i, out + 2 * i);
+    }
+    for (; i + 32 <= len; i += 32) {
+        hex_encode32_avx2(data + i, out + 2 * i);
+    }
+    for (; i + 16 <= len; i += 16) {
+        hex_encode16_ssse3(data + i, out + 2 * i);
+    }
+    return i;
+}
+
+HEX_TARGET("avx512f,avx512bw,avx2") static bool hex_decode_avx512(const char* hex, size_t len, uint8_t* out, size_t* done) {
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        if (!hex_decode64_avx512(hex + 2 * i, out + i)) {
+            return false;
+        }
+    }
+    for (; i + 32 <= len; i += 32) {
+        if (!hex_decode32_avx2(hex + 2 * i, out + i)) {
+            return false;
+        }
+    }
+    for (; i + 16 <= len; i += 16) {
+        if (!hex_decode16_ssse3(hex + 2 * i, out + i)) {
+            return false;
+        }
+    }
+    *done = i;
+    return true;
+}
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+static size_t hex_encode_neon(const uint8_t* data, size_t len, char* out) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        hex_encode16_neon(data + i, out + 2 * i);
+    }
+    return i;
+}
+
+static bool hex_decode_neon(const char* hex, size_t len, uint8_t* out, size_t* done) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        if (!hex_decode16_neon(hex + 2 * i, out + i)) {
+            return false;
+        }
+    }
+    *done = i;
+    return true;
+}
+#endif
+
+void hex_encode(const uint8_t* data, size_t len, char* out) {
+    size_t i = 0;
+    switch (active_hex_codec()) {
+#if defined(HEX_AVX512)
+    case HEX_CODEC_AVX512: i = hex_encode_avx512(data, len, out); break;
+#endif
+#if defined(HEX_AVX2)
+    case HEX_CODEC_AVX2: i = hex_encode_avx2(data, len, out); break;
+#endif
+#if defined(HEX_SSSE3)
+    case HEX_CODEC_SSSE3: i = hex_encode_ssse3(data, len, out); break;
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    case HEX_CODEC_NEON: i = hex_encode_neon(data, len, out); break;
+#endif
+    default: break;
+    }
+    hex_encode_scalar(data + i, len - i, out + 2 * i);
+}
+
+bool hex_decode(const char* hex, size_t len, uint8_t* out) {
+    size_t i = 0;
+    bool ok = true;
+    switch (active_hex_codec()) {
+#if defined(HEX_AVX512)
+    case HEX_CODEC_AVX512: ok = hex_decode_avx512(hex, len, out, &i); break;
+#endif
+#if defined(HEX_AVX2)
+    case HEX_CODEC_AVX2: ok = hex_decode_avx2(hex, len, out, &i); break;
+#endif
+#if defined(HEX_SSSE3)
+    case HEX_CODEC_SSSE3: ok = hex_decode_ssse3(hex, len, out, &i); break;
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    case HEX_CODEC_NEON: ok = hex_decode_neon(hex, len, out, &i); break;
+#endif
+    default: break;
+    }
+    return ok && hex_decode_scalar(hex + 2 * i, len - i, out + i);
+}
+
+const char* hex_codec_name() {
+    static const char* const NAMES[] = {"scalar", "neon", "ssse3", "avx2", "avx512"};
+    return NAMES[active_hex_codec()];
+}
+
+std::string bytes_to_hex(const uint8_t* data, size_t len) {
+    std::string hex(len * 2, '\0');
+    hex_encode(data, len, &hex[0]);
+    return hex;
 }
 
 std::string bytes_to_hex_reversed(const uint8_t* data, size_t len) {
     // Display in reversed byte order (big-endian) for block hashes
-    std::ostringstream oss;
-    for (int i = len - 1; i >= 0; i--) {
-        oss << std::hex << std::setw(2) << std::setfill('0') << (int)data[i];
+    std::string hex(len * 2, '\0');
+    for (size_t i = 0; i < len; i++) {
+        hex_encode_scalar(data + len - 1 - i, 1, &hex[2 * i]);
     }
-    return oss.str();
+    return hex;
 }
 
 std::vector<uint8_t> hex_to_bytes(const std::string& hex) {
-    std::vector<uint8_t> bytes;
-    for (size_t i = 0; i < hex.length(); i += 2) {
-        std::string byte_str = hex.substr(i, 2);
-        uint8_t byte = static_cast<uint8_t>(std::stoi(byte_str, nullptr, 16));
-        bytes.push_back(byte);
+    if (hex.size() % 2 != 0) {
+        throw std::invalid_argument("odd-length hex string");
+    }
+    std::vector<uint8_t> bytes(hex.size() / 2);
+    if (!hex_decode(hex.data(), bytes.size(), bytes.data())) {
+        throw std::invalid_argument("invalid hex string");
     }
     return bytes;
 }
@@ -215,12 +903,171 @@ bool hash_meets_target(const uint8_t* hash, const std::vector<uint8_t>& target)
     return true; // Equal is valid (hash == target is acceptable)
 }
 
+std::vector<uint8_t> leading_zero_target(unsigned int zero_bits) {
+    std::vector<uint8_t> target(32, 0xff);
+    for (unsigned int bit = 0; bit < zero_bits && bit < 256; bit++) {
+        target[31 - bit / 8] &= (uint8_t)~(0x80 >> (bit % 8));
+    }
+    return target;
+}
+
+TargetLimbs target_to_limbs(const std::vector<uint8_t>& target) {
+    TargetLimbs limbs = {};
+    for (int i = 0; i < 4 && (size_t)(i + 1) * 8 <= target.size(); i++) {
+        limbs.limbs[i] = read_le64(target.data() + i * 8);
+    }
+    return limbs;
+}
+
+bool hash_meets_target_full(const uint8_t* hash, const TargetLimbs& target) {
+    // Compare limbs from most to least significant; equal is valid
+    for (int i = 3; i >= 0; i--) {
+        uint64_t hash_limb = read_le64(hash + i * 8);
+        if (hash_limb < target.limbs[i]) return true;
+        if (hash_limb > target.limbs[i]) return false;
+    }
+    return true;
+}
+
 // Legacy hex string comparison (kept for compatibility)
 bool hash_meets_target_hex(const uint8_t* hash, const std::string& target_hex) {
     std::vector<uint8_t> target = hex_to_bytes(target_hex);
     return hash_meets_target(hash, target);
 }
 
+size_t huge_page_bytes(const void* addr, size_t len) {
+    std::ifstream smaps("/proc/self/smaps");
+    if (!smaps) {
+        return 0;
+    }
+
+    uintptr_t begin = reinterpret_cast<uintptr_t>(addr);
+    uintptr_t end = begin + len;
+    size_t total = 0;
+
+    // Per-mapping state; a mapping's fields follow its "start-end perms ..." header line
+    bool overlaps = false;
+    size_t overlap_bytes = 0;
+    size_t mapping_huge_bytes = 0;
+    auto finish_mapping = [&]() {
+        if (overlaps) {
+            total += std::min(mapping_huge_bytes, overlap_bytes);
+        }
+        overlaps = false;
+        mapping_huge_bytes = 0;
+    };
+
+    std::string line;
+    while (std::getline(smaps, line)) {
+        if (line.empty()) continue;
+
+        // Field lines look like "AnonHugePages:      2048 kB"
+        size_t colon = line.find(':');
+        size_t dash = line.find('-');
+        if (dash != std::string::npos && (colon == std::string::npos || dash < colon) &&
+            std::isxdigit(static_cast<unsigned char>(line[0]))) {
+            finish_mapping();
+            uintptr_t map_start = std::stoull(line.substr(0, dash), nullptr, 16);
+            size_t space = line.find(' ', dash);
+            uintptr_t map_end = std::stoull(line.substr(dash + 1, space - dash - 1), nullptr, 16);
+            if (map_start < end && map_end > begin) {
+                overlaps = true;
+                overlap_bytes = std::min(map_end, end) - std::max(map_start, begin);
+            }
+            continue;
+        }
+
+        if (!overlaps || colon == std::string::npos) continue;
+        std::string key = line.substr(0, colon);
+        if (key == "AnonHugePages" || key == "Private_Hugetlb" || key == "Shared_Hugetlb") {
+            mapping_huge_bytes += std::stoull(line.substr(colon + 1)) * 1024;
+        }
+    }
+    finish_mapping();
+
+    return total;
+}
+
+bool process_memory_mb(size_t& resident_mb, size_t& peak_mb) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    bool found = false;
+    resident_mb = 0;
+    peak_mb = 0;
+    while (std::getline(status, line)) {
+        bool resident = line.find("VmRSS:") == 0;
+        if (resident || line.find("VmHWM:") == 0) {
+            std::istringstream iss(line);
+            std::string label;
+            size_t value = 0;
+            iss >> label >> value;
+            (resident ? resident_mb : peak_mb) = value / 1024;  // Convert KB to MB
+            found = true;
+        }
+    }
+    return found;
+}
+
+// The kB value of the line starting with label in a /proc key: value file
+static bool read_proc_kb(const char* path, const char* label, size_t& kb) {
+    std::ifstream file(path);
+    std::string line;
+    size_t label_length = std::strlen(label);
+    while (std::getline(file, line)) {
+        if (line.compare(0, label_length, label) == 0) {
+            std::istringstream iss(line.substr(label_length));
+            return (bool)(iss >> kb);
+        }
+    }
+    return false;
+}
+
+bool process_huge_page_mb(size_t& hugetlb_mb, size_t& transparent_mb) {
+    size_t hugetlb_kb = 0;
+    size_t transparent_kb = 0;
+    bool found = read_proc_kb("/proc/self/status", "HugetlbPages:", hugetlb_kb);
+    found = read_proc_kb("/proc/self/smaps_rollup", "AnonHugePages:", transparent_kb) || found;
+    hugetlb_mb = hugetlb_kb / 1024;
+    transparent_mb = transparent_kb / 1024;
+    return found;
+}
+
+int listen_tcp(const std::string& address, std::string& error) {
+    size_t colon = address.rfind(':');
+    std::string host = colon == std::string::npos ? std::string() : address.substr(0, colon);
+    std::string port = colon == std::string::npos ? address : address.substr(colon + 1);
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* addresses = nullptr;
+    int res = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &addresses);
+    if (res != 0) {
+        error = std::string("can't resolve ") + address + ": " + gai_strerror(res);
+        return -1;
+    }
+    int listen_fd = -1;
+    for (addrinfo* ai = addresses; ai && listen_fd < 0; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            listen_fd = fd;
+        } else {
+            error = std::string("can't listen on ") + address + ": " + std::strerror(errno);
+            close(fd);
+        }
+    }
+    freeaddrinfo(addresses);
+    return listen_fd;
+}
+
 uint64_t get_current_timestamp() {
     auto now = std::chrono::system_clock::now();
     auto duration = now.time_since_epoch();
@@ -273,26 +1120,93 @@ std::string serialize_block(const std::vector<uint8_t>& header,
         result += static_cast<char>(byte);
     }
 
+    std::vector<std::string_view> txn_views(txn_hex.begin(), txn_hex.end());
+    return bytes_to_hex(reinterpret_cast<const uint8_t*>(result.data()), result.size()) +
+           serialize_block_body(coinbase_hex, txn_views);
+}
+
+// Lower-case hex digit for each valid input character, 0 otherwise
+static const struct HexDigitTable {
+    char map[256];
+    HexDigitTable() : map() {
+        for (char c = '0'; c <= '9'; c++) map[static_cast<unsigned char>(c)] = c;
+        for (char c = 'a'; c <= 'f'; c++) map[static_cast<unsigned char>(c)] = c;
+        for (char c = 'A'; c <= 'F'; c++) map[static_cast<unsigned char>(c)] = static_cast<char>(c - 'A' + 'a');
+    }
+} hex_digit_table;
+
+size_t append_hex_lower(const char* hex, size_t len, std::string& out) {
+    size_t count = 0;
+    bool upper = false;
+    while (count < len) {
+        char digit = hex_digit_table.map[static_cast<unsigned char>(hex[count])];
+        if (digit == 0) {
+            break;
+        }
+        upper |= digit != hex[count];
+        count++;
+    }
+    size_t start = out.size();
+    out.append(hex, count);
+    // Nodes print lower case, so this pass is normally skipped
+    if (upper) {
+        for (size_t i = start; i < out.size(); i++) {
+            out[i] = hex_digit_table.map[static_cast<unsigned char>(out[i])];
+        }
+    }
+    return count;
+}
+
+std::string serialize_block_body(std::string_view coinbase_hex, const std::vector<std::string_view>& txn_hex) {
+    // The transactions arrive as hex of their wire format already, so they are
+    // copied (checked and lower-cased, as bytes_to_hex prints) rather than
+    // decoded and encoded again
+    std::string tx_count = encode_varint(1 + txn_hex.size()); // coinbase + other txs
+    size_t total = tx_count.size() * 2 + coinbase_hex.size();
+    for (const auto& tx_hex : txn_hex) {
+        total += tx_hex.size();
+    }
+    std::string result;
+    result.reserve(total);
+
+    auto append_hex = [&result](std::string_view hex) {
+        if (hex.size() % 2 != 0) {
+            throw std::runtime_error("Odd-length transaction hex in block template");
+        }
+        if (append_hex_lower(hex.data(), hex.size(), result) != hex.size()) {
+            throw std::runtime_error("Invalid transaction hex in block template");
+        }
+    };
+
     // 3. Transaction count (varint)
-    uint64_t tx_count = 1 + txn_hex.size(); // coinbase + other txs
-    result += encode_varint(tx_count);
+    result += bytes_to_hex(reinterpret_cast<const uint8_t*>(tx_count.data()), tx_count.size());
 
     // 4. Coinbase transaction
-    std::vector<uint8_t> coinbase_bytes = hex_to_bytes(coinbase_hex);
-    for (uint8_t byte : coinbase_bytes) {
-        result += static_cast<char>(byte);
-    }
+    append_hex(coinbase_hex);
 
     // 5. Other transactions
     for (const auto& tx_hex : txn_hex) {
-        std::vector<uint8_t> tx_bytes = hex_to_bytes(tx_hex);
-        for (uint8_t byte : tx_bytes) {
-            result += static_cast<char>(byte);
-        }
+        append_hex(tx_hex);
     }
+    return result;
+}
 
-    // Convert to hex string
-    return bytes_to_hex(reinterpret_cast<const uint8_t*>(result.data()), result.size());
+std::string format_block(const uint8_t* header, const uint8_t* solution, const std::string& body_hex) {
+    static const char digits[] = "0123456789abcdef";
+    std::string result;
+    result.reserve((140 + 1 + 32) * 2 + body_hex.size());
+    auto append = [&](const uint8_t* data, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            result += digits[data[i] >> 4];
+            result += digits[data[i] & 0xf];
+        }
+    };
+    const uint8_t solution_size = 32;  // compact_size prefix of nSolution
+    append(header, 140);
+    append(&solution_size, 1);
+    append(solution, 32);
+    result += body_hex;
+    return result;
 }
 
 
@@ -2,30 +2,77 @@
 #define UTILS_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
+#include <cstring>
 
 namespace utils {
 
 // System resource detection
+// A cgroup limit that isn't set
+static const size_t RESOURCE_UNLIMITED = SIZE_MAX;
+
 struct SystemResources {
     size_t total_ram_mb;
     size_t available_ram_mb;
     unsigned int cpu_cores;
+    unsigned int l3_thread_limit;  // Threads the L3 caches can feed (2MB each), see CpuTopology
     unsigned int optimal_threads;
+
+    // Limits behind the figures above, which are already clamped to them
+    unsigned int host_cpus;        // hardware_concurrency
+    unsigned int affinity_cpus;    // CPUs in the affinity mask (always within the cpuset), 0 if unknown
+    double cpu_quota;              // CPUs' worth of cgroup cpu.max / CFS quota, 0 if none
+    int cgroup_version;            // 1 or 2 for the hierarchy that set a limit, 0 if none
+    size_t memory_limit_mb;        // cgroup memory.max (or .high) / limit_in_bytes
+    size_t huge_page_budget_mb;    // 2MB pages the hugetlb cgroup still lets us fault in
+    size_t huge_page_1gb_budget_mb;
+
+    SystemResources()
+        : total_ram_mb(0), available_ram_mb(0), cpu_cores(1), l3_thread_limit(0), optimal_threads(1)
+        , host_cpus(1), affinity_cpus(0), cpu_quota(0), cgroup_version(0)
+        , memory_limit_mb(RESOURCE_UNLIMITED), huge_page_budget_mb(RESOURCE_UNLIMITED)
+        , huge_page_1gb_budget_mb(RESOURCE_UNLIMITED) {}
 };
 
+// Host RAM and CPUs narrowed to what this process may use: the affinity mask,
+// and the cgroup (v1 or v2, including its ancestors) CPU quota and memory
+// limit, so auto threads and the mode choice don't oversubscribe a container
+// or get it OOM-killed
 SystemResources detect_system_resources();
 
-// Calculate optimal thread count based on RandomX mode
+// MemAvailable now, narrowed to the cgroup memory budget as in
+// detect_system_resources (cheap enough to poll once a second)
+size_t available_ram_mb();
+
+// The limits that narrowed detect_system_resources, e.g. "cgroup v2: cpu.max
+// 1.5 CPUs, memory.max 4096 MB; affinity 4 of 64 CPUs"; empty if none did
+std::string describe_resource_limits(const SystemResources& resources);
+
+// Calculate optimal thread count based on RandomX mode, RAM, cores and L3 size
 // fast_mode: true = full dataset (~2GB shared), false = light mode (~256MB per cache)
 unsigned int calculate_optimal_threads(const SystemResources& resources, bool fast_mode);
 
 // Hex conversion utilities
 std::string bytes_to_hex(const uint8_t* data, size_t len);
 std::string bytes_to_hex_reversed(const uint8_t* data, size_t len); // For displaying block hashes
+// Throws std::invalid_argument on an odd length or a non-hex character
 std::vector<uint8_t> hex_to_bytes(const std::string& hex);
 
+// Raw hex codecs behind the above, vectorized with AVX-512BW, AVX2, SSSE3 or
+// NEON: the widest the build has that the CPU supports (a portable build has
+// all the x86 ones). hex_encode writes 2 * len lower-case digits;
+// hex_decode reads 2 * len digits of either case into len bytes and returns
+// false if any character isn't a hex digit (out is then unspecified).
+void hex_encode(const uint8_t* data, size_t len, char* out);
+bool hex_decode(const char* hex, size_t len, uint8_t* out);
+// The codec in use: "avx512", "avx2", "ssse3", "neon" or "scalar"
+const char* hex_codec_name();
+// Append the run of hex digits at the start of hex[0, len) to out, lower-cased;
+// returns its length (the first non-hex character ends it)
+size_t append_hex_lower(const char* hex, size_t len, std::string& out);
+
 // Endianness conversions
 uint32_t read_le32(const uint8_t* data);
 void write_le32(uint8_t* data, uint32_t value);
@@ -35,13 +82,57 @@ void write_le64(uint8_t* data, uint64_t value);
 // Compact bits conversion (like Bitcoin/Zcash SetCompact)
 // Converts compact bits format (e.g., 0x1f09daa8) to 256-bit target
 std::vector<uint8_t> compact_to_target(uint32_t compact_bits);
+// Pseudo-share target: the 256-bit target (little-endian) met by hashes with
+// zero_bits leading zero bits, i.e. one hash in 2^zero_bits on average
+std::vector<uint8_t> leading_zero_target(unsigned int zero_bits);
 
 // Hash comparison using 256-bit integer comparison
 bool hash_meets_target(const uint8_t* hash, const std::vector<uint8_t>& target);
 
+// 256-bit target as four native 64-bit limbs (limbs[0] least significant).
+// limbs[3] doubles as the fast-reject threshold: almost every hash has a
+// larger top limb and is rejected with a single compare.
+struct TargetLimbs {
+    uint64_t limbs[4];
+};
+
+TargetLimbs target_to_limbs(const std::vector<uint8_t>& target);
+
+// Full 256-bit comparison, only needed when the top limbs tie
+bool hash_meets_target_full(const uint8_t* hash, const TargetLimbs& target);
+
+// Fast-path hash <= target check for the mining hot loop (no heap access)
+inline bool hash_meets_target(const uint8_t* hash, const TargetLimbs& target) {
+    uint64_t top;
+    std::memcpy(&top, hash + 24, sizeof(top));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    top = __builtin_bswap64(top);
+#endif
+    if (__builtin_expect(top > target.limbs[3], 1)) return false;
+    if (top < target.limbs[3]) return true;
+    return hash_meets_target_full(hash, target);
+}
+
 // Legacy hex string comparison (kept for compatibility)
 bool hash_meets_target_hex(const uint8_t* hash, const std::string& target_hex);
 
+// Number of bytes in [addr, addr + len) currently backed by huge pages, either
+// reserved hugetlbfs pages or transparent huge pages (from /proc/self/smaps).
+// Returns 0 where smaps is not available.
+size_t huge_page_bytes(const void* addr, size_t len);
+
+// This process's resident memory now and at its peak, in MB (VmRSS and
+// VmHWM from /proc/self/status). False where that is not available.
+bool process_memory_mb(size_t& resident_mb, size_t& peak_mb);
+// This process's memory on reserved hugetlbfs pages (HugetlbPages) and on
+// transparent huge pages (AnonHugePages in /proc/self/smaps_rollup), in MB.
+// False where neither is available.
+bool process_huge_page_mb(size_t& hugetlb_mb, size_t& transparent_mb);
+
+// A non-blocking TCP socket listening on host:port (host may be empty or
+// 0.0.0.0 for every interface), or -1 with error set if it can't be bound
+int listen_tcp(const std::string& address, std::string& error);
+
 // Time utilities
 uint64_t get_current_timestamp();
 
@@ -53,6 +144,13 @@ std::string serialize_block(const std::vector<uint8_t>& header,
                            const std::vector<uint8_t>& solution,
                            const std::string& coinbase_hex,
                            const std::vector<std::string>& txn_hex);
+// The part after the header and nSolution (transaction count, coinbase, other
+// transactions) as hex, so it can be built once per template. Throws
+// std::runtime_error on malformed transaction hex.
+std::string serialize_block_body(std::string_view coinbase_hex, const std::vector<std::string_view>& txn_hex);
+// Full block hex from a 140-byte header, a 32-byte RandomX solution and a
+// body from serialize_block_body
+std::string format_block(const uint8_t* header, const uint8_t* solution, const std::string& body_hex);
 
 } // namespace utils
 
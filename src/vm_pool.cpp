@@ -0,0 +1,96 @@
+#include "vm_pool.h"
+#include "configuration.h"
+#include <cstring>
+#include <iterator>
+
+randomx_vm* VmPool::create(randomx_flags flags, randomx_cache* cache, randomx_dataset* dataset) {
+    randomx_vm* vm = randomx_create_vm(flags, cache, (flags & RANDOMX_FLAG_FULL_MEM) ? dataset : nullptr);
+    if (!vm) {
+        return nullptr;
+    }
+    if (dataset && !(flags & RANDOMX_FLAG_FULL_MEM)) {
+        // A light VM given a dataset is a medium-mode VM: it reads the items
+        // the partial dataset holds and computes the rest from its cache
+        randomx_vm_set_partial_dataset(vm, dataset);
+    }
+    // Fault the scratchpad in now, under the caller's memory policy, rather
+    // than in the first hash (huge pages are populated by mmap already). The
+    // VM overwrites it at the start of every hash.
+    if (!(flags & RANDOMX_FLAG_LARGE_PAGES)) {
+        std::memset(const_cast<void*>(randomx_get_scratchpad(vm)), 0, RANDOMX_SCRATCHPAD_L3);
+    }
+    return vm;
+}
+
+randomx_vm* VmPool::acquire(randomx_flags flags, int node, randomx_cache* cache, randomx_dataset* dataset) {
+    randomx_vm* vm = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Most recently released first: its pages are the likeliest still cached
+        for (auto it = idle_.rbegin(); it != idle_.rend(); ++it) {
+            if (it->key.flags == flags && it->key.node == node) {
+                vm = it->vm;
+                idle_.erase(std::next(it).base());
+                reused_++;
+                break;
+            }
+        }
+    }
+    if (vm) {
+        if (flags & RANDOMX_FLAG_FULL_MEM) {
+            randomx_vm_set_dataset(vm, dataset);
+        } else {
+            randomx_vm_set_cache(vm, cache);
+            randomx_vm_set_partial_dataset(vm, dataset);
+        }
+        return vm;
+    }
+    vm = create(flags, cache, dataset);
+    if (vm) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        keys_[vm] = Key{flags, node};
+    }
+    return vm;
+}
+
+void VmPool::release(randomx_vm* vm) {
+    if (!vm) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = keys_.find(vm);
+    if (it == keys_.end()) {
+        randomx_destroy_vm(vm);
+        return;
+    }
+    idle_.push_back(Idle{vm, it->second});
+}
+
+void VmPool::trim(size_t keep) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Count from the most recently released back; older ones past keep go
+    std::deque<Idle> kept_order;
+    for (auto it = idle_.rbegin(); it != idle_.rend(); ++it) {
+        size_t same = 0;
+        for (const Idle& other : kept_order) {
+            if (other.key.flags == it->key.flags && other.key.node == it->key.node) same++;
+        }
+        if (same < keep) {
+            kept_order.push_front(*it);
+        } else {
+            keys_.erase(it->vm);
+            randomx_destroy_vm(it->vm);
+        }
+    }
+    idle_.swap(kept_order);
+}
+
+size_t VmPool::idle() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idle_.size();
+}
+
+uint64_t VmPool::reused() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reused_;
+}
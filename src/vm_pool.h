@@ -0,0 +1,59 @@
+#ifndef VM_POOL_H
+#define VM_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include "randomx.h"
+
+// RandomX VMs kept for reuse. A new VM maps a fresh 2MB scratchpad and JIT
+// buffer that its first hash would fault in page by page, and the miner
+// drops and recreates whole sets of VMs at thread count changes, mode
+// switches and every fast-mode warm-up. The pool creates VMs with their
+// scratchpad already faulted in (on the NUMA node preferred at the time),
+// and keeps released VMs by flags and node to hand out again. Thread-safe.
+class VmPool {
+public:
+    VmPool() : reused_(0) {}
+    ~VmPool() { clear(); }
+
+    VmPool(const VmPool&) = delete;
+    VmPool& operator=(const VmPool&) = delete;
+
+    // An idle VM created with flags for node (-1: no NUMA), or a new one;
+    // nullptr if none can be created. A fast VM gets dataset, a light VM
+    // cache and dataset as its partial dataset (nullptr: none). Set the
+    // node's memory policy first.
+    randomx_vm* acquire(randomx_flags flags, int node, randomx_cache* cache, randomx_dataset* dataset);
+    // Back to the pool; nothing may use it any more
+    void release(randomx_vm* vm);
+    // Keep at most keep idle VMs of each kind (flags and node), the most
+    // recently released; destroy the rest
+    void trim(size_t keep);
+    void clear() { trim(0); }
+
+    size_t idle() const;
+    // VMs handed out again instead of created
+    uint64_t reused() const;
+
+private:
+    struct Key {
+        randomx_flags flags;
+        int node;
+    };
+    struct Idle {
+        randomx_vm* vm;
+        Key key;
+    };
+
+    mutable std::mutex mutex_;
+    std::unordered_map<randomx_vm*, Key> keys_;    // Every VM the pool created and not yet destroyed
+    std::deque<Idle> idle_;                         // Oldest release first
+    uint64_t reused_;
+
+    static randomx_vm* create(randomx_flags flags, randomx_cache* cache, randomx_dataset* dataset);
+};
+
+#endif // VM_POOL_H
@@ -0,0 +1,481 @@
+#include "work_proxy.h"
+#include "logger.h"
+#include "stratum_client.h"
+#include "utils.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// A rig line longer than this without a newline is dropped with the rig
+static const size_t PROXY_MAX_LINE = 64 << 10;
+// Sends never block the proxy thread: what a rig's socket doesn't take is
+// queued, and a rig that leaves output waiting this long, or lets this much
+// pile up, is dropped
+static const int PROXY_SEND_TIMEOUT_SECONDS = 5;
+static const size_t PROXY_MAX_QUEUED = 1 << 20;
+// Share verification threads: at most this many, and half the CPUs
+static const unsigned int PROXY_VERIFY_THREADS = 4;
+// Seconds between warnings that shares were turned away unchecked
+static const int PROXY_BUSY_WARNING_SECONDS = 60;
+
+static Json::Value proxy_error(const std::string& message) {
+    Json::Value error;
+    error["code"] = -1;
+    error["message"] = message;
+    return error;
+}
+
+WorkProxy::WorkProxy(ProxyBlockSink sink)
+    : sink_(std::move(sink)), listen_fd_(-1), stop_(false), rig_count_(0), next_instance_id_(1), next_job_id_(1)
+    , share_bits_(0), share_verify_percent_(100), verifier_([this]() { events_.wake(); }), next_ticket_(1)
+    , sample_rng_(std::random_device()()) {}
+
+WorkProxy::~WorkProxy() {
+    stop();
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+    }
+}
+
+bool WorkProxy::listen(const std::string& address, std::string& error) {
+    listen_fd_ = utils::listen_tcp(address, error);
+    return listen_fd_ >= 0;
+}
+
+void WorkProxy::set_share_bits(unsigned int zero_bits) {
+    share_bits_ = zero_bits;
+    share_target_ = utils::leading_zero_target(zero_bits);
+}
+
+void WorkProxy::start() {
+    if (!thread_.joinable() && listen_fd_ >= 0) {
+        verifier_.start(std::max(1u, std::min(PROXY_VERIFY_THREADS, std::thread::hardware_concurrency() / 2)));
+        thread_ = std::thread(&WorkProxy::run, this);
+    }
+}
+
+void WorkProxy::stop() {
+    stop_ = true;
+    events_.wake();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    verifier_.stop();
+}
+
+void WorkProxy::publish(BlockTemplatePtr block_template) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        published_ = std::move(block_template);
+    }
+    events_.wake();
+}
+
+void WorkProxy::run() {
+    while (!stop_.load()) {
+        std::vector<int> fds(1, listen_fd_);
+        std::vector<int> writable;
+        for (const Rig& rig : rigs_) {
+            fds.push_back(rig.fd);
+            if (!rig.write_buffer.empty()) {
+                writable.push_back(rig.fd);
+            }
+        }
+        events_.watch_fds(fds);
+        events_.watch_writable_fds(writable);
+        events_.wait(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+
+        send_jobs();
+        finish_verified();
+        accept_rigs();
+        const auto now = std::chrono::steady_clock::now();
+        for (Rig& rig : rigs_) {
+            if (rig.fd >= 0 && (!read_rig(rig) || !flush(rig))) {
+                LOG_INFO_STREAM("Rig " << rig.address << " (instance " << rig.instance_id << ") disconnected");
+                close(rig.fd);
+                rig.fd = -1;
+            }
+            if (rig.fd >= 0 && !rig.write_buffer.empty() &&
+                now - rig.write_progress >= std::chrono::seconds(PROXY_SEND_TIMEOUT_SECONDS)) {
+                LOG_WARNING_STREAM("Rig " << rig.address << " stopped taking messages, dropping it");
+                close(rig.fd);
+                rig.fd = -1;
+            }
+        }
+        rigs_.erase(std::remove_if(rigs_.begin(), rigs_.end(), [](const Rig& rig) { return rig.fd < 0; }),
+                    rigs_.end());
+        rig_count_ = rigs_.size();
+        update_stats();
+    }
+    for (const Rig& rig : rigs_) {
+        close(rig.fd);
+    }
+    rigs_.clear();
+    rig_count_ = 0;
+    update_stats();
+}
+
+void WorkProxy::update_stats() {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<ProxyRigStats> stats;
+    for (const Rig& rig : rigs_) {
+        if (!rig.logged_in) {
+            continue;
+        }
+        ProxyRigStats rig_stats;
+        rig_stats.address = rig.address;
+        rig_stats.instance_id = rig.instance_id;
+        rig_stats.shares = rig.shares;
+        rig_stats.invalid_shares = rig.invalid;
+        double elapsed = std::chrono::duration<double>(now - rig.login_time).count();
+        rig_stats.effective_hashrate = share_bits_ && elapsed > 0
+            ? std::ldexp((double)rig.shares, (int)share_bits_) / elapsed : 0.0;
+        stats.push_back(std::move(rig_stats));
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.swap(stats);
+}
+
+std::vector<ProxyRigStats> WorkProxy::rig_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void WorkProxy::accept_rigs() {
+    for (;;) {
+        sockaddr_storage peer;
+        socklen_t peer_length = sizeof(peer);
+        int fd = accept(listen_fd_, (sockaddr*)&peer, &peer_length);
+        if (fd < 0) {
+            return;  // EAGAIN: nobody else waiting
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        // Jobs go out the moment they are published
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+
+        char host[NI_MAXHOST];
+        char port[NI_MAXSERV];
+        Rig rig;
+        rig.fd = fd;
+        rig.address = getnameinfo((sockaddr*)&peer, peer_length, host, sizeof(host), port, sizeof(port),
+                                  NI_NUMERICHOST | NI_NUMERICSERV) == 0
+            ? std::string(host) + ":" + port : std::string("?");
+        rig.instance_id = next_instance_id_++;
+        rig.logged_in = false;
+        rig.shares = 0;
+        rig.invalid = 0;
+        rig.suspect = false;
+        rigs_.push_back(std::move(rig));
+    }
+}
+
+bool WorkProxy::read_rig(Rig& rig) {
+    char buffer[4096];
+    for (;;) {
+        ssize_t n = recv(rig.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        rig.read_buffer.append(buffer, (size_t)n);
+        // Lines are handled as they arrive, so the buffer never holds more
+        // than one unfinished line
+        if (!handle_lines(rig)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WorkProxy::handle_lines(Rig& rig) {
+    size_t start = 0;
+    size_t end;
+    while ((end = rig.read_buffer.find('\n', start)) != std::string::npos) {
+        const char* line = rig.read_buffer.data() + start;
+        size_t length = end - start;
+        start = end + 1;
+
+        Json::CharReaderBuilder builder;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        Json::Value request;
+        std::string errors;
+        if (!reader->parse(line, line + length, &request, &errors) || !request.isObject()) {
+            LOG_WARNING_STREAM("Rig " << rig.address << " sent an invalid message: " << errors);
+            return false;
+        }
+        if (!handle_request(rig, request)) {
+            return false;
+        }
+    }
+    rig.read_buffer.erase(0, start);
+    return rig.read_buffer.size() <= PROXY_MAX_LINE;
+}
+
+bool WorkProxy::handle_request(Rig& rig, const Json::Value& request) {
+    const std::string method = request["method"].isString() ? request["method"].asString() : std::string();
+    Json::Value response;
+    response["id"] = request["id"];
+    response["jsonrpc"] = "2.0";
+    response["error"] = Json::Value();
+    response["result"] = Json::Value();
+
+    if (method == "login") {
+        if (jobs_.empty()) {
+            // The rig retries; the node has not given us a template yet
+            response["error"] = proxy_error("No job yet");
+            return send_message(rig, response);
+        }
+        rig.logged_in = true;
+        rig.login_time = std::chrono::steady_clock::now();
+        Json::Value& result = response["result"];
+        result["id"] = "rig" + std::to_string(rig.instance_id);
+        result["instance_id"] = rig.instance_id;
+        result["job"] = make_stratum_job(*jobs_.front().block_template, jobs_.front().id, jobs_.front().target);
+        result["status"] = "OK";
+        const Json::Value& params = request["params"];
+        LOG_INFO_STREAM("Rig " << rig.address << " logged in as "
+                        << (params["login"].isString() ? params["login"].asString() : std::string("?"))
+                        << ", instance " << rig.instance_id);
+    } else if (!rig.logged_in) {
+        response["error"] = proxy_error("Unauthenticated");
+    } else if (method == "submit") {
+        bool queued = false;
+        response["error"] = submit(rig, request, queued);
+        if (queued) {
+            return true;  // Answered once the hash is recomputed
+        }
+        if (response["error"].isNull()) {
+            response["result"]["status"] = "OK";
+        }
+    } else if (method == "keepalived") {
+        response["result"]["status"] = "KEEPALIVED";
+    } else {
+        response["error"] = proxy_error("Unsupported method " + method);
+    }
+    return send_message(rig, response);
+}
+
+Json::Value WorkProxy::submit(Rig& rig, const Json::Value& request, bool& queued) {
+    const Json::Value& params = request["params"];
+    const std::string job_id = params["job_id"].isString() ? params["job_id"].asString() : std::string();
+    Job* job = nullptr;
+    for (Job& recent : jobs_) {
+        if (recent.id == job_id) {
+            job = &recent;
+        }
+    }
+    if (!job) {
+        return proxy_error("Unknown job");
+    }
+
+    PendingShare share;
+    if (!params["nonce"].isString() || params["nonce"].asString().size() != NONCE_SIZE * 2 ||
+        !utils::hex_decode(params["nonce"].asCString(), NONCE_SIZE, share.header + NONCE_OFFSET) ||
+        !params["result"].isString() || params["result"].asString().size() != 64 ||
+        !utils::hex_decode(params["result"].asCString(), 32, share.hash)) {
+        return proxy_error("Malformed share");
+    }
+    // Each rig keeps to the instance it was given, so no two rigs hash the same nonce
+    if (utils::read_le32(share.header + NONCE_OFFSET + NONCE_INSTANCE_OFFSET) != rig.instance_id) {
+        return proxy_error("Nonce outside the rig's range");
+    }
+    const BlockTemplate& block_template = *job->block_template;
+    if (!utils::hash_meets_target(share.hash, job->target_limbs)) {
+        return proxy_error("Low difficulty share");
+    }
+    const std::string nonce(reinterpret_cast<const char*>(share.header + NONCE_OFFSET), NONCE_SIZE);
+    if (!job->nonces.insert(nonce).second) {
+        return proxy_error("Duplicate share");
+    }
+    std::memcpy(share.header, block_template.header_base.data(), NONCE_OFFSET);
+    share.block = utils::hash_meets_target(share.hash, block_template.target_limbs);
+    const bool sampled = share.block || rig.suspect || share_verify_percent_ >= 100 ||
+                         (share_verify_percent_ > 0 && sample_rng_() % 100 < share_verify_percent_);
+    if (!sampled) {
+        rig.shares++;
+        return Json::Value();
+    }
+
+    share.rig = rig.instance_id;
+    share.request_id = request["id"];
+    share.block_template = job->block_template;
+    const uint64_t ticket = next_ticket_++;
+    if (!verifier_.verify(ticket, block_template.seed_hash, share.header, share.block)) {
+        auto now = std::chrono::steady_clock::now();
+        if (now - busy_warned_ >= std::chrono::seconds(PROXY_BUSY_WARNING_SECONDS)) {
+            LOG_WARNING("Proxy: share verification can't keep up, turning shares away; raise --share-bits or "
+                        "lower --share-verify");
+            busy_warned_ = now;
+        }
+        job->nonces.erase(nonce);
+        return proxy_error("Proxy busy, share not checked");
+    }
+    pending_.emplace(ticket, std::move(share));
+    queued = true;
+    return Json::Value();
+}
+
+void WorkProxy::finish_verified() {
+    for (const ShareVerifier::Result& result : verifier_.take_results()) {
+        auto it = pending_.find(result.ticket);
+        if (it == pending_.end()) {
+            continue;
+        }
+        const PendingShare share = std::move(it->second);
+        pending_.erase(it);
+        // The rig may have gone meanwhile; its block still counts
+        Rig* rig = nullptr;
+        for (Rig& connected : rigs_) {
+            if (connected.instance_id == share.rig && connected.fd >= 0) {
+                rig = &connected;
+            }
+        }
+
+        Json::Value response;
+        response["id"] = share.request_id;
+        response["jsonrpc"] = "2.0";
+        response["error"] = Json::Value();
+        response["result"] = Json::Value();
+        if (result.hashed && std::memcmp(result.hash, share.hash, sizeof(share.hash)) != 0) {
+            response["error"] = proxy_error("Wrong hash: the rig's RandomX result doesn't match");
+            if (rig) {
+                if (rig->invalid++ == 0) {
+                    LOG_WARNING_STREAM("Rig " << rig->address << " (instance " << rig->instance_id
+                                       << ") sent a share with a wrong hash; its hashing is broken");
+                }
+                rig->suspect = true;
+            }
+        } else {
+            if (!result.hashed) {
+                LOG_WARNING("Proxy: could not recompute a share's hash, taking it unchecked");
+            }
+            response["result"]["status"] = "OK";
+            if (rig) {
+                rig->shares++;
+            }
+            if (share.block) {
+                forward_block(share, rig ? rig->address : "instance " + std::to_string(share.rig));
+            }
+        }
+        if (rig && !send_message(*rig, response)) {
+            LOG_INFO_STREAM("Rig " << rig->address << " (instance " << rig->instance_id << ") disconnected");
+            close(rig->fd);
+            rig->fd = -1;
+        }
+    }
+}
+
+void WorkProxy::forward_block(const PendingShare& share, const std::string& rig) {
+    const BlockTemplate& block_template = *share.block_template;
+    std::string block_hash_hex = utils::bytes_to_hex_reversed(share.hash, 32);
+    LOG_INFO_STREAM("Rig " << rig << " solved height " << block_template.height << " ("
+                    << block_hash_hex << "), forwarding to the node");
+    sink_(std::make_shared<const std::string>(utils::format_block(share.header, share.hash,
+                                                                  block_template.block_body_hex)),
+          block_template.height, block_hash_hex);
+}
+
+void WorkProxy::send_jobs() {
+    BlockTemplatePtr published;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        published.swap(published_);
+    }
+    if (!published) {
+        return;
+    }
+
+    Job job;
+    job.id = std::to_string(next_job_id_++);
+    job.block_template = std::move(published);
+    // Rigs mine to the share target when it is the easier one
+    bool share_target = share_bits_ && utils::hash_meets_target_full(job.block_template->target.data(),
+                                                                     utils::target_to_limbs(share_target_));
+    job.target = share_target ? share_target_ : job.block_template->target;
+    job.target_limbs = utils::target_to_limbs(job.target);
+    if (jobs_.empty() || jobs_.front().block_template->seed_hash != job.block_template->seed_hash) {
+        verifier_.prepare(job.block_template->seed_hash);
+    }
+    jobs_.push_front(std::move(job));
+    if (jobs_.size() > PROXY_RECENT_JOBS) {
+        jobs_.pop_back();
+    }
+
+    Json::Value notification;
+    notification["jsonrpc"] = "2.0";
+    notification["method"] = "job";
+    notification["params"] = make_stratum_job(*jobs_.front().block_template, jobs_.front().id, jobs_.front().target);
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    const std::string line = Json::writeString(writer, notification) + "\n";
+    for (Rig& rig : rigs_) {
+        if (rig.logged_in && !send_line(rig, line)) {
+            LOG_WARNING_STREAM("Rig " << rig.address << " did not take the new job, dropping it");
+            close(rig.fd);
+            rig.fd = -1;
+        }
+    }
+    LOG_DEBUG_STREAM("Job " << jobs_.front().id << " for height " << jobs_.front().block_template->height
+                     << " sent to " << rigs_.size() << " rigs");
+}
+
+bool WorkProxy::send_message(Rig& rig, const Json::Value& message) {
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    return send_line(rig, Json::writeString(writer, message) + "\n");
+}
+
+bool WorkProxy::send_line(Rig& rig, const std::string& line) {
+    if (rig.fd < 0) {
+        return false;
+    }
+    if (rig.write_buffer.size() + line.size() > PROXY_MAX_QUEUED) {
+        LOG_WARNING_STREAM("Rig " << rig.address << " let " << rig.write_buffer.size()
+                           << " bytes of messages pile up, dropping it");
+        return false;
+    }
+    if (rig.write_buffer.empty()) {
+        rig.write_progress = std::chrono::steady_clock::now();
+    }
+    rig.write_buffer += line;
+    return flush(rig);
+}
+
+bool WorkProxy::flush(Rig& rig) {
+    size_t sent = 0;
+    while (sent < rig.write_buffer.size()) {
+        ssize_t n = send(rig.fd, rig.write_buffer.data() + sent, rig.write_buffer.size() - sent,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;  // The rest goes when the socket is writable again
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += (size_t)n;
+    }
+    if (sent > 0) {
+        rig.write_buffer.erase(0, sent);
+        rig.write_progress = std::chrono::steady_clock::now();
+    }
+    return true;
+}
@@ -0,0 +1,148 @@
+#ifndef WORK_PROXY_H
+#define WORK_PROXY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <json/json.h>
+#include "event_loop.h"
+#include "mining_backend.h"
+#include "share_verifier.h"
+
+// Jobs kept for late solutions after the next one is published
+static const size_t PROXY_RECENT_JOBS = 4;
+
+// One rig as the 60-second report shows it
+struct ProxyRigStats {
+    std::string address;
+    uint32_t instance_id;
+    uint64_t shares;           // Pseudo-shares accepted since login
+    uint64_t invalid_shares;   // Shares whose hash the proxy computed differently
+    double effective_hashrate; // What they imply (see set_share_bits), 0 without a share target
+};
+
+// Receives each block a rig solved, serialized and ready for submitblock
+typedef std::function<void(std::shared_ptr<const std::string> block_hex, uint32_t height,
+                           std::string block_hash_hex)> ProxyBlockSink;
+
+// Serves one node's work to many rigs (--proxy): the proxy process alone
+// talks to the node, and rigs run in pool mode against it. It speaks the
+// StratumClient dialect on plain TCP: every published template goes out as
+// a job with the network target to each logged-in rig at once, each rig is
+// assigned its own nonce instance ID at login (so rigs search disjoint
+// ranges), and solutions are checked against the job and rig and handed to
+// the sink as full blocks. With a share target set, rigs mine to it
+// instead and report every pseudo-share, which shows each rig's effective
+// hashrate here without trusting its own count. A ShareVerifier recomputes
+// the hash of every block candidate and of a sample of the pseudo-shares
+// (all of a rig's once one was wrong) before it is counted or forwarded,
+// so a rig that hashes wrong is caught instead of looking healthy.
+class WorkProxy {
+public:
+    explicit WorkProxy(ProxyBlockSink sink);
+    ~WorkProxy();
+
+    WorkProxy(const WorkProxy&) = delete;
+    WorkProxy& operator=(const WorkProxy&) = delete;
+
+    // Listen on host:port (host may be empty or 0.0.0.0 for every interface).
+    // False with error set if the socket can't be bound.
+    bool listen(const std::string& address, std::string& error);
+    // Pseudo-shares: send rigs a target with zero_bits leading zero bits
+    // (when easier than the network's) and count what they submit at it.
+    // Call before start.
+    void set_share_bits(unsigned int zero_bits);
+    // Percentage of pseudo-shares whose hash is recomputed (default 100);
+    // block candidates always are. Call before start.
+    void set_share_verify(unsigned int percent) { share_verify_percent_ = percent; }
+    void start();
+    void stop();
+
+    // Make block_template the job every rig mines, now and from login on
+    void publish(BlockTemplatePtr block_template);
+
+    size_t rig_count() const { return rig_count_.load(); }
+    std::vector<ProxyRigStats> rig_stats() const;
+
+private:
+    struct Rig {
+        int fd;
+        std::string address;
+        std::string read_buffer;
+        std::string write_buffer;     // Lines the socket hasn't taken yet
+        std::chrono::steady_clock::time_point write_progress;  // When the rig last took output, or output began to wait
+        uint32_t instance_id;
+        bool logged_in;
+        uint64_t shares;
+        uint64_t invalid;
+        bool suspect;                 // Sent a wrong hash: every share is checked from then on
+        std::chrono::steady_clock::time_point login_time;
+    };
+    struct Job {
+        std::string id;
+        BlockTemplatePtr block_template;
+        std::vector<uint8_t> target;  // What rigs mine to: the share target or the network's
+        utils::TargetLimbs target_limbs;
+        std::unordered_set<std::string> nonces;  // Submitted so far, to turn away repeats
+    };
+    // A share waiting for its hash to be recomputed
+    struct PendingShare {
+        uint32_t rig;                 // Instance ID
+        Json::Value request_id;
+        BlockTemplatePtr block_template;
+        uint8_t header[BLOCK_HEADER_SIZE];
+        uint8_t hash[32];             // What the rig claimed
+        bool block;                   // Meets the network target
+    };
+
+    ProxyBlockSink sink_;
+    int listen_fd_;
+    EventLoop events_;
+    std::thread thread_;
+    std::atomic<bool> stop_;
+    std::atomic<size_t> rig_count_;
+    uint32_t next_instance_id_;
+    uint64_t next_job_id_;
+    unsigned int share_bits_;
+    std::vector<uint8_t> share_target_;
+    unsigned int share_verify_percent_;
+    ShareVerifier verifier_;
+
+    mutable std::mutex mutex_;
+    BlockTemplatePtr published_;  // Guarded by mutex_; taken by the proxy thread
+    std::vector<ProxyRigStats> stats_;  // Guarded by mutex_; refreshed by the proxy thread
+
+    // Proxy thread only
+    std::vector<Rig> rigs_;
+    std::deque<Job> jobs_;        // Newest first
+    std::unordered_map<uint64_t, PendingShare> pending_;  // By verifier ticket
+    uint64_t next_ticket_;
+    std::mt19937 sample_rng_;
+    std::chrono::steady_clock::time_point busy_warned_;
+
+    void run();
+    void accept_rigs();
+    bool read_rig(Rig& rig);
+    bool handle_lines(Rig& rig);
+    bool handle_request(Rig& rig, const Json::Value& request);
+    Json::Value submit(Rig& rig, const Json::Value& request, bool& queued);
+    void finish_verified();
+    void forward_block(const PendingShare& share, const std::string& rig);
+    void send_jobs();
+    bool send_message(Rig& rig, const Json::Value& message);
+    bool send_line(Rig& rig, const std::string& line);
+    bool flush(Rig& rig);
+    void update_stats();
+};
+
+#endif // WORK_PROXY_H